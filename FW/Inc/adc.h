@@ -2,6 +2,10 @@
  * @file adc.h
  * @brief ADC Driver for Current, Voltage, and Temperature Sensing
  * @version 2.1
+ *
+ * Acquisition (adc.c) is split from conversion (adc_conv.c): the control
+ * ISR reads raw codes, hands them to the recorder and converts them, so a
+ * recorded code stream replays through the identical conversion path.
  */
 
 #ifndef __ADC_H
@@ -14,13 +18,40 @@ extern "C" {
 #include "stm32g4xx_hal.h"
 #include "types.h"
 
+/* Raw channel index (order of AdcRaw_t.code) */
+typedef enum {
+    ADC_RAW_IA = 0,         // ADC1 injected rank 1
+    ADC_RAW_IB,             // ADC1 injected rank 2
+    ADC_RAW_IC,             // ADC1 injected rank 3
+    ADC_RAW_IDC,            // ADC1 injected rank 4
+    ADC_RAW_VA,             // ADC2 injected rank 1
+    ADC_RAW_VB,             // ADC2 injected rank 2
+    ADC_RAW_VC,             // ADC2 injected rank 3
+    ADC_RAW_VDC,            // ADC2 injected rank 4
+    ADC_RAW_VDC_NEG,        // ADC1 regular (DMA)
+    ADC_RAW_NTC_HEATSINK,   // ADC1 regular (DMA)
+    ADC_RAW_NTC_INDUCTOR,   // ADC1 regular (DMA)
+    ADC_RAW_COUNT
+} AdcRawChannel_t;
+
+/* One control-period sample set, 12-bit right aligned */
+typedef struct {
+    uint16_t code[ADC_RAW_COUNT];
+} AdcRaw_t;
+
 /* ADC Initialization */
 void ADC_Init(ADC_HandleTypeDef *hadc1, ADC_HandleTypeDef *hadc2);
 
 /* Start Conversions */
 void ADC_Start(ADC_HandleTypeDef *hadc1, ADC_HandleTypeDef *hadc2);
 
-/* Read Results (called from control ISR) */
+/* Raw Codes of the Current Control Period (driver specific) */
+void ADC_GetRaw(AdcRaw_t *raw);
+
+/* Raw Codes to Engineering Units (portable) */
+void ADC_Convert(const AdcRaw_t *raw, DcMeasurements_t *dc, AcMeasurements_t *ac, Temperatures_t *temps);
+
+/* Read Results (called from control ISR): raw -> recorder -> convert */
 void ADC_ReadResults(DcMeasurements_t *dc, AcMeasurements_t *ac, Temperatures_t *temps);
 
 /* Calibration */
@@ -34,4 +65,3 @@ float32_t ADC_ConvertNtcToTemp(uint16_t adc_value);
 #endif
 
 #endif /* __ADC_H */
-
@@ -2,6 +2,35 @@
  * @file can_bms.h
  * @brief CAN-FD BMS Communication Handler
  * @version 2.1
+ *
+ * The FDCAN driver (can_bms.c) accepts only the BMS identifiers in
+ * hardware (one mask filter on BMS_NODE_ID..+0x0F, everything else
+ * rejected before RX FIFO 0) and empties the FIFO from its interrupt into
+ * a lock-free single-producer, single-consumer mailbox, each frame
+ * stamped with the HAL tick of its reception. The main loop drains the
+ * mailbox and decodes the frames (can_bms_frames.c, hardware
+ * independent), so a burst of cell frames between two passes is not
+ * lost in the three-element hardware FIFO.
+ *
+ * Frames from the BMS (standard ids, little endian, BRS at 2 Mbit/s):
+ *   +0x00 pack    voltage u16 0.1 V, current i16 0.1 A (+ = discharge),
+ *                 SOC u16 0.01 %, SOH u16 0.01 %, status u32      (14 B)
+ *   +0x01 limits  charge u16 0.1 A, discharge u16 0.1 A            (4 B)
+ *   +0x02 cells   block u8, reserved u8, up to BMS_CELLS_PER_FRAME
+ *                 × u16 mV for cells block·31 on                 (64 B)
+ *   +0x03 temps   block u8, reserved u8, up to BMS_TEMPS_PER_FRAME
+ *                 × i8 °C for sensors block·62 on                (64 B)
+ * Longer frames (DLC padding) are accepted; 0xFFFF / -128 mark a cell or
+ * sensor without a reading.
+ *
+ * Inverter to BMS, every BMS_HEARTBEAT_MS:
+ *   +0x10 status  state u8, counter u8, faults u32, Vdc u16 0.1 V   (8 B)
+ *
+ * Freshness follows the RX timestamps, not the decode time: a group is
+ * stale when its oldest frame (the oldest block for cells) is older than
+ * BMS_FRESH_MS / BMS_CELL_FRESH_MS, and the limits it feeds drop to zero.
+ * Protection trips FAULT_BMS_TIMEOUT when any group is older than
+ * BMS_TIMEOUT_MS (CAN_BMS_Age).
  */
 
 #ifndef __CAN_BMS_H
@@ -13,11 +42,50 @@ extern "C" {
 
 #include "stm32g4xx_hal.h"
 #include "types.h"
+#include "config.h"
 
+/* Identifiers */
+#define BMS_ID_PACK             (BMS_NODE_ID + 0x00U)
+#define BMS_ID_LIMITS           (BMS_NODE_ID + 0x01U)
+#define BMS_ID_CELLS            (BMS_NODE_ID + 0x02U)
+#define BMS_ID_TEMPS            (BMS_NODE_ID + 0x03U)
+#define BMS_ID_HEARTBEAT        (BMS_NODE_ID + 0x10U)
+#define BMS_ID_FILTER_MASK      0x7F0U      // Standard id bits compared with BMS_NODE_ID
+
+/* Payload sizes */
+#define BMS_FRAME_MAX           64U         // CAN-FD data field
+#define BMS_PACK_LEN            14U
+#define BMS_LIMITS_LEN          4U
+#define BMS_BLOCK_HEADER        2U          // Block index, reserved
+#define BMS_CELL_NONE           0xFFFFU
+#define BMS_TEMP_NONE           (-128)
+
+/* Received frame (mailbox element) */
+typedef struct {
+    uint32_t id;                // Standard identifier
+    uint32_t stamp_ms;          // HAL tick at reception
+    uint8_t len;                // Data bytes (0..64)
+    uint8_t data[BMS_FRAME_MAX];
+} BmsFrame_t;
+
+/* Lock-free SPSC mailbox: the RX interrupt writes head, the main loop
+ * tail; both only ever increase */
+typedef struct {
+    BmsFrame_t slot[BMS_MAILBOX_DEPTH];
+    volatile uint32_t head;
+    volatile uint32_t tail;
+    volatile uint32_t dropped;  // Mailbox full (producer)
+    volatile uint32_t lost;     // Hardware FIFO overrun (producer)
+} BmsMailbox_t;
+
+/* ============================================================================
+ * DRIVER (can_bms.c on target, sim_hal.c on the host)
+ * ========================================================================== */
 /* CAN Initialization */
 void CAN_BMS_Init(FDCAN_HandleTypeDef *hfdcan);
 
-/* Process BMS Messages (called from main loop) */
+/* Drain and decode received frames, update limits and freshness, send
+ * the heartbeat when due (called from main loop) */
 void CAN_BMS_Process(void);
 
 /* Get BMS Data */
@@ -26,9 +94,33 @@ BmsData_t* CAN_BMS_GetData(void);
 /* Send Commands to BMS */
 void CAN_BMS_SendHeartbeat(void);
 
+/* ============================================================================
+ * FRAME ENGINE (can_bms_frames.c, hardware independent)
+ * ========================================================================== */
+/* Reset data, timestamps and statistics; no group has been seen */
+void CAN_BMS_Reset(BmsData_t *bms);
+
+/* Producer side (RX interrupt): copy a frame in, false when full */
+bool CAN_BMS_Push(BmsMailbox_t *mb, const BmsFrame_t *frame);
+
+/* Consumer side (main loop): take the oldest frame, false when empty */
+bool CAN_BMS_Pop(BmsMailbox_t *mb, BmsFrame_t *frame);
+
+/* Decode one frame into bms; returns the group it updated or
+ * BMS_GRP_COUNT for a frame that was rejected */
+BmsGroup_t CAN_BMS_Decode(BmsData_t *bms, const BmsFrame_t *frame);
+
+/* Freshness, cell extremes and effective limits at now_ms */
+void CAN_BMS_Refresh(BmsData_t *bms, uint32_t now_ms);
+
+/* Drain the mailbox into bms and refresh; returns the frames decoded */
+uint32_t CAN_BMS_Drain(BmsMailbox_t *mb, BmsData_t *bms, uint32_t now_ms);
+
+/* Age of the oldest group [ms] (since boot for a group never received) */
+uint32_t CAN_BMS_Age(const BmsData_t *bms, uint32_t now_ms);
+
 #ifdef __cplusplus
 }
 #endif
 
 #endif /* __CAN_BMS_H */
-
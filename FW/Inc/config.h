@@ -44,8 +44,47 @@ extern "C" {
 
 /* HRTIM Counter Period for 100 kHz */
 #define HRTIM_PERIOD            (HRTIM_FREQ_HZ / PWM_FREQUENCY_HZ)  // 1700
-#define HRTIM_DEAD_TIME_RISING  ((PWM_DEAD_TIME_NS * HRTIM_FREQ_HZ) / 1000000000)
-#define HRTIM_DEAD_TIME_FALLING ((PWM_DEAD_TIME_NS * HRTIM_FREQ_HZ) / 1000000000)
+#define HRTIM_DEAD_TIME_RISING  ((PWM_DEAD_TIME_NS * (HRTIM_FREQ_HZ / 1000000)) / 1000)
+#define HRTIM_DEAD_TIME_FALLING ((PWM_DEAD_TIME_NS * (HRTIM_FREQ_HZ / 1000000)) / 1000)
+
+/* Dead-Time Scheduling and Compensation */
+#define DEADTIME_MIN_NS         65.0f       // Gate driver t_off + margin - t_on
+#define DEADTIME_MAX_NS         150.0f      // Upper bound (distortion limit)
+#define DEADTIME_QOSS_NC        600.0f      // Qoss of 2 paralleled devices [nC]
+#define DEADTIME_TEMP_COEFF_NS  0.1f        // Turn-off delay increase [ns/°C]
+#define DEADTIME_I_FLOOR_A      5.0f        // Current floor for Qoss term
+#define DEADTIME_COMP_BAND_A    4.0f        // Zero-crossing band of compensator
+#ifndef DEADTIME_COMP_ENABLE
+#define DEADTIME_COMP_ENABLE    1           // Polarity compensation of the duties
+#endif
+
+/* Compare update at crest and valley (1) or once per period (0) */
+#ifndef HRTIM_DOUBLE_UPDATE
+#define HRTIM_DOUBLE_UPDATE     1
+#endif
+
+/* Switching Frequency Scheduling (main loop, every 10 ms)
+ * Below FSW_LOAD_PU of rated current the carrier period is lengthened to
+ * a level of FSW_PERIODS: switching losses fall with f_sw, conduction
+ * losses do not. The control ISR runs at every crest and valley, so Ts
+ * follows the period. A level is used only while the worst-case converter
+ * ripple Vdc / (8·Lc·f_sw) stays below FSW_RIPPLE_MAX_A; the current limit
+ * is lowered by the extra half ripple so the peak current never exceeds
+ * its value at PWM_FREQUENCY_HZ. A predicted junction temperature within
+ * FSW_TJ_MARGIN_C of THERMAL_TJ_LIMIT_C moves one level further down.
+ * Periods are multiples of HRTIM_PERIOD / 2 (whole up-down half periods).
+ * Not available with FCS-MPC (fixed sampling rate). */
+#ifndef FSW_SCHEDULE_ENABLE
+#define FSW_SCHEDULE_ENABLE     1           // 0 = fixed PWM_FREQUENCY_HZ
+#endif
+#define FSW_LEVELS              3
+#define FSW_PERIODS             { HRTIM_PERIOD, HRTIM_PERIOD * 3 / 2, HRTIM_PERIOD * 2 }  // 100, 66.7, 50 kHz
+#define FSW_LOAD_PU             { 1.0f, 0.50f, 0.25f }     // Highest load of each level [pu of peak]
+#define FSW_LOAD_HYST_PU        0.05f       // Extra load before leaving a level upwards
+#define FSW_RIPPLE_MAX_A        45.0f       // Converter ripple limit, peak to peak
+#define FSW_TJ_MARGIN_C         10.0f       // One level lower when the prediction is this close
+#define FSW_DEMAND_TAU_S        0.5f        // Decay of the current demand (rise is immediate)
+#define FSW_HOLD_MS             200         // Minimum time at a level before going down
 
 /* ============================================================================
  * DC BUS CONFIGURATION
@@ -90,24 +129,212 @@ extern "C" {
 #define TEMP_AMBIENT_DERATING_C 45.0f       // Start derating
 #define TEMP_AMBIENT_MAX_C      60.0f       // Max ambient
 
+/* Junction Temperature Estimator (thermal.c). Conduction, switching and
+ * dead-time losses per switch position, sampled every THERMAL_LOSS_DECIM
+ * periods; a Foster network from the heatsink NTC to each junction runs
+ * with the slow protection checks and predicts Tj THERMAL_PREDICT_S ahead.
+ * Device data: 2 × IMT65R010M2H in parallel per T1/T4 position, 2S2P in
+ * the T2/T3 neutral path. */
+#ifndef THERMAL_PREDICT_ENABLE
+#define THERMAL_PREDICT_ENABLE  1           // 0 = derate on the present Tj estimate only
+#endif
+#define THERMAL_LOSS_DECIM      20          // Loss sample every 20 ISRs (10 kHz)
+#define THERMAL_RDS_OUTER_OHM   0.005f      // T1/T4 position RDS(on) at 25 °C
+#define THERMAL_RDS_INNER_OHM   0.010f      // T2 + T3 path RDS(on) at 25 °C
+#define THERMAL_RDS_TC          0.0055f     // RDS(on) increase [1/K]
+#define THERMAL_ESW_J_PER_AV    3.2e-8f     // Eon + Eoff per position [J/(A·V)]
+#define THERMAL_VF_BODY_V       4.0f        // Body diode drop during dead-time [V]
+#define THERMAL_PREDICT_S       5.0f        // Prediction horizon [s]
+#define THERMAL_TJ_LIMIT_C      TEMP_MOSFET_WARNING_C  // Predicted Tj kept below the linear derating
+#define THERMAL_LOSS_TAU_S      0.05f       // Loss filter for the prediction (~3 cycles)
+#define THERMAL_DERATE_TAU_S    0.5f        // Predictive derating integration time
+#define THERMAL_RECOVERY_PER_S  0.1f        // Maximum derating recovery rate [1/s]
+
 /* ============================================================================
  * CONTROL LOOP PARAMETERS
  * ========================================================================== */
-/* Current Loop (PR Controller) */
-#define CURRENT_KP              0.5f        // Proportional gain
-#define CURRENT_KR              50.0f       // Resonant gain
+/* Tuned gains: config_tuned.h is generated by the host autotuner (fwtune,
+ * see Sim/README.md) and overrides the hand-set defaults below */
+#ifndef CONTROL_TUNED_GAINS
+#define CONTROL_TUNED_GAINS     0           // 1 = include config_tuned.h
+#endif
+#if CONTROL_TUNED_GAINS
+#include "config_tuned.h"
+#endif
+
+/* LCL Active Damping (virtual resistor across Cf)
+ * Only the converter current and the capacitor (PCC) voltage are sensed, so
+ * the capacitor current is estimated as Cf·dv/dt of the PCC voltage in the
+ * current-loop frame (the fundamental drops out) and fed back to the
+ * converter voltage: K·i_Cf acts as Rv = Lc/(K·Cf) across Cf, damping the
+ * resonance by ζ ≈ K/(2·Lc·ω_res). ω_res falls with the grid inductance
+ * (10.6 kHz stiff, 5.9 kHz at 250 µH), so ζ rises on weak grids. The
+ * filter trades phase at resonance for noise; with it the PR loop stays
+ * stable to CURRENT_KP ≈ 7 from 20 µH to 1.5 mH (≈ 4 undamped) and the
+ * default gain holds on a 3 mH grid. */
+#ifndef LCL_ACTIVE_DAMPING
+#define LCL_ACTIVE_DAMPING      1           // 1 = capacitor current feedback
+#endif
+#ifndef LCL_AD_GAIN
+#define LCL_AD_GAIN             1.5f        // K [V/A] (Rv ≈ 2.7 Ω)
+#endif
+#define LCL_AD_LPF_HZ           8000.0f     // Capacitor current estimate filter
+
+/* Current Loop (PR Controller)
+ * Tuned to the delay of the double update (7.5 µs measured, fwsim --fra):
+ * 46° phase margin at the 17 kHz crossover on a 250 µH grid, as Kp = 4
+ * had at 13 kHz with the 10 µs of single update. Kr keeps its ratio. */
+#ifndef CURRENT_KP
+#if LCL_ACTIVE_DAMPING
+#define CURRENT_KP              5.5f        // Proportional gain [V/A] (≈ Lc·2π·14.6 kHz)
+#else
+#define CURRENT_KP              0.5f        // Proportional gain [V/A]
+#endif
+#endif
+#ifndef CURRENT_KR
+#define CURRENT_KR              68.75f      // Resonant gain (12.5 × CURRENT_KP)
+#endif
+#ifndef CURRENT_OMEGA_C
+#define CURRENT_OMEGA_C         10.0f       // Resonant term bandwidth [rad/s]
+#endif
 #define CURRENT_OMEGA0          (2.0f * 3.14159f * GRID_FREQ_NOMINAL_HZ)
-#define CURRENT_BANDWIDTH_HZ    2000.0f     // Current loop bandwidth
+#define CURRENT_BANDWIDTH_HZ    (CURRENT_KP / (6.2831853f * LC_INDUCTANCE_H))  // Kp/(2π·Lc)
+
+/* Computational Delay Compensation
+ * Sample to the centre of the pulse it sets, in control periods: 1 sample
+ * compute + 0.5 ZOH with double update; single update transfers the crest
+ * ISR's values at the valley and holds them a whole PWM period (1 + 1).
+ * fwsim measures 7.5 and 10 µs at 100 kHz. */
+#if HRTIM_DOUBLE_UPDATE
+#define CONTROL_DELAY_SAMPLES   1.5f
+#else
+#define CONTROL_DELAY_SAMPLES   2.0f
+#endif
+#ifndef CURRENT_DELAY_OBSERVER
+#define CURRENT_DELAY_OBSERVER  0           // 1 = Smith predictor on current
+#endif
 
-/* Voltage Loop (PI Controller) */
-#define VOLTAGE_KP              0.1f        // Proportional gain
-#define VOLTAGE_KI              10.0f       // Integral gain
+/* DC-Link Voltage Loop (PI Controller, outer loop of the current loop)
+ * Runs every VOLTAGE_LOOP_DECIM control periods on the averaged Vdc when
+ * the Modbus control word selects DC voltage control. With the battery on
+ * the link the plant is its resistance seen through the bridge
+ * (~1.5·Vd/Vdc · R_bat ≈ 0.03 V/A), so the gains are in A per V. */
+#ifndef VOLTAGE_KP
+#define VOLTAGE_KP              1.0f        // Proportional gain [A/V]
+#endif
+#ifndef VOLTAGE_KI
+#define VOLTAGE_KI              2000.0f     // Integral gain [A/(V·s)]
+#endif
 #define VOLTAGE_BANDWIDTH_HZ    200.0f      // Voltage loop bandwidth
+#define VOLTAGE_LOOP_DECIM      20          // Outer loop every 20 ISRs (10 kHz)
+#ifndef VOLTAGE_FF_ENABLE
+#define VOLTAGE_FF_ENABLE       1           // DC load power feed-forward
+#endif
+#ifndef VOLTAGE_FF_LPF_HZ
+#define VOLTAGE_FF_LPF_HZ       300.0f      // Load power estimate filter
+#endif
+
+/* Reference Trajectory (P_cmd/Q_cmd → P_ref/Q_ref, every VOLTAGE_LOOP_DECIM
+ * periods). P and Q move at most full scale per REF_RAMP_TIME_MS and reach
+ * that rate over REF_JERK_TIME_MS, so a stop from rest at P takes exactly
+ * |P|/rate + REF_JERK_TIME_MS. The first ramp after RUN entry runs at the
+ * SOFT_START_TIME_MS rate. A change of power direction brings P to rest at
+ * zero for REF_REVERSAL_DWELL_MS before it continues. */
+#ifndef REF_TRAJECTORY_ENABLE
+#define REF_TRAJECTORY_ENABLE   1           // 0 = P/Q references step to the commands
+#endif
+#define REF_RAMP_TIME_MS        200         // Full-scale P/Q ramp (running, stopping)
+#define REF_JERK_TIME_MS        20          // Time to reach the ramp rate from rest
+#define REF_REVERSAL_DWELL_MS   10          // Rest at P = 0 on inverter <-> rectifier
+#define REF_STOP_TIME_MS        (REF_RAMP_TIME_MS + REF_JERK_TIME_MS)  // Full-scale stop
+#define REF_VD_LPF_HZ           20.0f       // Vd filter for Id/Iq = P/Q / (1.5·Vd): dividing
+                                            // by the instantaneous Vd makes the power
+                                            // reference a negative resistance at the PCC
+
+/* Current Limits (Control_CurrentLimits, every main-loop pass): the BMS
+ * limits tapered at the SOC ends, slewed while switching, converted to a
+ * d-axis window against the filtered Vd and a current circle of radius
+ * fsw.I_limit. The control ISR clamps Id to the window and, on the circle,
+ * keeps P (default) or Q (control word bit 3) */
+#define ILIM_SOC_CHG_TAPER      95.0f       // Charge taper start, none at 100 % [%]
+#define ILIM_SOC_DIS_TAPER      10.0f       // Discharge taper start [%]
+#define ILIM_SOC_MIN            5.0f        // No discharge at or below [%]
+#define ILIM_FALL_A_PER_S       1500.0f     // Battery limit decrease while switching [A/s]
+#define ILIM_RISE_A_PER_S       750.0f      // Battery limit increase (~ the P ramp) [A/s]
+#define ILIM_VD_MIN_PU          0.5f        // Vd floor of the power → Id conversion
 
 /* PLL Parameters */
+#ifndef PLL_KP
 #define PLL_KP                  100.0f      // PLL proportional gain
+#endif
+#ifndef PLL_KI
 #define PLL_KI                  5000.0f     // PLL integral gain
+#endif
 #define PLL_BANDWIDTH_HZ        50.0f       // PLL bandwidth
+#define PLL_LOCK_VD_MIN_V       40.0f       // No lock on a dead bus (~0.1 pu)
+
+/* Grid-Forming Control (mode_select OFF_GRID, DROOP, VF_CONTROL)
+ * Virtual synchronous machine: swing equation with inertia GFM_INERTIA_H
+ * and damping set by the P-f droop (the same as a droop behind a power
+ * filter of 2·H·m_p = 10 ms), Q-V droop, virtual impedance, and a PCC
+ * voltage PI that sets the current references of the PR loop. Grid-tied,
+ * the voltage PI integral and the network reactance form a dq mode damped
+ * only by R/X, hence the virtual resistance. */
+#define GFM_DROOP_P             0.01f       // P-f droop: Δf/f_nom at rated P (0.6 Hz)
+#define GFM_DROOP_Q             0.05f       // Q-V droop: ΔV/V_nom at rated Q
+#define GFM_INERTIA_H           0.5f        // Virtual inertia constant [s]
+#define GFM_POWER_LPF_HZ        10.0f       // P/Q measurement filter (Q droop)
+#define GFM_VIRTUAL_R_OHM       0.05f       // Virtual resistance (2.6 % of Zbase)
+#define GFM_VIRTUAL_L_H         250e-6f     // Virtual inductance (5 % of Zbase)
+#define GFM_VOLTAGE_KP          0.2f        // PCC voltage PI [A/V]
+#define GFM_VOLTAGE_KI          1000.0f     // [A/(V·s)]
+#define GFM_PLIM_GAIN           10.0f       // Droop steepening outside the BMS power window
+#define GFM_DEAD_BUS_V          50.0f       // Dead bus below this L-L magnitude [V]
+#define GFM_DEAD_BUS_MS         200         // Dead bus confirmation before black start
+#define GFM_VOLTAGE_RAMP_MS     100         // Black-start voltage ramp
+
+/* Current Controller Selection (build time) */
+#ifndef CURRENT_CTRL_FCS_MPC
+#define CURRENT_CTRL_FCS_MPC    0           // 1 = FCS-MPC, 0 = PR + SVPWM
+#endif
+
+/* Finite-Control-Set MPC (27-state T-Type) */
+#define MPC_LAMBDA_NP           0.5f        // NP balance weight [A²/V²]
+#define MPC_LAMBDA_SW           4.0f        // Switching weight [A² per transition]
+#define MPC_IG_FILTER_HZ        1000.0f     // Grid-current estimate LPF cutoff
+#define MPC_AD_R_OHM            4.0f        // Virtual resistor across Cf (≈ √(Lg/Cf) at 250 µH)
+#define MPC_AD_LPF_HZ           200.0f      // PCC voltage share left undamped
+
+/* Grid Impedance Estimation and Gain Scheduling (grid-following PR loop)
+ * Every GRIDZ_PERIOD_MS at steady state the ISR adds a GRIDZ_INJ_A sine at
+ * GRIDZ_INJ_HZ to the d-axis current error for GRIDZ_CYCLES periods
+ * (interharmonics at f1 ± GRIDZ_INJ_HZ, a whole number of 120/360 Hz dq
+ * ripple periods). Correlating the d-axis PCC voltage and the dq currents
+ * at that frequency gives R and L behind the PCC from
+ *   ΔVd = R·ΔId + L·(jω_i·ΔId - ω·ΔIq)
+ * (the q axis carries the PLL response and is not used). Lg is subtracted
+ * and SCR = V_ll² / (|R + jω·L_grid| · SYSTEM_POWER_RATING). The SCR
+ * selects a band of GAIN_BAND_SCR with GRIDZ_SCR_HYST; the band factors
+ * scale the nominal PR and PLL gains, which reach the ISR through a
+ * double-buffered bank swapped by one byte write. Weak grids get a slower
+ * PLL (its coupling through the grid impedance destabilises it), stiff
+ * grids a faster current loop. */
+#ifndef GRIDZ_ENABLE
+#define GRIDZ_ENABLE            (!CURRENT_CTRL_FCS_MPC)  // 0 = fixed gains
+#endif
+#define GRIDZ_INJ_HZ            170.0f      // Injection frequency in the dq frame
+#define GRIDZ_INJ_A             4.0f        // Injection amplitude (2.5 % of rated)
+#define GRIDZ_CYCLES            17          // Window length (100 ms)
+#define GRIDZ_START_MS          300         // Steady state before the first window
+#define GRIDZ_PERIOD_MS         5000        // Between windows
+#define GRIDZ_FILTER            0.5f        // Weight of a new estimate
+#define GRIDZ_JUMP              0.5f        // Relative change of Lg + L_grid taken at once
+#define GRIDZ_SCR_HYST          0.15f       // Band hysteresis, ratio of the SCR limit
+#define GAIN_BANDS              3           // Weak, nominal, stiff
+#define GAIN_BAND_SCR           { 3.0f, 10.0f }            // Upper SCR of the weak and nominal bands
+#define GAIN_BAND_CURRENT_KP    { 1.0f, 1.0f, 1.3f }       // Factors on CURRENT_KP (stiff: 34° PM)
+#define GAIN_BAND_PLL_KP        { 0.5f, 1.0f, 1.0f }       // Factors on PLL_KP
+#define GAIN_BAND_PLL_KI        { 0.25f, 1.0f, 1.0f }      // Factors on PLL_KI
 
 /* ============================================================================
  * ADC CONFIGURATION
@@ -116,27 +343,58 @@ extern "C" {
 #define ADC_MAX_VALUE           4095
 #define ADC_VREF                3.3f        // ADC reference voltage
 
-/* Current Sensing Scaling */
+/* Current Sensing Scaling (bidirectional, REF pin at Vref/2) */
 #define SHUNT_RESISTANCE_OHM    0.0001f     // 100 µΩ shunt
-#define SHUNT_AMP_GAIN          200.0f      // INA240A4 gain
+#define SHUNT_AMP_GAIN          50.0f       // INA240A2 gain (±330 A span)
+#define SHUNT_OFFSET_V          1.65f       // Zero current output
 #define IDC_SCALE               (ADC_VREF / ADC_MAX_VALUE / SHUNT_AMP_GAIN / SHUNT_RESISTANCE_OHM)
 
-/* Hall Effect Sensor (LEM HLSR 50-P) */
-#define HALL_NOMINAL_CURRENT    50.0f       // Nominal primary current
-#define HALL_SENSITIVITY        0.0264f     // V/A at 3.3V supply
+/* Hall Effect Sensor (LEM HLSR 200-P, ±528 A span at 3.3 V) */
+#define HALL_NOMINAL_CURRENT    200.0f      // Nominal primary current
+#define HALL_SENSITIVITY        0.003125f   // V/A (0.625 V at IPN)
 #define HALL_OFFSET_V           1.65f       // Zero current offset (Vref/2)
-#define IAC_SCALE               ((ADC_VREF / ADC_MAX_VALUE - HALL_OFFSET_V) / HALL_SENSITIVITY)
+#define IAC_SCALE               (ADC_VREF / ADC_MAX_VALUE / HALL_SENSITIVITY)
 
 /* Voltage Sensing Scaling */
-#define VDC_DIVIDER_RATIO       301.0f      // DC bus voltage divider
+#define VDC_DIVIDER_RATIO       350.0f      // DC voltage divider (1155 V full scale)
 #define VDC_SCALE               (ADC_VREF / ADC_MAX_VALUE * VDC_DIVIDER_RATIO)
-#define VAC_DIVIDER_RATIO       200.0f      // AC voltage divider
+#define VAC_DIVIDER_RATIO       400.0f      // AC voltage divider (±660 V span)
+#define VAC_OFFSET_V            1.65f       // Zero voltage offset (Vref/2)
 #define VAC_SCALE               (ADC_VREF / ADC_MAX_VALUE * VAC_DIVIDER_RATIO)
 
-/* Temperature Sensing (NTC 10k B3950) */
+/* Temperature Sensing (NTC 10k B3950 to GND, series R to Vref) */
 #define NTC_R25                 10000.0f    // Resistance at 25°C
 #define NTC_BETA                3950.0f     // Beta value
 #define NTC_SERIES_R            10000.0f    // Series resistor
+#define NTC_TABLE_T_MIN_C       -40.0f      // First lookup table entry
+#define NTC_TABLE_STEP_C        5.0f        // Lookup table spacing
+
+/* ============================================================================
+ * ISR INPUT RECORDER
+ * ========================================================================== */
+#ifndef RECORDER_ENABLE
+#define RECORDER_ENABLE         0           // Record ADC codes/commands/duties (field debug builds)
+#endif
+#ifndef REC_BLOCK_SIZE
+#define REC_BLOCK_SIZE          4096        // Bytes per block (keyframe each, from the main loop)
+#endif
+#ifndef REC_BLOCK_COUNT
+#define REC_BLOCK_COUNT         8           // Ring depth (~7 ms at 200 kHz)
+#endif
+#define REC_POST_TRIGGER_BLOCKS 2           // Blocks kept after a fault
+
+/* ============================================================================
+ * BINARY TELEMETRY STREAM (own UART, USART1 TX; never on the Modbus bus)
+ * ========================================================================== */
+#ifndef TELEMETRY_ENABLE
+#define TELEMETRY_ENABLE        1           // ISR sampling + frames on the telemetry UART
+#endif
+#define TELEMETRY_RATE_MAX_HZ   20000       // Highest sample rate (40009)
+#define TELEMETRY_RING_WORDS    2048        // ISR -> main loop ring (32-bit words)
+#define TELEMETRY_FRAME_MAX     1024        // Encoded frame incl. delimiters [bytes]
+#define TELEMETRY_LINK_MS       10          // Line time per 10 ms tick for frames [ms]
+#define TELEMETRY_BAUDRATE      921600      // 8N1, point to point to the host
+#define TELEMETRY_IRQ_PRIORITY  6           // UART + DMA, below Modbus (5)
 
 /* ============================================================================
  * FILTER PARAMETERS
@@ -152,14 +410,29 @@ extern "C" {
 /* RS485 / Modbus RTU */
 #define MODBUS_SLAVE_ADDRESS    1
 #define MODBUS_BAUDRATE         115200
-#define MODBUS_PARITY           0           // None
+#define MODBUS_PARITY           0           // 0 none, 1 odd, 2 even
 #define MODBUS_STOPBITS         1
+#define MODBUS_IRQ_PRIORITY     5           // UART + DMA, below the control ISR (0)
 
 /* CAN-FD (BMS Interface) */
 #define CAN_BAUDRATE            500000      // 500 kbps nominal
 #define CAN_FD_BAUDRATE         2000000     // 2 Mbps data phase
-#define BMS_NODE_ID             0x100       // BMS CAN ID base
+#define CAN_IRQ_PRIORITY        4           // FDCAN1 RX FIFO 0, below the control ISR (0)
+#define BMS_NODE_ID             0x100       // BMS CAN ID base (accepted: +0x00..+0x0F)
 #define BMS_TIMEOUT_MS          5000        // BMS communication timeout
+#define BMS_FRESH_MS            500         // Pack / limit data older than this is stale
+#define BMS_CELL_FRESH_MS       1000        // Cell data older than this is stale
+#define BMS_HEARTBEAT_MS        100         // Inverter status frame to the BMS
+#define BMS_MAILBOX_DEPTH       32          // RX frames between main-loop passes (power of 2)
+
+/* Cell-level current limits: linear taper to zero, stale data limits to 0 */
+#define BMS_CELL_V_MAX          4.15f       // No charge at or above [V]
+#define BMS_CELL_V_CHG_TAPER    4.10f       // Charge taper start [V]
+#define BMS_CELL_V_MIN          3.00f       // No discharge at or below [V]
+#define BMS_CELL_V_DIS_TAPER    3.10f       // Discharge taper start [V]
+#define BMS_CELL_T_MAX          55.0f       // No current at or above [°C]
+#define BMS_CELL_T_TAPER        45.0f       // Temperature taper start [°C]
+#define BMS_CELL_T_CHG_MIN      0.0f        // No charge below [°C]
 
 /* ============================================================================
  * PROTECTION TIMING
@@ -169,16 +442,119 @@ extern "C" {
 #define FAULT_OC_RESPONSE_US    1000        // AC over-current response
 #define FAULT_SC_RESPONSE_US    10          // Short circuit response
 #define FAULT_OT_RESPONSE_MS    10          // Over-temperature response
-#define ANTI_ISLAND_TIME_MS     2000        // Anti-islanding detection time
+#define ANTI_ISLAND_TIME_MS     2000        // PLL unlocked while connected (passive backstop)
+
+/* Hardware Fault Inputs (HRTIM FLT1..FLT6, hrtim.c)
+ * Each one takes all twelve gate outputs to their inactive level in the
+ * HRTIM itself, with no software in the path:
+ *   FLT1    DESAT, wired-OR /FLT of the gate drivers
+ *   FLT2    Gate-driver supply /RDY (UVLO)
+ *   FLT3    E-stop loop (also polled on DI_ESTOP)
+ *   FLT4-6  COMP1/3/5: phase A/B/C current above IAC_HW_TRIP_A
+ * The comparators see the Hall outputs against a DAC threshold, positive
+ * direction only: the phase currents sum to zero, so a negative fault
+ * current shows up in another phase at half its size or more, and the
+ * ISR short-circuit check (IAC_SC_TRIP_A) covers the rest. The fault
+ * interrupt then classifies and logs the trip (Protection_HardwareFault). */
+#ifndef HW_FAULT_ENABLE
+#define HW_FAULT_ENABLE         1           // 0 = ISR checks only
+#endif
+#define IAC_HW_TRIP_A           280.0f      // Comparator threshold (between OC and SC)
+#define HWFLT_FILTER            3           // FLTxF: 8 consecutive samples at fHRTIM
+#define HWFLT_DELAY_NS          60          // Input to outputs off (filter + resync)
+#define HWFLT_IRQ_PRIORITY      1           // Fault interrupt, below the control ISR (0)
+
+/* Active Anti-Islanding (Sandia frequency shift, grid-following only)
+ * The current reference is turned ahead of the PLL frame by
+ *   φ = 90° · (AI_SFS_CF0 + AI_SFS_K · Δf),  |φ| ≤ AI_SFS_PHI_MAX_DEG
+ * which on the grid is a small reactive current. In an island the PCC
+ * voltage takes the phase of the load; a parallel RLC load of quality
+ * factor Qf turns by ≈ 2·Qf/f0 rad per Hz, so with a steeper φ(f) no
+ * frequency is an equilibrium and the island runs away (above resonance
+ * the load is capacitive, current leading). AI_SFS_K covers Qf up to ~3.
+ * Frequency deviation and ROCOF are filtered at the PLL rate; a trip needs
+ * a drift away from nominal with ROCOF above the IEEE 1547-2018 ride-through
+ * (3 Hz/s) for AI_ROCOF_MS, or the frequency outside the OF2/UF2 defaults
+ * for AI_WINDOW_MS. A phase jump (grid fault, or an island with a load
+ * mismatch) makes the PLL swing: the SFS phase and the ROCOF timer are
+ * held over that transient for AI_JUMP_HOLD_MS. */
+#ifndef ANTI_ISLAND_ACTIVE
+#define ANTI_ISLAND_ACTIVE      1           // 0 = passive backstop only
+#endif
+#define AI_SFS_CF0              0.005f      // Chopping fraction at nominal frequency
+#define AI_SFS_K                0.07f       // Chopping fraction per Hz of deviation
+#define AI_SFS_PHI_MAX_DEG      20.0f       // Phase lead limit
+#define AI_FREQ_LPF_HZ          20.0f       // Frequency deviation filter
+#define AI_ROCOF_LPF_HZ         10.0f       // ROCOF filter
+#define AI_FREQ_DEV_HZ          0.3f        // Drift that qualifies the ROCOF
+#define AI_ROCOF_HZ_S           4.0f        // ROCOF trip threshold
+#define AI_ROCOF_MS             60          // ROCOF persistence
+#define AI_FREQ_LOW_HZ          56.5f       // Frequency window (OF2/UF2)
+#define AI_FREQ_HIGH_HZ         62.0f
+#define AI_WINDOW_MS            160         // Window persistence
+#define AI_PHASE_JUMP_DEG       10.0f       // PLL phase error taken as a jump
+#define AI_JUMP_HOLD_MS         60          // SFS phase and ROCOF timer held after a jump
 
 /* ============================================================================
  * STATE MACHINE TIMING
  * ========================================================================== */
 #define PRECHARGE_TIME_MS       2000        // Pre-charge duration
-#define SOFT_START_TIME_MS      1000        // Soft start ramp time
+#define PRECHARGE_DV_MAX_V      5.0f        // Max Vbat - Vdc at main contactor close
+#define SOFT_START_TIME_MS      1000        // Full-scale P/Q ramp after RUN entry
 #define GRID_SYNC_TIMEOUT_MS    5000        // Grid synchronization timeout
 #define FAULT_RETRY_DELAY_MS    30000       // Delay before fault retry
 
+/* ============================================================================
+ * ISR DEADLINE SUPERVISION (deadline.c)
+ * The control ISR has half a carrier period (850 cycles at 100 kHz) from
+ * the repetition event. Its entry delay (master counter at entry: masked
+ * sections, tail-chained handlers) plus its execution is the load; an ISR
+ * still running at the next event is an overrun. Each main-loop tick sheds
+ * the next optional stage after DEADLINE_SHED_MS of load above
+ * DEADLINE_LOAD_SHED, overruns or a late tick, and restores the last one
+ * after DEADLINE_RESTORE_MS below DEADLINE_LOAD_RESTORE. Only overruns
+ * with every stage shed, for DEADLINE_TRIP_MS, trip FAULT_WATCHDOG. The
+ * IWDG is refreshed by the main loop alone: a starved loop resets the MCU,
+ * which takes the gate outputs to their reset (off) state.
+ * ========================================================================== */
+#define DEADLINE_SHED_ORDER     { SHED_RECORDER, SHED_TELEMETRY, SHED_GRIDZ }  // First shed first
+#define DEADLINE_LOAD_SHED      0.85f       // Worst period of a tick [pu of the budget]
+#define DEADLINE_LOAD_RESTORE   0.70f
+#define DEADLINE_SHED_MS        20          // Overload persistence per stage shed
+#define DEADLINE_RESTORE_MS     2000        // Headroom persistence per stage restored
+#define DEADLINE_TRIP_MS        50          // Overruns with all stages shed
+#define DEADLINE_ENTRY_NS       500         // Entry delay counted as late
+#define DEADLINE_LOOP_LATE_MS   75          // Main-loop tick counted as late (precharge holds 60)
+#define IWDG_TIMEOUT_MS         150         // LSI / 32: 1 ms per count, up to 4095
+
+/* ============================================================================
+ * RUNTIME PARAMETERS (params.c)
+ * The current, PLL and DC voltage gains, the protection thresholds and
+ * the state machine timing above are the defaults of the parameter store;
+ * a protection threshold or response time can only be tightened from its
+ * value here. The store keeps two CRC-checked records, one per flash page,
+ * in the last two pages of bank 2: with nDBANK = 1 (dual bank, 2 KB pages)
+ * they are erased and programmed while the core executes from bank 1. The
+ * linker script must leave both pages out of the application.
+ * ========================================================================== */
+#define PARAM_NV_ADDR           0x0807F000U // First slot (bank 2, page PARAM_NV_PAGE)
+#define PARAM_NV_PAGE           126U        // Bank 2 page of the first slot
+#define PARAM_NV_SLOTS          2U          // One page each, written alternately
+
+/* ============================================================================
+ * EFFICIENCY MONITORING
+ * The measured Pac/Pdc ratio carries ripple and sensor noise and is low-pass
+ * filtered. The expected efficiency at the operating point is interpolated
+ * from eff_map.h, generated by the host loss-map tool (fweffmap, see
+ * Sim/README.md); a growing gap between the two points at ageing devices or
+ * filter components.
+ * ========================================================================== */
+#ifndef EFFICIENCY_MAP_ENABLE
+#define EFFICIENCY_MAP_ENABLE   0           // 1 = include eff_map.h, publish expected efficiency
+#endif
+#define EFFICIENCY_MIN_POWER_W  1000.0f     // Both sides above this for a valid ratio
+#define EFFICIENCY_LPF_TAU_S    1.0f        // Measured efficiency filter
+
 /* ============================================================================
  * GPIO PIN DEFINITIONS (STM32G474)
  * ========================================================================== */
@@ -200,6 +576,10 @@ extern "C" {
 #define ADC_IC_CHANNEL          ADC_CHANNEL_5   // PF0
 #define ADC_TEMP1_CHANNEL       ADC_CHANNEL_6   // PC0
 #define ADC_TEMP2_CHANNEL       ADC_CHANNEL_7   // PC1
+#define ADC_VA_CHANNEL          ADC_CHANNEL_17  // PA4 (ADC2)
+#define ADC_VB_CHANNEL          ADC_CHANNEL_13  // PA5 (ADC2)
+#define ADC_VC_CHANNEL          ADC_CHANNEL_8   // PC2
+#define ADC_VDC_NEG_CHANNEL     ADC_CHANNEL_9   // PC3
 
 /* Digital I/O */
 #define RELAY_PRECHARGE_PORT    GPIOB
@@ -217,6 +597,14 @@ extern "C" {
 #define DI_ENABLE_PORT          GPIOC
 #define DI_ENABLE_PIN           GPIO_PIN_7
 
+/* HRTIM Fault Inputs (AF13) */
+#define FLT_DESAT_PORT          GPIOA
+#define FLT_DESAT_PIN           GPIO_PIN_12     // HRTIM_FLT1, active low
+#define FLT_DRIVER_PORT         GPIOA
+#define FLT_DRIVER_PIN          GPIO_PIN_15     // HRTIM_FLT2, active low
+#define FLT_ESTOP_PORT          GPIOB
+#define FLT_ESTOP_PIN           GPIO_PIN_10     // HRTIM_FLT3, active high
+
 /* Communication Pins */
 #define UART_MODBUS_TX_PORT     GPIOC
 #define UART_MODBUS_TX_PIN      GPIO_PIN_10     // USART3
@@ -224,6 +612,8 @@ extern "C" {
 #define UART_MODBUS_RX_PIN      GPIO_PIN_11
 #define RS485_DE_PORT           GPIOC
 #define RS485_DE_PIN            GPIO_PIN_12
+#define UART_TELEM_TX_PORT      GPIOB
+#define UART_TELEM_TX_PIN       GPIO_PIN_6      // USART1, telemetry RS485 (DE high)
 #define CAN_TX_PORT             GPIOD
 #define CAN_TX_PIN              GPIO_PIN_1      // FDCAN1
 #define CAN_RX_PORT             GPIOD
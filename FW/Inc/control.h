@@ -16,6 +16,7 @@ extern "C" {
 /* Initialization */
 void Control_Init(void);
 void Control_Reset(SystemData_t *sys);
+void Control_SetSampleTime(SystemData_t *sys, uint16_t period);
 
 /* Transformations */
 void Clarke_Transform(float32_t a, float32_t b, float32_t c, AlphaBeta_t *ab);
@@ -26,19 +27,49 @@ void InvPark_Transform(float32_t d, float32_t q, float32_t theta, float32_t *alp
 /* PLL */
 void PLL_Init(Pll_t *pll);
 void PLL_Reset(Pll_t *pll);
-void PLL_Update(Pll_t *pll, float32_t Va, float32_t Vb, float32_t Vc);
+void PLL_Update(Pll_t *pll, float32_t Va, float32_t Vb, float32_t Vc, float32_t Ts);
 
 /* Controllers */
-float32_t PR_Controller(PrController_t *pr, float32_t error);
-float32_t PI_Controller(PiController_t *pi, float32_t error);
+float32_t PR_Controller(PrController_t *pr, float32_t error, float32_t Ts);
+float32_t PI_Controller(PiController_t *pi, float32_t error, float32_t Ts);
+
+/* Reference Trajectory (command limits in the main loop, steps in the ISR) */
+void Control_ReferenceCommand(SystemData_t *sys, float32_t P_in, float32_t Q_in);
+void Control_Trajectory(SystemData_t *sys);
 
 /* Control Loops */
+void Control_VoltageLoop(SystemData_t *sys);
+void Control_CurrentReference(SystemData_t *sys);
 void Control_CurrentLoop(SystemData_t *sys);
+void Control_ActiveDamping(SystemData_t *sys);
+
+/* Grid-Forming (VSM / droop) */
+bool Control_FormingMode(OperationMode_t mode);
+bool Control_BlackStartMode(OperationMode_t mode);
+void Control_GridForming(SystemData_t *sys);
+void Control_GridFormingReference(SystemData_t *sys);
+
+/* Computational Delay Compensation */
+void Control_DelayCompensation(SystemData_t *sys);
+float32_t Control_CompensatedTheta(const SystemData_t *sys);
+void Control_PredictCurrent(SystemData_t *sys);
 
 /* SVPWM */
 void SVPWM_Calculate(SvpwmOutput_t *svpwm, float32_t Vd, float32_t Vq, 
                      float32_t theta, float32_t Vdc);
 
+/* Dead-Time Compensation and Scheduling */
+void DeadTime_Compensate(SvpwmOutput_t *svpwm, const DeadTime_t *dt,
+                         float32_t Ia, float32_t Ib, float32_t Ic);
+void DeadTime_Schedule(SystemData_t *sys);
+bool DeadTime_Load(SystemData_t *sys);
+
+/* Switching Frequency Scheduling (main loop) */
+void Fsw_Schedule(SystemData_t *sys, uint32_t elapsed_ms);
+
+/* Current Limits (main loop → ISR, after Fsw_Schedule) */
+void Control_CurrentLimits(SystemData_t *sys, uint32_t elapsed_ms);
+
 /* Neutral Point Balance */
 float32_t NeutralPointBalance(float32_t Vnp_error, float32_t Ia, float32_t Ib, float32_t Ic);
 
@@ -0,0 +1,32 @@
+/**
+ * @file deadline.h
+ * @brief Control ISR Deadline Supervision and Load Shedding
+ * @version 2.1
+ */
+
+#ifndef __DEADLINE_H
+#define __DEADLINE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "types.h"
+
+/* Initialization (reset cause from the RCC flags) */
+void Deadline_Init(Deadline_t *dl, bool iwdg_reset);
+
+/* Entry delay and execution of one control ISR, and whether it ran into
+ * the next repetition event (called at the end of the ISR) */
+void Deadline_Isr(Deadline_t *dl, uint32_t entry_cycles, uint32_t exec_cycles, bool overrun);
+
+/* Load, shedding and trip decision (called from the main loop every tick);
+ * returns true when the core loop misses its deadline with every optional
+ * stage shed */
+bool Deadline_Supervise(SystemData_t *sys, uint32_t elapsed_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __DEADLINE_H */
@@ -26,9 +26,26 @@ void HRTIM_DisableOutputs(HRTIM_HandleTypeDef *hhrtim);
 void HRTIM_SetDuty(HRTIM_HandleTypeDef *hhrtim, 
                    uint16_t duty_a, uint16_t duty_b, uint16_t duty_c);
 
+/* Carrier Period (applied at the next valley when called after a crest) */
+void HRTIM_SetPeriod(HRTIM_HandleTypeDef *hhrtim, uint16_t period);
+bool HRTIM_CarrierAtCrest(HRTIM_HandleTypeDef *hhrtim);
+
+/* Compare Update Mode (false: once per period, true: crest and valley) */
+void HRTIM_SetUpdateMode(HRTIM_HandleTypeDef *hhrtim, bool double_update);
+
 /* Dead Time Configuration */
 void HRTIM_SetDeadTime(HRTIM_HandleTypeDef *hhrtim, uint16_t dt_rising, uint16_t dt_falling);
 
+/* Hardware Fault Inputs (bit per HwFaultInput_t, FLT1..FLT6) */
+void HRTIM_ConfigFaults(HRTIM_HandleTypeDef *hhrtim);
+uint32_t HRTIM_FaultFlags(HRTIM_HandleTypeDef *hhrtim);    // Tripped since the last call (cleared)
+uint32_t HRTIM_FaultLevels(HRTIM_HandleTypeDef *hhrtim);   // Asserted now
+
+/* Master counter: ticks since the sampling event of the control ISR, and
+ * the next event already due (control ISR overrun) */
+uint16_t HRTIM_MasterCount(HRTIM_HandleTypeDef *hhrtim);
+bool HRTIM_RepetitionPending(HRTIM_HandleTypeDef *hhrtim);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,30 @@
+/**
+ * @file impedance.h
+ * @brief Grid Impedance Estimator and Gain Scheduling
+ * @version 2.1
+ */
+
+#ifndef __IMPEDANCE_H
+#define __IMPEDANCE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "types.h"
+
+/* Initialization */
+void Impedance_Init(GridImpedance_t *gz);
+
+/* Injection and correlation (called from the current loop when following
+ * the grid) */
+void Impedance_Step(SystemData_t *sys);
+
+/* Window requests, evaluation and band selection (called from main loop) */
+void Impedance_Update(SystemData_t *sys, uint32_t elapsed_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __IMPEDANCE_H */
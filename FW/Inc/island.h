@@ -0,0 +1,35 @@
+/**
+ * @file island.h
+ * @brief Active Anti-Islanding Detection (Sandia Frequency Shift)
+ * @version 2.1
+ */
+
+#ifndef __ISLAND_H
+#define __ISLAND_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "types.h"
+
+/* Initialization */
+void Island_Init(AntiIsland_t *ai);
+
+/* Frequency deviation, ROCOF, phase jumps and the SFS phase (called from the
+ * ISR after the PLL update) */
+void Island_Step(SystemData_t *sys);
+
+/* Reference rotation by the SFS phase (called from the current loop when
+ * following the grid, after the current references) */
+void Island_Shift(SystemData_t *sys);
+
+/* Arming and trip decision (called from the slow protection checks);
+ * returns true when an island is detected */
+bool Island_Update(SystemData_t *sys, uint32_t elapsed_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ISLAND_H */
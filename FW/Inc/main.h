@@ -0,0 +1,33 @@
+/**
+ * @file main.h
+ * @brief Application Entry Points
+ * @version 2.1
+ */
+
+#ifndef __MAIN_H
+#define __MAIN_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "stm32g4xx_hal.h"
+
+/* Application (split from main() so a host harness can drive it) */
+void App_Init(void);
+void App_MainLoop(void);
+
+/* Control ISR (200 kHz, HRTIM master repetition) */
+void HRTIM1_Master_IRQHandler(void);
+
+/* Hardware fault interrupt (HRTIM FLT1..FLT6) */
+void HRTIM1_FLT_IRQHandler(void);
+
+/* Error Handler */
+void Error_Handler(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __MAIN_H */
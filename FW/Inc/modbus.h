@@ -2,6 +2,26 @@
  * @file modbus.h
  * @brief Modbus RTU Communication Handler
  * @version 2.1
+ *
+ * The frame engine (modbus_rtu.c) is hardware independent and serves the
+ * flat register image g_modbus in place: holding registers are its first
+ * MODBUS_HOLDING_COUNT words, input registers the rest. The UART driver
+ * (modbus.c) receives and transmits by DMA and hands a frame to the engine
+ * from the idle-line interrupt, so a request is answered without waiting
+ * for the main loop.
+ *
+ * The register map (modbus_map.c) produces input register values when a
+ * master reads them, from g_sys and at most once per main-loop tick, so
+ * the main loop does no conversion while nobody polls. Its extended bank
+ * carries the telemetry as 32-bit values in one block readable with a
+ * single FC 04, followed by a diagnostics block with its own header and
+ * the same update sequence, and describes its layout in a descriptor
+ * block.
+ * Holding register writes are recorded per register; the main loop takes
+ * them with Modbus_TakeWrites and applies each one once. The parameter
+ * bank (holding registers 41001+) serves the runtime parameter store
+ * (params.h) the same way: written values are range checked before they
+ * are applied and taken per value with Modbus_TakeParamWrites.
  */
 
 #ifndef __MODBUS_H
@@ -12,13 +32,117 @@ extern "C" {
 #endif
 
 #include "stm32g4xx_hal.h"
+#include "types.h"
+#include <stddef.h>
+
+/* Register image layout (all fields are 16-bit, no padding) */
+#define MODBUS_HOLDING_COUNT    (offsetof(ModbusRegisters_t, status_word) / sizeof(uint16_t))
+#define MODBUS_INPUT_COUNT      ((sizeof(ModbusRegisters_t) - offsetof(ModbusRegisters_t, status_word)) / sizeof(uint16_t))
+
+/* Holding register address of a field, and its bit in Modbus_TakeWrites */
+#define MODBUS_REG(field)       ((uint16_t)(offsetof(ModbusRegisters_t, field) / sizeof(uint16_t)))
+#define MODBUS_WRITTEN(field)   (1UL << MODBUS_REG(field))
+
+/* Extended bank (input registers, see ModbusExtended_t) */
+#define MODBUS_EXT_BASE         1000U       // 31001: header + 32-bit values
+#define MODBUS_DESC_BASE        2000U       // 32001: layout descriptors
+#define MODBUS_EXT_VERSION      2U          // 2: telemetry and diagnostics blocks
+
+/* Parameter bank (holding registers) and its descriptors (input registers) */
+#define MODBUS_PARAM_BASE       1000U       // 41001: header + 32-bit values
+#define MODBUS_PDESC_BASE       3000U       // 33001: descriptors with ranges
+
+/* Descriptor value types (high byte of entry word 1; the low byte is the
+ * decimal exponent: value = raw · 10^exp in the entry's unit) */
+#define MODBUS_TYPE_U32         1U
+#define MODBUS_TYPE_I32         2U
+#define MODBUS_TYPE_F32         3U          // IEEE-754 single, exponent 0
+
+/* RTU frame limits */
+#define MODBUS_ADU_MAX          256         // Address + PDU (253) + CRC
+#define MODBUS_ADDR_BROADCAST   0U
+
+/* Function codes */
+#define MODBUS_FC_READ_HOLDING  0x03U
+#define MODBUS_FC_READ_INPUT    0x04U
+#define MODBUS_FC_WRITE_SINGLE  0x06U
+#define MODBUS_FC_WRITE_MULTI   0x10U
+#define MODBUS_FC_READ_WRITE    0x17U
+
+/* Exception codes */
+#define MODBUS_EX_ILLEGAL_FUNCTION  0x01U
+#define MODBUS_EX_ILLEGAL_ADDRESS   0x02U
+#define MODBUS_EX_ILLEGAL_VALUE     0x03U
+
+/* Link statistics (frame engine) */
+typedef struct {
+    uint32_t frames;            // Frames with a valid CRC, any address
+    uint32_t responses;         // Normal and exception responses sent
+    uint32_t exceptions;
+    uint32_t crc_errors;        // Also runts below 4 bytes
+    uint32_t writes;            // Register writes applied (FC 06/16/23)
+    uint32_t refreshes;         // Banks converted from g_sys for a read
+} ModbusStats_t;
 
 /* Modbus Initialization */
 void Modbus_Init(UART_HandleTypeDef *huart);
 
-/* Process Received Messages (called from main loop) */
+/* Link supervision: re-arms reception after a UART error (called from
+ * main loop; frames are handled in the UART interrupt) */
 void Modbus_Process(void);
 
+/* Hold off frame handling while the main loop reads commands from or
+ * writes measurements to the register image (masks the UART and its DMA,
+ * not the control ISR) */
+void Modbus_Lock(void);
+void Modbus_Unlock(void);
+
+/* CRC-16/MODBUS (poly 0xA001 reflected, init 0xFFFF), low byte first on
+ * the wire */
+uint16_t Modbus_Crc16(const uint8_t *data, uint16_t len);
+
+/* Handle one received RTU frame; returns the response length in rsp
+ * (0: no response - bad CRC, other address or broadcast) */
+uint16_t Modbus_HandleFrame(const uint8_t *req, uint16_t len, uint8_t *rsp);
+
+/* Holding registers written since the last call, one MODBUS_WRITTEN bit
+ * each (main loop, under Modbus_Lock) */
+uint32_t Modbus_TakeWrites(void);
+
+/* Parameter values written since the last call, one bit per ParamId_t
+ * (main loop, under Modbus_Lock) */
+uint32_t Modbus_TakeParamWrites(void);
+
+/* Register map: source of the input registers, extended bank header and
+ * descriptors (App_Init) */
+void Modbus_InitMap(const SystemData_t *sys);
+
+/* Main loop starts updating the source (top of each tick): reads are
+ * answered from the last conversion until Modbus_Invalidate */
+void Modbus_Hold(void);
+
+/* Source updated (main loop, once per tick, under Modbus_Lock): the next
+ * read of a bank converts it again; banks read while held are converted
+ * here */
+void Modbus_Invalidate(void);
+
+/* Convert a bank from the source if it is older than the last
+ * Modbus_Invalidate and not held (frame engine, before a read); true if
+ * converted */
+bool Modbus_RefreshInputs(void);
+bool Modbus_RefreshExtended(void);
+
+/* Parameter bank: check a write of n registers at a bank offset before it
+ * is applied (frame engine; exception code, 0 = accepted), take the
+ * written values into a set, and write a set into the bank (main loop,
+ * under Modbus_Lock) */
+uint8_t Modbus_CheckParamWrite(uint16_t offset, uint16_t n, const uint8_t *data);
+void Modbus_GetParams(Params_t *p, uint32_t written);
+void Modbus_PutParams(const Params_t *p);
+
+/* Frame engine statistics */
+const ModbusStats_t *Modbus_GetStats(void);
+
 /* Register Access */
 uint16_t Modbus_ReadHoldingRegister(uint16_t address);
 void Modbus_WriteHoldingRegister(uint16_t address, uint16_t value);
@@ -29,4 +153,3 @@ uint16_t Modbus_ReadInputRegister(uint16_t address);
 #endif
 
 #endif /* __MODBUS_H */
-
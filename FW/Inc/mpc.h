@@ -0,0 +1,27 @@
+/**
+ * @file mpc.h
+ * @brief Finite-Control-Set Model Predictive Current Control
+ * @version 2.1
+ */
+
+#ifndef __MPC_H
+#define __MPC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "types.h"
+
+/* Initialization */
+void MPC_Init(FcsMpc_t *mpc);
+void MPC_Reset(FcsMpc_t *mpc);
+
+/* Current Control (replaces Control_CurrentLoop + SVPWM_Calculate) */
+void MPC_CurrentLoop(SystemData_t *sys);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __MPC_H */
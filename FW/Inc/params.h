@@ -0,0 +1,91 @@
+/**
+ * @file params.h
+ * @brief Runtime Parameter Store
+ * @version 2.1
+ */
+
+#ifndef __PARAMS_H
+#define __PARAMS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "types.h"
+
+/* Layout of Params_t and the NV record (see ParamId_t) */
+#define PARAM_VERSION           1U
+
+/* Commands (holding register 40010) */
+#define PARAM_CMD_SAVE          1U          // Values in force to NV
+#define PARAM_CMD_DEFAULTS      2U          // config.h values
+#define PARAM_CMD_RELOAD        3U          // Newest valid NV record
+
+typedef struct {
+    const char *name;           // Up to 16 characters
+    const char *unit;           // Up to 4 characters
+    uint8_t type;               // MODBUS_TYPE_U32 or MODBUS_TYPE_F32
+    uint16_t offset;            // offsetof(Params_t, ...)
+    float32_t def;              // Default (config.h)
+    float32_t min;              // Accepted range, limits included
+    float32_t max;
+} ParamInfo_t;
+
+/* Table entry of an id (NULL past PARAM_COUNT), and the id of a name
+ * (PARAM_COUNT if none) */
+const ParamInfo_t *Params_Info(uint32_t id);
+uint32_t Params_Find(const char *name);
+
+/* Value of an id as its 32-bit raw (float bits for F32), and a raw value
+ * into a set if it is in range */
+uint32_t Params_GetRaw(const Params_t *p, uint32_t id);
+bool Params_SetRaw(Params_t *p, uint32_t id, uint32_t raw);
+bool Params_CheckRaw(uint32_t id, uint32_t raw);
+
+/* Set from the config.h defaults; every value in range and the cross
+ * checks between them */
+void Params_Defaults(Params_t *p);
+bool Params_Validate(const Params_t *p);
+
+/* Defaults or the newest valid NV record, published (App_Init, before
+ * Control_Init) */
+void Params_Init(SystemData_t *sys);
+
+/* Main loop: values in force (the staged set if any), stage a set for the
+ * ISR (false: refused by Params_Validate, counted) and publish it once the
+ * ISR has loaded the previous one (true: published) */
+const Params_t *Params_Get(const SystemData_t *sys);
+bool Params_Stage(SystemData_t *sys, const Params_t *p);
+bool Params_Update(SystemData_t *sys);
+
+/* Main loop: republish the set in force with its gains scaled to another
+ * grid impedance band, and publish a set as is, without the checks (the
+ * simulator's gain overrides); false while the ISR has not loaded the
+ * previous swap, nothing changed */
+bool Params_SetBand(SystemData_t *sys, uint8_t band);
+bool Params_Publish(SystemData_t *sys, const Params_t *p);
+
+/* ISR: take a published set at the start of the period (the current, PLL
+ * and DC voltage gains follow it), and the set in force for this period */
+void Params_Load(SystemData_t *sys);
+static inline const Params_t *Params_Live(const SystemData_t *sys)
+{
+    return &sys->params.set[sys->params.loaded];
+}
+
+/* NV: stage the newest valid record (false if none) and save the values
+ * in force to the older slot (main loop; the erase takes ~20 ms) */
+bool Params_Reload(SystemData_t *sys);
+bool Params_Save(SystemData_t *sys);
+
+/* Flash slots (params_flash.c on target, RAM in the simulator and the
+ * Modbus bench): len a multiple of 8; Write erases the slot, programs
+ * the first double word last and verifies */
+bool ParamsNv_Read(uint32_t slot, void *dst, uint32_t len);
+bool ParamsNv_Write(uint32_t slot, const void *src, uint32_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __PARAMS_H */
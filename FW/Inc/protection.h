@@ -21,6 +21,11 @@ void Protection_Init(void);
 bool Protection_CheckFast(SystemData_t *sys);   // Called from ISR
 void Protection_CheckSlow(SystemData_t *sys);   // Called from main loop
 
+/* Hardware Fault Path (fault interrupt and control ISR) */
+void Protection_HardwareFault(SystemData_t *sys, uint32_t inputs);
+void Protection_FaultReaction(SystemData_t *sys, uint32_t cycles);
+void Protection_SoftwareTrip(SystemData_t *sys, uint16_t ticks);
+
 /* Fault Management */
 bool Protection_ClearFault(SystemData_t *sys, FaultCode_t fault);
 const char* Protection_GetFaultString(FaultCode_t fault);
@@ -0,0 +1,221 @@
+/**
+ * @file recorder.h
+ * @brief ISR Input Recorder for Off-Target Replay
+ * @version 2.1
+ *
+ * Captures everything the control ISR consumes (raw ADC codes, commands
+ * written by the main loop, state transitions) and the compare values it
+ * produces into a RAM ring. Exported by debugger dump of g_rec and fed to
+ * the host replay driver (Sim/), which runs the same ISR on the recorded
+ * inputs and checks the duties bit for bit.
+ *
+ * The ISR only appends deltas. Keyframes are copied by the main loop
+ * (Recorder_Service, in its idle wait) between two control ISRs, and the
+ * writers of command fields flag them (Recorder_Begin/Recorder_End), so
+ * the ISR neither copies state nor compares it. Off by default
+ * (RECORDER_ENABLE).
+ *
+ * Image = RecHeader_t + REC_BLOCK_COUNT × RecBlock_t, little endian.
+ * Each block starts with a keyframe and is decodable on its own.
+ * Block payload is a sequence of tagged records:
+ *   'K' keyframe : { id u8, size u16, bytes }... terminated by id 0
+ *   'C' commands : count u8, { id u8, size u8, bytes }...
+ *   'F' frame    : ADC_RAW_COUNT zigzag varints, delta to previous frame
+ *   'O' output   : 3 zigzag varints (duty a/b/c), delta to previous output
+ * Delta bases are zero at the start of every block.
+ */
+
+#ifndef __RECORDER_H
+#define __RECORDER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "types.h"
+#include "config.h"
+#include "adc.h"
+
+/* ============================================================================
+ * FORMAT
+ * ========================================================================== */
+#define REC_MAGIC               0x43455246U     // "FREC"
+#define REC_FORMAT_VERSION      1
+#define REC_BLOCK_HEADER_SIZE   12
+#define REC_PAYLOAD_SIZE        (REC_BLOCK_SIZE - REC_BLOCK_HEADER_SIZE)
+
+#define REC_TAG_KEYFRAME        'K'
+#define REC_TAG_COMMAND         'C'
+#define REC_TAG_FRAME           'F'
+#define REC_TAG_OUTPUT          'O'
+
+typedef enum {
+    REC_MODE_OFF = 0,           // Not initialised
+    REC_MODE_ARMED,             // Ring overwrites oldest block
+    REC_MODE_POST_TRIGGER,      // Filling the remaining post-trigger blocks
+    REC_MODE_FROZEN             // Stopped, waiting for export and rearm
+} RecMode_t;
+
+/* Field ids are part of the format: never renumber, only append */
+typedef enum {
+    REC_FIELD_END = 0,
+    REC_FIELD_STATE,
+    REC_FIELD_MODE,
+    REC_FIELD_POWER_DIR,
+    REC_FIELD_FAULTS,
+    REC_FIELD_DC,
+    REC_FIELD_AC,
+    REC_FIELD_TEMPS,
+    REC_FIELD_ADC_CAL,
+    REC_FIELD_P_REF,
+    REC_FIELD_Q_REF,
+    REC_FIELD_ID_REF,
+    REC_FIELD_IQ_REF,
+    REC_FIELD_VDC_REF,
+    REC_FIELD_PF_REF,
+    REC_FIELD_PLL,
+    REC_FIELD_CTRL_D,
+    REC_FIELD_CTRL_Q,
+    REC_FIELD_VOLTAGE_CTRL,
+    REC_FIELD_SVPWM,
+    REC_FIELD_MPC,
+    REC_FIELD_DELAY,
+    REC_FIELD_DEADTIME,
+    REC_FIELD_I_DQ,
+    REC_FIELD_V_DQ,
+    REC_FIELD_V_REF_DQ,
+    REC_FIELD_PROT,
+    REC_FIELD_BMS_CHARGE_LIMIT,
+    REC_FIELD_BMS_DISCHARGE_LIMIT,
+    REC_FIELD_BMS_VALID,
+    REC_FIELD_ENABLE_CMD,
+    REC_FIELD_GRID_CONNECTED,
+    REC_FIELD_CYCLE_COUNT,
+    REC_FIELD_VDC_CONTROL,
+    REC_FIELD_VDC_LOOP,
+    REC_FIELD_GFM,
+    REC_FIELD_P_CMD,
+    REC_FIELD_Q_CMD,
+    REC_FIELD_TRAJ,
+    REC_FIELD_OUTPUTS_ENABLED,
+    REC_FIELD_VD_PQ,
+    REC_FIELD_T_MAX,
+    REC_FIELD_THERMAL_RON,
+    REC_FIELD_THERMAL_ACC,
+    REC_FIELD_FSW_PERIOD_REQ,
+    REC_FIELD_FSW_I_LIMIT,
+    REC_FIELD_TIMING,
+    REC_FIELD_DAMPING,
+    REC_FIELD_GRIDZ_REQ,
+    REC_FIELD_GRIDZ_ACC,
+    REC_FIELD_ISLAND_ARMED,
+    REC_FIELD_ISLAND_EST,
+    REC_FIELD_ILIM_I_CHARGE,
+    REC_FIELD_ILIM_I_DISCHARGE,
+    REC_FIELD_ILIM_ID_MAX_TGT,
+    REC_FIELD_ILIM_ID_MIN_TGT,
+    REC_FIELD_ILIM_ID_STEP,
+    REC_FIELD_ILIM_ID_MAX,
+    REC_FIELD_ILIM_ID_MIN,
+    REC_FIELD_ILIM_I_MAX,
+    REC_FIELD_ILIM_I_MAX_SQ,
+    REC_FIELD_ILIM_Q_PRIORITY,
+    REC_FIELD_PARAM_SET,
+    REC_FIELD_PARAM_GAINS,
+    REC_FIELD_PARAM_ACTIVE,
+    REC_FIELD_PARAM_LOADED,
+    REC_FIELD_PARAM_BAND,
+    REC_FIELD_COUNT
+} RecFieldId_t;
+
+/* Command groups: fields written by the main loop, flagged by their
+ * writer. The ISR writes the REC_CMD_STATE fields as well */
+#define REC_CMD_STATE           0x0001U     // State, power direction, faults, output enable
+#define REC_CMD_HOST            0x0002U     // Mode, enable, Vdc/pf references, grid presence
+#define REC_CMD_ADC_CAL         0x0004U
+#define REC_CMD_DEADTIME        0x0008U
+#define REC_CMD_BMS             0x0010U
+#define REC_CMD_REF             0x0020U     // P/Q commands
+#define REC_CMD_THERMAL         0x0040U
+#define REC_CMD_FSW             0x0080U
+#define REC_CMD_GRIDZ           0x0100U
+#define REC_CMD_ISLAND          0x0200U
+#define REC_CMD_ILIM            0x0400U
+#define REC_CMD_PARAMS          0x0800U
+
+/* ISR-visible part of g_sys */
+typedef struct {
+    uint8_t id;                 // RecFieldId_t
+    uint16_t cmd;               // REC_CMD_* of its writer, 0 = ISR state
+    uint16_t size;
+    uint16_t offset;            // offsetof(SystemData_t, ...)
+} RecField_t;
+
+typedef struct {
+    uint32_t magic;             // REC_MAGIC
+    uint16_t version;           // REC_FORMAT_VERSION
+    uint16_t header_size;       // sizeof(RecHeader_t)
+    uint16_t block_size;        // REC_BLOCK_SIZE
+    uint16_t block_count;       // REC_BLOCK_COUNT
+    uint32_t build_id;          // FW version major.minor.patch
+    uint32_t head;              // Block being written
+    uint32_t next_seq;          // Sequence number of the next block
+    uint32_t frame_count;       // Frames recorded since init/rearm
+    uint32_t trigger_frame;     // Frame index of the trigger
+    uint32_t trigger_faults;    // Faults at trigger
+    uint8_t mode;               // RecMode_t
+    uint8_t post_left;          // Post-trigger blocks still to fill
+    uint16_t reserved;
+} RecHeader_t;
+
+typedef struct {
+    uint32_t seq;               // Block sequence number (0 = unused)
+    uint32_t first_frame;       // Frame index of the first frame
+    uint16_t used;              // Payload bytes written
+    uint16_t frames;            // Frames in this block
+    uint8_t data[REC_PAYLOAD_SIZE];
+} RecBlock_t;
+
+typedef struct {
+    RecHeader_t hdr;
+    RecBlock_t block[REC_BLOCK_COUNT];
+} RecImage_t;
+
+/* Recording image (dump this symbol) */
+extern FW_INSTANCE_LOCAL RecImage_t g_rec;
+
+/* ============================================================================
+ * API
+ * ========================================================================== */
+void Recorder_Init(void);
+void Recorder_Rearm(void);
+
+/* Control ISR hooks */
+void Recorder_CaptureInput(const AdcRaw_t *raw);            // From ADC_ReadResults
+void Recorder_Output(uint16_t duty_a, uint16_t duty_b, uint16_t duty_c);
+
+/* Main loop, between control ISRs (idle wait): takes the keyframe the ISR
+ * asked for, one attempt per call */
+void Recorder_Service(void);
+
+/* Around writes of command fields (main loop, not nested per group): the
+ * ISR records the groups every period until Recorder_End and once after */
+#if RECORDER_ENABLE
+void Recorder_Begin(uint32_t cmds);
+void Recorder_End(uint32_t cmds);
+#else
+static inline void Recorder_Begin(uint32_t cmds) { (void)cmds; }
+static inline void Recorder_End(uint32_t cmds) { (void)cmds; }
+#endif
+
+/* Freeze after REC_POST_TRIGGER_BLOCKS (also triggered by any fault) */
+void Recorder_Trigger(uint32_t faults);
+
+/* Field table lookup for the replay driver */
+const RecField_t* Recorder_FindField(uint8_t id);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __RECORDER_H */
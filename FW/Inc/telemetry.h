@@ -0,0 +1,76 @@
+/**
+ * @file telemetry.h
+ * @brief Push-Mode Binary Telemetry Stream on its own UART
+ * @version 2.1
+ *
+ * The control ISR samples a selectable set of signals (TelemetrySignal_t)
+ * at 1 Hz to TELEMETRY_RATE_MAX_HZ into a RAM ring; the main loop packs
+ * the samples into frames and sends them on the telemetry UART (USART1,
+ * TELEMETRY_BAUDRATE), at most one frame per tick and TELEMETRY_LINK_MS
+ * of line time. The Modbus bus never carries a frame.
+ *
+ * Frame (little endian), before COBS:
+ *   version u8 (TELEMETRY_VERSION), seq u16, mask u32, rate_Hz u16,
+ *   index u32 (first sample), count u8,
+ *   count × (one zigzag varint per signal in the set, ascending id: delta
+ *   to the same signal in the previous sample, zero base per frame),
+ *   CRC-16/MODBUS u16 over everything before it.
+ * On the line: 0x00, COBS(frame), 0x00. The leading delimiter lets a
+ * receiver that starts mid-frame resynchronise.
+ *
+ * A sample is the signal's raw integer: value = raw · 10^exp (see
+ * telemetry.c). Samples in a frame are consecutive; a jump in index
+ * between frames is a loss in the firmware (ring full), a jump in seq a
+ * frame lost on the line.
+ */
+
+#ifndef __TELEMETRY_H
+#define __TELEMETRY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "stm32g4xx_hal.h"
+#include "types.h"
+
+#define TELEMETRY_VERSION       1
+#define TELEMETRY_HEADER_SIZE   14
+#define TELEMETRY_VARINT_MAX    5           // 32-bit zigzag varint
+
+/* Signal sets for 40007/40008 */
+#define TLM_SET_AC      ((1UL << TLM_IA) | (1UL << TLM_IB) | (1UL << TLM_IC) | \
+                         (1UL << TLM_VA) | (1UL << TLM_VB) | (1UL << TLM_VC))
+#define TLM_SET_DC      ((1UL << TLM_VDC) | (1UL << TLM_VDC_POS) | (1UL << TLM_VDC_NEG) | \
+                         (1UL << TLM_VNP) | (1UL << TLM_IDC))
+#define TLM_SET_DQ      ((1UL << TLM_ID) | (1UL << TLM_IQ) | (1UL << TLM_ID_REF) | \
+                         (1UL << TLM_IQ_REF) | (1UL << TLM_VD) | (1UL << TLM_VQ) | \
+                         (1UL << TLM_VD_REF) | (1UL << TLM_VQ_REF))
+#define TLM_SET_POWER   ((1UL << TLM_PAC) | (1UL << TLM_QAC) | (1UL << TLM_P_REF) | \
+                         (1UL << TLM_Q_REF) | (1UL << TLM_FREQUENCY))
+#define TLM_SET_PWM     ((1UL << TLM_THETA) | (1UL << TLM_DUTY_A) | (1UL << TLM_DUTY_B) | \
+                         (1UL << TLM_DUTY_C))
+#define TLM_SET_ALL     ((1UL << TLM_SIG_COUNT) - 1UL)
+
+/* Select the signal set and sample rate (main loop; rate 0 stops the
+ * stream, the ring restarts empty) */
+void Telemetry_Configure(TelemetryStream_t *tlm, uint32_t mask, uint16_t rate_Hz);
+
+/* Take a sample when due (control ISR, every control period) */
+void Telemetry_Capture(SystemData_t *sys);
+
+/* Send one frame of pending samples if the UART is free (main loop) */
+void Telemetry_Process(TelemetryStream_t *tlm);
+
+/* Telemetry UART driver (telemetry_uart.c): transmit only. Send starts a
+ * DMA transfer if the UART is ready; data must stay valid until it is
+ * ready again. */
+void Telemetry_UartInit(UART_HandleTypeDef *huart);
+bool Telemetry_UartReady(void);
+bool Telemetry_UartSend(const uint8_t *data, uint16_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __TELEMETRY_H */
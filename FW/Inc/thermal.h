@@ -0,0 +1,29 @@
+/**
+ * @file thermal.h
+ * @brief Junction Temperature Estimator and Predictive Derating
+ * @version 2.1
+ */
+
+#ifndef __THERMAL_H
+#define __THERMAL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "types.h"
+
+/* Initialization */
+void Thermal_Init(Thermal_t *th);
+
+/* Loss sampling (called from ISR while the bridge switches, decimated) */
+void Thermal_AccumulateLosses(SystemData_t *sys);
+
+/* Foster network, prediction and derating (called from main loop) */
+void Thermal_Update(SystemData_t *sys, uint32_t elapsed_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __THERMAL_H */
@@ -138,16 +138,21 @@ typedef struct {
 } Dq_t;
 
 typedef struct {
-    float32_t Tj_phase_a[2];    // MOSFET junction temp phase A [°C]
+    float32_t Tj_phase_a[2];    // MOSFET junction temp phase A [°C]: [0] T1/T4, [1] T2/T3
     float32_t Tj_phase_b[2];    // MOSFET junction temp phase B [°C]
     float32_t Tj_phase_c[2];    // MOSFET junction temp phase C [°C]
     float32_t T_heatsink;       // Heatsink temperature [°C]
     float32_t T_inductor;       // Inductor temperature [°C]
     float32_t T_ambient;        // Ambient temperature [°C]
     float32_t T_pcb;            // PCB temperature [°C]
-    float32_t T_max;            // Maximum temperature [°C]
+    float32_t T_max;            // Hottest estimated junction [°C]
 } Temperatures_t;
 
+typedef struct {
+    int16_t i_trim[4];          // Zero-current code trim IA, IB, IC, IDC [LSB]
+    bool valid;                 // Offsets calibrated
+} AdcCalibration_t;
+
 /* ============================================================================
  * CONTROL STRUCTURES
  * ========================================================================== */
@@ -189,14 +194,417 @@ typedef struct {
     uint16_t duty_a;        // Duty cycle phase A (HRTIM compare)
     uint16_t duty_b;        // Duty cycle phase B
     uint16_t duty_c;        // Duty cycle phase C
+    uint16_t period;        // Carrier period the duties refer to [HRTIM ticks]
 } SvpwmOutput_t;
 
+typedef struct {
+    float32_t dt_ns;            // Scheduled dead-time [ns]
+    uint16_t dt_counts;         // Dead-time in HRTIM ticks (applied)
+    uint16_t dt_req;            // Dead-time requested by the schedule [ticks]
+    float32_t i_band;           // Compensator zero-crossing band [A]
+    bool comp_enable;           // Dead-time voltage compensation enable
+} DeadTime_t;
+
+typedef struct {
+    float32_t theta_advance;    // Angle advance for PWM delay [rad]
+    Dq_t I_pred;                // Predicted current at PWM update [A]
+    Dq_t V_applied;             // Voltage reference still pending in PWM [V]
+} DelayComp_t;
+
+/* LCL active damping: capacitor current estimated from the PCC (filter
+ * capacitor) voltage in the current-loop frame */
+typedef struct {
+    float32_t K;                // Virtual resistor gain [V/A], Rv = Lc/(K·Cf)
+    Dq_t V_prev;                // PCC voltage of the last period [V]
+    Dq_t I_cf;                  // Filtered capacitor current estimate [A]
+    Dq_t V_damp;                // Voltage subtracted from the reference [V]
+    bool primed;                // V_prev valid
+} ActiveDamping_t;
+
+typedef struct {
+    bool active;                // Loop owns Id_ref (bumpless entry done)
+    uint16_t decim;             // Control periods accumulated
+    float32_t vdc_sum;          // Vdc accumulated over the outer period [V]
+    float32_t pload_sum;        // Load power accumulated over the outer period [W]
+    float32_t vdc_prev;         // Previous outer-period Vdc average [V]
+    float32_t P_load;           // Filtered DC load power, + = drawn from link [W]
+    float32_t Id_ff;            // Load feed-forward current [A]
+    float32_t Id_max;           // Upper Id bound from BMS discharge limit [A]
+    float32_t Id_min;           // Lower Id bound from BMS charge limit [A]
+} DcVoltageLoop_t;
+
+typedef struct {
+    bool active;                // Current loop runs in the internal frame
+    Pll_t frame;                // Internal frame: theta, omega, PCC Vd/Vq (pi unused)
+    float32_t E;                // Internal EMF, d axis (phase peak) [V]
+    float32_t E_ramp;           // Black-start voltage ramp [0..1]
+    float32_t P_filt;           // Filtered active power, + = export [W]
+    float32_t Q_filt;           // Filtered reactive power [VAr]
+    PiController_t v_d;         // PCC voltage PI, d axis [A/V]
+    PiController_t v_q;         // PCC voltage PI, q axis [A/V]
+} GridForming_t;
+
+typedef struct {
+    uint8_t state;          // Switching state applied this period (0-26)
+    uint8_t candidates;     // Candidates evaluated in last cycle
+    float32_t lambda_np;    // NP voltage cost weight
+    float32_t lambda_sw;    // Switching count cost weight
+    float32_t cost;         // Cost of selected candidate
+    float32_t ig_alpha;     // Estimated grid current alpha [A]
+    float32_t ig_beta;      // Estimated grid current beta [A]
+    Dq_t V_lp;              // PCC voltage below MPC_AD_LPF_HZ [V]
+    bool ad_primed;         // V_lp valid
+} FcsMpc_t;
+
+/* Reference trajectory: one rate- and acceleration-limited axis */
+typedef struct {
+    float32_t x;                // Output [W] / [VAr]
+    float32_t v;                // Rate [W/s] / [VAr/s]
+} RefAxis_t;
+
+typedef struct {
+    RefAxis_t p;                // → ref.P_ref
+    RefAxis_t q;                // → ref.Q_ref
+    uint16_t decim;             // Control periods since the last step
+    uint16_t dwell;             // Steps left at rest on a power reversal
+    bool soft_start;            // First ramp after RUN entry (SOFT_START_TIME_MS)
+    bool idle;                  // Both axes at zero and at rest
+} RefTrajectory_t;
+
+/* Control period and the coefficients derived from it, switched with the
+ * carrier period (Control_SetSampleTime) */
+typedef struct {
+    float32_t Ts;               // Control period = half carrier period [s]
+    uint32_t Ts_ns;             // Same, for the protection timers [ns]
+    float32_t voltage_Ts;       // Outer loop / trajectory step [s]
+    float32_t voltage_ff_alpha; // DC load power filter coefficient
+    float32_t gfm_pq_alpha;     // Grid-forming P/Q filter coefficient
+    float32_t ref_vd_alpha;     // Vd filter coefficient of the P/Q division
+    float32_t gfm_ramp_step;    // Black-start EMF ramp per period
+    uint16_t ref_dwell_steps;   // Trajectory steps of the reversal dwell
+    float32_t ad_cf_ts;         // Cf/Ts of the capacitor current estimate [F/s]
+    float32_t ad_alpha;         // Capacitor current filter coefficient
+    bool crest;                 // This ISR is at a carrier crest
+    bool pending;               // Period written, Ts changes at the valley
+} ControlTiming_t;
+
+/* ============================================================================
+ * SWITCHING FREQUENCY SCHEDULE (main loop → ISR)
+ * ========================================================================== */
+typedef struct {
+    uint16_t period_req;        // Carrier period for the ISR to switch to [HRTIM ticks]
+    float32_t I_limit;          // dq current limit with the ripple of the level [A]
+    uint8_t level;              // Index into FSW_PERIODS
+    float32_t I_demand;         // Current demand, fast rise, slow decay [A]
+    float32_t ripple_pp;        // Worst-case converter ripple at the level [A]
+    uint32_t hold_ms;           // Time at the present level [ms]
+} FswSchedule_t;
+
+/* ============================================================================
+ * CURRENT LIMITS (main loop → ISR)
+ * Battery limits converted once per main-loop pass; the ISR only clamps,
+ * and steps the d-axis bounds towards their targets so that they do not
+ * jump at the main-loop rate. The fields are written one at a time and
+ * move slowly (slewed), so a pass read half-updated is still a valid limit
+ * ========================================================================== */
+typedef struct {
+    float32_t I_charge;         // Battery charge limit, SOC tapered, slewed [A]
+    float32_t I_discharge;      // Battery discharge limit, SOC tapered, slewed [A]
+    float32_t Id_max_tgt;       // d-axis bound, inverter (discharge) [A]
+    float32_t Id_min_tgt;       // d-axis bound, rectifier (charge), <= 0 [A]
+    float32_t Id_step;          // Bound change per control period [A]
+    float32_t Id_max;           // Bounds in use, stepped towards the targets (ISR) [A]
+    float32_t Id_min;
+    float32_t I_max;            // Current circle radius = fsw.I_limit [A]
+    float32_t I_max_sq;         // I_max² [A²]
+    bool q_priority;            // Iq keeps its value on the circle, Id gives way
+} CurrentLimit_t;
+
+/* ============================================================================
+ * TERMINAL POWER AVERAGING (efficiency)
+ * ========================================================================== */
+typedef struct {
+    float32_t P_dc_sum[2];      // Sum of ISR samples of Pdc since the last tick [W]
+    float32_t P_ac_sum[2];      // Sum of ISR samples of Pac [W]
+    uint32_t n[2];              // Samples per bank
+    uint8_t bank;               // Bank the ISR accumulates into
+} PowerAcc_t;
+
+/* ============================================================================
+ * JUNCTION TEMPERATURE ESTIMATOR
+ * ========================================================================== */
+#define THERMAL_POSITIONS       9           // Per phase: T1 (upper), T4 (lower), T2/T3
+#define THERMAL_FOSTER_ORDER    3
+
+typedef struct {
+    float32_t E[2][THERMAL_POSITIONS];  // Loss energy since the last update [J]
+    uint8_t bank;               // Bank the ISR accumulates into
+    uint8_t decim;              // ISR periods since the last loss sample
+} ThermalAcc_t;
+
+typedef struct {
+    ThermalAcc_t acc;           // ISR side
+    float32_t R_on[THERMAL_POSITIONS];      // RDS(on) at the estimated Tj [Ω]
+    float32_t dT[THERMAL_POSITIONS][THERMAL_FOSTER_ORDER];  // Foster terms [K]
+    float32_t P_loss[THERMAL_POSITIONS];    // Loss over the last update [W]
+    float32_t P_filt[THERMAL_POSITIONS];    // Filtered loss for the prediction [W]
+    float32_t Tj[THERMAL_POSITIONS];        // Estimated junction temperature [°C]
+    float32_t Tj_pred[THERMAL_POSITIONS];   // Tj after THERMAL_PREDICT_S at P_filt [°C]
+    float32_t Tj_pred_max;      // Hottest predicted junction [°C]
+    float32_t P_total;          // Semiconductor loss, all positions [W]
+    float32_t derating;         // Predictive power derating [0..1]
+} Thermal_t;
+
+/* ============================================================================
+ * GRID IMPEDANCE ESTIMATOR
+ * ========================================================================== */
+#define GRIDZ_SIGNALS           3           // Vd, Id, Iq
+
+typedef struct {
+    bool running;               // Injection window in progress
+    uint8_t seq;                // Last completed request
+    uint16_t cycles;            // Injection periods completed
+    float32_t phase;            // Injection phase [deg]
+    float32_t I_inj;            // Injected d-axis current this period [A]
+    float32_t x0[GRIDZ_SIGNALS];            // First sample (DC removal)
+    float32_t c[GRIDZ_SIGNALS];             // Σ (x - x0)·cos·Ts
+    float32_t s[GRIDZ_SIGNALS];             // Σ (x - x0)·sin·Ts
+} GridZAcc_t;
+
+typedef struct {
+    uint8_t req;                // Window request, incremented by the main loop
+    GridZAcc_t acc;             // ISR side
+    uint8_t seq_read;           // Last window evaluated
+    bool disturbed;             // Not at steady state during the window
+    uint32_t timer_ms;          // Steady state since the last window [ms]
+    uint32_t windows;           // Windows evaluated
+    bool valid;                 // R, L_grid and SCR hold an estimate
+    float32_t R;                // Resistance behind the PCC [Ω]
+    float32_t L_grid;           // Grid inductance beyond Lg [H]
+    float32_t SCR;              // Short-circuit ratio at the PCC
+} GridImpedance_t;
+
+/* ============================================================================
+ * PROTECTION STATE
+ * ========================================================================== */
+typedef struct {
+    uint32_t ov_timer_ms;       // DC over-voltage persistence
+    uint32_t uv_timer_ms;       // DC under-voltage persistence
+    uint32_t oc_timer_ns;       // AC over-current persistence (ISR)
+    uint32_t freq_timer_ms;     // Frequency deviation persistence
+    uint32_t island_timer_ms;   // PLL unlocked while grid connected
+    uint32_t slow_last_tick;    // Last slow check [ms]
+    float32_t derating;         // Thermal power derating [0..1]
+} ProtectionState_t;
+
+/* Hardware fault inputs, in HRTIM FLT1..FLT6 order */
+typedef enum {
+    HWFLT_IN_DESAT = 0,         // FLT1: gate-driver desaturation
+    HWFLT_IN_DRIVER,            // FLT2: gate-driver supply not ready (UVLO)
+    HWFLT_IN_ESTOP,             // FLT3: E-stop loop open
+    HWFLT_IN_OC_A,              // FLT4: phase A comparator
+    HWFLT_IN_OC_B,              // FLT5: phase B comparator
+    HWFLT_IN_OC_C,              // FLT6: phase C comparator
+    HWFLT_IN_COUNT
+} HwFaultInput_t;
+
+#define HWFLT_BIT(in)           (1U << (in))
+#define HWFLT_OC_MASK           (HWFLT_BIT(HWFLT_IN_OC_A) | HWFLT_BIT(HWFLT_IN_OC_B) | \
+                                 HWFLT_BIT(HWFLT_IN_OC_C))
+#define HWFLT_LOG_DEPTH         8           // Trips kept (power of 2)
+
+typedef struct {
+    uint32_t t_ms;              // HAL tick of the trip
+    uint8_t inputs;             // Tripped inputs (bit per HwFaultInput_t)
+    uint8_t state;              // SystemState_t at the trip
+    uint16_t react_ns;          // Fault interrupt entry to state set [ns]
+    float32_t Ia, Ib, Ic;       // Last control ISR sample [A]
+    float32_t Vdc;              // [V]
+} HwFaultEntry_t;
+
+typedef struct {
+    HwFaultEntry_t log[HWFLT_LOG_DEPTH];
+    uint32_t head;              // Trips logged (next entry at head % depth)
+    uint32_t count[HWFLT_IN_COUNT];
+    uint32_t last_inputs;       // Inputs of the last trip
+    uint32_t active;            // Inputs asserted now (main loop)
+    uint32_t react_ns_max;      // Worst fault interrupt reaction [ns]
+    uint32_t sw_trip_ns;        // Last ISR protection trip: sample to outputs off [ns]
+    uint32_t sw_trip_ns_max;    // Worst of those [ns]
+} HwFaultState_t;
+
+/* ============================================================================
+ * ISR DEADLINE SUPERVISION
+ * ========================================================================== */
+/* Optional stages (bit each), shed in DEADLINE_SHED_ORDER */
+#define SHED_TELEMETRY          0x01U       // Telemetry sampling in the ISR
+#define SHED_GRIDZ              0x02U       // Grid impedance windows (injection, correlation)
+#define SHED_RECORDER           0x04U       // Recorder capture (varint frames, command diff)
+#define SHED_STAGES             3
+
+typedef struct {
+    /* Control ISR */
+    uint32_t used_max;          // Worst entry delay + execution since the tick [cycles]
+    uint32_t overruns;          // ISRs still running at the next repetition event
+    uint32_t late;              // Entries later than DEADLINE_ENTRY_NS
+    uint32_t entry_max;         // Worst entry delay [cycles]
+    uint32_t exec_max;          // Worst execution [cycles]
+    
+    /* Main loop */
+    uint32_t overruns_seen;     // overruns at the previous tick
+    uint32_t hot_ms;            // Overloaded (shed timer)
+    uint32_t cool_ms;           // Below DEADLINE_LOAD_RESTORE (restore timer)
+    uint32_t miss_ms;           // Overrunning with every stage shed (trip timer)
+    uint32_t sheds;             // Stages shed since reset
+    uint32_t loop_late;         // Ticks later than DEADLINE_LOOP_LATE_MS
+    uint32_t loop_max_ms;       // Longest tick
+    float32_t load;             // Worst period of the last tick [pu of the budget]
+    float32_t load_max;         // Worst since reset [pu]
+    uint8_t shed;               // Stages shed now (SHED_* bits, read by the ISR)
+    uint8_t level;              // Stages shed, in DEADLINE_SHED_ORDER
+    bool iwdg_reset;            // Last reset was the independent watchdog
+} Deadline_t;
+
+/* ============================================================================
+ * RUNTIME PARAMETERS
+ * One 32-bit value per id, in id order. Ids are part of the NV record and
+ * Modbus layout: only append, and bump PARAM_VERSION when an id changes
+ * meaning.
+ * ========================================================================== */
+typedef enum {
+    /* Gains */
+    PARAM_CURRENT_KP = 0,
+    PARAM_CURRENT_KR,
+    PARAM_PLL_KP,
+    PARAM_PLL_KI,
+    PARAM_VOLTAGE_KP,
+    PARAM_VOLTAGE_KI,
+    
+    /* Protection thresholds */
+    PARAM_VDC_OV,
+    PARAM_VDC_UV,
+    PARAM_IDC_OC,
+    PARAM_IAC_OC,
+    PARAM_IAC_SC,
+    PARAM_T_MOSFET,
+    PARAM_T_HEATSINK,
+    PARAM_VAC_MAX,
+    PARAM_VAC_MIN,
+    PARAM_FREQ_MAX,
+    PARAM_FREQ_MIN,
+    
+    /* Timing */
+    PARAM_OC_RESPONSE,
+    PARAM_UV_RESPONSE,
+    PARAM_BMS_TIMEOUT,
+    PARAM_ANTI_ISLAND,
+    PARAM_PRECHARGE,
+    PARAM_GRID_SYNC,
+    
+    PARAM_COUNT
+} ParamId_t;
+
+typedef struct {
+    float32_t current_kp;       // PR proportional gain [V/A]
+    float32_t current_kr;       // PR resonant gain
+    float32_t pll_kp;           // PLL proportional gain
+    float32_t pll_ki;           // PLL integral gain
+    float32_t voltage_kp;       // DC voltage PI [A/V]
+    float32_t voltage_ki;       // [A/(V·s)]
+    float32_t vdc_ov_V;         // DC over-voltage trip
+    float32_t vdc_uv_V;         // DC under-voltage trip
+    float32_t idc_oc_A;         // DC over-current trip
+    float32_t iac_oc_A;         // AC over-current trip (after oc_response_us)
+    float32_t iac_sc_A;         // AC short-circuit trip
+    float32_t t_mosfet_C;       // MOSFET trip (end of the linear derating)
+    float32_t t_heatsink_C;     // Heatsink trip
+    float32_t vac_max_V;        // AC over-voltage trip (L-L RMS)
+    float32_t vac_min_V;        // AC under-voltage trip
+    float32_t f_max_Hz;         // Over-frequency trip
+    float32_t f_min_Hz;         // Under-frequency trip
+    uint32_t oc_response_us;    // AC over-current persistence
+    uint32_t uv_response_ms;    // DC under-voltage persistence
+    uint32_t bms_timeout_ms;    // BMS data age trip
+    uint32_t anti_island_ms;    // PLL unlocked at power (passive anti-islanding)
+    uint32_t precharge_ms;      // Pre-charge timeout
+    uint32_t grid_sync_ms;      // Grid synchronization timeout
+} Params_t;
+
+typedef enum {
+    PARAM_NV_NONE = 0,          // No record: defaults
+    PARAM_NV_LOADED,            // Newest valid record loaded
+    PARAM_NV_INVALID,           // Records found, none valid: defaults
+    PARAM_NV_SAVED,             // Written and verified
+    PARAM_NV_FAILED             // Last save failed (erase, program or verify)
+} ParamNvStatus_t;
+
+/* Current and PLL gains of a set, scaled to the grid impedance band */
+typedef struct {
+    float32_t current_kp;       // PR proportional gain [V/A]
+    float32_t current_kr;       // PR resonant gain
+    float32_t pll_kp;           // PLL proportional gain
+    float32_t pll_ki;           // PLL integral gain
+} ControlGains_t;
+
+typedef struct {
+    Params_t set[2];            // Published sets, set[active] in force
+    ControlGains_t gains[2];    // set[i] gains at the band, gains[active] in use
+    uint8_t active;             // Set the ISR loads (written last)
+    uint8_t loaded;             // Set the ISR reads (ISR side)
+    uint8_t band;               // Gain band of set[active] (0 = weak grid)
+    
+    /* Main-loop side */
+    Params_t next;              // Staged, published when the ISR is free
+    bool pending;
+    uint8_t nv;                 // ParamNvStatus_t
+    uint8_t nv_slot;            // Slot of the newest valid record
+    uint32_t nv_seq;            // Its sequence number (0 = none)
+    uint32_t seq;               // Sets published
+    uint32_t rejects;           // Sets refused by the range or cross checks
+} ParamBank_t;
+
+/* ============================================================================
+ * ACTIVE ANTI-ISLANDING
+ * ========================================================================== */
+typedef enum {
+    AI_CAUSE_NONE = 0,
+    AI_CAUSE_PLL_UNLOCK,        // Passive backstop (ANTI_ISLAND_TIME_MS)
+    AI_CAUSE_ROCOF,             // Drift away from nominal with high ROCOF
+    AI_CAUSE_FREQ_WINDOW        // SFS pushed the frequency out of the window
+} AiCause_t;
+
+typedef struct {
+    float32_t df;               // Filtered frequency deviation from nominal [Hz]
+    float32_t rocof;            // Filtered rate of change of frequency [Hz/s]
+    float32_t phi;              // SFS phase lead of the current reference [deg]
+    Dq_t dI;                    // Current reference rotation by phi [A]
+    bool jump_hi;               // PLL phase error above AI_PHASE_JUMP_DEG
+    uint8_t jumps;              // Phase jumps seen (wraps)
+    float32_t hold_s;           // SFS phase held after a jump [s]
+} AiEstimate_t;
+
+typedef struct {
+    bool armed;                 // Grid-following at power: SFS on, estimates run
+    AiEstimate_t est;           // ISR side
+    uint8_t jumps_read;         // Last phase jump seen by the main loop
+    uint32_t jump_timer_ms;     // ROCOF timer held after a phase jump [ms]
+    uint32_t rocof_timer_ms;    // Drift with ROCOF above threshold [ms]
+    uint32_t window_timer_ms;   // Outside the AI frequency window [ms]
+    uint32_t detections;        // Trips raised
+    uint8_t cause;              // AiCause_t of the last trip
+} AntiIsland_t;
+
 /* ============================================================================
  * REFERENCE STRUCTURES
  * ========================================================================== */
 typedef struct {
-    float32_t P_ref;        // Active power reference [W]
-    float32_t Q_ref;        // Reactive power reference [VAr]
+    float32_t P_set;        // P command as last written by Modbus [W]
+    float32_t Q_set;        // Q command as last written by Modbus [VAr]
+    float32_t P_cmd;        // Commanded P after BMS / derating limits [W]
+    float32_t Q_cmd;        // Commanded Q after derating [VAr]
+    float32_t P_ref;        // Active power reference (trajectory) [W]
+    float32_t Q_ref;        // Reactive power reference (trajectory) [VAr]
+    float32_t Vd_pq;        // Filtered PCC Vd for the P/Q → Id/Iq division [V]
     float32_t Id_ref;       // D-axis current reference [A]
     float32_t Iq_ref;       // Q-axis current reference [A]
     float32_t Vdc_ref;      // DC voltage reference [V]
@@ -206,20 +614,122 @@ typedef struct {
 /* ============================================================================
  * BMS DATA STRUCTURE
  * ========================================================================== */
+#define BMS_CELL_COUNT          240         // Series cells (3.54 V nominal)
+#define BMS_TEMP_COUNT          48          // Cell temperature sensors
+#define BMS_CELLS_PER_FRAME     31          // u16 mV after a 2-byte header (64-byte FD frame)
+#define BMS_TEMPS_PER_FRAME     62          // i8 °C after a 2-byte header
+#define BMS_CELL_BLOCKS         ((BMS_CELL_COUNT + BMS_CELLS_PER_FRAME - 1) / BMS_CELLS_PER_FRAME)
+#define BMS_TEMP_BLOCKS         ((BMS_TEMP_COUNT + BMS_TEMPS_PER_FRAME - 1) / BMS_TEMPS_PER_FRAME)
+
+/* Data groups with their own freshness (bit in BmsData_t seen / stale) */
+typedef enum {
+    BMS_GRP_PACK = 0,           // Pack voltage, current, SOC, SOH, status
+    BMS_GRP_LIMITS,             // Charge/discharge current limits of the BMS
+    BMS_GRP_CELL_V,             // Cell voltages, all blocks
+    BMS_GRP_CELL_T,             // Cell temperatures, all blocks
+    BMS_GRP_COUNT
+} BmsGroup_t;
+
 typedef struct {
     float32_t voltage;          // Pack voltage [V]
-    float32_t current;          // Pack current [A]
+    float32_t current;          // Pack current, + = discharge [A]
     float32_t soc;              // State of charge [%]
     float32_t soh;              // State of health [%]
     float32_t temperature_max;  // Max cell temperature [°C]
     float32_t temperature_min;  // Min cell temperature [°C]
-    float32_t charge_limit;     // Max charge current [A]
-    float32_t discharge_limit;  // Max discharge current [A]
+    float32_t charge_limit;     // Max charge current: BMS limit with cell derating [A]
+    float32_t discharge_limit;  // Max discharge current: BMS limit with cell derating [A]
     uint32_t status;            // BMS status flags
-    uint32_t last_update_ms;    // Last update timestamp
-    bool valid;                 // Data validity flag
+    bool valid;                 // Every group received within BMS_TIMEOUT_MS
+    
+    /* Limits as sent by the BMS [A] */
+    float32_t charge_limit_bms;
+    float32_t discharge_limit_bms;
+    
+    /* Per-cell data */
+    float32_t cell_voltage[BMS_CELL_COUNT];     // [V]
+    float32_t cell_temperature[BMS_TEMP_COUNT]; // [°C]
+    float32_t cell_v_max;       // Highest cell voltage [V]
+    float32_t cell_v_min;       // Lowest cell voltage [V]
+    uint16_t cell_v_max_idx;
+    uint16_t cell_v_min_idx;
+    
+    /* Freshness: RX timestamps of the frames (HAL tick at the FDCAN
+     * interrupt), the oldest block for the cell groups */
+    uint32_t rx_ms[BMS_GRP_COUNT];
+    uint32_t cell_v_ms[BMS_CELL_BLOCKS];
+    uint32_t cell_t_ms[BMS_TEMP_BLOCKS];
+    uint32_t cell_v_seen;       // Bit per cell voltage block received
+    uint32_t cell_t_seen;       // Bit per temperature block received
+    uint32_t seen;              // Bit per BmsGroup_t complete at least once
+    uint32_t stale;             // Bit per BmsGroup_t older than its window
+    
+    /* Statistics */
+    uint32_t rx_frames;         // Frames decoded
+    uint32_t bad_frames;        // Unknown id, short frame, block out of range
+    uint32_t dropped;           // Mailbox full (copied from the driver)
+    uint32_t lost;              // Hardware RX FIFO overrun (copied from the driver)
 } BmsData_t;
 
+/* ============================================================================
+ * BINARY TELEMETRY STREAM
+ * ========================================================================== */
+/* Signal ids are part of the stream format (bit in the set mask 40007/8):
+ * never renumber, only append (at most 32) */
+typedef enum {
+    TLM_IA = 0,
+    TLM_IB,
+    TLM_IC,
+    TLM_VA,
+    TLM_VB,
+    TLM_VC,
+    TLM_VDC,
+    TLM_VDC_POS,
+    TLM_VDC_NEG,
+    TLM_VNP,
+    TLM_IDC,
+    TLM_ID,
+    TLM_IQ,
+    TLM_ID_REF,
+    TLM_IQ_REF,
+    TLM_VD,
+    TLM_VQ,
+    TLM_VD_REF,
+    TLM_VQ_REF,
+    TLM_PAC,
+    TLM_QAC,
+    TLM_P_REF,
+    TLM_Q_REF,
+    TLM_FREQUENCY,
+    TLM_THETA,
+    TLM_DUTY_A,
+    TLM_DUTY_B,
+    TLM_DUTY_C,
+    TLM_SIG_COUNT
+} TelemetrySignal_t;
+
+typedef struct {
+    /* Configuration (main loop; the ISR samples only while period > 0) */
+    uint32_t mask;              // Signal set, bit per TelemetrySignal_t
+    uint16_t rate_Hz;           // Sample rate (0 = stream off)
+    uint8_t n_sig;              // Signals in the set
+    uint8_t sig[TLM_SIG_COUNT]; // Their ids, ascending
+    uint16_t stride;            // Ring words per sample (index + values)
+    uint16_t capacity;          // Ring samples
+    float32_t period;           // Sample period [s] (0 = off)
+    
+    /* ISR side */
+    float32_t phase;            // Time since the last sample [s]
+    uint32_t index;             // Sample number (t = index / rate)
+    volatile uint32_t head;     // Samples written (ISR)
+    volatile uint32_t tail;     // Samples framed (main loop)
+    uint32_t dropped;           // Samples lost to a full ring
+    
+    /* Main-loop side */
+    uint16_t seq;               // Frame sequence number
+    uint32_t frames;            // Frames sent
+} TelemetryStream_t;
+
 /* ============================================================================
  * SYSTEM DATA STRUCTURE
  * ========================================================================== */
@@ -237,6 +747,7 @@ typedef struct {
     DcMeasurements_t dc;
     AcMeasurements_t ac;
     Temperatures_t temps;
+    AdcCalibration_t adc_cal;
     
     /* Control */
     References_t ref;
@@ -244,21 +755,45 @@ typedef struct {
     PrController_t current_ctrl_d;
     PrController_t current_ctrl_q;
     PiController_t voltage_ctrl;
+    RefTrajectory_t traj;
+    DcVoltageLoop_t vdc_loop;
+    GridForming_t gfm;
     SvpwmOutput_t svpwm;
+    ControlTiming_t timing;
+    FswSchedule_t fsw;
+    CurrentLimit_t ilim;
+    FcsMpc_t mpc;
+    DelayComp_t delay;
+    ActiveDamping_t damping;
+    ParamBank_t params;
+    GridImpedance_t gridz;
+    DeadTime_t deadtime;
     Dq_t I_dq;
     Dq_t V_dq;
     Dq_t V_ref_dq;
     
+    /* Protection */
+    ProtectionState_t prot;
+    HwFaultState_t hwflt;
+    Deadline_t deadline;
+    AntiIsland_t island;
+    Thermal_t thermal;
+    
     /* BMS */
     BmsData_t bms;
     
     /* Statistics */
+    PowerAcc_t power_acc;
     float32_t efficiency;
+    float32_t efficiency_expected;  // Loss-map value at the operating point (0 = no map)
     float32_t energy_inverter_kWh;
     float32_t energy_rectifier_kWh;
     uint32_t run_time_hours;
     uint32_t fault_count;
     
+    /* Binary telemetry stream */
+    TelemetryStream_t telem;
+    
     /* Timing */
     uint32_t uptime_ms;
     uint32_t control_cycle_count;
@@ -266,7 +801,11 @@ typedef struct {
     
     /* Flags */
     bool enable_cmd;
+    bool vdc_control;       // Regulate Vdc_ref instead of P_ref
+    bool fsw_fixed;         // Switching frequency scheduling off (PWM_FREQUENCY_HZ)
+    bool q_priority;        // Reactive current first at the current limit
     bool grid_connected;
+    bool outputs_enabled;   // Bridge switching: RUN entry until stop or trip
     bool precharge_complete;
     bool ready_to_run;
 } SystemData_t;
@@ -282,6 +821,10 @@ typedef struct {
     int16_t  Q_ref_100VAr;          // 40004: Reactive power ref (×100VAr)
     uint16_t pf_ref_1000;           // 40005: Power factor (×1000)
     uint16_t Vdc_ref_V;             // 40006: DC voltage reference
+    uint16_t telem_mask_low;        // 40007: Telemetry signal set (bits 0-15)
+    uint16_t telem_mask_high;       // 40008: Telemetry signal set (bits 16-31)
+    uint16_t telem_rate_Hz;         // 40009: Telemetry sample rate (0 = off)
+    uint16_t param_cmd;             // 40010: Parameter store command (PARAM_CMD_*)
     
     /* Input Registers (Read Only) - 30001+ */
     uint16_t status_word;           // 30001: System status
@@ -300,11 +843,154 @@ typedef struct {
     int16_t  temp_mosfet_10C;       // 30014: MOSFET temp (×0.1°C)
     uint16_t efficiency_100;        // 30015: Efficiency (×0.01%)
     uint16_t soc_100;               // 30016: Battery SOC (×0.01%)
+    uint16_t eff_expected_100;      // 30017: Expected efficiency (×0.01%, 0 = no map)
+    uint16_t fsw_100Hz;             // 30018: Switching frequency (×100Hz)
+    uint16_t grid_scr_10;           // 30019: Grid SCR estimate (×0.1, 0 = none)
+    uint16_t grid_L_uH;             // 30020: Grid inductance estimate (µH)
 } ModbusRegisters_t;
 
+/* ============================================================================
+ * MODBUS EXTENDED REGISTER BANK
+ * Input registers 31001+ (address MODBUS_EXT_BASE): blocks of at most one
+ * FC 04 (125 registers), each a header, then one 32-bit value per id, high
+ * word first. The telemetry block (31001-31124) is full; the diagnostics
+ * block follows at 31125 (MODBUS_EXT_DIAG_AT). Layout descriptors at
+ * 32001+ (MODBUS_DESC_BASE). Ids are part of the layout: only append, and
+ * bump MODBUS_EXT_VERSION when an id changes meaning.
+ * ========================================================================== */
+typedef enum {
+    /* State */
+    MB_EXT_STATUS = 0,          // Legacy status word bits + outputs/GFM
+    MB_EXT_MODE,
+    MB_EXT_FAULTS,
+    MB_EXT_FAULT_HISTORY,
+    
+    /* DC */
+    MB_EXT_VDC,
+    MB_EXT_VDC_POS,
+    MB_EXT_VDC_NEG,
+    MB_EXT_VNP,
+    MB_EXT_IDC,
+    MB_EXT_PDC,
+    
+    /* AC */
+    MB_EXT_VAB,
+    MB_EXT_VBC,
+    MB_EXT_VCA,
+    MB_EXT_IA,
+    MB_EXT_IB,
+    MB_EXT_IC,
+    MB_EXT_FREQUENCY,
+    MB_EXT_PAC,
+    MB_EXT_QAC,
+    MB_EXT_SAC,
+    MB_EXT_PF,
+    
+    /* References */
+    MB_EXT_P_CMD,
+    MB_EXT_Q_CMD,
+    MB_EXT_P_REF,
+    MB_EXT_Q_REF,
+    MB_EXT_VDC_REF,
+    
+    /* Temperatures and losses */
+    MB_EXT_T_HEATSINK,
+    MB_EXT_T_INDUCTOR,
+    MB_EXT_T_AMBIENT,
+    MB_EXT_TJ_MAX,
+    MB_EXT_TJ_PRED_MAX,
+    MB_EXT_P_LOSS,
+    MB_EXT_DERATING,
+    
+    /* BMS */
+    MB_EXT_BMS_VOLTAGE,
+    MB_EXT_BMS_CURRENT,
+    MB_EXT_BMS_SOC,
+    MB_EXT_BMS_SOH,
+    MB_EXT_BMS_T_MAX,
+    MB_EXT_BMS_T_MIN,
+    MB_EXT_BMS_CHARGE_LIMIT,
+    MB_EXT_BMS_DISCHARGE_LIMIT,
+    MB_EXT_BMS_STATUS,
+    
+    /* Statistics and counters */
+    MB_EXT_EFFICIENCY,
+    MB_EXT_EFFICIENCY_EXPECTED,
+    MB_EXT_ENERGY_INVERTER,
+    MB_EXT_ENERGY_RECTIFIER,
+    MB_EXT_RUN_TIME,
+    MB_EXT_FAULT_COUNT,
+    MB_EXT_UPTIME,
+    MB_EXT_CYCLE_COUNT,
+    MB_EXT_EXEC_TIME,
+    
+    /* Switching and grid */
+    MB_EXT_FSW,
+    MB_EXT_GRID_SCR,
+    MB_EXT_GRID_R,
+    MB_EXT_GRID_L,
+    MB_EXT_ISLAND_DETECTIONS,
+    
+    /* Hardware fault path */
+    MB_EXT_HWFLT_TRIPS,
+    MB_EXT_HWFLT_INPUTS,
+    MB_EXT_HWFLT_REACT_MAX,
+    MB_EXT_SW_TRIP_LATENCY,
+    
+    /* Diagnostics block: ISR deadline supervision */
+    MB_EXT_ISR_LOAD,
+    MB_EXT_ISR_LOAD_MAX,
+    MB_EXT_ISR_OVERRUNS,
+    MB_EXT_ISR_LATE,
+    MB_EXT_ISR_SHED,
+    MB_EXT_LOOP_LATE,
+    MB_EXT_IWDG_RESET,
+    
+    /* Parameter store */
+    MB_EXT_PARAM_SEQ,
+    MB_EXT_PARAM_REJECTS,
+    MB_EXT_PARAM_NV,
+    MB_EXT_PARAM_NV_SEQ,
+    
+    MB_EXT_COUNT
+} ModbusExtId_t;
+
+#define MB_EXT_DIAG_FIRST       MB_EXT_ISR_LOAD             // First id of the diagnostics block
+#define MODBUS_EXT_HEADER       4           // Per block: version, values, words, sequence
+#define MODBUS_EXT_BLOCK_MAX    125         // Registers per block (one FC 04)
+#define MODBUS_EXT_DIAG_AT      (MODBUS_EXT_HEADER + 2 * MB_EXT_DIAG_FIRST)
+#define MODBUS_EXT_WORDS        (2 * MODBUS_EXT_HEADER + 2 * MB_EXT_COUNT)
+#define MODBUS_EXT_OFFSET(id)   (MODBUS_EXT_HEADER * ((id) < MB_EXT_DIAG_FIRST ? 1 : 2) + 2 * (id))
+#define MODBUS_DESC_HEADER      4           // Version, entries, words per entry, bank address
+#define MODBUS_DESC_ENTRY       12          // Offset, type/exponent, unit[4], name[16]
+#define MODBUS_DESC_WORDS       (MODBUS_DESC_HEADER + MODBUS_DESC_ENTRY * MB_EXT_COUNT)
+
+/* Parameter bank: holding registers 41001+ (MODBUS_PARAM_BASE), a header
+ * and one 32-bit value per ParamId_t, high word first; descriptors with
+ * the accepted range at 33001+ (MODBUS_PDESC_BASE) */
+#define MODBUS_PARAM_HEADER     4           // Version, values, words, descriptor address
+#define MODBUS_PARAM_WORDS      (MODBUS_PARAM_HEADER + 2 * PARAM_COUNT)
+#define MODBUS_PDESC_ENTRY      16          // Descriptor entry, then minimum and maximum
+#define MODBUS_PDESC_WORDS      (MODBUS_DESC_HEADER + MODBUS_PDESC_ENTRY * PARAM_COUNT)
+
+typedef struct {
+    uint16_t bank[MODBUS_EXT_WORDS];        // 31001+: converted on read, once per tick
+    uint16_t desc[MODBUS_DESC_WORDS];       // 32001+: built once at init
+    uint16_t param[MODBUS_PARAM_WORDS];     // 41001+: values in force, written by masters
+    uint16_t pdesc[MODBUS_PDESC_WORDS];     // 33001+: built once at init
+} ModbusExtended_t;
+
+/* Storage class of firmware instance state. Empty on target; host builds
+ * that run several firmware instances in parallel (Sim/ sweep) define it
+ * as _Thread_local so every thread owns a private copy. */
+#ifndef FW_INSTANCE_LOCAL
+#define FW_INSTANCE_LOCAL
+#endif
+
 /* Global system data instance (defined in main.c) */
-extern SystemData_t g_sys;
-extern ModbusRegisters_t g_modbus;
+extern FW_INSTANCE_LOCAL SystemData_t g_sys;
+extern FW_INSTANCE_LOCAL ModbusRegisters_t g_modbus;
+extern FW_INSTANCE_LOCAL ModbusExtended_t g_modbus_ext;
 
 #ifdef __cplusplus
 }
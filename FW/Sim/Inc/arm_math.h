@@ -0,0 +1,29 @@
+/**
+ * @file arm_math.h
+ * @brief Host shim of the CMSIS-DSP functions used by the firmware
+ * @version 2.1
+ */
+
+#ifndef __ARM_MATH_H
+#define __ARM_MATH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <math.h>
+
+/* Sine and cosine, angle in degrees. Same 512-point table with cubic
+ * interpolation as CMSIS-DSP, so results match the target closely. */
+void arm_sin_cos_f32(float theta, float *pSinVal, float *pCosVal);
+
+/* CMSIS core intrinsics (arm_math.h includes the core header on the
+ * target). The simulated ISR runs inline, but the bench CLIs run an
+ * interrupt side in a thread, so the barrier is a real fence. */
+static inline void __DMB(void) { __atomic_thread_fence(__ATOMIC_SEQ_CST); }
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ARM_MATH_H */
@@ -0,0 +1,52 @@
+/**
+ * @file bmsgen.h
+ * @brief Simulated BMS: CAN-FD Frames as the Firmware Receives Them
+ * @version 2.1
+ *
+ * Encodes a pack state into the frames of can_bms.h (pack, limits, cell
+ * voltage and temperature blocks), padded to a valid CAN-FD length, for
+ * the simulator (sim_hal.c) and the BMS bench (bms_main.c).
+ */
+
+#ifndef __BMSGEN_H
+#define __BMSGEN_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "can_bms.h"
+
+#define BMSGEN_CYCLE_MAX        (2U + BMS_CELL_BLOCKS + BMS_TEMP_BLOCKS)
+
+typedef struct {
+    float32_t pack_V;
+    float32_t current_A;            // + = discharge
+    float32_t soc;                  // [%]
+    float32_t soh;                  // [%]
+    uint32_t status;
+    float32_t charge_limit_A;
+    float32_t discharge_limit_A;
+    float32_t cell_V[BMS_CELL_COUNT];
+    float32_t cell_T[BMS_TEMP_COUNT];
+} BmsGen_t;
+
+/* One frame each */
+void BmsGen_Pack(const BmsGen_t *g, BmsFrame_t *f);
+void BmsGen_Limits(const BmsGen_t *g, BmsFrame_t *f);
+void BmsGen_Cells(const BmsGen_t *g, uint32_t block, BmsFrame_t *f);
+void BmsGen_Temps(const BmsGen_t *g, uint32_t block, BmsFrame_t *f);
+
+/* Frames of one BMS cycle in bus order: pack and limits, then with
+ * cells every cell and temperature block. All stamped stamp_ms; returns
+ * the count (at most BMSGEN_CYCLE_MAX). */
+uint32_t BmsGen_Cycle(const BmsGen_t *g, bool cells, uint32_t stamp_ms, BmsFrame_t *out);
+
+/* Time on the bus with bit rate switching, typical stuffing [µs] */
+double BmsGen_WireTime_us(const BmsFrame_t *f);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __BMSGEN_H */
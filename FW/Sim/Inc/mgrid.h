@@ -0,0 +1,104 @@
+/**
+ * @file mgrid.h
+ * @brief Multi-Unit Microgrid Simulation (paralleled inverters on one bus)
+ * @version 2.1
+ *
+ * Runs N firmware instances, one Sim_Run per thread, whose grid sides
+ * connect through their line impedance (each unit's L_grid/R_grid) to a
+ * shared AC bus. The bus carries a capacitance, an optional R/L load and
+ * the utility source behind its own impedance and breaker. Requires the
+ * thread-local build (-DFW_INSTANCE_LOCAL=_Thread_local -pthread).
+ *
+ * The units advance in lock-step: after every half carrier period each
+ * unit publishes its line current, waits at a barrier, and then steps its
+ * own copy of the bus with the sum of all currents. Every copy sees the
+ * same inputs in the same order, so the copies stay identical and the run
+ * is deterministic regardless of thread scheduling.
+ */
+
+#ifndef __MGRID_H
+#define __MGRID_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "sim.h"
+
+/* ============================================================================
+ * CONSTANTS
+ * ========================================================================== */
+#define MGRID_MAX_UNITS         8
+#define MGRID_MAX_EVENTS        16
+#define MGRID_TAIL_S            0.1         // P/Q, f, V averaging window before t_end
+#define MGRID_GLITCH_V_WIN_S    0.1         // Voltage glitch window after islanding
+#define MGRID_GLITCH_PH_WIN_S   0.02        // Phase glitch window after islanding
+#define MGRID_F_LPF_HZ          20.0        // Bus frequency estimate filter
+#define MGRID_LIVE_PU           0.9         // Bus live above this magnitude
+
+/* ============================================================================
+ * CONFIGURATION / RESULT
+ * ========================================================================== */
+typedef struct {
+    double C_bus;               // Bus capacitance (cables, other equipment) [F]
+    double R_load;              // Bus load resistance [Ω] (0 = none)
+    double L_load;              // Bus load inductance [H] (0 = none)
+    double L_src;               // Utility source inductance [H]
+    double R_src;               // Utility source resistance [Ω]
+    double V_ll_rms;            // Utility L-L voltage [V]
+    double f_src;               // Utility frequency [Hz]
+
+    /* vsag, freq, phase, island, rload; applied identically by all units */
+    SimEvent_t events[MGRID_MAX_EVENTS];
+    uint32_t n_events;
+} MgridBus_t;
+
+typedef struct {
+    uint32_t n_units;
+    SimConfig_t unit[MGRID_MAX_UNITS];      // Per-unit scenario (trace must be NULL)
+    MgridBus_t bus;
+
+    FILE *trace;                // Bus CSV (NULL = none), written by unit 0
+    uint32_t trace_decim;
+} MgridConfig_t;
+
+typedef struct {
+    SimResult_t sim;
+    int rc;                     // Sim_Run return code
+    double P_W;                 // Mean over MGRID_TAIL_S at the unit PCC, + = export
+    double Q_VAr;
+} MgridUnitResult_t;
+
+typedef struct {
+    MgridUnitResult_t unit[MGRID_MAX_UNITS];
+    double t_wall_s;
+
+    /* Bus (NaN when not applicable) */
+    double t_island_s;          // First utility breaker opening
+    double glitch_v_pct;        // Peak |ΔV| within MGRID_GLITCH_V_WIN_S [% of nominal]
+    double glitch_phase_deg;    // Peak phase step against the utility within MGRID_GLITCH_PH_WIN_S
+    double f_min_hz;            // Bus frequency extremes after islanding
+    double f_max_hz;
+    double f_final_hz;          // Mean over MGRID_TAIL_S
+    double v_final_pu;          // Mean magnitude over MGRID_TAIL_S
+    double share_p_pct;         // max |ΔP_k - mean ΔP| over running units, ΔP_k = P_k - p_ref_W [% of rating]
+    double share_q_pct;         // Same for Q against q_ref_VAr
+} MgridResult_t;
+
+/* ============================================================================
+ * API
+ * ========================================================================== */
+void Mgrid_DefaultConfig(MgridConfig_t *cfg, uint32_t n_units);
+bool Mgrid_ParseBusEvent(MgridConfig_t *cfg, const char *spec);    // "t:name:value"
+
+/* Runs all units to completion; returns 0 when every unit ran */
+int Mgrid_Run(MgridConfig_t *cfg, MgridResult_t *res);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __MGRID_H */
@@ -0,0 +1,216 @@
+/**
+ * @file plant.h
+ * @brief T-Type + LCL + Grid + Battery Plant Model for Host Simulation
+ * @version 2.1
+ * 
+ * Switched model of the 3-level T-Type bridge on a split DC link, LCL
+ * filter with optional local RLC load, Thevenin grid with programmable
+ * disturbances, a Thevenin battery behind pre-charge/main contactors and
+ * an optional constant-power load on the DC link.
+ * 
+ * The AC network is linear, so each half carrier period is integrated
+ * exactly with precomputed matrix exponentials. Switching edges and
+ * dead-time are resolved to PLANT_SUBSTEPS per nominal half period; the
+ * carrier period may be changed at any valley (whole substeps).
+ * 
+ * Semiconductor losses are taken from the switched waveform (conduction
+ * per segment, one commutation and one dead-time interval per edge) and
+ * heat a three-node Cauer ladder per switch position, which sits on a
+ * lumped heatsink cooled to ambient. They are accounted in every
+ * PLANT_LOSS_DECIM-th half period, weighted by the time since the
+ * previous one. The heatsink NTC follows the heatsink
+ * with a first-order lag. Losses and the terminal energies are also
+ * accumulated per category (PlantLoss_t) for efficiency measurement.
+ */
+
+#ifndef __PLANT_H
+#define __PLANT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* ============================================================================
+ * CONSTANTS
+ * ========================================================================== */
+#define PLANT_SUBSTEPS          256         // Edge resolution per nominal half period
+#define PLANT_NX                4           // [ic, vc, ig, iLload] per αβ axis
+#define PLANT_NU                2           // [v_conv, v_grid]
+#define PLANT_DC_LOAD_UVLO_V    400.0       // DC load off below this link voltage
+#define PLANT_TH_POSITIONS      9           // T1, T4, T2/T3 per phase
+#define PLANT_TH_ORDER          3           // Cauer nodes per position
+#define PLANT_TH_DECIM          20          // Nominal half periods per thermal step
+#define PLANT_LOSS_DECIM        5           // Half periods per loss accounting (odd)
+
+/* Network topology index: bit 0 = grid breaker closed, bit 1 = bridge
+ * connected (AC contactor closed and current flowing) */
+#define PLANT_NET_GRID          0x01U
+#define PLANT_NET_BRIDGE        0x02U
+#define PLANT_NET_COUNT         4
+
+/* ============================================================================
+ * PARAMETERS
+ * ========================================================================== */
+typedef struct {
+    /* LCL filter */
+    double Lc;              // Converter-side inductance [H]
+    double Rc;              // Converter-side inductor ESR [Ω]
+    double Cf;              // Filter capacitance [F]
+    double Lg;              // Grid-side inductance [H]
+    double Rg;              // Grid-side inductor ESR [Ω]
+    
+    /* Grid Thevenin source */
+    double L_grid;          // Grid inductance [H]
+    double R_grid;          // Grid resistance [Ω]
+    double V_ll_rms;        // Source L-L voltage [V]
+    double f_grid;          // Source frequency [Hz]
+    
+    /* Local load at PCC (0 = not fitted) */
+    double R_load;          // Parallel resistance [Ω]
+    double L_load;          // Parallel inductance [H]
+    double C_load;          // Parallel capacitance [F]
+    
+    /* DC link and battery */
+    double C_half;          // Each half of the split DC link [F]
+    double V_bat_nom;       // Battery open-circuit voltage at 50% SOC [V]
+    double V_bat_slope;     // OCV change over 0-100% SOC [V]
+    double R_bat;           // Battery + cable resistance [Ω]
+    double R_precharge;     // Pre-charge resistor [Ω]
+    double bat_capacity_Ah; // Battery capacity [Ah]
+    double soc0;            // Initial SOC [0..1]
+    double Vdc0;            // Initial DC-link voltage [V]
+    double P_dc_load;       // Constant-power load across the DC link [W]
+    
+    /* Thermal */
+    double T_ambient;       // Cooling air [°C]
+    double T_heatsink0;     // Initial heatsink temperature [°C]
+    double Rth_ha;          // Heatsink to ambient [K/W]
+    double C_hs;            // Heatsink heat capacity [J/K]
+    double tau_ntc;         // Heatsink NTC lag [s]
+    double th_accel;        // Thermal time compression (1 = real time)
+    
+    /* Bridge */
+    double f_hrtim;         // HRTIM tick rate [Hz]
+    uint32_t hrtim_period;  // Nominal carrier period in ticks
+    double t_half;          // Nominal half carrier period = control period [s]
+} PlantParams_t;
+
+/* ============================================================================
+ * STATE
+ * ========================================================================== */
+/* Energies since the last Plant_ResetLosses [J] */
+typedef struct {
+    double E_cond;                  // MOSFET channel conduction
+    double E_sw;                    // Commutation (Eon + Eoff)
+    double E_diode;                 // Body diodes (dead-time, freewheeling)
+    double E_cu_conv;               // Converter-side inductor ESR
+    double E_cu_grid;               // Grid-side inductor ESR
+    double E_core;                  // Converter-side inductor core
+    double E_bridge;                // Into the ideal bridge from the DC link
+    double E_pcc;                   // Out of the filter capacitor node (vc·ig)
+    double i2_t;                    // ∫ Σ ic² dt [A²·s]
+    double di_max;                  // Largest converter ripple in a half (peak-peak) [A]
+    double i_peak;                  // Largest converter current [A]
+    double halves;                  // Half carrier periods accumulated
+    double t;                       // Accumulation time [s]
+} PlantLoss_t;
+
+typedef struct {
+    PlantParams_t p;
+    
+    /* Time */
+    double t;                       // Simulation time [s]
+    uint64_t half_periods;          // Completed half periods
+    uint64_t ticks;                 // Elapsed HRTIM ticks
+    uint32_t period;                // Carrier period in force [ticks]
+    
+    /* AC network (αβ), see PLANT_NX ordering */
+    double x[2][PLANT_NX];
+    bool grid_breaker;              // Utility breaker (false = islanded)
+    bool ext_source;                // v_s driven externally (shared bus)
+    double vs_ext[2];               // External v_s at mid-step (αβ) [V]
+    
+    /* Grid source */
+    double theta_grid;              // Source angle [rad]
+    double omega_grid;              // Source angular frequency [rad/s]
+    double V_pk;                    // Source phase peak [V]
+    double h5_pu;                   // 5th harmonic content [pu]
+    double unbalance_pu;            // Negative sequence content [pu]
+    
+    /* Source phasor advanced by rotation instead of cos/sin per step */
+    double ph_cos, ph_sin;          // cos/sin of last mid-step angle
+    double ph_theta;                // Angle the phasor corresponds to
+    double rot_cos, rot_sin;        // Rotation by omega_grid·h
+    double rot_omega;               // omega_grid the rotation was built for
+    double rot_h;                   // Step h the rotation was built for
+    bool ph_valid;
+    uint32_t nx;                    // Active states (3 without load inductor)
+    
+    /* DC side */
+    double v_pos;                   // Upper DC-link half [V]
+    double v_neg;                   // Lower DC-link half [V]
+    double i_bat;                   // Battery current, + = discharge [A]
+    double i_dc_load;               // DC load current [A]
+    double soc;                     // State of charge [0..1]
+    double cell_dv;                 // Last cell above the pack average (BMS frames) [V]
+    double bms_limit_pu;            // BMS current limits in the frames [pu of IDC_MAX_A]
+    
+    /* Contactors / outputs */
+    bool relay_precharge;
+    bool relay_main;
+    bool relay_grid;
+    bool outputs_enabled;
+    
+    /* Bridge command: outer-switch on-time per phase, sign = level [ticks] */
+    int32_t on_ticks[3];
+    uint32_t dead_ticks;
+    int8_t level_end[3];            // Output level at the end of the last half
+    
+    /* Thermal (positions T1, T4, T2/T3 of phase a, then b, c) */
+    double th_E[PLANT_TH_POSITIONS];                    // Loss energy since last step [J]
+    double th_T[PLANT_TH_POSITIONS][PLANT_TH_ORDER];    // Cauer nodes, [0] = junction [°C]
+    double T_hs;                    // Heatsink [°C]
+    double T_ntc;                   // Heatsink NTC [°C]
+    uint32_t th_substeps;           // Substeps since the last thermal step
+    double loss_h;                  // Time since the last loss accounting [s]
+    PlantLoss_t loss;
+    
+    /* Exact discretisation tables, index = substeps (segments longer than
+     * PLANT_SUBSTEPS are taken in several pieces) */
+    double Phi[PLANT_NET_COUNT][PLANT_SUBSTEPS + 1][PLANT_NX][PLANT_NX];
+    double Gam[PLANT_NET_COUNT][PLANT_SUBSTEPS + 1][PLANT_NX][PLANT_NU];
+} Plant_t;
+
+/* Sampled quantities seen by the firmware sensors */
+typedef struct {
+    double Va, Vb, Vc;              // PCC phase voltages [V]
+    double Ia, Ib, Ic;              // Converter currents [A]
+    double Iga, Igb, Igc;           // Grid currents [A]
+    double Vdc_pos, Vdc_neg;        // DC-link halves [V]
+    double Idc;                     // Bridge DC input current [A]
+    double Vbat, Ibat;              // Battery terminal [V], [A]
+    double T_ntc;                   // Heatsink NTC [°C]
+} PlantSample_t;
+
+/* ============================================================================
+ * API
+ * ========================================================================== */
+void Plant_DefaultParams(PlantParams_t *p);
+void Plant_Init(Plant_t *pl, const PlantParams_t *p);
+void Plant_Rebuild(Plant_t *pl);        // After changing filter/grid/load params
+
+void Plant_StepHalfPeriod(Plant_t *pl, bool rising);
+void Plant_Sample(const Plant_t *pl, PlantSample_t *s);
+
+double Plant_BatteryOcv(const Plant_t *pl);
+double Plant_JunctionMax(const Plant_t *pl);
+void Plant_ResetLosses(Plant_t *pl);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __PLANT_H */
@@ -0,0 +1,49 @@
+/**
+ * @file replay.h
+ * @brief Replay of Recorder Images Through the Control ISR
+ * @version 2.1
+ *
+ * Loads a recorder image (see recorder.h), restores keyframes and command
+ * records into g_sys and runs HRTIM1_Master_IRQHandler once per recorded
+ * frame with the recorded ADC codes. Compare values written through
+ * HRTIM_SetDuty are checked against the recorded outputs and optionally
+ * written as CSV for comparison between firmware builds.
+ */
+
+#ifndef __REPLAY_H
+#define __REPLAY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "adc.h"
+
+typedef struct {
+    uint32_t blocks;            // Blocks replayed
+    uint32_t frames;            // ISR invocations
+    uint32_t outputs;           // Recorded outputs compared
+    uint32_t mismatches;        // Frames whose duties differ
+    int64_t first_mismatch;     // Frame index of first mismatch (-1 = none)
+    uint32_t field_skips;       // Keyframe/command fields not applied
+    uint32_t build_id;          // Firmware build of the recording
+    uint32_t trigger_frame;
+    uint32_t trigger_faults;
+} ReplayResult_t;
+
+/* Returns 0 on success (duties may still mismatch, see result) */
+int Replay_Run(const char *rec_path, FILE *csv, ReplayResult_t *res);
+
+/* Driver hooks (sim_hal.c) */
+bool Replay_Active(void);
+void Replay_GetRaw(AdcRaw_t *raw);
+void Replay_CaptureDuty(uint16_t duty_a, uint16_t duty_b, uint16_t duty_c);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __REPLAY_H */
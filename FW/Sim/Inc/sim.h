@@ -0,0 +1,256 @@
+/**
+ * @file sim.h
+ * @brief Firmware-in-the-Loop Simulation Engine
+ * @version 2.1
+ * 
+ * Runs the unmodified firmware (App_Init, App_MainLoop and the control
+ * ISR HRTIM1_Master_IRQHandler) against the plant model in virtual time.
+ * The ISR is invoked at every carrier crest and valley (200 kHz); the main
+ * loop every 10 ms; HAL_Delay advances the plant.
+ */
+
+#ifndef __SIM_H
+#define __SIM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "plant.h"
+
+/* ============================================================================
+ * CONSTANTS
+ * ========================================================================== */
+#define SIM_MAX_EVENTS          32
+#define SIM_MAIN_LOOP_MS        10
+#define SIM_METRIC_DECIM        10          // Metric sampling: every 10th nominal ISR (20 kHz)
+#define SIM_THD_MAX_HARMONIC    50
+#define SIM_VDC_SETTLE_V        1.0         // DC-link settling band [V]
+#define SIM_MAX_PARAMS          32          // --param overrides
+#define SIM_NV_SLOT_SIZE        2048        // Parameter store slot (one flash page)
+
+/* ============================================================================
+ * SCENARIO EVENTS
+ * ========================================================================== */
+typedef enum {
+    SIM_EV_VSAG = 0,        // Grid amplitude [pu of nominal]
+    SIM_EV_FREQ,            // Grid frequency [Hz]
+    SIM_EV_PHASE,           // Grid phase jump [deg]
+    SIM_EV_ISLAND,          // Utility breaker open (1) / closed (0)
+    SIM_EV_H5,              // 5th harmonic [pu]
+    SIM_EV_UNBALANCE,       // Negative sequence [pu]
+    SIM_EV_P_REF,           // Active power command [W]
+    SIM_EV_Q_REF,           // Reactive power command [VAr]
+    SIM_EV_ENABLE,          // Enable command (0/1)
+    SIM_EV_L_GRID,          // Grid inductance [H]
+    SIM_EV_R_LOAD,          // Local load resistance [Ω] (0 = none)
+    SIM_EV_ESTOP,           // E-stop input (0/1)
+    SIM_EV_DC_LOAD,         // DC-link load [W]
+    SIM_EV_VDC_REF,         // DC voltage reference [V]
+    SIM_EV_VDC_MODE,        // DC voltage control (1) / power reference (0)
+    SIM_EV_MODE,            // Modbus mode_select (OperationMode_t)
+    SIM_EV_FSW_FIX,         // Fixed switching frequency (1) / scheduled (0)
+    SIM_EV_L_LOAD,          // Local load inductance [H] (0 = none)
+    SIM_EV_C_LOAD,          // Local load capacitance [F] (0 = none)
+    SIM_EV_F_SLEW,          // Grid frequency ramp from now on [Hz/s] (0 = hold)
+    SIM_EV_TLM_MASK,        // Telemetry signal set (40007/40008, bit per signal id)
+    SIM_EV_TLM_RATE,        // Telemetry sample rate (40009) [Hz] (0 = off)
+    SIM_EV_CELL_DV,         // Last cell above the pack average in the BMS frames [V]
+    SIM_EV_Q_PRIO,          // Reactive current first at the limit (1) / active (0)
+    SIM_EV_BMS_LIMIT,       // BMS charge/discharge limits [pu of IDC_MAX_A]
+    SIM_EV_SOC,             // Battery state of charge [0..1]
+    SIM_EV_HW_FAULT,        // Fault inputs forced active (bit per HwFaultInput_t, 0 = release)
+    SIM_EV_ISR_DELAY,       // Control ISR entry held off [µs] (0 = none)
+    SIM_EV_PARAM_CMD,       // Parameter store command (40010, PARAM_CMD_*)
+    SIM_EV_COUNT
+} SimEventType_t;
+
+typedef struct {
+    double t;               // Event time [s]
+    SimEventType_t type;
+    double value;
+} SimEvent_t;
+
+/* ============================================================================
+ * RUNTIME GAIN OVERRIDES (applied to g_sys after App_Init)
+ * ========================================================================== */
+typedef enum {
+    SIM_GAIN_CURRENT_KP = 0,    // CURRENT_KP
+    SIM_GAIN_CURRENT_KR,        // CURRENT_KR
+    SIM_GAIN_CURRENT_WC,        // CURRENT_OMEGA_C
+    SIM_GAIN_PLL_KP,            // PLL_KP
+    SIM_GAIN_PLL_KI,            // PLL_KI
+    SIM_GAIN_VOLTAGE_KP,        // VOLTAGE_KP
+    SIM_GAIN_VOLTAGE_KI,        // VOLTAGE_KI
+    SIM_GAIN_AD_K,              // LCL_AD_GAIN
+    SIM_GAIN_COUNT
+} SimGain_t;
+
+/* ============================================================================
+ * CONFIGURATION / RESULT
+ * ========================================================================== */
+typedef struct {
+    PlantParams_t plant;
+    double t_end;               // Simulated duration [s]
+    double noise_i_A;           // Current sensor noise (1σ) [A]
+    double noise_v_V;           // Voltage sensor noise (1σ) [V]
+    uint32_t seed;              // Noise PRNG seed
+    
+    /* Commands at t = 0 (applied after events at t = 0 of the same kind) */
+    double p_ref_W;             // Active power command [W]
+    double q_ref_VAr;           // Reactive power command [VAr]
+    bool enable;                // Enable command
+    bool grid_present;          // Grid-presence input (false = off-grid site)
+    bool fixed_fsw;             // Switching frequency held at PWM_FREQUENCY_HZ
+    
+    SimEvent_t events[SIM_MAX_EVENTS];
+    uint32_t n_events;
+    
+    float gain[SIM_GAIN_COUNT]; // Override values
+    uint32_t gain_set;          // Bit per SimGain_t
+    
+    /* Parameter store: values staged after App_Init (checked like a
+     * Modbus write), and its flash image (NULL = erased, not kept) */
+    uint32_t param_id[SIM_MAX_PARAMS];      // ParamId_t
+    uint32_t param_raw[SIM_MAX_PARAMS];     // Value as stored (float bits for F32)
+    uint32_t n_params;
+    const char *nv_path;
+    
+    /* Metrics */
+    double metric_t0;           // Step instant [s] (< 0: entry into RUN)
+    double thd_window_s;        // THD window before t_end [s]
+    double loss_window_s;       // Loss/efficiency window before t_end [s]
+    double fra_hz;              // Loop gain injection frequency (0 = none) [Hz]
+    double fra_amp;             // Injection amplitude [compare counts]
+    
+    FILE *trace;                // CSV waveform output (NULL = none)
+    uint32_t trace_decim;       // Write every Nth ISR sample
+    FILE *telem_out;            // Telemetry stream bytes as on the line (NULL = none)
+    bool record;                // ISR recorder capturing (false: g_rec stays empty)
+    
+    /* External network coupling (NULL = Thevenin grid of the plant): called
+     * once after Plant_Init with init = true, then after every plant step.
+     * It owns pl->vs_ext and may change any plant parameter. */
+    void (*bus_step)(void *ctx, Plant_t *pl, bool init);
+    void *bus_ctx;
+} SimConfig_t;
+
+typedef struct {
+    double t_sim_s;             // Simulated time [s]
+    double t_wall_s;            // Host wall-clock time [s]
+    double speedup;             // t_sim / t_wall
+    uint64_t isr_count;         // Control ISR invocations
+    uint32_t final_state;       // SystemState_t at end
+    uint32_t faults;            // FaultCode_t at end
+    uint32_t fault_history;     // All faults raised during the run
+    
+    /* Metrics (NaN when not applicable) */
+    double t_run_s;             // First entry into RUN [s]
+    double first_trip_s;        // First fault [s]
+    double island_trip_ms;      // First fault after the utility breaker opened [ms]
+    uint32_t trip_count;        // Fault raising events
+    double thd_pct;             // Grid current THD, phase A, h2..h50 [%]
+    double rise_ms;             // Id 10 -> 90 % of the step after metric_t0
+    double settle_ms;           // Id settling to ±2 % of the step after metric_t0
+    double overshoot_pct;       // Id overshoot of the step after metric_t0
+    double id_err_rms;          // RMS(Id - Id_ref) over the last 20 ms [A]
+    double iae_dq;              // ∫(|Id - Id_ref| + |Iq - Iq_ref|) dt after metric_t0 [A·s]
+    double pll_iae;             // ∫|f_pll - f_grid| dt after metric_t0 [Hz·s]
+    double vdc_dev_V;           // Peak |Vdc - final| after metric_t0 [V]
+    double vdc_settle_ms;       // Vdc settling to ±SIM_VDC_SETTLE_V after metric_t0
+    double tj_ref_max;          // Hottest plant junction [°C]
+    double tj_est_max;          // Hottest firmware estimate (temps.T_max) [°C]
+    double tj_err_max;          // Peak |estimate - plant| of the hottest junction [K]
+    double grid_L_uH;           // Firmware grid inductance estimate at end (NaN = none) [µH]
+    double grid_scr;            // Firmware SCR estimate at end (NaN = none)
+    uint32_t gain_band;         // Gain band at end (0 = weak grid)
+    
+    /* Hardware fault path (NaN when no input tripped) */
+    uint32_t hw_fault_inputs;   // All fault inputs that tripped (bit per HwFaultInput_t)
+    double hw_trip_s;           // First trip: input asserted [s]
+    double hw_latency_us;       // First trip: input asserted to outputs off [µs]
+    
+    /* Control ISR deadline (firmware supervisor) */
+    double isr_load_max;        // Worst period [pu of the budget]
+    uint32_t isr_overruns;      // ISRs that ran into the next period
+    uint32_t isr_shed;          // Stages shed at end (SHED_* bits)
+    double isr_host_ns;         // Mean control ISR with outputs switching, host [ns]
+    double mpc_candidates;      // Mean FCS-MPC candidates per ISR (NaN for PR)
+    
+    /* Parameter store */
+    uint32_t param_seq;         // Sets published
+    uint32_t param_rejects;     // Sets refused
+    uint32_t param_nv;          // ParamNvStatus_t at end
+    uint32_t param_nv_seq;      // Newest valid record (0 = none)
+    
+    /* Plant losses over loss_window_s (NaN when the window was not reached) */
+    double p_cond_W;            // MOSFET conduction
+    double p_sw_W;              // Commutation
+    double p_diode_W;           // Body diodes
+    double p_cu_W;              // Inductor copper (Lc + Lg)
+    double p_core_W;            // Converter inductor core
+    double p_in_W;              // Source terminal (DC when exporting)
+    double p_out_W;             // Load terminal
+    double eff_pct;             // p_out / p_in
+    double i_rms_A;             // Converter current per phase
+    double fsw_kHz;             // Mean switching frequency
+    double ripple_pp_A;         // Largest converter ripple in a half period (peak-peak)
+    double i_peak_A;            // Largest converter current
+    
+    /* Current loop over thd_window_s while running (NaN when not measured) */
+    double loop_delay_us;       // Current sample to the centre of the pulse it sets
+    double fra_hz;              // Injection frequency, on the window's bins [Hz]
+    double loop_gain_db;        // |T(jω)| at fra_hz
+    double loop_phase_deg;      // ∠T(jω) at fra_hz, -180..180
+} SimResult_t;
+
+/* ============================================================================
+ * API
+ * ========================================================================== */
+void Sim_DefaultConfig(SimConfig_t *cfg);
+bool Sim_AddEvent(SimConfig_t *cfg, double t, SimEventType_t type, double value);
+bool Sim_ParseEvent(SimConfig_t *cfg, const char *spec);    // "t:name:value"
+bool Sim_ParseGain(SimConfig_t *cfg, const char *spec);     // "name=value"
+bool Sim_ParseParam(SimConfig_t *cfg, const char *spec);    // "name=value", in range
+const char* Sim_GainName(SimGain_t g);
+float Sim_GainValue(const SimConfig_t *cfg, SimGain_t g);   // Override or config.h
+
+/* Scenario option shared by fwsim and the sweep runner ("--p", "60000") */
+bool Sim_ParseOption(SimConfig_t *cfg, const char *opt, const char *value);
+int Sim_Run(const SimConfig_t *cfg, SimResult_t *res);
+
+/* Plant and configuration of the running simulation (for drivers) */
+Plant_t* Sim_GetPlant(void);
+const SimConfig_t* Sim_GetConfig(void);
+
+/* Advance virtual time with ISR execution (used by HAL_Delay) */
+void Sim_Advance(double dt_s);
+
+/* Sensor noise sample (1σ = 1) */
+double Sim_Gauss(void);
+
+/* Called by the HRTIM shim */
+void Sim_HrtimSetDuty(uint16_t duty_a, uint16_t duty_b, uint16_t duty_c);
+void Sim_HrtimSetOutputs(bool enabled);
+void Sim_HrtimSetDeadTime(uint16_t ticks);
+void Sim_HrtimSetUpdateMode(bool double_update);
+void Sim_HrtimSetPeriod(uint16_t period);
+bool Sim_HrtimAtCrest(void);
+void Sim_HrtimArmFaults(void);
+uint32_t Sim_HrtimFaultFlags(void);
+uint32_t Sim_HrtimFaultLevels(void);
+uint16_t Sim_HrtimEntryDelay(void);
+bool Sim_HrtimOverrun(void);
+
+/* Parameter store flash (false in replay: no store) */
+bool Sim_NvRead(uint32_t slot, void *dst, uint32_t len);
+bool Sim_NvWrite(uint32_t slot, const void *src, uint32_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SIM_H */
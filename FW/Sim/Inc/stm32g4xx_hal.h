@@ -0,0 +1,214 @@
+/**
+ * @file stm32g4xx_hal.h
+ * @brief Host shim of the STM32G4 HAL for the plant simulator
+ * @version 2.1
+ * 
+ * Provides just the types, constants and functions the firmware sources
+ * reference so that main.c, control.c and protection.c compile unchanged
+ * on Linux. Peripheral drivers (adc, hrtim, modbus, can_bms) are replaced
+ * by plant-backed implementations in sim_hal.c.
+ */
+
+#ifndef __STM32G4XX_HAL_H
+#define __STM32G4XX_HAL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <math.h>
+
+/* ============================================================================
+ * STATUS / HANDLES
+ * ========================================================================== */
+typedef enum {
+    HAL_OK = 0,
+    HAL_ERROR,
+    HAL_BUSY,
+    HAL_TIMEOUT
+} HAL_StatusTypeDef;
+
+typedef struct { void *Instance; } HRTIM_HandleTypeDef;
+typedef struct { void *Instance; } ADC_HandleTypeDef;
+typedef struct { void *Instance; } FDCAN_HandleTypeDef;
+typedef struct { void *Instance; } UART_HandleTypeDef;
+typedef struct { void *Instance; } TIM_HandleTypeDef;
+
+/* ============================================================================
+ * GPIO
+ * ========================================================================== */
+typedef struct {
+    uint16_t odr;           // Output data
+    uint16_t idr;           // Input data (driven by the simulator)
+} GPIO_TypeDef;
+
+typedef enum {
+    GPIO_PIN_RESET = 0,
+    GPIO_PIN_SET
+} GPIO_PinState;
+
+typedef struct {
+    uint32_t Pin;
+    uint32_t Mode;
+    uint32_t Pull;
+    uint32_t Speed;
+    uint32_t Alternate;
+} GPIO_InitTypeDef;
+
+/* Per-instance when the firmware runs multi-threaded (see types.h) */
+#ifndef FW_INSTANCE_LOCAL
+#define FW_INSTANCE_LOCAL
+#endif
+
+extern FW_INSTANCE_LOCAL GPIO_TypeDef sim_gpio[4];
+#define GPIOA                   (&sim_gpio[0])
+#define GPIOB                   (&sim_gpio[1])
+#define GPIOC                   (&sim_gpio[2])
+#define GPIOD                   (&sim_gpio[3])
+
+#define GPIO_PIN_0              ((uint16_t)0x0001)
+#define GPIO_PIN_1              ((uint16_t)0x0002)
+#define GPIO_PIN_2              ((uint16_t)0x0004)
+#define GPIO_PIN_3              ((uint16_t)0x0008)
+#define GPIO_PIN_4              ((uint16_t)0x0010)
+#define GPIO_PIN_5              ((uint16_t)0x0020)
+#define GPIO_PIN_6              ((uint16_t)0x0040)
+#define GPIO_PIN_7              ((uint16_t)0x0080)
+#define GPIO_PIN_8              ((uint16_t)0x0100)
+#define GPIO_PIN_9              ((uint16_t)0x0200)
+#define GPIO_PIN_10             ((uint16_t)0x0400)
+#define GPIO_PIN_11             ((uint16_t)0x0800)
+#define GPIO_PIN_12             ((uint16_t)0x1000)
+#define GPIO_PIN_13             ((uint16_t)0x2000)
+#define GPIO_PIN_14             ((uint16_t)0x4000)
+#define GPIO_PIN_15             ((uint16_t)0x8000)
+
+#define GPIO_MODE_INPUT         0x00U
+#define GPIO_MODE_OUTPUT_PP     0x01U
+#define GPIO_NOPULL             0x00U
+#define GPIO_PULLUP             0x01U
+#define GPIO_PULLDOWN           0x02U
+#define GPIO_SPEED_FREQ_LOW     0x00U
+
+void HAL_GPIO_Init(GPIO_TypeDef *port, GPIO_InitTypeDef *init);
+void HAL_GPIO_WritePin(GPIO_TypeDef *port, uint16_t pin, GPIO_PinState state);
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef *port, uint16_t pin);
+void HAL_GPIO_TogglePin(GPIO_TypeDef *port, uint16_t pin);
+
+#define __HAL_RCC_GPIOA_CLK_ENABLE()    do { } while (0)
+#define __HAL_RCC_GPIOB_CLK_ENABLE()    do { } while (0)
+#define __HAL_RCC_GPIOC_CLK_ENABLE()    do { } while (0)
+#define __HAL_RCC_GPIOD_CLK_ENABLE()    do { } while (0)
+
+/* ============================================================================
+ * RCC / PWR / FLASH (accepted and ignored)
+ * ========================================================================== */
+typedef struct {
+    uint32_t PLLState, PLLSource, PLLM, PLLN, PLLP, PLLQ, PLLR;
+} RCC_PLLInitTypeDef;
+
+typedef struct {
+    uint32_t OscillatorType;
+    uint32_t HSEState;
+    RCC_PLLInitTypeDef PLL;
+} RCC_OscInitTypeDef;
+
+typedef struct {
+    uint32_t ClockType;
+    uint32_t SYSCLKSource;
+    uint32_t AHBCLKDivider;
+    uint32_t APB1CLKDivider;
+    uint32_t APB2CLKDivider;
+} RCC_ClkInitTypeDef;
+
+#define RCC_OSCILLATORTYPE_HSE          0x01U
+#define RCC_HSE_ON                      0x01U
+#define RCC_PLL_ON                      0x02U
+#define RCC_PLLSOURCE_HSE               0x03U
+#define RCC_PLLM_DIV2                   0x01U
+#define RCC_PLLP_DIV2                   0x02U
+#define RCC_PLLQ_DIV2                   0x02U
+#define RCC_PLLR_DIV2                   0x02U
+#define RCC_CLOCKTYPE_SYSCLK            0x01U
+#define RCC_CLOCKTYPE_HCLK              0x02U
+#define RCC_CLOCKTYPE_PCLK1             0x04U
+#define RCC_CLOCKTYPE_PCLK2             0x08U
+#define RCC_SYSCLKSOURCE_PLLCLK         0x03U
+#define RCC_SYSCLK_DIV1                 0x00U
+#define RCC_HCLK_DIV1                   0x00U
+#define FLASH_LATENCY_8                 0x08U
+#define PWR_REGULATOR_VOLTAGE_SCALE1_BOOST 0x00U
+
+static inline HAL_StatusTypeDef HAL_Init(void) { return HAL_OK; }
+static inline HAL_StatusTypeDef HAL_RCC_OscConfig(RCC_OscInitTypeDef *o) { (void)o; return HAL_OK; }
+static inline HAL_StatusTypeDef HAL_RCC_ClockConfig(RCC_ClkInitTypeDef *c, uint32_t l) { (void)c; (void)l; return HAL_OK; }
+static inline HAL_StatusTypeDef HAL_PWREx_ControlVoltageScaling(uint32_t v) { (void)v; return HAL_OK; }
+
+#define RCC_FLAG_IWDGRST                0x7DU
+#define __HAL_RCC_GET_FLAG(flag)        (0U)
+#define __HAL_RCC_CLEAR_RESET_FLAGS()   do { } while (0)
+
+/* ============================================================================
+ * IWDG (accepted and ignored: the simulated main loop never stalls)
+ * ========================================================================== */
+typedef struct {
+    uint32_t Prescaler;
+    uint32_t Reload;
+    uint32_t Window;
+} IWDG_InitTypeDef;
+
+typedef struct {
+    void *Instance;
+    IWDG_InitTypeDef Init;
+} IWDG_HandleTypeDef;
+
+#define IWDG                            ((void *)0)
+#define IWDG_PRESCALER_32               0x03U
+#define IWDG_WINDOW_DISABLE             0x0FFFU
+#define __HAL_DBGMCU_FREEZE_IWDG()      do { } while (0)
+
+static inline HAL_StatusTypeDef HAL_IWDG_Init(IWDG_HandleTypeDef *h) { (void)h; return HAL_OK; }
+static inline HAL_StatusTypeDef HAL_IWDG_Refresh(IWDG_HandleTypeDef *h) { (void)h; return HAL_OK; }
+
+/* ============================================================================
+ * CORE (DWT cycle counter, interrupts)
+ * ========================================================================== */
+typedef struct {
+    volatile uint32_t CTRL;
+    volatile uint32_t CYCCNT;
+} DWT_Type;
+
+typedef struct {
+    volatile uint32_t DEMCR;
+} CoreDebug_Type;
+
+extern FW_INSTANCE_LOCAL DWT_Type sim_dwt;
+extern FW_INSTANCE_LOCAL CoreDebug_Type sim_core_debug;
+#define DWT                             (&sim_dwt)
+#define CoreDebug                       (&sim_core_debug)
+#define DWT_CTRL_CYCCNTENA_Msk          0x01U
+#define CoreDebug_DEMCR_TRCENA_Msk      0x01000000U
+
+static inline void __enable_irq(void) { }
+static inline void __disable_irq(void) { }
+
+/* ============================================================================
+ * HRTIM (interrupt flag handling only)
+ * ========================================================================== */
+#define HRTIM_MASTER_IT_MREP            0x04U
+#define __HAL_HRTIM_MASTER_CLEAR_IT(h, it)  do { (void)(h); (void)(it); } while (0)
+
+/* ============================================================================
+ * TIME BASE (virtual time, advanced by the simulator)
+ * ========================================================================== */
+uint32_t HAL_GetTick(void);
+void HAL_Delay(uint32_t delay_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __STM32G4XX_HAL_H */
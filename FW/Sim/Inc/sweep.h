@@ -0,0 +1,75 @@
+/**
+ * @file sweep.h
+ * @brief Parallel Scenario Sweep Runner for the Host Simulator
+ * @version 2.1
+ *
+ * Runs many independent Sim_Run scenarios on a work-stealing thread pool.
+ * Requires the sweep build (-DFW_INSTANCE_LOCAL=_Thread_local -pthread):
+ * each worker thread then owns a private copy of g_sys, g_modbus, the
+ * recorder and the simulator context, so scenarios never share state.
+ *
+ * Results are written as a columnar file (one block per metric):
+ *   "SWPC" u32 version, u32 n_rows, u32 n_cols, then per column
+ *   u8 type ('f' f64 / 'u' u32 / 's' string), u8 name length, name,
+ *   n_rows values ('s': u8 length + bytes each). Little endian.
+ * Sim/tools/sweep_read.py reads it.
+ */
+
+#ifndef __SWEEP_H
+#define __SWEEP_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdio.h>
+#include "sim.h"
+
+/* ============================================================================
+ * CONSTANTS
+ * ========================================================================== */
+#define SWEEP_NAME_LEN          96
+#define SWEEP_FORMAT_VERSION    1
+#define SWEEP_MAGIC             "SWPC"
+
+/* ============================================================================
+ * TYPES
+ * ========================================================================== */
+typedef struct {
+    char name[SWEEP_NAME_LEN];
+    SimConfig_t cfg;            // trace must be NULL
+    SimResult_t res;
+    int rc;                     // Sim_Run return code
+    double t_cpu_s;             // Thread CPU time of the job
+} SweepJob_t;
+
+typedef struct {
+    uint32_t threads;
+    double t_wall_s;            // Whole sweep
+    double t_sim_s;             // Sum of simulated time
+    double t_busy_s;            // Sum of job CPU time
+    uint64_t steals;            // Jobs taken from another worker's queue
+} SweepStats_t;
+
+/* ============================================================================
+ * API
+ * ========================================================================== */
+uint32_t Sweep_CpuCount(void);
+bool Sweep_Parallel(void);      // Built with per-thread firmware state
+
+/* Scenario file (format in sweep_main.c); *jobs is malloc'ed */
+int Sweep_LoadScenarios(const char *path, SweepJob_t **jobs, uint32_t *n_jobs);
+
+/* Runs all jobs on n_threads workers; returns 0 when every job ran */
+int Sweep_Run(SweepJob_t *jobs, uint32_t n_jobs, uint32_t n_threads, SweepStats_t *stats);
+
+/* Result files: columnar binary / CSV with the same columns */
+int Sweep_WriteColumns(const char *path, const SweepJob_t *jobs, uint32_t n_jobs);
+int Sweep_WriteCsv(FILE *f, const SweepJob_t *jobs, uint32_t n_jobs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SWEEP_H */
@@ -0,0 +1,76 @@
+/**
+ * @file arm_math.c
+ * @brief Host implementation of the CMSIS-DSP functions used by the firmware
+ * @version 2.1
+ * @date 2025-12
+ */
+
+#include "arm_math.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/* ============================================================================
+ * CONSTANTS
+ * ========================================================================== */
+#define FAST_MATH_TABLE_SIZE    512
+
+/* ============================================================================
+ * PRIVATE VARIABLES
+ * ========================================================================== */
+/* Built lazily per thread: no locking needed in parallel sweeps */
+static _Thread_local float sin_table[FAST_MATH_TABLE_SIZE + 1];
+static _Thread_local bool sin_table_ready = false;
+
+static void BuildTable(void)
+{
+    for (int i = 0; i <= FAST_MATH_TABLE_SIZE; i++) {
+        sin_table[i] = (float)sin(6.283185307179586 * i / FAST_MATH_TABLE_SIZE);
+    }
+    sin_table_ready = true;
+}
+
+/* ============================================================================
+ * SINE / COSINE (degrees)
+ * ========================================================================== */
+void arm_sin_cos_f32(float theta, float *pSinVal, float *pCosVal)
+{
+    const float Dn = 0.0122718463030f;     // 2π / table size
+    float in, findex, fract, f1, f2, d1, d2, Df, temp;
+    uint16_t indexS, indexC;
+    
+    if (!sin_table_ready) BuildTable();
+    
+    /* Normalise to [0, 1) of a turn */
+    in = theta * 0.00277777777778f;
+    if (in < 0.0f) in = -in;
+    in = in - (float)(int32_t)in;
+    
+    findex = (float)FAST_MATH_TABLE_SIZE * in;
+    indexS = ((uint16_t)findex) & 0x1ff;
+    indexC = (indexS + (FAST_MATH_TABLE_SIZE / 4)) & 0x1ff;
+    fract = findex - (float)indexS;
+    
+    /* Cosine: Hermite interpolation with the sine table as derivative */
+    f1 = sin_table[indexC];
+    f2 = sin_table[indexC + 1];
+    d1 = -sin_table[indexS];
+    d2 = -sin_table[indexS + 1];
+    Df = f2 - f1;
+    temp = Dn * (d1 + d2) - 2.0f * Df;
+    temp = fract * temp + (3.0f * Df - (d2 + 2.0f * d1) * Dn);
+    temp = fract * temp + d1 * Dn;
+    *pCosVal = fract * temp + f1;
+    
+    /* Sine */
+    f1 = sin_table[indexS];
+    f2 = sin_table[indexS + 1];
+    d1 = sin_table[indexC];
+    d2 = sin_table[indexC + 1];
+    Df = f2 - f1;
+    temp = Dn * (d1 + d2) - 2.0f * Df;
+    temp = fract * temp + (3.0f * Df - (d2 + 2.0f * d1) * Dn);
+    temp = fract * temp + d1 * Dn;
+    *pSinVal = fract * temp + f1;
+    
+    if (theta < 0.0f) *pSinVal = -*pSinVal;
+}
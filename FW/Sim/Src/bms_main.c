@@ -0,0 +1,520 @@
+/**
+ * @file bms_main.c
+ * @brief CAN-FD BMS Frame-to-Limit Latency Bench
+ * @version 2.1
+ * @date 2025-12
+ *
+ * Usage: fwbms [options]
+ *   --seconds <s>         Run time per driver model (default 3)
+ *   --tick-ms <ms>        Main-loop period (default 10)
+ *   --pack-ms <ms>        BMS pack and limit frame period (default 10)
+ *   --cell-ms <ms>        BMS cell and temperature period (default 100)
+ *
+ * First checks the firmware frame engine (Src/can_bms_frames.c) on its
+ * own: every cell, temperature and pack value through encode and decode,
+ * rejected frames, a full mailbox, freshness windows, a cell block that
+ * stops arriving, and the cell-level taper.
+ *
+ * Then a simulated BMS (bmsgen.c) sends on a virtual bus: each frame is
+ * delivered when its last bit would arrive at CAN_BAUDRATE /
+ * CAN_FD_BAUDRATE, pack and limits every --pack-ms, the eight cell
+ * blocks and the temperatures every --cell-ms, in one burst. The BMS
+ * discharge limit changes with every limit frame and the voltage of the
+ * last cell (last block of the burst) steps inside the charge taper with
+ * every cell cycle, so every frame that arrives changes a limit.
+ *
+ * A main-loop thread runs every --tick-ms, as App_MainLoop, and measures
+ * from the arrival of a frame to the pass whose refresh changed the
+ * limit, for two receive paths:
+ *
+ *   polled   frames wait in the three-element FDCAN RX FIFO until the
+ *            main loop reads it; the rest of a burst is lost
+ *   mailbox  the RX interrupt (here the bus thread) moves every frame
+ *            into the lock-free mailbox at arrival (can_bms.c)
+ *
+ * Exits 1 on a failed check or a frame lost by the mailbox path.
+ */
+
+#define _GNU_SOURCE                 // clock_nanosleep
+
+#include "can_bms.h"
+#include "bmsgen.h"
+#include "config.h"
+#include "arm_math.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <time.h>
+
+/* ============================================================================
+ * CONSTANTS
+ * ========================================================================== */
+#define HW_FIFO_DEPTH           3           // FDCAN RX FIFO 0 elements (STM32G4)
+#define RAMP_CELL               (BMS_CELL_COUNT - 1)
+#define WARMUP_MS               300U        // Before stale ticks are counted
+#define COST_LOOPS              20000
+
+typedef enum {
+    MODEL_POLLED = 0,
+    MODEL_MAILBOX,
+    MODEL_COUNT
+} Model_t;
+
+static const char *const model_name[MODEL_COUNT] = { "polled", "mailbox" };
+
+/* ============================================================================
+ * PRIVATE VARIABLES
+ * ========================================================================== */
+static struct {
+    double seconds;
+    uint32_t tick_ms;
+    uint32_t pack_ms;
+    uint32_t cell_ms;
+} bench;
+
+/* Shared by the bus thread (producer) and the main-loop thread */
+static struct {
+    Model_t model;
+    double t0;                      // Epoch of the run [s]
+    volatile int running;
+
+    /* mailbox path: mailbox and arrival time of each slot [s] */
+    BmsMailbox_t mbox;
+    double arrival[BMS_MAILBOX_DEPTH];
+
+    /* polled path: hardware FIFO */
+    pthread_mutex_t lock;
+    BmsFrame_t fifo[HW_FIFO_DEPTH];
+    double fifo_arrival[HW_FIFO_DEPTH];
+    uint32_t fifo_n;
+    uint32_t fifo_lost;
+
+    /* Bus statistics */
+    uint32_t sent;
+    uint32_t limit_frames;
+    uint32_t cell_cycles;
+} link;
+
+/* Main-loop results */
+typedef struct {
+    double *lat;
+    uint32_t n;
+} Samples_t;
+
+static Samples_t lat_limits, lat_cells;
+static uint32_t ticks, stale_ticks, decoded;
+static uint32_t failures;
+
+/* ============================================================================
+ * HELPERS
+ * ========================================================================== */
+static double Now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + 1e-9 * (double)ts.tv_nsec;
+}
+
+static void SleepUntil(double t)
+{
+    struct timespec ts;
+    ts.tv_sec = (time_t)t;
+    ts.tv_nsec = (long)((t - (double)ts.tv_sec) * 1e9);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0) { }
+}
+
+/* Bench time as the HAL tick */
+static uint32_t TickMs(double t)
+{
+    return (uint32_t)((t - link.t0) * 1000.0);
+}
+
+static int CompareDouble(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void Check(const char *what, bool ok)
+{
+    printf("  %-48s %s\n", what, ok ? "ok" : "FAIL");
+    if (!ok) failures++;
+}
+
+/* Pack with distinct cell voltages and temperatures */
+static void FillPack(BmsGen_t *g)
+{
+    memset(g, 0, sizeof(*g));
+    g->pack_V = 851.3f;
+    g->current_A = -123.4f;
+    g->soc = 57.25f;
+    g->soh = 98.5f;
+    g->status = 0x00A50003U;
+    g->charge_limit_A = 150.0f;
+    g->discharge_limit_A = 175.5f;
+    for (uint32_t i = 0; i < BMS_CELL_COUNT; i++) {
+        g->cell_V[i] = 3.400f + 0.001f * (float32_t)(i % 200);
+    }
+    for (uint32_t i = 0; i < BMS_TEMP_COUNT; i++) {
+        g->cell_T[i] = 20.0f + (float32_t)(i % 20);
+    }
+}
+
+static void PushAll(BmsMailbox_t *mb, const BmsFrame_t *f, uint32_t n)
+{
+    for (uint32_t i = 0; i < n; i++) CAN_BMS_Push(mb, &f[i]);
+}
+
+/* ============================================================================
+ * FRAME ENGINE CHECKS
+ * ========================================================================== */
+static void EngineChecks(void)
+{
+    static BmsMailbox_t mb;
+    static BmsData_t bms;
+    BmsGen_t g;
+    BmsFrame_t f[BMSGEN_CYCLE_MAX], bad;
+    bool ok = true;
+    uint32_t n;
+
+    printf("frame engine (%u cells in %u blocks, %u sensors, mailbox %u):\n",
+           (unsigned)BMS_CELL_COUNT, (unsigned)BMS_CELL_BLOCKS, (unsigned)BMS_TEMP_COUNT,
+           (unsigned)BMS_MAILBOX_DEPTH);
+
+    /* Values through encode, mailbox, decode */
+    FillPack(&g);
+    CAN_BMS_Reset(&bms);
+    n = BmsGen_Cycle(&g, true, 1000U, f);
+    PushAll(&mb, f, n);
+    Check("one cycle decoded", CAN_BMS_Drain(&mb, &bms, 1000U) == n && bms.rx_frames == n);
+    for (uint32_t i = 0; i < BMS_CELL_COUNT; i++) ok = ok && fabsf(bms.cell_voltage[i] - g.cell_V[i]) < 0.6e-3f;
+    Check("cell voltages", ok);
+    ok = true;
+    for (uint32_t i = 0; i < BMS_TEMP_COUNT; i++) ok = ok && bms.cell_temperature[i] == g.cell_T[i];
+    Check("cell temperatures", ok);
+    Check("pack values", fabsf(bms.voltage - g.pack_V) < 0.051f && fabsf(bms.current - g.current_A) < 0.051f &&
+          fabsf(bms.soc - g.soc) < 0.006f && fabsf(bms.soh - g.soh) < 0.006f && bms.status == g.status);
+    Check("cell extremes", bms.cell_v_max_idx == 199U && bms.cell_v_min_idx == 0U &&
+          bms.temperature_max == 39.0f && bms.temperature_min == 20.0f);
+    Check("limits untapered", bms.charge_limit == 150.0f && bms.discharge_limit == 175.5f);
+    Check("all groups seen, fresh, valid", bms.seen == (1UL << BMS_GRP_COUNT) - 1UL &&
+          bms.stale == 0U && bms.valid);
+
+    /* Rejected frames leave the data alone */
+    bad = f[2];
+    bad.id = BMS_NODE_ID + 0x05U;
+    CAN_BMS_Decode(&bms, &bad);
+    bad.id = BMS_ID_CELLS;
+    bad.data[0] = BMS_CELL_BLOCKS;
+    CAN_BMS_Decode(&bms, &bad);
+    bad.data[0] = 0;
+    bad.len = 12;
+    CAN_BMS_Decode(&bms, &bad);
+    bad = f[0];
+    bad.len = 8;
+    CAN_BMS_Decode(&bms, &bad);
+    Check("unknown id, block, short frames rejected", bms.bad_frames == 4U && bms.rx_frames == n &&
+          fabsf(bms.cell_voltage[0] - g.cell_V[0]) < 0.6e-3f);
+
+    /* Full mailbox */
+    for (uint32_t i = 0; i < BMS_MAILBOX_DEPTH + 3U; i++) CAN_BMS_Push(&mb, &f[0]);
+    Check("full mailbox counts drops", CAN_BMS_Drain(&mb, &bms, 1000U) == BMS_MAILBOX_DEPTH &&
+          bms.dropped == 3U);
+
+    /* Freshness by RX stamp */
+    CAN_BMS_Refresh(&bms, 1000U + BMS_FRESH_MS + 1U);
+    Check("stale limits drop to zero", (bms.stale & (1UL << BMS_GRP_LIMITS)) && bms.valid &&
+          bms.charge_limit == 0.0f && bms.discharge_limit == 0.0f);
+    CAN_BMS_Refresh(&bms, 1000U + BMS_TIMEOUT_MS + 1U);
+    Check("timeout invalidates", !bms.valid && CAN_BMS_Age(&bms, 1000U + BMS_TIMEOUT_MS + 1U) ==
+          BMS_TIMEOUT_MS + 1U);
+
+    /* A frame received during the drain is new, not 4 billion ms old */
+    n = BmsGen_Cycle(&g, true, 2000U, f);
+    PushAll(&mb, f, n);
+    CAN_BMS_Drain(&mb, &bms, 1999U);
+    Check("frame stamped after now is fresh", bms.stale == 0U && bms.valid);
+
+    /* Block 3 stops arriving: the group ages with it */
+    for (uint32_t k = 1; k <= 12; k++) {
+        n = BmsGen_Cycle(&g, true, 2000U + 100U * k, f);
+        for (uint32_t i = 0; i < n; i++) {
+            if (f[i].id != BMS_ID_CELLS || f[i].data[0] != 3U) CAN_BMS_Push(&mb, &f[i]);
+        }
+        CAN_BMS_Drain(&mb, &bms, 2000U + 100U * k);
+    }
+    Check("missing cell block makes the group stale", bms.rx_ms[BMS_GRP_CELL_V] == 2000U &&
+          (bms.stale & (1UL << BMS_GRP_CELL_V)) && bms.charge_limit == 0.0f);
+
+    /* Cell taper: one cell halfway into the charge window, then over the
+     * temperature taper start */
+    g.cell_V[RAMP_CELL] = 0.5f * (BMS_CELL_V_CHG_TAPER + BMS_CELL_V_MAX);
+    n = BmsGen_Cycle(&g, true, 4000U, f);
+    PushAll(&mb, f, n);
+    CAN_BMS_Drain(&mb, &bms, 4000U);
+    Check("charge taper at a high cell", fabsf(bms.charge_limit - 75.0f) < 1.0f &&
+          bms.discharge_limit == 175.5f && bms.cell_v_max_idx == RAMP_CELL);
+    g.cell_T[7] = 0.5f * (BMS_CELL_T_TAPER + BMS_CELL_T_MAX);
+    g.cell_T[8] = -3.0f;
+    n = BmsGen_Cycle(&g, true, 4100U, f);
+    PushAll(&mb, f, n);
+    CAN_BMS_Drain(&mb, &bms, 4100U);
+    Check("temperature taper, no charge below 0 C", bms.charge_limit == 0.0f &&
+          fabsf(bms.discharge_limit - 87.75f) < 0.5f);
+
+    /* Main-loop cost of a full burst */
+    FillPack(&g);
+    n = BmsGen_Cycle(&g, true, 5000U, f);
+    double t = Now();
+    for (uint32_t k = 0; k < COST_LOOPS; k++) {
+        PushAll(&mb, f, n);
+        CAN_BMS_Drain(&mb, &bms, 5000U);
+    }
+    printf("  drain and refresh of one burst (%u frames): %.2f us\n", (unsigned)n,
+           (Now() - t) * 1e6 / COST_LOOPS);
+}
+
+/* ============================================================================
+ * BUS THREAD (BMS, bus and RX interrupt)
+ * ========================================================================== */
+static void Deliver(const BmsFrame_t *frame, double t)
+{
+    BmsFrame_t f = *frame;
+    f.stamp_ms = TickMs(t);
+
+    if (link.model == MODEL_MAILBOX) {
+        /* RX interrupt: arrival time before the slot is published (a
+         * full mailbox keeps the slot's time for the consumer) */
+        if (link.mbox.head - link.mbox.tail < BMS_MAILBOX_DEPTH) {
+            link.arrival[link.mbox.head & (BMS_MAILBOX_DEPTH - 1U)] = t;
+        }
+        CAN_BMS_Push(&link.mbox, &f);
+    } else {
+        pthread_mutex_lock(&link.lock);
+        if (link.fifo_n < HW_FIFO_DEPTH) {
+            link.fifo[link.fifo_n] = f;
+            link.fifo_arrival[link.fifo_n] = t;
+            link.fifo_n++;
+        } else {
+            link.fifo_lost++;
+        }
+        pthread_mutex_unlock(&link.lock);
+    }
+    link.sent++;
+}
+
+static void *BusThread(void *arg)
+{
+    BmsGen_t g;
+    BmsFrame_t f[BMSGEN_CYCLE_MAX];
+    (void)arg;
+
+    FillPack(&g);
+    for (uint32_t i = 0; i < BMS_CELL_COUNT; i++) g.cell_V[i] = 3.600f;
+    g.charge_limit_A = 180.0f;
+
+    /* Bursts offset from the main-loop ticks */
+    for (uint32_t k = 0; link.running; k++) {
+        double t = link.t0 + 3.3e-3 + 1e-3 * bench.pack_ms * k;
+        bool cells = ((k * bench.pack_ms) % bench.cell_ms) == 0U;
+
+        g.discharge_limit_A = 100.0f + 0.5f * (float32_t)(k % 100U);
+        if (cells) {
+            g.cell_V[RAMP_CELL] = BMS_CELL_V_CHG_TAPER + 0.005f + 0.005f * (float32_t)(link.cell_cycles % 8U);
+            link.cell_cycles++;
+        }
+        link.limit_frames++;
+
+        uint32_t n = BmsGen_Cycle(&g, cells, 0U, f);
+        for (uint32_t i = 0; i < n; i++) {
+            t += BmsGen_WireTime_us(&f[i]) * 1e-6;
+            SleepUntil(t);
+            Deliver(&f[i], Now());
+        }
+    }
+    return NULL;
+}
+
+/* ============================================================================
+ * MAIN-LOOP THREAD
+ * ========================================================================== */
+static void Sample(Samples_t *s, double dt)
+{
+    s->lat[s->n++] = dt;
+}
+
+static void *MainLoopThread(void *arg)
+{
+    static BmsData_t bms;
+    const uint32_t n_ticks = (uint32_t)(bench.seconds * 1000.0 / bench.tick_ms);
+    (void)arg;
+
+    CAN_BMS_Reset(&bms);
+    for (uint32_t j = 1; j <= n_ticks; j++) {
+        double newest[BMS_GRP_COUNT];
+        BmsFrame_t frames[BMS_MAILBOX_DEPTH];
+        double arrival[BMS_MAILBOX_DEPTH];
+        uint32_t n = 0;
+
+        SleepUntil(link.t0 + 1e-3 * bench.tick_ms * j);
+        const double now = Now();
+        const float32_t chg = bms.charge_limit, dis = bms.discharge_limit;
+
+        /* Collect what the path holds at this pass */
+        if (link.model == MODEL_MAILBOX) {
+            while (n < BMS_MAILBOX_DEPTH && link.mbox.head != link.mbox.tail) {
+                __DMB();
+                arrival[n] = link.arrival[link.mbox.tail & (BMS_MAILBOX_DEPTH - 1U)];
+                CAN_BMS_Pop(&link.mbox, &frames[n]);
+                n++;
+            }
+        } else {
+            pthread_mutex_lock(&link.lock);
+            for (n = 0; n < link.fifo_n; n++) {
+                frames[n] = link.fifo[n];
+                arrival[n] = link.fifo_arrival[n];
+            }
+            link.fifo_n = 0;
+            pthread_mutex_unlock(&link.lock);
+        }
+
+        for (uint32_t g = 0; g < BMS_GRP_COUNT; g++) newest[g] = -1.0;
+        for (uint32_t i = 0; i < n; i++) {
+            BmsGroup_t grp = CAN_BMS_Decode(&bms, &frames[i]);
+            if (grp < BMS_GRP_COUNT) newest[grp] = arrival[i];
+        }
+        decoded += n;
+        CAN_BMS_Refresh(&bms, TickMs(now));
+
+        /* Latency from the frame that carried the change */
+        if (bms.discharge_limit != dis && newest[BMS_GRP_LIMITS] >= 0.0) {
+            Sample(&lat_limits, now - newest[BMS_GRP_LIMITS]);
+        }
+        if (bms.charge_limit != chg && newest[BMS_GRP_CELL_V] >= 0.0) {
+            Sample(&lat_cells, now - newest[BMS_GRP_CELL_V]);
+        }
+        ticks++;
+        if (TickMs(now) >= WARMUP_MS && (bms.stale & (1UL << BMS_GRP_CELL_V))) stale_ticks++;
+    }
+    return NULL;
+}
+
+/* ============================================================================
+ * RUN
+ * ========================================================================== */
+static void Report(const char *path, Samples_t *s, uint32_t sent)
+{
+    double sum = 0.0;
+
+    if (s->n == 0U) {
+        printf("  %-24s %6u/%-6u %9s %9s %9s\n", path, 0U, (unsigned)sent, "-", "-", "-");
+        return;
+    }
+    qsort(s->lat, s->n, sizeof(double), CompareDouble);
+    for (uint32_t i = 0; i < s->n; i++) sum += s->lat[i];
+    printf("  %-24s %6u/%-6u %9.2f %9.2f %9.2f\n", path, (unsigned)s->n, (unsigned)sent,
+           1e3 * sum / s->n, 1e3 * s->lat[(uint32_t)(0.99 * (s->n - 1U))], 1e3 * s->lat[s->n - 1U]);
+}
+
+static void Run(Model_t model)
+{
+    pthread_t bus, loop;
+
+    memset(&link.mbox, 0, sizeof(link.mbox));
+    link.model = model;
+    link.fifo_n = 0;
+    link.fifo_lost = 0;
+    link.sent = 0;
+    link.limit_frames = 0;
+    link.cell_cycles = 0;
+    lat_limits.n = 0;
+    lat_cells.n = 0;
+    ticks = 0;
+    stale_ticks = 0;
+    decoded = 0;
+
+    link.running = 1;
+    link.t0 = Now() + 0.01;
+    if (pthread_create(&bus, NULL, BusThread, NULL) != 0 ||
+        pthread_create(&loop, NULL, MainLoopThread, NULL) != 0) {
+        failures++;
+        return;
+    }
+    pthread_join(loop, NULL);
+    link.running = 0;
+    pthread_join(bus, NULL);
+
+    const uint32_t lost = (model == MODEL_MAILBOX) ? link.mbox.dropped : link.fifo_lost;
+    printf("%s: %u frames sent, %u decoded, %u lost; cell group stale in %.0f %% of ticks\n",
+           model_name[model], (unsigned)link.sent, (unsigned)decoded, (unsigned)lost,
+           100.0 * stale_ticks / (ticks > 0U ? ticks : 1U));
+    printf("  %-24s %13s %9s %9s %9s\n", "frame -> limit", "updates", "mean_ms", "p99_ms", "max_ms");
+    Report("limit frame -> discharge", &lat_limits, link.limit_frames);
+    Report("cell frame -> charge", &lat_cells, link.cell_cycles);
+
+    if (model == MODEL_MAILBOX && (lost != 0U || lat_cells.n == 0U)) failures++;
+}
+
+/* ============================================================================
+ * MAIN
+ * ========================================================================== */
+static void Usage(const char *argv0)
+{
+    fprintf(stderr, "usage: %s [--seconds s] [--tick-ms ms] [--pack-ms ms] [--cell-ms ms]\n", argv0);
+}
+
+int main(int argc, char **argv)
+{
+    bench.seconds = 3.0;
+    bench.tick_ms = 10;
+    bench.pack_ms = 10;
+    bench.cell_ms = 100;
+
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        const char *v = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+        if (v == NULL) { Usage(argv[0]); return 1; }
+        i++;
+
+        if (strcmp(a, "--seconds") == 0)            bench.seconds = atof(v);
+        else if (strcmp(a, "--tick-ms") == 0)       bench.tick_ms = (uint32_t)strtoul(v, NULL, 0);
+        else if (strcmp(a, "--pack-ms") == 0)       bench.pack_ms = (uint32_t)strtoul(v, NULL, 0);
+        else if (strcmp(a, "--cell-ms") == 0)       bench.cell_ms = (uint32_t)strtoul(v, NULL, 0);
+        else { Usage(argv[0]); return 1; }
+    }
+    if (!(bench.seconds > 0.0) || bench.tick_ms == 0U || bench.pack_ms == 0U ||
+        bench.cell_ms < bench.pack_ms) {
+        Usage(argv[0]);
+        return 1;
+    }
+
+    EngineChecks();
+
+    /* Burst on the bus */
+    {
+        BmsGen_t g;
+        BmsFrame_t f[BMSGEN_CYCLE_MAX];
+        double wire = 0.0;
+        FillPack(&g);
+        uint32_t n = BmsGen_Cycle(&g, true, 0U, f);
+        for (uint32_t i = 0; i < n; i++) wire += BmsGen_WireTime_us(&f[i]);
+        printf("\nBMS cycle: %u frames, %.2f ms on the bus at %u / %u kbit/s; main loop every %u ms\n",
+               (unsigned)n, wire * 1e-3, (unsigned)(CAN_BAUDRATE / 1000), (unsigned)(CAN_FD_BAUDRATE / 1000),
+               (unsigned)bench.tick_ms);
+    }
+
+    lat_limits.lat = malloc(sizeof(double) * ((uint32_t)(bench.seconds * 1000.0) + 16U));
+    lat_cells.lat = malloc(sizeof(double) * ((uint32_t)(bench.seconds * 1000.0) + 16U));
+    if (lat_limits.lat == NULL || lat_cells.lat == NULL) return 1;
+    pthread_mutex_init(&link.lock, NULL);
+
+    for (uint32_t m = 0; m < MODEL_COUNT; m++) Run((Model_t)m);
+
+    free(lat_limits.lat);
+    free(lat_cells.lat);
+    printf("%s\n", failures == 0U ? "PASS" : "FAIL");
+    return (failures == 0U) ? 0 : 1;
+}
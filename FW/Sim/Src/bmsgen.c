@@ -0,0 +1,119 @@
+/**
+ * @file bmsgen.c
+ * @brief Simulated BMS: CAN-FD Frames as the Firmware Receives Them
+ * @version 2.1
+ * @date 2025-12
+ *
+ * Values are rounded to the resolution of the frame, so the firmware
+ * decodes them to within half a step. The wire time counts 29 nominal
+ * bits (arbitration, ACK, EOF, intermission) at CAN_BAUDRATE and the
+ * data phase at CAN_FD_BAUDRATE with the stuff count, the 17/21-bit CRC
+ * and its fixed stuff bits, plus 10 % dynamic stuffing.
+ */
+
+#include "bmsgen.h"
+#include "config.h"
+#include <math.h>
+#include <string.h>
+
+/* ============================================================================
+ * PRIVATE HELPERS
+ * ========================================================================== */
+static uint8_t FdLength(uint32_t n)
+{
+    static const uint8_t len[] = { 8, 12, 16, 20, 24, 32, 48, 64 };
+    
+    for (uint32_t i = 0; i < sizeof(len); i++) {
+        if (n <= len[i]) return len[i];
+    }
+    return 64;
+}
+
+static void Put16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static uint16_t Unsigned(float32_t v, float32_t scale)
+{
+    long raw = lroundf(v * scale);
+    return (uint16_t)(raw < 0 ? 0 : (raw > 0xFFFE ? 0xFFFE : raw));
+}
+
+static void Begin(BmsFrame_t *f, uint32_t id, uint32_t n)
+{
+    memset(f->data, 0, sizeof(f->data));
+    f->id = id;
+    f->len = FdLength(n);
+}
+
+/* ============================================================================
+ * FRAMES
+ * ========================================================================== */
+void BmsGen_Pack(const BmsGen_t *g, BmsFrame_t *f)
+{
+    Begin(f, BMS_ID_PACK, BMS_PACK_LEN);
+    Put16(f->data, Unsigned(g->pack_V, 10.0f));
+    Put16(f->data + 2, (uint16_t)(int16_t)lroundf(g->current_A * 10.0f));
+    Put16(f->data + 4, Unsigned(g->soc, 100.0f));
+    Put16(f->data + 6, Unsigned(g->soh, 100.0f));
+    Put16(f->data + 8, (uint16_t)g->status);
+    Put16(f->data + 10, (uint16_t)(g->status >> 16));
+}
+
+void BmsGen_Limits(const BmsGen_t *g, BmsFrame_t *f)
+{
+    Begin(f, BMS_ID_LIMITS, BMS_LIMITS_LEN);
+    Put16(f->data, Unsigned(g->charge_limit_A, 10.0f));
+    Put16(f->data + 2, Unsigned(g->discharge_limit_A, 10.0f));
+}
+
+void BmsGen_Cells(const BmsGen_t *g, uint32_t block, BmsFrame_t *f)
+{
+    uint32_t first = block * BMS_CELLS_PER_FRAME;
+    uint32_t n = BMS_CELL_COUNT - first;
+    
+    if (n > BMS_CELLS_PER_FRAME) n = BMS_CELLS_PER_FRAME;
+    Begin(f, BMS_ID_CELLS, BMS_BLOCK_HEADER + 2U * n);
+    f->data[0] = (uint8_t)block;
+    for (uint32_t i = 0; i < n; i++) {
+        Put16(f->data + BMS_BLOCK_HEADER + 2U * i, Unsigned(g->cell_V[first + i], 1000.0f));
+    }
+}
+
+void BmsGen_Temps(const BmsGen_t *g, uint32_t block, BmsFrame_t *f)
+{
+    uint32_t first = block * BMS_TEMPS_PER_FRAME;
+    uint32_t n = BMS_TEMP_COUNT - first;
+    
+    if (n > BMS_TEMPS_PER_FRAME) n = BMS_TEMPS_PER_FRAME;
+    Begin(f, BMS_ID_TEMPS, BMS_BLOCK_HEADER + n);
+    f->data[0] = (uint8_t)block;
+    for (uint32_t i = 0; i < n; i++) {
+        long t = lroundf(g->cell_T[first + i]);
+        f->data[BMS_BLOCK_HEADER + i] = (uint8_t)(int8_t)(t < -127 ? -127 : (t > 127 ? 127 : t));
+    }
+}
+
+uint32_t BmsGen_Cycle(const BmsGen_t *g, bool cells, uint32_t stamp_ms, BmsFrame_t *out)
+{
+    uint32_t n = 0;
+    
+    BmsGen_Pack(g, &out[n++]);
+    BmsGen_Limits(g, &out[n++]);
+    if (cells) {
+        for (uint32_t b = 0; b < BMS_CELL_BLOCKS; b++) BmsGen_Cells(g, b, &out[n++]);
+        for (uint32_t b = 0; b < BMS_TEMP_BLOCKS; b++) BmsGen_Temps(g, b, &out[n++]);
+    }
+    for (uint32_t i = 0; i < n; i++) out[i].stamp_ms = stamp_ms;
+    return n;
+}
+
+double BmsGen_WireTime_us(const BmsFrame_t *f)
+{
+    const double crc = (f->len > 16U) ? 21.0 : 17.0;
+    const double data_bits = 1.1 * (5.0 + 8.0 * f->len) + 4.0 + crc + ceil(crc / 4.0) + 1.0;
+    
+    return 29.0 * 1e6 / CAN_BAUDRATE + data_bits * 1e6 / CAN_FD_BAUDRATE;
+}
@@ -0,0 +1,277 @@
+/**
+ * @file effmap_main.c
+ * @brief Efficiency and Loss Map Generator over the Host Simulator
+ * @version 2.1
+ * @date 2025-12
+ *
+ * Usage: fweffmap [options]
+ *   --jobs <n>            Worker threads (default: online cores)
+ *   --vdc <V,V,...>       Battery voltages (default 700 to 1000 in 50 V steps)
+ *   --p <W,W,...>         Active power set-points, + export / - import
+ *                         (default ±12, 24, 36, 48, 72, 96, 120 kW)
+ *   --q <VAr>             Reactive power at every point (default 0)
+ *   --t-hs <C>            Heatsink temperature (default 60)
+ *   --t-end <s>           Simulated time per point (default 2)
+ *   --fixed-fsw <0/1>     Hold PWM_FREQUENCY_HZ instead of the scheduled
+ *                         switching frequency (default 0)
+ *   --csv <file>          Map as CSV (default stdout)
+ *   --header <file.h>     Also write the firmware lookup table (eff_map.h)
+ *
+ * Every point runs the firmware in closed loop against the switched plant
+ * and reads the plant's loss accounting over the last 0.1 s: semiconductor
+ * conduction (RDS(on) at the modelled junction temperature), switching and
+ * body-diode losses of the IMT65R010M2H, inductor copper and core losses.
+ * Efficiency is measured at the terminals (DC link, grid side of Lg), so it
+ * also covers whatever the control does to ripple and reactive current.
+ *
+ * The heatsink is held at --t-hs (Rth_ha = 0) and the thermal network runs
+ * PLANT_TH_ACCEL times faster, so junctions reach their steady temperature
+ * and RDS(on) within the run. A point that trips, leaves RUN or ends more
+ * than 5 % off its set-point is flagged in the CSV, and the header is then
+ * not written. Below ~10 % load the dq PR loop (no DC integrator) leaves a
+ * visible steady-state error at high Vdc, hence the 12 kW default floor.
+ */
+
+#include "sweep.h"
+#include "config.h"
+#include "types.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+/* ============================================================================
+ * CONSTANTS
+ * ========================================================================== */
+#define MAP_MAX_VDC             16
+#define MAP_MAX_P               32
+#define PLANT_TH_ACCEL          50.0        // Thermal time compression
+#define MAP_P_TOL               0.05        // Tail P within 5 % of the set-point
+
+/* ============================================================================
+ * PRIVATE VARIABLES
+ * ========================================================================== */
+static struct {
+    uint32_t threads;
+    double vdc[MAP_MAX_VDC];
+    uint32_t n_vdc;
+    double p[MAP_MAX_P];
+    uint32_t n_p;
+    double q;
+    double t_hs;
+    double t_end;
+    bool fixed_fsw;
+} map;
+
+/* ============================================================================
+ * JOBS
+ * ========================================================================== */
+static void BuildJob(SweepJob_t *job, double vdc, double p)
+{
+    memset(job, 0, sizeof(*job));
+    Sim_DefaultConfig(&job->cfg);
+    snprintf(job->name, SWEEP_NAME_LEN, "vdc=%g/p=%g/q=%g", vdc, p, map.q);
+    job->cfg.t_end = map.t_end;
+    job->cfg.p_ref_W = p;
+    job->cfg.q_ref_VAr = map.q;
+    job->cfg.plant.V_bat_nom = vdc;
+    job->cfg.plant.T_ambient = map.t_hs;
+    job->cfg.plant.T_heatsink0 = map.t_hs;
+    job->cfg.plant.Rth_ha = 0.0;
+    job->cfg.plant.th_accel = PLANT_TH_ACCEL;
+    job->cfg.fixed_fsw = map.fixed_fsw;
+}
+
+static bool Valid(const SweepJob_t *job, double p)
+{
+    const SimResult_t *r = &job->res;
+
+    if (job->rc != 0 || r->trip_count != 0U) return false;
+    if (r->final_state != STATE_RUN_INVERTER && r->final_state != STATE_RUN_RECTIFIER) return false;
+    if (isnan(r->eff_pct)) return false;
+    /* Derating or a current limit would map a different operating point */
+    double p_ac = (p >= 0.0) ? r->p_out_W : -r->p_in_W;
+    return fabs(p_ac - p) <= MAP_P_TOL * fabs(p);
+}
+
+/* ============================================================================
+ * OUTPUT
+ * ========================================================================== */
+static void WriteCsv(FILE *f, const SweepJob_t *jobs)
+{
+    fprintf(f, "vdc_V,p_set_W,q_set_VAr,p_in_W,p_out_W,eff_pct,p_loss_W,p_cond_W,p_sw_W,"
+               "p_diode_W,p_cu_W,p_core_W,i_rms_A,fsw_kHz,ripple_pp_A,tj_max_C,trips,valid\n");
+    for (uint32_t v = 0; v < map.n_vdc; v++) {
+        for (uint32_t k = 0; k < map.n_p; k++) {
+            const SweepJob_t *job = &jobs[v * map.n_p + k];
+            const SimResult_t *r = &job->res;
+            fprintf(f, "%g,%g,%g,%.1f,%.1f,%.3f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.2f,%.1f,%.1f,%.1f,%u,%d\n",
+                    map.vdc[v], map.p[k], map.q, r->p_in_W, r->p_out_W, r->eff_pct,
+                    r->p_in_W - r->p_out_W, r->p_cond_W, r->p_sw_W, r->p_diode_W,
+                    r->p_cu_W, r->p_core_W, r->i_rms_A, r->fsw_kHz, r->ripple_pp_A, r->tj_ref_max,
+                    (unsigned)r->trip_count, Valid(job, map.p[k]) ? 1 : 0);
+        }
+    }
+}
+
+static int WriteHeader(const char *path, const SweepJob_t *jobs)
+{
+    char date[16];
+    time_t now = time(NULL);
+    FILE *f = fopen(path, "w");
+
+    if (f == NULL) return -1;
+    strftime(date, sizeof(date), "%Y-%m", gmtime(&now));
+
+    fprintf(f, "/**\n");
+    fprintf(f, " * @file eff_map.h\n");
+    fprintf(f, " * @brief Expected Efficiency Map (generated by fweffmap, do not edit)\n");
+    fprintf(f, " * @version %d.%d\n", FW_VERSION_MAJOR, FW_VERSION_MINOR);
+    fprintf(f, " * @date %s\n", date);
+    fprintf(f, " *\n");
+    fprintf(f, " * Terminal efficiency from the switched plant and loss model at a\n");
+    fprintf(f, " * %.0f C heatsink, Q = %g VAr. Filter: LC %.0f uH, CF %.1f uF, LG %.0f uH.\n",
+            map.t_hs, map.q, LC_INDUCTANCE_H * 1e6, CF_CAPACITANCE_F * 1e6, LG_INDUCTANCE_H * 1e6);
+    fprintf(f, " * Rows: battery voltage [V]; columns: AC power [W], + export.\n");
+    fprintf(f, " * Used with -DEFFICIENCY_MAP_ENABLE=1 (see config.h).\n");
+    fprintf(f, " */\n\n");
+    fprintf(f, "#ifndef __EFF_MAP_H\n#define __EFF_MAP_H\n\n");
+    fprintf(f, "#define EFF_MAP_N_VDC           %u\n", (unsigned)map.n_vdc);
+    fprintf(f, "#define EFF_MAP_N_P             %u\n\n", (unsigned)map.n_p);
+
+    fprintf(f, "static const float32_t eff_map_vdc[EFF_MAP_N_VDC] = {");
+    for (uint32_t v = 0; v < map.n_vdc; v++) fprintf(f, "%s %.1ff", v ? "," : "", map.vdc[v]);
+    fprintf(f, " };\n");
+    fprintf(f, "static const float32_t eff_map_p[EFF_MAP_N_P] = {");
+    for (uint32_t k = 0; k < map.n_p; k++) fprintf(f, "%s %.1ff", k ? "," : "", map.p[k]);
+    fprintf(f, " };\n\n");
+
+    fprintf(f, "/* Efficiency ×0.01 %% */\n");
+    fprintf(f, "static const uint16_t eff_map[EFF_MAP_N_VDC][EFF_MAP_N_P] = {\n");
+    for (uint32_t v = 0; v < map.n_vdc; v++) {
+        fprintf(f, "    {");
+        for (uint32_t k = 0; k < map.n_p; k++) {
+            const SweepJob_t *job = &jobs[v * map.n_p + k];
+            fprintf(f, "%s %5u", k ? "," : "", (unsigned)lround(job->res.eff_pct * 100.0));
+        }
+        fprintf(f, " },   // %g V\n", map.vdc[v]);
+    }
+    fprintf(f, "};\n\n#endif /* __EFF_MAP_H */\n");
+
+    return (fclose(f) == 0) ? 0 : -1;
+}
+
+/* ============================================================================
+ * MAIN
+ * ========================================================================== */
+static void Usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [--jobs n] [--vdc V,V] [--p W,W] [--q VAr] [--t-hs C] "
+                    "[--t-end s] [--fixed-fsw 0/1] [--csv file] [--header file.h]\n", prog);
+}
+
+static int CompareDouble(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/* Comma list, sorted ascending; the lookup needs monotonic axes */
+static bool ParseList(const char *v, double *out, uint32_t max, uint32_t *n)
+{
+    char buf[512];
+
+    snprintf(buf, sizeof(buf), "%s", v);
+    *n = 0;
+    for (char *t = strtok(buf, ","); t != NULL; t = strtok(NULL, ",")) {
+        if (*n == max) return false;
+        out[(*n)++] = atof(t);
+    }
+    qsort(out, *n, sizeof(double), CompareDouble);
+    for (uint32_t i = 1; i < *n; i++) {
+        if (out[i] == out[i - 1]) return false;
+    }
+    return *n > 0;
+}
+
+int main(int argc, char **argv)
+{
+    const char *csv_path = NULL, *header_path = NULL;
+
+    map.threads = Sweep_CpuCount();
+    map.t_hs = 60.0;
+    map.t_end = 2.0;
+    ParseList("700,750,800,850,900,950,1000", map.vdc, MAP_MAX_VDC, &map.n_vdc);
+    ParseList("-120000,-96000,-72000,-48000,-36000,-24000,-12000,"
+              "12000,24000,36000,48000,72000,96000,120000", map.p, MAP_MAX_P, &map.n_p);
+
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        const char *v = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+        if (v == NULL) { Usage(argv[0]); return 1; }
+        i++;
+
+        if (strcmp(a, "--jobs") == 0)               map.threads = (uint32_t)strtoul(v, NULL, 0);
+        else if (strcmp(a, "--q") == 0)             map.q = atof(v);
+        else if (strcmp(a, "--t-hs") == 0)          map.t_hs = atof(v);
+        else if (strcmp(a, "--t-end") == 0)         map.t_end = atof(v);
+        else if (strcmp(a, "--fixed-fsw") == 0)     map.fixed_fsw = (atof(v) != 0.0);
+        else if (strcmp(a, "--csv") == 0)           csv_path = v;
+        else if (strcmp(a, "--header") == 0)        header_path = v;
+        else if (strcmp(a, "--vdc") == 0) {
+            if (!ParseList(v, map.vdc, MAP_MAX_VDC, &map.n_vdc)) { fprintf(stderr, "bad --vdc '%s'\n", v); return 1; }
+        }
+        else if (strcmp(a, "--p") == 0) {
+            if (!ParseList(v, map.p, MAP_MAX_P, &map.n_p)) { fprintf(stderr, "bad --p '%s'\n", v); return 1; }
+        }
+        else { Usage(argv[0]); return 1; }
+    }
+    if (map.threads == 0U || !(map.t_end > 0.5)) { Usage(argv[0]); return 1; }
+
+    uint32_t n_jobs = map.n_vdc * map.n_p;
+    SweepJob_t *jobs = (SweepJob_t *)calloc(n_jobs, sizeof(SweepJob_t));
+    if (jobs == NULL) return 1;
+    for (uint32_t v = 0; v < map.n_vdc; v++) {
+        for (uint32_t k = 0; k < map.n_p; k++) BuildJob(&jobs[v * map.n_p + k], map.vdc[v], map.p[k]);
+    }
+
+    SweepStats_t st;
+    int rc = Sweep_Run(jobs, n_jobs, map.threads, &st);
+    fprintf(stderr, "%u points, %u threads, %.1f s wall\n", (unsigned)n_jobs, (unsigned)st.threads, st.t_wall_s);
+
+    FILE *csv = (csv_path != NULL) ? fopen(csv_path, "w") : stdout;
+    if (csv == NULL) {
+        perror(csv_path);
+        free(jobs);
+        return 1;
+    }
+    WriteCsv(csv, jobs);
+    if (csv != stdout) fclose(csv);
+
+    uint32_t invalid = 0;
+    for (uint32_t j = 0; j < n_jobs; j++) {
+        if (!Valid(&jobs[j], map.p[j % map.n_p])) {
+            fprintf(stderr, "%s: not mapped (trips %u, eff %.3f %%)\n", jobs[j].name,
+                    (unsigned)jobs[j].res.trip_count, jobs[j].res.eff_pct);
+            invalid++;
+        }
+    }
+
+    if (header_path != NULL) {
+        if (rc != 0 || invalid != 0U) {
+            fprintf(stderr, "%u points not mapped, %s not written\n", (unsigned)invalid, header_path);
+            free(jobs);
+            return 2;
+        }
+        if (WriteHeader(header_path, jobs) != 0) {
+            perror(header_path);
+            free(jobs);
+            return 1;
+        }
+        fprintf(stderr, "wrote %s\n", header_path);
+    }
+    free(jobs);
+    return (rc == 0) ? 0 : 1;
+}
@@ -0,0 +1,591 @@
+/**
+ * @file mgrid.c
+ * @brief Multi-Unit Microgrid Simulation (paralleled inverters on one bus)
+ * @version 2.1
+ * @date 2025-12
+ *
+ * Per αβ axis the bus is  x = [v, i_s, i_L],  u = [Σig, v_src]:
+ *   C_bus dv/dt   = Σig + i_s - i_L - v/R_load
+ *   L_src di_s/dt = v_src - v - R_src·i_s          (utility breaker closed)
+ *   L_load di_L/dt = v
+ * and is integrated exactly over each half carrier period with Σig taken
+ * as the mean of its values at both ends (trapezoid). Each unit sees the
+ * bus as its grid source, held at the mid-step value extrapolated from
+ * the last two bus samples.
+ *
+ * Step n of every unit thread:
+ *   1. Sim steps the unit plant over [t_n, t_n+1] against the bus
+ *   2. The unit publishes ig(t_n+1) into slot[n & 1] and waits for all
+ *   3. Each thread steps its bus copy with Σig over the units still
+ *      running at step n, applies bus events and sets the next v_s
+ * The slots alternate by step parity: a unit can only overwrite slot
+ * [n & 1] at step n + 2, which needs every other unit past the barrier
+ * of step n + 1 and so done reading it. A unit that finishes (HAL_Delay
+ * lets units end a few steps apart) records the first step it misses and
+ * leaves the barrier; every copy then drops it from that same step on.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "mgrid.h"
+#include "sweep.h"
+#include "types.h"
+#include "config.h"
+#include "recorder.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+
+/* ============================================================================
+ * CONSTANTS
+ * ========================================================================== */
+#define TWO_PI          6.283185307179586
+#define SQRT3_2         0.8660254037844386
+#define BUS_NX          3               // [v, i_s, i_L]
+#define BUS_NU          2               // [Σig, v_src]
+#define SLOT_N          4               // ig_α, ig_β, P, Q
+
+/* ============================================================================
+ * PRIVATE TYPES
+ * ========================================================================== */
+typedef struct {
+    double x[2][BUS_NX];
+    double Phi[BUS_NX][BUS_NX];
+    double Gam[BUS_NX][BUS_NU];
+    double R_load;
+    bool breaker;
+
+    /* Utility source */
+    double theta;
+    double omega;
+    double V_pk;
+
+    double ig_prev[2];          // Σig at the start of the step
+    double v_prev[2];           // Bus voltage one step earlier
+    uint32_t next_event;
+} Bus_t;
+
+typedef struct Mgrid_s Mgrid_t;
+
+typedef struct {
+    Mgrid_t *mg;
+    uint32_t k;
+    uint64_t step;
+    Bus_t bus;
+    double p_acc, q_acc;        // Tail window sums
+    uint32_t pq_n;
+    uint32_t trace_count;
+
+    /* Bus metrics (unit 0's copy) */
+    double ang_prev, f_lpf;
+    double ph_pre, mag_pre;
+    double f_acc, mag_acc;
+    uint32_t tail_n;
+    pthread_t thread;
+} Unit_t;
+
+struct Mgrid_s {
+    MgridConfig_t *cfg;
+    MgridResult_t *res;
+    double h;                   // Step = half carrier period [s]
+    double V_nom;               // Nominal phase peak [V]
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint32_t active;            // Units still stepping
+    uint32_t arrived;
+    uint64_t generation;
+
+    double slot[2][MGRID_MAX_UNITS][SLOT_N];
+    _Atomic uint64_t left_at[MGRID_MAX_UNITS];     // First step without the unit
+    Unit_t unit[MGRID_MAX_UNITS];
+};
+
+/* ============================================================================
+ * CONFIGURATION
+ * ========================================================================== */
+void Mgrid_DefaultConfig(MgridConfig_t *cfg, uint32_t n_units)
+{
+    memset(cfg, 0, sizeof(*cfg));
+    if (n_units > MGRID_MAX_UNITS) n_units = MGRID_MAX_UNITS;
+    cfg->n_units = n_units;
+    for (uint32_t k = 0; k < MGRID_MAX_UNITS; k++) {
+        Sim_DefaultConfig(&cfg->unit[k]);
+    }
+
+    cfg->bus.C_bus = 50e-6;
+    cfg->bus.L_src = 100e-6;
+    cfg->bus.R_src = 5e-3;
+    cfg->bus.V_ll_rms = cfg->unit[0].plant.V_ll_rms;
+    cfg->bus.f_src = cfg->unit[0].plant.f_grid;
+    cfg->trace_decim = 10;
+}
+
+bool Mgrid_ParseBusEvent(MgridConfig_t *cfg, const char *spec)
+{
+    SimConfig_t tmp;
+    MgridBus_t *b = &cfg->bus;
+
+    memset(&tmp, 0, sizeof(tmp));
+    if (!Sim_ParseEvent(&tmp, spec) || b->n_events >= MGRID_MAX_EVENTS) return false;
+
+    switch (tmp.events[0].type) {
+        case SIM_EV_VSAG:
+        case SIM_EV_FREQ:
+        case SIM_EV_PHASE:
+        case SIM_EV_ISLAND:
+        case SIM_EV_R_LOAD:
+            break;
+        default:
+            return false;
+    }
+
+    /* Kept in time order, equal times in command-line order */
+    uint32_t j = b->n_events++;
+    while (j > 0 && b->events[j - 1].t > tmp.events[0].t) {
+        b->events[j] = b->events[j - 1];
+        j--;
+    }
+    b->events[j] = tmp.events[0];
+    return true;
+}
+
+/* ============================================================================
+ * BUS MODEL
+ * ========================================================================== */
+static void BusDiscretise(Bus_t *bus, const MgridBus_t *p, double h)
+{
+    double A[BUS_NX][BUS_NX] = {{0}}, B[BUS_NX][BUS_NU] = {{0}};
+
+    if (bus->R_load > 0.0) A[0][0] = -1.0 / (bus->R_load * p->C_bus);
+    B[0][0] = 1.0 / p->C_bus;
+    if (bus->breaker) {
+        A[0][1] = 1.0 / p->C_bus;
+        A[1][0] = -1.0 / p->L_src;
+        A[1][1] = -p->R_src / p->L_src;
+        B[1][1] = 1.0 / p->L_src;
+    }
+    if (p->L_load > 0.0) {
+        A[0][2] = -1.0 / p->C_bus;
+        A[2][0] = 1.0 / p->L_load;
+    }
+
+    /* Taylor series: Φ = Σ (Ah)^k/k!,  Γ = Σ A^k h^(k+1)/(k+1)! · B */
+    double term[BUS_NX][BUS_NX] = {{0}}, S[BUS_NX][BUS_NX] = {{0}};
+    memset(bus->Phi, 0, sizeof(bus->Phi));
+    for (int i = 0; i < BUS_NX; i++) term[i][i] = 1.0;
+
+    for (int k = 0; k < 16; k++) {
+        double next[BUS_NX][BUS_NX];
+        for (int i = 0; i < BUS_NX; i++) {
+            for (int j = 0; j < BUS_NX; j++) {
+                bus->Phi[i][j] += term[i][j];
+                S[i][j] += term[i][j] * h / (double)(k + 1);
+            }
+        }
+        for (int i = 0; i < BUS_NX; i++) {
+            for (int j = 0; j < BUS_NX; j++) {
+                double acc = 0.0;
+                for (int m = 0; m < BUS_NX; m++) acc += A[i][m] * term[m][j];
+                next[i][j] = acc * h / (double)(k + 1);
+            }
+        }
+        memcpy(term, next, sizeof(term));
+    }
+    for (int i = 0; i < BUS_NX; i++) {
+        for (int j = 0; j < BUS_NU; j++) {
+            double acc = 0.0;
+            for (int m = 0; m < BUS_NX; m++) acc += S[i][m] * B[m][j];
+            bus->Gam[i][j] = acc;
+        }
+    }
+}
+
+static void BusApplyEvent(Unit_t *u, const SimEvent_t *ev, double t)
+{
+    Mgrid_t *mg = u->mg;
+    Bus_t *bus = &u->bus;
+    const MgridBus_t *p = &mg->cfg->bus;
+
+    switch (ev->type) {
+        case SIM_EV_VSAG:
+            bus->V_pk = ev->value * mg->V_nom;
+            break;
+        case SIM_EV_FREQ:
+            bus->omega = TWO_PI * ev->value;
+            break;
+        case SIM_EV_PHASE:
+            bus->theta = fmod(bus->theta + ev->value * (TWO_PI / 360.0) + TWO_PI, TWO_PI);
+            break;
+        case SIM_EV_ISLAND:
+            if (ev->value != 0.0 && bus->breaker && t > 0.0 && u->k == 0U && isnan(mg->res->t_island_s)) {
+                /* Glitch reference: the bus just before the breaker opens */
+                mg->res->t_island_s = t;
+                u->mag_pre = hypot(bus->x[0][0], bus->x[1][0]);
+                u->ph_pre = atan2(bus->x[1][0], bus->x[0][0]) - bus->theta;
+            }
+            bus->breaker = (ev->value == 0.0);
+            if (!bus->breaker) {
+                bus->x[0][1] = 0.0;
+                bus->x[1][1] = 0.0;
+            }
+            BusDiscretise(bus, p, mg->h);
+            break;
+        case SIM_EV_R_LOAD:
+            bus->R_load = ev->value;
+            BusDiscretise(bus, p, mg->h);
+            break;
+        default:
+            break;
+    }
+}
+
+static void BusEvents(Unit_t *u, double t)
+{
+    const MgridBus_t *p = &u->mg->cfg->bus;
+
+    while (u->bus.next_event < p->n_events && p->events[u->bus.next_event].t <= t) {
+        BusApplyEvent(u, &p->events[u->bus.next_event], t);
+        u->bus.next_event++;
+    }
+}
+
+static void BusAdvance(Bus_t *bus, const double ig[2], double h)
+{
+    double th = bus->theta + 0.5 * bus->omega * h;
+    double vs[2] = { bus->V_pk * cos(th), bus->V_pk * sin(th) };
+
+    for (int ax = 0; ax < 2; ax++) {
+        double u0 = 0.5 * (bus->ig_prev[ax] + ig[ax]);
+        double xn[BUS_NX];
+        for (int i = 0; i < BUS_NX; i++) {
+            double acc = bus->Gam[i][0] * u0 + bus->Gam[i][1] * vs[ax];
+            for (int m = 0; m < BUS_NX; m++) acc += bus->Phi[i][m] * bus->x[ax][m];
+            xn[i] = acc;
+        }
+        bus->v_prev[ax] = bus->x[ax][0];
+        memcpy(bus->x[ax], xn, sizeof(xn));
+        bus->ig_prev[ax] = ig[ax];
+    }
+
+    bus->theta += bus->omega * h;
+    if (bus->theta >= TWO_PI) bus->theta -= TWO_PI;
+}
+
+/* ============================================================================
+ * BARRIER
+ * ========================================================================== */
+static void BarrierWait(Mgrid_t *mg)
+{
+    pthread_mutex_lock(&mg->lock);
+    uint64_t gen = mg->generation;
+    if (++mg->arrived == mg->active) {
+        mg->arrived = 0;
+        mg->generation++;
+        pthread_cond_broadcast(&mg->cond);
+    } else {
+        while (gen == mg->generation) pthread_cond_wait(&mg->cond, &mg->lock);
+    }
+    pthread_mutex_unlock(&mg->lock);
+}
+
+static void BarrierLeave(Mgrid_t *mg, Unit_t *u)
+{
+    atomic_store(&mg->left_at[u->k], u->step);
+
+    pthread_mutex_lock(&mg->lock);
+    mg->active--;
+    if (mg->arrived > 0U && mg->arrived == mg->active) {
+        mg->arrived = 0;
+        mg->generation++;
+        pthread_cond_broadcast(&mg->cond);
+    }
+    pthread_mutex_unlock(&mg->lock);
+}
+
+/* ============================================================================
+ * METRICS / TRACE (unit 0's bus copy)
+ * ========================================================================== */
+static void BusMetrics(Unit_t *u, double t)
+{
+    Mgrid_t *mg = u->mg;
+    MgridResult_t *res = mg->res;
+    const Bus_t *bus = &u->bus;
+    double mag = hypot(bus->x[0][0], bus->x[1][0]);
+    double ang = atan2(bus->x[1][0], bus->x[0][0]);
+
+    /* Frequency from the bus voltage angle (meaningless on a dead bus) */
+    double d = ang - u->ang_prev;
+    if (d > 0.5 * TWO_PI) d -= TWO_PI;
+    else if (d < -0.5 * TWO_PI) d += TWO_PI;
+    u->ang_prev = ang;
+    if (mag > MGRID_LIVE_PU * mg->V_nom) {
+        double a = 1.0 - exp(-TWO_PI * MGRID_F_LPF_HZ * mg->h);
+        u->f_lpf += a * (d / (TWO_PI * mg->h) - u->f_lpf);
+    }
+
+    if (!isnan(res->t_island_s)) {
+        double dt = t - res->t_island_s;
+        if (dt <= MGRID_GLITCH_V_WIN_S) {
+            double g = 100.0 * fabs(mag - u->mag_pre) / mg->V_nom;
+            if (isnan(res->glitch_v_pct) || g > res->glitch_v_pct) res->glitch_v_pct = g;
+        }
+        if (dt <= MGRID_GLITCH_PH_WIN_S) {
+            double p = fmod(ang - bus->theta - u->ph_pre, TWO_PI);
+            if (p > 0.5 * TWO_PI) p -= TWO_PI;
+            else if (p < -0.5 * TWO_PI) p += TWO_PI;
+            p = fabs(p) * (360.0 / TWO_PI);
+            if (isnan(res->glitch_phase_deg) || p > res->glitch_phase_deg) res->glitch_phase_deg = p;
+        }
+        /* Extremes once the frequency filter has seen the new operating point */
+        if (dt > 2.0 / MGRID_F_LPF_HZ) {
+            if (isnan(res->f_min_hz) || u->f_lpf < res->f_min_hz) res->f_min_hz = u->f_lpf;
+            if (isnan(res->f_max_hz) || u->f_lpf > res->f_max_hz) res->f_max_hz = u->f_lpf;
+        }
+    }
+
+    if (t > mg->cfg->unit[0].t_end - MGRID_TAIL_S) {
+        u->f_acc += u->f_lpf;
+        u->mag_acc += mag;
+        u->tail_n++;
+    }
+}
+
+static void TraceHeader(const Mgrid_t *mg, FILE *f)
+{
+    fprintf(f, "t,Va,Vb,Vc,f,breaker");
+    for (uint32_t k = 0; k < mg->cfg->n_units; k++) fprintf(f, ",P%u,Q%u", (unsigned)k, (unsigned)k);
+    fprintf(f, "\n");
+}
+
+static void TraceRow(Unit_t *u, double t, uint32_t par)
+{
+    Mgrid_t *mg = u->mg;
+    const Bus_t *bus = &u->bus;
+    FILE *f = mg->cfg->trace;
+    double a = bus->x[0][0], b = bus->x[1][0];
+
+    fprintf(f, "%.7f,%.3f,%.3f,%.3f,%.4f,%d", t, a, -0.5 * a + SQRT3_2 * b, -0.5 * a - SQRT3_2 * b,
+            u->f_lpf, bus->breaker ? 1 : 0);
+    for (uint32_t k = 0; k < mg->cfg->n_units; k++) {
+        bool in = u->step < atomic_load(&mg->left_at[k]);
+        fprintf(f, ",%.1f,%.1f", in ? mg->slot[par][k][2] : 0.0, in ? mg->slot[par][k][3] : 0.0);
+    }
+    fprintf(f, "\n");
+}
+
+/* ============================================================================
+ * UNIT COUPLING (SimConfig_t.bus_step, runs on the unit's thread)
+ * ========================================================================== */
+static void SetSource(Unit_t *u, Plant_t *pl)
+{
+    const Bus_t *bus = &u->bus;
+
+    /* Mid-step extrapolation of the bus voltage */
+    pl->vs_ext[0] = 1.5 * bus->x[0][0] - 0.5 * bus->v_prev[0];
+    pl->vs_ext[1] = 1.5 * bus->x[1][0] - 0.5 * bus->v_prev[1];
+
+    /* Grid-presence input: utility breaker auxiliary contact, or a live bus
+     * formed by other units (above the firmware under-voltage limit, so a
+     * unit still ramping its own voltage up does not trip itself) */
+    bool live = bus->breaker || hypot(bus->x[0][0], bus->x[1][0]) > MGRID_LIVE_PU * u->mg->V_nom;
+    if (live != g_sys.grid_connected) {
+        Recorder_Begin(REC_CMD_HOST);
+        g_sys.grid_connected = live;
+        Recorder_End(REC_CMD_HOST);
+    }
+}
+
+static void BusInit(Unit_t *u, Plant_t *pl)
+{
+    Mgrid_t *mg = u->mg;
+    const MgridBus_t *p = &mg->cfg->bus;
+    Bus_t *bus = &u->bus;
+
+    memset(bus, 0, sizeof(*bus));
+    bus->omega = TWO_PI * p->f_src;
+    bus->V_pk = mg->V_nom * p->V_ll_rms / mg->cfg->unit[0].plant.V_ll_rms;
+    bus->R_load = p->R_load;
+    bus->breaker = true;
+    BusDiscretise(bus, p, mg->h);
+    BusEvents(u, 0.0);
+
+    /* Live bus at the source voltage, or dead with the breaker open */
+    double v0 = bus->breaker ? bus->V_pk : 0.0;
+    bus->x[0][0] = v0;
+    bus->v_prev[0] = v0;
+    pl->x[0][1] = v0;
+    pl->x[1][1] = 0.0;
+
+    pl->ext_source = true;
+    u->ang_prev = 0.0;
+    u->f_lpf = p->f_src;
+    SetSource(u, pl);
+}
+
+static void BusStep(void *ctx, Plant_t *pl, bool init)
+{
+    Unit_t *u = (Unit_t *)ctx;
+    Mgrid_t *mg = u->mg;
+    uint32_t par = (uint32_t)(u->step & 1U);
+    double *my = mg->slot[par][u->k];
+
+    if (init) {
+        BusInit(u, pl);
+        return;
+    }
+
+    /* Publish: line current and power at the unit PCC */
+    my[0] = pl->x[0][2];
+    my[1] = pl->x[1][2];
+    my[2] = 1.5 * (pl->x[0][1] * pl->x[0][2] + pl->x[1][1] * pl->x[1][2]);
+    my[3] = 1.5 * (pl->x[1][1] * pl->x[0][2] - pl->x[0][1] * pl->x[1][2]);
+    if (pl->t > u->mg->cfg->unit[u->k].t_end - MGRID_TAIL_S) {
+        u->p_acc += my[2];
+        u->q_acc += my[3];
+        u->pq_n++;
+    }
+
+    BarrierWait(mg);
+
+    /* Identical on every thread: fixed summation order, same inputs */
+    double ig[2] = { 0.0, 0.0 };
+    for (uint32_t k = 0; k < mg->cfg->n_units; k++) {
+        if (u->step < atomic_load(&mg->left_at[k])) {
+            ig[0] += mg->slot[par][k][0];
+            ig[1] += mg->slot[par][k][1];
+        }
+    }
+    BusAdvance(&u->bus, ig, mg->h);
+    BusEvents(u, pl->t);
+
+    if (u->k == 0U) {
+        BusMetrics(u, pl->t);
+        if (mg->cfg->trace && ++u->trace_count >= mg->cfg->trace_decim) {
+            u->trace_count = 0;
+            TraceRow(u, pl->t, par);
+        }
+    }
+    u->step++;
+    SetSource(u, pl);
+}
+
+/* ============================================================================
+ * RUN
+ * ========================================================================== */
+static void* UnitMain(void *arg)
+{
+    Unit_t *u = (Unit_t *)arg;
+    Mgrid_t *mg = u->mg;
+    MgridUnitResult_t *r = &mg->res->unit[u->k];
+
+    r->rc = Sim_Run(&mg->cfg->unit[u->k], &r->sim);
+    BarrierLeave(mg, u);
+
+    r->P_W = (u->pq_n > 0U) ? u->p_acc / u->pq_n : NAN;
+    r->Q_VAr = (u->pq_n > 0U) ? u->q_acc / u->pq_n : NAN;
+    if (u->k == 0U && u->tail_n > 0U) {
+        mg->res->f_final_hz = u->f_acc / u->tail_n;
+        mg->res->v_final_pu = u->mag_acc / u->tail_n / mg->V_nom;
+    }
+    return NULL;
+}
+
+static void Sharing(const MgridConfig_t *cfg, MgridResult_t *res)
+{
+    double dp[MGRID_MAX_UNITS], dq[MGRID_MAX_UNITS];
+    double p = 0.0, q = 0.0;
+    uint32_t m = 0;
+
+    /* Droop pick-up: the change from each unit's own command */
+    for (uint32_t k = 0; k < cfg->n_units; k++) {
+        uint32_t st = res->unit[k].sim.final_state;
+        if (st != STATE_RUN_INVERTER && st != STATE_RUN_RECTIFIER) continue;
+        dp[m] = res->unit[k].P_W - cfg->unit[k].p_ref_W;
+        dq[m] = res->unit[k].Q_VAr - cfg->unit[k].q_ref_VAr;
+        p += dp[m];
+        q += dq[m];
+        m++;
+    }
+    if (m < 2U) return;
+    p /= m;
+    q /= m;
+
+    res->share_p_pct = 0.0;
+    res->share_q_pct = 0.0;
+    for (uint32_t k = 0; k < m; k++) {
+        double ep = 100.0 * fabs(dp[k] - p) / SYSTEM_POWER_RATING;
+        double eq = 100.0 * fabs(dq[k] - q) / SYSTEM_POWER_RATING;
+        if (ep > res->share_p_pct) res->share_p_pct = ep;
+        if (eq > res->share_q_pct) res->share_q_pct = eq;
+    }
+}
+
+int Mgrid_Run(MgridConfig_t *cfg, MgridResult_t *res)
+{
+    uint32_t n = cfg->n_units;
+    struct timespec t0, t1;
+    int rc = 0;
+
+    if (n == 0U || n > MGRID_MAX_UNITS || !Sweep_Parallel()) return -1;
+
+    Mgrid_t *mg = (Mgrid_t *)calloc(1, sizeof(Mgrid_t));
+    if (mg == NULL) return -1;
+
+    memset(res, 0, sizeof(*res));
+    res->t_island_s = NAN;
+    res->glitch_v_pct = NAN;
+    res->glitch_phase_deg = NAN;
+    res->f_min_hz = NAN;
+    res->f_max_hz = NAN;
+    res->f_final_hz = NAN;
+    res->v_final_pu = NAN;
+    res->share_p_pct = NAN;
+    res->share_q_pct = NAN;
+
+    mg->cfg = cfg;
+    mg->res = res;
+    mg->h = cfg->unit[0].plant.t_half;
+    mg->V_nom = cfg->unit[0].plant.V_ll_rms * sqrt(2.0 / 3.0);
+    mg->active = n;
+    pthread_mutex_init(&mg->lock, NULL);
+    pthread_cond_init(&mg->cond, NULL);
+    for (uint32_t k = 0; k < MGRID_MAX_UNITS; k++) atomic_init(&mg->left_at[k], UINT64_MAX);
+
+    if (cfg->trace) TraceHeader(mg, cfg->trace);
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    uint32_t started = 0;
+    for (uint32_t k = 0; k < n; k++) {
+        Unit_t *u = &mg->unit[k];
+        u->mg = mg;
+        u->k = k;
+        cfg->unit[k].trace = NULL;
+        cfg->unit[k].bus_step = BusStep;
+        cfg->unit[k].bus_ctx = u;
+        cfg->unit[k].fixed_fsw = true;     // Bus steps in nominal half periods
+        if (pthread_create(&u->thread, NULL, UnitMain, u) != 0) break;
+        started++;
+    }
+    if (started < n) {
+        /* The missing units never reach the barrier */
+        for (uint32_t k = started; k < n; k++) BarrierLeave(mg, &mg->unit[k]);
+        rc = -1;
+    }
+    for (uint32_t k = 0; k < started; k++) {
+        pthread_join(mg->unit[k].thread, NULL);
+        if (res->unit[k].rc != 0) rc = -1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    res->t_wall_s = (double)(t1.tv_sec - t0.tv_sec) + 1e-9 * (double)(t1.tv_nsec - t0.tv_nsec);
+
+    Sharing(cfg, res);
+
+    pthread_mutex_destroy(&mg->lock);
+    pthread_cond_destroy(&mg->cond);
+    free(mg);
+    return rc;
+}
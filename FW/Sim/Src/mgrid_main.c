@@ -0,0 +1,179 @@
+/**
+ * @file mgrid_main.c
+ * @brief Command-Line Front End of the Multi-Unit Microgrid Simulation
+ * @version 2.1
+ * @date 2025-12
+ *
+ * Usage: fwmgrid [options]
+ *   --units <n>              Paralleled units (default 2, max MGRID_MAX_UNITS)
+ *   --mode <m>               Modbus mode_select of every unit at t = 0
+ *                            (default 2 = grid-forming droop)
+ *   --unit <k> "<options>"   fwsim scenario options for unit k only, applied
+ *                            after the common ones, e.g. --unit 1 "--p 0 --lgrid 500e-6"
+ *   --bus-event <t:name:val> Bus event, repeatable: vsag freq phase island rload
+ *   --rload <Ω>              Bus load resistance at t = 0 (default none)
+ *   --lload <H>              Bus load inductance (default none)
+ *   --cbus <F>               Bus capacitance (default 50e-6)
+ *   --lsrc <H> / --rsrc <Ω>  Utility source impedance (default 100e-6 / 5e-3)
+ *   --trace <file.csv>       Bus trace: t, Va..Vc, f, breaker, P/Q per unit
+ *   --decim <n>              Trace every n-th step (default 10)
+ * Any other fwsim scenario option (--t-end --p --q --event --lgrid ...)
+ * applies to every unit; --lgrid is then the unit's line to the bus.
+ *
+ * Exit 0 when all units ran, 2 when any unit tripped, 1 on bad arguments.
+ */
+
+#include "mgrid.h"
+#include "sweep.h"
+#include "types.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+/* ============================================================================
+ * ARGUMENTS
+ * ========================================================================== */
+static void Usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [--units n] [--mode m] [--unit k \"options\"]... [--bus-event t:name:value]... "
+                    "[--rload ohm] [--lload H] [--cbus F] [--lsrc H] [--rsrc ohm] "
+                    "[--trace file.csv] [--decim n] [fwsim scenario options]\n", prog);
+}
+
+/* "--p 0 --lgrid 500e-6" → Sim_ParseOption pairs on one unit */
+static bool ParseUnitOptions(SimConfig_t *cfg, const char *spec)
+{
+    char buf[512];
+    char *tok[32];
+    uint32_t n = 0;
+
+    if (strlen(spec) >= sizeof(buf)) return false;
+    strcpy(buf, spec);
+    for (char *p = strtok(buf, " \t"); p != NULL && n < 32U; p = strtok(NULL, " \t")) tok[n++] = p;
+    if ((n & 1U) != 0U) return false;
+
+    for (uint32_t i = 0; i < n; i += 2) {
+        if (!Sim_ParseOption(cfg, tok[i], tok[i + 1])) return false;
+    }
+    return true;
+}
+
+/* ============================================================================
+ * REPORT
+ * ========================================================================== */
+static void PrintMetric(const char *name, double v, const char *unit)
+{
+    if (isnan(v)) printf("%-14s -\n", name);
+    else printf("%-14s %.3f %s\n", name, v, unit);
+}
+
+static void PrintResult(const MgridConfig_t *cfg, const MgridResult_t *res)
+{
+    printf("unit  state  trips    faults  first_trip_s        P_kW      Q_kVAr\n");
+    for (uint32_t k = 0; k < cfg->n_units; k++) {
+        const MgridUnitResult_t *u = &res->unit[k];
+        printf("%4u  %5u  %5u  %8x  %12.4f  %10.2f  %10.2f\n", (unsigned)k, (unsigned)u->sim.final_state,
+               (unsigned)u->sim.trip_count, (unsigned)u->sim.fault_history, u->sim.first_trip_s,
+               1e-3 * u->P_W, 1e-3 * u->Q_VAr);
+    }
+    PrintMetric("t_island", res->t_island_s, "s");
+    PrintMetric("glitch_v", res->glitch_v_pct, "%");
+    PrintMetric("glitch_phase", res->glitch_phase_deg, "deg");
+    PrintMetric("f_min", res->f_min_hz, "Hz");
+    PrintMetric("f_max", res->f_max_hz, "Hz");
+    PrintMetric("f_final", res->f_final_hz, "Hz");
+    PrintMetric("v_final", res->v_final_pu, "pu");
+    PrintMetric("share_p", res->share_p_pct, "% of rating");
+    PrintMetric("share_q", res->share_q_pct, "% of rating");
+    printf("wall           %.2f s\n", res->t_wall_s);
+}
+
+int main(int argc, char **argv)
+{
+    static MgridConfig_t cfg;
+    static MgridResult_t res;
+    const char *unit_spec[MGRID_MAX_UNITS] = { NULL };
+    const char *trace_path = NULL;
+    double mode = (double)MODE_DROOP;
+    uint32_t n_units = 2;
+
+    /* Unit count first: the defaults depend on it */
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], "--units") == 0) n_units = (uint32_t)strtoul(argv[i + 1], NULL, 0);
+    }
+    if (n_units == 0U || n_units > MGRID_MAX_UNITS) { Usage(argv[0]); return 1; }
+    Mgrid_DefaultConfig(&cfg, n_units);
+
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        const char *v = (i + 1 < argc) ? argv[i + 1] : NULL;
+        bool ok = true;
+
+        if (v == NULL) { Usage(argv[0]); return 1; }
+        i++;
+
+        if (strcmp(a, "--units") == 0)                  continue;
+        else if (strcmp(a, "--mode") == 0)              mode = strtod(v, NULL);
+        else if (strcmp(a, "--bus-event") == 0)         ok = Mgrid_ParseBusEvent(&cfg, v);
+        else if (strcmp(a, "--rload") == 0)             cfg.bus.R_load = strtod(v, NULL);
+        else if (strcmp(a, "--lload") == 0)             cfg.bus.L_load = strtod(v, NULL);
+        else if (strcmp(a, "--cbus") == 0)              cfg.bus.C_bus = strtod(v, NULL);
+        else if (strcmp(a, "--lsrc") == 0)              cfg.bus.L_src = strtod(v, NULL);
+        else if (strcmp(a, "--rsrc") == 0)              cfg.bus.R_src = strtod(v, NULL);
+        else if (strcmp(a, "--trace") == 0)             trace_path = v;
+        else if (strcmp(a, "--decim") == 0)             cfg.trace_decim = (uint32_t)strtoul(v, NULL, 0);
+        else if (strcmp(a, "--unit") == 0) {
+            uint32_t k = (uint32_t)strtoul(v, NULL, 0);
+            if (i + 1 >= argc || k >= n_units) { Usage(argv[0]); return 1; }
+            unit_spec[k] = argv[++i];
+        }
+        else {
+            for (uint32_t k = 0; k < n_units && ok; k++) ok = Sim_ParseOption(&cfg.unit[k], a, v);
+        }
+        if (!ok) {
+            fprintf(stderr, "bad option: %s %s\n", a, v);
+            return 1;
+        }
+    }
+
+    for (uint32_t k = 0; k < n_units; k++) {
+        /* Mode first so a per-unit "--event 0:mode:m" overrides it */
+        SimConfig_t *u = &cfg.unit[k];
+        if (!Sim_AddEvent(u, 0.0, SIM_EV_MODE, mode)) { Usage(argv[0]); return 1; }
+        if (u->n_events > 1U) {
+            SimEvent_t ev = u->events[u->n_events - 1U];
+            memmove(&u->events[1], &u->events[0], (u->n_events - 1U) * sizeof(SimEvent_t));
+            u->events[0] = ev;
+        }
+        if (unit_spec[k] != NULL && !ParseUnitOptions(u, unit_spec[k])) {
+            fprintf(stderr, "bad options for unit %u: %s\n", (unsigned)k, unit_spec[k]);
+            return 1;
+        }
+    }
+
+    if (!Sweep_Parallel()) {
+        fprintf(stderr, "needs the -DFW_INSTANCE_LOCAL=_Thread_local build\n");
+        return 1;
+    }
+    if (trace_path != NULL) {
+        cfg.trace = fopen(trace_path, "w");
+        if (cfg.trace == NULL) {
+            perror(trace_path);
+            return 1;
+        }
+    }
+
+    int rc = Mgrid_Run(&cfg, &res);
+    if (cfg.trace != NULL) fclose(cfg.trace);
+    if (rc == -1 && res.t_wall_s == 0.0) {
+        fprintf(stderr, "thread start failed\n");
+        return 1;
+    }
+    PrintResult(&cfg, &res);
+
+    for (uint32_t k = 0; k < n_units; k++) {
+        if (res.unit[k].rc != 0 || res.unit[k].sim.trip_count > 0U) return 2;
+    }
+    return 0;
+}
@@ -0,0 +1,697 @@
+/**
+ * @file plant.c
+ * @brief T-Type + LCL + Grid + Battery Plant Model for Host Simulation
+ * @version 2.1
+ * 
+ * Per αβ axis the AC network is  x = [ic, vc, ig, iL],  u = [v_conv, v_s]:
+ *   Lc  dic/dt = v_conv - vc - Rc·ic
+ *   C   dvc/dt = ic - ig - iL - vc/R_load          (C = Cf + C_load)
+ *   Lgt dig/dt = vc - v_s - Rgt·ig                 (Lgt = Lg + L_grid)
+ *   Ll  diL/dt = vc
+ * Open grid breaker or open bridge removes the corresponding branch.
+ * 
+ * Bridge: each phase is at level +1/0/-1 (P/NP/N). Within a half carrier
+ * period at most one edge per phase occurs; dead-time moves the edge
+ * according to current polarity (the outer switch turn-on is lost when
+ * the current flows out of the active rail, the turn-off is extended when
+ * it flows into it). With outputs disabled the phases freewheel through
+ * the body diodes to the rail opposing the current.
+ * 
+ * Thermal: level +1/-1 conducts through T1/T4, level 0 through the T2/T3
+ * neutral path, with RDS(on) at the present junction temperature (body
+ * diodes while freewheeling). Each edge costs one hard commutation in the
+ * outer switch when current and level have the same sign, in the neutral
+ * path otherwise, and a dead-time interval of body-diode conduction in the
+ * other one. The Cauer ladders (junction, case, baseplate) and the
+ * heatsink are integrated with forward Euler every PLANT_TH_DECIM nominal
+ * half periods; the fastest ladder time constant is ~15 ms (divided by
+ * th_accel, which must stay below ~50). Rth_ha = 0 holds the heatsink at
+ * ambient.
+ * 
+ * Converter inductor core loss scales with the current ripple of each half
+ * period and the carrier frequency as
+ * CORE_W_REF · (ΔI_pp / CORE_DI_REF)^CORE_BETA · (f_sw / f_nom)^CORE_ALPHA
+ * (Steinmetz exponents).
+ * 
+ * Losses and terminal energies are accounted in every PLANT_LOSS_DECIM-th
+ * half period only, weighted by the time since the previous one; an odd
+ * decimation alternates rising and falling halves. The ripple and current
+ * peaks are still tracked in every half.
+ * 
+ * Carrier period: pl->period may differ from the nominal hrtim_period in
+ * multiples of hrtim_period / 2 up to PLANT_CHUNKS × hrtim_period. The
+ * substep length stays that of the nominal half period, so a half period
+ * of n substeps is integrated in pieces of at most PLANT_SUBSTEPS.
+ */
+
+#include "plant.h"
+#include "config.h"
+#include <math.h>
+#include <string.h>
+
+/* ============================================================================
+ * CONSTANTS
+ * ========================================================================== */
+#define TWO_PI          6.283185307179586
+#define SQRT3_2         0.8660254037844386
+#define DIODE_I_MIN_A   0.5             // Below this the diode bridge blocks
+
+/* Devices: 2 × 650 V SiC MOSFET per outer position, 2S2P in the T2/T3 path */
+#define TH_T1           0U
+#define TH_T4           1U
+#define TH_T23          2U
+#define TH_TYPE(pos)    (((pos) % 3U == TH_T23) ? 1U : 0U)
+#define TH_RDS_TC       0.0055          // RDS(on) rise per K above 25 °C
+#define TH_ESW_J_PER_AV 3.2e-8          // Eon + Eoff per position [J/(A·V)]
+#define TH_VF_BODY_V    4.0             // SiC body diode forward voltage [V]
+
+/* Converter inductor core (powder core, per phase) */
+#define CORE_W_REF      15.0            // At CORE_DI_REF peak-peak ripple [W]
+#define CORE_DI_REF     15.0            // [A]
+#define CORE_BETA       2.2
+#define CORE_ALPHA      1.3
+
+#define PLANT_CHUNKS    4               // Longest half period in nominal halves
+
+/* Junction to heatsink Cauer ladders per position type */
+static const double th_rds25[2] = { 5e-3, 10e-3 };
+static const double th_R[2][PLANT_TH_ORDER] = {
+    { 0.06, 0.10, 0.30 },
+    { 0.015, 0.025, 0.15 },
+};
+static const double th_C[2][PLANT_TH_ORDER] = {
+    { 0.25, 1.5, 7.0 },
+    { 1.0, 6.0, 14.0 },
+};
+
+/* ============================================================================
+ * PARAMETERS
+ * ========================================================================== */
+void Plant_DefaultParams(PlantParams_t *p)
+{
+    memset(p, 0, sizeof(*p));
+    
+    p->Lc = LC_INDUCTANCE_H;
+    p->Rc = 5e-3;
+    p->Cf = CF_CAPACITANCE_F;
+    p->Lg = LG_INDUCTANCE_H;
+    p->Rg = 3e-3;
+    
+    /* SCR ≈ 20 at 120 kW: Zbase = 480² / 120k = 1.92 Ω */
+    p->L_grid = 250e-6;
+    p->R_grid = 10e-3;
+    p->V_ll_rms = VAC_NOMINAL_V;
+    p->f_grid = GRID_FREQ_NOMINAL_HZ;
+    
+    p->C_half = 2.0 * CDC_CAPACITANCE_F;
+    p->V_bat_nom = VDC_NOMINAL_V;
+    p->V_bat_slope = 100.0;
+    p->R_bat = 50e-3;
+    p->R_precharge = 50.0;
+    p->bat_capacity_Ah = 200.0;
+    p->soc0 = 0.5;
+    p->Vdc0 = 0.6 * VDC_NOMINAL_V;  // Residual charge, above STANDBY threshold
+    p->P_dc_load = 0.0;
+    
+    p->T_ambient = 40.0;
+    p->T_heatsink0 = 40.0;
+    p->Rth_ha = 0.045;              // Heatsink ~78 °C at 120 kW, 45 °C air
+    p->C_hs = 1300.0;               // τ ≈ 60 s
+    p->tau_ntc = 5.0;
+    p->th_accel = 1.0;
+    
+    p->f_hrtim = HRTIM_FREQ_HZ;
+    p->hrtim_period = HRTIM_PERIOD;
+    p->t_half = 0.5 * (double)HRTIM_PERIOD / (double)HRTIM_FREQ_HZ;
+}
+
+/* ============================================================================
+ * DISCRETISATION
+ * ========================================================================== */
+static void BuildContinuous(const PlantParams_t *p, uint32_t net,
+                            double A[PLANT_NX][PLANT_NX], double B[PLANT_NX][PLANT_NU])
+{
+    memset(A, 0, sizeof(double) * PLANT_NX * PLANT_NX);
+    memset(B, 0, sizeof(double) * PLANT_NX * PLANT_NU);
+    
+    double C = p->Cf + p->C_load;
+    double Lgt = p->Lg + p->L_grid;
+    double Rgt = p->Rg + p->R_grid;
+    
+    if (net & PLANT_NET_BRIDGE) {
+        A[0][0] = -p->Rc / p->Lc;
+        A[0][1] = -1.0 / p->Lc;
+        B[0][0] = 1.0 / p->Lc;
+        A[1][0] = 1.0 / C;
+    }
+    
+    if (p->R_load > 0.0) A[1][1] = -1.0 / (p->R_load * C);
+    
+    if (net & PLANT_NET_GRID) {
+        A[1][2] = -1.0 / C;
+        A[2][1] = 1.0 / Lgt;
+        A[2][2] = -Rgt / Lgt;
+        B[2][1] = -1.0 / Lgt;
+    }
+    
+    if (p->L_load > 0.0) {
+        A[1][3] = -1.0 / C;
+        A[3][1] = 1.0 / p->L_load;
+    }
+}
+
+static void MatMul(double R[PLANT_NX][PLANT_NX], 
+                   double X[PLANT_NX][PLANT_NX], double Y[PLANT_NX][PLANT_NX])
+{
+    double T[PLANT_NX][PLANT_NX];
+    for (int i = 0; i < PLANT_NX; i++) {
+        for (int j = 0; j < PLANT_NX; j++) {
+            double acc = 0.0;
+            for (int k = 0; k < PLANT_NX; k++) acc += X[i][k] * Y[k][j];
+            T[i][j] = acc;
+        }
+    }
+    memcpy(R, T, sizeof(T));
+}
+
+static void Discretise(Plant_t *pl, uint32_t net)
+{
+    double A[PLANT_NX][PLANT_NX], B[PLANT_NX][PLANT_NU];
+    double q = pl->p.t_half / PLANT_SUBSTEPS;
+    
+    BuildContinuous(&pl->p, net, A, B);
+    
+    /* Taylor series: Φ = Σ (Aq)^k/k!,  Γ = Σ A^k q^(k+1)/(k+1)! · B */
+    double Phi1[PLANT_NX][PLANT_NX] = {{0}};
+    double S[PLANT_NX][PLANT_NX] = {{0}};         // Σ A^k q^(k+1)/(k+1)!
+    double term[PLANT_NX][PLANT_NX] = {{0}};      // (Aq)^k / k!
+    
+    for (int i = 0; i < PLANT_NX; i++) term[i][i] = 1.0;
+    
+    for (int k = 0; k < 12; k++) {
+        for (int i = 0; i < PLANT_NX; i++) {
+            for (int j = 0; j < PLANT_NX; j++) {
+                Phi1[i][j] += term[i][j];
+                S[i][j] += term[i][j] * q / (double)(k + 1);
+            }
+        }
+        double Aq[PLANT_NX][PLANT_NX];
+        for (int i = 0; i < PLANT_NX; i++) {
+            for (int j = 0; j < PLANT_NX; j++) Aq[i][j] = A[i][j] * q / (double)(k + 1);
+        }
+        MatMul(term, Aq, term);
+    }
+    
+    double Gam1[PLANT_NX][PLANT_NU];
+    for (int i = 0; i < PLANT_NX; i++) {
+        for (int j = 0; j < PLANT_NU; j++) {
+            double acc = 0.0;
+            for (int k = 0; k < PLANT_NX; k++) acc += S[i][k] * B[k][j];
+            Gam1[i][j] = acc;
+        }
+    }
+    
+    /* Φ(n+1) = Φ(n)·Φ(1),  Γ(n+1) = Γ(n) + Φ(n)·Γ(1) */
+    double (*Phi)[PLANT_NX][PLANT_NX] = pl->Phi[net];
+    double (*Gam)[PLANT_NX][PLANT_NU] = pl->Gam[net];
+    
+    memset(Phi[0], 0, sizeof(Phi[0]));
+    memset(Gam[0], 0, sizeof(Gam[0]));
+    for (int i = 0; i < PLANT_NX; i++) Phi[0][i][i] = 1.0;
+    
+    for (int n = 0; n < PLANT_SUBSTEPS; n++) {
+        MatMul(Phi[n + 1], Phi[n], Phi1);
+        for (int i = 0; i < PLANT_NX; i++) {
+            for (int j = 0; j < PLANT_NU; j++) {
+                double acc = Gam[n][i][j];
+                for (int k = 0; k < PLANT_NX; k++) acc += Phi[n][i][k] * Gam1[k][j];
+                Gam[n + 1][i][j] = acc;
+            }
+        }
+    }
+}
+
+void Plant_Rebuild(Plant_t *pl)
+{
+    for (uint32_t net = 0; net < PLANT_NET_COUNT; net++) {
+        Discretise(pl, net);
+    }
+    
+    /* iL is decoupled (and stays zero) without a load inductor */
+    pl->nx = (pl->p.L_load > 0.0) ? PLANT_NX : PLANT_NX - 1;
+}
+
+/* ============================================================================
+ * INITIALIZATION
+ * ========================================================================== */
+void Plant_Init(Plant_t *pl, const PlantParams_t *p)
+{
+    memset(pl, 0, sizeof(*pl));
+    pl->p = *p;
+    
+    pl->omega_grid = TWO_PI * p->f_grid;
+    pl->V_pk = p->V_ll_rms * sqrt(2.0 / 3.0);
+    pl->grid_breaker = true;
+    
+    pl->soc = p->soc0;
+    pl->bms_limit_pu = 1.0;
+    pl->v_pos = 0.5 * p->Vdc0;
+    pl->v_neg = 0.5 * p->Vdc0;
+    pl->dead_ticks = HRTIM_DEAD_TIME_RISING;
+    pl->period = p->hrtim_period;
+    
+    pl->T_hs = p->T_heatsink0;
+    pl->T_ntc = p->T_heatsink0;
+    for (uint32_t pos = 0; pos < PLANT_TH_POSITIONS; pos++) {
+        for (uint32_t k = 0; k < PLANT_TH_ORDER; k++) pl->th_T[pos][k] = p->T_heatsink0;
+    }
+    
+    /* Filter capacitor starts at the grid voltage */
+    pl->x[0][1] = pl->V_pk;
+    pl->x[1][1] = 0.0;
+    
+    Plant_Rebuild(pl);
+}
+
+double Plant_BatteryOcv(const Plant_t *pl)
+{
+    return pl->p.V_bat_nom + (pl->soc - 0.5) * pl->p.V_bat_slope;
+}
+
+void Plant_ResetLosses(Plant_t *pl)
+{
+    memset(&pl->loss, 0, sizeof(pl->loss));
+    pl->loss_h = 0.0;
+}
+
+double Plant_JunctionMax(const Plant_t *pl)
+{
+    double t = pl->th_T[0][0];
+    for (uint32_t pos = 1; pos < PLANT_TH_POSITIONS; pos++) {
+        if (pl->th_T[pos][0] > t) t = pl->th_T[pos][0];
+    }
+    return t;
+}
+
+/* ============================================================================
+ * THERMAL NETWORK
+ * ========================================================================== */
+static void ThermalStep(Plant_t *pl, double h)
+{
+    const PlantParams_t *p = &pl->p;
+    double q_hs = 0.0;      // Heat into the heatsink [W]
+    
+    for (uint32_t pos = 0; pos < PLANT_TH_POSITIONS; pos++) {
+        const double *R = th_R[TH_TYPE(pos)];
+        const double *C = th_C[TH_TYPE(pos)];
+        double *T = pl->th_T[pos];
+        double q[PLANT_TH_ORDER + 1];
+        
+        q[0] = pl->th_E[pos] / h;
+        pl->th_E[pos] = 0.0;
+        for (uint32_t k = 0; k < PLANT_TH_ORDER; k++) {
+            double T_next = (k + 1 < PLANT_TH_ORDER) ? T[k + 1] : pl->T_hs;
+            q[k + 1] = (T[k] - T_next) / R[k];
+        }
+        for (uint32_t k = 0; k < PLANT_TH_ORDER; k++) {
+            T[k] += h * p->th_accel * (q[k] - q[k + 1]) / C[k];
+        }
+        q_hs += q[PLANT_TH_ORDER];
+    }
+    
+    if (p->Rth_ha > 0.0) {
+        pl->T_hs += h * p->th_accel * (q_hs - (pl->T_hs - p->T_ambient) / p->Rth_ha) / p->C_hs;
+    } else {
+        pl->T_hs = p->T_ambient;
+    }
+    pl->T_ntc += h / p->tau_ntc * (pl->T_hs - pl->T_ntc);
+}
+
+/* Conduction loss of one phase over a segment at level lv */
+static inline void ConductionLoss(Plant_t *pl, int ph, int lv, double i, double dt)
+{
+    uint32_t pos = 3U * (uint32_t)ph + ((lv > 0) ? TH_T1 : ((lv < 0) ? TH_T4 : TH_T23));
+    double e;
+    if (pl->outputs_enabled) {
+        double rds = th_rds25[TH_TYPE(pos)] * (1.0 + TH_RDS_TC * (pl->th_T[pos][0] - 25.0));
+        e = i * i * rds * dt;
+        pl->loss.E_cond += e;
+    } else {
+        e = TH_VF_BODY_V * fabs(i) * dt;
+        pl->loss.E_diode += e;
+    }
+    pl->th_E[pos] += e;
+}
+
+/* Commutation and dead-time diode loss of one edge from or to level lv */
+static inline void EdgeLoss(Plant_t *pl, int ph, int lv, double i, double t_dead, double w)
+{
+    double i_mag = fabs(i);
+    double v_sw = (lv > 0) ? pl->v_pos : pl->v_neg;
+    uint32_t outer = 3U * (uint32_t)ph + ((lv > 0) ? TH_T1 : TH_T4);
+    uint32_t inner = 3U * (uint32_t)ph + TH_T23;
+    bool outer_hard = i * (double)lv > 0.0;
+    double e_sw = 0.5 * TH_ESW_J_PER_AV * i_mag * v_sw * w;
+    double e_bd = TH_VF_BODY_V * i_mag * t_dead * w;
+    pl->th_E[outer_hard ? outer : inner] += e_sw;
+    pl->th_E[outer_hard ? inner : outer] += e_bd;
+    pl->loss.E_sw += e_sw;
+    pl->loss.E_diode += e_bd;
+}
+
+/* ============================================================================
+ * GRID SOURCE (αβ)
+ * ========================================================================== */
+#define PHASOR_RESYNC_MASK  0xFFFU      // Exact cos/sin every 4096 steps
+
+static void GridPhasor(Plant_t *pl, double theta, double h, double *c, double *s)
+{
+    const double dtheta = pl->omega_grid * h;
+    
+    if (pl->omega_grid != pl->rot_omega || h != pl->rot_h) {
+        pl->rot_omega = pl->omega_grid;
+        pl->rot_h = h;
+        pl->rot_cos = cos(dtheta);
+        pl->rot_sin = sin(dtheta);
+        pl->ph_valid = false;
+    }
+    
+    /* Rotate if theta is the previous angle advanced by one step */
+    double err = theta - (pl->ph_theta + dtheta);
+    if (err > 0.5 * TWO_PI) err -= TWO_PI;
+    else if (err < -0.5 * TWO_PI) err += TWO_PI;
+    
+    if (pl->ph_valid && fabs(err) < 1e-9 && (pl->half_periods & PHASOR_RESYNC_MASK) != 0) {
+        double cn = pl->ph_cos * pl->rot_cos - pl->ph_sin * pl->rot_sin;
+        double sn = pl->ph_sin * pl->rot_cos + pl->ph_cos * pl->rot_sin;
+        pl->ph_cos = cn;
+        pl->ph_sin = sn;
+    } else {
+        pl->ph_cos = cos(theta);
+        pl->ph_sin = sin(theta);
+        pl->ph_valid = true;
+    }
+    pl->ph_theta = theta;
+    
+    *c = pl->ph_cos;
+    *s = pl->ph_sin;
+}
+
+static void GridVoltage(Plant_t *pl, double theta, double h, double *va, double *vb)
+{
+    double c1, s1;
+    GridPhasor(pl, theta, h, &c1, &s1);
+    
+    /* Positive sequence + negative-sequence unbalance */
+    *va = pl->V_pk * (1.0 + pl->unbalance_pu) * c1;
+    *vb = pl->V_pk * (1.0 - pl->unbalance_pu) * s1;
+    
+    /* 5th harmonic, negative sequence */
+    if (pl->h5_pu != 0.0) {
+        *va += pl->h5_pu * pl->V_pk * cos(5.0 * theta);
+        *vb -= pl->h5_pu * pl->V_pk * sin(5.0 * theta);
+    }
+}
+
+/* ============================================================================
+ * HALF-PERIOD STEP
+ * rising = true for valley -> crest (carrier counting up)
+ * ========================================================================== */
+static inline void AlphaBetaToAbc(double a, double b, double abc[3])
+{
+    abc[0] = a;
+    abc[1] = -0.5 * a + SQRT3_2 * b;
+    abc[2] = -0.5 * a - SQRT3_2 * b;
+}
+
+/* x ← Φ·x + Γ·u on both axes; nx constant at each call so the loops unroll */
+static inline void NetworkStep(Plant_t *pl, const double Phi[PLANT_NX][PLANT_NX],
+                               const double Gam[PLANT_NX][PLANT_NU], const double u[2][PLANT_NU], uint32_t nx)
+{
+    double xa[PLANT_NX], xb[PLANT_NX];
+    
+    for (uint32_t i = 0; i < nx; i++) {
+        double acc_a = Gam[i][0] * u[0][0] + Gam[i][1] * u[0][1];
+        double acc_b = Gam[i][0] * u[1][0] + Gam[i][1] * u[1][1];
+        for (uint32_t k = 0; k < nx; k++) {
+            acc_a += Phi[i][k] * pl->x[0][k];
+            acc_b += Phi[i][k] * pl->x[1][k];
+        }
+        xa[i] = acc_a;
+        xb[i] = acc_b;
+    }
+    memcpy(pl->x[0], xa, sizeof(double) * nx);
+    memcpy(pl->x[1], xb, sizeof(double) * nx);
+}
+
+void Plant_StepHalfPeriod(Plant_t *pl, bool rising)
+{
+    const PlantParams_t *p = &pl->p;
+    const double q = p->t_half / PLANT_SUBSTEPS;
+    const double substeps_per_tick = PLANT_SUBSTEPS / (0.5 * (double)p->hrtim_period);
+    const double half_ticks = 0.5 * (double)pl->period;
+    
+    /* Length of this half period in substeps */
+    int n_half = (int)((uint64_t)pl->period * PLANT_SUBSTEPS / p->hrtim_period);
+    if (n_half > PLANT_CHUNKS * PLANT_SUBSTEPS) n_half = PLANT_CHUNKS * PLANT_SUBSTEPS;
+    const double h = n_half * q;
+    
+    double i_abc[3];
+    AlphaBetaToAbc(pl->x[0][0], pl->x[1][0], i_abc);
+    
+    /* Per-phase level and edge position (in substeps) */
+    int level[3];
+    int edge[3];
+    bool bridge = pl->relay_grid;
+    
+    if (!pl->outputs_enabled) {
+        /* Freewheeling through body diodes until the currents die out */
+        bool conducting = fabs(i_abc[0]) > DIODE_I_MIN_A || 
+                          fabs(i_abc[1]) > DIODE_I_MIN_A || 
+                          fabs(i_abc[2]) > DIODE_I_MIN_A;
+        for (int ph = 0; ph < 3; ph++) {
+            level[ph] = (i_abc[ph] > 0.0) ? -1 : 1;
+            edge[ph] = rising ? 0 : n_half;             // Whole half active
+        }
+        if (!conducting) {
+            bridge = false;
+            pl->x[0][0] = 0.0;
+            pl->x[1][0] = 0.0;
+        }
+    } else {
+        for (int ph = 0; ph < 3; ph++) {
+            int32_t on = pl->on_ticks[ph];
+            int32_t w = (on < 0) ? -on : on;
+            level[ph] = (on > 0) ? 1 : ((on < 0) ? -1 : 0);
+            
+            double e;
+            bool shorten = (i_abc[ph] >= 0.0) == (level[ph] > 0);
+            if (rising) {
+                /* Leading edge: lost by dead-time if current leaves the rail */
+                e = half_ticks - 0.5 * (double)w;
+                if (shorten) e += (double)pl->dead_ticks;
+            } else {
+                /* Trailing edge: extended by dead-time if current enters the rail */
+                e = 0.5 * (double)w;
+                if (!shorten) e += (double)pl->dead_ticks;
+            }
+            if (w == 0) e = rising ? n_half : 0;
+            else if (w >= (int32_t)pl->period) e = rising ? 0 : n_half;
+            else e = e * substeps_per_tick + 0.5;
+            
+            if (e < 0.0) e = 0.0;
+            if (e > n_half) e = n_half;
+            edge[ph] = (int)e;      // e >= 0: truncation rounds
+        }
+    }
+    
+    if (!pl->relay_grid) {
+        bridge = false;
+        pl->x[0][0] = 0.0;
+        pl->x[1][0] = 0.0;
+    }
+    
+    uint32_t net = (pl->grid_breaker ? PLANT_NET_GRID : 0U) | (bridge ? PLANT_NET_BRIDGE : 0U);
+    if (!pl->grid_breaker) {
+        pl->x[0][2] = 0.0;
+        pl->x[1][2] = 0.0;
+    }
+    
+    /* Grid source (or external bus) held at mid-step */
+    double vs_a, vs_b;
+    if (pl->ext_source) {
+        vs_a = pl->vs_ext[0];
+        vs_b = pl->vs_ext[1];
+    } else {
+        GridVoltage(pl, pl->theta_grid + 0.5 * pl->omega_grid * h, h, &vs_a, &vs_b);
+    }
+    
+    /* Loss accounting in this half, weight = time since the last one in
+     * units of this half */
+    pl->loss_h += h;
+    const bool account = (pl->half_periods % PLANT_LOSS_DECIM) == 0U;
+    const double w = account ? pl->loss_h / h : 0.0;
+    if (account) pl->loss_h = 0.0;
+    
+    /* Commutation and dead-time losses, one per edge inside the half, and
+     * one per level step at its start (whole-half levels: FCS-MPC, and the
+     * polarity change of a PWM phase) */
+    const double t_dead = (double)pl->dead_ticks / p->f_hrtim;
+    for (int ph = 0; ph < 3; ph++) {
+        int start = (rising == (edge[ph] > 0)) ? 0 : level[ph];
+        int end = (rising == (edge[ph] < n_half)) ? level[ph] : 0;
+        if (!pl->outputs_enabled) start = end = 0;
+        
+        if (account && pl->outputs_enabled && bridge) {
+            if (level[ph] != 0 && edge[ph] > 0 && edge[ph] < n_half) {
+                EdgeLoss(pl, ph, level[ph], i_abc[ph], t_dead, w);
+            }
+            if (start != pl->level_end[ph]) {
+                if (start != 0) EdgeLoss(pl, ph, start, i_abc[ph], t_dead, w);
+                if (pl->level_end[ph] != 0) EdgeLoss(pl, ph, pl->level_end[ph], i_abc[ph], t_dead, w);
+            }
+        }
+        pl->level_end[ph] = (int8_t)end;
+    }
+    
+    double i_max[3] = { i_abc[0], i_abc[1], i_abc[2] };
+    double i_min[3] = { i_abc[0], i_abc[1], i_abc[2] };
+    
+    /* Sorted breakpoints: edges, then the pieces of a long half period */
+    int bp[4 + PLANT_CHUNKS] = { 0, edge[0], edge[1], edge[2] };
+    for (int k = 1; k <= PLANT_CHUNKS; k++) {
+        bp[3 + k] = (k * PLANT_SUBSTEPS < n_half) ? k * PLANT_SUBSTEPS : n_half;
+    }
+    for (int i = 1; i < 3 + PLANT_CHUNKS; i++) {
+        for (int j = i + 1; j < 3 + PLANT_CHUNKS; j++) {
+            if (bp[j] < bp[i]) { int t = bp[i]; bp[i] = bp[j]; bp[j] = t; }
+        }
+    }
+    
+    /* Battery branch */
+    double R_bat = pl->relay_main ? p->R_bat : (pl->relay_precharge ? p->R_precharge : 0.0);
+    const double G_bat = (R_bat > 0.0) ? 1.0 / R_bat : 0.0;
+    const double q_C = q / p->C_half;
+    const double ocv = Plant_BatteryOcv(pl);
+    
+    for (int seg = 0; seg < 3 + PLANT_CHUNKS; seg++) {
+        int n = bp[seg + 1] - bp[seg];
+        if (n <= 0) continue;
+        int mid = bp[seg];
+        const double dt_w = n * q * w;      // Accounted time of the segment
+        
+        /* Levels in this segment */
+        double v_abc[3];
+        double i_p = 0.0, i_n = 0.0;
+        AlphaBetaToAbc(pl->x[0][0], pl->x[1][0], i_abc);
+        for (int ph = 0; ph < 3; ph++) {
+            bool active = rising ? (mid >= edge[ph]) : (mid < edge[ph]);
+            int lv = active ? level[ph] : 0;
+            if (lv > 0) { v_abc[ph] = pl->v_pos; i_p += i_abc[ph]; }
+            else if (lv < 0) { v_abc[ph] = -pl->v_neg; i_n += i_abc[ph]; }
+            else v_abc[ph] = 0.0;
+            if (account && bridge) ConductionLoss(pl, ph, lv, i_abc[ph], dt_w);
+            if (i_abc[ph] > i_max[ph]) i_max[ph] = i_abc[ph];
+            if (i_abc[ph] < i_min[ph]) i_min[ph] = i_abc[ph];
+        }
+        if (!bridge) { i_p = 0.0; i_n = 0.0; }
+        
+        const double pcc0[4] = { pl->x[0][1], pl->x[0][2], pl->x[1][1], pl->x[1][2] };    // vc, ig (αβ)
+        double i_seg0[3] = { i_abc[0], i_abc[1], i_abc[2] };
+        
+        /* Clarke (amplitude-invariant) removes the common mode */
+        double vc_a = (2.0 * v_abc[0] - v_abc[1] - v_abc[2]) * (1.0 / 3.0);
+        double vc_b = (v_abc[1] - v_abc[2]) * (0.5 / SQRT3_2);
+        
+        /* AC network: exact step, both axes share Φ and Γ */
+        const double u[2][PLANT_NU] = { { vc_a, vs_a }, { vc_b, vs_b } };
+        if (pl->nx == PLANT_NX) NetworkStep(pl, pl->Phi[net][n], pl->Gam[net][n], u, PLANT_NX);
+        else NetworkStep(pl, pl->Phi[net][n], pl->Gam[net][n], u, PLANT_NX - 1);
+        
+        /* Energy accounting over the segment: converter current is a ramp
+         * (trapezoid / exact square), PCC quantities trapezoidal */
+        if (account && bridge) {
+            double i_seg1[3], p_br = 0.0, i2 = 0.0;
+            AlphaBetaToAbc(pl->x[0][0], pl->x[1][0], i_seg1);
+            for (int ph = 0; ph < 3; ph++) {
+                double a = i_seg0[ph], b = i_seg1[ph];
+                p_br += v_abc[ph] * 0.5 * (a + b);
+                i2 += (a * a + a * b + b * b) * (1.0 / 3.0);
+            }
+            pl->loss.E_bridge += p_br * dt_w;
+            pl->loss.E_cu_conv += p->Rc * i2 * dt_w;
+            pl->loss.i2_t += i2 * dt_w;
+        }
+        if (account) {
+            double p_pcc0 = 1.5 * (pcc0[0] * pcc0[1] + pcc0[2] * pcc0[3]);
+            double ig2_0 = 1.5 * (pcc0[1] * pcc0[1] + pcc0[3] * pcc0[3]);
+            double p_pcc1 = 1.5 * (pl->x[0][1] * pl->x[0][2] + pl->x[1][1] * pl->x[1][2]);
+            double ig2_1 = 1.5 * (pl->x[0][2] * pl->x[0][2] + pl->x[1][2] * pl->x[1][2]);
+            pl->loss.E_pcc += 0.5 * (p_pcc0 + p_pcc1) * dt_w;
+            pl->loss.E_cu_grid += 0.5 * p->Rg * (ig2_0 + ig2_1) * dt_w;
+        }
+        
+        /* DC link: forward Euler over the segment; the load draws constant
+         * power above its under-voltage lockout */
+        double vdc = pl->v_pos + pl->v_neg;
+        pl->i_bat = (ocv - vdc) * G_bat;
+        pl->i_dc_load = (p->P_dc_load != 0.0 && vdc > PLANT_DC_LOAD_UVLO_V) ? p->P_dc_load / vdc : 0.0;
+        pl->v_pos += n * q_C * (pl->i_bat - pl->i_dc_load - i_p);
+        pl->v_neg += n * q_C * (pl->i_bat - pl->i_dc_load + i_n);
+    }
+    
+    /* Core loss from the ripple of this half */
+    const double k_core = account ? pow((double)p->hrtim_period / (double)pl->period, CORE_ALPHA) : 0.0;
+    AlphaBetaToAbc(pl->x[0][0], pl->x[1][0], i_abc);
+    for (int ph = 0; ph < 3; ph++) {
+        if (i_abc[ph] > i_max[ph]) i_max[ph] = i_abc[ph];
+        if (i_abc[ph] < i_min[ph]) i_min[ph] = i_abc[ph];
+        if (account) {
+            pl->loss.E_core += CORE_W_REF * pow((i_max[ph] - i_min[ph]) / CORE_DI_REF, CORE_BETA) * k_core * h * w;
+        }
+        if (i_max[ph] - i_min[ph] > pl->loss.di_max) pl->loss.di_max = i_max[ph] - i_min[ph];
+        if (i_max[ph] > pl->loss.i_peak) pl->loss.i_peak = i_max[ph];
+        if (-i_min[ph] > pl->loss.i_peak) pl->loss.i_peak = -i_min[ph];
+    }
+    pl->loss.t += h;
+    pl->loss.halves += 1.0;
+    
+    /* Battery SOC (+ = discharge) */
+    pl->soc -= pl->i_bat * h / (3600.0 * p->bat_capacity_Ah);
+    
+    /* Thermal network */
+    pl->th_substeps += (uint32_t)n_half;
+    if (pl->th_substeps >= PLANT_TH_DECIM * PLANT_SUBSTEPS) {
+        ThermalStep(pl, pl->th_substeps * q);
+        pl->th_substeps = 0;
+    }
+    
+    /* Advance time and grid angle */
+    pl->theta_grid += pl->omega_grid * h;
+    if (pl->theta_grid >= TWO_PI) pl->theta_grid -= TWO_PI;
+    pl->t += h;
+    pl->ticks += pl->period / 2U;
+    pl->half_periods++;
+}
+
+/* ============================================================================
+ * SENSORS
+ * ========================================================================== */
+void Plant_Sample(const Plant_t *pl, PlantSample_t *s)
+{
+    double v[3], i[3], ig[3];
+    
+    AlphaBetaToAbc(pl->x[0][1], pl->x[1][1], v);
+    AlphaBetaToAbc(pl->x[0][0], pl->x[1][0], i);
+    AlphaBetaToAbc(pl->x[0][2], pl->x[1][2], ig);
+    
+    s->Va = v[0];  s->Vb = v[1];  s->Vc = v[2];
+    s->Ia = i[0];  s->Ib = i[1];  s->Ic = i[2];
+    s->Iga = ig[0]; s->Igb = ig[1]; s->Igc = ig[2];
+    s->Vdc_pos = pl->v_pos;
+    s->Vdc_neg = pl->v_neg;
+    s->Idc = pl->i_bat;
+    s->Vbat = Plant_BatteryOcv(pl) - pl->i_bat * pl->p.R_bat;
+    s->Ibat = pl->i_bat;
+    s->T_ntc = pl->T_ntc;
+}
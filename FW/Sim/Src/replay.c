@@ -0,0 +1,261 @@
+/**
+ * @file replay.c
+ * @brief Replay of Recorder Images Through the Control ISR
+ * @version 2.1
+ * @date 2025-12
+ *
+ * Blocks are replayed oldest first. Every block restarts from its
+ * keyframe, so a divergence never propagates past the block it starts in.
+ * Fields are matched by id and size: a recording from another firmware
+ * build replays as long as the ISR-visible structures kept their layout;
+ * fields that do not match are skipped and counted.
+ */
+
+#include "replay.h"
+#include "recorder.h"
+#include "main.h"
+#include "types.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* ============================================================================
+ * PRIVATE VARIABLES
+ * ========================================================================== */
+static FW_INSTANCE_LOCAL struct {
+    bool active;
+    AdcRaw_t raw;               // Codes of the frame being replayed
+    bool duty_set;              // HRTIM_SetDuty called in this frame
+    uint16_t duty[3];
+} rp;
+
+/* ============================================================================
+ * DRIVER HOOKS
+ * ========================================================================== */
+bool Replay_Active(void)
+{
+    return rp.active;
+}
+
+void Replay_GetRaw(AdcRaw_t *raw)
+{
+    *raw = rp.raw;
+}
+
+void Replay_CaptureDuty(uint16_t duty_a, uint16_t duty_b, uint16_t duty_c)
+{
+    rp.duty_set = true;
+    rp.duty[0] = duty_a;
+    rp.duty[1] = duty_b;
+    rp.duty[2] = duty_c;
+}
+
+/* ============================================================================
+ * DECODING
+ * ========================================================================== */
+static bool GetVarint(const uint8_t **p, const uint8_t *end, int32_t *delta)
+{
+    uint32_t z = 0;
+
+    for (uint32_t shift = 0; shift < 35; shift += 7) {
+        if (*p >= end) return false;
+        uint8_t b = *(*p)++;
+        z |= (uint32_t)(b & 0x7FU) << shift;
+        if ((b & 0x80U) == 0) {
+            *delta = (int32_t)(z >> 1) ^ -(int32_t)(z & 1U);
+            return true;
+        }
+    }
+    return false;
+}
+
+static void ApplyField(uint8_t id, const uint8_t *data, uint32_t size, ReplayResult_t *res)
+{
+    const RecField_t *f = Recorder_FindField(id);
+
+    if (f == NULL || f->size != size) {
+        res->field_skips++;
+        return;
+    }
+    memcpy((uint8_t *)&g_sys + f->offset, data, size);
+}
+
+static bool ParseKeyframe(const uint8_t **pp, const uint8_t *end, ReplayResult_t *res)
+{
+    const uint8_t *p = *pp;
+
+    for (;;) {
+        if (p >= end) return false;
+        uint8_t id = *p++;
+        if (id == REC_FIELD_END) break;
+        if (end - p < 2) return false;
+        uint32_t size = (uint32_t)p[0] | ((uint32_t)p[1] << 8);
+        p += 2;
+        if ((uint32_t)(end - p) < size) return false;
+        ApplyField(id, p, size, res);
+        p += size;
+    }
+    *pp = p;
+    return true;
+}
+
+static bool ParseCommands(const uint8_t **pp, const uint8_t *end, ReplayResult_t *res)
+{
+    const uint8_t *p = *pp;
+
+    if (p >= end) return false;
+    uint8_t count = *p++;
+    for (uint8_t i = 0; i < count; i++) {
+        if (end - p < 2) return false;
+        uint8_t id = p[0];
+        uint32_t size = p[1];
+        p += 2;
+        if ((uint32_t)(end - p) < size) return false;
+        ApplyField(id, p, size, res);
+        p += size;
+    }
+    *pp = p;
+    return true;
+}
+
+/* ============================================================================
+ * OUTPUT
+ * ========================================================================== */
+static void CsvHeader(FILE *f)
+{
+    fprintf(f, "frame,state,faults,duty_set,duty_a,duty_b,duty_c,"
+               "Id,Iq,Id_ref,Iq_ref,Vd_ref,Vq_ref,theta,freq\n");
+}
+
+static void CsvRow(FILE *f, uint32_t frame)
+{
+    /* %.9g round-trips binary32, so equal text means equal bits */
+    fprintf(f, "%u,%u,%u,%u,%u,%u,%u,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g\n",
+            (unsigned)frame, (unsigned)g_sys.state, (unsigned)g_sys.faults,
+            rp.duty_set ? 1U : 0U, rp.duty[0], rp.duty[1], rp.duty[2],
+            (double)g_sys.I_dq.d, (double)g_sys.I_dq.q,
+            (double)g_sys.ref.Id_ref, (double)g_sys.ref.Iq_ref,
+            (double)g_sys.V_ref_dq.d, (double)g_sys.V_ref_dq.q,
+            (double)g_sys.pll.theta, (double)g_sys.pll.frequency);
+}
+
+/* ============================================================================
+ * BLOCK REPLAY
+ * ========================================================================== */
+static int ReplayBlock(const RecBlock_t *blk, FILE *csv, ReplayResult_t *res)
+{
+    const uint8_t *p = blk->data;
+    const uint8_t *end = blk->data + blk->used;
+    uint16_t code[ADC_RAW_COUNT] = { 0 };
+    uint16_t duty[3] = { 0 };
+    uint32_t frame = blk->first_frame;
+    int32_t d;
+
+    if (blk->used > REC_PAYLOAD_SIZE || blk->used == 0 || p[0] != REC_TAG_KEYFRAME) return -1;
+
+    while (p < end) {
+        uint8_t tag = *p++;
+
+        switch (tag) {
+            case REC_TAG_KEYFRAME:
+                if (!ParseKeyframe(&p, end, res)) return -1;
+                break;
+
+            case REC_TAG_COMMAND:
+                if (!ParseCommands(&p, end, res)) return -1;
+                break;
+
+            case REC_TAG_FRAME: {
+                for (uint32_t i = 0; i < ADC_RAW_COUNT; i++) {
+                    if (!GetVarint(&p, end, &d)) return -1;
+                    code[i] = (uint16_t)(code[i] + d);
+                }
+                memcpy(rp.raw.code, code, sizeof(code));
+                rp.duty_set = false;
+
+                HRTIM1_Master_IRQHandler();
+
+                /* Recorded output, if any, follows its frame */
+                bool recorded = (p < end && *p == REC_TAG_OUTPUT);
+                bool match = (recorded == rp.duty_set);
+                if (recorded) {
+                    p++;
+                    for (uint32_t i = 0; i < 3; i++) {
+                        if (!GetVarint(&p, end, &d)) return -1;
+                        duty[i] = (uint16_t)(duty[i] + d);
+                    }
+                    res->outputs++;
+                    match = match && memcmp(duty, rp.duty, sizeof(duty)) == 0;
+                }
+                if (!match) {
+                    if (res->first_mismatch < 0) res->first_mismatch = frame;
+                    res->mismatches++;
+                }
+
+                if (csv) CsvRow(csv, frame);
+                frame++;
+                res->frames++;
+                break;
+            }
+
+            default:
+                return -1;
+        }
+    }
+    return 0;
+}
+
+static int CompareSeq(const void *a, const void *b)
+{
+    uint32_t sa = (*(const RecBlock_t *const *)a)->seq;
+    uint32_t sb = (*(const RecBlock_t *const *)b)->seq;
+    return (sa > sb) - (sa < sb);
+}
+
+/* ============================================================================
+ * RUN
+ * ========================================================================== */
+int Replay_Run(const char *rec_path, FILE *csv, ReplayResult_t *res)
+{
+    static RecImage_t img;
+    const RecBlock_t *order[REC_BLOCK_COUNT];
+    uint32_t n = 0;
+    int rc = 0;
+
+    memset(res, 0, sizeof(*res));
+    res->first_mismatch = -1;
+
+    FILE *f = fopen(rec_path, "rb");
+    if (f == NULL) return -1;
+    size_t got = fread(&img, 1, sizeof(img), f);
+    fclose(f);
+
+    /* Geometry must match this build (REC_BLOCK_SIZE / REC_BLOCK_COUNT) */
+    if (got != sizeof(img) || img.hdr.magic != REC_MAGIC ||
+        img.hdr.version != REC_FORMAT_VERSION ||
+        img.hdr.header_size != sizeof(RecHeader_t) ||
+        img.hdr.block_size != REC_BLOCK_SIZE ||
+        img.hdr.block_count != REC_BLOCK_COUNT) {
+        return -2;
+    }
+    res->build_id = img.hdr.build_id;
+    res->trigger_frame = img.hdr.trigger_frame;
+    res->trigger_faults = img.hdr.trigger_faults;
+
+    for (uint32_t i = 0; i < REC_BLOCK_COUNT; i++) {
+        if (img.block[i].seq != 0U) order[n++] = &img.block[i];
+    }
+    qsort(order, n, sizeof(order[0]), CompareSeq);
+
+    memset(&g_sys, 0, sizeof(g_sys));
+    memset(&rp, 0, sizeof(rp));
+    rp.active = true;
+    if (csv) CsvHeader(csv);
+
+    for (uint32_t i = 0; i < n && rc == 0; i++) {
+        rc = ReplayBlock(order[i], csv, res);
+        if (rc == 0) res->blocks++;
+    }
+
+    rp.active = false;
+    return rc;
+}
@@ -0,0 +1,883 @@
+/**
+ * @file rtu_main.c
+ * @brief Modbus RTU Pseudo-Terminal Bench
+ * @version 2.1
+ * @date 2025-12
+ *
+ * Usage: fwrtu [options]
+ *   --frames <n>          Timed transactions (default 20000)
+ *   --baud <bps>          Line rate for the wire-time figures
+ *                         (default MODBUS_BAUDRATE)
+ *   --idle-us <us>        Silence that closes a frame at the slave
+ *                         (default one character at --baud)
+ *   --serve <0/1>         Only serve: print the pty path and answer an
+ *                         external master until interrupted (default 0)
+ *
+ * Runs the firmware frame engine (Src/modbus_rtu.c) behind a Linux
+ * pseudo-terminal. The slave thread reads raw bytes and closes a frame
+ * after --idle-us of silence, as the USART idle-line interrupt does on
+ * target, then answers from the register image. The built-in master
+ * first checks every function code, the exception responses and the
+ * frames that must stay unanswered (bad CRC, other address, broadcast),
+ * then times a mix modelled on the host application:
+ *
+ *   FC 04  16 input registers       read_all (legacy registers)
+ *   FC 04  extended telemetry       read_all (32-bit values, one block
+ *   FC 04  extended diagnostics     per read, sequence words compared)
+ *   FC 16  P, Q                     write_power_reference
+ *   FC 03  all holding registers
+ *   FC 23  write P, Q, read all holding registers
+ *
+ * The mix runs with the binary telemetry stream on (one FC 16 to
+ * 40007-40009, as the host application starts it): the slave's main
+ * loop frames the samples onto a second pty, the telemetry UART, and a
+ * reader thread decodes them (COBS, CRC, sequence and sample index).
+ * Every request must still be answered and every frame must arrive.
+ *
+ * A pty has no baud rate: the measured turnaround is engine plus host
+ * scheduling. The wire time of request and response at --baud is listed
+ * next to it, and the link-limited rate adds the slave's idle detection
+ * and the master's 3.5-character gap before the next request.
+ *
+ * The slave thread also stands in for the main loop: every 10 ms of wall
+ * time it marks new data (Modbus_Invalidate) and takes the written
+ * registers, as App_MainLoop does. Before serving it times one main-loop
+ * tick of Modbus work with registers converted on read (now) against
+ * converting both banks every tick (before).
+ *
+ * With --serve 1 the SW/ application connects to the printed paths
+ * (serial port and telemetry port settings) and talks to the same
+ * engine.
+ */
+
+#define _GNU_SOURCE                 // ppoll, posix_openpt, cfmakeraw
+
+#include "modbus.h"
+#include "params.h"
+#include "telemetry.h"
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <termios.h>
+#include <pthread.h>
+#include <time.h>
+
+/* ============================================================================
+ * CONSTANTS
+ * ========================================================================== */
+#define BENCH_TIMEOUT_MS        100         // No response: timeout
+#define BENCH_SILENT_MS         20          // Frames that must stay unanswered
+#define BENCH_MIX               6
+#define BENCH_READ_MAX          125U        // FC 03/04 registers per request
+#define BENCH_VDC               850.25f     // Published Vdc (beyond the 16-bit register)
+#define BENCH_UPTIME_MS         4000000000U
+#define BENCH_TICK_S            0.010       // Main-loop period
+#define BENCH_TICK_LOOPS        200000      // Main-loop cost: ticks timed
+#define CHAR_BITS               10.0        // Start, 8 data, stop (8N1)
+#define BENCH_TLM_MASK          ((1UL << TLM_IA) | (1UL << TLM_IB) | (1UL << TLM_IC))
+#define BENCH_TLM_RATE_HZ       5000U       // Stream during the timed mix
+#define BENCH_TLM_DRAIN_MS      100         // Reader: silence that ends the stream
+
+/* Register images (defined in main.c on target) */
+FW_INSTANCE_LOCAL ModbusRegisters_t g_modbus;
+FW_INSTANCE_LOCAL ModbusExtended_t g_modbus_ext;
+
+/* No parameter flash on the bench: the store starts from its defaults */
+bool ParamsNv_Read(uint32_t slot, void *dst, uint32_t len)
+{
+    (void)slot; (void)dst; (void)len;
+    return false;
+}
+
+bool ParamsNv_Write(uint32_t slot, const void *src, uint32_t len)
+{
+    (void)slot; (void)src; (void)len;
+    return false;
+}
+
+/* ============================================================================
+ * PRIVATE VARIABLES
+ * ========================================================================== */
+static struct {
+    uint32_t frames;
+    double baud;
+    uint32_t idle_us;
+    bool serve;
+} bench;
+
+static int pty_master = -1;         // Slave end of the link (engine)
+static int pty_slave = -1;          // Master end of the link (bench / SW)
+static int tlm_master = -1;         // Telemetry UART (slave main loop)
+static int tlm_slave = -1;          // Telemetry port (reader / SW)
+static struct {
+    uint32_t frames;                // Frames with a valid CRC
+    uint32_t samples;
+    uint32_t crc_errors;            // Bad CRC or COBS
+    uint32_t seq_gaps;              // Frames lost on the line
+    uint32_t index_gaps;            // Samples dropped by the firmware
+    uint32_t line_drops;            // Frames the pty did not take
+} tlm_rx;
+static ModbusStats_t slave_stats;   // Engine statistics when the slave stops
+static uint32_t slave_ticks;        // Main-loop ticks seen by the slave
+static uint32_t slave_takes;        // Ticks that took written registers
+static double tick_lazy_ns;         // Main-loop Modbus work per tick, now
+static double tick_eager_ns;        // Same, converting every tick
+static uint32_t failures;
+
+/* ============================================================================
+ * HELPERS
+ * ========================================================================== */
+static double Now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + 1e-9 * (double)ts.tv_nsec;
+}
+
+static bool WriteAll(int fd, const uint8_t *buf, uint16_t len)
+{
+    while (len > 0U) {
+        ssize_t n = write(fd, buf, len);
+        if (n <= 0) return false;
+        buf += n;
+        len = (uint16_t)(len - n);
+    }
+    return true;
+}
+
+static int CompareDouble(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/* ============================================================================
+ * TELEMETRY UART (telemetry.h on the second pty; no reader: frame dropped)
+ * ========================================================================== */
+bool Telemetry_UartReady(void)
+{
+    return tlm_master >= 0;
+}
+
+bool Telemetry_UartSend(const uint8_t *data, uint16_t len)
+{
+    if (write(tlm_master, data, len) != (ssize_t)len) tlm_rx.line_drops++;
+    return true;
+}
+
+/* Control ISR stand-in: one main-loop tick of samples at the control rate,
+ * currents moving so the deltas are not all zero */
+static void TelemetryTick(SystemData_t *sys)
+{
+    static uint32_t k;
+    
+    for (uint32_t i = 0; i < (uint32_t)(BENCH_TICK_S * CONTROL_LOOP_FREQ_HZ); i++, k++) {
+        sys->ac.Ia = (float32_t)(k % 400U) * 0.5f - 100.0f;
+        sys->ac.Ib = -sys->ac.Ia;
+        sys->ac.Ic = (float32_t)(k % 100U);
+        Telemetry_Capture(sys);
+    }
+    Telemetry_Process(&sys->telem);
+}
+
+/* ============================================================================
+ * SLAVE (frame engine behind the pty)
+ * ========================================================================== */
+/* Main-loop Modbus work per tick: as App_MainLoop now, and with both banks
+ * converted every tick as before (no master polling either way) */
+static void MainLoopCost(void)
+{
+    volatile uint32_t sink = 0;
+    double t0 = Now();
+    
+    for (uint32_t i = 0; i < BENCH_TICK_LOOPS; i++) {
+        Modbus_Invalidate();
+        sink += Modbus_TakeWrites();
+    }
+    double t1 = Now();
+    for (uint32_t i = 0; i < BENCH_TICK_LOOPS; i++) {
+        Modbus_Invalidate();
+        sink += Modbus_TakeWrites();
+        sink += (uint32_t)Modbus_RefreshInputs() + (uint32_t)Modbus_RefreshExtended();
+    }
+    double t2 = Now();
+    (void)sink;
+    
+    tick_lazy_ns = (t1 - t0) * 1e9 / BENCH_TICK_LOOPS;
+    tick_eager_ns = (t2 - t1) * 1e9 / BENCH_TICK_LOOPS;
+}
+
+static void *SlaveThread(void *arg)
+{
+    uint8_t req[2 * MODBUS_ADU_MAX], rsp[MODBUS_ADU_MAX];
+    const struct timespec idle = { 0, (long)bench.idle_us * 1000L };
+    struct pollfd pfd = { pty_master, POLLIN, 0 };
+    (void)arg;
+
+    /* The images belong to this thread in _Thread_local builds */
+    static SystemData_t sys;
+    sys.state = STATE_READY;
+    sys.pll.locked = true;
+    sys.dc.Vdc = BENCH_VDC;
+    sys.dc.Idc = -12.5f;
+    sys.energy_inverter_kWh = 1234.5f;
+    sys.uptime_ms = BENCH_UPTIME_MS;
+    sys.gridz.L_grid = -12e-6f;
+    sys.deadline.shed = SHED_RECORDER | SHED_GRIDZ;
+    sys.svpwm.period = (uint16_t)(HRTIM_FREQ_HZ / PWM_FREQUENCY_HZ);
+    sys.timing.Ts = 1.0f / CONTROL_LOOP_FREQ_HZ;
+    Telemetry_Configure(&sys.telem, 0U, 0U);
+    Params_Init(&sys);
+    Modbus_InitMap(&sys);
+    MainLoopCost();
+    Modbus_InitMap(&sys);
+    Modbus_WriteHoldingRegister(MODBUS_REG(Vdc_ref_V), (uint16_t)VDC_NOMINAL_V);
+    double t_tick = Now();
+
+    for (;;) {
+        /* First byte of a frame; EIO once every master end is closed */
+        ssize_t n = read(pty_master, req, sizeof(req));
+        if (n <= 0) break;
+        size_t len = (size_t)n;
+
+        /* Idle line: the frame ends after idle_us without a byte (an
+         * overlong frame is cut at the buffer and fails its CRC) */
+        while (len < sizeof(req) && ppoll(&pfd, 1, &idle, NULL) > 0) {
+            n = read(pty_master, &req[len], sizeof(req) - len);
+            if (n <= 0) break;
+            len += (size_t)n;
+        }
+
+        /* Main-loop ticks since the last frame: new data, commands taken,
+         * one tick of telemetry samples framed */
+        const double t = Now();
+        if (t - t_tick >= BENCH_TICK_S) {
+            slave_ticks += (uint32_t)((t - t_tick) / BENCH_TICK_S);
+            t_tick = t;
+            Modbus_Invalidate();
+            const uint32_t written = Modbus_TakeWrites();
+            if (written != 0U) slave_takes++;
+            if (written & (MODBUS_WRITTEN(telem_mask_low) | MODBUS_WRITTEN(telem_mask_high) |
+                           MODBUS_WRITTEN(telem_rate_Hz))) {
+                Telemetry_Configure(&sys.telem,
+                                    ((uint32_t)g_modbus.telem_mask_high << 16) | g_modbus.telem_mask_low,
+                                    g_modbus.telem_rate_Hz);
+            }
+            TelemetryTick(&sys);
+        }
+        
+        uint16_t r = Modbus_HandleFrame(req, (uint16_t)len, rsp);
+        if (r > 0U && !WriteAll(pty_master, rsp, r)) break;
+    }
+    slave_stats = *Modbus_GetStats();
+    return NULL;
+}
+
+static bool OpenPty(int *master, int *slave)
+{
+    struct termios tio;
+
+    *master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (*master < 0 || grantpt(*master) != 0 || unlockpt(*master) != 0) return false;
+    *slave = open(ptsname(*master), O_RDWR | O_NOCTTY);
+    if (*slave < 0) return false;
+
+    /* Raw 8-bit both ways: no echo, no line editing, no CR/LF mapping */
+    if (tcgetattr(*slave, &tio) != 0) return false;
+    cfmakeraw(&tio);
+    return tcsetattr(*slave, TCSANOW, &tio) == 0;
+}
+
+/* ============================================================================
+ * TELEMETRY READER (host side of the telemetry port)
+ * ========================================================================== */
+static uint16_t Le16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+/* One COBS-encoded frame between delimiters */
+static void TelemetryFrame(const uint8_t *enc, uint32_t n)
+{
+    static bool started;
+    static uint16_t seq;
+    static uint32_t index;
+    uint8_t raw[TELEMETRY_FRAME_MAX];
+    uint32_t len = 0;
+
+    for (uint32_t i = 0; i < n;) {
+        const uint8_t code = enc[i++];
+        if (code == 0U || i + code - 1U > n) { tlm_rx.crc_errors++; return; }
+        for (uint8_t j = 1; j < code; j++) raw[len++] = enc[i++];
+        if (code < 0xFFU && i < n) raw[len++] = 0x00U;
+    }
+    if (len < TELEMETRY_HEADER_SIZE + 2U ||
+        Modbus_Crc16(raw, (uint16_t)(len - 2U)) != Le16(&raw[len - 2U])) {
+        tlm_rx.crc_errors++;
+        return;
+    }
+
+    const uint16_t f_seq = Le16(&raw[1]);
+    const uint32_t f_index = Le16(&raw[9]) | ((uint32_t)Le16(&raw[11]) << 16);
+    const uint8_t count = raw[13];
+    if (started && f_seq != seq) tlm_rx.seq_gaps++;
+    if (started && f_index != index) tlm_rx.index_gaps++;
+    started = true;
+    seq = (uint16_t)(f_seq + 1U);
+    index = f_index + count;
+    tlm_rx.frames++;
+    tlm_rx.samples += count;
+}
+
+/* Until BENCH_TLM_DRAIN_MS of silence after the mix */
+static void *TelemetryReader(void *arg)
+{
+    static uint8_t enc[TELEMETRY_FRAME_MAX];
+    struct pollfd pfd = { tlm_slave, POLLIN, 0 };
+    const volatile bool *done = (const volatile bool *)arg;
+    uint32_t n = 0;
+    uint8_t buf[256];
+
+    for (;;) {
+        if (poll(&pfd, 1, BENCH_TLM_DRAIN_MS) <= 0) {
+            if (*done) break;
+            continue;
+        }
+        ssize_t got = read(tlm_slave, buf, sizeof(buf));
+        if (got <= 0) break;
+        for (ssize_t i = 0; i < got; i++) {
+            if (buf[i] != 0x00U) {
+                if (n < sizeof(enc)) enc[n++] = buf[i];
+            } else if (n > 0U) {
+                TelemetryFrame(enc, n);
+                n = 0;
+            }
+        }
+    }
+    return NULL;
+}
+
+/* ============================================================================
+ * MASTER (request builders and transactions)
+ * ========================================================================== */
+static uint16_t Finish(uint8_t *f, uint16_t len)
+{
+    uint16_t crc = Modbus_Crc16(f, len);
+    f[len] = (uint8_t)(crc & 0xFFU);
+    f[len + 1U] = (uint8_t)(crc >> 8);
+    return (uint16_t)(len + 2U);
+}
+
+static uint16_t Put16(uint8_t *f, uint16_t at, uint16_t v)
+{
+    f[at] = (uint8_t)(v >> 8);
+    f[at + 1U] = (uint8_t)(v & 0xFFU);
+    return (uint16_t)(at + 2U);
+}
+
+static uint16_t Get16(const uint8_t *p)
+{
+    return (uint16_t)(((uint16_t)p[0] << 8) | p[1]);
+}
+
+static uint16_t RequestRead(uint8_t *f, uint8_t addr, uint8_t fc, uint16_t first, uint16_t n)
+{
+    f[0] = addr;
+    f[1] = fc;
+    Put16(f, 2, first);
+    return Finish(f, Put16(f, 4, n));
+}
+
+static uint16_t RequestWriteSingle(uint8_t *f, uint8_t addr, uint16_t reg, uint16_t v)
+{
+    f[0] = addr;
+    f[1] = MODBUS_FC_WRITE_SINGLE;
+    Put16(f, 2, reg);
+    return Finish(f, Put16(f, 4, v));
+}
+
+static uint16_t RequestWrite(uint8_t *f, uint8_t addr, uint16_t first, uint16_t n, const uint16_t *v)
+{
+    uint16_t at;
+
+    f[0] = addr;
+    f[1] = MODBUS_FC_WRITE_MULTI;
+    Put16(f, 2, first);
+    Put16(f, 4, n);
+    f[6] = (uint8_t)(2U * n);
+    at = 7;
+    for (uint16_t i = 0; i < n; i++) at = Put16(f, at, v[i]);
+    return Finish(f, at);
+}
+
+static uint16_t RequestReadWrite(uint8_t *f, uint16_t r_first, uint16_t r_n,
+                                 uint16_t w_first, uint16_t w_n, const uint16_t *v)
+{
+    uint16_t at;
+
+    f[0] = MODBUS_SLAVE_ADDRESS;
+    f[1] = MODBUS_FC_READ_WRITE;
+    Put16(f, 2, r_first);
+    Put16(f, 4, r_n);
+    Put16(f, 6, w_first);
+    Put16(f, 8, w_n);
+    f[10] = (uint8_t)(2U * w_n);
+    at = 11;
+    for (uint16_t i = 0; i < w_n; i++) at = Put16(f, at, v[i]);
+    return Finish(f, at);
+}
+
+/* Send a request and collect a response of the expected length or an
+ * exception; returns the bytes received (0: none within timeout_ms) */
+static uint16_t Transact(const uint8_t *req, uint16_t len, uint16_t expect, uint8_t *rsp,
+                         int timeout_ms, double *t_us)
+{
+    struct pollfd pfd = { pty_slave, POLLIN, 0 };
+    uint16_t got = 0;
+    double t0 = Now();
+
+    if (!WriteAll(pty_slave, req, len)) return 0;
+    while (got < expect && !(got >= 5U && (rsp[1] & 0x80U) != 0U)) {
+        if (poll(&pfd, 1, timeout_ms) <= 0) break;
+        ssize_t n = read(pty_slave, &rsp[got], (size_t)(MODBUS_ADU_MAX - got));
+        if (n <= 0) break;
+        got = (uint16_t)(got + n);
+    }
+    *t_us = (Now() - t0) * 1e6;
+    return got;
+}
+
+/* Valid frame from this slave for the function: 0, else exception or -1 */
+static int ResponseStatus(const uint8_t *rsp, uint16_t len, uint8_t fc)
+{
+    if (len < 5U || Modbus_Crc16(rsp, (uint16_t)(len - 2U)) != (uint16_t)(rsp[len - 2U] | (rsp[len - 1U] << 8))) {
+        return -1;
+    }
+    if (rsp[0] != MODBUS_SLAVE_ADDRESS) return -1;
+    if (rsp[1] == (fc | 0x80U)) return rsp[2];
+    return (rsp[1] == fc) ? 0 : -1;
+}
+
+static uint32_t Get32(const uint8_t *p)
+{
+    return ((uint32_t)Get16(p) << 16) | Get16(p + 2);
+}
+
+static uint32_t FloatBits(float f)
+{
+    uint32_t u;
+    memcpy(&u, &f, sizeof(u));
+    return u;
+}
+
+static void Check(const char *what, bool ok)
+{
+    printf("  %-44s %s\n", what, ok ? "ok" : "FAIL");
+    if (!ok) failures++;
+}
+
+/* ============================================================================
+ * CONFORMANCE
+ * ========================================================================== */
+static bool ReadHolding(uint16_t *out)
+{
+    uint8_t req[MODBUS_ADU_MAX], rsp[MODBUS_ADU_MAX];
+    const uint16_t n = (uint16_t)MODBUS_HOLDING_COUNT;
+    double t;
+
+    uint16_t len = RequestRead(req, MODBUS_SLAVE_ADDRESS, MODBUS_FC_READ_HOLDING, 0, n);
+    uint16_t got = Transact(req, len, (uint16_t)(5U + 2U * n), rsp, BENCH_TIMEOUT_MS, &t);
+    if (ResponseStatus(rsp, got, MODBUS_FC_READ_HOLDING) != 0 || rsp[2] != 2U * n) return false;
+    for (uint16_t i = 0; i < n; i++) out[i] = Get16(&rsp[3U + 2U * i]);
+    return true;
+}
+
+/* Request expected to draw the given exception */
+static void CheckException(const char *what, const uint8_t *req, uint16_t len, uint8_t ex)
+{
+    uint8_t rsp[MODBUS_ADU_MAX];
+    double t;
+
+    uint16_t got = Transact(req, len, 5U, rsp, BENCH_TIMEOUT_MS, &t);
+    Check(what, ResponseStatus(rsp, got, req[1]) == (int)ex);
+}
+
+/* Request that must stay unanswered */
+static void CheckSilent(const char *what, const uint8_t *req, uint16_t len)
+{
+    uint8_t rsp[MODBUS_ADU_MAX];
+    double t;
+
+    Check(what, Transact(req, len, 5U, rsp, BENCH_SILENT_MS, &t) == 0U);
+}
+
+static void Conformance(void)
+{
+    uint8_t req[MODBUS_ADU_MAX], rsp[MODBUS_ADU_MAX];
+    uint16_t hold[MODBUS_HOLDING_COUNT], len, got;
+    const uint16_t n_in = (uint16_t)MODBUS_INPUT_COUNT;
+    double t;
+
+    printf("conformance\n");
+
+    len = RequestRead(req, MODBUS_SLAVE_ADDRESS, MODBUS_FC_READ_INPUT, 0, n_in);
+    got = Transact(req, len, (uint16_t)(5U + 2U * n_in), rsp, BENCH_TIMEOUT_MS, &t);
+    bool ok = ResponseStatus(rsp, got, MODBUS_FC_READ_INPUT) == 0 && rsp[2] == 2U * n_in;
+    Check("FC 04 all input registers", ok);
+    const uint8_t *in = &rsp[3];
+    Check("status word converted on read", ok && Get16(&in[2 * 0]) == (STATE_READY | 0x0100U));
+    Check("30004 Vdc saturates at 327.67 V", ok && Get16(&in[2 * 3]) == 0x7FFFU);
+    Check("30005 Idc signed", ok && (int16_t)Get16(&in[2 * 4]) == -1250);
+    Check("30018 fsw", ok && Get16(&in[2 * 17]) == PWM_FREQUENCY_HZ / 100U);
+
+    len = RequestWriteSingle(req, MODBUS_SLAVE_ADDRESS, 2, 0x1234U);
+    got = Transact(req, len, 8U, rsp, BENCH_TIMEOUT_MS, &t);
+    ok = ResponseStatus(rsp, got, MODBUS_FC_WRITE_SINGLE) == 0 && memcmp(rsp, req, 8) == 0;
+    Check("FC 06 echo", ok);
+    Check("FC 03 reads the FC 06 value", ReadHolding(hold) && hold[2] == 0x1234U);
+
+    const uint16_t pq[2] = { 600U, (uint16_t)-300 };
+    len = RequestWrite(req, MODBUS_SLAVE_ADDRESS, 2, 2, pq);
+    got = Transact(req, len, 8U, rsp, BENCH_TIMEOUT_MS, &t);
+    ok = ResponseStatus(rsp, got, MODBUS_FC_WRITE_MULTI) == 0 && memcmp(rsp, req, 6) == 0;
+    Check("FC 16 P, Q", ok);
+    Check("FC 03 reads P, Q", ReadHolding(hold) && hold[2] == pq[0] && hold[3] == pq[1]);
+
+    const uint16_t vdc[2] = { 0x0055U, 820U };
+    len = RequestReadWrite(req, 0, (uint16_t)MODBUS_HOLDING_COUNT, 4, 2, vdc);
+    got = Transact(req, len, (uint16_t)(5U + 2U * MODBUS_HOLDING_COUNT), rsp, BENCH_TIMEOUT_MS, &t);
+    ok = ResponseStatus(rsp, got, MODBUS_FC_READ_WRITE) == 0 && rsp[2] == 2U * MODBUS_HOLDING_COUNT &&
+         Get16(&rsp[3 + 2 * 2]) == pq[0] && Get16(&rsp[3 + 2 * 4]) == vdc[0] && Get16(&rsp[3 + 2 * 5]) == vdc[1];
+    Check("FC 23 returns the values it wrote", ok);
+
+    len = RequestRead(req, MODBUS_SLAVE_ADDRESS, MODBUS_FC_READ_HOLDING, 0, 0);
+    CheckException("FC 03 zero registers -> 03", req, len, MODBUS_EX_ILLEGAL_VALUE);
+    len = RequestRead(req, MODBUS_SLAVE_ADDRESS, MODBUS_FC_READ_HOLDING, 0, (uint16_t)(MODBUS_HOLDING_COUNT + 1U));
+    CheckException("FC 03 past the holding bank -> 02", req, len, MODBUS_EX_ILLEGAL_ADDRESS);
+    len = RequestRead(req, MODBUS_SLAVE_ADDRESS, MODBUS_FC_READ_INPUT, n_in, 1);
+    CheckException("FC 04 past the input bank -> 02", req, len, MODBUS_EX_ILLEGAL_ADDRESS);
+
+    const uint16_t bad[2] = { 0xDEADU, 0xBEEFU };
+    len = RequestWrite(req, MODBUS_SLAVE_ADDRESS, (uint16_t)(MODBUS_HOLDING_COUNT - 1U), 2, bad);
+    CheckException("FC 16 across the bank end -> 02", req, len, MODBUS_EX_ILLEGAL_ADDRESS);
+    len = RequestWrite(req, MODBUS_SLAVE_ADDRESS, 2, 2, bad);
+    req[6] = 3;
+    len = Finish(req, (uint16_t)(len - 2U));
+    CheckException("FC 16 byte count mismatch -> 03", req, len, MODBUS_EX_ILLEGAL_VALUE);
+    Check("rejected writes left the image untouched",
+          ReadHolding(hold) && hold[2] == pq[0] && hold[3] == pq[1] && hold[MODBUS_REG(Vdc_ref_V)] == vdc[1]);
+
+    len = RequestRead(req, MODBUS_SLAVE_ADDRESS, 0x2BU, 0, 1);
+    CheckException("FC 43 -> 01", req, len, MODBUS_EX_ILLEGAL_FUNCTION);
+
+    len = RequestRead(req, MODBUS_SLAVE_ADDRESS, MODBUS_FC_READ_HOLDING, 0, 1);
+    req[len - 1U] ^= 0x01U;
+    CheckSilent("bad CRC unanswered", req, len);
+    len = RequestRead(req, MODBUS_SLAVE_ADDRESS + 1U, MODBUS_FC_READ_HOLDING, 0, 1);
+    CheckSilent("other address unanswered", req, len);
+    len = RequestWriteSingle(req, MODBUS_ADDR_BROADCAST, 3, 0x0BCDU);
+    CheckSilent("broadcast FC 06 unanswered", req, len);
+    Check("broadcast FC 06 applied", ReadHolding(hold) && hold[3] == 0x0BCDU);
+
+    /* Extended bank: block by block, one FC 04 each, each block header
+     * giving its length; values high word first */
+    const uint16_t n_ext = (uint16_t)MODBUS_EXT_WORDS;
+    uint8_t ext[2U * MODBUS_EXT_WORDS];
+    uint16_t blocks = 0;
+    ok = true;
+    for (uint16_t at = 0; ok && at < n_ext; blocks++) {
+        const uint16_t left = (uint16_t)(n_ext - at);
+        const uint16_t n = (left > BENCH_READ_MAX) ? (uint16_t)BENCH_READ_MAX : left;
+        len = RequestRead(req, MODBUS_SLAVE_ADDRESS, MODBUS_FC_READ_INPUT, (uint16_t)(MODBUS_EXT_BASE + at), n);
+        got = Transact(req, len, (uint16_t)(5U + 2U * n), rsp, BENCH_TIMEOUT_MS, &t);
+        ok = ResponseStatus(rsp, got, MODBUS_FC_READ_INPUT) == 0 && rsp[2] == 2U * n &&
+             Get16(&rsp[3]) == MODBUS_EXT_VERSION && Get16(&rsp[7]) <= n && Get16(&rsp[7]) > MODBUS_EXT_HEADER;
+        if (ok) memcpy(&ext[2U * at], &rsp[3], 2U * n);
+        if (ok) at = (uint16_t)(at + Get16(&rsp[7]));
+    }
+    const uint8_t *diag = &ext[2U * MODBUS_EXT_DIAG_AT];
+    ok = ok && blocks == 2U && Get16(&ext[2]) + Get16(&diag[2]) == MB_EXT_COUNT;
+    Check("FC 04 extended bank, one read per block", ok);
+    Check("extended blocks carry the same sequence", ok && Get16(&ext[6]) == Get16(&diag[6]));
+
+    uint32_t bits = Get32(&ext[2U * MODBUS_EXT_OFFSET(MB_EXT_VDC)]);
+    float vdc_f;
+    memcpy(&vdc_f, &bits, sizeof(vdc_f));
+    Check("extended Vdc beyond 16 bits (F32)", ok && vdc_f == BENCH_VDC);
+    Check("extended energy scaled (U32, 10^-3)", ok && Get32(&ext[2U * MODBUS_EXT_OFFSET(MB_EXT_ENERGY_INVERTER)]) == 1234500U);
+    Check("extended uptime (U32)", ok && Get32(&ext[2U * MODBUS_EXT_OFFSET(MB_EXT_UPTIME)]) == BENCH_UPTIME_MS);
+    Check("extended grid L signed (I32, 10^-6)", ok && (int32_t)Get32(&ext[2U * MODBUS_EXT_OFFSET(MB_EXT_GRID_L)]) == -12);
+    Check("extended shed stages (U8 source, diagnostics block)",
+          ok && Get32(&ext[2U * MODBUS_EXT_OFFSET(MB_EXT_ISR_SHED)]) == (SHED_RECORDER | SHED_GRIDZ));
+
+    /* Descriptors: header, then the entry of each value */
+    len = RequestRead(req, MODBUS_SLAVE_ADDRESS, MODBUS_FC_READ_INPUT, MODBUS_DESC_BASE, MODBUS_DESC_HEADER);
+    got = Transact(req, len, (uint16_t)(5U + 2U * MODBUS_DESC_HEADER), rsp, BENCH_TIMEOUT_MS, &t);
+    ok = ResponseStatus(rsp, got, MODBUS_FC_READ_INPUT) == 0 && Get16(&rsp[5]) == MB_EXT_COUNT &&
+         Get16(&rsp[7]) == MODBUS_DESC_ENTRY && Get16(&rsp[9]) == MODBUS_EXT_BASE;
+    Check("descriptor header", ok);
+
+    const uint16_t at = (uint16_t)(MODBUS_DESC_BASE + MODBUS_DESC_HEADER + MB_EXT_VDC * MODBUS_DESC_ENTRY);
+    len = RequestRead(req, MODBUS_SLAVE_ADDRESS, MODBUS_FC_READ_INPUT, at, MODBUS_DESC_ENTRY);
+    got = Transact(req, len, (uint16_t)(5U + 2U * MODBUS_DESC_ENTRY), rsp, BENCH_TIMEOUT_MS, &t);
+    ok = ResponseStatus(rsp, got, MODBUS_FC_READ_INPUT) == 0 &&
+         Get16(&rsp[3]) == MODBUS_EXT_OFFSET(MB_EXT_VDC) && rsp[5] == MODBUS_TYPE_F32 &&
+         memcmp(&rsp[7], "V\0", 2) == 0 && memcmp(&rsp[11], "vdc\0", 4) == 0;
+    Check("descriptor of vdc", ok);
+
+    len = RequestRead(req, MODBUS_SLAVE_ADDRESS, MODBUS_FC_READ_INPUT, (uint16_t)(MODBUS_EXT_BASE + n_ext - 1U), 2);
+    CheckException("FC 04 past the extended bank -> 02", req, len, MODBUS_EX_ILLEGAL_ADDRESS);
+
+    /* Parameter bank: header, a value written whole and read back, and the
+     * writes it refuses (range, half a value, header) */
+    const ParamInfo_t *ov = Params_Info(PARAM_VDC_OV);
+    const uint16_t ov_at = (uint16_t)(MODBUS_PARAM_BASE + MODBUS_PARAM_HEADER + 2U * PARAM_VDC_OV);
+    len = RequestRead(req, MODBUS_SLAVE_ADDRESS, MODBUS_FC_READ_HOLDING, MODBUS_PARAM_BASE, MODBUS_PARAM_WORDS);
+    got = Transact(req, len, (uint16_t)(5U + 2U * MODBUS_PARAM_WORDS), rsp, BENCH_TIMEOUT_MS, &t);
+    ok = ResponseStatus(rsp, got, MODBUS_FC_READ_HOLDING) == 0 && Get16(&rsp[3]) == PARAM_VERSION &&
+         Get16(&rsp[5]) == PARAM_COUNT && Get16(&rsp[9]) == MODBUS_PDESC_BASE &&
+         Get32(&rsp[3U + 2U * (ov_at - MODBUS_PARAM_BASE)]) == FloatBits(ov->def);
+    Check("FC 03 parameter bank (defaults)", ok);
+
+    const uint32_t ov_new = FloatBits(0.5f * (ov->min + ov->max));
+    const uint16_t ov_w[2] = { (uint16_t)(ov_new >> 16), (uint16_t)(ov_new & 0xFFFFU) };
+    len = RequestWrite(req, MODBUS_SLAVE_ADDRESS, ov_at, 2, ov_w);
+    got = Transact(req, len, 8U, rsp, BENCH_TIMEOUT_MS, &t);
+    ok = ResponseStatus(rsp, got, MODBUS_FC_WRITE_MULTI) == 0;
+    len = RequestRead(req, MODBUS_SLAVE_ADDRESS, MODBUS_FC_READ_HOLDING, ov_at, 2);
+    got = Transact(req, len, 9U, rsp, BENCH_TIMEOUT_MS, &t);
+    ok = ok && ResponseStatus(rsp, got, MODBUS_FC_READ_HOLDING) == 0 && Get32(&rsp[3]) == ov_new;
+    Check("FC 16 parameter value read back", ok);
+
+    const uint32_t ov_bad = FloatBits(ov->max + 100.0f);
+    const uint16_t ov_b[2] = { (uint16_t)(ov_bad >> 16), (uint16_t)(ov_bad & 0xFFFFU) };
+    len = RequestWrite(req, MODBUS_SLAVE_ADDRESS, ov_at, 2, ov_b);
+    CheckException("FC 16 parameter out of range -> 03", req, len, MODBUS_EX_ILLEGAL_VALUE);
+    len = RequestWriteSingle(req, MODBUS_SLAVE_ADDRESS, ov_at, 0x4400U);
+    CheckException("FC 06 half a parameter -> 02", req, len, MODBUS_EX_ILLEGAL_ADDRESS);
+    len = RequestWrite(req, MODBUS_SLAVE_ADDRESS, MODBUS_PARAM_BASE, 2, ov_w);
+    CheckException("FC 16 parameter header -> 02", req, len, MODBUS_EX_ILLEGAL_ADDRESS);
+    len = RequestRead(req, MODBUS_SLAVE_ADDRESS, MODBUS_FC_READ_HOLDING, ov_at, 2);
+    got = Transact(req, len, 9U, rsp, BENCH_TIMEOUT_MS, &t);
+    Check("refused parameter writes left the value",
+          ResponseStatus(rsp, got, MODBUS_FC_READ_HOLDING) == 0 && Get32(&rsp[3]) == ov_new);
+
+    const uint16_t p_at = (uint16_t)(MODBUS_PDESC_BASE + MODBUS_DESC_HEADER + PARAM_VDC_OV * MODBUS_PDESC_ENTRY);
+    len = RequestRead(req, MODBUS_SLAVE_ADDRESS, MODBUS_FC_READ_INPUT, p_at, MODBUS_PDESC_ENTRY);
+    got = Transact(req, len, (uint16_t)(5U + 2U * MODBUS_PDESC_ENTRY), rsp, BENCH_TIMEOUT_MS, &t);
+    ok = ResponseStatus(rsp, got, MODBUS_FC_READ_INPUT) == 0 &&
+         Get16(&rsp[3]) == ov_at - MODBUS_PARAM_BASE && rsp[5] == MODBUS_TYPE_F32 &&
+         memcmp(&rsp[11], ov->name, strlen(ov->name)) == 0 &&
+         Get32(&rsp[27]) == FloatBits(ov->min) && Get32(&rsp[31]) == FloatBits(ov->max);
+    Check("parameter descriptor with range", ok);
+}
+
+/* ============================================================================
+ * TIMED MIX
+ * ========================================================================== */
+/* Telemetry set and rate, one FC 16 to 40007-40009 */
+static bool WriteTelemetry(uint32_t mask, uint16_t rate_Hz)
+{
+    uint8_t req[MODBUS_ADU_MAX], rsp[MODBUS_ADU_MAX];
+    const uint16_t v[3] = { (uint16_t)(mask & 0xFFFFU), (uint16_t)(mask >> 16), rate_Hz };
+    double t;
+
+    uint16_t len = RequestWrite(req, MODBUS_SLAVE_ADDRESS, MODBUS_REG(telem_mask_low), 3, v);
+    uint16_t got = Transact(req, len, 8U, rsp, BENCH_TIMEOUT_MS, &t);
+    return ResponseStatus(rsp, got, MODBUS_FC_WRITE_MULTI) == 0;
+}
+
+static void TimedMix(void)
+{
+    static const char *const name[BENCH_MIX] = {
+        "FC 04  16 input", "FC 04  ext telemetry", "FC 04  ext diagnostic", "FC 16  P, Q", "FC 03  holding",
+        "FC 23  P, Q + holding"
+    };
+    uint8_t req[MODBUS_ADU_MAX], rsp[MODBUS_ADU_MAX];
+    uint16_t req_len[BENCH_MIX] = {0}, rsp_len[BENCH_MIX] = {0};
+    uint32_t count[BENCH_MIX] = {0}, timeouts = 0, mismatches = 0;
+    const uint16_t n_hold = (uint16_t)MODBUS_HOLDING_COUNT;
+    double *lat[BENCH_MIX];
+    volatile bool tlm_done = false;
+    pthread_t reader;
+
+    for (uint32_t k = 0; k < BENCH_MIX; k++) {
+        lat[k] = (double *)malloc(sizeof(double) * (bench.frames / BENCH_MIX + 1U));
+        if (lat[k] == NULL) exit(1);
+    }
+
+    /* Stream on for the whole mix */
+    if (pthread_create(&reader, NULL, TelemetryReader, (void *)&tlm_done) != 0) exit(1);
+    Check("telemetry stream started (FC 16 40007-40009)", WriteTelemetry(BENCH_TLM_MASK, BENCH_TLM_RATE_HZ));
+
+    uint16_t pq[2] = { 0, 0 };
+    double t0 = Now();
+    for (uint32_t i = 0; i < bench.frames; i++) {
+        const uint32_t k = i % BENCH_MIX;
+        uint16_t len, expect;
+        uint8_t fc;
+        double t;
+
+        switch (k) {
+            case 0:
+                fc = MODBUS_FC_READ_INPUT;
+                len = RequestRead(req, MODBUS_SLAVE_ADDRESS, fc, 0, 16);
+                expect = 5U + 2U * 16U;
+                break;
+            case 1:
+                fc = MODBUS_FC_READ_INPUT;
+                len = RequestRead(req, MODBUS_SLAVE_ADDRESS, fc, MODBUS_EXT_BASE, MODBUS_EXT_DIAG_AT);
+                expect = (uint16_t)(5U + 2U * MODBUS_EXT_DIAG_AT);
+                break;
+            case 2:
+                fc = MODBUS_FC_READ_INPUT;
+                len = RequestRead(req, MODBUS_SLAVE_ADDRESS, fc, (uint16_t)(MODBUS_EXT_BASE + MODBUS_EXT_DIAG_AT),
+                                  (uint16_t)(MODBUS_EXT_WORDS - MODBUS_EXT_DIAG_AT));
+                expect = (uint16_t)(5U + 2U * (MODBUS_EXT_WORDS - MODBUS_EXT_DIAG_AT));
+                break;
+            case 3:
+                pq[0] = (uint16_t)(i & 0x3FFU);
+                pq[1] = (uint16_t)-(int16_t)(i & 0x1FFU);
+                fc = MODBUS_FC_WRITE_MULTI;
+                len = RequestWrite(req, MODBUS_SLAVE_ADDRESS, 2, 2, pq);
+                expect = 8U;
+                break;
+            case 4:
+                fc = MODBUS_FC_READ_HOLDING;
+                len = RequestRead(req, MODBUS_SLAVE_ADDRESS, fc, 0, n_hold);
+                expect = (uint16_t)(5U + 2U * n_hold);
+                break;
+            default:
+                pq[0] = (uint16_t)((i + 1U) & 0x3FFU);
+                fc = MODBUS_FC_READ_WRITE;
+                len = RequestReadWrite(req, 0, n_hold, 2, 2, pq);
+                expect = (uint16_t)(5U + 2U * n_hold);
+                break;
+        }
+
+        uint16_t got = Transact(req, len, expect, rsp, BENCH_TIMEOUT_MS, &t);
+        if (got == 0U) { timeouts++; continue; }
+        if (got != expect || ResponseStatus(rsp, got, fc) != 0) { mismatches++; continue; }
+
+        /* Holding reads see the last P, Q written */
+        if ((k == 4U || k == 5U) && (Get16(&rsp[3 + 2 * 2]) != pq[0] || Get16(&rsp[3 + 2 * 3]) != pq[1])) {
+            mismatches++;
+            continue;
+        }
+        req_len[k] = len;
+        rsp_len[k] = got;
+        lat[k][count[k]++] = t;
+    }
+    double wall = Now() - t0;
+    
+    (void)WriteTelemetry(0U, 0U);
+    tlm_done = true;
+    pthread_join(reader, NULL);
+
+    const double t_char_us = CHAR_BITS / bench.baud * 1e6;
+    double link_us = 0.0;
+    uint32_t done = 0;
+
+    printf("\n%u transactions in %.2f s: %.0f frames/s, %u timeouts, %u mismatches\n",
+           (unsigned)bench.frames, wall, (double)bench.frames / wall, (unsigned)timeouts, (unsigned)mismatches);
+    printf("%-22s %7s %8s %8s %8s %8s %9s\n", "", "count", "min_us", "mean_us", "p99_us", "max_us", "wire_us");
+    for (uint32_t k = 0; k < BENCH_MIX; k++) {
+        const uint32_t n = count[k];
+        double sum = 0.0, wire;
+
+        if (n == 0U) continue;
+        qsort(lat[k], n, sizeof(double), CompareDouble);
+        for (uint32_t j = 0; j < n; j++) sum += lat[k][j];
+        wire = (double)(req_len[k] + rsp_len[k]) * t_char_us;
+        printf("%-22s %7u %8.1f %8.1f %8.1f %8.1f %9.1f\n", name[k], (unsigned)n, lat[k][0], sum / n,
+               lat[k][(uint32_t)(0.99 * (n - 1U))], lat[k][n - 1U], wire);
+
+        /* On the line: wire time, idle detection, the master's 3.5-char gap */
+        link_us += (double)n * (wire + (double)bench.idle_us + 3.5 * t_char_us);
+        done += n;
+    }
+    if (done > 0U) {
+        printf("link-limited at %.0f baud: %.0f frames/s\n", bench.baud, 1e6 * (double)done / link_us);
+    }
+    printf("telemetry at %u Hz on its own port: %u frames, %u samples, %u CRC errors, "
+           "%u sequence gaps, %u index gaps, %u not taken by the pty\n",
+           (unsigned)BENCH_TLM_RATE_HZ, (unsigned)tlm_rx.frames, (unsigned)tlm_rx.samples,
+           (unsigned)tlm_rx.crc_errors, (unsigned)tlm_rx.seq_gaps, (unsigned)tlm_rx.index_gaps,
+           (unsigned)tlm_rx.line_drops);
+    Check("no request lost with telemetry on", timeouts == 0U && mismatches == 0U);
+    Check("telemetry frames intact, no sequence gap",
+          tlm_rx.frames > 0U && tlm_rx.crc_errors == 0U && tlm_rx.seq_gaps == 0U && tlm_rx.line_drops == 0U);
+    for (uint32_t k = 0; k < BENCH_MIX; k++) free(lat[k]);
+}
+
+/* ============================================================================
+ * MAIN
+ * ========================================================================== */
+static void Usage(const char *argv0)
+{
+    fprintf(stderr,
+            "usage: %s [--frames n] [--baud bps] [--idle-us us] [--serve 0/1]\n", argv0);
+}
+
+int main(int argc, char **argv)
+{
+    pthread_t slave;
+
+    bench.frames = 20000;
+    bench.baud = MODBUS_BAUDRATE;
+    bench.idle_us = 0;
+
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        const char *v = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+        if (v == NULL) { Usage(argv[0]); return 1; }
+        i++;
+
+        if (strcmp(a, "--frames") == 0)             bench.frames = (uint32_t)strtoul(v, NULL, 0);
+        else if (strcmp(a, "--baud") == 0)          bench.baud = atof(v);
+        else if (strcmp(a, "--idle-us") == 0)       bench.idle_us = (uint32_t)strtoul(v, NULL, 0);
+        else if (strcmp(a, "--serve") == 0)         bench.serve = (atof(v) != 0.0);
+        else { Usage(argv[0]); return 1; }
+    }
+    if (!(bench.baud > 0.0) || bench.frames == 0U) { Usage(argv[0]); return 1; }
+    if (bench.idle_us == 0U) bench.idle_us = (uint32_t)(CHAR_BITS / bench.baud * 1e6 + 0.5);
+
+    if (!OpenPty(&pty_master, &pty_slave) || !OpenPty(&tlm_master, &tlm_slave)) {
+        perror("pty");
+        return 1;
+    }
+    /* A telemetry port nobody reads must not stall the slave */
+    fcntl(tlm_master, F_SETFL, fcntl(tlm_master, F_GETFL) | O_NONBLOCK);
+    if (pthread_create(&slave, NULL, SlaveThread, NULL) != 0) return 1;
+
+    if (bench.serve) {
+        /* pty_slave stays open, so masters can come and go */
+        printf("slave %u on %s (idle %u us), telemetry on %s, Ctrl-C to stop\n",
+               (unsigned)MODBUS_SLAVE_ADDRESS, ptsname(pty_master), (unsigned)bench.idle_us,
+               ptsname(tlm_master));
+        fflush(stdout);
+        pthread_join(slave, NULL);
+        return 0;
+    }
+
+    Conformance();
+    TimedMix();
+
+    /* Closing the master end ends the slave thread */
+    close(pty_slave);
+    pthread_join(slave, NULL);
+    printf("engine: %u frames, %u responses, %u exceptions, %u CRC errors, %u writes\n",
+           (unsigned)slave_stats.frames, (unsigned)slave_stats.responses, (unsigned)slave_stats.exceptions,
+           (unsigned)slave_stats.crc_errors, (unsigned)slave_stats.writes);
+    printf("main loop: %u ticks, %u took writes, %u bank conversions on read\n",
+           (unsigned)slave_ticks, (unsigned)slave_takes, (unsigned)slave_stats.refreshes);
+    printf("main-loop Modbus work per tick: %.1f ns (converting every tick: %.1f ns)\n",
+           tick_lazy_ns, tick_eager_ns);
+    printf("%s\n", failures == 0U ? "PASS" : "FAIL");
+    return (failures == 0U) ? 0 : 1;
+}
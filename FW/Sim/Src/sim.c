@@ -0,0 +1,1255 @@
+/**
+ * @file sim.c
+ * @brief Firmware-in-the-Loop Simulation Engine
+ * @version 2.1
+ * @date 2025-12
+ * 
+ * Event order at every carrier crest/valley instant t_k:
+ *   1. HRTIM preload -> active compare (both instants with double update,
+ *      valley only with single update) and carrier period
+ *   2. Control ISR: samples the plant at t_k and writes new preloads
+ *   3. Plant integrates [t_k, t_k+1] with the active compares
+ * This reproduces the sample -> compute -> PWM latency of the target.
+ *
+ * All firmware and simulator state is FW_INSTANCE_LOCAL: with the sweep
+ * build (-DFW_INSTANCE_LOCAL=_Thread_local) every thread runs its own
+ * instance of Sim_Run.
+ */
+
+#define _POSIX_C_SOURCE 199309L     // clock_gettime
+
+#include "sim.h"
+#include "main.h"
+#include "types.h"
+#include "config.h"
+#include "modbus.h"
+#include "params.h"
+#include "recorder.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+
+/* ============================================================================
+ * CONSTANTS
+ * ========================================================================== */
+#define TWO_PI          6.283185307179586
+#define N_DEFAULT_EVENTS 4                  // P, Q, enable, fixed f_sw at t = 0
+
+#define METRIC_FS       ((double)CONTROL_LOOP_FREQ_HZ / SIM_METRIC_DECIM)
+#define METRIC_TICKS    (SIM_METRIC_DECIM * (HRTIM_PERIOD / 2U))  // 1 / METRIC_FS
+#define METRIC_LPF_HZ   3000.0              // Id filter for step metrics
+#define METRIC_TAIL_S   0.020               // Final value / error window
+#define SETTLE_BAND     0.02                // ±2 % of the step
+#define SETTLE_BAND_MIN 0.5                 // [A]
+#define ISR_TIMING_DECIM 16U                // Host-timed switching ISRs: 1 in N
+
+/* ============================================================================
+ * PRIVATE TYPES / VARIABLES
+ * ========================================================================== */
+typedef struct {
+    const SimConfig_t *cfg;
+    Plant_t *plant;
+    
+    /* HRTIM model */
+    int32_t preload_on[3];          // Written by HRTIM_SetDuty
+    uint16_t preload_period;        // Written by HRTIM_SetPeriod
+    bool double_update;
+    double preload_t;               // Sample instant of the ISR that wrote preload_on
+    
+    /* Current loop measurement (metric window) */
+    double held_t;                  // Last preload transfer [s]
+    double loop_t0;                 // First transfer in the window (NaN = none yet)
+    double held_sample_t;           // Sample instant of the values it applied
+    double delay_sum;               // Σ (pulse centre - sample instant) [s]
+    uint32_t delay_n;
+    double fra_w;                   // Injection [rad/s], on the window's bins
+    double fra_isr[2], fra_plant[2];    // DFT of the ISR / plant compare vector
+    
+    /* Control ISR cost on the host (switching ISRs only) */
+    double isr_wall;                // Σ wall time of the timed ISRs [s]
+    uint32_t isr_timed;
+    double mpc_cand_sum;            // Σ FCS-MPC candidates of the timed ISRs
+    
+    /* HRTIM fault inputs */
+    bool flt_armed;                 // HRTIM_ConfigFaults called
+    uint32_t flt_forced;            // Held active by flt events
+    uint32_t flt_levels;            // At the last check
+    uint32_t flt_flags;             // Tripped, until the fault ISR reads them
+    double flt_t_event;             // Last flt / estop event [s]
+    double flt_i_prev[3];           // Converter currents at the last check [A]
+    double flt_t_prev;              // Time of the last check [s]
+    uint32_t flt_inputs;            // OR of all tripped inputs
+    double flt_t_trip;              // First trip: input asserted [s]
+    double flt_latency;             // First trip: input to outputs off [s]
+    
+    /* Control ISR entry delay (isr events) */
+    uint32_t isr_delay;             // Master counter at ISR entry [HRTIM ticks]
+    
+    /* Parameter store flash, erased (0xFF) unless loaded from nv_path */
+    uint8_t nv[PARAM_NV_SLOTS][SIM_NV_SLOT_SIZE];
+    bool nv_written;
+    
+    /* Scheduling: events sorted by time, next one to apply */
+    SimEvent_t events[SIM_MAX_EVENTS + N_DEFAULT_EVENTS];
+    uint32_t n_events;
+    uint32_t next_event;
+    uint64_t isr_count;
+    uint32_t trace_count;
+    uint32_t fault_mask;            // OR of all faults seen
+    double f_slew;                  // Grid frequency ramp [Hz/s]
+    
+    /* Metrics */
+    uint64_t metric_tick;           // Next metric instant [HRTIM ticks]
+    uint64_t prev_tick;             // Previous ISR instant [HRTIM ticks]
+    double iga_prev;                // Grid current at the previous ISR [A]
+    uint32_t prev_faults;
+    uint32_t trips;
+    double t_run;                   // First RUN entry (NaN = none)
+    double t_trip;                  // First fault (NaN = none)
+    double t_island;                // First breaker opening (NaN = none)
+    double t_island_trip;           // First fault after t_island (NaN = none)
+    double t0;                      // Step instant (NaN = from RUN entry)
+    double id_lpf;
+    double vdc_lpf;
+    double iae_dq;                  // After t0 [A·s]
+    double pll_iae;                 // After t0 [Hz·s]
+    float *id_buf;                  // Filtered Id from t0, at METRIC_FS
+    float *vdc_buf;                 // Filtered Vdc from t0, same length
+    uint32_t id_n, id_cap;
+    float *err_ring;                // Id - Id_ref, last METRIC_TAIL_S
+    uint32_t err_n, err_len;
+    float *ig_ring;                 // Phase A grid current, last thd_window_s
+    uint32_t ig_n, ig_len;
+    double tj_ref_max;              // Per main loop
+    double tj_est_max;
+    double tj_err_max;
+    bool loss_started;              // Plant loss window opened
+    
+    /* Noise PRNG */
+    uint64_t rng;
+    bool gauss_has_spare;
+    double gauss_spare;
+} Sim_t;
+
+static FW_INSTANCE_LOCAL Sim_t *sim_ctx = NULL;
+
+static const char *const event_names[SIM_EV_COUNT] = {
+    "vsag", "freq", "phase", "island", "h5", "unbal",
+    "p", "q", "enable", "lgrid", "rload", "estop", "dcload", "vdcref", "vdcmode",
+    "mode", "fswfix", "lload", "cload", "fslew", "tmask", "trate", "celldv",
+    "qprio", "bmslim", "soc", "flt", "isr", "pcmd"
+};
+
+static const char *const gain_names[SIM_GAIN_COUNT] = {
+    "current_kp", "current_kr", "current_wc", "pll_kp", "pll_ki", "voltage_kp", "voltage_ki", "ad_k"
+};
+
+static const float gain_defaults[SIM_GAIN_COUNT] = {
+    CURRENT_KP, CURRENT_KR, CURRENT_OMEGA_C, PLL_KP, PLL_KI, VOLTAGE_KP, VOLTAGE_KI,
+    LCL_ACTIVE_DAMPING ? LCL_AD_GAIN : 0.0f
+};
+
+/* ============================================================================
+ * CONFIGURATION
+ * ========================================================================== */
+void Sim_DefaultConfig(SimConfig_t *cfg)
+{
+    memset(cfg, 0, sizeof(*cfg));
+    Plant_DefaultParams(&cfg->plant);
+    cfg->t_end = 1.0;
+    cfg->seed = 1;
+    cfg->p_ref_W = 60000.0;
+    cfg->q_ref_VAr = 0.0;
+    cfg->enable = true;
+    cfg->grid_present = true;
+    cfg->metric_t0 = -1.0;
+    cfg->thd_window_s = 0.1;
+    cfg->loss_window_s = 0.1;
+    cfg->fra_amp = 0.01 * HRTIM_PERIOD;
+    cfg->trace_decim = 10;
+}
+
+bool Sim_AddEvent(SimConfig_t *cfg, double t, SimEventType_t type, double value)
+{
+    if (cfg->n_events >= SIM_MAX_EVENTS || type >= SIM_EV_COUNT) return false;
+    
+    cfg->events[cfg->n_events].t = t;
+    cfg->events[cfg->n_events].type = type;
+    cfg->events[cfg->n_events].value = value;
+    cfg->n_events++;
+    return true;
+}
+
+bool Sim_ParseEvent(SimConfig_t *cfg, const char *spec)
+{
+    char name[16];
+    double t, value;
+    
+    if (sscanf(spec, "%lf:%15[^:]:%lf", &t, name, &value) != 3) return false;
+    
+    for (uint32_t i = 0; i < SIM_EV_COUNT; i++) {
+        if (strcmp(name, event_names[i]) == 0) {
+            return Sim_AddEvent(cfg, t, (SimEventType_t)i, value);
+        }
+    }
+    return false;
+}
+
+bool Sim_ParseGain(SimConfig_t *cfg, const char *spec)
+{
+    char name[16];
+    double value;
+    
+    if (sscanf(spec, "%15[^=]=%lf", name, &value) != 2) return false;
+    
+    for (uint32_t i = 0; i < SIM_GAIN_COUNT; i++) {
+        if (strcmp(name, gain_names[i]) == 0) {
+            cfg->gain[i] = (float)value;
+            cfg->gain_set |= 1U << i;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Sim_ParseParam(SimConfig_t *cfg, const char *spec)
+{
+    char name[24];
+    double value;
+    uint32_t id, raw;
+    
+    if (cfg->n_params >= SIM_MAX_PARAMS) return false;
+    if (sscanf(spec, "%23[^=]=%lf", name, &value) != 2) return false;
+    
+    id = Params_Find(name);
+    if (id >= PARAM_COUNT) return false;
+    
+    if (Params_Info(id)->type == MODBUS_TYPE_F32) {
+        float32_t f = (float32_t)value;
+        memcpy(&raw, &f, sizeof(raw));
+    } else {
+        if (value < 0.0 || value > 4294967295.0) return false;
+        raw = (uint32_t)value;
+    }
+    if (!Params_CheckRaw(id, raw)) return false;
+    
+    cfg->param_id[cfg->n_params] = id;
+    cfg->param_raw[cfg->n_params] = raw;
+    cfg->n_params++;
+    return true;
+}
+
+const char* Sim_GainName(SimGain_t g)
+{
+    return (g < SIM_GAIN_COUNT) ? gain_names[g] : "";
+}
+
+float Sim_GainValue(const SimConfig_t *cfg, SimGain_t g)
+{
+    if (g >= SIM_GAIN_COUNT) return 0.0f;
+    return (cfg->gain_set & (1U << g)) ? cfg->gain[g] : gain_defaults[g];
+}
+
+bool Sim_ParseOption(SimConfig_t *cfg, const char *opt, const char *value)
+{
+    char *end;
+    double v = strtod(value, &end);
+    bool num = (end != value && *end == '\0');
+    
+    if (strcmp(opt, "--event") == 0)        return Sim_ParseEvent(cfg, value);
+    if (strcmp(opt, "--gain") == 0)         return Sim_ParseGain(cfg, value);
+    if (strcmp(opt, "--param") == 0)        return Sim_ParseParam(cfg, value);
+    if (strcmp(opt, "--nv") == 0) {
+        cfg->nv_path = value;
+        return true;
+    }
+    if (!num)                               return false;
+    
+    if (strcmp(opt, "--t-end") == 0)        cfg->t_end = v;
+    else if (strcmp(opt, "--p") == 0)       cfg->p_ref_W = v;
+    else if (strcmp(opt, "--q") == 0)       cfg->q_ref_VAr = v;
+    else if (strcmp(opt, "--enable") == 0)  cfg->enable = (v != 0.0);
+    else if (strcmp(opt, "--grid-present") == 0) cfg->grid_present = (v != 0.0);
+    else if (strcmp(opt, "--lgrid") == 0)   cfg->plant.L_grid = v;
+    else if (strcmp(opt, "--rload") == 0)   cfg->plant.R_load = v;
+    else if (strcmp(opt, "--lload") == 0)   cfg->plant.L_load = v;
+    else if (strcmp(opt, "--cload") == 0)   cfg->plant.C_load = v;
+    else if (strcmp(opt, "--t-amb") == 0)   cfg->plant.T_ambient = v;
+    else if (strcmp(opt, "--t-hs") == 0)    cfg->plant.T_heatsink0 = v;
+    else if (strcmp(opt, "--rth-ha") == 0)  cfg->plant.Rth_ha = v;
+    else if (strcmp(opt, "--vbat") == 0)    cfg->plant.V_bat_nom = v;
+    else if (strcmp(opt, "--noise-i") == 0) cfg->noise_i_A = v;
+    else if (strcmp(opt, "--noise-v") == 0) cfg->noise_v_V = v;
+    else if (strcmp(opt, "--seed") == 0)    cfg->seed = (uint32_t)v;
+    else if (strcmp(opt, "--metric-t0") == 0)  cfg->metric_t0 = v;
+    else if (strcmp(opt, "--thd-window") == 0) cfg->thd_window_s = v;
+    else if (strcmp(opt, "--loss-window") == 0) cfg->loss_window_s = v;
+    else if (strcmp(opt, "--fixed-fsw") == 0) cfg->fixed_fsw = (v != 0.0);
+    else if (strcmp(opt, "--fra") == 0)     cfg->fra_hz = v;
+    else if (strcmp(opt, "--fra-amp") == 0) cfg->fra_amp = v;
+    else return false;
+    return true;
+}
+
+/* ============================================================================
+ * HOST TIME
+ * ========================================================================== */
+static double WallTime(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + 1e-9 * (double)ts.tv_nsec;
+}
+
+/* ============================================================================
+ * NOISE
+ * ========================================================================== */
+static double Uniform(Sim_t *s)
+{
+    /* xorshift64* */
+    s->rng ^= s->rng >> 12;
+    s->rng ^= s->rng << 25;
+    s->rng ^= s->rng >> 27;
+    return (double)((s->rng * 2685821657736338717ULL) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+double Sim_Gauss(void)
+{
+    Sim_t *s = sim_ctx;
+    
+    if (s->gauss_has_spare) {
+        s->gauss_has_spare = false;
+        return s->gauss_spare;
+    }
+    
+    double u1 = Uniform(s), u2 = Uniform(s);
+    if (u1 < 1e-300) u1 = 1e-300;
+    double r = sqrt(-2.0 * log(u1));
+    s->gauss_spare = r * sin(TWO_PI * u2);
+    s->gauss_has_spare = true;
+    return r * cos(TWO_PI * u2);
+}
+
+/* ============================================================================
+ * HRTIM MODEL
+ * ========================================================================== */
+void Sim_HrtimSetDuty(uint16_t duty_a, uint16_t duty_b, uint16_t duty_c)
+{
+    const uint16_t duty[3] = { duty_a, duty_b, duty_c };
+    
+    /* Same decomposition as hrtim.c: m > 0 -> T1 pulse, m < 0 -> T4 pulse */
+    for (int ph = 0; ph < 3; ph++) {
+        int32_t period = sim_ctx->preload_period;
+        int32_t m_counts = 2 * (int32_t)duty[ph] - period;
+        int32_t w = (m_counts < 0) ? -m_counts : m_counts;
+        if (w < 10) m_counts = 0;
+        else if (w > period - 10) m_counts = (m_counts > 0) ? period : -period;
+        sim_ctx->preload_on[ph] = m_counts;
+    }
+    sim_ctx->preload_t = sim_ctx->plant->t;
+}
+
+void Sim_HrtimSetPeriod(uint16_t period)
+{
+    if (sim_ctx == NULL) return;
+    sim_ctx->preload_period = period;
+}
+
+bool Sim_HrtimAtCrest(void)
+{
+    /* Valley -> crest is the rising half, so an odd count ends at a crest */
+    return (sim_ctx->plant->half_periods & 1U) != 0;
+}
+
+void Sim_HrtimSetOutputs(bool enabled)
+{
+    if (sim_ctx == NULL) return;    // Replay: no plant
+    if (enabled && sim_ctx->flt_levels != 0U) return;   // Held off by a fault input
+    sim_ctx->plant->outputs_enabled = enabled;
+}
+
+void Sim_HrtimSetDeadTime(uint16_t ticks)
+{
+    if (sim_ctx == NULL) return;
+    sim_ctx->plant->dead_ticks = ticks;
+}
+
+void Sim_HrtimSetUpdateMode(bool double_update)
+{
+    if (sim_ctx == NULL) return;
+    sim_ctx->double_update = double_update;
+}
+
+/* ============================================================================
+ * HRTIM FAULT INPUTS
+ * Levels at every half-period boundary: flt events (driver inputs or any
+ * input forced), the E-stop input and the phase comparators on the
+ * converter currents (positive above IAC_HW_TRIP_A, as on the board). An
+ * asserted input turns the plant outputs off at once and raises the fault
+ * interrupt after the control ISR. The plant resolves half periods, so
+ * the latency is the wait for the boundary plus HWFLT_DELAY_NS; the input
+ * instant is the event time, or the comparator crossing interpolated
+ * between two boundaries.
+ * ========================================================================== */
+void Sim_HrtimArmFaults(void)
+{
+    if (sim_ctx == NULL) return;
+    sim_ctx->flt_armed = true;
+}
+
+uint32_t Sim_HrtimFaultFlags(void)
+{
+    uint32_t flags;
+    
+    if (sim_ctx == NULL) return 0U;
+    flags = sim_ctx->flt_flags;
+    sim_ctx->flt_flags = 0U;
+    return flags;
+}
+
+uint32_t Sim_HrtimFaultLevels(void)
+{
+    return sim_ctx ? sim_ctx->flt_levels : 0U;
+}
+
+/* ============================================================================
+ * CONTROL ISR ENTRY DELAY
+ * An isr event holds the ISR off by a fixed time after each repetition
+ * event, as a masked section or a long handler would: the firmware sees
+ * it in the master counter at entry, and an overrun once it reaches the
+ * half period. The modelled ISR itself still runs at the boundary and
+ * takes no time.
+ * ========================================================================== */
+uint16_t Sim_HrtimEntryDelay(void)
+{
+    return sim_ctx ? (uint16_t)sim_ctx->isr_delay : 0U;
+}
+
+bool Sim_HrtimOverrun(void)
+{
+    return sim_ctx != NULL && sim_ctx->isr_delay >= sim_ctx->plant->period / 2U;
+}
+
+static bool FaultInputs(Sim_t *s)
+{
+    Plant_t *pl = s->plant;
+    PlantSample_t ps;
+    
+    if (!s->flt_armed) return false;
+    
+    Plant_Sample(pl, &ps);
+    const double i[3] = { ps.Ia, ps.Ib, ps.Ic };
+    uint32_t levels = s->flt_forced;
+    if (GPIOC->idr & DI_ESTOP_PIN) levels |= HWFLT_BIT(HWFLT_IN_ESTOP);
+    for (int ph = 0; ph < 3; ph++) {
+        if (i[ph] > IAC_HW_TRIP_A) levels |= HWFLT_BIT(HWFLT_IN_OC_A + ph);
+    }
+    
+    uint32_t tripped = levels & ~s->flt_levels;
+    if (tripped != 0U) {
+        double t_in = pl->t;
+        if (tripped & (s->flt_forced | HWFLT_BIT(HWFLT_IN_ESTOP))) t_in = s->flt_t_event;
+        for (int ph = 0; ph < 3; ph++) {
+            uint32_t bit = HWFLT_BIT(HWFLT_IN_OC_A + ph);
+            if (!(tripped & bit) || (s->flt_forced & bit) || i[ph] <= s->flt_i_prev[ph]) continue;
+            double frac = (IAC_HW_TRIP_A - s->flt_i_prev[ph]) / (i[ph] - s->flt_i_prev[ph]);
+            if (frac < 0.0) frac = 0.0;
+            t_in = fmin(t_in, s->flt_t_prev + frac * (pl->t - s->flt_t_prev));
+        }
+        
+        pl->outputs_enabled = false;
+        s->flt_flags |= tripped;
+        if (s->flt_inputs == 0U) {
+            s->flt_t_trip = t_in;
+            s->flt_latency = pl->t - t_in + HWFLT_DELAY_NS * 1e-9;
+        }
+        s->flt_inputs |= tripped;
+    }
+    
+    s->flt_levels = levels;
+    memcpy(s->flt_i_prev, i, sizeof(s->flt_i_prev));
+    s->flt_t_prev = pl->t;
+    return tripped != 0U;
+}
+
+/* ============================================================================
+ * EVENTS
+ * Commands are written as a Modbus master would, so the firmware applies
+ * them on its next main-loop tick
+ * ========================================================================== */
+static void ControlBit(uint16_t bit, bool set)
+{
+    uint16_t cw = Modbus_ReadHoldingRegister(MODBUS_REG(control_word));
+    
+    cw = set ? (uint16_t)(cw | bit) : (uint16_t)(cw & ~bit);
+    Modbus_WriteHoldingRegister(MODBUS_REG(control_word), cw);
+}
+
+static void ApplyEvent(Sim_t *s, const SimEvent_t *ev)
+{
+    Plant_t *pl = s->plant;
+    
+    switch (ev->type) {
+        case SIM_EV_VSAG:
+            pl->V_pk = ev->value * pl->p.V_ll_rms * sqrt(2.0 / 3.0);
+            break;
+        case SIM_EV_FREQ:
+            pl->omega_grid = TWO_PI * ev->value;
+            break;
+        case SIM_EV_PHASE:
+            pl->theta_grid = fmod(pl->theta_grid + ev->value * (TWO_PI / 360.0) + TWO_PI, TWO_PI);
+            break;
+        case SIM_EV_ISLAND:
+            pl->grid_breaker = (ev->value == 0.0);
+            if (!pl->grid_breaker && isnan(s->t_island)) s->t_island = pl->t;
+            break;
+        case SIM_EV_H5:
+            pl->h5_pu = ev->value;
+            break;
+        case SIM_EV_UNBALANCE:
+            pl->unbalance_pu = ev->value;
+            break;
+        case SIM_EV_P_REF:
+            Modbus_WriteHoldingRegister(MODBUS_REG(P_ref_100W), (uint16_t)(int16_t)lround(ev->value / 100.0));
+            break;
+        case SIM_EV_Q_REF:
+            Modbus_WriteHoldingRegister(MODBUS_REG(Q_ref_100VAr), (uint16_t)(int16_t)lround(ev->value / 100.0));
+            break;
+        case SIM_EV_ENABLE:
+            ControlBit(0x0001, ev->value != 0.0);
+            break;
+        case SIM_EV_L_GRID:
+            pl->p.L_grid = ev->value;
+            Plant_Rebuild(pl);
+            break;
+        case SIM_EV_R_LOAD:
+            pl->p.R_load = ev->value;
+            Plant_Rebuild(pl);
+            break;
+        case SIM_EV_L_LOAD:
+            pl->p.L_load = ev->value;
+            Plant_Rebuild(pl);
+            break;
+        case SIM_EV_C_LOAD:
+            pl->p.C_load = ev->value;
+            Plant_Rebuild(pl);
+            break;
+        case SIM_EV_F_SLEW:
+            s->f_slew = ev->value;
+            break;
+        case SIM_EV_ESTOP:
+            if (ev->value != 0.0) GPIOC->idr |= DI_ESTOP_PIN;
+            else GPIOC->idr &= (uint16_t)~DI_ESTOP_PIN;
+            s->flt_t_event = ev->t;
+            break;
+        case SIM_EV_DC_LOAD:
+            pl->p.P_dc_load = ev->value;
+            break;
+        case SIM_EV_VDC_REF:
+            Modbus_WriteHoldingRegister(MODBUS_REG(Vdc_ref_V), (uint16_t)lround(ev->value));
+            break;
+        case SIM_EV_VDC_MODE:
+            ControlBit(0x0002, ev->value != 0.0);
+            break;
+        case SIM_EV_MODE:
+            Modbus_WriteHoldingRegister(MODBUS_REG(mode_select), (uint16_t)lround(ev->value));
+            break;
+        case SIM_EV_FSW_FIX:
+            ControlBit(0x0004, ev->value != 0.0);
+            break;
+        case SIM_EV_TLM_MASK: {
+            uint32_t mask = (uint32_t)ev->value;
+            Modbus_WriteHoldingRegister(MODBUS_REG(telem_mask_low), (uint16_t)mask);
+            Modbus_WriteHoldingRegister(MODBUS_REG(telem_mask_high), (uint16_t)(mask >> 16));
+            break;
+        }
+        case SIM_EV_TLM_RATE:
+            Modbus_WriteHoldingRegister(MODBUS_REG(telem_rate_Hz), (uint16_t)lround(ev->value));
+            break;
+        case SIM_EV_CELL_DV:
+            pl->cell_dv = ev->value;
+            break;
+        case SIM_EV_Q_PRIO:
+            ControlBit(0x0008, ev->value != 0.0);
+            break;
+        case SIM_EV_BMS_LIMIT:
+            pl->bms_limit_pu = ev->value;
+            break;
+        case SIM_EV_SOC:
+            pl->soc = ev->value;
+            break;
+        case SIM_EV_HW_FAULT:
+            s->flt_forced = (uint32_t)ev->value & (HWFLT_BIT(HWFLT_IN_COUNT) - 1U);
+            s->flt_t_event = ev->t;
+            break;
+        case SIM_EV_ISR_DELAY:
+            s->isr_delay = (uint32_t)fmin(fmax(ev->value, 0.0) * 1e-6 * HRTIM_FREQ_HZ + 0.5, 65535.0);
+            break;
+        case SIM_EV_PARAM_CMD:
+            Modbus_WriteHoldingRegister(MODBUS_REG(param_cmd), (uint16_t)ev->value);
+            break;
+        default:
+            break;
+    }
+}
+
+static void SortEvents(Sim_t *s)
+{
+    const SimConfig_t *cfg = s->cfg;
+    
+    /* Stable insertion sort: equal times keep command-line order, and the
+     * t = 0 commands follow the scenario's own events at t = 0 */
+    memcpy(s->events, cfg->events, sizeof(SimEvent_t) * cfg->n_events);
+    s->n_events = cfg->n_events;
+    s->events[s->n_events++] = (SimEvent_t){ 0.0, SIM_EV_P_REF, cfg->p_ref_W };
+    s->events[s->n_events++] = (SimEvent_t){ 0.0, SIM_EV_Q_REF, cfg->q_ref_VAr };
+    s->events[s->n_events++] = (SimEvent_t){ 0.0, SIM_EV_ENABLE, cfg->enable ? 1.0 : 0.0 };
+    s->events[s->n_events++] = (SimEvent_t){ 0.0, SIM_EV_FSW_FIX, cfg->fixed_fsw ? 1.0 : 0.0 };
+    
+    for (uint32_t i = 1; i < s->n_events; i++) {
+        SimEvent_t ev = s->events[i];
+        uint32_t j = i;
+        while (j > 0 && s->events[j - 1].t > ev.t) {
+            s->events[j] = s->events[j - 1];
+            j--;
+        }
+        s->events[j] = ev;
+    }
+}
+
+static inline void ProcessEvents(Sim_t *s)
+{
+    while (s->next_event < s->n_events && s->events[s->next_event].t <= s->plant->t) {
+        ApplyEvent(s, &s->events[s->next_event]);
+        s->next_event++;
+    }
+}
+
+/* ============================================================================
+ * TRACE
+ * ========================================================================== */
+static void TraceHeader(FILE *f)
+{
+    fprintf(f, "t,state,faults,Va,Vb,Vc,Ia,Ib,Ic,Iga,Igb,Igc,Vdc,Vnp,"
+               "Id,Iq,Id_ref,Iq_ref,theta,freq,duty_a,duty_b,duty_c,"
+               "Tj_est,Tj_ref,derating\n");
+}
+
+static void TraceRow(Sim_t *s)
+{
+    PlantSample_t ps;
+    Plant_Sample(s->plant, &ps);
+    
+    fprintf(s->cfg->trace, 
+            "%.7f,%u,%u,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,"
+            "%.3f,%.3f,%.3f,%.3f,%.5f,%.4f,%u,%u,%u,%.2f,%.2f,%.4f\n",
+            s->plant->t, (unsigned)g_sys.state, (unsigned)g_sys.faults,
+            ps.Va, ps.Vb, ps.Vc, ps.Ia, ps.Ib, ps.Ic, ps.Iga, ps.Igb, ps.Igc,
+            ps.Vdc_pos + ps.Vdc_neg, 0.5 * (ps.Vdc_pos - ps.Vdc_neg),
+            g_sys.I_dq.d, g_sys.I_dq.q, g_sys.ref.Id_ref, g_sys.ref.Iq_ref,
+            g_sys.pll.theta, g_sys.pll.frequency,
+            g_sys.svpwm.duty_a, g_sys.svpwm.duty_b, g_sys.svpwm.duty_c,
+            g_sys.temps.T_max, Plant_JunctionMax(s->plant), g_sys.prot.derating);
+}
+
+/* ============================================================================
+ * METRICS
+ * ========================================================================== */
+static bool IsRunning(uint32_t state)
+{
+    return state == STATE_RUN_INVERTER || state == STATE_RUN_RECTIFIER;
+}
+
+static bool MetricsInit(Sim_t *s)
+{
+    const SimConfig_t *cfg = s->cfg;
+    
+    s->t_run = NAN;
+    s->t_trip = NAN;
+    s->t_island = NAN;
+    s->t_island_trip = NAN;
+    s->t0 = (cfg->metric_t0 >= 0.0) ? cfg->metric_t0 : NAN;
+    s->tj_ref_max = -INFINITY;
+    s->tj_est_max = -INFINITY;
+    s->metric_tick = METRIC_TICKS - HRTIM_PERIOD / 2U;     // 10th ISR at PWM_FREQUENCY_HZ
+    
+    /* Auto: first dispatch or DC load change after start-up, else the RUN entry */
+    for (uint32_t i = 0; cfg->metric_t0 < 0.0 && i < cfg->n_events; i++) {
+        const SimEvent_t *ev = &cfg->events[i];
+        bool step = (ev->type == SIM_EV_P_REF || ev->type == SIM_EV_DC_LOAD ||
+                     ev->type == SIM_EV_VDC_REF);
+        if (step && ev->t > 0.0 && (isnan(s->t0) || ev->t < s->t0)) {
+            s->t0 = ev->t;
+        }
+    }
+    
+    s->err_len = (uint32_t)(METRIC_TAIL_S * METRIC_FS);
+    s->ig_len = (uint32_t)(cfg->thd_window_s * METRIC_FS);
+    if (s->ig_len < 1U) s->ig_len = 1U;
+    s->err_ring = (float *)calloc(s->err_len, sizeof(float));
+    s->ig_ring = (float *)calloc(s->ig_len, sizeof(float));
+    return s->err_ring != NULL && s->ig_ring != NULL;
+}
+
+static void MetricsSample(Sim_t *s)
+{
+    const double alpha = 1.0 - exp(-TWO_PI * METRIC_LPF_HZ / METRIC_FS);
+    uint32_t faults = (uint32_t)g_sys.faults;
+    double t = s->plant->t;
+    
+    /* Trip events: any fault bit raised */
+    if ((faults & ~s->prev_faults) != 0U) {
+        if (s->trips == 0U) s->t_trip = t;
+        if (!isnan(s->t_island) && isnan(s->t_island_trip)) s->t_island_trip = t;
+        s->trips++;
+    }
+    s->prev_faults = faults;
+    
+    /* Metric instants are fixed in time whatever the carrier period; the
+     * grid current is interpolated to the instant between ISR samples */
+    uint64_t now = s->plant->ticks;
+    uint64_t span = now - s->prev_tick;
+    double iga = s->plant->x[0][2];         // Phase A = α
+    double iga_prev = s->iga_prev;
+    s->iga_prev = iga;
+    s->prev_tick = now;
+    
+    if (now < s->metric_tick) return;
+    if (now > s->metric_tick && span > 0U) {
+        iga += (iga_prev - iga) * (double)(now - s->metric_tick) / (double)span;
+    }
+    s->metric_tick += METRIC_TICKS;
+    
+    if (isnan(s->t_run) && IsRunning(g_sys.state)) {
+        s->t_run = t;
+        if (isnan(s->t0)) s->t0 = t;
+    }
+    
+    s->id_lpf += alpha * ((double)g_sys.I_dq.d - s->id_lpf);
+    s->vdc_lpf += alpha * (s->plant->v_pos + s->plant->v_neg - s->vdc_lpf);
+    if (!isnan(s->t0) && t >= s->t0) {
+        if (s->id_n == s->id_cap) {
+            uint32_t cap = s->id_cap ? 2U * s->id_cap : 4096U;
+            float *p = (float *)realloc(s->id_buf, cap * sizeof(float));
+            if (p == NULL) return;
+            s->id_buf = p;
+            p = (float *)realloc(s->vdc_buf, cap * sizeof(float));
+            if (p == NULL) return;
+            s->vdc_buf = p;
+            s->id_cap = cap;
+        }
+        s->vdc_buf[s->id_n] = (float)s->vdc_lpf;
+        s->id_buf[s->id_n++] = (float)s->id_lpf;
+        s->iae_dq += (fabs((double)g_sys.I_dq.d - g_sys.ref.Id_ref) +
+                      fabs((double)g_sys.I_dq.q - g_sys.ref.Iq_ref)) / METRIC_FS;
+        s->pll_iae += fabs((double)g_sys.pll.frequency - s->plant->omega_grid / TWO_PI) / METRIC_FS;
+    }
+    
+    s->err_ring[s->err_n++ % s->err_len] = g_sys.I_dq.d - g_sys.ref.Id_ref;
+    s->ig_ring[s->ig_n++ % s->ig_len] = (float)iga;
+}
+
+static double GridCurrentThd(const Sim_t *s)
+{
+    double f1 = s->plant->omega_grid / TWO_PI;
+    uint32_t avail = (s->ig_n < s->ig_len) ? s->ig_n : s->ig_len;
+    uint32_t cycles = (uint32_t)((double)avail / METRIC_FS * f1);
+    uint32_t n = (uint32_t)lround((double)cycles * METRIC_FS / f1);
+    
+    if (cycles == 0U || n > avail) return NAN;
+    
+    /* Goertzel per harmonic over the last n samples (integer cycles) */
+    double fund = 0.0, harm = 0.0;
+    for (uint32_t h = 1; h <= SIM_THD_MAX_HARMONIC && h * f1 < 0.5 * METRIC_FS; h++) {
+        double w = TWO_PI * h * f1 / METRIC_FS;
+        double c = 2.0 * cos(w), s1 = 0.0, s2 = 0.0;
+        for (uint32_t k = 0; k < n; k++) {
+            double x = s->ig_ring[(s->ig_n - n + k) % s->ig_len];
+            double s0 = x + c * s1 - s2;
+            s2 = s1;
+            s1 = s0;
+        }
+        double p = s1 * s1 + s2 * s2 - c * s1 * s2;
+        if (h == 1) fund = p;
+        else harm += p;
+    }
+    if (fund <= 0.0) return NAN;
+    return 100.0 * sqrt(harm / fund);
+}
+
+/* Junction estimate against the plant, once per main loop */
+static void MetricsThermal(Sim_t *s)
+{
+    if (g_sys.prot.slow_last_tick == 0U) return;    // Estimator not run yet
+    
+    double tj_ref = Plant_JunctionMax(s->plant);
+    double tj_est = (double)g_sys.temps.T_max;
+    double err = fabs(tj_est - tj_ref);
+    
+    if (tj_ref > s->tj_ref_max) s->tj_ref_max = tj_ref;
+    if (tj_est > s->tj_est_max) s->tj_est_max = tj_est;
+    if (err > s->tj_err_max) s->tj_err_max = err;
+}
+
+/* Losses and efficiency over the last loss_window_s (plant energies) */
+static void MetricsLosses(const Sim_t *s, SimResult_t *res)
+{
+    const PlantLoss_t *lo = &s->plant->loss;
+    double t = lo->t;
+    
+    res->p_cond_W = res->p_sw_W = res->p_diode_W = NAN;
+    res->p_cu_W = res->p_core_W = res->p_in_W = res->p_out_W = NAN;
+    res->eff_pct = NAN;
+    res->i_rms_A = NAN;
+    res->fsw_kHz = res->ripple_pp_A = res->i_peak_A = NAN;
+    if (!s->loss_started || t <= 0.0) return;
+    
+    res->p_cond_W = lo->E_cond / t;
+    res->p_sw_W = lo->E_sw / t;
+    res->p_diode_W = lo->E_diode / t;
+    res->p_cu_W = (lo->E_cu_conv + lo->E_cu_grid) / t;
+    res->p_core_W = lo->E_core / t;
+    res->i_rms_A = sqrt(lo->i2_t / (3.0 * t));
+    res->fsw_kHz = 1e-3 * lo->halves / (2.0 * t);
+    res->ripple_pp_A = lo->di_max;
+    res->i_peak_A = lo->i_peak;
+    
+    /* Terminals: DC link (bridge plus semiconductor losses) and the grid
+     * side of Lg (PCC less Lg copper and core, which the circuit omits) */
+    double semi = lo->E_cond + lo->E_sw + lo->E_diode;
+    double e_dc = lo->E_bridge + semi;
+    double e_ac = lo->E_pcc - lo->E_cu_grid - lo->E_core;
+    if (e_dc >= 0.0) {
+        res->p_in_W = e_dc / t;
+        res->p_out_W = e_ac / t;
+    } else {
+        res->p_in_W = -e_ac / t;
+        res->p_out_W = -e_dc / t;
+    }
+    if (res->p_in_W > 0.0) res->eff_pct = 100.0 * res->p_out_W / res->p_in_W;
+}
+
+/* ============================================================================
+ * CURRENT LOOP MEASUREMENT
+ * At every preload transfer: the delay from the current sample to the
+ * centre of the pulse its compare values set, and, with fra_hz, a
+ * positive-sequence sine added to the compare values on their way to the
+ * plant. The loop gain from that injection point is
+ * T(jω) = -U_isr(jω) / U_plant(jω), from the DFT of both compare space
+ * vectors over thd_window_s (ω rounded to a bin of the window, so the
+ * fundamental and its harmonics drop out)
+ * ========================================================================== */
+static void LoopTransfer(Sim_t *s, int32_t on[3])
+{
+    const SimConfig_t *cfg = s->cfg;
+    const Plant_t *pl = s->plant;
+    double t = pl->t;
+    bool window = t >= cfg->t_end - cfg->thd_window_s && IsRunning(g_sys.state) && pl->outputs_enabled;
+    
+    /* Values held since the previous transfer, if computed in the window */
+    if (window && isnan(s->loop_t0)) s->loop_t0 = t;
+    if (window && s->held_sample_t >= s->loop_t0) {
+        s->delay_sum += 0.5 * (s->held_t + t) - s->held_sample_t;
+        s->delay_n++;
+    }
+    s->held_t = t;
+    s->held_sample_t = s->preload_t;
+    
+    memcpy(on, s->preload_on, 3 * sizeof(int32_t));
+    if (s->fra_w <= 0.0) return;
+    
+    int32_t period = s->preload_period;
+    double u[2][3];
+    for (int ph = 0; ph < 3; ph++) {
+        double e = cfg->fra_amp * cos(s->fra_w * t - ph * (TWO_PI / 3.0));
+        double m = fmin(fmax(round(s->preload_on[ph] + e), -period), period);
+        on[ph] = (int32_t)m;
+        u[0][ph] = s->preload_on[ph];
+        u[1][ph] = m;
+    }
+    if (!window) return;
+    
+    double c = cos(s->fra_w * t), sn = sin(s->fra_w * t);
+    double *acc[2] = { s->fra_isr, s->fra_plant };
+    for (int k = 0; k < 2; k++) {
+        double al = (2.0 * u[k][0] - u[k][1] - u[k][2]) / 3.0;
+        double be = (u[k][1] - u[k][2]) / sqrt(3.0);
+        acc[k][0] += al * c + be * sn;
+        acc[k][1] += be * c - al * sn;
+    }
+}
+
+static void MetricsLoop(const Sim_t *s, SimResult_t *res)
+{
+    res->loop_delay_us = (s->delay_n > 0U) ? 1e6 * s->delay_sum / s->delay_n : NAN;
+    res->fra_hz = NAN;
+    res->loop_gain_db = NAN;
+    res->loop_phase_deg = NAN;
+    
+    double den = s->fra_plant[0] * s->fra_plant[0] + s->fra_plant[1] * s->fra_plant[1];
+    if (s->fra_w <= 0.0 || s->delay_n == 0U || den <= 0.0) return;
+    
+    /* -U_isr / U_plant */
+    double re = -(s->fra_isr[0] * s->fra_plant[0] + s->fra_isr[1] * s->fra_plant[1]) / den;
+    double im = -(s->fra_isr[1] * s->fra_plant[0] - s->fra_isr[0] * s->fra_plant[1]) / den;
+    res->fra_hz = s->fra_w / TWO_PI;
+    res->loop_gain_db = 10.0 * log10(re * re + im * im);
+    res->loop_phase_deg = atan2(im, re) * (360.0 / TWO_PI);
+}
+
+static void MetricsFinish(Sim_t *s, SimResult_t *res)
+{
+    bool running = IsRunning(g_sys.state);
+    uint32_t tail = (uint32_t)(METRIC_TAIL_S * METRIC_FS);
+    
+    res->t_run_s = s->t_run;
+    res->first_trip_s = s->t_trip;
+    res->island_trip_ms = 1e3 * (s->t_island_trip - s->t_island);
+    res->trip_count = s->trips;
+    res->thd_pct = running ? GridCurrentThd(s) : NAN;
+    res->rise_ms = NAN;
+    res->settle_ms = NAN;
+    res->overshoot_pct = NAN;
+    res->id_err_rms = NAN;
+    res->iae_dq = (s->id_n > 0U) ? s->iae_dq : NAN;
+    res->pll_iae = (s->id_n > 0U) ? s->pll_iae : NAN;
+    res->vdc_dev_V = NAN;
+    res->vdc_settle_ms = NAN;
+    res->tj_ref_max = s->tj_ref_max;
+    res->tj_est_max = s->tj_est_max;
+    res->tj_err_max = s->tj_err_max;
+    res->grid_L_uH = g_sys.gridz.valid ? 1e6 * g_sys.gridz.L_grid : NAN;
+    res->grid_scr = g_sys.gridz.valid ? g_sys.gridz.SCR : NAN;
+    res->gain_band = g_sys.params.band;
+    MetricsLosses(s, res);
+    MetricsLoop(s, res);
+    
+    if (running && s->err_n >= s->err_len) {
+        double acc = 0.0;
+        for (uint32_t i = 0; i < s->err_len; i++) acc += (double)s->err_ring[i] * s->err_ring[i];
+        res->id_err_rms = sqrt(acc / s->err_len);
+    }
+    
+    /* Step response of filtered Id from t0: final value = tail mean */
+    if (running && s->id_n > 2U * tail) {
+        const float *x = s->id_buf;
+        uint32_t n = s->id_n;
+        double final = 0.0;
+        for (uint32_t i = n - tail; i < n; i++) final += x[i];
+        final /= tail;
+        double step = final - x[0];
+        
+        if (fabs(step) >= 1.0) {
+            double band = fmax(SETTLE_BAND * fabs(step), SETTLE_BAND_MIN);
+            double sign = (step > 0.0) ? 1.0 : -1.0;
+            double peak = 0.0;
+            uint32_t last_out = 0, i10 = 0, i90 = 0;
+            for (uint32_t i = 0; i < n; i++) {
+                double e = (x[i] - final) * sign;
+                double frac = (x[i] - x[0]) / step;
+                if (e > peak) peak = e;
+                if (fabs(x[i] - final) > band) last_out = i + 1U;
+                if (i10 == 0U && frac >= 0.1) i10 = i;
+                if (i90 == 0U && frac >= 0.9) i90 = i;
+            }
+            res->overshoot_pct = 100.0 * peak / fabs(step);
+            if (i90 > 0U) res->rise_ms = 1e3 * (i90 - i10) / METRIC_FS;
+            if (last_out < n - tail) res->settle_ms = 1e3 * last_out / METRIC_FS;
+        }
+    }
+    
+    /* DC link after t0: peak deviation from and settling to the tail mean */
+    if (running && s->id_n > 2U * tail) {
+        const float *v = s->vdc_buf;
+        uint32_t n = s->id_n, last_out = 0;
+        double final = 0.0, dev = 0.0;
+        for (uint32_t i = n - tail; i < n; i++) final += v[i];
+        final /= tail;
+        for (uint32_t i = 0; i < n; i++) {
+            double e = fabs(v[i] - final);
+            if (e > dev) dev = e;
+            if (e > SIM_VDC_SETTLE_V) last_out = i + 1U;
+        }
+        res->vdc_dev_V = dev;
+        if (last_out < n - tail) res->vdc_settle_ms = 1e3 * last_out / METRIC_FS;
+    }
+}
+
+/* ============================================================================
+ * TIME ADVANCE
+ * ========================================================================== */
+static void SyncRelays(Plant_t *pl)
+{
+    pl->relay_precharge = (RELAY_PRECHARGE_PORT->odr & RELAY_PRECHARGE_PIN) != 0;
+    pl->relay_main = (RELAY_MAIN_PORT->odr & RELAY_MAIN_PIN) != 0;
+    pl->relay_grid = (RELAY_GRID_PORT->odr & RELAY_GRID_PIN) != 0;
+}
+
+static void StepHalfPeriod(Sim_t *s)
+{
+    Plant_t *pl = s->plant;
+    bool valley = (pl->half_periods & 1U) == 0;
+    
+    ProcessEvents(s);
+    bool fault_irq = FaultInputs(s);
+    
+    if (!s->loss_started && pl->t >= s->cfg->t_end - s->cfg->loss_window_s) {
+        Plant_ResetLosses(pl);
+        s->loss_started = true;
+    }
+    
+    /* 1. Preload transfer (the period is written after a crest, so it
+     * reaches the plant at a valley) */
+    if (s->double_update || valley) {
+        LoopTransfer(s, pl->on_ticks);
+        pl->period = s->preload_period;
+    }
+    
+#if RECORDER_ENABLE
+    /* Firmware idle loop between control ISRs: recorder keyframes */
+    Recorder_Service();
+#endif
+    
+    /* 2. Control ISR, every ISR_TIMING_DECIM-th switching one timed */
+    const bool timed = g_sys.outputs_enabled && (s->isr_count % ISR_TIMING_DECIM) == 0U;
+    const double t_isr = timed ? WallTime() : 0.0;
+    HRTIM1_Master_IRQHandler();
+    if (timed) {
+        s->isr_wall += WallTime() - t_isr;
+        s->isr_timed++;
+        s->mpc_cand_sum += g_sys.mpc.candidates;
+    }
+    s->isr_count++;
+    s->fault_mask |= (uint32_t)g_sys.faults;
+    MetricsSample(s);
+    
+    /* Fault interrupt (lower priority: after the control ISR) */
+    if (fault_irq) HRTIM1_FLT_IRQHandler();
+    
+    if (s->cfg->trace && ++s->trace_count >= s->cfg->trace_decim) {
+        s->trace_count = 0;
+        TraceRow(s);
+    }
+    
+    /* 3. Plant: valley -> crest is the rising half */
+    SyncRelays(pl);
+    double t_step = pl->t;
+    Plant_StepHalfPeriod(pl, valley);
+    if (s->f_slew != 0.0) pl->omega_grid += TWO_PI * s->f_slew * (pl->t - t_step);
+    if (s->cfg->bus_step) s->cfg->bus_step(s->cfg->bus_ctx, pl, false);
+}
+
+void Sim_Advance(double dt_s)
+{
+    Sim_t *s = sim_ctx;
+    double t_stop = s->plant->t + dt_s - 0.5 * s->plant->p.t_half;
+    
+    while (s->plant->t < t_stop) {
+        StepHalfPeriod(s);
+    }
+}
+
+Plant_t* Sim_GetPlant(void)
+{
+    return sim_ctx ? sim_ctx->plant : NULL;
+}
+
+const SimConfig_t* Sim_GetConfig(void)
+{
+    return sim_ctx ? sim_ctx->cfg : NULL;
+}
+
+/* ============================================================================
+ * RUN
+ * ========================================================================== */
+static void ApplyGains(const SimConfig_t *cfg)
+{
+    const float *g = cfg->gain;
+    uint32_t set = cfg->gain_set;
+    
+    if (set & (1U << SIM_GAIN_CURRENT_WC)) {
+        g_sys.current_ctrl_d.omega_c = g[SIM_GAIN_CURRENT_WC];
+        g_sys.current_ctrl_q.omega_c = g[SIM_GAIN_CURRENT_WC];
+    }
+    if (set & (1U << SIM_GAIN_AD_K))        g_sys.damping.K = g[SIM_GAIN_AD_K];
+    
+    /* Parameter gains: published as the set in force, scaled to the band
+     * and loaded by the first ISR, so that a later publish keeps them (not
+     * validated: the override is the harness's) */
+    Params_t p = *Params_Get(&g_sys);
+    const uint32_t params = (1U << SIM_GAIN_CURRENT_KP) | (1U << SIM_GAIN_CURRENT_KR) |
+                            (1U << SIM_GAIN_PLL_KP) | (1U << SIM_GAIN_PLL_KI) |
+                            (1U << SIM_GAIN_VOLTAGE_KP) | (1U << SIM_GAIN_VOLTAGE_KI);
+    if (set & (1U << SIM_GAIN_CURRENT_KP))  p.current_kp = g[SIM_GAIN_CURRENT_KP];
+    if (set & (1U << SIM_GAIN_CURRENT_KR))  p.current_kr = g[SIM_GAIN_CURRENT_KR];
+    if (set & (1U << SIM_GAIN_PLL_KP))      p.pll_kp = g[SIM_GAIN_PLL_KP];
+    if (set & (1U << SIM_GAIN_PLL_KI))      p.pll_ki = g[SIM_GAIN_PLL_KI];
+    if (set & (1U << SIM_GAIN_VOLTAGE_KP))  p.voltage_kp = g[SIM_GAIN_VOLTAGE_KP];
+    if (set & (1U << SIM_GAIN_VOLTAGE_KI))  p.voltage_ki = g[SIM_GAIN_VOLTAGE_KI];
+    if (set & params) {
+        (void)Params_Publish(&g_sys, &p);
+        Modbus_PutParams(&p);
+    }
+}
+
+/* --param values, staged as one set (published by the first main loop) */
+static bool ApplyParams(const SimConfig_t *cfg)
+{
+    Params_t p;
+    
+    if (cfg->n_params == 0U) return true;
+    
+    p = *Params_Get(&g_sys);
+    for (uint32_t i = 0; i < cfg->n_params; i++) {
+        (void)Params_SetRaw(&p, cfg->param_id[i], cfg->param_raw[i]);
+    }
+    if (!Params_Stage(&g_sys, &p)) return false;
+    Modbus_PutParams(&p);
+    return true;
+}
+
+/* Flash image from / to cfg->nv_path (a missing file is an erased store) */
+static bool NvLoad(Sim_t *s)
+{
+    FILE *f;
+    
+    memset(s->nv, 0xFF, sizeof(s->nv));
+    if (s->cfg->nv_path == NULL) return true;
+    
+    f = fopen(s->cfg->nv_path, "rb");
+    if (f == NULL) return true;
+    bool ok = fread(s->nv, 1, sizeof(s->nv), f) == sizeof(s->nv);
+    fclose(f);
+    return ok;
+}
+
+static bool NvSave(const Sim_t *s)
+{
+    FILE *f;
+    
+    if (s->cfg->nv_path == NULL || !s->nv_written) return true;
+    
+    f = fopen(s->cfg->nv_path, "wb");
+    if (f == NULL) return false;
+    bool ok = fwrite(s->nv, 1, sizeof(s->nv), f) == sizeof(s->nv);
+    return (fclose(f) == 0) && ok;
+}
+
+bool Sim_NvRead(uint32_t slot, void *dst, uint32_t len)
+{
+    if (sim_ctx == NULL || slot >= PARAM_NV_SLOTS || len > SIM_NV_SLOT_SIZE) return false;
+    memcpy(dst, sim_ctx->nv[slot], len);
+    return true;
+}
+
+bool Sim_NvWrite(uint32_t slot, const void *src, uint32_t len)
+{
+    if (sim_ctx == NULL || slot >= PARAM_NV_SLOTS || len > SIM_NV_SLOT_SIZE) return false;
+    memset(sim_ctx->nv[slot], 0xFF, SIM_NV_SLOT_SIZE);
+    memcpy(sim_ctx->nv[slot], src, len);
+    sim_ctx->nv_written = true;
+    return true;
+}
+
+int Sim_Run(const SimConfig_t *cfg, SimResult_t *res)
+{
+    Sim_t s;
+    memset(&s, 0, sizeof(s));
+    s.cfg = cfg;
+    s.double_update = HRTIM_DOUBLE_UPDATE;
+    s.preload_period = HRTIM_PERIOD;
+    s.loop_t0 = NAN;
+    s.fra_w = TWO_PI * round(cfg->fra_hz * cfg->thd_window_s) / cfg->thd_window_s;
+    s.rng = (cfg->seed != 0) ? cfg->seed : 1;
+    
+    s.plant = (Plant_t *)malloc(sizeof(Plant_t));
+    if (s.plant == NULL || !MetricsInit(&s)) {
+        free(s.plant);
+        free(s.err_ring);
+        free(s.ig_ring);
+        return -1;
+    }
+    if (!NvLoad(&s)) {
+        fprintf(stderr, "sim: cannot read parameter store %s\n", cfg->nv_path);
+        free(s.plant);
+        free(s.err_ring);
+        free(s.ig_ring);
+        return -1;
+    }
+    Plant_Init(s.plant, &cfg->plant);
+    if (cfg->bus_step) cfg->bus_step(cfg->bus_ctx, s.plant, true);
+    SortEvents(&s);
+    
+    sim_ctx = &s;
+    memset(&g_sys, 0, sizeof(g_sys));
+    memset(&g_modbus, 0, sizeof(g_modbus));
+    memset(sim_gpio, 0, sizeof(sim_gpio));
+    
+    if (cfg->trace) TraceHeader(cfg->trace);
+    
+    double t0 = WallTime();
+    
+    App_Init();
+    
+    /* The recorder captures only when its image is kept */
+    if (!cfg->record) g_rec.hdr.mode = REC_MODE_OFF;
+    ApplyGains(cfg);
+    if (!ApplyParams(cfg)) {
+        fprintf(stderr, "sim: --param values refused (cross check)\n");
+        sim_ctx = NULL;
+        free(s.plant);
+        free(s.id_buf);
+        free(s.vdc_buf);
+        free(s.err_ring);
+        free(s.ig_ring);
+        return -1;
+    }
+    
+    /* Grid-presence input: no detection in firmware, the harness provides it */
+    g_sys.grid_connected = cfg->grid_present;
+    
+    while (s.plant->t < cfg->t_end) {
+        App_MainLoop();
+        MetricsThermal(&s);
+        Sim_Advance(SIM_MAIN_LOOP_MS * 1e-3);
+    }
+    
+    double t_wall = WallTime() - t0;
+    
+    if (res) {
+        res->t_sim_s = s.plant->t;
+        res->t_wall_s = t_wall;
+        res->speedup = (t_wall > 0.0) ? s.plant->t / t_wall : 0.0;
+        res->isr_count = s.isr_count;
+        res->final_state = (uint32_t)g_sys.state;
+        res->faults = (uint32_t)g_sys.faults;
+        res->fault_history = s.fault_mask;
+        res->hw_fault_inputs = s.flt_inputs;
+        res->hw_trip_s = s.flt_inputs ? s.flt_t_trip : NAN;
+        res->hw_latency_us = s.flt_inputs ? 1e6 * s.flt_latency : NAN;
+        res->isr_load_max = g_sys.deadline.load_max;
+        res->isr_overruns = g_sys.deadline.overruns;
+        res->isr_shed = g_sys.deadline.shed;
+        res->isr_host_ns = (s.isr_timed > 0U) ? 1e9 * s.isr_wall / s.isr_timed : NAN;
+        res->mpc_candidates = (s.isr_timed > 0U && CURRENT_CTRL_FCS_MPC) ?
+                              s.mpc_cand_sum / s.isr_timed : NAN;
+        res->param_seq = g_sys.params.seq;
+        res->param_rejects = g_sys.params.rejects;
+        res->param_nv = g_sys.params.nv;
+        res->param_nv_seq = g_sys.params.nv_seq;
+        MetricsFinish(&s, res);
+    }
+    
+    sim_ctx = NULL;
+    free(s.plant);
+    free(s.id_buf);
+    free(s.vdc_buf);
+    free(s.err_ring);
+    free(s.ig_ring);
+    if (!NvSave(&s)) {
+        fprintf(stderr, "sim: cannot write parameter store %s\n", cfg->nv_path);
+        return -1;
+    }
+    return 0;
+}
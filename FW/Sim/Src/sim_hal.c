@@ -0,0 +1,396 @@
+/**
+ * @file sim_hal.c
+ * @brief Plant-backed HAL and Peripheral Drivers for the Host Simulator
+ * @version 2.1
+ * @date 2025-12
+ * 
+ * Replaces adc.c, hrtim.c, modbus.c, can_bms.c and params_flash.c when the firmware is
+ * linked into the simulator. The API is identical to the target drivers.
+ * ADC codes come from the plant, or from a recording during replay.
+ */
+
+#include "stm32g4xx_hal.h"
+#include "sim.h"
+#include "replay.h"
+#include "config.h"
+#include "types.h"
+#include "adc.h"
+#include "hrtim.h"
+#include "modbus.h"
+#include "telemetry.h"
+#include "can_bms.h"
+#include "params.h"
+#include "bmsgen.h"
+#include <math.h>
+#include <string.h>
+
+/* ============================================================================
+ * CORE / GPIO
+ * ========================================================================== */
+FW_INSTANCE_LOCAL GPIO_TypeDef sim_gpio[4];
+FW_INSTANCE_LOCAL DWT_Type sim_dwt;
+FW_INSTANCE_LOCAL CoreDebug_Type sim_core_debug;
+
+void HAL_GPIO_Init(GPIO_TypeDef *port, GPIO_InitTypeDef *init)
+{
+    (void)port;
+    (void)init;
+}
+
+void HAL_GPIO_WritePin(GPIO_TypeDef *port, uint16_t pin, GPIO_PinState state)
+{
+    if (state == GPIO_PIN_SET) port->odr |= pin;
+    else port->odr &= (uint16_t)~pin;
+}
+
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef *port, uint16_t pin)
+{
+    return (port->idr & pin) ? GPIO_PIN_SET : GPIO_PIN_RESET;
+}
+
+void HAL_GPIO_TogglePin(GPIO_TypeDef *port, uint16_t pin)
+{
+    port->odr ^= pin;
+}
+
+/* ============================================================================
+ * TIME BASE
+ * ========================================================================== */
+uint32_t HAL_GetTick(void)
+{
+    Plant_t *pl = Sim_GetPlant();
+    return pl ? (uint32_t)(pl->t * 1000.0 + 1e-6) : 0U;
+}
+
+void HAL_Delay(uint32_t delay_ms)
+{
+    Sim_Advance((double)delay_ms * 1e-3);
+}
+
+/* ============================================================================
+ * ADC (plant values quantised to codes; conversion is the firmware's own)
+ * ========================================================================== */
+#define LSB_V                   ((double)ADC_VREF / ADC_MAX_VALUE)
+#define SIM_T_INDUCTOR_C        60.0
+
+void ADC_Init(ADC_HandleTypeDef *hadc1, ADC_HandleTypeDef *hadc2)
+{
+    (void)hadc1;
+    (void)hadc2;
+}
+
+void ADC_Start(ADC_HandleTypeDef *hadc1, ADC_HandleTypeDef *hadc2)
+{
+    (void)hadc1;
+    (void)hadc2;
+}
+
+static void AddNoise(PlantSample_t *s, double ni, double nv)
+{
+    s->Va += nv * Sim_Gauss();
+    s->Vb += nv * Sim_Gauss();
+    s->Vc += nv * Sim_Gauss();
+    s->Ia += ni * Sim_Gauss();
+    s->Ib += ni * Sim_Gauss();
+    s->Ic += ni * Sim_Gauss();
+    s->Vdc_pos += nv * Sim_Gauss();
+    s->Vdc_neg += nv * Sim_Gauss();
+    s->Ibat += ni * Sim_Gauss();
+}
+
+static uint16_t Quantise(double v_pin)
+{
+    double code = floor(v_pin / LSB_V + 0.5);
+    if (code < 0.0) return 0;
+    if (code > ADC_MAX_VALUE) return ADC_MAX_VALUE;
+    return (uint16_t)code;
+}
+
+static uint16_t NtcCode(double t_c)
+{
+    double r = NTC_R25 * exp(NTC_BETA * (1.0 / (t_c + 273.15) - 1.0 / 298.15));
+    return Quantise((double)ADC_VREF * r / (r + NTC_SERIES_R));
+}
+
+/* Temperatures move slowly: the code is recomputed only when its input
+ * changed (per NTC channel) */
+static FW_INSTANCE_LOCAL struct {
+    double t_c;
+    uint16_t code;
+    bool valid;
+} ntc_cache[2];
+
+static uint16_t NtcCodeCached(uint32_t ch, double t_c)
+{
+    if (!ntc_cache[ch].valid || ntc_cache[ch].t_c != t_c) {
+        ntc_cache[ch].t_c = t_c;
+        ntc_cache[ch].code = NtcCode(t_c);
+        ntc_cache[ch].valid = true;
+    }
+    return ntc_cache[ch].code;
+}
+
+void ADC_GetRaw(AdcRaw_t *raw)
+{
+    const SimConfig_t *cfg;
+    PlantSample_t s;
+    
+    if (Replay_Active()) {
+        Replay_GetRaw(raw);
+        return;
+    }
+    
+    cfg = Sim_GetConfig();
+    Plant_Sample(Sim_GetPlant(), &s);
+    if (cfg->noise_i_A > 0.0 || cfg->noise_v_V > 0.0) {
+        AddNoise(&s, cfg->noise_i_A, cfg->noise_v_V);
+    }
+    
+    /* AC: PCC phase voltages and converter-side currents */
+    raw->code[ADC_RAW_IA] = Quantise(HALL_OFFSET_V + s.Ia * HALL_SENSITIVITY);
+    raw->code[ADC_RAW_IB] = Quantise(HALL_OFFSET_V + s.Ib * HALL_SENSITIVITY);
+    raw->code[ADC_RAW_IC] = Quantise(HALL_OFFSET_V + s.Ic * HALL_SENSITIVITY);
+    raw->code[ADC_RAW_VA] = Quantise(VAC_OFFSET_V + s.Va / VAC_DIVIDER_RATIO);
+    raw->code[ADC_RAW_VB] = Quantise(VAC_OFFSET_V + s.Vb / VAC_DIVIDER_RATIO);
+    raw->code[ADC_RAW_VC] = Quantise(VAC_OFFSET_V + s.Vc / VAC_DIVIDER_RATIO);
+    
+    /* DC: total link, lower half and battery shunt */
+    raw->code[ADC_RAW_VDC] = Quantise((s.Vdc_pos + s.Vdc_neg) / VDC_DIVIDER_RATIO);
+    raw->code[ADC_RAW_VDC_NEG] = Quantise(s.Vdc_neg / VDC_DIVIDER_RATIO);
+    raw->code[ADC_RAW_IDC] = Quantise(SHUNT_OFFSET_V + s.Ibat * SHUNT_RESISTANCE_OHM * SHUNT_AMP_GAIN);
+    
+    /* Heatsink from the plant thermal model; inductors at a fixed point */
+    raw->code[ADC_RAW_NTC_HEATSINK] = NtcCodeCached(0U, s.T_ntc);
+    raw->code[ADC_RAW_NTC_INDUCTOR] = NtcCodeCached(1U, SIM_T_INDUCTOR_C);
+}
+
+/* ============================================================================
+ * HRTIM
+ * ========================================================================== */
+void HRTIM_Init(HRTIM_HandleTypeDef *hhrtim)
+{
+    (void)hhrtim;
+    Sim_HrtimSetDeadTime(HRTIM_DEAD_TIME_RISING);
+    Sim_HrtimSetUpdateMode(HRTIM_DOUBLE_UPDATE);
+    Sim_HrtimSetDuty(HRTIM_PERIOD / 2, HRTIM_PERIOD / 2, HRTIM_PERIOD / 2);
+}
+
+void HRTIM_Start(HRTIM_HandleTypeDef *hhrtim)
+{
+    (void)hhrtim;
+}
+
+void HRTIM_Stop(HRTIM_HandleTypeDef *hhrtim)
+{
+    (void)hhrtim;
+    Sim_HrtimSetOutputs(false);
+}
+
+void HRTIM_EnableOutputs(HRTIM_HandleTypeDef *hhrtim)
+{
+    (void)hhrtim;
+    Sim_HrtimSetOutputs(true);
+}
+
+void HRTIM_DisableOutputs(HRTIM_HandleTypeDef *hhrtim)
+{
+    (void)hhrtim;
+    Sim_HrtimSetOutputs(false);
+}
+
+void HRTIM_SetDuty(HRTIM_HandleTypeDef *hhrtim, 
+                   uint16_t duty_a, uint16_t duty_b, uint16_t duty_c)
+{
+    (void)hhrtim;
+    if (Replay_Active()) Replay_CaptureDuty(duty_a, duty_b, duty_c);
+    else Sim_HrtimSetDuty(duty_a, duty_b, duty_c);
+}
+
+void HRTIM_SetPeriod(HRTIM_HandleTypeDef *hhrtim, uint16_t period)
+{
+    (void)hhrtim;
+    Sim_HrtimSetPeriod(period);
+}
+
+bool HRTIM_CarrierAtCrest(HRTIM_HandleTypeDef *hhrtim)
+{
+    (void)hhrtim;
+    /* Replay: ISRs alternate, the keyframe holds the previous instant */
+    if (Replay_Active()) return !g_sys.timing.crest;
+    return Sim_HrtimAtCrest();
+}
+
+void HRTIM_SetUpdateMode(HRTIM_HandleTypeDef *hhrtim, bool double_update)
+{
+    (void)hhrtim;
+    Sim_HrtimSetUpdateMode(double_update);
+}
+
+void HRTIM_SetDeadTime(HRTIM_HandleTypeDef *hhrtim, uint16_t dt_rising, uint16_t dt_falling)
+{
+    (void)hhrtim;
+    (void)dt_falling;
+    Sim_HrtimSetDeadTime(dt_rising);
+}
+
+void HRTIM_ConfigFaults(HRTIM_HandleTypeDef *hhrtim)
+{
+    (void)hhrtim;
+    Sim_HrtimArmFaults();
+}
+
+uint32_t HRTIM_FaultFlags(HRTIM_HandleTypeDef *hhrtim)
+{
+    (void)hhrtim;
+    return Sim_HrtimFaultFlags();
+}
+
+uint32_t HRTIM_FaultLevels(HRTIM_HandleTypeDef *hhrtim)
+{
+    (void)hhrtim;
+    return Sim_HrtimFaultLevels();
+}
+
+uint16_t HRTIM_MasterCount(HRTIM_HandleTypeDef *hhrtim)
+{
+    /* The modelled ISR takes no time: only an isr event delays it */
+    (void)hhrtim;
+    return Sim_HrtimEntryDelay();
+}
+
+bool HRTIM_RepetitionPending(HRTIM_HandleTypeDef *hhrtim)
+{
+    (void)hhrtim;
+    return Sim_HrtimOverrun();
+}
+
+/* ============================================================================
+ * MODBUS (register image only, no serial link; the frame engine
+ * modbus_rtu.c runs on a pseudo-terminal in fwrtu)
+ * ========================================================================== */
+void Modbus_Init(UART_HandleTypeDef *huart)
+{
+    (void)huart;
+}
+
+void Modbus_Process(void)
+{
+}
+
+void Modbus_Lock(void)
+{
+}
+
+void Modbus_Unlock(void)
+{
+}
+
+/* ============================================================================
+ * TELEMETRY UART (frames go to the --telem-out file, the line busy for
+ * their time at TELEMETRY_BAUDRATE)
+ * ========================================================================== */
+static FW_INSTANCE_LOCAL double line_busy_until;
+
+void Telemetry_UartInit(UART_HandleTypeDef *huart)
+{
+    (void)huart;
+    line_busy_until = 0.0;
+}
+
+bool Telemetry_UartReady(void)
+{
+    Plant_t *pl = Sim_GetPlant();
+    return pl != NULL && pl->t >= line_busy_until;
+}
+
+bool Telemetry_UartSend(const uint8_t *data, uint16_t len)
+{
+    const SimConfig_t *cfg = Sim_GetConfig();
+    Plant_t *pl = Sim_GetPlant();
+    
+    if (!Telemetry_UartReady()) return false;
+    line_busy_until = pl->t + (double)len * 10.0 / TELEMETRY_BAUDRATE;
+    if (cfg != NULL && cfg->telem_out != NULL) {
+        fwrite(data, 1, len, cfg->telem_out);
+    }
+    return true;
+}
+
+/* ============================================================================
+ * CAN BMS (simulated BMS on the plant battery)
+ * The BMS sends pack and limits every main-loop pass and its cell blocks
+ * every BMS_CELL_PERIOD_MS; the frames pass the firmware mailbox and
+ * decoder. Limits are bms_limit_pu × IDC_MAX_A. Cells sit at the pack
+ * average, the last one cell_dv above it; temperatures spread from 25 to
+ * 30 °C.
+ * ========================================================================== */
+#define BMS_CELL_PERIOD_MS      100U
+
+static FW_INSTANCE_LOCAL BmsMailbox_t bms_mbox;
+static FW_INSTANCE_LOCAL BmsGen_t bms_gen;
+static FW_INSTANCE_LOCAL uint32_t bms_cells_due_ms;
+
+void CAN_BMS_Init(FDCAN_HandleTypeDef *hfdcan)
+{
+    (void)hfdcan;
+    memset(&bms_mbox, 0, sizeof(bms_mbox));
+    bms_cells_due_ms = 0;
+    CAN_BMS_Reset(&g_sys.bms);
+}
+
+void CAN_BMS_Process(void)
+{
+    Plant_t *pl = Sim_GetPlant();
+    BmsGen_t *g = &bms_gen;
+    BmsFrame_t frames[BMSGEN_CYCLE_MAX];
+    const uint32_t now = HAL_GetTick();
+    bool cells = false;
+    
+    g->pack_V = (float32_t)Plant_BatteryOcv(pl);
+    g->current_A = (float32_t)pl->i_bat;
+    g->soc = (float32_t)(pl->soc * 100.0);
+    g->soh = 100.0f;
+    g->status = 0;
+    g->charge_limit_A = IDC_MAX_A * (float32_t)pl->bms_limit_pu;
+    g->discharge_limit_A = IDC_MAX_A * (float32_t)pl->bms_limit_pu;
+    
+    if ((int32_t)(now - bms_cells_due_ms) >= 0) {
+        bms_cells_due_ms = now + BMS_CELL_PERIOD_MS;
+        cells = true;
+        for (uint32_t i = 0; i < BMS_CELL_COUNT; i++) {
+            g->cell_V[i] = g->pack_V / (float32_t)BMS_CELL_COUNT;
+        }
+        g->cell_V[BMS_CELL_COUNT - 1] += (float32_t)pl->cell_dv;
+        for (uint32_t i = 0; i < BMS_TEMP_COUNT; i++) {
+            g->cell_T[i] = 25.0f + 5.0f * (float32_t)i / (float32_t)(BMS_TEMP_COUNT - 1);
+        }
+    }
+    
+    uint32_t n = BmsGen_Cycle(g, cells, now, frames);
+    for (uint32_t i = 0; i < n; i++) {
+        CAN_BMS_Push(&bms_mbox, &frames[i]);
+    }
+    CAN_BMS_Drain(&bms_mbox, &g_sys.bms, now);
+}
+
+BmsData_t* CAN_BMS_GetData(void)
+{
+    return &g_sys.bms;
+}
+
+void CAN_BMS_SendHeartbeat(void)
+{
+}
+
+/* ============================================================================
+ * PARAMETER STORE (RAM image of the two flash slots, kept in --nv)
+ * ========================================================================== */
+bool ParamsNv_Read(uint32_t slot, void *dst, uint32_t len)
+{
+    return Sim_NvRead(slot, dst, len);
+}
+
+bool ParamsNv_Write(uint32_t slot, const void *src, uint32_t len)
+{
+    return Sim_NvWrite(slot, src, len);
+}
@@ -0,0 +1,235 @@
+/**
+ * @file sim_main.c
+ * @brief Command-Line Front End of the Host Simulator
+ * @version 2.1
+ * @date 2025-12
+ * 
+ * Usage: fwsim [options]
+ *   --t-end <s>           Simulated time (default 1.0)
+ *   --p <W>               Active power command at t = 0 (default 60000)
+ *   --q <VAr>             Reactive power command at t = 0 (default 0)
+ *   --event <t:name:val>  Scenario event, repeatable. Names:
+ *                         vsag freq phase island h5 unbal p q enable
+ *                         lgrid rload lload cload fslew estop
+ *                         tmask trate (telemetry set and rate, 40007-40009)
+ *                         celldv (last cell above the pack average [V])
+ *                         qprio (0/1, control word bit 3) bmslim (pu of
+ *                         IDC_MAX_A) soc (0..1)
+ *                         flt (HRTIM fault inputs forced, bit per
+ *                         HwFaultInput_t: 1 DESAT, 2 driver, 4 E-stop,
+ *                         8-32 phase comparators; 0 releases)
+ *                         isr (control ISR entry delay [µs], 0 = none)
+ *                         pcmd (parameter store command, 40010: 1 save,
+ *                         2 defaults, 3 reload)
+ *   --lgrid <H>           Grid inductance (default 250e-6)
+ *   --rload/--lload/--cload <Ω/H/F>  Parallel RLC load at the PCC (default none)
+ *   --noise-i <A>         Current sensor noise 1σ
+ *   --noise-v <V>         Voltage sensor noise 1σ
+ *   --seed <n>            Noise seed
+ *   --gain <name=val>     Controller gain override, repeatable. Names:
+ *                         current_kp current_kr current_wc pll_kp
+ *                         pll_ki voltage_kp voltage_ki ad_k
+ *   --param <name=val>    Runtime parameter (params.c table), repeatable;
+ *                         in range, staged as one set after start-up
+ *   --nv <file>           Parameter store flash image, loaded at start-up
+ *                         and written back after a save (missing = erased)
+ *   --metric-t0 <s>       Step instant for settling/overshoot
+ *                         (default: first p event after 0, else RUN entry)
+ *   --thd-window <s>      THD window before the end (default 0.1); also
+ *                         the current loop measurement window
+ *   --fra <Hz>            Current loop gain at this frequency: sine added
+ *                         to the compare values (use --fixed-fsw 1 and a
+ *                         frequency off the grid harmonics)
+ *   --fra-amp <counts>    Injection amplitude (default 1 % of HRTIM_PERIOD)
+ *   --trace <file.csv>    Waveform trace
+ *   --decim <n>           Trace every n-th ISR (default 10)
+ *   --telem-out <file>    Telemetry stream bytes as sent on the RS485 line
+ *   --min-speedup <x>     Exit 2 if slower than x times real time
+ *   --record <file.bin>   Write the ISR recorder image at the end of the run
+ *                         (without it the recorder is off; needs a
+ *                         -DRECORDER_ENABLE=1 build)
+ *
+ * Usage: fwsim --replay <file.bin> [--replay-out <file.csv>]
+ *   Runs the control ISR on a recorder image (from target or --record).
+ *   Exit 0 when all duties reproduce, 3 on mismatch, 1 on a bad image.
+ */
+
+#include "sim.h"
+#include "replay.h"
+#include "recorder.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void Usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [--t-end s] [--p W] [--q VAr] [--event t:name:value]... "
+                    "[--enable 0/1] [--grid-present 0/1] [--lgrid H] [--rload ohm] [--lload H] [--cload F] [--t-amb C] [--t-hs C] [--rth-ha K/W] [--vbat V] [--noise-i A] [--noise-v V] [--seed n] [--gain name=value]... [--param name=value]... [--nv file] "
+                    "[--metric-t0 s] [--thd-window s] [--fra Hz] [--fra-amp counts] [--loss-window s] [--fixed-fsw 0/1] "
+                    "[--trace file.csv] [--decim n] [--telem-out file] [--min-speedup x] [--record file.bin]\n"
+                    "       %s --replay file.bin [--replay-out file.csv]\n", prog, prog);
+}
+
+static int RunReplay(const char *rec_path, const char *out_path)
+{
+    ReplayResult_t res;
+    FILE *csv = NULL;
+    
+    if (out_path != NULL) {
+        csv = fopen(out_path, "w");
+        if (csv == NULL) {
+            perror(out_path);
+            return 1;
+        }
+    }
+    
+    int rc = Replay_Run(rec_path, csv, &res);
+    if (csv != NULL) fclose(csv);
+    
+    if (rc != 0) {
+        fprintf(stderr, "%s: %s\n", rec_path, (rc == -2) ? "not a recorder image of this geometry"
+                                                          : "unreadable or corrupt");
+        return 1;
+    }
+    
+    printf("build_id     %u.%u.%u\n", (unsigned)(res.build_id >> 16),
+           (unsigned)((res.build_id >> 8) & 0xFFU), (unsigned)(res.build_id & 0xFFU));
+    printf("blocks       %u\n", (unsigned)res.blocks);
+    printf("frames       %u\n", (unsigned)res.frames);
+    printf("outputs      %u\n", (unsigned)res.outputs);
+    printf("trigger      frame %u faults 0x%08X\n", (unsigned)res.trigger_frame, (unsigned)res.trigger_faults);
+    printf("field_skips  %u\n", (unsigned)res.field_skips);
+    printf("mismatches   %u\n", (unsigned)res.mismatches);
+    if (res.first_mismatch >= 0) {
+        printf("first        frame %lld\n", (long long)res.first_mismatch);
+        return 3;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    static SimConfig_t cfg;
+    SimResult_t res;
+    double min_speedup = 0.0;
+    const char *trace_path = NULL, *telem_path = NULL;
+    const char *record_path = NULL, *replay_path = NULL, *replay_out = NULL;
+    
+    Sim_DefaultConfig(&cfg);
+    
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        const char *v = (i + 1 < argc) ? argv[i + 1] : NULL;
+        
+        if (v == NULL) { Usage(argv[0]); return 1; }
+        i++;
+        
+        if (strcmp(a, "--trace") == 0)              trace_path = v;
+        else if (strcmp(a, "--decim") == 0)         cfg.trace_decim = (uint32_t)strtoul(v, NULL, 0);
+        else if (strcmp(a, "--telem-out") == 0)     telem_path = v;
+        else if (strcmp(a, "--min-speedup") == 0)   min_speedup = atof(v);
+        else if (strcmp(a, "--record") == 0)        record_path = v;
+        else if (strcmp(a, "--replay") == 0)        replay_path = v;
+        else if (strcmp(a, "--replay-out") == 0)    replay_out = v;
+        else if (!Sim_ParseOption(&cfg, a, v)) {
+            fprintf(stderr, "bad option '%s %s'\n", a, v);
+            Usage(argv[0]);
+            return 1;
+        }
+    }
+    
+    if (replay_path != NULL) {
+        return RunReplay(replay_path, replay_out);
+    }
+    
+    if (trace_path != NULL) {
+        cfg.trace = fopen(trace_path, "w");
+        if (cfg.trace == NULL) {
+            perror(trace_path);
+            return 1;
+        }
+    }
+    
+    if (telem_path != NULL) {
+        cfg.telem_out = fopen(telem_path, "wb");
+        if (cfg.telem_out == NULL) {
+            perror(telem_path);
+            return 1;
+        }
+    }
+    
+#if !RECORDER_ENABLE
+    if (record_path != NULL) {
+        fprintf(stderr, "--record: built without the recorder (-DRECORDER_ENABLE=1)\n");
+        return 1;
+    }
+#endif
+    cfg.record = (record_path != NULL);
+    if (Sim_Run(&cfg, &res) != 0) {
+        fprintf(stderr, "simulation failed\n");
+        return 1;
+    }
+    
+    if (cfg.trace != NULL) fclose(cfg.trace);
+    if (cfg.telem_out != NULL) fclose(cfg.telem_out);
+    
+    if (record_path != NULL) {
+        FILE *f = fopen(record_path, "wb");
+        if (f == NULL || fwrite(&g_rec, sizeof(g_rec), 1, f) != 1) {
+            perror(record_path);
+            if (f != NULL) fclose(f);
+            return 1;
+        }
+        fclose(f);
+    }
+    
+    printf("t_sim        %.4f s\n", res.t_sim_s);
+    printf("t_wall       %.4f s\n", res.t_wall_s);
+    printf("speedup      %.1fx real time\n", res.speedup);
+    printf("isr_count    %llu\n", (unsigned long long)res.isr_count);
+    printf("final_state  %u\n", (unsigned)res.final_state);
+    printf("faults       0x%08X\n", (unsigned)res.faults);
+    printf("fault_hist   0x%08X\n", (unsigned)res.fault_history);
+    printf("trips        %u (first at %.4f s)\n", (unsigned)res.trip_count, res.first_trip_s);
+    printf("hw_fault     0x%02X (first at %.6f s, %.2f us to outputs off)\n",
+           (unsigned)res.hw_fault_inputs, res.hw_trip_s, res.hw_latency_us);
+    printf("deadline     load max %.2f, %u overruns, shed 0x%02X\n",
+           res.isr_load_max, (unsigned)res.isr_overruns, (unsigned)res.isr_shed);
+    printf("isr_host     %.0f ns per switching ISR, %.1f mpc candidates\n",
+           res.isr_host_ns, res.mpc_candidates);
+    printf("params       %u published, %u refused, nv %u (record %u)\n",
+           (unsigned)res.param_seq, (unsigned)res.param_rejects,
+           (unsigned)res.param_nv, (unsigned)res.param_nv_seq);
+    printf("island_trip  %.1f ms\n", res.island_trip_ms);
+    printf("t_run        %.4f s\n", res.t_run_s);
+    printf("thd          %.2f %%\n", res.thd_pct);
+    printf("rise         %.2f ms\n", res.rise_ms);
+    printf("settle       %.2f ms\n", res.settle_ms);
+    printf("overshoot    %.2f %%\n", res.overshoot_pct);
+    printf("id_err_rms   %.3f A\n", res.id_err_rms);
+    printf("iae_dq       %.4f A s\n", res.iae_dq);
+    printf("pll_iae      %.5f Hz s\n", res.pll_iae);
+    printf("vdc_dev      %.2f V\n", res.vdc_dev_V);
+    printf("vdc_settle   %.2f ms\n", res.vdc_settle_ms);
+    printf("tj_ref_max   %.1f C\n", res.tj_ref_max);
+    printf("tj_est_max   %.1f C\n", res.tj_est_max);
+    printf("tj_err_max   %.1f K\n", res.tj_err_max);
+    printf("grid_est     L %.0f uH, SCR %.1f, band %u\n",
+           res.grid_L_uH, res.grid_scr, (unsigned)res.gain_band);
+    printf("p_in         %.0f W\n", res.p_in_W);
+    printf("p_out        %.0f W\n", res.p_out_W);
+    printf("eff          %.3f %%\n", res.eff_pct);
+    printf("losses       cond %.0f, sw %.0f, diode %.0f, cu %.0f, core %.0f W\n",
+           res.p_cond_W, res.p_sw_W, res.p_diode_W, res.p_cu_W, res.p_core_W);
+    printf("i_rms        %.1f A\n", res.i_rms_A);
+    printf("fsw          %.1f kHz, ripple %.1f A pp, i_peak %.1f A\n",
+           res.fsw_kHz, res.ripple_pp_A, res.i_peak_A);
+    printf("loop         delay %.2f us, gain %.2f dB, phase %.1f deg at %.0f Hz\n",
+           res.loop_delay_us, res.loop_gain_db, res.loop_phase_deg, res.fra_hz);
+    
+    if (min_speedup > 0.0 && res.speedup < min_speedup) {
+        fprintf(stderr, "speedup %.1fx below required %.1fx\n", res.speedup, min_speedup);
+        return 2;
+    }
+    return 0;
+}
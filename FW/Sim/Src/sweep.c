@@ -0,0 +1,533 @@
+/**
+ * @file sweep.c
+ * @brief Parallel Scenario Sweep Runner for the Host Simulator
+ * @version 2.1
+ * @date 2025-12
+ *
+ * Work stealing: jobs are dealt round-robin into one deque per worker.
+ * A worker pops from the bottom of its own deque and, once empty, steals
+ * from the top of the others. Scenario run times differ by orders of
+ * magnitude (t_end, early trips), so static partitioning leaves cores
+ * idle; stealing keeps them busy until the last job. No job creates new
+ * jobs, so a worker that finds every deque empty is done.
+ */
+
+#define _POSIX_C_SOURCE 200809L     // sysconf, clock_gettime
+
+#include "sweep.h"
+#include "types.h"
+#include <pthread.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+
+/* ============================================================================
+ * CONSTANTS
+ * ========================================================================== */
+#define STR_(x)         #x
+#define STR(x)          STR_(x)
+
+#define MAX_LINE        1024
+#define MAX_TOKENS      64
+#define MAX_CHOICES     32
+
+/* ============================================================================
+ * PRIVATE TYPES
+ * ========================================================================== */
+typedef struct {
+    pthread_mutex_t lock;
+    uint32_t *idx;              // Job indices
+    uint32_t top;               // Next to steal
+    uint32_t bottom;            // One past the next to pop
+} Deque_t;
+
+typedef struct {
+    SweepJob_t *jobs;
+    Deque_t *dq;
+    uint32_t n_threads;
+} Pool_t;
+
+typedef struct {
+    Pool_t *pool;
+    uint32_t id;
+    uint64_t steals;
+    pthread_t thread;
+} Worker_t;
+
+/* ============================================================================
+ * RESULT COLUMNS
+ * ========================================================================== */
+typedef enum {
+    COL_F64 = 'f',
+    COL_U32 = 'u',
+    COL_STR = 's'
+} ColType_t;
+
+typedef struct {
+    const char *name;
+    ColType_t type;
+    size_t offset;              // In SweepJob_t
+} Column_t;
+
+#define COL(name, type, member)     { name, type, offsetof(SweepJob_t, member) }
+
+static const Column_t columns[] = {
+    COL("name",             COL_STR, name),
+    COL("p_ref_W",          COL_F64, cfg.p_ref_W),
+    COL("q_ref_VAr",        COL_F64, cfg.q_ref_VAr),
+    COL("l_grid_H",         COL_F64, cfg.plant.L_grid),
+    COL("v_bat_V",          COL_F64, cfg.plant.V_bat_nom),
+    COL("noise_i_A",        COL_F64, cfg.noise_i_A),
+    COL("noise_v_V",        COL_F64, cfg.noise_v_V),
+    COL("t_end_s",          COL_F64, cfg.t_end),
+    COL("final_state",      COL_U32, res.final_state),
+    COL("faults",           COL_U32, res.faults),
+    COL("fault_history",    COL_U32, res.fault_history),
+    COL("trip_count",       COL_U32, res.trip_count),
+    COL("first_trip_s",     COL_F64, res.first_trip_s),
+    COL("island_trip_ms",   COL_F64, res.island_trip_ms),
+    COL("t_run_s",          COL_F64, res.t_run_s),
+    COL("thd_pct",          COL_F64, res.thd_pct),
+    COL("rise_ms",          COL_F64, res.rise_ms),
+    COL("settle_ms",        COL_F64, res.settle_ms),
+    COL("overshoot_pct",    COL_F64, res.overshoot_pct),
+    COL("id_err_rms_A",     COL_F64, res.id_err_rms),
+    COL("iae_dq_As",        COL_F64, res.iae_dq),
+    COL("pll_iae_Hzs",      COL_F64, res.pll_iae),
+    COL("vdc_dev_V",        COL_F64, res.vdc_dev_V),
+    COL("vdc_settle_ms",    COL_F64, res.vdc_settle_ms),
+    COL("tj_ref_max_C",     COL_F64, res.tj_ref_max),
+    COL("tj_est_max_C",     COL_F64, res.tj_est_max),
+    COL("tj_err_max_K",     COL_F64, res.tj_err_max),
+    COL("grid_L_uH",        COL_F64, res.grid_L_uH),
+    COL("grid_scr",         COL_F64, res.grid_scr),
+    COL("gain_band",        COL_U32, res.gain_band),
+    COL("p_in_W",           COL_F64, res.p_in_W),
+    COL("p_out_W",          COL_F64, res.p_out_W),
+    COL("eff_pct",          COL_F64, res.eff_pct),
+    COL("p_cond_W",         COL_F64, res.p_cond_W),
+    COL("p_sw_W",           COL_F64, res.p_sw_W),
+    COL("p_diode_W",        COL_F64, res.p_diode_W),
+    COL("p_cu_W",           COL_F64, res.p_cu_W),
+    COL("p_core_W",         COL_F64, res.p_core_W),
+    COL("i_rms_A",          COL_F64, res.i_rms_A),
+    COL("fsw_kHz",          COL_F64, res.fsw_kHz),
+    COL("ripple_pp_A",      COL_F64, res.ripple_pp_A),
+    COL("i_peak_A",         COL_F64, res.i_peak_A),
+    COL("loop_delay_us",    COL_F64, res.loop_delay_us),
+    COL("fra_hz",           COL_F64, res.fra_hz),
+    COL("loop_gain_db",     COL_F64, res.loop_gain_db),
+    COL("loop_phase_deg",   COL_F64, res.loop_phase_deg),
+    COL("hw_fault_inputs",  COL_U32, res.hw_fault_inputs),
+    COL("hw_latency_us",    COL_F64, res.hw_latency_us),
+    COL("isr_load_max",     COL_F64, res.isr_load_max),
+    COL("isr_overruns",     COL_U32, res.isr_overruns),
+    COL("isr_host_ns",      COL_F64, res.isr_host_ns),
+    COL("mpc_candidates",   COL_F64, res.mpc_candidates),
+    COL("t_cpu_s",          COL_F64, t_cpu_s),
+    COL("speedup",          COL_F64, res.speedup),
+};
+
+#define N_COLUMNS       (sizeof(columns) / sizeof(columns[0]))
+#define N_ALL_COLUMNS   (N_COLUMNS + SIM_GAIN_COUNT)    // + effective gains
+
+/* ============================================================================
+ * HELPERS
+ * ========================================================================== */
+static double ClockTime(clockid_t clk)
+{
+    struct timespec ts;
+    clock_gettime(clk, &ts);
+    return (double)ts.tv_sec + 1e-9 * (double)ts.tv_nsec;
+}
+
+bool Sweep_Parallel(void)
+{
+    /* Without per-thread firmware state all workers would share g_sys */
+    return sizeof(STR(FW_INSTANCE_LOCAL)) > 1U;
+}
+
+uint32_t Sweep_CpuCount(void)
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return (n > 0) ? (uint32_t)n : 1U;
+}
+
+/* ============================================================================
+ * WORK-STEALING POOL
+ * ========================================================================== */
+static bool PopBottom(Deque_t *d, uint32_t *job)
+{
+    bool ok = false;
+
+    pthread_mutex_lock(&d->lock);
+    if (d->bottom > d->top) {
+        *job = d->idx[--d->bottom];
+        ok = true;
+    }
+    pthread_mutex_unlock(&d->lock);
+    return ok;
+}
+
+static bool StealTop(Deque_t *d, uint32_t *job)
+{
+    bool ok = false;
+
+    pthread_mutex_lock(&d->lock);
+    if (d->bottom > d->top) {
+        *job = d->idx[d->top++];
+        ok = true;
+    }
+    pthread_mutex_unlock(&d->lock);
+    return ok;
+}
+
+static void RunJob(SweepJob_t *job)
+{
+    /* CPU time, not wall: with more threads than cores the wall time of a
+     * job includes the time other jobs held its core */
+    double t0 = ClockTime(CLOCK_THREAD_CPUTIME_ID);
+    job->rc = Sim_Run(&job->cfg, &job->res);
+    job->t_cpu_s = ClockTime(CLOCK_THREAD_CPUTIME_ID) - t0;
+    if (job->rc != 0) {
+        memset(&job->res, 0, sizeof(job->res));
+        job->res.t_run_s = job->res.first_trip_s = NAN;
+        job->res.thd_pct = job->res.settle_ms = NAN;
+        job->res.overshoot_pct = job->res.id_err_rms = NAN;
+        job->res.rise_ms = job->res.iae_dq = job->res.pll_iae = NAN;
+        job->res.vdc_dev_V = job->res.vdc_settle_ms = NAN;
+    }
+}
+
+static void* WorkerMain(void *arg)
+{
+    Worker_t *w = (Worker_t *)arg;
+    Pool_t *pool = w->pool;
+    uint32_t job;
+
+    for (;;) {
+        bool found = PopBottom(&pool->dq[w->id], &job);
+
+        for (uint32_t v = 1; !found && v < pool->n_threads; v++) {
+            found = StealTop(&pool->dq[(w->id + v) % pool->n_threads], &job);
+            if (found) w->steals++;
+        }
+        if (!found) break;
+
+        RunJob(&pool->jobs[job]);
+    }
+    return NULL;
+}
+
+int Sweep_Run(SweepJob_t *jobs, uint32_t n_jobs, uint32_t n_threads, SweepStats_t *stats)
+{
+    Pool_t pool;
+    Worker_t *workers;
+    uint32_t *idx;
+    int rc = 0;
+
+    if (n_threads == 0U || !Sweep_Parallel()) n_threads = 1U;
+    if (n_threads > n_jobs && n_jobs > 0U) n_threads = n_jobs;
+
+    pool.jobs = jobs;
+    pool.n_threads = n_threads;
+    pool.dq = (Deque_t *)calloc(n_threads, sizeof(Deque_t));
+    workers = (Worker_t *)calloc(n_threads, sizeof(Worker_t));
+    idx = (uint32_t *)malloc(((size_t)n_jobs + 1U) * sizeof(uint32_t));
+    if (pool.dq == NULL || workers == NULL || idx == NULL) {
+        free(pool.dq);
+        free(workers);
+        free(idx);
+        return -1;
+    }
+
+    /* Round-robin deal: worker k owns jobs k, k + n, k + 2n, ... */
+    uint32_t pos = 0;
+    for (uint32_t k = 0; k < n_threads; k++) {
+        Deque_t *d = &pool.dq[k];
+        pthread_mutex_init(&d->lock, NULL);
+        d->idx = &idx[pos];
+        d->top = 0;
+        for (uint32_t j = k; j < n_jobs; j += n_threads) {
+            idx[pos++] = j;
+        }
+        d->bottom = (uint32_t)(&idx[pos] - d->idx);
+        /* Owner pops from the bottom: reverse so it runs its jobs in index order */
+        for (uint32_t a = 0, b = d->bottom; a + 1U < b; a++, b--) {
+            uint32_t t = d->idx[a];
+            d->idx[a] = d->idx[b - 1U];
+            d->idx[b - 1U] = t;
+        }
+    }
+
+    double t0 = ClockTime(CLOCK_MONOTONIC);
+    uint32_t started = 0;
+    for (uint32_t k = 0; k < n_threads; k++) {
+        workers[k].pool = &pool;
+        workers[k].id = k;
+        if (pthread_create(&workers[k].thread, NULL, WorkerMain, &workers[k]) != 0) {
+            rc = -1;
+            break;
+        }
+        started++;
+    }
+    /* With a failed create the started workers still drain every deque */
+    for (uint32_t k = 0; k < started; k++) {
+        pthread_join(workers[k].thread, NULL);
+    }
+    double t_wall = ClockTime(CLOCK_MONOTONIC) - t0;
+
+    if (stats) {
+        memset(stats, 0, sizeof(*stats));
+        stats->threads = started;
+        stats->t_wall_s = t_wall;
+        for (uint32_t k = 0; k < started; k++) stats->steals += workers[k].steals;
+        for (uint32_t j = 0; j < n_jobs; j++) {
+            stats->t_sim_s += jobs[j].res.t_sim_s;
+            stats->t_busy_s += jobs[j].t_cpu_s;
+        }
+    }
+    for (uint32_t j = 0; j < n_jobs && rc == 0; j++) {
+        if (jobs[j].rc != 0) rc = -2;
+    }
+
+    for (uint32_t k = 0; k < n_threads; k++) pthread_mutex_destroy(&pool.dq[k].lock);
+    free(pool.dq);
+    free(workers);
+    free(idx);
+    return (started == 0U) ? -1 : rc;
+}
+
+/* ============================================================================
+ * SCENARIO FILE
+ * ========================================================================== */
+typedef struct {
+    SweepJob_t *jobs;
+    uint32_t n;
+    uint32_t cap;
+} JobList_t;
+
+typedef struct {
+    char *prefix;               // Text before '{' (points into the line)
+    char *choice[MAX_CHOICES];
+    uint32_t n_choices;
+    char *suffix;               // Text after '}'
+} Expansion_t;
+
+static SweepJob_t* NewJob(JobList_t *list)
+{
+    if (list->n == list->cap) {
+        uint32_t cap = list->cap ? 2U * list->cap : 64U;
+        SweepJob_t *p = (SweepJob_t *)realloc(list->jobs, cap * sizeof(SweepJob_t));
+        if (p == NULL) return NULL;
+        list->jobs = p;
+        list->cap = cap;
+    }
+    SweepJob_t *job = &list->jobs[list->n++];
+    memset(job, 0, sizeof(*job));
+    return job;
+}
+
+/* Splits "pre{a,b}post" in place; false when the token has no braces */
+static bool SplitBraces(char *tok, Expansion_t *ex)
+{
+    char *open = strchr(tok, '{');
+    char *close = open ? strchr(open, '}') : NULL;
+
+    if (open == NULL || close == NULL) return false;
+
+    *open = '\0';
+    *close = '\0';
+    ex->prefix = tok;
+    ex->suffix = close + 1;
+    ex->n_choices = 0;
+    for (char *c = strtok(open + 1, ","); c != NULL && ex->n_choices < MAX_CHOICES; c = strtok(NULL, ",")) {
+        ex->choice[ex->n_choices++] = c;
+    }
+    return ex->n_choices > 0;
+}
+
+static int ParseLine(char *line, uint32_t line_no, JobList_t *list)
+{
+    char *tok[MAX_TOKENS];
+    uint32_t n_tok = 0;
+    Expansion_t ex[MAX_TOKENS];
+    int32_t ex_of[MAX_TOKENS];
+    uint32_t n_ex = 0;
+
+    char *hash = strchr(line, '#');
+    if (hash) *hash = '\0';
+
+    for (char *t = strtok(line, " \t\r\n"); t != NULL; t = strtok(NULL, " \t\r\n")) {
+        if (n_tok == MAX_TOKENS) {
+            fprintf(stderr, "line %u: too many tokens\n", (unsigned)line_no);
+            return -1;
+        }
+        tok[n_tok++] = t;
+    }
+    if (n_tok == 0) return 0;
+    if ((n_tok & 1U) == 0) {
+        fprintf(stderr, "line %u: option without value\n", (unsigned)line_no);
+        return -1;
+    }
+
+    /* Tokens are complete at this point: SplitBraces runs its own strtok */
+    for (uint32_t i = 0; i < n_tok; i++) {
+        ex_of[i] = -1;
+        if (i > 0 && (i & 1U) == 0 && strchr(tok[i], '{') != NULL) {
+            if (!SplitBraces(tok[i], &ex[n_ex])) {
+                fprintf(stderr, "line %u: bad {...} in '%s'\n", (unsigned)line_no, tok[i]);
+                return -1;
+            }
+            ex_of[i] = (int32_t)n_ex++;
+        }
+    }
+
+    /* Cartesian product: mixed-radix counter over the expansions */
+    uint32_t pick[MAX_TOKENS] = { 0 };
+    for (;;) {
+        SweepJob_t *job = NewJob(list);
+        if (job == NULL) return -1;
+        Sim_DefaultConfig(&job->cfg);
+
+        size_t len = (size_t)snprintf(job->name, SWEEP_NAME_LEN, "%s", tok[0]);
+        for (uint32_t i = 1; i + 1 < n_tok; i += 2) {
+            char value[256];
+            const char *v = tok[i + 1];
+
+            if (ex_of[i + 1] >= 0) {
+                const Expansion_t *e = &ex[ex_of[i + 1]];
+                snprintf(value, sizeof(value), "%s%s%s", e->prefix, e->choice[pick[ex_of[i + 1]]], e->suffix);
+                v = value;
+                if (len < SWEEP_NAME_LEN) {
+                    len += (size_t)snprintf(job->name + len, SWEEP_NAME_LEN - len, "/%s=%s",
+                                            tok[i] + strspn(tok[i], "-"), value);
+                }
+            }
+            if (!Sim_ParseOption(&job->cfg, tok[i], v)) {
+                fprintf(stderr, "line %u: bad option '%s %s'\n", (unsigned)line_no, tok[i], v);
+                return -1;
+            }
+        }
+
+        uint32_t k = 0;
+        while (k < n_ex && ++pick[k] == ex[k].n_choices) {
+            pick[k++] = 0;
+        }
+        if (k == n_ex) break;
+    }
+    return 0;
+}
+
+int Sweep_LoadScenarios(const char *path, SweepJob_t **jobs, uint32_t *n_jobs)
+{
+    JobList_t list = { 0 };
+    char line[MAX_LINE];
+    uint32_t line_no = 0;
+    int rc = 0;
+
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+    while (rc == 0 && fgets(line, sizeof(line), f) != NULL) {
+        rc = ParseLine(line, ++line_no, &list);
+    }
+    fclose(f);
+    
+    if (rc != 0) {
+        free(list.jobs);
+        list.jobs = NULL;
+        list.n = 0;
+    }
+    *jobs = list.jobs;
+    *n_jobs = list.n;
+    return rc;
+}
+
+/* ============================================================================
+ * RESULT FILES
+ * ========================================================================== */
+static const void* Field(const SweepJob_t *job, const Column_t *c)
+{
+    return (const uint8_t *)job + c->offset;
+}
+
+static bool PutU32(FILE *f, uint32_t v)
+{
+    uint8_t b[4] = { (uint8_t)v, (uint8_t)(v >> 8), (uint8_t)(v >> 16), (uint8_t)(v >> 24) };
+    return fwrite(b, 1, 4, f) == 4;
+}
+
+static bool PutName(FILE *f, ColType_t type, const char *prefix, const char *name)
+{
+    size_t lp = strlen(prefix), ln = strlen(name);
+
+    if (lp + ln > 255U) return false;
+    return fputc(type, f) != EOF && fputc((int)(lp + ln), f) != EOF &&
+           fwrite(prefix, 1, lp, f) == lp && fwrite(name, 1, ln, f) == ln;
+}
+
+int Sweep_WriteColumns(const char *path, const SweepJob_t *jobs, uint32_t n_jobs)
+{
+    FILE *f = fopen(path, "wb");
+    bool ok;
+
+    if (f == NULL) return -1;
+
+    ok = fwrite(SWEEP_MAGIC, 1, 4, f) == 4 && PutU32(f, SWEEP_FORMAT_VERSION) &&
+         PutU32(f, n_jobs) && PutU32(f, (uint32_t)N_ALL_COLUMNS);
+
+    /* f64 and u32 values are written in host order: x86 and ARM hosts are little endian */
+    for (uint32_t c = 0; ok && c < N_COLUMNS; c++) {
+        const Column_t *col = &columns[c];
+        ok = PutName(f, col->type, "", col->name);
+        for (uint32_t j = 0; ok && j < n_jobs; j++) {
+            const void *v = Field(&jobs[j], col);
+            if (col->type == COL_F64) {
+                ok = fwrite(v, sizeof(double), 1, f) == 1;
+            } else if (col->type == COL_U32) {
+                ok = PutU32(f, *(const uint32_t *)v);
+            } else {
+                size_t len = strnlen((const char *)v, SWEEP_NAME_LEN);
+                ok = fputc((int)len, f) != EOF && fwrite(v, 1, len, f) == len;
+            }
+        }
+    }
+    for (uint32_t g = 0; ok && g < SIM_GAIN_COUNT; g++) {
+        ok = PutName(f, COL_F64, "gain.", Sim_GainName((SimGain_t)g));
+        for (uint32_t j = 0; ok && j < n_jobs; j++) {
+            double v = Sim_GainValue(&jobs[j].cfg, (SimGain_t)g);
+            ok = fwrite(&v, sizeof(v), 1, f) == 1;
+        }
+    }
+
+    if (fclose(f) != 0) ok = false;
+    return ok ? 0 : -1;
+}
+
+int Sweep_WriteCsv(FILE *f, const SweepJob_t *jobs, uint32_t n_jobs)
+{
+    for (uint32_t c = 0; c < N_COLUMNS; c++) fprintf(f, "%s,", columns[c].name);
+    for (uint32_t g = 0; g < SIM_GAIN_COUNT; g++) {
+        fprintf(f, "gain.%s%s", Sim_GainName((SimGain_t)g), (g + 1U < SIM_GAIN_COUNT) ? "," : "\n");
+    }
+
+    for (uint32_t j = 0; j < n_jobs; j++) {
+        for (uint32_t c = 0; c < N_COLUMNS; c++) {
+            const void *v = Field(&jobs[j], &columns[c]);
+            if (columns[c].type == COL_F64)         fprintf(f, "%.9g,", *(const double *)v);
+            else if (columns[c].type == COL_U32)    fprintf(f, "%u,", (unsigned)*(const uint32_t *)v);
+            else                                    fprintf(f, "%s,", (const char *)v);
+        }
+        for (uint32_t g = 0; g < SIM_GAIN_COUNT; g++) {
+            fprintf(f, "%.9g%s", (double)Sim_GainValue(&jobs[j].cfg, (SimGain_t)g),
+                    (g + 1U < SIM_GAIN_COUNT) ? "," : "\n");
+        }
+    }
+    return ferror(f) ? -1 : 0;
+}
@@ -0,0 +1,130 @@
+/**
+ * @file sweep_main.c
+ * @brief Command-Line Front End of the Scenario Sweep Runner
+ * @version 2.1
+ * @date 2025-12
+ *
+ * Usage: fwsweep <scenarios.txt> [options]
+ *   --jobs <n>            Worker threads (default: online cores)
+ *   --out <file.col>      Columnar results (default sweep.col)
+ *   --csv <file.csv>      Same results as CSV
+ *   --scaling             Run the sweep at 1, 2, 4 ... --jobs threads and
+ *                         report throughput against thread count
+ *
+ * Scenario file: one scenario per line, a name followed by fwsim scenario
+ * options (--t-end --p --q --event --lgrid --noise-i --noise-v --seed
+ * --gain --metric-t0 --thd-window --fra --fra-amp). '#' starts a comment. A value written
+ * as {a,b,c} expands the line into one scenario per value; several such
+ * values expand to their cartesian product. Example:
+ *   step   --t-end 1.5 --event 1.0:p:120000 --lgrid {50e-6,250e-6,1e-3}
+ *   kp     --t-end 1.0 --gain current_kp={0.3,0.5,0.8} --noise-i {0,0.5}
+ */
+
+#include "sweep.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ============================================================================
+ * REPORT
+ * ========================================================================== */
+static void Usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s scenarios.txt [--jobs n] [--out file.col] [--csv file.csv] [--scaling]\n", prog);
+}
+
+static void PrintStats(const SweepStats_t *st, uint32_t n_jobs, double t_wall_1)
+{
+    /* Against the 1-thread pass with --scaling, else against the summed job CPU time */
+    double ref = (t_wall_1 > 0.0) ? t_wall_1 : st->t_busy_s;
+    double speedup = (st->t_wall_s > 0.0) ? ref / st->t_wall_s : 0.0;
+
+    printf("%7u %9.2f %10.2f %10.1f %8.2f %6.0f %% %7llu\n",
+           (unsigned)st->threads, st->t_wall_s,
+           n_jobs / st->t_wall_s, st->t_sim_s / st->t_wall_s,
+           speedup, 100.0 * speedup / st->threads, (unsigned long long)st->steals);
+}
+
+static void PrintSummary(const SweepJob_t *jobs, uint32_t n)
+{
+    uint32_t failed = 0, tripped = 0;
+
+    for (uint32_t j = 0; j < n; j++) {
+        if (jobs[j].rc != 0) failed++;
+        else if (jobs[j].res.trip_count > 0U) tripped++;
+    }
+    printf("scenarios    %u (%u tripped, %u failed)\n", (unsigned)n, (unsigned)tripped, (unsigned)failed);
+}
+
+int main(int argc, char **argv)
+{
+    SweepJob_t *jobs = NULL;
+    uint32_t n_jobs = 0;
+    SweepStats_t st;
+    uint32_t n_threads = Sweep_CpuCount();
+    const char *scen_path = NULL, *out_path = "sweep.col", *csv_path = NULL;
+    bool scaling = false;
+
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        const char *v = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+        if (strcmp(a, "--scaling") == 0)                { scaling = true; continue; }
+        if (a[0] != '-' && scen_path == NULL)           { scen_path = a; continue; }
+        if (v == NULL) { Usage(argv[0]); return 1; }
+        i++;
+
+        if (strcmp(a, "--jobs") == 0)                   n_threads = (uint32_t)strtoul(v, NULL, 0);
+        else if (strcmp(a, "--out") == 0)               out_path = v;
+        else if (strcmp(a, "--csv") == 0)               csv_path = v;
+        else { Usage(argv[0]); return 1; }
+    }
+    if (scen_path == NULL || n_threads == 0U) { Usage(argv[0]); return 1; }
+
+    if (!Sweep_Parallel() && n_threads > 1U) {
+        fprintf(stderr, "built without -DFW_INSTANCE_LOCAL=_Thread_local: running on 1 thread\n");
+        n_threads = 1U;
+    }
+    if (Sweep_LoadScenarios(scen_path, &jobs, &n_jobs) != 0) return 1;
+    if (n_jobs == 0U) {
+        fprintf(stderr, "%s: no scenarios\n", scen_path);
+        return 1;
+    }
+
+    printf("scenarios    %u, %u threads, %u cores online\n",
+           (unsigned)n_jobs, (unsigned)n_threads, (unsigned)Sweep_CpuCount());
+    printf("threads    wall_s  scen_per_s  sim_per_s  speedup    eff  steals\n");
+
+    /* Scaling: same job set at 1, 2, 4 ... n threads (results are per job
+     * deterministic, the last pass is the one written out) */
+    double t_wall_1 = 0.0;
+    int rc = 0;
+    for (uint32_t t = scaling ? 1U : n_threads; ; t = (2U * t < n_threads) ? 2U * t : n_threads) {
+        rc = Sweep_Run(jobs, n_jobs, t, &st);
+        if (rc == -1) {
+            fprintf(stderr, "thread pool failed\n");
+            return 1;
+        }
+        if (scaling && t == 1U) t_wall_1 = st.t_wall_s;
+        PrintStats(&st, n_jobs, t_wall_1);
+        if (t >= n_threads) break;
+    }
+    PrintSummary(jobs, n_jobs);
+
+    if (Sweep_WriteColumns(out_path, jobs, n_jobs) != 0) {
+        perror(out_path);
+        return 1;
+    }
+    if (csv_path != NULL) {
+        FILE *f = fopen(csv_path, "w");
+        if (f == NULL || Sweep_WriteCsv(f, jobs, n_jobs) != 0) {
+            perror(csv_path);
+            if (f != NULL) fclose(f);
+            return 1;
+        }
+        fclose(f);
+    }
+
+    free(jobs);
+    return (rc == 0) ? 0 : 2;
+}
@@ -0,0 +1,497 @@
+/**
+ * @file tune_main.c
+ * @brief Control Gain Autotuner over the Host Simulator
+ * @version 2.1
+ * @date 2025-12
+ *
+ * Usage: fwtune [options]
+ *   --jobs <n>            Worker threads (default: online cores)
+ *   --max-evals <n>       Candidate evaluations (default 150)
+ *   --lgrid <H,H,...>     Grid inductances every scenario runs at
+ *                         (default 250e-6,1e-3: nominal and weak grid)
+ *   --w-bw <w>            Weight of step rise time (default 1)
+ *   --w-os <w>            Weight of step overshoot and settling (default 1)
+ *   --w-ripple <w>        Weight of current ripple and THD (default 1)
+ *   --w-dist <w>          Weight of sag/swell/frequency-jump IAE (default 1)
+ *   --out <file.h>        Generated header (default Inc/config_tuned.h)
+ *
+ * Searches CURRENT_KP, CURRENT_KR, CURRENT_OMEGA_C, PLL_KP, PLL_KI and
+ * LCL_AD_GAIN (no effect with LCL_ACTIVE_DAMPING=0) with Nelder-Mead in
+ * log10 space within fixed bounds. Each candidate runs the scenario set
+ * below at every --lgrid on the sweep thread pool. Metrics are normalised
+ * to the hand-set config.h gains, so the defaults score 1.0 and lower is
+ * better. A candidate that trips, leaves RUN, exceeds
+ * TUNE_RIPPLE_MAX_A tracking error or TUNE_THD_MAX_PCT is infeasible.
+ *
+ * Needs -DREF_TRAJECTORY_ENABLE=0 so the P command steps. The winner is
+ * written as config_tuned.h; build the firmware with
+ * -DCONTROL_TUNED_GAINS=1 to use it. The plant is the one compiled in
+ * (config.h filter values), so rebuild fwtune after changing the filter.
+ */
+
+#include "sweep.h"
+#include "config.h"
+#include "types.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+/* ============================================================================
+ * CONSTANTS
+ * ========================================================================== */
+#define TUNE_MAX_GRIDS          4
+#define TUNE_N_PARAMS           6
+#define TUNE_RIPPLE_MAX_A       10.0        // Tail RMS(Id - Id_ref) limit
+#define TUNE_THD_MAX_PCT        5.0         // IEEE 519 current TDD
+#define TUNE_INFEASIBLE         1000.0      // Score per infeasible scenario
+#define TUNE_INIT_STEP          0.3         // Initial simplex [decades]
+#define TUNE_TOL_F              1e-3        // Stop: score spread
+#define TUNE_TOL_X              0.01        // Stop: simplex size [decades]
+
+/* ============================================================================
+ * SCENARIOS / PARAMETERS
+ * ========================================================================== */
+typedef enum {
+    ROLE_STEP = 0,              // Scored on rise, overshoot, settling
+    ROLE_DISTURB                // Scored on dq and PLL error integrals
+} TuneRole_t;
+
+typedef struct {
+    const char *name;
+    TuneRole_t role;
+    const char *opts;           // fwsim scenario options
+} TuneScenario_t;
+
+static const TuneScenario_t scenarios[] = {
+    { "step",   ROLE_STEP,    "--t-end 0.9 --noise-i 0.5 --noise-v 1.0 --event 0.7:p:120000" },
+    { "sag",    ROLE_DISTURB, "--t-end 0.9 --noise-i 0.5 --noise-v 1.0 --metric-t0 0.7 --event 0.7:vsag:0.92" },
+    { "swell",  ROLE_DISTURB, "--t-end 0.9 --noise-i 0.5 --noise-v 1.0 --metric-t0 0.7 --event 0.7:vsag:1.06" },
+    { "fjump",  ROLE_DISTURB, "--t-end 0.9 --noise-i 0.5 --noise-v 1.0 --metric-t0 0.7 --event 0.7:freq:50.5 --event 0.7:phase:10" },
+};
+
+#define N_SCENARIOS     (sizeof(scenarios) / sizeof(scenarios[0]))
+
+typedef struct {
+    SimGain_t gain;
+    const char *macro;          // config.h name
+    double lo, hi;              // Bounds
+} TuneParam_t;
+
+static const TuneParam_t params[TUNE_N_PARAMS] = {
+    { SIM_GAIN_CURRENT_KP, "CURRENT_KP",      0.05,   10.0  },
+    { SIM_GAIN_CURRENT_KR, "CURRENT_KR",      1.0,    2000.0 },
+    { SIM_GAIN_CURRENT_WC, "CURRENT_OMEGA_C", 1.0,    100.0 },
+    { SIM_GAIN_PLL_KP,     "PLL_KP",          10.0,   1000.0 },
+    { SIM_GAIN_PLL_KI,     "PLL_KI",          500.0,  100000.0 },
+    { SIM_GAIN_AD_K,       "LCL_AD_GAIN",     0.1,    8.0   },
+};
+
+/* Normalised metrics of one scenario, in score order */
+typedef enum {
+    M_RISE = 0, M_OVERSHOOT, M_SETTLE, M_RIPPLE, M_THD, M_IAE, M_PLL_IAE, M_COUNT
+} TuneMetric_t;
+
+static const char *const metric_names[M_COUNT] = {
+    "rise_ms", "overshoot_pct", "settle_ms", "id_err_rms_A", "thd_pct", "iae_dq_As", "pll_iae_Hzs"
+};
+
+/* ============================================================================
+ * PRIVATE VARIABLES
+ * ========================================================================== */
+static struct {
+    uint32_t threads;
+    uint32_t max_evals;
+    double lgrid[TUNE_MAX_GRIDS];
+    uint32_t n_grids;
+    double w_bw, w_os, w_ripple, w_dist;
+
+    SweepJob_t *jobs;           // Candidates × scenarios × grids
+    uint32_t n_per_cand;
+    double ref[N_SCENARIOS * TUNE_MAX_GRIDS][M_COUNT];     // Defaults' metrics
+    uint32_t evals;
+} tune;
+
+/* ============================================================================
+ * EVALUATION
+ * ========================================================================== */
+static double Clamp(double x, double lo, double hi)
+{
+    return (x < lo) ? lo : (x > hi) ? hi : x;
+}
+
+static void ToGains(const double *x, float *gain)
+{
+    for (uint32_t p = 0; p < TUNE_N_PARAMS; p++) {
+        gain[p] = (float)pow(10.0, Clamp(x[p], log10(params[p].lo), log10(params[p].hi)));
+    }
+}
+
+static bool BuildJob(SweepJob_t *job, uint32_t s, uint32_t g, const float *gain)
+{
+    char opts[256];
+
+    memset(job, 0, sizeof(*job));
+    Sim_DefaultConfig(&job->cfg);
+    snprintf(job->name, SWEEP_NAME_LEN, "%s/lgrid=%g", scenarios[s].name, tune.lgrid[g]);
+    job->cfg.plant.L_grid = tune.lgrid[g];
+
+    snprintf(opts, sizeof(opts), "%s", scenarios[s].opts);
+    char *opt = strtok(opts, " ");
+    while (opt != NULL) {
+        char *val = strtok(NULL, " ");
+        if (val == NULL || !Sim_ParseOption(&job->cfg, opt, val)) return false;
+        opt = strtok(NULL, " ");
+    }
+
+    if (gain != NULL) {
+        for (uint32_t p = 0; p < TUNE_N_PARAMS; p++) {
+            job->cfg.gain[params[p].gain] = gain[p];
+            job->cfg.gain_set |= 1U << params[p].gain;
+        }
+    }
+    return true;
+}
+
+static void Metrics(const SweepJob_t *job, double *m)
+{
+    m[M_RISE] = job->res.rise_ms;
+    m[M_OVERSHOOT] = job->res.overshoot_pct;
+    m[M_SETTLE] = job->res.settle_ms;
+    m[M_RIPPLE] = job->res.id_err_rms;
+    m[M_THD] = job->res.thd_pct;
+    m[M_IAE] = job->res.iae_dq;
+    m[M_PLL_IAE] = job->res.pll_iae;
+}
+
+static bool Feasible(const SweepJob_t *job, TuneRole_t role)
+{
+    const SimResult_t *r = &job->res;
+
+    if (job->rc != 0 || r->trip_count != 0U) return false;
+    if (r->final_state != STATE_RUN_INVERTER && r->final_state != STATE_RUN_RECTIFIER) return false;
+    if (!(r->id_err_rms <= TUNE_RIPPLE_MAX_A) || !(r->thd_pct <= TUNE_THD_MAX_PCT)) return false;
+    if (role == ROLE_STEP && (isnan(r->rise_ms) || isnan(r->settle_ms))) return false;
+    return true;
+}
+
+/* Metric relative to the config.h gains (guarded against a zero reference) */
+static double Ratio(double v, double ref)
+{
+    return v / fmax(ref, 1e-9);
+}
+
+static double Score(const SweepJob_t *jobs)
+{
+    double score = 0.0, wsum = 0.0;
+    uint32_t infeasible = 0;
+
+    for (uint32_t k = 0; k < tune.n_per_cand; k++) {
+        const SweepJob_t *job = &jobs[k];
+        TuneRole_t role = scenarios[k / tune.n_grids].role;
+        double m[M_COUNT];
+
+        if (!Feasible(job, role)) {
+            infeasible++;
+            continue;
+        }
+        Metrics(job, m);
+        const double *ref = tune.ref[k];
+
+        score += tune.w_ripple * 0.5 * (Ratio(m[M_RIPPLE], ref[M_RIPPLE]) + Ratio(m[M_THD], ref[M_THD]));
+        wsum += tune.w_ripple;
+        if (role == ROLE_STEP) {
+            score += tune.w_bw * Ratio(m[M_RISE], ref[M_RISE]);
+            score += tune.w_os * 0.5 * (Ratio(fmax(m[M_OVERSHOOT], 0.1), fmax(ref[M_OVERSHOOT], 0.1)) +
+                                        Ratio(m[M_SETTLE], ref[M_SETTLE]));
+            wsum += tune.w_bw + tune.w_os;
+        } else {
+            score += tune.w_dist * 0.5 * (Ratio(m[M_IAE], ref[M_IAE]) + Ratio(m[M_PLL_IAE], ref[M_PLL_IAE]));
+            wsum += tune.w_dist;
+        }
+    }
+    /* Weighted mean of ratios; each infeasible scenario outranks any feasible set */
+    return ((wsum > 0.0) ? score / wsum : 0.0) + TUNE_INFEASIBLE * infeasible;
+}
+
+/* Evaluates n candidates in one batch: every scenario of every candidate
+ * is an independent job on the pool */
+static int Evaluate(double (*x)[TUNE_N_PARAMS], uint32_t n, double *f)
+{
+    uint32_t per = tune.n_per_cand;
+
+    for (uint32_t c = 0; c < n; c++) {
+        float gain[TUNE_N_PARAMS];
+        ToGains(x[c], gain);
+        for (uint32_t k = 0; k < per; k++) {
+            if (!BuildJob(&tune.jobs[c * per + k], k / tune.n_grids, k % tune.n_grids, gain)) return -1;
+        }
+    }
+    if (Sweep_Run(tune.jobs, n * per, tune.threads, NULL) == -1) return -1;
+
+    for (uint32_t c = 0; c < n; c++) {
+        f[c] = Score(&tune.jobs[c * per]);
+        tune.evals++;
+    }
+    return 0;
+}
+
+/* ============================================================================
+ * NELDER-MEAD
+ * ========================================================================== */
+static void Blend(const double *a, const double *b, double t, double *out)
+{
+    /* out = a + t (b - a) */
+    for (uint32_t p = 0; p < TUNE_N_PARAMS; p++) out[p] = a[p] + t * (b[p] - a[p]);
+}
+
+static void Sort(double (*x)[TUNE_N_PARAMS], double *f, uint32_t n)
+{
+    for (uint32_t i = 1; i < n; i++) {
+        double fi = f[i], xi[TUNE_N_PARAMS];
+        memcpy(xi, x[i], sizeof(xi));
+        uint32_t j = i;
+        while (j > 0 && f[j - 1] > fi) {
+            f[j] = f[j - 1];
+            memcpy(x[j], x[j - 1], sizeof(xi));
+            j--;
+        }
+        f[j] = fi;
+        memcpy(x[j], xi, sizeof(xi));
+    }
+}
+
+static int NelderMead(double *best, double *f_best)
+{
+    enum { N = TUNE_N_PARAMS };
+    double x[N + 1][N], f[N + 1];
+    double c[N], t[4][N], ft[4];
+
+    for (uint32_t i = 0; i <= N; i++) {
+        memcpy(x[i], best, sizeof(x[i]));
+        if (i > 0) x[i][i - 1] += TUNE_INIT_STEP;
+    }
+    if (Evaluate(x, N + 1, f) != 0) return -1;
+
+    while (tune.evals < tune.max_evals) {
+        Sort(x, f, N + 1);
+
+        double size = 0.0;
+        for (uint32_t i = 1; i <= N; i++) {
+            for (uint32_t p = 0; p < N; p++) size = fmax(size, fabs(x[i][p] - x[0][p]));
+        }
+        printf("eval %4u  best %.4f  worst %.4f  size %.3f\n",
+               (unsigned)tune.evals, f[0], f[N], size);
+        if (f[N] - f[0] < TUNE_TOL_F && size < TUNE_TOL_X) break;
+
+        /* Centroid of all but the worst */
+        memset(c, 0, sizeof(c));
+        for (uint32_t i = 0; i < N; i++) {
+            for (uint32_t p = 0; p < N; p++) c[p] += x[i][p] / N;
+        }
+
+        /* Reflection */
+        Blend(c, x[N], -1.0, t[0]);
+        if (Evaluate(&t[0], 1, &ft[0]) != 0) return -1;
+
+        if (ft[0] < f[0]) {
+            /* Expansion */
+            Blend(c, x[N], -2.0, t[1]);
+            if (Evaluate(&t[1], 1, &ft[1]) != 0) return -1;
+            uint32_t k = (ft[1] < ft[0]) ? 1U : 0U;
+            memcpy(x[N], t[k], sizeof(x[N]));
+            f[N] = ft[k];
+        } else if (ft[0] < f[N - 1]) {
+            memcpy(x[N], t[0], sizeof(x[N]));
+            f[N] = ft[0];
+        } else {
+            /* Contraction: outside if the reflection beat the worst, else inside */
+            bool outside = ft[0] < f[N];
+            Blend(c, x[N], outside ? -0.5 : 0.5, t[2]);
+            if (Evaluate(&t[2], 1, &ft[2]) != 0) return -1;
+            if (ft[2] < (outside ? ft[0] : f[N])) {
+                memcpy(x[N], t[2], sizeof(x[N]));
+                f[N] = ft[2];
+            } else {
+                /* Shrink towards the best, evaluated as one batch */
+                for (uint32_t i = 1; i <= N; i++) Blend(x[0], x[i], 0.5, x[i]);
+                if (Evaluate(&x[1], N, &f[1]) != 0) return -1;
+            }
+        }
+    }
+
+    Sort(x, f, N + 1);
+    memcpy(best, x[0], sizeof(x[0]));
+    *f_best = f[0];
+    return 0;
+}
+
+/* ============================================================================
+ * OUTPUT
+ * ========================================================================== */
+static void PrintTable(const char *title, const SweepJob_t *jobs)
+{
+    printf("\n%s\n%-24s", title, "scenario");
+    for (uint32_t m = 0; m < M_COUNT; m++) printf(" %13s", metric_names[m]);
+    printf("\n");
+    for (uint32_t k = 0; k < tune.n_per_cand; k++) {
+        double m[M_COUNT];
+        Metrics(&jobs[k], m);
+        printf("%-24s", jobs[k].name);
+        for (uint32_t i = 0; i < M_COUNT; i++) printf(" %13.4g", m[i]);
+        printf("%s\n", Feasible(&jobs[k], scenarios[k / tune.n_grids].role) ? "" : "  infeasible");
+    }
+}
+
+static int WriteHeader(const char *path, const float *gain, double score)
+{
+    char date[16];
+    time_t now = time(NULL);
+    FILE *f = fopen(path, "w");
+
+    if (f == NULL) return -1;
+    strftime(date, sizeof(date), "%Y-%m", gmtime(&now));
+
+    fprintf(f, "/**\n");
+    fprintf(f, " * @file config_tuned.h\n");
+    fprintf(f, " * @brief Tuned Control Gains (generated by fwtune, do not edit)\n");
+    fprintf(f, " * @version %d.%d\n", FW_VERSION_MAJOR, FW_VERSION_MINOR);
+    fprintf(f, " * @date %s\n", date);
+    fprintf(f, " *\n");
+    fprintf(f, " * Score %.4f (config.h defaults = 1.0000) after %u evaluations.\n",
+            score, (unsigned)tune.evals);
+    fprintf(f, " * Filter: LC %.0f uH, CF %.1f uF, LG %.0f uH. Grid L:",
+            LC_INDUCTANCE_H * 1e6, CF_CAPACITANCE_F * 1e6, LG_INDUCTANCE_H * 1e6);
+    for (uint32_t g = 0; g < tune.n_grids; g++) fprintf(f, " %g", tune.lgrid[g]);
+    fprintf(f, " H.\n * Scenarios:");
+    for (uint32_t s = 0; s < N_SCENARIOS; s++) fprintf(f, " %s", scenarios[s].name);
+    fprintf(f, ". Weights: bw %g, os %g, ripple %g, dist %g.\n",
+            tune.w_bw, tune.w_os, tune.w_ripple, tune.w_dist);
+    fprintf(f, " * Used with -DCONTROL_TUNED_GAINS=1 (see config.h).\n");
+    fprintf(f, " */\n\n");
+    fprintf(f, "#ifndef __CONFIG_TUNED_H\n#define __CONFIG_TUNED_H\n\n");
+    for (uint32_t p = 0; p < TUNE_N_PARAMS; p++) {
+        fprintf(f, "#define %-23s %#.6gf\n", params[p].macro, (double)gain[p]);
+    }
+    fprintf(f, "\n#endif /* __CONFIG_TUNED_H */\n");
+
+    return (fclose(f) == 0) ? 0 : -1;
+}
+
+/* ============================================================================
+ * MAIN
+ * ========================================================================== */
+static void Usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [--jobs n] [--max-evals n] [--lgrid H,H] [--w-bw w] [--w-os w] "
+                    "[--w-ripple w] [--w-dist w] [--out file.h]\n", prog);
+}
+
+static bool ParseGrids(const char *v)
+{
+    char buf[128];
+
+    snprintf(buf, sizeof(buf), "%s", v);
+    tune.n_grids = 0;
+    for (char *t = strtok(buf, ","); t != NULL; t = strtok(NULL, ",")) {
+        if (tune.n_grids == TUNE_MAX_GRIDS) return false;
+        tune.lgrid[tune.n_grids] = atof(t);
+        if (!(tune.lgrid[tune.n_grids] > 0.0)) return false;
+        tune.n_grids++;
+    }
+    return tune.n_grids > 0;
+}
+
+int main(int argc, char **argv)
+{
+    const char *out_path = "Inc/config_tuned.h";
+    double x[TUNE_N_PARAMS], f_best;
+    float gain[TUNE_N_PARAMS];
+
+    tune.threads = Sweep_CpuCount();
+    tune.max_evals = 150;
+    tune.w_bw = tune.w_os = tune.w_ripple = tune.w_dist = 1.0;
+    ParseGrids("250e-6,1e-3");
+
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        const char *v = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+        if (v == NULL) { Usage(argv[0]); return 1; }
+        i++;
+
+        if (strcmp(a, "--jobs") == 0)               tune.threads = (uint32_t)strtoul(v, NULL, 0);
+        else if (strcmp(a, "--max-evals") == 0)     tune.max_evals = (uint32_t)strtoul(v, NULL, 0);
+        else if (strcmp(a, "--w-bw") == 0)          tune.w_bw = atof(v);
+        else if (strcmp(a, "--w-os") == 0)          tune.w_os = atof(v);
+        else if (strcmp(a, "--w-ripple") == 0)      tune.w_ripple = atof(v);
+        else if (strcmp(a, "--w-dist") == 0)        tune.w_dist = atof(v);
+        else if (strcmp(a, "--out") == 0)           out_path = v;
+        else if (strcmp(a, "--lgrid") == 0) {
+            if (!ParseGrids(v)) { fprintf(stderr, "bad --lgrid '%s'\n", v); return 1; }
+        }
+        else { Usage(argv[0]); return 1; }
+    }
+    if (tune.threads == 0U) { Usage(argv[0]); return 1; }
+
+#if REF_TRAJECTORY_ENABLE
+    /* The step scenario would measure the P ramp, not the current loop */
+    fprintf(stderr, "build fwtune with -DREF_TRAJECTORY_ENABLE=0 (step references)\n");
+    return 1;
+#endif
+    tune.n_per_cand = (uint32_t)N_SCENARIOS * tune.n_grids;
+    tune.jobs = (SweepJob_t *)calloc((size_t)tune.n_per_cand * (TUNE_N_PARAMS + 1U), sizeof(SweepJob_t));
+    if (tune.jobs == NULL) return 1;
+
+    /* Reference: hand-set gains from config.h */
+    for (uint32_t k = 0; k < tune.n_per_cand; k++) {
+        if (!BuildJob(&tune.jobs[k], k / tune.n_grids, k % tune.n_grids, NULL)) return 1;
+    }
+    if (Sweep_Run(tune.jobs, tune.n_per_cand, tune.threads, NULL) == -1) return 1;
+    PrintTable("config.h gains", tune.jobs);
+    for (uint32_t k = 0; k < tune.n_per_cand; k++) {
+        if (!Feasible(&tune.jobs[k], scenarios[k / tune.n_grids].role)) {
+            fprintf(stderr, "%s: infeasible with the config.h gains, no reference\n", tune.jobs[k].name);
+            return 1;
+        }
+        Metrics(&tune.jobs[k], tune.ref[k]);
+    }
+
+    printf("\n%u scenarios per candidate, %u threads\n", (unsigned)tune.n_per_cand, (unsigned)tune.threads);
+    for (uint32_t p = 0; p < TUNE_N_PARAMS; p++) {
+        x[p] = log10(Sim_GainValue(&tune.jobs[0].cfg, params[p].gain));
+    }
+    if (NelderMead(x, &f_best) != 0) {
+        fprintf(stderr, "evaluation failed\n");
+        return 1;
+    }
+
+    /* Re-run the winner for the report */
+    ToGains(x, gain);
+    for (uint32_t k = 0; k < tune.n_per_cand; k++) {
+        BuildJob(&tune.jobs[k], k / tune.n_grids, k % tune.n_grids, gain);
+    }
+    Sweep_Run(tune.jobs, tune.n_per_cand, tune.threads, NULL);
+    PrintTable("tuned gains", tune.jobs);
+
+    printf("\nscore %.4f (config.h = 1.0000), %u evaluations\n", f_best, (unsigned)tune.evals);
+    for (uint32_t p = 0; p < TUNE_N_PARAMS; p++) {
+        printf("%-16s %12.6g  (config.h %g)\n", params[p].macro, (double)gain[p],
+               (double)Sim_GainValue(&(SimConfig_t){ 0 }, params[p].gain));
+    }
+
+    if (f_best >= 1.0) {
+        printf("no improvement over config.h, %s not written\n", out_path);
+        free(tune.jobs);
+        return 2;
+    }
+    if (WriteHeader(out_path, gain, f_best) != 0) {
+        perror(out_path);
+        free(tune.jobs);
+        return 1;
+    }
+    printf("wrote %s\n", out_path);
+    free(tune.jobs);
+    return 0;
+}
@@ -0,0 +1,86 @@
+#!/usr/bin/env python3
+"""
+Report the first divergence between two replays of the same recording.
+
+Both CSVs come from `fwsim --replay rec.bin --replay-out x.csv`, usually
+built from two firmware versions. Rows are matched by frame index and
+compared as text: the replay prints floats with %.9g, so equal text means
+bit-identical values.
+
+Usage:
+    replay_diff.py a.csv b.csv [--context 3] [--ignore freq --ignore theta]
+Exit status 0 = identical, 1 = divergence, 2 = incompatible replays.
+"""
+
+import argparse
+import csv
+import sys
+
+
+def load(path):
+    with open(path, newline="") as f:
+        reader = csv.reader(f)
+        header = next(reader)
+        rows = {int(row[0]): row for row in reader}
+    return header, rows
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.split("\n")[1])
+    ap.add_argument("a")
+    ap.add_argument("b")
+    ap.add_argument("--context", type=int, default=3, help="rows printed after the divergence")
+    ap.add_argument("--ignore", action="append", default=[], help="column excluded from comparison")
+    args = ap.parse_args()
+
+    h_a, a = load(args.a)
+    h_b, b = load(args.b)
+    if h_a[0] != "frame" or h_b[0] != "frame":
+        print("incompatible replays: no frame column", file=sys.stderr)
+        return 2
+
+    common = [c for c in h_a if c in h_b and c != "frame" and c not in args.ignore]
+    ia = {c: h_a.index(c) for c in common}
+    ib = {c: h_b.index(c) for c in common}
+    for c in h_a:
+        if c not in h_b:
+            print(f"note: column '{c}' only in {args.a}")
+    for c in h_b:
+        if c not in h_a:
+            print(f"note: column '{c}' only in {args.b}")
+
+    frames = sorted(set(a) & set(b))
+    if not frames:
+        print("incompatible replays: no common frames", file=sys.stderr)
+        return 2
+    if len(frames) != len(a) or len(frames) != len(b):
+        print(f"note: {len(a)} / {len(b)} frames, comparing {len(frames)} common")
+
+    diverged = 0
+    first = None
+    for n in frames:
+        cols = [c for c in common if a[n][ia[c]] != b[n][ib[c]]]
+        if cols:
+            diverged += 1
+            if first is None:
+                first = (n, cols)
+
+    if first is None:
+        print(f"identical: {len(frames)} frames, {len(common)} columns")
+        return 0
+
+    n0, cols = first
+    print(f"first divergence at frame {n0}: {', '.join(cols)}")
+    print(f"{diverged} of {len(frames)} frames differ")
+    print(f"{'frame':>10} {'column':<10} {args.a:>20} {args.b:>20}")
+    shown = [n for n in frames if n >= n0][:args.context + 1]
+    for n in shown:
+        for c in common:
+            va, vb = a[n][ia[c]], b[n][ib[c]]
+            if va != vb:
+                print(f"{n:>10} {c:<10} {va:>20} {vb:>20}")
+    return 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,110 @@
+#!/usr/bin/env python3
+"""
+Read the columnar results file written by fwsweep.
+
+Format (little endian): "SWPC", u32 version, u32 rows, u32 columns, then
+per column: u8 type ('f' f64, 'u' u32, 's' string), u8 name length, name,
+and the values of all rows ('s': u8 length + bytes each).
+
+Usage:
+    sweep_read.py sweep.col                         # table of all columns
+    sweep_read.py sweep.col --cols name,thd_pct,settle_ms --sort thd_pct
+    sweep_read.py sweep.col --where "trip_count>0" --csv tripped.csv
+As a module: load(path) returns {column name: list of values}.
+"""
+
+import argparse
+import csv
+import math
+import struct
+import sys
+
+MAGIC = b"SWPC"
+VERSION = 1
+
+
+def load(path):
+    with open(path, "rb") as f:
+        data = f.read()
+    if data[:4] != MAGIC:
+        raise ValueError(f"{path}: not a sweep results file")
+    version, rows, ncols = struct.unpack_from("<III", data, 4)
+    if version != VERSION:
+        raise ValueError(f"{path}: format version {version}, expected {VERSION}")
+
+    pos = 16
+    cols = {}
+    for _ in range(ncols):
+        ctype = chr(data[pos])
+        nlen = data[pos + 1]
+        name = data[pos + 2:pos + 2 + nlen].decode()
+        pos += 2 + nlen
+        if ctype == "f":
+            cols[name] = list(struct.unpack_from(f"<{rows}d", data, pos))
+            pos += 8 * rows
+        elif ctype == "u":
+            cols[name] = list(struct.unpack_from(f"<{rows}I", data, pos))
+            pos += 4 * rows
+        elif ctype == "s":
+            vals = []
+            for _ in range(rows):
+                slen = data[pos]
+                vals.append(data[pos + 1:pos + 1 + slen].decode())
+                pos += 1 + slen
+            cols[name] = vals
+        else:
+            raise ValueError(f"{path}: unknown column type '{ctype}'")
+    return cols
+
+
+def fmt(v):
+    if isinstance(v, float):
+        return "nan" if math.isnan(v) else f"{v:.6g}"
+    return str(v)
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.split("\n")[1])
+    ap.add_argument("path")
+    ap.add_argument("--cols", help="comma-separated columns to show")
+    ap.add_argument("--sort", help="sort rows by this column (NaN last)")
+    ap.add_argument("--where", help="row filter, Python expression over column names")
+    ap.add_argument("--csv", help="write the selection as CSV instead of printing")
+    args = ap.parse_args()
+
+    try:
+        cols = load(args.path)
+    except (OSError, ValueError, struct.error) as e:
+        print(e, file=sys.stderr)
+        return 1
+
+    names = args.cols.split(",") if args.cols else list(cols)
+    for n in names:
+        if n not in cols:
+            print(f"no column '{n}'", file=sys.stderr)
+            return 1
+
+    n_rows = len(next(iter(cols.values()))) if cols else 0
+    rows = [{n: cols[n][i] for n in cols} for i in range(n_rows)]
+    if args.where:
+        rows = [r for r in rows if eval(args.where, {"math": math}, dict(r))]
+    if args.sort:
+        rows.sort(key=lambda r: (isinstance(r[args.sort], float) and math.isnan(r[args.sort]), r[args.sort]))
+
+    if args.csv:
+        with open(args.csv, "w", newline="") as f:
+            w = csv.writer(f)
+            w.writerow(names)
+            for r in rows:
+                w.writerow([fmt(r[n]) for n in names])
+        return 0
+
+    table = [names] + [[fmt(r[n]) for n in names] for r in rows]
+    widths = [max(len(t[i]) for t in table) for i in range(len(names))]
+    for t in table:
+        print("  ".join(v.ljust(w) for v, w in zip(t, widths)).rstrip())
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
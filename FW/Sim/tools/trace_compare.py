@@ -0,0 +1,85 @@
+#!/usr/bin/env python3
+"""
+Compare a simulator waveform trace against a golden reference.
+
+Rows are matched by index (both traces must come from the same t_end and
+decimation). Discrete columns (state, faults) must match exactly; analog
+columns pass when max|a - b| <= abs_tol + rel_tol * max|ref|.
+
+Usage:
+    trace_compare.py golden.csv new.csv [--abs 1.0] [--rel 0.01]
+                     [--tol Id=0.5 --tol Vdc=2.0] [--from 0.5]
+Exit status 0 = match, 1 = regression, 2 = incompatible traces.
+"""
+
+import argparse
+import csv
+import sys
+
+DISCRETE = ("state", "faults")
+
+
+def load(path):
+    with open(path, newline="") as f:
+        reader = csv.reader(f)
+        header = next(reader)
+        cols = {name: [] for name in header}
+        for row in reader:
+            for name, value in zip(header, row):
+                cols[name].append(float(value))
+    return header, cols
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.split("\n")[1])
+    ap.add_argument("golden")
+    ap.add_argument("new")
+    ap.add_argument("--abs", type=float, default=1.0, help="absolute tolerance")
+    ap.add_argument("--rel", type=float, default=0.01, help="tolerance relative to max|golden|")
+    ap.add_argument("--tol", action="append", default=[], help="per-column absolute tolerance, name=value")
+    ap.add_argument("--from", dest="t_from", type=float, default=0.0, help="ignore rows before this time [s]")
+    args = ap.parse_args()
+
+    per_col = {}
+    for spec in args.tol:
+        name, value = spec.split("=", 1)
+        per_col[name] = float(value)
+
+    h_ref, ref = load(args.golden)
+    h_new, new = load(args.new)
+    if h_ref != h_new or len(ref["t"]) != len(new["t"]):
+        print("incompatible traces: columns or length differ", file=sys.stderr)
+        return 2
+
+    rows = [i for i, t in enumerate(ref["t"]) if t >= args.t_from]
+    failed = False
+    print(f"{'column':<10} {'max|diff|':>12} {'at t':>12} {'limit':>10}")
+
+    for name in h_ref:
+        if name == "t":
+            continue
+        a, b = ref[name], new[name]
+        worst, worst_i = 0.0, rows[0] if rows else 0
+        for i in rows:
+            d = abs(a[i] - b[i])
+            if d > worst:
+                worst, worst_i = d, i
+
+        if name in DISCRETE:
+            limit = 0.0
+        elif name in per_col:
+            limit = per_col[name]
+        else:
+            peak = max((abs(a[i]) for i in rows), default=0.0)
+            limit = args.abs + args.rel * peak
+
+        bad = worst > limit
+        failed |= bad
+        flag = "  FAIL" if bad else ""
+        print(f"{name:<10} {worst:12.4f} {ref['t'][worst_i]:12.6f} {limit:10.4f}{flag}")
+
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,178 @@
+/**
+ * @file adc.c
+ * @brief ADC Driver for Current, Voltage, and Temperature Sensing
+ * @version 2.1
+ * @date 2025-12
+ *
+ * Channel allocation:
+ *   ADC1 injected (HRTIM trigger): IA, IB, IC, IDC
+ *   ADC2 injected (HRTIM trigger): VA, VB, VC, VDC
+ *   ADC1 regular (continuous, DMA): VDC_NEG, NTC heatsink, NTC inductor
+ * Both injected sequences are triggered by the HRTIM master period event
+ * that also raises the control ISR, so all currents and voltages of a
+ * control period are sampled at the same carrier crest/valley.
+ *
+ * Only acquisition lives here; conversion is in adc_conv.c.
+ */
+
+#include "adc.h"
+#include "main.h"
+#include "config.h"
+
+/* ============================================================================
+ * CONSTANTS
+ * ========================================================================== */
+#define ADC_REGULAR_COUNT       3
+#define ADC_INJ_TIMEOUT         200         // Polls before giving up (~1 µs)
+
+/* ============================================================================
+ * PRIVATE VARIABLES
+ * ========================================================================== */
+static ADC_HandleTypeDef *adc_i;            // ADC1: currents
+static ADC_HandleTypeDef *adc_v;            // ADC2: voltages
+static DMA_HandleTypeDef hdma_adc1;
+static volatile uint16_t regular_buf[ADC_REGULAR_COUNT];
+
+/* ============================================================================
+ * PRIVATE HELPERS
+ * ========================================================================== */
+static void ConfigureCommon(ADC_HandleTypeDef *hadc, ADC_TypeDef *instance, bool regular)
+{
+    hadc->Instance = instance;
+    hadc->Init.ClockPrescaler = ADC_CLOCK_SYNC_PCLK_DIV4;
+    hadc->Init.Resolution = ADC_RESOLUTION_12B;
+    hadc->Init.DataAlign = ADC_DATAALIGN_RIGHT;
+    hadc->Init.GainCompensation = 0;
+    hadc->Init.ScanConvMode = ADC_SCAN_ENABLE;
+    hadc->Init.EOCSelection = ADC_EOC_SEQ_CONV;
+    hadc->Init.LowPowerAutoWait = DISABLE;
+    hadc->Init.ContinuousConvMode = regular ? ENABLE : DISABLE;
+    hadc->Init.NbrOfConversion = regular ? ADC_REGULAR_COUNT : 1;
+    hadc->Init.DiscontinuousConvMode = DISABLE;
+    hadc->Init.ExternalTrigConv = ADC_SOFTWARE_START;
+    hadc->Init.DMAContinuousRequests = regular ? ENABLE : DISABLE;
+    hadc->Init.Overrun = ADC_OVR_DATA_OVERWRITTEN;
+    hadc->Init.OversamplingMode = DISABLE;
+    if (HAL_ADC_Init(hadc) != HAL_OK) {
+        Error_Handler();
+    }
+}
+
+static void ConfigureInjected(ADC_HandleTypeDef *hadc, const uint32_t channel[4])
+{
+    ADC_InjectionConfTypeDef inj = {0};
+    static const uint32_t rank[4] = {
+        ADC_INJECTED_RANK_1, ADC_INJECTED_RANK_2, ADC_INJECTED_RANK_3, ADC_INJECTED_RANK_4
+    };
+
+    inj.InjectedSamplingTime = ADC_SAMPLETIME_6CYCLES_5;
+    inj.InjectedSingleDiff = ADC_SINGLE_ENDED;
+    inj.InjectedOffsetNumber = ADC_OFFSET_NONE;
+    inj.InjectedNbrOfConversion = 4;
+    inj.InjectedDiscontinuousConvMode = DISABLE;
+    inj.AutoInjectedConv = DISABLE;
+    inj.QueueInjectedContext = DISABLE;
+    inj.ExternalTrigInjecConv = ADC_EXTERNALTRIGINJEC_HRTIM_TRG2;
+    inj.ExternalTrigInjecConvEdge = ADC_EXTERNALTRIGINJECCONV_EDGE_RISING;
+    inj.InjecOversamplingMode = DISABLE;
+
+    for (uint32_t i = 0; i < 4; i++) {
+        inj.InjectedChannel = channel[i];
+        inj.InjectedRank = rank[i];
+        if (HAL_ADCEx_InjectedConfigChannel(hadc, &inj) != HAL_OK) {
+            Error_Handler();
+        }
+    }
+}
+
+/* ============================================================================
+ * INITIALIZATION
+ * ========================================================================== */
+void ADC_Init(ADC_HandleTypeDef *hadc1, ADC_HandleTypeDef *hadc2)
+{
+    static const uint32_t ch_i[4] = { ADC_IA_CHANNEL, ADC_IB_CHANNEL, ADC_IC_CHANNEL, ADC_IDC_CHANNEL };
+    static const uint32_t ch_v[4] = { ADC_VA_CHANNEL, ADC_VB_CHANNEL, ADC_VC_CHANNEL, ADC_VDC_CHANNEL };
+    static const uint32_t ch_r[ADC_REGULAR_COUNT] = { ADC_VDC_NEG_CHANNEL, ADC_TEMP1_CHANNEL, ADC_TEMP2_CHANNEL };
+    static const uint32_t rank_r[ADC_REGULAR_COUNT] = { ADC_REGULAR_RANK_1, ADC_REGULAR_RANK_2, ADC_REGULAR_RANK_3 };
+    ADC_ChannelConfTypeDef reg = {0};
+
+    adc_i = hadc1;
+    adc_v = hadc2;
+
+    __HAL_RCC_ADC12_CLK_ENABLE();
+    __HAL_RCC_DMAMUX1_CLK_ENABLE();
+    __HAL_RCC_DMA1_CLK_ENABLE();
+
+    ConfigureCommon(hadc1, ADC1, true);
+    ConfigureCommon(hadc2, ADC2, false);
+
+    /* Regular sequence: slow channels, long sampling for the dividers */
+    reg.SamplingTime = ADC_SAMPLETIME_92CYCLES_5;
+    reg.SingleDiff = ADC_SINGLE_ENDED;
+    reg.OffsetNumber = ADC_OFFSET_NONE;
+    for (uint32_t i = 0; i < ADC_REGULAR_COUNT; i++) {
+        reg.Channel = ch_r[i];
+        reg.Rank = rank_r[i];
+        if (HAL_ADC_ConfigChannel(hadc1, &reg) != HAL_OK) {
+            Error_Handler();
+        }
+    }
+
+    ConfigureInjected(hadc1, ch_i);
+    ConfigureInjected(hadc2, ch_v);
+
+    /* Circular DMA for the regular results */
+    hdma_adc1.Instance = DMA1_Channel1;
+    hdma_adc1.Init.Request = DMA_REQUEST_ADC1;
+    hdma_adc1.Init.Direction = DMA_PERIPH_TO_MEMORY;
+    hdma_adc1.Init.PeriphInc = DMA_PINC_DISABLE;
+    hdma_adc1.Init.MemInc = DMA_MINC_ENABLE;
+    hdma_adc1.Init.PeriphDataAlignment = DMA_PDATAALIGN_HALFWORD;
+    hdma_adc1.Init.MemDataAlignment = DMA_MDATAALIGN_HALFWORD;
+    hdma_adc1.Init.Mode = DMA_CIRCULAR;
+    hdma_adc1.Init.Priority = DMA_PRIORITY_LOW;
+    if (HAL_DMA_Init(&hdma_adc1) != HAL_OK) {
+        Error_Handler();
+    }
+    __HAL_LINKDMA(hadc1, DMA_Handle, hdma_adc1);
+
+    HAL_ADCEx_Calibration_Start(hadc1, ADC_SINGLE_ENDED);
+    HAL_ADCEx_Calibration_Start(hadc2, ADC_SINGLE_ENDED);
+}
+
+/* ============================================================================
+ * START CONVERSIONS
+ * ========================================================================== */
+void ADC_Start(ADC_HandleTypeDef *hadc1, ADC_HandleTypeDef *hadc2)
+{
+    HAL_ADC_Start_DMA(hadc1, (uint32_t *)regular_buf, ADC_REGULAR_COUNT);
+    HAL_ADCEx_InjectedStart(hadc1);
+    HAL_ADCEx_InjectedStart(hadc2);
+}
+
+/* ============================================================================
+ * RAW READ (called from control ISR)
+ * ========================================================================== */
+void ADC_GetRaw(AdcRaw_t *raw)
+{
+    ADC_TypeDef *a1 = adc_i->Instance;
+    ADC_TypeDef *a2 = adc_v->Instance;
+    uint32_t timeout = ADC_INJ_TIMEOUT;
+
+    /* Injected sequences finish ~1 µs after the trigger that raised the ISR */
+    while (((a1->ISR & a2->ISR) & ADC_ISR_JEOS) == 0U && --timeout) { }
+    a1->ISR = ADC_ISR_JEOS | ADC_ISR_JEOC;
+    a2->ISR = ADC_ISR_JEOS | ADC_ISR_JEOC;
+
+    raw->code[ADC_RAW_IA] = (uint16_t)a1->JDR1;
+    raw->code[ADC_RAW_IB] = (uint16_t)a1->JDR2;
+    raw->code[ADC_RAW_IC] = (uint16_t)a1->JDR3;
+    raw->code[ADC_RAW_IDC] = (uint16_t)a1->JDR4;
+    raw->code[ADC_RAW_VA] = (uint16_t)a2->JDR1;
+    raw->code[ADC_RAW_VB] = (uint16_t)a2->JDR2;
+    raw->code[ADC_RAW_VC] = (uint16_t)a2->JDR3;
+    raw->code[ADC_RAW_VDC] = (uint16_t)a2->JDR4;
+    raw->code[ADC_RAW_VDC_NEG] = regular_buf[0];
+    raw->code[ADC_RAW_NTC_HEATSINK] = regular_buf[1];
+    raw->code[ADC_RAW_NTC_INDUCTOR] = regular_buf[2];
+}
@@ -0,0 +1,146 @@
+/**
+ * @file adc_conv.c
+ * @brief ADC Code Conversion and Recording Hook
+ * @version 2.1
+ * @date 2025-12
+ *
+ * Hardware independent: linked unchanged into the target, the host
+ * simulator and the replay driver. Every control period follows
+ *   ADC_GetRaw -> Recorder_CaptureInput -> ADC_Convert
+ * so a recorded code stream reproduces the measurements bit for bit.
+ */
+
+#include "adc.h"
+#include "config.h"
+#include "recorder.h"
+#include <math.h>
+
+/* ============================================================================
+ * CONSTANTS
+ * ========================================================================== */
+/* Mid-scale codes of the bipolar channels (sensor offset at Vref/2) */
+#define HALL_ZERO_CODE          (HALL_OFFSET_V / ADC_VREF * ADC_MAX_VALUE)
+#define SHUNT_ZERO_CODE         (SHUNT_OFFSET_V / ADC_VREF * ADC_MAX_VALUE)
+#define VAC_ZERO_CODE           (VAC_OFFSET_V / ADC_VREF * ADC_MAX_VALUE)
+
+#define CAL_SAMPLES             64
+#define CAL_TRIM_MAX            200         // ±160 mV sensor offset
+
+/* NTC code vs temperature, NTC_TABLE_T_MIN_C in NTC_TABLE_STEP_C steps.
+ * 10k B3950 to GND, 10k to Vref: code = 4095 · R / (R + 10k) */
+static const uint16_t ntc_table[] = {
+    3996, 3955, 3900, 3830, 3740, 3629, 3495, 3337, 3156, 2955,
+    2738, 2510, 2278, 2048, 1825, 1614, 1419, 1241, 1081,  940,
+     815,  707,  613,  532,  462,  401,  350,  305,  267,  234,
+     206,  181,  160,  142,  126,  112,  100,   89,   80,   72,
+      65,
+};
+#define NTC_TABLE_SIZE          (sizeof(ntc_table) / sizeof(ntc_table[0]))
+
+/* ============================================================================
+ * READ RESULTS (called from control ISR)
+ * ========================================================================== */
+void ADC_ReadResults(DcMeasurements_t *dc, AcMeasurements_t *ac, Temperatures_t *temps)
+{
+    AdcRaw_t raw;
+
+    ADC_GetRaw(&raw);
+
+#if RECORDER_ENABLE
+    Recorder_CaptureInput(&raw);
+#endif
+
+    ADC_Convert(&raw, dc, ac, temps);
+}
+
+/* ============================================================================
+ * CONVERSION
+ * ========================================================================== */
+void ADC_Convert(const AdcRaw_t *raw, DcMeasurements_t *dc, AcMeasurements_t *ac, Temperatures_t *temps)
+{
+    const int16_t *trim = g_sys.adc_cal.i_trim;
+
+    /* AC: PCC phase voltages and converter-side currents */
+    ac->Va = ((float32_t)raw->code[ADC_RAW_VA] - VAC_ZERO_CODE) * VAC_SCALE;
+    ac->Vb = ((float32_t)raw->code[ADC_RAW_VB] - VAC_ZERO_CODE) * VAC_SCALE;
+    ac->Vc = ((float32_t)raw->code[ADC_RAW_VC] - VAC_ZERO_CODE) * VAC_SCALE;
+    ac->Ia = ((float32_t)(raw->code[ADC_RAW_IA] - trim[0]) - HALL_ZERO_CODE) * IAC_SCALE;
+    ac->Ib = ((float32_t)(raw->code[ADC_RAW_IB] - trim[1]) - HALL_ZERO_CODE) * IAC_SCALE;
+    ac->Ic = ((float32_t)(raw->code[ADC_RAW_IC] - trim[2]) - HALL_ZERO_CODE) * IAC_SCALE;
+    ac->Vab = ac->Va - ac->Vb;
+    ac->Vbc = ac->Vb - ac->Vc;
+    ac->Vca = ac->Vc - ac->Va;
+
+    /* Instantaneous power */
+    ac->Pac = ac->Va * ac->Ia + ac->Vb * ac->Ib + ac->Vc * ac->Ic;
+    ac->Qac = (ac->Vbc * ac->Ia + ac->Vca * ac->Ib + ac->Vab * ac->Ic) * 0.57735027f;
+    ac->Sac = sqrtf(ac->Pac * ac->Pac + ac->Qac * ac->Qac);
+    ac->pf = (ac->Sac > 1.0f) ? ac->Pac / ac->Sac : 1.0f;
+    ac->frequency = g_sys.pll.frequency;
+
+    /* DC: total link and lower half, battery shunt */
+    dc->Vdc = (float32_t)raw->code[ADC_RAW_VDC] * VDC_SCALE;
+    dc->Vdc_neg = (float32_t)raw->code[ADC_RAW_VDC_NEG] * VDC_SCALE;
+    dc->Vdc_pos = dc->Vdc - dc->Vdc_neg;
+    dc->Vnp = 0.5f * (dc->Vdc_pos - dc->Vdc_neg);
+    dc->Idc = ((float32_t)(raw->code[ADC_RAW_IDC] - trim[3]) - SHUNT_ZERO_CODE) * IDC_SCALE;
+    dc->Pdc = dc->Vdc * dc->Idc;
+
+    /* Temperatures (junctions are estimated from these by thermal.c) */
+    temps->T_heatsink = ADC_ConvertNtcToTemp(raw->code[ADC_RAW_NTC_HEATSINK]);
+    temps->T_inductor = ADC_ConvertNtcToTemp(raw->code[ADC_RAW_NTC_INDUCTOR]);
+}
+
+/* ============================================================================
+ * TEMPERATURE CONVERSION (table lookup, linear interpolation)
+ * ========================================================================== */
+float32_t ADC_ConvertNtcToTemp(uint16_t adc_value)
+{
+    uint32_t lo = 0, hi = NTC_TABLE_SIZE - 1;
+
+    /* Clamp to table range (open / shorted sensor reads as the limit) */
+    if (adc_value >= ntc_table[0]) return NTC_TABLE_T_MIN_C;
+    if (adc_value <= ntc_table[hi]) return NTC_TABLE_T_MIN_C + NTC_TABLE_STEP_C * (float32_t)hi;
+
+    /* Codes descend with temperature */
+    while (hi - lo > 1) {
+        uint32_t mid = (lo + hi) >> 1;
+        if (adc_value > ntc_table[mid]) hi = mid;
+        else lo = mid;
+    }
+
+    float32_t frac = (float32_t)(ntc_table[lo] - adc_value) /
+                     (float32_t)(ntc_table[lo] - ntc_table[hi]);
+    return NTC_TABLE_T_MIN_C + NTC_TABLE_STEP_C * ((float32_t)lo + frac);
+}
+
+/* ============================================================================
+ * OFFSET CALIBRATION (outputs disabled, no current flowing)
+ * ========================================================================== */
+void ADC_CalibrateOffsets(void)
+{
+    static const uint8_t ch[4] = { ADC_RAW_IA, ADC_RAW_IB, ADC_RAW_IC, ADC_RAW_IDC };
+    static const float32_t zero[4] = { HALL_ZERO_CODE, HALL_ZERO_CODE, HALL_ZERO_CODE, SHUNT_ZERO_CODE };
+    int32_t sum[4] = { 0 };
+    AdcRaw_t raw;
+
+    for (uint32_t n = 0; n < CAL_SAMPLES; n++) {
+        ADC_GetRaw(&raw);
+        for (uint32_t i = 0; i < 4; i++) {
+            sum[i] += raw.code[ch[i]];
+        }
+    }
+
+    g_sys.adc_cal.valid = true;
+    for (uint32_t i = 0; i < 4; i++) {
+        float32_t trim = (float32_t)sum[i] / CAL_SAMPLES - zero[i];
+
+        /* Larger error is a sensor fault, not an offset */
+        if (fabsf(trim) > CAL_TRIM_MAX) {
+            g_sys.adc_cal.i_trim[i] = 0;
+            g_sys.adc_cal.valid = false;
+        } else {
+            g_sys.adc_cal.i_trim[i] = (int16_t)lrintf(trim);
+        }
+    }
+}
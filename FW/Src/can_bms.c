@@ -0,0 +1,210 @@
+/**
+ * @file can_bms.c
+ * @brief CAN-FD BMS Driver (FDCAN1, RX FIFO 0 interrupt)
+ * @version 2.1
+ * @date 2025-12
+ *
+ * FDCAN1 runs at CAN_BAUDRATE nominal and CAN_FD_BAUDRATE in the data
+ * phase (bit rate switching, transmitter delay compensation on). One
+ * standard-id mask filter passes BMS_NODE_ID..+0x0F into RX FIFO 0; the
+ * global filter rejects every other standard, extended and remote frame,
+ * so the CPU never sees foreign traffic on a shared bus.
+ *
+ * The FIFO 0 new-message interrupt, at CAN_IRQ_PRIORITY below the control
+ * ISR, empties the three-element hardware FIFO into the mailbox with the
+ * HAL tick of reception. A burst of one BMS cycle (pack, limits, eight
+ * cell frames, temperatures: about 3.5 ms on the bus) therefore reaches
+ * the main loop whole instead of overflowing the FIFO between two 10 ms
+ * polls. A FIFO overrun is still counted (lost), a full mailbox too
+ * (dropped).
+ *
+ * The main loop decodes the mailbox (can_bms_frames.c) into g_sys.bms,
+ * which the control ISR only reads as whole floats.
+ */
+
+#include "can_bms.h"
+#include "main.h"
+#include "config.h"
+
+/* ============================================================================
+ * CONSTANTS
+ * Time quantum 170 MHz / 5 = 34 MHz: 68 tq per nominal bit, 17 per data
+ * bit, sample point 81 % / 82 %
+ * ========================================================================== */
+#define FDCAN_PRESCALER     5U
+#define FDCAN_TQ_HZ         (APB1_FREQ_HZ / FDCAN_PRESCALER)
+#define NOM_TQ              (FDCAN_TQ_HZ / CAN_BAUDRATE)
+#define NOM_SEG2            (NOM_TQ / 5U)
+#define NOM_SEG1            (NOM_TQ - 1U - NOM_SEG2)
+#define DATA_TQ             (FDCAN_TQ_HZ / CAN_FD_BAUDRATE)
+#define DATA_SEG2           (DATA_TQ / 5U)
+#define DATA_SEG1           (DATA_TQ - 1U - DATA_SEG2)
+
+/* DLC code → data bytes (CAN-FD) */
+static const uint8_t dlc_len[16] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 12, 16, 20, 24, 32, 48, 64 };
+
+/* ============================================================================
+ * PRIVATE VARIABLES
+ * ========================================================================== */
+static FDCAN_HandleTypeDef *can;
+static BmsMailbox_t mbox;
+static uint32_t last_heartbeat_ms;
+static uint8_t heartbeat_counter;
+
+/* ============================================================================
+ * INITIALIZATION
+ * ========================================================================== */
+void CAN_BMS_Init(FDCAN_HandleTypeDef *hfdcan)
+{
+    GPIO_InitTypeDef GPIO_InitStruct = {0};
+    RCC_PeriphCLKInitTypeDef PeriphClkInit = {0};
+    FDCAN_FilterTypeDef filter = {0};
+    
+    can = hfdcan;
+    CAN_BMS_Reset(&g_sys.bms);
+    
+    PeriphClkInit.PeriphClockSelection = RCC_PERIPHCLK_FDCAN;
+    PeriphClkInit.FdcanClockSelection = RCC_FDCANCLKSOURCE_PCLK1;
+    if (HAL_RCCEx_PeriphCLKConfig(&PeriphClkInit) != HAL_OK) {
+        Error_Handler();
+    }
+    __HAL_RCC_FDCAN_CLK_ENABLE();
+    __HAL_RCC_GPIOD_CLK_ENABLE();
+    
+    GPIO_InitStruct.Pin = CAN_TX_PIN | CAN_RX_PIN;
+    GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
+    GPIO_InitStruct.Pull = GPIO_NOPULL;
+    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_HIGH;
+    GPIO_InitStruct.Alternate = GPIO_AF9_FDCAN1;
+    HAL_GPIO_Init(CAN_TX_PORT, &GPIO_InitStruct);
+    
+    hfdcan->Instance = FDCAN1;
+    hfdcan->Init.ClockDivider = FDCAN_CLOCK_DIV1;
+    hfdcan->Init.FrameFormat = FDCAN_FRAME_FD_BRS;
+    hfdcan->Init.Mode = FDCAN_MODE_NORMAL;
+    hfdcan->Init.AutoRetransmission = ENABLE;
+    hfdcan->Init.TransmitPause = DISABLE;
+    hfdcan->Init.ProtocolException = DISABLE;
+    hfdcan->Init.NominalPrescaler = FDCAN_PRESCALER;
+    hfdcan->Init.NominalSyncJumpWidth = NOM_SEG2;
+    hfdcan->Init.NominalTimeSeg1 = NOM_SEG1;
+    hfdcan->Init.NominalTimeSeg2 = NOM_SEG2;
+    hfdcan->Init.DataPrescaler = FDCAN_PRESCALER;
+    hfdcan->Init.DataSyncJumpWidth = DATA_SEG2;
+    hfdcan->Init.DataTimeSeg1 = DATA_SEG1;
+    hfdcan->Init.DataTimeSeg2 = DATA_SEG2;
+    hfdcan->Init.StdFiltersNbr = 1;
+    hfdcan->Init.ExtFiltersNbr = 0;
+    hfdcan->Init.TxFifoQueueMode = FDCAN_TX_FIFO_OPERATION;
+    if (HAL_FDCAN_Init(hfdcan) != HAL_OK) {
+        Error_Handler();
+    }
+    
+    /* Hardware acceptance: BMS ids only, into FIFO 0 */
+    filter.IdType = FDCAN_STANDARD_ID;
+    filter.FilterIndex = 0;
+    filter.FilterType = FDCAN_FILTER_MASK;
+    filter.FilterConfig = FDCAN_FILTER_TO_RXFIFO0;
+    filter.FilterID1 = BMS_NODE_ID;
+    filter.FilterID2 = BMS_ID_FILTER_MASK;
+    if (HAL_FDCAN_ConfigFilter(hfdcan, &filter) != HAL_OK ||
+        HAL_FDCAN_ConfigGlobalFilter(hfdcan, FDCAN_REJECT, FDCAN_REJECT,
+                                     FDCAN_REJECT_REMOTE, FDCAN_REJECT_REMOTE) != HAL_OK) {
+        Error_Handler();
+    }
+    
+    /* Data phase at 2 Mbit/s needs the transceiver loop delay compensated */
+    HAL_FDCAN_ConfigTxDelayCompensation(hfdcan, FDCAN_PRESCALER * DATA_SEG1, 0);
+    HAL_FDCAN_EnableTxDelayCompensation(hfdcan);
+    
+    HAL_FDCAN_ActivateNotification(hfdcan, FDCAN_IT_RX_FIFO0_NEW_MESSAGE |
+                                   FDCAN_IT_RX_FIFO0_MESSAGE_LOST, 0);
+    HAL_NVIC_SetPriority(FDCAN1_IT0_IRQn, CAN_IRQ_PRIORITY, 0);
+    HAL_NVIC_EnableIRQ(FDCAN1_IT0_IRQn);
+    
+    if (HAL_FDCAN_Start(hfdcan) != HAL_OK) {
+        Error_Handler();
+    }
+}
+
+/* ============================================================================
+ * MAIN LOOP
+ * ========================================================================== */
+void CAN_BMS_Process(void)
+{
+    uint32_t now = HAL_GetTick();
+    
+    CAN_BMS_Drain(&mbox, &g_sys.bms, now);
+    
+    if (now - last_heartbeat_ms >= BMS_HEARTBEAT_MS) {
+        last_heartbeat_ms = now;
+        CAN_BMS_SendHeartbeat();
+    }
+}
+
+BmsData_t* CAN_BMS_GetData(void)
+{
+    return &g_sys.bms;
+}
+
+void CAN_BMS_SendHeartbeat(void)
+{
+    FDCAN_TxHeaderTypeDef header = {0};
+    uint8_t data[8];
+    uint16_t vdc = (uint16_t)(g_sys.dc.Vdc > 0.0f ? g_sys.dc.Vdc * 10.0f + 0.5f : 0.0f);
+    
+    data[0] = (uint8_t)g_sys.state;
+    data[1] = heartbeat_counter++;
+    data[2] = (uint8_t)g_sys.faults;
+    data[3] = (uint8_t)(g_sys.faults >> 8);
+    data[4] = (uint8_t)(g_sys.faults >> 16);
+    data[5] = (uint8_t)(g_sys.faults >> 24);
+    data[6] = (uint8_t)vdc;
+    data[7] = (uint8_t)(vdc >> 8);
+    
+    header.Identifier = BMS_ID_HEARTBEAT;
+    header.IdType = FDCAN_STANDARD_ID;
+    header.TxFrameType = FDCAN_DATA_FRAME;
+    header.DataLength = FDCAN_DLC_BYTES_8;
+    header.ErrorStateIndicator = FDCAN_ESI_ACTIVE;
+    header.BitRateSwitch = FDCAN_BRS_ON;
+    header.FDFormat = FDCAN_FD_CAN;
+    header.TxEventFifoControl = FDCAN_NO_TX_EVENTS;
+    header.MessageMarker = 0;
+    
+    /* A full TX FIFO (bus off, no BMS) skips this heartbeat */
+    if (HAL_FDCAN_GetTxFifoFreeLevel(can) > 0U) {
+        HAL_FDCAN_AddMessageToTxFifoQ(can, &header, data);
+    }
+}
+
+/* ============================================================================
+ * HAL CALLBACKS (FDCAN interrupt line 0)
+ * ========================================================================== */
+void HAL_FDCAN_RxFifo0Callback(FDCAN_HandleTypeDef *hfdcan, uint32_t RxFifo0ITs)
+{
+    FDCAN_RxHeaderTypeDef header;
+    BmsFrame_t frame;
+    
+    if (hfdcan != can) return;
+    if (RxFifo0ITs & FDCAN_IT_RX_FIFO0_MESSAGE_LOST) mbox.lost++;
+    
+    frame.stamp_ms = HAL_GetTick();
+    while (HAL_FDCAN_GetRxFifoFillLevel(hfdcan, FDCAN_RX_FIFO0) > 0U) {
+        if (HAL_FDCAN_GetRxMessage(hfdcan, FDCAN_RX_FIFO0, &header, frame.data) != HAL_OK) break;
+        
+        /* DLC field: code in bits 19:16 of older HAL releases, 3:0 of newer */
+        uint32_t dlc = (header.DataLength > 0xFU) ? (header.DataLength >> 16) : header.DataLength;
+        frame.id = header.Identifier;
+        frame.len = dlc_len[dlc & 0xFU];
+        CAN_BMS_Push(&mbox, &frame);
+    }
+}
+
+/* ============================================================================
+ * INTERRUPT HANDLERS
+ * ========================================================================== */
+void FDCAN1_IT0_IRQHandler(void)
+{
+    HAL_FDCAN_IRQHandler(can);
+}
@@ -0,0 +1,307 @@
+/**
+ * @file can_bms_frames.c
+ * @brief CAN-FD BMS Frame Engine (mailbox, decoding, cell-level limits)
+ * @version 2.1
+ * @date 2025-12
+ *
+ * Hardware independent: the FDCAN driver (can_bms.c) pushes stamped
+ * frames from its RX interrupt, the main loop drains them here. The same
+ * code runs in the simulator (frames from a simulated BMS in sim_hal.c)
+ * and in the host bench fwbms.
+ *
+ * The mailbox is a power-of-two ring with free-running indices: only the
+ * producer writes head and the dropped/lost counters, only the consumer
+ * writes tail, and a barrier orders the slot copy against the index
+ * update on each side. No interrupt is masked.
+ *
+ * Every decoded frame keeps its RX timestamp. The cell groups are as old
+ * as their oldest block, so one cell frame missing from every BMS cycle
+ * makes the whole group stale instead of hiding behind newer blocks.
+ *
+ * The effective limits are the BMS limits scaled by the cell margins,
+ * evaluated on every pass from the cell data as received:
+ *   charge    × taper(V_MAX - v_max) × taper(T_MAX - t_max), 0 below T_CHG_MIN
+ *   discharge × taper(v_min - V_MIN) × taper(T_MAX - t_max)
+ * A cell frame near the ceiling therefore cuts charge current at the
+ * next main-loop pass, without waiting for the BMS to recompute and send
+ * its own limit. Stale limit or cell data sets both limits to zero.
+ */
+
+#include "can_bms.h"
+#include "config.h"
+#include "arm_math.h"
+#include <string.h>
+
+#if (BMS_MAILBOX_DEPTH & (BMS_MAILBOX_DEPTH - 1)) != 0
+#error "BMS_MAILBOX_DEPTH must be a power of 2"
+#endif
+
+/* ============================================================================
+ * CONSTANTS
+ * ========================================================================== */
+#define TEMP_NONE_F     ((float32_t)BMS_TEMP_NONE)
+#define LIMIT_GROUPS    ((1UL << BMS_GRP_LIMITS) | (1UL << BMS_GRP_CELL_V) | (1UL << BMS_GRP_CELL_T))
+
+static const uint32_t fresh_ms[BMS_GRP_COUNT] = {
+    [BMS_GRP_PACK]   = BMS_FRESH_MS,
+    [BMS_GRP_LIMITS] = BMS_FRESH_MS,
+    [BMS_GRP_CELL_V] = BMS_CELL_FRESH_MS,
+    [BMS_GRP_CELL_T] = BMS_CELL_FRESH_MS,
+};
+
+/* ============================================================================
+ * PRIVATE HELPERS
+ * ========================================================================== */
+static uint16_t Get16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | ((uint16_t)p[1] << 8));
+}
+
+static uint32_t Get32(const uint8_t *p)
+{
+    return (uint32_t)Get16(p) | ((uint32_t)Get16(p + 2) << 16);
+}
+
+/* Age of a stamp; a frame stamped after now (received during the drain)
+ * is new */
+static uint32_t AgeMs(uint32_t now_ms, uint32_t stamp_ms)
+{
+    int32_t age = (int32_t)(now_ms - stamp_ms);
+    return (age > 0) ? (uint32_t)age : 0U;
+}
+
+/* Stamp of the oldest block, relative to the newest one */
+static uint32_t OldestStamp(const uint32_t *stamp, uint32_t n, uint32_t newest)
+{
+    uint32_t oldest = newest, age_max = 0;
+    
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t age = AgeMs(newest, stamp[i]);
+        if (age > age_max) {
+            age_max = age;
+            oldest = stamp[i];
+        }
+    }
+    return oldest;
+}
+
+/* Fraction of the limit left with margin to the hard limit */
+static float32_t Taper(float32_t margin, float32_t window)
+{
+    if (margin <= 0.0f) return 0.0f;
+    if (margin >= window) return 1.0f;
+    return margin / window;
+}
+
+/* Values a block carries (the last one may be short) */
+static uint32_t BlockValues(uint32_t block, uint32_t per_frame, uint32_t total)
+{
+    uint32_t first = block * per_frame;
+    return (total - first < per_frame) ? total - first : per_frame;
+}
+
+/* Block stamp and seen bit; once every block is in, the group is complete
+ * and as old as its oldest block */
+static void BlockReceived(BmsData_t *bms, BmsGroup_t grp, uint32_t *stamp, uint32_t *seen,
+                          uint32_t blocks, uint32_t block, uint32_t stamp_ms)
+{
+    stamp[block] = stamp_ms;
+    *seen |= 1UL << block;
+    if (*seen == (1UL << blocks) - 1UL) {
+        bms->seen |= 1UL << grp;
+        bms->rx_ms[grp] = OldestStamp(stamp, blocks, stamp_ms);
+    }
+}
+
+/* ============================================================================
+ * MAILBOX
+ * ========================================================================== */
+void CAN_BMS_Reset(BmsData_t *bms)
+{
+    memset(bms, 0, sizeof(*bms));
+    for (uint32_t i = 0; i < BMS_TEMP_COUNT; i++) {
+        bms->cell_temperature[i] = TEMP_NONE_F;
+    }
+}
+
+bool CAN_BMS_Push(BmsMailbox_t *mb, const BmsFrame_t *frame)
+{
+    const uint32_t head = mb->head;
+    
+    if (head - mb->tail >= BMS_MAILBOX_DEPTH) {
+        mb->dropped++;
+        return false;
+    }
+    mb->slot[head & (BMS_MAILBOX_DEPTH - 1U)] = *frame;
+    __DMB();                    // Slot complete before it is published
+    mb->head = head + 1U;
+    return true;
+}
+
+bool CAN_BMS_Pop(BmsMailbox_t *mb, BmsFrame_t *frame)
+{
+    const uint32_t tail = mb->tail;
+    
+    if (mb->head == tail) return false;
+    __DMB();                    // Head read before the slot
+    *frame = mb->slot[tail & (BMS_MAILBOX_DEPTH - 1U)];
+    __DMB();                    // Slot copied before it is released
+    mb->tail = tail + 1U;
+    return true;
+}
+
+/* ============================================================================
+ * DECODING
+ * ========================================================================== */
+BmsGroup_t CAN_BMS_Decode(BmsData_t *bms, const BmsFrame_t *frame)
+{
+    const uint8_t *d = frame->data;
+    const uint8_t *v = d + BMS_BLOCK_HEADER;
+    BmsGroup_t grp = BMS_GRP_COUNT;
+    uint32_t block, first, n;
+    
+    switch (frame->id) {
+        case BMS_ID_PACK:
+            if (frame->len < BMS_PACK_LEN) break;
+            bms->voltage = (float32_t)Get16(d) * 0.1f;
+            bms->current = (float32_t)(int16_t)Get16(d + 2) * 0.1f;
+            bms->soc = (float32_t)Get16(d + 4) * 0.01f;
+            bms->soh = (float32_t)Get16(d + 6) * 0.01f;
+            bms->status = Get32(d + 8);
+            bms->rx_ms[BMS_GRP_PACK] = frame->stamp_ms;
+            bms->seen |= 1UL << BMS_GRP_PACK;
+            grp = BMS_GRP_PACK;
+            break;
+        
+        case BMS_ID_LIMITS:
+            if (frame->len < BMS_LIMITS_LEN) break;
+            bms->charge_limit_bms = (float32_t)Get16(d) * 0.1f;
+            bms->discharge_limit_bms = (float32_t)Get16(d + 2) * 0.1f;
+            bms->rx_ms[BMS_GRP_LIMITS] = frame->stamp_ms;
+            bms->seen |= 1UL << BMS_GRP_LIMITS;
+            grp = BMS_GRP_LIMITS;
+            break;
+        
+        case BMS_ID_CELLS:
+            if (frame->len < BMS_BLOCK_HEADER || d[0] >= BMS_CELL_BLOCKS) break;
+            block = d[0];
+            n = BlockValues(block, BMS_CELLS_PER_FRAME, BMS_CELL_COUNT);
+            if (frame->len < BMS_BLOCK_HEADER + 2U * n) break;
+            first = block * BMS_CELLS_PER_FRAME;
+            for (uint32_t i = 0; i < n; i++) {
+                uint16_t mV = Get16(v + 2U * i);
+                bms->cell_voltage[first + i] = (mV == BMS_CELL_NONE) ? 0.0f : (float32_t)mV * 0.001f;
+            }
+            BlockReceived(bms, BMS_GRP_CELL_V, bms->cell_v_ms, &bms->cell_v_seen,
+                          BMS_CELL_BLOCKS, block, frame->stamp_ms);
+            grp = BMS_GRP_CELL_V;
+            break;
+        
+        case BMS_ID_TEMPS:
+            if (frame->len < BMS_BLOCK_HEADER || d[0] >= BMS_TEMP_BLOCKS) break;
+            block = d[0];
+            n = BlockValues(block, BMS_TEMPS_PER_FRAME, BMS_TEMP_COUNT);
+            if (frame->len < BMS_BLOCK_HEADER + n) break;
+            first = block * BMS_TEMPS_PER_FRAME;
+            for (uint32_t i = 0; i < n; i++) {
+                bms->cell_temperature[first + i] = (float32_t)(int8_t)v[i];
+            }
+            BlockReceived(bms, BMS_GRP_CELL_T, bms->cell_t_ms, &bms->cell_t_seen,
+                          BMS_TEMP_BLOCKS, block, frame->stamp_ms);
+            grp = BMS_GRP_CELL_T;
+            break;
+        
+        default:
+            break;
+    }
+    
+    if (grp == BMS_GRP_COUNT) {
+        bms->bad_frames++;
+    } else {
+        bms->rx_frames++;
+    }
+    return grp;
+}
+
+/* ============================================================================
+ * FRESHNESS AND LIMITS (main loop)
+ * ========================================================================== */
+void CAN_BMS_Refresh(BmsData_t *bms, uint32_t now_ms)
+{
+    float32_t v_max = 0.0f, v_min = 0.0f, t_max = TEMP_NONE_F, t_min = TEMP_NONE_F;
+    uint32_t n_v = 0, n_t = 0;
+    
+    bms->stale = 0;
+    for (uint32_t g = 0; g < BMS_GRP_COUNT; g++) {
+        if (!(bms->seen & (1UL << g)) || AgeMs(now_ms, bms->rx_ms[g]) > fresh_ms[g]) {
+            bms->stale |= 1UL << g;
+        }
+    }
+    
+    /* Cell extremes (0 V and -128 °C: no reading) */
+    for (uint32_t i = 0; i < BMS_CELL_COUNT; i++) {
+        float32_t v = bms->cell_voltage[i];
+        if (v <= 0.0f) continue;
+        if (n_v == 0U || v > v_max) {
+            v_max = v;
+            bms->cell_v_max_idx = (uint16_t)i;
+        }
+        if (n_v == 0U || v < v_min) {
+            v_min = v;
+            bms->cell_v_min_idx = (uint16_t)i;
+        }
+        n_v++;
+    }
+    for (uint32_t i = 0; i < BMS_TEMP_COUNT; i++) {
+        float32_t t = bms->cell_temperature[i];
+        if (t <= TEMP_NONE_F) continue;
+        if (n_t == 0U || t > t_max) t_max = t;
+        if (n_t == 0U || t < t_min) t_min = t;
+        n_t++;
+    }
+    bms->cell_v_max = v_max;
+    bms->cell_v_min = v_min;
+    bms->temperature_max = t_max;
+    bms->temperature_min = t_min;
+    
+    /* Effective limits */
+    float32_t k_t = Taper(BMS_CELL_T_MAX - t_max, BMS_CELL_T_MAX - BMS_CELL_T_TAPER);
+    float32_t k_chg = Taper(BMS_CELL_V_MAX - v_max, BMS_CELL_V_MAX - BMS_CELL_V_CHG_TAPER) * k_t;
+    float32_t k_dis = Taper(v_min - BMS_CELL_V_MIN, BMS_CELL_V_DIS_TAPER - BMS_CELL_V_MIN) * k_t;
+    
+    if (t_min < BMS_CELL_T_CHG_MIN) k_chg = 0.0f;
+    if ((bms->stale & LIMIT_GROUPS) || n_v == 0U || n_t == 0U) {
+        k_chg = 0.0f;
+        k_dis = 0.0f;
+    }
+    bms->charge_limit = bms->charge_limit_bms * k_chg;
+    bms->discharge_limit = bms->discharge_limit_bms * k_dis;
+    bms->valid = CAN_BMS_Age(bms, now_ms) <= BMS_TIMEOUT_MS;
+}
+
+uint32_t CAN_BMS_Drain(BmsMailbox_t *mb, BmsData_t *bms, uint32_t now_ms)
+{
+    BmsFrame_t frame;
+    uint32_t n = 0;
+    
+    /* At most one mailbox of frames per pass */
+    while (n < BMS_MAILBOX_DEPTH && CAN_BMS_Pop(mb, &frame)) {
+        CAN_BMS_Decode(bms, &frame);
+        n++;
+    }
+    bms->dropped = mb->dropped;
+    bms->lost = mb->lost;
+    CAN_BMS_Refresh(bms, now_ms);
+    return n;
+}
+
+uint32_t CAN_BMS_Age(const BmsData_t *bms, uint32_t now_ms)
+{
+    uint32_t age_max = 0;
+    
+    for (uint32_t g = 0; g < BMS_GRP_COUNT; g++) {
+        uint32_t age = (bms->seen & (1UL << g)) ? AgeMs(now_ms, bms->rx_ms[g]) : now_ms;
+        if (age > age_max) age_max = age;
+    }
+    return age_max;
+}
@@ -7,15 +7,22 @@
  * Implements:
  * - SVPWM for 3-Level T-Type topology
  * - PR Current Controller
+ * - LCL Active Damping (capacitor current feedback)
  * - PI Voltage Controller
  * - SRF-PLL for Grid Synchronization
+ * - Grid-Forming VSM / Droop Control
  * - Neutral Point Balance
  */
 
 #include "control.h"
+#include "mpc.h"
+#include "impedance.h"
+#include "island.h"
+#include "params.h"
 #include "config.h"
 #include "arm_math.h"
 #include <math.h>
+#include <string.h>
 
 /* ============================================================================
  * CONSTANTS
@@ -27,38 +34,103 @@
 #define ONE_THIRD       0.33333333333f
 #define SQRT2           1.41421356237f
 #define SQRT2_INV       0.70710678118f
+#define PLL_VNORM_INV   (1.0f / (VAC_NOMINAL_V * 0.81649658f))  // 1 / phase peak
 
-#define CONTROL_TS      (1.0f / CONTROL_LOOP_FREQ_HZ)  // 5 µs
+#define I_PEAK_LIMIT    (IAC_RATED_A * SQRT2)          // Rated current, dq amplitude
+
+/* Periods and filter coefficients follow the carrier: see ControlTiming_t */
+#define REF_RATE_RUN    (SYSTEM_POWER_RATING * 1000.0f / REF_RAMP_TIME_MS)     // [W/s]
+#define REF_RATE_SOFT   (SYSTEM_POWER_RATING * 1000.0f / SOFT_START_TIME_MS)
+
+#define GFM_OMEGA_NOM   (TWO_PI * GRID_FREQ_NOMINAL_HZ)
+#define GFM_V_NOM       (VAC_NOMINAL_V * 0.81649658f)  // Phase peak
 
 /* ============================================================================
  * INITIALIZATION
  * ========================================================================== */
 void Control_Init(void)
 {
+    /* Gains from the parameter store (Params_Init), PR and PLL at its band */
+    const Params_t *p = Params_Get(&g_sys);
+    const ControlGains_t *g = &g_sys.params.gains[g_sys.params.active];
+    
     /* Initialize current PR controllers */
-    g_sys.current_ctrl_d.Kp = CURRENT_KP;
-    g_sys.current_ctrl_d.Kr = CURRENT_KR;
+    g_sys.current_ctrl_d.Kp = g->current_kp;
+    g_sys.current_ctrl_d.Kr = g->current_kr;
     g_sys.current_ctrl_d.omega0 = CURRENT_OMEGA0;
-    g_sys.current_ctrl_d.omega_c = 10.0f;
+    g_sys.current_ctrl_d.omega_c = CURRENT_OMEGA_C;
     g_sys.current_ctrl_d.x1 = 0.0f;
     g_sys.current_ctrl_d.x2 = 0.0f;
     
-    g_sys.current_ctrl_q.Kp = CURRENT_KP;
-    g_sys.current_ctrl_q.Kr = CURRENT_KR;
+    g_sys.current_ctrl_q.Kp = g->current_kp;
+    g_sys.current_ctrl_q.Kr = g->current_kr;
     g_sys.current_ctrl_q.omega0 = CURRENT_OMEGA0;
-    g_sys.current_ctrl_q.omega_c = 10.0f;
+    g_sys.current_ctrl_q.omega_c = CURRENT_OMEGA_C;
     g_sys.current_ctrl_q.x1 = 0.0f;
     g_sys.current_ctrl_q.x2 = 0.0f;
     
     /* Initialize voltage PI controller */
-    g_sys.voltage_ctrl.Kp = VOLTAGE_KP;
-    g_sys.voltage_ctrl.Ki = VOLTAGE_KI;
+    g_sys.voltage_ctrl.Kp = p->voltage_kp;
+    g_sys.voltage_ctrl.Ki = p->voltage_ki;
     g_sys.voltage_ctrl.integral = 0.0f;
     g_sys.voltage_ctrl.output_max = IAC_RATED_A;
     g_sys.voltage_ctrl.output_min = -IAC_RATED_A;
     
+    /* Initialize grid-forming PCC voltage controllers */
+    g_sys.gfm.v_d.Kp = GFM_VOLTAGE_KP;
+    g_sys.gfm.v_d.Ki = GFM_VOLTAGE_KI;
+    g_sys.gfm.v_d.output_max = I_PEAK_LIMIT;
+    g_sys.gfm.v_d.output_min = -I_PEAK_LIMIT;
+    g_sys.gfm.v_q = g_sys.gfm.v_d;
+    g_sys.gfm.E_ramp = 1.0f;
+    
     /* Initialize PLL */
     PLL_Init(&g_sys.pll);
+    g_sys.pll.pi.Kp = g->pll_kp;
+    g_sys.pll.pi.Ki = g->pll_ki;
+    
+    /* Initialize FCS-MPC (used when CURRENT_CTRL_FCS_MPC = 1) */
+    MPC_Init(&g_sys.mpc);
+    
+    /* Initialize dead-time at the configured fixed value */
+    g_sys.deadtime.dt_ns = PWM_DEAD_TIME_NS;
+    g_sys.deadtime.dt_counts = HRTIM_DEAD_TIME_RISING;
+    g_sys.deadtime.dt_req = HRTIM_DEAD_TIME_RISING;
+    g_sys.deadtime.i_band = DEADTIME_COMP_BAND_A;
+    g_sys.deadtime.comp_enable = DEADTIME_COMP_ENABLE;
+    
+    /* LCL active damping gain (used with LCL_ACTIVE_DAMPING) */
+    g_sys.damping.K = LCL_AD_GAIN;
+    
+    /* Start at the nominal switching frequency */
+    g_sys.svpwm.period = HRTIM_PERIOD;
+    g_sys.fsw.period_req = HRTIM_PERIOD;
+    g_sys.fsw.I_limit = I_PEAK_LIMIT;
+    g_sys.ilim.I_max = I_PEAK_LIMIT;
+    g_sys.ilim.I_max_sq = I_PEAK_LIMIT * I_PEAK_LIMIT;
+    Control_SetSampleTime(&g_sys, HRTIM_PERIOD);
+}
+
+/* Control period of an up-down carrier (one ISR per half period) and the
+ * coefficients derived from it, in the operation order of the fixed-rate
+ * constants so that HRTIM_PERIOD reproduces them exactly */
+void Control_SetSampleTime(SystemData_t *sys, uint16_t period)
+{
+    ControlTiming_t *tm = &sys->timing;
+    float32_t Ts = (float32_t)period / (2.0f * HRTIM_FREQ_HZ);
+    float32_t Tv = Ts * VOLTAGE_LOOP_DECIM;
+    
+    tm->Ts = Ts;
+    tm->Ts_ns = ((uint32_t)period * 5000U + HRTIM_FREQ_HZ / 200000U) / (HRTIM_FREQ_HZ / 100000U);
+    tm->voltage_Ts = Tv;
+    tm->voltage_ff_alpha = 6.2831853f * VOLTAGE_FF_LPF_HZ * Tv /
+                           (1.0f + 6.2831853f * VOLTAGE_FF_LPF_HZ * Tv);
+    tm->gfm_pq_alpha = 6.2831853f * GFM_POWER_LPF_HZ * Ts;
+    tm->ref_vd_alpha = 6.2831853f * REF_VD_LPF_HZ * Ts;
+    tm->gfm_ramp_step = Ts * 1000.0f / GFM_VOLTAGE_RAMP_MS;
+    tm->ref_dwell_steps = (uint16_t)(REF_REVERSAL_DWELL_MS * 1e-3f / Tv + 0.5f);
+    tm->ad_cf_ts = CF_CAPACITANCE_F / Ts;
+    tm->ad_alpha = 6.2831853f * LCL_AD_LPF_HZ * Ts / (1.0f + 6.2831853f * LCL_AD_LPF_HZ * Ts);
 }
 
 void Control_Reset(SystemData_t *sys)
@@ -69,10 +141,36 @@ void Control_Reset(SystemData_t *sys)
     sys->current_ctrl_q.x1 = 0.0f;
     sys->current_ctrl_q.x2 = 0.0f;
     sys->voltage_ctrl.integral = 0.0f;
+    sys->vdc_loop.active = false;
+    sys->vdc_loop.decim = 0;
+    sys->vdc_loop.vdc_sum = 0.0f;
+    sys->vdc_loop.pload_sum = 0.0f;
+    sys->vdc_loop.P_load = 0.0f;
+    sys->gfm.active = false;
+    sys->gfm.E_ramp = 1.0f;
+    MPC_Reset(&sys->mpc);
+    sys->delay.V_applied.d = 0.0f;
+    sys->delay.V_applied.q = 0.0f;
+    sys->damping.primed = false;
+    sys->damping.I_cf.d = 0.0f;
+    sys->damping.I_cf.q = 0.0f;
+    sys->damping.V_damp.d = 0.0f;
+    sys->damping.V_damp.q = 0.0f;
+    
+    /* Drop a pending impedance window: it would start in the soft start */
+    sys->gridz.acc.running = false;
+    sys->gridz.acc.I_inj = 0.0f;
+    sys->gridz.acc.seq = sys->gridz.req;
     
-    /* Reset references */
+    /* Reset references; the trajectory soft-starts from zero */
     sys->ref.Id_ref = 0.0f;
     sys->ref.Iq_ref = 0.0f;
+    sys->ref.P_ref = 0.0f;
+    sys->ref.Q_ref = 0.0f;
+    sys->ref.Vd_pq = 0.0f;
+    memset(&sys->traj, 0, sizeof(sys->traj));
+    sys->traj.soft_start = true;
+    sys->traj.idle = true;
 }
 
 /* ============================================================================
@@ -140,7 +238,7 @@ void PLL_Reset(Pll_t *pll)
     pll->locked = false;
 }
 
-void PLL_Update(Pll_t *pll, float32_t Va, float32_t Vb, float32_t Vc)
+void PLL_Update(Pll_t *pll, float32_t Va, float32_t Vb, float32_t Vc, float32_t Ts)
 {
     AlphaBeta_t V_ab;
     Dq_t V_dq;
@@ -155,9 +253,11 @@ void PLL_Update(Pll_t *pll, float32_t Va, float32_t Vb, float32_t Vc)
     pll->Vq = V_dq.q;
     
     /* PI controller on Vq (should be zero when locked) */
-    float32_t error = -V_dq.q;  // Negative feedback
+    /* Vq = Vpk·sin(θgrid - θ): positive Vq means the PLL lags, speed up.
+     * Gains are per-unit of nominal phase peak (ωn ≈ 70 rad/s, ζ ≈ 0.7) */
+    float32_t error = V_dq.q * PLL_VNORM_INV;
     
-    pll->pi.integral += pll->pi.Ki * error * CONTROL_TS;
+    pll->pi.integral += pll->pi.Ki * error * Ts;
     
     /* Anti-windup */
     if (pll->pi.integral > pll->pi.output_max) pll->pi.integral = pll->pi.output_max;
@@ -170,7 +270,7 @@ void PLL_Update(Pll_t *pll, float32_t Va, float32_t Vb, float32_t Vc)
     if (pll->omega < pll->pi.output_min) pll->omega = pll->pi.output_min;
     
     /* Integrate to get theta */
-    pll->theta += pll->omega * CONTROL_TS;
+    pll->theta += pll->omega * Ts;
     
     /* Wrap theta to [0, 2π] */
     if (pll->theta >= TWO_PI) pll->theta -= TWO_PI;
@@ -180,7 +280,7 @@ void PLL_Update(Pll_t *pll, float32_t Va, float32_t Vb, float32_t Vc)
     pll->frequency = pll->omega / TWO_PI;
     
     /* Check lock condition */
-    pll->locked = (fabsf(V_dq.q) < 20.0f) && 
+    pll->locked = (fabsf(V_dq.q) < 20.0f) && (V_dq.d > PLL_LOCK_VD_MIN_V) &&
                   (pll->frequency > GRID_FREQ_MIN_HZ) && 
                   (pll->frequency < GRID_FREQ_MAX_HZ);
 }
@@ -188,14 +288,13 @@ void PLL_Update(Pll_t *pll, float32_t Va, float32_t Vb, float32_t Vc)
 /* ============================================================================
  * PR (Proportional-Resonant) CONTROLLER
  * ========================================================================== */
-float32_t PR_Controller(PrController_t *pr, float32_t error)
+float32_t PR_Controller(PrController_t *pr, float32_t error, float32_t Ts)
 {
     /* Discrete PR controller using Tustin transformation */
     /* Transfer function: Kp + Kr * 2*wc*s / (s^2 + 2*wc*s + w0^2) */
     
     float32_t omega0_sq = pr->omega0 * pr->omega0;
     float32_t wc = pr->omega_c;
-    float32_t Ts = CONTROL_TS;
     
     /* State space update for resonant part */
     float32_t x1_new = pr->x1 + Ts * pr->x2;
@@ -213,10 +312,10 @@ float32_t PR_Controller(PrController_t *pr, float32_t error)
 /* ============================================================================
  * PI CONTROLLER
  * ========================================================================== */
-float32_t PI_Controller(PiController_t *pi, float32_t error)
+float32_t PI_Controller(PiController_t *pi, float32_t error, float32_t Ts)
 {
     /* Update integral */
-    pi->integral += pi->Ki * error * CONTROL_TS;
+    pi->integral += pi->Ki * error * Ts;
     
     /* Anti-windup */
     if (pi->integral > pi->output_max) pi->integral = pi->output_max;
@@ -232,56 +331,570 @@ float32_t PI_Controller(PiController_t *pi, float32_t error)
     return pi->output;
 }
 
+/* ============================================================================
+ * CURRENT LIMITS (main loop)
+ * The division by Vd and the tapers run here, once per pass; the control
+ * ISR only clamps against the result (Control_CurrentReference)
+ * ========================================================================== */
+/* 0 at margin <= 0, 1 at margin >= window, linear between */
+static float32_t Limit_Taper(float32_t margin, float32_t window)
+{
+    if (margin <= 0.0f) return 0.0f;
+    if (margin >= window) return 1.0f;
+    return margin / window;
+}
+
+/* Move x towards target by at most rise (up) or fall (down) */
+static float32_t Limit_Slew(float32_t x, float32_t target, float32_t rise, float32_t fall)
+{
+    if (target > x + rise) return x + rise;
+    if (target < x - fall) return x - fall;
+    return target;
+}
+
+void Control_CurrentLimits(SystemData_t *sys, uint32_t elapsed_ms)
+{
+    CurrentLimit_t *lim = &sys->ilim;
+    const BmsData_t *bms = &sys->bms;
+    
+    /* Battery limits: BMS (cell tapered, can_bms_frames.c) × SOC taper */
+    float32_t I_chg = bms->charge_limit *
+                      Limit_Taper(100.0f - bms->soc, 100.0f - ILIM_SOC_CHG_TAPER);
+    float32_t I_dis = bms->discharge_limit *
+                      Limit_Taper(bms->soc - ILIM_SOC_MIN, ILIM_SOC_DIS_TAPER - ILIM_SOC_MIN);
+    
+    /* A BMS limit step becomes a ramp the trajectory and the current loop
+     * follow; with the bridge off the limits jump */
+    if (sys->outputs_enabled) {
+        float32_t dt = (float32_t)elapsed_ms * 1e-3f;
+        I_chg = Limit_Slew(lim->I_charge, I_chg, ILIM_RISE_A_PER_S * dt, ILIM_FALL_A_PER_S * dt);
+        I_dis = Limit_Slew(lim->I_discharge, I_dis, ILIM_RISE_A_PER_S * dt, ILIM_FALL_A_PER_S * dt);
+    }
+    lim->I_charge = I_chg;
+    lim->I_discharge = I_dis;
+    
+    /* Id = P / (1.5·Vd) against the filtered Vd of the P/Q division, held
+     * off zero in a sag (the circle bounds Id there anyway) */
+    float32_t Vd = sys->ref.Vd_pq;
+    if (Vd < ILIM_VD_MIN_PU / PLL_VNORM_INV) Vd = ILIM_VD_MIN_PU / PLL_VNORM_INV;
+    float32_t k_id = sys->dc.Vdc / (1.5f * Vd);
+    float32_t I_max = sys->fsw.I_limit;
+    float32_t Id_max = I_dis * k_id;
+    float32_t Id_min = -I_chg * k_id;
+    if (Id_max > I_max) Id_max = I_max;
+    if (Id_min < -I_max) Id_min = -I_max;
+    
+    lim->Id_max_tgt = Id_max;
+    lim->Id_min_tgt = Id_min;
+    lim->Id_step = ILIM_FALL_A_PER_S * k_id * sys->timing.Ts;
+    if (!sys->outputs_enabled) {
+        lim->Id_max = Id_max;
+        lim->Id_min = Id_min;
+    }
+    lim->I_max = I_max;
+    lim->I_max_sq = I_max * I_max;
+    
+    /* The Vdc loop needs Id to hold the link: P priority while it runs */
+    lim->q_priority = sys->q_priority && !sys->vdc_control;
+}
+
 /* ============================================================================
  * CURRENT CONTROL LOOP
  * ========================================================================== */
+/* Synchronous frame of the current loop: the PLL when following the grid,
+ * the internal frame (same fields) when forming it */
+static inline const Pll_t* Control_Frame(const SystemData_t *sys)
+{
+    return sys->gfm.active ? &sys->gfm.frame : &sys->pll;
+}
+
+void Control_CurrentReference(SystemData_t *sys)
+{
+    /* Calculate current references from power references. The division uses
+     * the filtered Vd so that Id does not follow voltage ripple (constant
+     * power would act as a negative resistance and excite the LCL filter) */
+    if (sys->ref.Vd_pq == 0.0f) sys->ref.Vd_pq = sys->pll.Vd;
+    sys->ref.Vd_pq += sys->timing.ref_vd_alpha * (sys->pll.Vd - sys->ref.Vd_pq);
+    
+    if (sys->ref.Vd_pq > 50.0f) {
+        /* P = 1.5 * Vd * Id, Q = -1.5 * Vd * Iq (Id from the Vdc loop when active) */
+        if (!sys->vdc_loop.active) {
+            sys->ref.Id_ref = (2.0f / 3.0f) * sys->ref.P_ref / sys->ref.Vd_pq;
+        }
+        sys->ref.Iq_ref = -(2.0f / 3.0f) * sys->ref.Q_ref / sys->ref.Vd_pq;
+    }
+    
+    /* Limits precomputed by Control_CurrentLimits: the BMS window on Id
+     * (the Vdc loop limits Id itself, with a window that accounts for the
+     * DC load), then the circle with P or Q priority */
+    CurrentLimit_t *lim = &sys->ilim;
+    float32_t Id = sys->ref.Id_ref;
+    float32_t Iq = sys->ref.Iq_ref;
+    
+    /* Bounds towards the targets of the last pass (the faster of the two
+     * slew rates, so a pass of change is covered within the pass) */
+    float32_t dmax = lim->Id_max_tgt - lim->Id_max;
+    float32_t dmin = lim->Id_min_tgt - lim->Id_min;
+    if (dmax > lim->Id_step) dmax = lim->Id_step;
+    if (dmax < -lim->Id_step) dmax = -lim->Id_step;
+    if (dmin > lim->Id_step) dmin = lim->Id_step;
+    if (dmin < -lim->Id_step) dmin = -lim->Id_step;
+    lim->Id_max += dmax;
+    lim->Id_min += dmin;
+    
+    if (!sys->vdc_loop.active) {
+        if (Id > lim->Id_max) Id = lim->Id_max;
+        if (Id < lim->Id_min) Id = lim->Id_min;
+    }
+    
+    /* Outside the circle the priority axis is bounded by the radius and the
+     * other keeps its sign with the remaining length (one sqrtf, only while
+     * limiting) */
+    if (Id * Id + Iq * Iq > lim->I_max_sq) {
+        if (lim->q_priority) {
+            if (Iq > lim->I_max) Iq = lim->I_max;
+            if (Iq < -lim->I_max) Iq = -lim->I_max;
+            float32_t Id_room = sqrtf(lim->I_max_sq - Iq * Iq);
+            if (Id > Id_room) Id = Id_room;
+            if (Id < -Id_room) Id = -Id_room;
+        } else {
+            if (Id > lim->I_max) Id = lim->I_max;
+            if (Id < -lim->I_max) Id = -lim->I_max;
+            float32_t Iq_room = sqrtf(lim->I_max_sq - Id * Id);
+            if (Iq > Iq_room) Iq = Iq_room;
+            if (Iq < -Iq_room) Iq = -Iq_room;
+        }
+    }
+    
+    sys->ref.Id_ref = Id;
+    sys->ref.Iq_ref = Iq;
+}
+
 void Control_CurrentLoop(SystemData_t *sys)
 {
-    AlphaBeta_t I_ab, V_ab;
+    AlphaBeta_t I_ab;
+    const Pll_t *frame = Control_Frame(sys);
     
     /* Clarke transform currents */
     Clarke_Transform(sys->ac.Ia, sys->ac.Ib, sys->ac.Ic, &I_ab);
     
     /* Park transform to dq */
-    Park_Transform(I_ab.alpha, I_ab.beta, sys->pll.theta, &sys->I_dq);
-    
-    /* Calculate current references from power references */
-    if (sys->pll.Vd > 50.0f) {
-        /* P = 1.5 * Vd * Id, Q = -1.5 * Vd * Iq */
-        sys->ref.Id_ref = (2.0f / 3.0f) * sys->ref.P_ref / sys->pll.Vd;
-        sys->ref.Iq_ref = -(2.0f / 3.0f) * sys->ref.Q_ref / sys->pll.Vd;
-    }
-    
-    /* Limit current references */
-    float32_t I_limit = IAC_RATED_A;
+    Park_Transform(I_ab.alpha, I_ab.beta, frame->theta, &sys->I_dq);
     
-    /* Apply BMS current limits */
-    if (sys->power_dir == POWER_DIR_RECTIFIER) {
-        float32_t bms_limit = sys->bms.charge_limit * sys->dc.Vdc / (1.5f * sys->pll.Vd);
-        if (bms_limit < I_limit) I_limit = bms_limit;
+    /* Current references: PCC voltage loop when forming, else from the
+     * power references, with limits */
+    if (sys->gfm.active) {
+        Control_GridFormingReference(sys);
     } else {
-        float32_t bms_limit = sys->bms.discharge_limit * sys->dc.Vdc / (1.5f * sys->pll.Vd);
-        if (bms_limit < I_limit) I_limit = bms_limit;
+        Control_CurrentReference(sys);
     }
     
-    if (sys->ref.Id_ref > I_limit) sys->ref.Id_ref = I_limit;
-    if (sys->ref.Id_ref < -I_limit) sys->ref.Id_ref = -I_limit;
-    if (sys->ref.Iq_ref > I_limit) sys->ref.Iq_ref = I_limit;
-    if (sys->ref.Iq_ref < -I_limit) sys->ref.Iq_ref = -I_limit;
-    
     /* Current errors */
+#if CURRENT_DELAY_OBSERVER
+    /* Smith predictor: regulate the current expected when this output applies */
+    Control_PredictCurrent(sys);
+    float32_t Id_error = sys->ref.Id_ref - sys->delay.I_pred.d;
+    float32_t Iq_error = sys->ref.Iq_ref - sys->delay.I_pred.q;
+#else
     float32_t Id_error = sys->ref.Id_ref - sys->I_dq.d;
     float32_t Iq_error = sys->ref.Iq_ref - sys->I_dq.q;
+#endif
+    
+#if GRIDZ_ENABLE
+    /* Impedance estimation: injection on the d-axis error (Id_ref is held
+     * by the Vdc loop between its updates) */
+    if (!sys->gfm.active) {
+        Impedance_Step(sys);
+        Id_error += sys->gridz.acc.I_inj;
+    }
+#endif
+    
+#if ANTI_ISLAND_ACTIVE
+    /* Sandia frequency shift: the reference turned ahead by the SFS phase */
+    if (!sys->gfm.active) {
+        Island_Shift(sys);
+        Id_error += sys->island.est.dI.d;
+        Iq_error += sys->island.est.dI.q;
+    }
+#endif
     
     /* PR controllers */
-    float32_t Vd_ctrl = PR_Controller(&sys->current_ctrl_d, Id_error);
-    float32_t Vq_ctrl = PR_Controller(&sys->current_ctrl_q, Iq_error);
+    float32_t Vd_ctrl = PR_Controller(&sys->current_ctrl_d, Id_error, sys->timing.Ts);
+    float32_t Vq_ctrl = PR_Controller(&sys->current_ctrl_q, Iq_error, sys->timing.Ts);
+    
+#if LCL_ACTIVE_DAMPING
+    /* Virtual resistor across the filter capacitor */
+    Control_ActiveDamping(sys);
+#endif
+    
+    /* Feed-forward, decoupling and active damping */
+    float32_t omega_L = frame->omega * LC_INDUCTANCE_H;
+    
+    sys->V_ref_dq.d = Vd_ctrl + frame->Vd - omega_L * sys->I_dq.q - sys->damping.V_damp.d;
+    sys->V_ref_dq.q = Vq_ctrl + frame->Vq + omega_L * sys->I_dq.d - sys->damping.V_damp.q;
+    
+    /* Remember output for the predictor; it reaches the bridge next period */
+    sys->delay.V_applied = sys->V_ref_dq;
+}
+
+/* ============================================================================
+ * LCL ACTIVE DAMPING
+ * Capacitor current from the sampled PCC voltage: i_Cf = Cf·dv/dt. In the
+ * rotating frame the derivative leaves out the fundamental jωCf·V, so only
+ * the resonance (and transients) are fed back; a first-order filter at
+ * LCL_AD_LPF_HZ limits the sensor noise the difference amplifies.
+ * ========================================================================== */
+void Control_ActiveDamping(SystemData_t *sys)
+{
+    ActiveDamping_t *ad = &sys->damping;
+    const Pll_t *frame = Control_Frame(sys);
+    
+    if (!ad->primed) {
+        ad->V_prev.d = frame->Vd;
+        ad->V_prev.q = frame->Vq;
+        ad->primed = true;
+    }
+    
+    float32_t icf_d = sys->timing.ad_cf_ts * (frame->Vd - ad->V_prev.d);
+    float32_t icf_q = sys->timing.ad_cf_ts * (frame->Vq - ad->V_prev.q);
+    ad->V_prev.d = frame->Vd;
+    ad->V_prev.q = frame->Vq;
+    
+    ad->I_cf.d += sys->timing.ad_alpha * (icf_d - ad->I_cf.d);
+    ad->I_cf.q += sys->timing.ad_alpha * (icf_q - ad->I_cf.q);
+    
+    ad->V_damp.d = ad->K * ad->I_cf.d;
+    ad->V_damp.q = ad->K * ad->I_cf.q;
+}
+
+/* ============================================================================
+ * DC-LINK VOLTAGE LOOP (outer loop, every VOLTAGE_LOOP_DECIM periods)
+ * ========================================================================== */
+void Control_VoltageLoop(SystemData_t *sys)
+{
+    DcVoltageLoop_t *vl = &sys->vdc_loop;
+    PiController_t *pi = &sys->voltage_ctrl;
+    
+    /* Stopping hands Id back to the trajectory, which ramps it to zero */
+    if (!sys->vdc_control || sys->gfm.active || sys->state == STATE_STOPPING) {
+        vl->active = false;
+        return;
+    }
+    
+    /* Average over the outer period. DC node: Vdc * Ibat = P_bridge + P_load
+     * + P_cap (bridge power from the previous period's Idq) */
+    vl->vdc_sum += sys->dc.Vdc;
+    vl->pload_sum += sys->dc.Vdc * sys->dc.Idc -
+                     1.5f * (sys->pll.Vd * sys->I_dq.d + sys->pll.Vq * sys->I_dq.q);
+    if (++vl->decim < VOLTAGE_LOOP_DECIM) return;
+    
+    float32_t Vdc = vl->vdc_sum * (1.0f / VOLTAGE_LOOP_DECIM);
+    float32_t P_load = vl->pload_sum * (1.0f / VOLTAGE_LOOP_DECIM);
+    vl->decim = 0;
+    vl->vdc_sum = 0.0f;
+    vl->pload_sum = 0.0f;
+    
+    /* Remove the DC-link capacitor power, else every bridge power change
+     * reads as a load change until the battery current follows (R_bat * C) */
+    if (vl->active) {
+        P_load -= CDC_CAPACITANCE_F * Vdc * (Vdc - vl->vdc_prev) * (1.0f / sys->timing.voltage_Ts);
+    }
+    vl->vdc_prev = Vdc;
+    
+    if (sys->pll.Vd < 50.0f) return;
+    
+    /* Id per W at nominal grid voltage: dividing by the measured Vd would
+     * make the loop a constant-power load that destabilises the PLL on a
+     * weak grid; the PI absorbs the difference */
+    const float32_t k_id = (2.0f / 3.0f) * PLL_VNORM_INV;
+    
+    /* Load feed-forward: the bridge supplies the DC load */
+#if VOLTAGE_FF_ENABLE
+    vl->P_load += sys->timing.voltage_ff_alpha * (P_load - vl->P_load);
+#endif
+    vl->Id_ff = -vl->P_load * k_id;
+    
+    /* Id window from the BMS limits: Ibat = (P_bridge + P_load) / Vdc
+     * must stay within [-I_charge, I_discharge] (Control_CurrentLimits) */
+    vl->Id_max = (sys->ilim.I_discharge * Vdc - vl->P_load) * k_id;
+    vl->Id_min = (-sys->ilim.I_charge * Vdc - vl->P_load) * k_id;
+    if (vl->Id_max > sys->fsw.I_limit) vl->Id_max = sys->fsw.I_limit;
+    if (vl->Id_max < -sys->fsw.I_limit) vl->Id_max = -sys->fsw.I_limit;
+    if (vl->Id_min > vl->Id_max) vl->Id_min = vl->Id_max;
+    if (vl->Id_min < -sys->fsw.I_limit) vl->Id_min = -sys->fsw.I_limit;
+    
+    /* Anti-windup: the PI integrates only inside the window left by the
+     * feed-forward */
+    pi->output_max = vl->Id_max - vl->Id_ff;
+    pi->output_min = vl->Id_min - vl->Id_ff;
+    
+    /* Vdc above reference: discharge into the grid (Id > 0) */
+    float32_t error = Vdc - sys->ref.Vdc_ref;
+    
+    /* Bumpless entry: preload so the first output equals the present Id_ref */
+    if (!vl->active) {
+        pi->integral = sys->ref.Id_ref - vl->Id_ff - pi->Kp * error;
+        vl->active = true;
+    }
+    
+    sys->ref.Id_ref = vl->Id_ff + PI_Controller(pi, error, sys->timing.voltage_Ts);
+}
+
+/* ============================================================================
+ * REFERENCE TRAJECTORY (every VOLTAGE_LOOP_DECIM periods)
+ * Moves P_ref/Q_ref towards the commands with bounded rate and rate of
+ * change, so the DC-link and battery current never step. The commands are
+ * limited here in the main loop; the trajectory runs in the ISR so the
+ * current references change smoothly between main-loop passes.
+ * ========================================================================== */
+void Control_ReferenceCommand(SystemData_t *sys, float32_t P_in, float32_t Q_in)
+{
+    float32_t S_max = SYSTEM_POWER_RATING * sys->prot.derating;
+    float32_t P_max = sys->ilim.I_discharge * sys->dc.Vdc;
+    float32_t P_min = -sys->ilim.I_charge * sys->dc.Vdc;
+    
+    if (sys->state == STATE_STOPPING) {
+        P_in = 0.0f;
+        Q_in = 0.0f;
+    }
+    
+    if (P_max > S_max) P_max = S_max;
+    if (P_min < -S_max) P_min = -S_max;
+    if (P_in > P_max) P_in = P_max;
+    if (P_in < P_min) P_in = P_min;
+    if (Q_in > S_max) Q_in = S_max;
+    if (Q_in < -S_max) Q_in = -S_max;
+    
+    sys->ref.P_cmd = P_in;
+    sys->ref.Q_cmd = Q_in;
+}
+
+#if REF_TRAJECTORY_ENABLE
+/* One step towards target: accelerate at acc up to ±rate, and brake so as
+ * to arrive at rest (whole steps: v·h/2 + v²/(2·acc) = remaining distance) */
+static bool RefAxis_Step(RefAxis_t *ax, float32_t target, float32_t rate, float32_t acc,
+                         float32_t h)
+{
+    float32_t dv_max = acc * h;
+    float32_t e = target - ax->x;
+    float32_t v_stop = acc * (sqrtf(0.25f * h * h + 2.0f * fabsf(e) / acc) - 0.5f * h);
     
-    /* Feed-forward and decoupling */
-    float32_t omega_L = sys->pll.omega * LC_INDUCTANCE_H;
+    if (v_stop > rate) v_stop = rate;
+    float32_t dv = ((e >= 0.0f) ? v_stop : -v_stop) - ax->v;
+    if (dv > dv_max) dv = dv_max;
+    if (dv < -dv_max) dv = -dv_max;
+    ax->v += dv;
+    ax->x += ax->v * h;
     
-    sys->V_ref_dq.d = Vd_ctrl + sys->pll.Vd - omega_L * sys->I_dq.q;
-    sys->V_ref_dq.q = Vq_ctrl + sys->pll.Vq + omega_L * sys->I_dq.d;
+    /* Arrival within one step at the lowest speed */
+    if (fabsf(target - ax->x) <= dv_max * h && fabsf(ax->v) <= dv_max) {
+        ax->x = target;
+        ax->v = 0.0f;
+    }
+    return (ax->x == target) && (ax->v == 0.0f);
+}
+#endif
+
+void Control_Trajectory(SystemData_t *sys)
+{
+    RefTrajectory_t *tr = &sys->traj;
+    
+#if !REF_TRAJECTORY_ENABLE
+    /* Step references (current-loop tuning and comparison) */
+    if (!sys->vdc_loop.active) sys->ref.P_ref = sys->ref.P_cmd;
+    sys->ref.Q_ref = sys->ref.Q_cmd;
+    tr->idle = (sys->ref.P_cmd == 0.0f) && (sys->ref.Q_cmd == 0.0f);
+#else
+    if (++tr->decim < VOLTAGE_LOOP_DECIM) return;
+    tr->decim = 0;
+    
+    /* The Vdc loop owns Id: follow its power, so that handing P back to the
+     * trajectory (Modbus or stop) starts from where the loop left it */
+    if (sys->vdc_loop.active) {
+        tr->p.x = 1.5f * sys->pll.Vd * sys->ref.Id_ref;
+        tr->p.v = 0.0f;
+        tr->dwell = 0;
+    }
+    
+    /* Reversal: to rest at zero first, dwell, then on to the new sign */
+    float32_t P_t = sys->ref.P_cmd;
+    if ((tr->p.x > 0.0f && P_t < 0.0f) || (tr->p.x < 0.0f && P_t > 0.0f)) {
+        P_t = 0.0f;
+        tr->dwell = sys->timing.ref_dwell_steps;
+    } else if (tr->dwell > 0U) {
+        P_t = 0.0f;
+        if (tr->p.x == 0.0f && tr->p.v == 0.0f) tr->dwell--;
+    }
+    
+    float32_t rate = (tr->soft_start && sys->state != STATE_STOPPING) ? REF_RATE_SOFT : REF_RATE_RUN;
+    float32_t acc = rate * (1000.0f / REF_JERK_TIME_MS);
+    bool p_done = RefAxis_Step(&tr->p, P_t, rate, acc, sys->timing.voltage_Ts);
+    bool q_done = RefAxis_Step(&tr->q, sys->ref.Q_cmd, rate, acc, sys->timing.voltage_Ts);
+    if (p_done && q_done && tr->dwell == 0U) tr->soft_start = false;
+    tr->idle = p_done && q_done && P_t == 0.0f && sys->ref.Q_cmd == 0.0f;
+    
+    if (!sys->vdc_loop.active) sys->ref.P_ref = tr->p.x;
+    sys->ref.Q_ref = tr->q.x;
+#endif
+}
+
+/* ============================================================================
+ * GRID-FORMING CONTROL (virtual synchronous machine, P-f / Q-V droop)
+ * The internal frame is the rotor of a virtual machine; its EMF, behind a
+ * virtual impedance, is the PCC voltage reference. Grid-tied the angle
+ * sets the exported power, islanded the droops share the load between
+ * paralleled units. Not available with FCS-MPC (no voltage-source path).
+ * ========================================================================== */
+bool Control_FormingMode(OperationMode_t mode)
+{
+    return (mode != MODE_GRID_TIED) && !CURRENT_CTRL_FCS_MPC;
+}
+
+bool Control_BlackStartMode(OperationMode_t mode)
+{
+    /* DROOP only parallels onto a live bus (grid or other units) */
+    return Control_FormingMode(mode) && (mode != MODE_DROOP);
+}
+
+void Control_GridForming(SystemData_t *sys)
+{
+    GridForming_t *gf = &sys->gfm;
+    Pll_t *fr = &gf->frame;
+    AlphaBeta_t V_ab;
+    Dq_t V;
+    
+    if (!Control_FormingMode(sys->mode)) {
+        gf->active = false;
+        return;
+    }
+    
+    /* Entry: the rotor starts at the PLL angle and speed, the voltage PIs
+     * at the present current references (seamless from grid-following) */
+    if (!gf->active) {
+        fr->theta = sys->pll.theta;
+        fr->omega = sys->pll.omega;
+        fr->Vd = sys->pll.Vd;
+        fr->Vq = sys->pll.Vq;
+        gf->P_filt = 1.5f * (fr->Vd * sys->I_dq.d + fr->Vq * sys->I_dq.q);
+        gf->Q_filt = 1.5f * (fr->Vq * sys->I_dq.d - fr->Vd * sys->I_dq.q);
+        gf->v_d.integral = sys->ref.Id_ref + fr->omega * CF_CAPACITANCE_F * fr->Vq;
+        gf->v_q.integral = sys->ref.Iq_ref - fr->omega * CF_CAPACITANCE_F * fr->Vd;
+        gf->active = true;
+    }
+    
+    /* PCC voltage in the rotor frame; power from the last period's current */
+    Clarke_Transform(sys->ac.Va, sys->ac.Vb, sys->ac.Vc, &V_ab);
+    Park_Transform(V_ab.alpha, V_ab.beta, fr->theta, &V);
+    fr->Vd = V.d;
+    fr->Vq = V.q;
+    
+    float32_t P = 1.5f * (V.d * sys->I_dq.d + V.q * sys->I_dq.q);
+    float32_t Q = 1.5f * (V.q * sys->I_dq.d - V.d * sys->I_dq.q);
+    gf->P_filt += sys->timing.gfm_pq_alpha * (P - gf->P_filt);
+    gf->Q_filt += sys->timing.gfm_pq_alpha * (Q - gf->Q_filt);
+    
+    if (sys->mode == MODE_VF_CONTROL) {
+        /* Isochronous: fixed frequency and amplitude (single forming unit) */
+        fr->omega = GFM_OMEGA_NOM;
+        gf->E = GFM_V_NOM;
+    } else {
+        /* P_ref is the droop setpoint, held inside the BMS power window;
+         * beyond the window the droop steepens by GFM_PLIM_GAIN */
+        float32_t P_max = sys->ilim.I_discharge * sys->dc.Vdc;
+        float32_t P_min = -sys->ilim.I_charge * sys->dc.Vdc;
+        float32_t P_set = sys->ref.P_ref;
+        if (P_set > P_max) P_set = P_max;
+        if (P_set < P_min) P_set = P_min;
+        
+        float32_t dP = P_set - P;
+        if (P > P_max) dP += GFM_PLIM_GAIN * (P_max - P);
+        if (P < P_min) dP += GFM_PLIM_GAIN * (P_min - P);
+        
+        /* Swing equation, per unit: 2H dω/dt = ΔP - (ω - ω_nom) / (m_p ω_nom) */
+        float32_t dw = dP * (1.0f / SYSTEM_POWER_RATING) -
+                       (fr->omega - GFM_OMEGA_NOM) * (1.0f / (GFM_DROOP_P * GFM_OMEGA_NOM));
+        fr->omega += (GFM_OMEGA_NOM / (2.0f * GFM_INERTIA_H)) * dw * sys->timing.Ts;
+        
+        /* Q-V droop around the Q_ref setpoint */
+        gf->E = GFM_V_NOM * (1.0f + GFM_DROOP_Q * (sys->ref.Q_ref - gf->Q_filt) *
+                             (1.0f / SYSTEM_POWER_RATING));
+    }
+    
+    if (fr->omega > TWO_PI * GRID_FREQ_MAX_HZ) fr->omega = TWO_PI * GRID_FREQ_MAX_HZ;
+    if (fr->omega < TWO_PI * GRID_FREQ_MIN_HZ) fr->omega = TWO_PI * GRID_FREQ_MIN_HZ;
+    
+    fr->theta += fr->omega * sys->timing.Ts;
+    if (fr->theta >= TWO_PI) fr->theta -= TWO_PI;
+    fr->frequency = fr->omega / TWO_PI;
+    
+    /* Black start: the EMF ramps up from zero */
+    if (gf->E_ramp < 1.0f) {
+        gf->E_ramp += sys->timing.gfm_ramp_step;
+        if (gf->E_ramp > 1.0f) gf->E_ramp = 1.0f;
+        gf->E *= gf->E_ramp;
+    }
+}
+
+void Control_GridFormingReference(SystemData_t *sys)
+{
+    GridForming_t *gf = &sys->gfm;
+    const Pll_t *fr = &gf->frame;
+    float32_t X_v = fr->omega * GFM_VIRTUAL_L_H;
+    float32_t B_c = fr->omega * CF_CAPACITANCE_F;
+    
+    /* PCC voltage reference: EMF behind the virtual impedance */
+    float32_t Vd_ref = gf->E - GFM_VIRTUAL_R_OHM * sys->I_dq.d + X_v * sys->I_dq.q;
+    float32_t Vq_ref = -GFM_VIRTUAL_R_OHM * sys->I_dq.q - X_v * sys->I_dq.d;
+    
+    /* Voltage PIs plus filter capacitor current feed-forward */
+    float32_t int_d = gf->v_d.integral;
+    float32_t int_q = gf->v_q.integral;
+    float32_t Id = PI_Controller(&gf->v_d, Vd_ref - fr->Vd, sys->timing.Ts) - B_c * fr->Vq;
+    float32_t Iq = PI_Controller(&gf->v_q, Vq_ref - fr->Vq, sys->timing.Ts) + B_c * fr->Vd;
+    
+    /* Current limit on the vector magnitude keeps its angle; the PIs hold
+     * their integrators while limited */
+    float32_t I_mag = sqrtf(Id * Id + Iq * Iq);
+    if (I_mag > sys->fsw.I_limit) {
+        float32_t k = sys->fsw.I_limit / I_mag;
+        Id *= k;
+        Iq *= k;
+        gf->v_d.integral = int_d;
+        gf->v_q.integral = int_q;
+    }
+    
+    sys->ref.Id_ref = Id;
+    sys->ref.Iq_ref = Iq;
+}
+
+/* ============================================================================
+ * COMPUTATIONAL DELAY COMPENSATION
+ * ========================================================================== */
+void Control_DelayCompensation(SystemData_t *sys)
+{
+    /* The bridge reproduces V_ref CONTROL_DELAY_SAMPLES later: rotate ahead */
+    sys->delay.theta_advance = CONTROL_DELAY_SAMPLES * Control_Frame(sys)->omega * sys->timing.Ts;
+}
+
+float32_t Control_CompensatedTheta(const SystemData_t *sys)
+{
+    float32_t theta = Control_Frame(sys)->theta + sys->delay.theta_advance;
+    if (theta >= TWO_PI) theta -= TWO_PI;
+    return theta;
+}
+
+void Control_PredictCurrent(SystemData_t *sys)
+{
+    /* Forward-Euler L model in dq over the pending compute delay:
+     * L dI/dt = V_conv - V_grid - jωL·I */
+    const Pll_t *frame = Control_Frame(sys);
+    float32_t h = (CONTROL_DELAY_SAMPLES - 0.5f) * sys->timing.Ts / LC_INDUCTANCE_H;
+    float32_t omega_L = frame->omega * LC_INDUCTANCE_H;
+    
+    sys->delay.I_pred.d = sys->I_dq.d + h * (sys->delay.V_applied.d - frame->Vd 
+                                            + omega_L * sys->I_dq.q);
+    sys->delay.I_pred.q = sys->I_dq.q + h * (sys->delay.V_applied.q - frame->Vq 
+                                            - omega_L * sys->I_dq.d);
 }
 
 /* ============================================================================
@@ -346,8 +959,9 @@ void SVPWM_Calculate(SvpwmOutput_t *svpwm, float32_t Vd, float32_t Vq,
     
     /* Convert to HRTIM compare values */
     /* For T-Type: duty = (1 + m) / 2 for upper switch, complementary for lower */
-    /* Center-aligned PWM: compare value = period/2 * (1 + m) */
-    uint16_t period = HRTIM_PERIOD;
+    /* Center-aligned PWM: compare value = period/2 * (1 + m), at the
+     * carrier period in force when these duties are loaded */
+    uint16_t period = svpwm->period;
     
     svpwm->duty_a = (uint16_t)((1.0f + Va) * 0.5f * (float32_t)period);
     svpwm->duty_b = (uint16_t)((1.0f + Vb) * 0.5f * (float32_t)period);
@@ -362,6 +976,158 @@ void SVPWM_Calculate(SvpwmOutput_t *svpwm, float32_t Vd, float32_t Vq,
     if (svpwm->duty_c > period - 10) svpwm->duty_c = period - 10;
 }
 
+/* ============================================================================
+ * DEAD-TIME COMPENSATION (Called from ISR after SVPWM)
+ * During dead-time the phase follows the current: for i > 0 the outer switch
+ * turn-on is lost, for i < 0 the turn-off is extended. Each edge pair costs
+ * one dead-time of on-time, i.e. dt_counts/2 in duty units.
+ * ========================================================================== */
+void DeadTime_Compensate(SvpwmOutput_t *svpwm, const DeadTime_t *dt,
+                         float32_t Ia, float32_t Ib, float32_t Ic)
+{
+    if (!dt->comp_enable) return;
+    
+    const float32_t i_current[3] = { Ia, Ib, Ic };
+    uint16_t *duty[3] = { &svpwm->duty_a, &svpwm->duty_b, &svpwm->duty_c };
+    float32_t half_dt = 0.5f * (float32_t)dt->dt_counts;
+    float32_t band_inv = 1.0f / dt->i_band;
+    
+    for (uint32_t ph = 0; ph < 3; ph++) {
+        /* Linear sign inside ±i_band avoids chatter at the zero crossing */
+        float32_t sgn = i_current[ph] * band_inv;
+        if (sgn > 1.0f) sgn = 1.0f;
+        if (sgn < -1.0f) sgn = -1.0f;
+        
+        float32_t d = (float32_t)*duty[ph] + sgn * half_dt;
+        if (d < 10.0f) d = 10.0f;
+        if (d > (float32_t)(svpwm->period - 10)) d = (float32_t)(svpwm->period - 10);
+        *duty[ph] = (uint16_t)(d + 0.5f);
+    }
+}
+
+/* ============================================================================
+ * DEAD-TIME SCHEDULING (Called from main loop)
+ * dt = DEADTIME_MIN + Qoss / |I| + k_T × (T - 25 °C), bounded to
+ * [DEADTIME_MIN_NS, DEADTIME_MAX_NS]. Low current needs longer for the
+ * resonant Coss transition; high current allows the minimum, which cuts
+ * body-diode conduction time. The result is only a request: the control
+ * ISR applies it at a valley (DeadTime_Load).
+ * ========================================================================== */
+void DeadTime_Schedule(SystemData_t *sys)
+{
+    DeadTime_t *dt = &sys->deadtime;
+    
+    float32_t I_mag = sqrtf(sys->I_dq.d * sys->I_dq.d + sys->I_dq.q * sys->I_dq.q);
+    if (I_mag < DEADTIME_I_FLOOR_A) I_mag = DEADTIME_I_FLOOR_A;
+    
+    /* Qoss [nC] / I [A] = Coss transition time [ns] */
+    float32_t dt_ns = DEADTIME_MIN_NS + DEADTIME_QOSS_NC / I_mag;
+    if (sys->temps.T_max > 25.0f) {
+        dt_ns += DEADTIME_TEMP_COEFF_NS * (sys->temps.T_max - 25.0f);
+    }
+    
+    if (dt_ns < DEADTIME_MIN_NS) dt_ns = DEADTIME_MIN_NS;
+    if (dt_ns > DEADTIME_MAX_NS) dt_ns = DEADTIME_MAX_NS;
+    
+    /* Round up to whole HRTIM ticks so the minimum is never undercut */
+    uint16_t counts = (uint16_t)ceilf(dt_ns * (HRTIM_FREQ_HZ / 1.0e9f));
+    
+    dt->dt_ns = dt_ns;
+    dt->dt_req = counts;
+}
+
+/* ============================================================================
+ * DEAD-TIME LOAD (Called from control ISR)
+ * DTxR has no preload, so a value written from the main loop lands at an
+ * arbitrary point of the carrier, possibly between the compensation of a
+ * duty and its edges. The request is taken over in the ISR at a valley,
+ * before DeadTime_Compensate, and written right after the compares: the
+ * duty then carries the compensation for the dead time it switches with.
+ * Returns true when HRTIM must be reloaded.
+ * ========================================================================== */
+bool DeadTime_Load(SystemData_t *sys)
+{
+    DeadTime_t *dt = &sys->deadtime;
+    
+    if (sys->timing.crest || dt->dt_req == dt->dt_counts) return false;
+    
+    dt->dt_counts = dt->dt_req;
+    return true;
+}
+
+/* ============================================================================
+ * SWITCHING FREQUENCY SCHEDULING (Called from main loop)
+ * Switching and dead-time losses scale with f_sw while conduction losses do
+ * not, so at partial load a longer carrier period saves more than the added
+ * ripple costs. The level follows the current demand (immediate rise, slow
+ * decay), stays within the ripple budget and drops one further level when
+ * the predicted Tj nears its limit. The ISR applies period_req at the next
+ * carrier crest; higher frequency is taken at once, lower after FSW_HOLD_MS.
+ * ========================================================================== */
+static const uint16_t fsw_periods[FSW_LEVELS] = FSW_PERIODS;
+static const float32_t fsw_load_pu[FSW_LEVELS] = FSW_LOAD_PU;
+
+/* Worst-case converter current ripple (peak-peak) of a 3-level leg: Vdc/2
+ * steps, largest at half the duty range: Vdc / (8 · Lc · f_sw) */
+static float32_t Fsw_Ripple(float32_t Vdc, uint16_t period)
+{
+    return Vdc * (float32_t)period * (1.0f / (8.0f * LC_INDUCTANCE_H * HRTIM_FREQ_HZ));
+}
+
+void Fsw_Schedule(SystemData_t *sys, uint32_t elapsed_ms)
+{
+    FswSchedule_t *fs = &sys->fsw;
+    uint8_t level = 0;
+    
+    /* Demand: the measured current or the one commanded, whichever is
+     * larger, so that a command step is met at full frequency */
+    float32_t I_dem = sqrtf(sys->I_dq.d * sys->I_dq.d + sys->I_dq.q * sys->I_dq.q);
+    if (sys->ref.Vd_pq > 50.0f) {
+        float32_t I_cmd = (2.0f / 3.0f) * sqrtf(sys->ref.P_cmd * sys->ref.P_cmd +
+                                                sys->ref.Q_cmd * sys->ref.Q_cmd) / sys->ref.Vd_pq;
+        if (I_cmd > I_dem) I_dem = I_cmd;
+    }
+    if (I_dem > fs->I_demand) {
+        fs->I_demand = I_dem;
+    } else {
+        float32_t dt = (float32_t)elapsed_ms * 1e-3f;
+        fs->I_demand += dt / (FSW_DEMAND_TAU_S + dt) * (I_dem - fs->I_demand);
+    }
+    
+#if FSW_SCHEDULE_ENABLE && !CURRENT_CTRL_FCS_MPC
+    /* Grid-forming holds the PCC voltage against unannounced load steps:
+     * keep the full voltage-loop bandwidth there */
+    if (sys->outputs_enabled && !sys->fsw_fixed && !sys->gfm.active) {
+        /* Lowest frequency whose load band holds the demand (the band of the
+         * present level and those below it widened by the hysteresis) */
+        for (level = FSW_LEVELS - 1; level > 0; level--) {
+            float32_t I_max = fsw_load_pu[level] * I_PEAK_LIMIT;
+            if (level <= fs->level) I_max += FSW_LOAD_HYST_PU * I_PEAK_LIMIT;
+            if (fs->I_demand <= I_max &&
+                Fsw_Ripple(sys->dc.Vdc, fsw_periods[level]) <= FSW_RIPPLE_MAX_A) break;
+        }
+        
+        /* Hot junctions: trade ripple for switching loss */
+        if (sys->thermal.Tj_pred_max > THERMAL_TJ_LIMIT_C - FSW_TJ_MARGIN_C &&
+            level < FSW_LEVELS - 1 &&
+            Fsw_Ripple(sys->dc.Vdc, fsw_periods[level + 1]) <= FSW_RIPPLE_MAX_A) {
+            level++;
+        }
+    }
+#endif
+    
+    fs->hold_ms += elapsed_ms;
+    if (level < fs->level || (level > fs->level && fs->hold_ms >= FSW_HOLD_MS)) {
+        fs->level = level;
+        fs->hold_ms = 0;
+    }
+    
+    /* Peak current unchanged: the limit gives up the extra half ripple */
+    fs->ripple_pp = Fsw_Ripple(sys->dc.Vdc, fsw_periods[fs->level]);
+    fs->I_limit = I_PEAK_LIMIT - 0.5f * (fs->ripple_pp - Fsw_Ripple(sys->dc.Vdc, fsw_periods[0]));
+    fs->period_req = fsw_periods[fs->level];
+}
+
 /* ============================================================================
  * NEUTRAL POINT BALANCE
  * For 3-level T-Type, inject offset to balance NP voltage
@@ -0,0 +1,119 @@
+/**
+ * @file deadline.c
+ * @brief Control ISR Deadline Supervision and Load Shedding
+ * @version 2.1
+ * @date 2025-12
+ *
+ * The control ISR must finish within half a carrier period of the
+ * repetition event that starts its conversions: the compares it writes
+ * take effect at the next crest or valley, and the next ISR is due there.
+ * Two things eat into that budget. The entry delay is the master counter
+ * at entry: a section with interrupts masked, or the tail of a handler
+ * the core is already stacking, holds off even a priority-0 interrupt.
+ * The execution is the DWT cycle count of the ISR itself. Their sum over
+ * the worst period of a main-loop tick is the load; the repetition flag
+ * found set again when the ISR returns is an overrun, and the late period
+ * starts late as well.
+ *
+ * The main loop acts on the load once per tick. Optional work comes off
+ * first, one stage per DEADLINE_SHED_MS of overload, in DEADLINE_SHED_ORDER:
+ *   - SHED_RECORDER: the recorder closes its block and captures nothing;
+ *     it resumes in a new block from a keyframe, so replay stays valid
+ *   - SHED_TELEMETRY: the ISR skips its telemetry samples
+ *   - SHED_GRIDZ: no new grid impedance window is requested; the ISR
+ *     aborts one that is running (injection off) and it is discarded
+ * and returns in reverse order after DEADLINE_RESTORE_MS of headroom. The
+ * core loop (protection, PLL, current control, modulation) is never shed:
+ * when it overruns with every stage off for DEADLINE_TRIP_MS, the
+ * converter trips with FAULT_WATCHDOG, since duties that take effect a
+ * period late no longer close the current loop.
+ *
+ * A main loop starved by the ISR and the interrupts below it shows up as
+ * late ticks, counted and taken as overload. The IWDG, refreshed only by
+ * the main loop, resets the MCU when it stops altogether.
+ */
+
+#include "deadline.h"
+#include "config.h"
+#include <string.h>
+
+/* ============================================================================
+ * CONSTANTS
+ * ========================================================================== */
+#define DEADLINE_ENTRY_CYCLES   ((uint32_t)((uint64_t)DEADLINE_ENTRY_NS * SYSCLK_FREQ_HZ / 1000000000U))
+
+static const uint8_t shed_order[SHED_STAGES] = DEADLINE_SHED_ORDER;
+
+/* ============================================================================
+ * INITIALIZATION
+ * ========================================================================== */
+void Deadline_Init(Deadline_t *dl, bool iwdg_reset)
+{
+    memset(dl, 0, sizeof(*dl));
+    dl->iwdg_reset = iwdg_reset;
+}
+
+/* ============================================================================
+ * ISR TIMING (end of the control ISR)
+ * ========================================================================== */
+void Deadline_Isr(Deadline_t *dl, uint32_t entry_cycles, uint32_t exec_cycles, bool overrun)
+{
+    const uint32_t used = entry_cycles + exec_cycles;
+    
+    if (used > dl->used_max) dl->used_max = used;
+    if (entry_cycles > dl->entry_max) dl->entry_max = entry_cycles;
+    if (exec_cycles > dl->exec_max) dl->exec_max = exec_cycles;
+    if (entry_cycles > DEADLINE_ENTRY_CYCLES) dl->late++;
+    if (overrun) dl->overruns++;
+}
+
+/* ============================================================================
+ * SUPERVISION (main loop, every 10 ms)
+ * ========================================================================== */
+bool Deadline_Supervise(SystemData_t *sys, uint32_t elapsed_ms)
+{
+    Deadline_t *dl = &sys->deadline;
+    
+    /* Main-loop liveness */
+    const bool loop_late = elapsed_ms > DEADLINE_LOOP_LATE_MS;
+    if (loop_late) dl->loop_late++;
+    if (elapsed_ms > dl->loop_max_ms) dl->loop_max_ms = elapsed_ms;
+    
+    /* Worst period since the last tick against the half carrier period
+     * (an ISR between the read and the clear is missed) */
+    const uint32_t used = dl->used_max;
+    dl->used_max = 0U;
+    const uint32_t budget = (uint32_t)(sys->svpwm.period / 2U) * (SYSCLK_FREQ_HZ / HRTIM_FREQ_HZ);
+    dl->load = (budget > 0U) ? (float32_t)used / (float32_t)budget : 0.0f;
+    if (dl->load > dl->load_max) dl->load_max = dl->load;
+    
+    const uint32_t overruns = dl->overruns - dl->overruns_seen;
+    dl->overruns_seen += overruns;
+    
+    /* Overload and headroom persistence */
+    if (overruns > 0U || loop_late || dl->load > DEADLINE_LOAD_SHED) {
+        dl->hot_ms += elapsed_ms;
+        dl->cool_ms = 0U;
+    } else {
+        dl->hot_ms = 0U;
+        dl->cool_ms = (dl->load < DEADLINE_LOAD_RESTORE) ? dl->cool_ms + elapsed_ms : 0U;
+    }
+    
+    /* One stage per persistence time: shed in order, restore in reverse */
+    if (dl->hot_ms >= DEADLINE_SHED_MS && dl->level < SHED_STAGES) {
+        dl->shed |= shed_order[dl->level++];
+        dl->sheds++;
+        dl->hot_ms = 0U;
+    } else if (dl->cool_ms >= DEADLINE_RESTORE_MS && dl->level > 0U) {
+        dl->shed &= (uint8_t)~shed_order[--dl->level];
+        dl->cool_ms = 0U;
+    }
+    
+    /* Nothing left to shed: the core loop itself misses */
+    if (dl->level == SHED_STAGES && overruns > 0U) {
+        dl->miss_ms += elapsed_ms;
+    } else {
+        dl->miss_ms = 0U;
+    }
+    return dl->miss_ms >= DEADLINE_TRIP_MS;
+}
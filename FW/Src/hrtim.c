@@ -0,0 +1,357 @@
+/**
+ * @file hrtim.c
+ * @brief HRTIM PWM Driver for 100 kHz T-Type Inverter
+ * @version 2.1
+ * @date 2025-12
+ * 
+ * Timer allocation (two timers per phase, up-down counting):
+ *   Phase A: Timer A (T1 / T2), Timer B (T4 / T3)
+ *   Phase B: Timer C (T1 / T2), Timer D (T4 / T3)
+ *   Phase C: Timer E (T1 / T2), Timer F (T4 / T3)
+ * Output 1 drives the outer switch, output 2 the complementary inner
+ * switch with hardware dead-time insertion.
+ * 
+ * Master timer runs at 2 × fsw and raises the control ISR (MREP) at
+ * every carrier crest and valley. The carrier period can be changed at run
+ * time (HRTIM_SetPeriod); it is preloaded like the compares.
+ * 
+ * Fault inputs FLT1..FLT6 (HRTIM_ConfigFaults) force every output to its
+ * inactive level in hardware; the fault interrupt only classifies.
+ */
+
+#include "hrtim.h"
+#include "config.h"
+#include "types.h"
+
+/* ============================================================================
+ * CONSTANTS
+ * ========================================================================== */
+#define HRTIM_NUM_TIMERS        6
+#define HRTIM_HALF_PERIOD       (HRTIM_PERIOD / 2)      // Up-down: PER = P/2 (at reset)
+#define HRTIM_MIN_PULSE         10                      // Same as SVPWM clamp
+
+#define HRTIM_ALL_TIMERS_UDIS   (HRTIM_CR1_TAUDIS | HRTIM_CR1_TBUDIS | \
+                                 HRTIM_CR1_TCUDIS | HRTIM_CR1_TDUDIS | \
+                                 HRTIM_CR1_TEUDIS | HRTIM_CR1_TFUDIS)
+
+#define HRTIM_ALL_OUTPUTS       (HRTIM_OENR_TA1OEN | HRTIM_OENR_TA2OEN | \
+                                 HRTIM_OENR_TB1OEN | HRTIM_OENR_TB2OEN | \
+                                 HRTIM_OENR_TC1OEN | HRTIM_OENR_TC2OEN | \
+                                 HRTIM_OENR_TD1OEN | HRTIM_OENR_TD2OEN | \
+                                 HRTIM_OENR_TE1OEN | HRTIM_OENR_TE2OEN | \
+                                 HRTIM_OENR_TF1OEN | HRTIM_OENR_TF2OEN)
+
+#define HRTIM_ALL_FAULTS        (HRTIM_FLTR_FLT1EN | HRTIM_FLTR_FLT2EN | HRTIM_FLTR_FLT3EN | \
+                                 HRTIM_FLTR_FLT4EN | HRTIM_FLTR_FLT5EN | HRTIM_FLTR_FLT6EN)
+
+/* FLTINRx byte of one input: enable, polarity, source, filter */
+#define FLT_IN(internal, active_high) \
+    (0x01U | ((active_high) ? 0x02U : 0U) | ((internal) ? 0x04U : 0U) | \
+     ((uint32_t)HWFLT_FILTER << 3))
+
+/* Comparator threshold: Hall output at IAC_HW_TRIP_A */
+#define HWFLT_DAC_CODE          ((uint32_t)((HALL_OFFSET_V + IAC_HW_TRIP_A * HALL_SENSITIVITY) * \
+                                            ADC_MAX_VALUE / ADC_VREF))
+
+/* Carrier period of the values written to the preload registers */
+static uint16_t carrier_period = HRTIM_PERIOD;
+
+/* ============================================================================
+ * PRIVATE HELPERS
+ * ========================================================================== */
+static inline HRTIM_Timerx_TypeDef* Timer(HRTIM_HandleTypeDef *hhrtim, uint32_t idx)
+{
+    return &hhrtim->Instance->sTimerxRegs[idx];
+}
+
+static void ConfigureDeadTime(HRTIM_Timerx_TypeDef *tim, uint16_t dt_rising, uint16_t dt_falling)
+{
+    /* DTPRSC = 3: tDTG = tHRTIM, so dead-time counts are in 170 MHz ticks */
+    tim->DTxR = (3U << HRTIM_DTR_DTPRSC_Pos) |
+                ((uint32_t)(dt_rising & 0x1FFU) << HRTIM_DTR_DTR_Pos) |
+                ((uint32_t)(dt_falling & 0x1FFU) << HRTIM_DTR_DTF_Pos);
+}
+
+static void ConfigureTimer(HRTIM_Timerx_TypeDef *tim)
+{
+    /* Continuous mode, preload enabled, update on repetition event */
+    tim->TIMxCR = HRTIM_TIMCR_CONT | HRTIM_TIMCR_PREEN | HRTIM_TIMCR_TREPU;
+    
+    /* Up-down (center-aligned) counting */
+    tim->TIMxCR2 = HRTIM_TIMCR2_UDM;
+    
+    tim->PERxR = HRTIM_HALF_PERIOD;
+    tim->CMP1xR = HRTIM_HALF_PERIOD;    // Outer switch off
+    
+    /* Output 1 high while counter above CMP1 (symmetric about crest) */
+    tim->SETx1R = HRTIM_SET1R_CMP1;
+    tim->RSTx1R = HRTIM_RST1R_CMP1;
+    
+    /* Output 2 complementary with dead-time, idle level low */
+    tim->OUTxR = HRTIM_OUTR_DTEN;
+    ConfigureDeadTime(tim, HRTIM_DEAD_TIME_RISING, HRTIM_DEAD_TIME_FALLING);
+}
+
+static inline uint32_t DutyToCompare(int32_t on_counts, uint16_t period)
+{
+    /* on_counts is outer-switch on-time in full-period counts */
+    if (on_counts < HRTIM_MIN_PULSE) return period / 2U;            // Held off
+    if (on_counts > period - HRTIM_MIN_PULSE) return 0;             // Held on
+    return period / 2U - ((uint32_t)on_counts >> 1);
+}
+
+/* ============================================================================
+ * INITIALIZATION
+ * ========================================================================== */
+void HRTIM_Init(HRTIM_HandleTypeDef *hhrtim)
+{
+    hhrtim->Instance = HRTIM1;
+    __HAL_RCC_HRTIM1_CLK_ENABLE();
+    
+    /* DLL calibration for high-resolution edges */
+    hhrtim->Instance->sCommonRegs.DLLCR = HRTIM_DLLCR_CAL | HRTIM_DLLCR_CALEN;
+    while ((hhrtim->Instance->sCommonRegs.ISR & HRTIM_ISR_DLLRDY) == 0) { }
+    
+    /* Master timer: control ISR at crest and valley (2 × fsw) */
+    hhrtim->Instance->sMasterRegs.MCR = HRTIM_MCR_CONT | HRTIM_MCR_PREEN | HRTIM_MCR_MREPU;
+    hhrtim->Instance->sMasterRegs.MPER = HRTIM_HALF_PERIOD;
+    hhrtim->Instance->sMasterRegs.MREP = 0;
+    hhrtim->Instance->sMasterRegs.MDIER = HRTIM_MDIER_MREPIE;
+    
+    /* ADC trigger 2 on the same event: injected sampling at crest/valley */
+    hhrtim->Instance->sCommonRegs.ADC2R = HRTIM_ADC2R_AD2MPER;
+    
+    /* Phase timers */
+    for (uint32_t i = 0; i < HRTIM_NUM_TIMERS; i++) {
+        ConfigureTimer(Timer(hhrtim, i));
+    }
+    
+    HRTIM_SetUpdateMode(hhrtim, HRTIM_DOUBLE_UPDATE);
+    
+    /* Outputs stay disabled until HRTIM_EnableOutputs */
+    hhrtim->Instance->sCommonRegs.ODISR = HRTIM_ALL_OUTPUTS;
+    
+    HAL_NVIC_SetPriority(HRTIM1_Master_IRQn, 0, 0);
+    HAL_NVIC_EnableIRQ(HRTIM1_Master_IRQn);
+}
+
+/* ============================================================================
+ * PWM CONTROL
+ * ========================================================================== */
+void HRTIM_Start(HRTIM_HandleTypeDef *hhrtim)
+{
+    /* Start master and all phase timers in the same write for alignment */
+    hhrtim->Instance->sMasterRegs.MCR |= HRTIM_MCR_MCEN |
+                                          HRTIM_MCR_TACEN | HRTIM_MCR_TBCEN |
+                                          HRTIM_MCR_TCCEN | HRTIM_MCR_TDCEN |
+                                          HRTIM_MCR_TECEN | HRTIM_MCR_TFCEN;
+}
+
+void HRTIM_Stop(HRTIM_HandleTypeDef *hhrtim)
+{
+    HRTIM_DisableOutputs(hhrtim);
+    hhrtim->Instance->sMasterRegs.MCR &= ~(HRTIM_MCR_MCEN |
+                                           HRTIM_MCR_TACEN | HRTIM_MCR_TBCEN |
+                                           HRTIM_MCR_TCCEN | HRTIM_MCR_TDCEN |
+                                           HRTIM_MCR_TECEN | HRTIM_MCR_TFCEN);
+}
+
+void HRTIM_EnableOutputs(HRTIM_HandleTypeDef *hhrtim)
+{
+    hhrtim->Instance->sCommonRegs.OENR = HRTIM_ALL_OUTPUTS;
+}
+
+void HRTIM_DisableOutputs(HRTIM_HandleTypeDef *hhrtim)
+{
+    hhrtim->Instance->sCommonRegs.ODISR = HRTIM_ALL_OUTPUTS;
+}
+
+/* ============================================================================
+ * DUTY CYCLE UPDATE
+ * duty = period/2 * (1 + m): m > 0 modulates T1, m < 0 modulates T4
+ * ========================================================================== */
+void HRTIM_SetDuty(HRTIM_HandleTypeDef *hhrtim, 
+                   uint16_t duty_a, uint16_t duty_b, uint16_t duty_c)
+{
+    const uint16_t duty[3] = { duty_a, duty_b, duty_c };
+    
+    /* Freeze preload transfer so both timers of a phase update together */
+    hhrtim->Instance->sCommonRegs.CR1 |= HRTIM_ALL_TIMERS_UDIS;
+    
+    for (uint32_t ph = 0; ph < 3; ph++) {
+        int32_t m_counts = 2 * (int32_t)duty[ph] - carrier_period;  // m × period
+        int32_t upper = (m_counts > 0) ? m_counts : 0;
+        int32_t lower = (m_counts < 0) ? -m_counts : 0;
+        
+        Timer(hhrtim, 2 * ph)->CMP1xR = DutyToCompare(upper, carrier_period);
+        Timer(hhrtim, 2 * ph + 1)->CMP1xR = DutyToCompare(lower, carrier_period);
+    }
+    
+    hhrtim->Instance->sCommonRegs.CR1 &= ~HRTIM_ALL_TIMERS_UDIS;
+}
+
+/* ============================================================================
+ * CARRIER PERIOD
+ * Master and phase periods are preloaded and transfer on the repetition
+ * event. Called right after a crest, the new period and the compares
+ * written in the same ISR transfer together at the valley, so each carrier
+ * period is symmetric and the crest/valley sampling stays centred.
+ * ========================================================================== */
+void HRTIM_SetPeriod(HRTIM_HandleTypeDef *hhrtim, uint16_t period)
+{
+    hhrtim->Instance->sCommonRegs.CR1 |= HRTIM_CR1_MUDIS | HRTIM_ALL_TIMERS_UDIS;
+    
+    hhrtim->Instance->sMasterRegs.MPER = period / 2U;
+    for (uint32_t i = 0; i < HRTIM_NUM_TIMERS; i++) {
+        Timer(hhrtim, i)->PERxR = period / 2U;
+    }
+    carrier_period = period;
+    
+    hhrtim->Instance->sCommonRegs.CR1 &= ~(HRTIM_CR1_MUDIS | HRTIM_ALL_TIMERS_UDIS);
+}
+
+bool HRTIM_CarrierAtCrest(HRTIM_HandleTypeDef *hhrtim)
+{
+    /* Counting down from PER just after a crest, up from 0 after a valley */
+    return Timer(hhrtim, 0)->CNTxR > carrier_period / 4U;
+}
+
+/* ============================================================================
+ * UPDATE MODE
+ * Single: compare preload transferred once per carrier period (valley).
+ * Double: transferred at crest and valley, halving the PWM update latency.
+ * ========================================================================== */
+void HRTIM_SetUpdateMode(HRTIM_HandleTypeDef *hhrtim, bool double_update)
+{
+    for (uint32_t i = 0; i < HRTIM_NUM_TIMERS; i++) {
+        HRTIM_Timerx_TypeDef *tim = Timer(hhrtim, i);
+        
+        /* ROM = 00: repetition at crest and valley, 01: valley only */
+        tim->TIMxCR2 &= ~HRTIM_TIMCR2_ROM;
+        if (!double_update) {
+            tim->TIMxCR2 |= HRTIM_TIMCR2_ROM_0;
+        }
+        tim->REPxR = 0;
+    }
+}
+
+/* ============================================================================
+ * DEAD TIME CONFIGURATION
+ * DTxR is not preloaded and takes effect at the next edge. Called from the
+ * control ISR at a valley right after the compares; both the old and the
+ * new value are at least DEADTIME_MIN_NS, so an edge racing the write is
+ * safe either way.
+ * ========================================================================== */
+void HRTIM_SetDeadTime(HRTIM_HandleTypeDef *hhrtim, uint16_t dt_rising, uint16_t dt_falling)
+{
+    for (uint32_t i = 0; i < HRTIM_NUM_TIMERS; i++) {
+        ConfigureDeadTime(Timer(hhrtim, i), dt_rising, dt_falling);
+    }
+}
+
+/* ============================================================================
+ * HARDWARE FAULT INPUTS
+ * FLT1..3 from pins, FLT4..6 from COMP1/3/5 (their internal fault
+ * sources). Inputs are sampled at fHRTIM and need HWFLT_FILTER consecutive
+ * active samples; the outputs then go to the fault state (inactive, like
+ * idle) and their enable bits clear, so HRTIM_EnableOutputs re-arms them
+ * once the input has been released. The comparators compare the Hall
+ * outputs (INP1, routed next to the ADC inputs on the power board) with
+ * the internal DAC3/DAC4 channel 1 at HWFLT_DAC_CODE.
+ * ========================================================================== */
+void HRTIM_ConfigFaults(HRTIM_HandleTypeDef *hhrtim)
+{
+    GPIO_InitTypeDef GPIO_InitStruct = {0};
+    COMP_TypeDef *const comp[3] = { COMP1, COMP3, COMP5 };
+    
+    __HAL_RCC_GPIOA_CLK_ENABLE();
+    __HAL_RCC_GPIOB_CLK_ENABLE();
+    __HAL_RCC_SYSCFG_CLK_ENABLE();
+    __HAL_RCC_DAC3_CLK_ENABLE();
+    __HAL_RCC_DAC4_CLK_ENABLE();
+    
+    /* Fault pins (open-drain driver outputs, pull-ups on the board) */
+    GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
+    GPIO_InitStruct.Pull = GPIO_NOPULL;
+    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
+    GPIO_InitStruct.Alternate = GPIO_AF13_HRTIM1;
+    GPIO_InitStruct.Pin = FLT_DESAT_PIN | FLT_DRIVER_PIN;
+    HAL_GPIO_Init(FLT_DESAT_PORT, &GPIO_InitStruct);
+    GPIO_InitStruct.Pin = FLT_ESTOP_PIN;
+    HAL_GPIO_Init(FLT_ESTOP_PORT, &GPIO_InitStruct);
+    
+    /* Threshold DACs, internal connection only */
+    DAC3->MCR = DAC_MCR_MODE1_0 | DAC_MCR_MODE1_1;
+    DAC4->MCR = DAC_MCR_MODE1_0 | DAC_MCR_MODE1_1;
+    DAC3->DHR12R1 = HWFLT_DAC_CODE;
+    DAC4->DHR12R1 = HWFLT_DAC_CODE;
+    DAC3->CR = DAC_CR_EN1;
+    DAC4->CR = DAC_CR_EN1;
+    
+    /* INM = DAC (INMSEL 100), INP1, 20 mV hysteresis, locked */
+    for (uint32_t ph = 0; ph < 3; ph++) {
+        comp[ph]->CSR = COMP_CSR_INMSEL_2 | COMP_CSR_INPSEL | COMP_CSR_HYST_1 | COMP_CSR_EN;
+        comp[ph]->CSR |= COMP_CSR_LOCK;
+    }
+    
+    /* Sources and polarity; sampling clock fFLTS = fHRTIM (FLTSD = 00) */
+    hhrtim->Instance->sCommonRegs.FLTINR1 = FLT_IN(false, false) |          // FLT1 DESAT
+                                            (FLT_IN(false, false) << 8) |   // FLT2 driver
+                                            (FLT_IN(false, true) << 16) |   // FLT3 E-stop
+                                            (FLT_IN(true, true) << 24);     // FLT4 COMP1
+    hhrtim->Instance->sCommonRegs.FLTINR2 = FLT_IN(true, true) |            // FLT5 COMP3
+                                            (FLT_IN(true, true) << 8);      // FLT6 COMP5
+    
+    /* Every timer reacts to every input, both outputs to inactive */
+    for (uint32_t i = 0; i < HRTIM_NUM_TIMERS; i++) {
+        HRTIM_Timerx_TypeDef *tim = Timer(hhrtim, i);
+        tim->OUTxR |= HRTIM_OUTR_FAULT1_1 | HRTIM_OUTR_FAULT2_1;
+        tim->FLTxR = HRTIM_ALL_FAULTS | HRTIM_FLTR_FLTLCK;
+    }
+    
+    hhrtim->Instance->sCommonRegs.ICR = HRTIM_ALL_FAULTS;
+    hhrtim->Instance->sCommonRegs.IER |= HRTIM_ALL_FAULTS;
+    HAL_NVIC_SetPriority(HRTIM1_FLT_IRQn, HWFLT_IRQ_PRIORITY, 0);
+    HAL_NVIC_EnableIRQ(HRTIM1_FLT_IRQn);
+}
+
+uint32_t HRTIM_FaultFlags(HRTIM_HandleTypeDef *hhrtim)
+{
+    /* FLT1..FLT6 flags are ISR bits 0..5, HwFaultInput_t order */
+    uint32_t flags = hhrtim->Instance->sCommonRegs.ISR & HRTIM_ALL_FAULTS;
+    
+    hhrtim->Instance->sCommonRegs.ICR = flags;
+    return flags;
+}
+
+uint32_t HRTIM_FaultLevels(HRTIM_HandleTypeDef *hhrtim)
+{
+    uint32_t levels = 0;
+    
+    (void)hhrtim;
+    if (HAL_GPIO_ReadPin(FLT_DESAT_PORT, FLT_DESAT_PIN) == GPIO_PIN_RESET) levels |= HWFLT_BIT(HWFLT_IN_DESAT);
+    if (HAL_GPIO_ReadPin(FLT_DRIVER_PORT, FLT_DRIVER_PIN) == GPIO_PIN_RESET) levels |= HWFLT_BIT(HWFLT_IN_DRIVER);
+    if (HAL_GPIO_ReadPin(FLT_ESTOP_PORT, FLT_ESTOP_PIN) == GPIO_PIN_SET) levels |= HWFLT_BIT(HWFLT_IN_ESTOP);
+    if (COMP1->CSR & COMP_CSR_VALUE) levels |= HWFLT_BIT(HWFLT_IN_OC_A);
+    if (COMP3->CSR & COMP_CSR_VALUE) levels |= HWFLT_BIT(HWFLT_IN_OC_B);
+    if (COMP5->CSR & COMP_CSR_VALUE) levels |= HWFLT_BIT(HWFLT_IN_OC_C);
+    return levels;
+}
+
+/* ============================================================================
+ * MASTER COUNTER
+ * The master timer counts up from the repetition event that starts the
+ * injected conversions and the control ISR, so its count is the time
+ * since the sample, in HRTIM ticks
+ * ========================================================================== */
+uint16_t HRTIM_MasterCount(HRTIM_HandleTypeDef *hhrtim)
+{
+    return (uint16_t)hhrtim->Instance->sMasterRegs.MCNTR;
+}
+
+/* The control ISR clears MREP on entry: set again, the next period has
+ * started before the ISR returned */
+bool HRTIM_RepetitionPending(HRTIM_HandleTypeDef *hhrtim)
+{
+    return (hhrtim->Instance->sMasterRegs.MISR & HRTIM_MISR_MREP) != 0U;
+}
@@ -0,0 +1,233 @@
+/**
+ * @file impedance.c
+ * @brief Grid Impedance Estimator and Gain Scheduling
+ * @version 2.1
+ * @date 2025-12
+ *
+ * The impedance behind the PCC sets how hard the inverter can drive the
+ * grid: a fast PLL couples with a weak grid through the voltage its own
+ * current induces, while a stiff grid leaves margin for a faster current
+ * loop. The estimate comes from a small injection in the synchronous frame.
+ *
+ * At steady state the main loop requests a window; the ISR then adds
+ *
+ *   ΔId* = GRIDZ_INJ_A · sin(ω_i·t)
+ *
+ * to the d-axis current error for GRIDZ_CYCLES periods and correlates the
+ * PCC voltage Vd and the measured Id, Iq with sin/cos of the same phase
+ * (~40 FLOPs per ISR while the window runs). The grid-side branch
+ * (Lg + grid) in the dq frame gives
+ *
+ *   ΔVd = R·ΔId + L·(jω_i·ΔId - ω·ΔIq)
+ *
+ * with phasors at ω_i. Vd is an amplitude and does not see the PLL
+ * response to the injection, which lands in Vq. The filter capacitor
+ * current at the resulting interharmonics is a few mA per volt and is
+ * neglected. Real and imaginary parts give R and L; the measured currents
+ * are used, so neither the current-loop response nor the control delay
+ * biases the result.
+ *
+ * The main loop evaluates a completed window, filters R and L_grid = L - Lg,
+ * and selects a gain band from the SCR with hysteresis. The parameter bank
+ * (params.c) republishes the set in force with its gains scaled to the
+ * band, and the ISR takes them at the start of a period.
+ */
+
+#include "impedance.h"
+#include "control.h"
+#include "params.h"
+#include "config.h"
+#include "arm_math.h"
+#include <math.h>
+#include <string.h>
+
+/* ============================================================================
+ * CONSTANTS
+ * ========================================================================== */
+#define TWO_PI          6.28318530718f
+#define SIG_VD          0U
+#define SIG_ID          1U
+#define SIG_IQ          2U
+
+#define GRIDZ_WINDOW_S  ((float32_t)GRIDZ_CYCLES / GRIDZ_INJ_HZ)
+#define Z_BASE          (VAC_NOMINAL_V * VAC_NOMINAL_V / (float32_t)SYSTEM_POWER_RATING)
+#define GRIDZ_SCR_MAX   100.0f      // Reported for an impedance below resolution
+#define GRIDZ_Z_MIN     (Z_BASE / GRIDZ_SCR_MAX)
+
+static const float32_t band_scr[GAIN_BANDS - 1] = GAIN_BAND_SCR;
+
+/* ============================================================================
+ * INITIALIZATION
+ * ========================================================================== */
+void Impedance_Init(GridImpedance_t *gz)
+{
+    memset(gz, 0, sizeof(*gz));
+}
+
+/* ============================================================================
+ * INJECTION AND CORRELATION (ISR, current loop, grid-following)
+ * ========================================================================== */
+void Impedance_Step(SystemData_t *sys)
+{
+    GridImpedance_t *gz = &sys->gridz;
+    GridZAcc_t *acc = &gz->acc;
+    
+    /* Shed for the deadline: a running or requested window stops at once
+     * and reads as completed; the main loop discards it (disturbed) */
+    if (sys->deadline.shed & SHED_GRIDZ) {
+        acc->running = false;
+        acc->I_inj = 0.0f;
+        acc->seq = gz->req;
+        return;
+    }
+    
+    const float32_t x[GRIDZ_SIGNALS] = { sys->pll.Vd, sys->I_dq.d, sys->I_dq.q };
+    if (!acc->running) {
+        if (acc->seq == gz->req) return;
+    
+        /* New window: the first sample is the DC level removed from all */
+        acc->running = true;
+        acc->cycles = 0;
+        acc->phase = 0.0f;
+        for (uint32_t k = 0; k < GRIDZ_SIGNALS; k++) {
+            acc->x0[k] = x[k];
+            acc->c[k] = 0.0f;
+            acc->s[k] = 0.0f;
+        }
+    }
+    
+    float32_t sn, cs;
+    arm_sin_cos_f32(acc->phase, &sn, &cs);
+    
+    const float32_t Ts = sys->timing.Ts;
+    for (uint32_t k = 0; k < GRIDZ_SIGNALS; k++) {
+        float32_t dx = (x[k] - acc->x0[k]) * Ts;
+        acc->c[k] += dx * cs;
+        acc->s[k] += dx * sn;
+    }
+    acc->I_inj = GRIDZ_INJ_A * sn;
+    
+    acc->phase += 360.0f * GRIDZ_INJ_HZ * Ts;
+    if (acc->phase >= 360.0f) {
+        acc->phase -= 360.0f;
+        if (++acc->cycles >= GRIDZ_CYCLES) {
+            acc->running = false;
+            acc->I_inj = 0.0f;
+            acc->seq = gz->req;
+        }
+    }
+}
+
+/* ============================================================================
+ * EVALUATION (main loop)
+ * ========================================================================== */
+static void Impedance_Evaluate(SystemData_t *sys)
+{
+    GridImpedance_t *gz = &sys->gridz;
+    const GridZAcc_t *acc = &gz->acc;
+    
+    const float32_t w_i = TWO_PI * GRIDZ_INJ_HZ;
+    const float32_t w = sys->pll.omega;
+    
+    /* Phasors X = c - j·s (common scale cancels) */
+    const float32_t vr = acc->c[SIG_VD], vi = -acc->s[SIG_VD];
+    float32_t ar = acc->c[SIG_ID], ai = -acc->s[SIG_ID];
+    float32_t br = acc->c[SIG_IQ], bi = -acc->s[SIG_IQ];
+    
+    /* The current loop must have followed the injection */
+    const float32_t i_amp = 2.0f / GRIDZ_WINDOW_S * sqrtf(ar * ar + ai * ai);
+    if (i_amp < 0.5f * GRIDZ_INJ_A) return;
+    
+    /* Grid current: less the capacitor current Cf·(jω_i·ΔVd, ω·ΔVd), ~10 %
+     * of the injection on a 4 mH grid (the ΔVq terms are left out) */
+    ar += w_i * CF_CAPACITANCE_F * vi;
+    ai -= w_i * CF_CAPACITANCE_F * vr;
+    br -= w * CF_CAPACITANCE_F * vr;
+    bi -= w * CF_CAPACITANCE_F * vi;
+    
+    /* ΔVd = R·a + L·e,  e = jω_i·a - ω·b */
+    const float32_t er = -w_i * ai - w * br;
+    const float32_t ei = w_i * ar - w * bi;
+    const float32_t det = ar * ei - ai * er;
+    if (fabsf(det) < 1e-12f) return;
+    
+    float32_t R = (vr * ei - vi * er) / det;
+    float32_t L_grid = (ar * vi - ai * vr) / det - LG_INDUCTANCE_H;
+    
+    /* Below resolution on a stiff grid, noise can go either way */
+    if (R < 0.0f) R = 0.0f;
+    if (L_grid < 0.0f) L_grid = 0.0f;
+    
+    /* Filtered; a grid switching event (L off by half) restarts the filter */
+    const float32_t L_tot = gz->L_grid + LG_INDUCTANCE_H;
+    const bool jump = fabsf(L_grid + LG_INDUCTANCE_H - L_tot) > GRIDZ_JUMP * L_tot;
+    if (gz->valid && !jump) {
+        gz->R += GRIDZ_FILTER * (R - gz->R);
+        gz->L_grid += GRIDZ_FILTER * (L_grid - gz->L_grid);
+    } else {
+        gz->R = R;
+        gz->L_grid = L_grid;
+        gz->valid = true;
+    }
+    
+    const float32_t X = w * gz->L_grid;
+    const float32_t Z = sqrtf(gz->R * gz->R + X * X);
+    gz->SCR = (Z > GRIDZ_Z_MIN) ? Z_BASE / Z : GRIDZ_SCR_MAX;
+}
+
+/* ============================================================================
+ * GAIN SCHEDULING (main loop)
+ * ========================================================================== */
+static void Impedance_SelectBand(SystemData_t *sys)
+{
+    const float32_t scr = sys->gridz.SCR;
+    uint8_t band = sys->params.band;
+    
+    while (band < GAIN_BANDS - 1 && scr > band_scr[band] * (1.0f + GRIDZ_SCR_HYST)) band++;
+    while (band > 0 && scr < band_scr[band - 1] * (1.0f - GRIDZ_SCR_HYST)) band--;
+    
+    /* Keeps the old band if the ISR has not taken the last swap yet; the
+     * next window retries */
+    (void)Params_SetBand(sys, band);
+}
+
+/* ============================================================================
+ * WINDOW SEQUENCING (main loop, every 10 ms)
+ * ========================================================================== */
+void Impedance_Update(SystemData_t *sys, uint32_t elapsed_ms)
+{
+    GridImpedance_t *gz = &sys->gridz;
+    
+    /* Steady grid-following operation: a ramp or a mode change during the
+     * window would leak into the correlation. Shed for the control ISR
+     * deadline, the ISR aborts a window in progress and it is discarded */
+    const bool steady = (sys->state == STATE_RUN_INVERTER || sys->state == STATE_RUN_RECTIFIER) &&
+                        sys->outputs_enabled && sys->grid_connected && sys->pll.locked &&
+                        !sys->gfm.active && sys->traj.p.v == 0.0f && sys->traj.q.v == 0.0f &&
+                        !(sys->deadline.shed & SHED_GRIDZ);
+    
+    if (steady) {
+        gz->timer_ms += elapsed_ms;
+    } else {
+        gz->timer_ms = 0;
+        gz->disturbed = true;
+    }
+    
+    /* Window completed by the ISR */
+    if (gz->acc.seq != gz->seq_read) {
+        gz->seq_read = gz->acc.seq;
+        gz->timer_ms = 0;
+        if (!gz->disturbed) {
+            gz->windows++;
+            Impedance_Evaluate(sys);
+            if (gz->valid) Impedance_SelectBand(sys);
+        }
+    }
+    
+    /* Next window: a byte write the ISR picks up */
+    uint32_t wait_ms = (gz->windows == 0U) ? GRIDZ_START_MS : GRIDZ_PERIOD_MS;
+    if (steady && gz->req == gz->seq_read && gz->timer_ms >= wait_ms) {
+        gz->disturbed = false;
+        gz->req++;
+    }
+}
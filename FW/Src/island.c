@@ -0,0 +1,189 @@
+/**
+ * @file island.c
+ * @brief Active Anti-Islanding Detection (Sandia Frequency Shift)
+ * @version 2.1
+ * @date 2025-12
+ *
+ * A PLL that stays locked is not proof of a grid: with the local load
+ * matched to the inverter output, the PCC voltage holds its amplitude and
+ * frequency after the utility breaker opens, and the passive check (PLL
+ * unlocked for ANTI_ISLAND_TIME_MS) never fires. The Sandia frequency shift
+ * removes that non-detection zone by turning the current reference ahead
+ * of the PLL frame by a phase that grows with the frequency deviation:
+ *
+ *   φ = 90° · (AI_SFS_CF0 + K · Δf)
+ *
+ * A stiff grid fixes the frequency and φ is a small reactive current. In an
+ * island the load phase has to follow φ; an RLC load turns by 2·Qf/f0 rad
+ * per Hz near resonance, less than φ does, so the frequency drifts away
+ * from nominal in the direction of the first error and keeps accelerating.
+ *
+ * The ISR filters the PLL frequency deviation and its derivative (in
+ * deviation form, where single precision keeps its resolution), watches
+ * the PLL phase error for jumps and updates φ. The main loop arms the
+ * method while following the grid at power and raises the trip from two
+ * criteria:
+ *   - ROCOF: a drift beyond AI_FREQ_DEV_HZ with |df/dt| > AI_ROCOF_HZ_S in
+ *     the same direction for AI_ROCOF_MS (an accelerating runaway; a grid
+ *     event with a large deviation has a low ROCOF and vice versa)
+ *   - Window: the frequency outside AI_FREQ_LOW_HZ .. AI_FREQ_HIGH_HZ for
+ *     AI_WINDOW_MS (a high-Qf island settling at the SFS phase limit)
+ * A phase jump, from a grid fault or from an island with a reactive
+ * mismatch, swings the PLL frequency by several hertz for a few tens of
+ * milliseconds. Fed to the SFS on a weak grid, that swing becomes a
+ * reactive current step that can trip the AC voltage limits, so the SFS
+ * phase and the ROCOF timer are held for AI_JUMP_HOLD_MS after a jump; an
+ * island starts its runaway that much later. Forming modes carry an island
+ * on purpose and are left alone.
+ */
+
+#include "island.h"
+#include "config.h"
+#include "arm_math.h"
+#include <math.h>
+#include <string.h>
+
+/* ============================================================================
+ * CONSTANTS
+ * ========================================================================== */
+#define TWO_PI          6.28318530718f
+#define AI_JUMP_RAD     (AI_PHASE_JUMP_DEG * (TWO_PI / 360.0f))   // Small-angle Vq/Vd
+
+/* ============================================================================
+ * INITIALIZATION
+ * ========================================================================== */
+void Island_Init(AntiIsland_t *ai)
+{
+    memset(ai, 0, sizeof(*ai));
+}
+
+/* ============================================================================
+ * ESTIMATION (ISR, after the PLL)
+ * ========================================================================== */
+void Island_Step(SystemData_t *sys)
+{
+    AntiIsland_t *ai = &sys->island;
+    AiEstimate_t *est = &ai->est;
+    const Pll_t *pll = &sys->pll;
+    const float32_t Ts = sys->timing.Ts;
+    const float32_t dev = pll->frequency - GRID_FREQ_NOMINAL_HZ;
+    
+    if (!ai->armed) {
+        /* Filters start from the present frequency when armed */
+        est->df = dev;
+        est->rocof = 0.0f;
+        est->phi = 0.0f;
+        est->dI.d = 0.0f;
+        est->dI.q = 0.0f;
+        est->jump_hi = false;
+        est->hold_s = 0.0f;
+        return;
+    }
+    
+    /* Frequency deviation and its derivative (first-order filters) */
+    float32_t step = TWO_PI * AI_FREQ_LPF_HZ * Ts * (dev - est->df);
+    est->df += step;
+    est->rocof += TWO_PI * AI_ROCOF_LPF_HZ * (step - Ts * est->rocof);
+    
+    /* Phase jump: the PLL error before the loop has followed it */
+    bool hi = fabsf(pll->Vq) > AI_JUMP_RAD * pll->Vd;
+    if (hi && !est->jump_hi) {
+        est->jumps++;
+        est->hold_s = 1e-3f * AI_JUMP_HOLD_MS;
+    }
+    est->jump_hi = hi;
+    
+    /* SFS phase lead, held over the PLL transient of a jump */
+    if (est->hold_s > 0.0f) {
+        est->hold_s -= Ts;
+        return;
+    }
+    float32_t phi = 90.0f * (AI_SFS_CF0 + AI_SFS_K * est->df);
+    if (phi > AI_SFS_PHI_MAX_DEG) phi = AI_SFS_PHI_MAX_DEG;
+    if (phi < -AI_SFS_PHI_MAX_DEG) phi = -AI_SFS_PHI_MAX_DEG;
+    est->phi = phi;
+}
+
+/* ============================================================================
+ * REFERENCE SHIFT (ISR, current loop, grid-following)
+ * ========================================================================== */
+void Island_Shift(SystemData_t *sys)
+{
+    AiEstimate_t *est = &sys->island.est;
+    
+    if (est->phi == 0.0f) {
+        est->dI.d = 0.0f;
+        est->dI.q = 0.0f;
+        return;
+    }
+    
+    /* The limited reference turned by φ keeps its magnitude */
+    float32_t sn, cs;
+    arm_sin_cos_f32(est->phi, &sn, &cs);
+    est->dI.d = sys->ref.Id_ref * (cs - 1.0f) - sys->ref.Iq_ref * sn;
+    est->dI.q = sys->ref.Id_ref * sn + sys->ref.Iq_ref * (cs - 1.0f);
+}
+
+/* ============================================================================
+ * DETECTION (main loop, slow protection)
+ * ========================================================================== */
+bool Island_Update(SystemData_t *sys, uint32_t elapsed_ms)
+{
+    AntiIsland_t *ai = &sys->island;
+    const AiEstimate_t *est = &ai->est;
+    
+    /* Following a grid with the bridge on */
+    const bool armed = (sys->state == STATE_RUN_INVERTER || sys->state == STATE_RUN_RECTIFIER) &&
+                       sys->outputs_enabled && sys->grid_connected && !sys->gfm.active;
+    
+    if (!armed) {
+        ai->armed = false;
+        ai->jumps_read = est->jumps;
+        ai->jump_timer_ms = 0;
+        ai->rocof_timer_ms = 0;
+        ai->window_timer_ms = 0;
+        return false;
+    }
+    ai->armed = true;
+    
+    /* Phase jump: ROCOF timer held over the PLL transient */
+    if (est->jumps != ai->jumps_read) {
+        ai->jumps_read = est->jumps;
+        ai->jump_timer_ms = AI_JUMP_HOLD_MS;
+    } else if (ai->jump_timer_ms > elapsed_ms) {
+        ai->jump_timer_ms -= elapsed_ms;
+    } else {
+        ai->jump_timer_ms = 0;
+    }
+    
+    /* Accelerating drift away from nominal */
+    const float32_t df = est->df;
+    const float32_t rocof = est->rocof;
+    const bool drift = (df > AI_FREQ_DEV_HZ && rocof > AI_ROCOF_HZ_S) ||
+                       (df < -AI_FREQ_DEV_HZ && rocof < -AI_ROCOF_HZ_S);
+    if (!drift) {
+        ai->rocof_timer_ms = 0;
+    } else if (ai->jump_timer_ms == 0U) {
+        ai->rocof_timer_ms += elapsed_ms;
+    }
+    
+    /* Frequency window */
+    const float32_t f = GRID_FREQ_NOMINAL_HZ + df;
+    if (f < AI_FREQ_LOW_HZ || f > AI_FREQ_HIGH_HZ) {
+        ai->window_timer_ms += elapsed_ms;
+    } else {
+        ai->window_timer_ms = 0;
+    }
+    
+    AiCause_t cause = AI_CAUSE_NONE;
+    if (ai->rocof_timer_ms >= AI_ROCOF_MS) {
+        cause = AI_CAUSE_ROCOF;
+    } else if (ai->window_timer_ms >= AI_WINDOW_MS) {
+        cause = AI_CAUSE_FREQ_WINDOW;
+    }
+    if (cause == AI_CAUSE_NONE) return false;
+    
+    ai->cause = (uint8_t)cause;
+    ai->detections++;
+    return true;
+}
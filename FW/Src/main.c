@@ -8,37 +8,58 @@
  * Control: SVPWM @ 100 kHz, Control Loop @ 200 kHz
  */
 
-#include "stm32g4xx_hal.h"
+#include "main.h"
 #include "config.h"
 #include "types.h"
 #include "adc.h"
 #include "hrtim.h"
 #include "control.h"
+#include "mpc.h"
 #include "protection.h"
+#include "thermal.h"
+#include "impedance.h"
+#include "island.h"
+#include "deadline.h"
+#include "params.h"
 #include "modbus.h"
 #include "can_bms.h"
+#include "recorder.h"
+#include "telemetry.h"
+#include <math.h>
+#if EFFICIENCY_MAP_ENABLE
+#include "eff_map.h"
+#endif
 
 /* ============================================================================
  * GLOBAL VARIABLES
  * ========================================================================== */
-SystemData_t g_sys = {0};
-ModbusRegisters_t g_modbus = {0};
+FW_INSTANCE_LOCAL SystemData_t g_sys = {0};
+FW_INSTANCE_LOCAL ModbusRegisters_t g_modbus = {0};
+FW_INSTANCE_LOCAL ModbusExtended_t g_modbus_ext;
 
 /* Peripheral handles */
 HRTIM_HandleTypeDef hhrtim1;
 ADC_HandleTypeDef hadc1, hadc2;
 FDCAN_HandleTypeDef hfdcan1;
 UART_HandleTypeDef huart3;
+UART_HandleTypeDef huart1;   // Telemetry stream
 TIM_HandleTypeDef htim6;    // Control loop timer
 TIM_HandleTypeDef htim7;    // Millisecond timer
+IWDG_HandleTypeDef hiwdg;
 
 /* ============================================================================
  * FUNCTION PROTOTYPES
  * ========================================================================== */
 static void SystemClock_Config(void);
 static void GPIO_Init(void);
+static void IWDG_Init(void);
 static void StateMachine_Run(void);
-static void UpdateModbusRegisters(void);
+static void EnterRun(bool black_start);
+static void ApplyModbusCommands(void);
+static void ControlIsrTiming(uint32_t start_time, uint32_t entry_ticks);
+#if EFFICIENCY_MAP_ENABLE
+static float32_t ExpectedEfficiency(float32_t P_ac, float32_t Vdc);
+#endif
 
 /* ============================================================================
  * MAIN FUNCTION
@@ -49,77 +70,156 @@ int main(void)
     HAL_Init();
     SystemClock_Config();
     
+    /* Initialize Application */
+    App_Init();
+    
+    /* Main Loop */
+    while (1)
+    {
+        App_MainLoop();
+        
+        /* Small delay for main loop rate; the recorder takes its
+         * keyframes in the idle time between control ISRs */
+#if RECORDER_ENABLE
+        uint32_t t0 = HAL_GetTick();
+        while (HAL_GetTick() - t0 < 10U) {
+            Recorder_Service();
+        }
+#else
+        HAL_Delay(10);
+#endif
+    }
+}
+
+/* ============================================================================
+ * APPLICATION INITIALIZATION
+ * Peripherals, control and state. Also the entry point of the host simulator.
+ * ========================================================================== */
+void App_Init(void)
+{
+    /* Reset cause, before anything clears the flags */
+    bool iwdg_reset = __HAL_RCC_GET_FLAG(RCC_FLAG_IWDGRST) != 0U;
+    __HAL_RCC_CLEAR_RESET_FLAGS();
+    
+    /* Parameters: the newest valid NV record, or the config.h defaults */
+    Params_Init(&g_sys);
+    
     /* Initialize Peripherals */
     GPIO_Init();
     ADC_Init(&hadc1, &hadc2);
     HRTIM_Init(&hhrtim1);
+#if HW_FAULT_ENABLE
+    HRTIM_ConfigFaults(&hhrtim1);
+#endif
     CAN_BMS_Init(&hfdcan1);
     Modbus_Init(&huart3);
+#if TELEMETRY_ENABLE
+    Telemetry_UartInit(&huart1);
+#endif
+    Modbus_InitMap(&g_sys);
     
     /* Initialize Control */
     Control_Init();
     Protection_Init();
+    Thermal_Init(&g_sys.thermal);
+    Impedance_Init(&g_sys.gridz);
+    Island_Init(&g_sys.island);
+    Deadline_Init(&g_sys.deadline, iwdg_reset);
+#if RECORDER_ENABLE
+    Recorder_Init();
+#endif
+    Telemetry_Configure(&g_sys.telem, 0U, 0U);
     
     /* Initialize System State */
     g_sys.state = STATE_INIT;
     g_sys.mode = MODE_GRID_TIED;
     g_sys.faults = FAULT_NONE;
     g_sys.enable_cmd = false;
+    Modbus_WriteHoldingRegister(MODBUS_REG(Vdc_ref_V), (uint16_t)VDC_NOMINAL_V);
     
     /* Start HRTIM PWM (outputs disabled) */
     HRTIM_Start(&hhrtim1);
     
-    /* Start ADC conversions */
+    /* Start ADC conversions, trim current sensor offsets (no current yet) */
     ADC_Start(&hadc1, &hadc2);
+    ADC_CalibrateOffsets();
     
     /* Enable global interrupts */
     __enable_irq();
     
+    /* Main-loop watchdog, from here on; the first tick times from now */
+    IWDG_Init();
+    g_sys.uptime_ms = HAL_GetTick();
+    
     /* Transition to STANDBY */
     g_sys.state = STATE_STANDBY;
+}
+
+/* ============================================================================
+ * MAIN LOOP ITERATION (~100 Hz)
+ * ========================================================================== */
+void App_MainLoop(void)
+{
+    /* g_sys changes from here: Modbus reads get the last tick's registers */
+    Modbus_Hold();
+    
+    /* State Machine (runs in main loop) */
+    StateMachine_Run();
+    
+    /* Apply Modbus commands (registers are converted when read) */
+    ApplyModbusCommands();
+    
+    /* Process Modbus Requests */
+    Modbus_Process();
+    
+#if TELEMETRY_ENABLE
+    /* Binary telemetry frame on its own UART */
+    Telemetry_Process(&g_sys.telem);
+#endif
+    
+    /* Process CAN BMS Data */
+    Recorder_Begin(REC_CMD_BMS);
+    CAN_BMS_Process();
+    Recorder_End(REC_CMD_BMS);
+    
+    /* Dead-time scheduling from current and temperature */
+    Recorder_Begin(REC_CMD_DEADTIME);
+    DeadTime_Schedule(&g_sys);
+    Recorder_End(REC_CMD_DEADTIME);
+    
+    /* This tick's data complete: the next read of 30001+ or 31001+
+     * converts it, and a bank read while held is converted now */
+    Modbus_Lock();
+    Modbus_Invalidate();
+    Modbus_Unlock();
+    
+    /* Update LEDs */
+    if (g_sys.faults != FAULT_NONE) {
+        HAL_GPIO_WritePin(LED_FAULT_PORT, LED_FAULT_PIN, GPIO_PIN_SET);
+    } else {
+        HAL_GPIO_WritePin(LED_FAULT_PORT, LED_FAULT_PIN, GPIO_PIN_RESET);
+    }
     
-    /* Main Loop */
-    while (1)
-    {
-        /* State Machine (runs in main loop) */
-        StateMachine_Run();
-        
-        /* Update Modbus Registers */
-        UpdateModbusRegisters();
-        
-        /* Process Modbus Requests */
-        Modbus_Process();
-        
-        /* Process CAN BMS Data */
-        CAN_BMS_Process();
-        
-        /* Update LEDs */
-        if (g_sys.faults != FAULT_NONE) {
-            HAL_GPIO_WritePin(LED_FAULT_PORT, LED_FAULT_PIN, GPIO_PIN_SET);
-        } else {
-            HAL_GPIO_WritePin(LED_FAULT_PORT, LED_FAULT_PIN, GPIO_PIN_RESET);
-        }
-        
-        if (g_sys.state == STATE_RUN_INVERTER || g_sys.state == STATE_RUN_RECTIFIER) {
-            HAL_GPIO_TogglePin(LED_STATUS_PORT, LED_STATUS_PIN);
-        } else if (g_sys.state == STATE_READY) {
-            HAL_GPIO_WritePin(LED_STATUS_PORT, LED_STATUS_PIN, GPIO_PIN_SET);
-        } else {
-            HAL_GPIO_WritePin(LED_STATUS_PORT, LED_STATUS_PIN, GPIO_PIN_RESET);
-        }
-        
-        /* Small delay for main loop rate */
-        HAL_Delay(10);
+    if (g_sys.state == STATE_RUN_INVERTER || g_sys.state == STATE_RUN_RECTIFIER) {
+        HAL_GPIO_TogglePin(LED_STATUS_PORT, LED_STATUS_PIN);
+    } else if (g_sys.state == STATE_READY) {
+        HAL_GPIO_WritePin(LED_STATUS_PORT, LED_STATUS_PIN, GPIO_PIN_SET);
+    } else {
+        HAL_GPIO_WritePin(LED_STATUS_PORT, LED_STATUS_PIN, GPIO_PIN_RESET);
     }
+    
+    /* Only a main loop that gets round refreshes the watchdog */
+    HAL_IWDG_Refresh(&hiwdg);
 }
 
 /* ============================================================================
- * CONTROL LOOP INTERRUPT (200 kHz / 5 µs)
+ * CONTROL LOOP INTERRUPT (200 kHz / 5 µs at PWM_FREQUENCY_HZ)
  * Called from HRTIM repetition interrupt, synchronized with PWM
  * ========================================================================== */
 void HRTIM1_Master_IRQHandler(void)
 {
     uint32_t start_time = DWT->CYCCNT;
+    uint32_t entry_ticks = HRTIM_MasterCount(&hhrtim1);
     
     /* Clear interrupt flag */
     __HAL_HRTIM_MASTER_CLEAR_IT(&hhrtim1, HRTIM_MASTER_IT_MREP);
@@ -127,33 +227,142 @@ void HRTIM1_Master_IRQHandler(void)
     /* Read ADC Results */
     ADC_ReadResults(&g_sys.dc, &g_sys.ac, &g_sys.temps);
     
+    /* Carrier period: a new one is written after a crest and takes effect
+     * with this ISR's compares at the valley, where the control period
+     * follows it */
+    g_sys.timing.crest = HRTIM_CarrierAtCrest(&hhrtim1);
+    if (g_sys.timing.pending) {
+        Control_SetSampleTime(&g_sys, g_sys.svpwm.period);
+        g_sys.timing.pending = false;
+    }
+    if (g_sys.timing.crest && g_sys.fsw.period_req != g_sys.svpwm.period) {
+        HRTIM_SetPeriod(&hhrtim1, g_sys.fsw.period_req);
+        g_sys.svpwm.period = g_sys.fsw.period_req;
+        g_sys.timing.pending = true;
+    }
+    
+    /* Parameter set for this period, with the controller gains of its band */
+    Params_Load(&g_sys);
+    
     /* Run Protection Checks (hardware-level) */
     if (Protection_CheckFast(&g_sys)) {
         /* Fault detected - disable outputs immediately */
         HRTIM_DisableOutputs(&hhrtim1);
+        Protection_SoftwareTrip(&g_sys, HRTIM_MasterCount(&hhrtim1));
+        g_sys.outputs_enabled = false;
         g_sys.state = STATE_FAULT;
+        ControlIsrTiming(start_time, entry_ticks);
         return;
     }
     
-    /* Run Control Algorithm (only in RUN states) */
-    if (g_sys.state == STATE_RUN_INVERTER || g_sys.state == STATE_RUN_RECTIFIER) {
+    /* Track the grid from GRID_SYNC on; PLL needs the full control rate */
+    if (g_sys.state == STATE_GRID_SYNC) {
+        PLL_Update(&g_sys.pll, g_sys.ac.Va, g_sys.ac.Vb, g_sys.ac.Vc, g_sys.timing.Ts);
+    }
+    
+    /* Run Control Algorithm (RUN states, and STOPPING while the bridge
+     * still switches: the stop ramp needs live duties) */
+    if (g_sys.state == STATE_RUN_INVERTER || g_sys.state == STATE_RUN_RECTIFIER ||
+        (g_sys.state == STATE_STOPPING && g_sys.outputs_enabled)) {
         /* Update PLL */
-        PLL_Update(&g_sys.pll, g_sys.ac.Va, g_sys.ac.Vb, g_sys.ac.Vc);
+        PLL_Update(&g_sys.pll, g_sys.ac.Va, g_sys.ac.Vb, g_sys.ac.Vc, g_sys.timing.Ts);
         
+#if ANTI_ISLAND_ACTIVE
+        /* Anti-islanding: frequency drift, ROCOF, phase jumps, SFS phase */
+        Island_Step(&g_sys);
+#endif
+        
+        /* Jerk-limited P/Q references from the commands (decimated) */
+        Control_Trajectory(&g_sys);
+        
+        /* Grid-forming modes: virtual machine frame and EMF */
+        Control_GridForming(&g_sys);
+        
+        /* DC-link voltage loop sets Id_ref when selected (decimated) */
+        Control_VoltageLoop(&g_sys);
+        
+        /* Scheduled dead time, taken over at a valley */
+        const bool dt_load = DeadTime_Load(&g_sys);
+        
+#if CURRENT_CTRL_FCS_MPC
+        /* FCS-MPC: selects switching state directly */
+        MPC_CurrentLoop(&g_sys);
+#else
         /* Run Current Control Loop */
+        Control_DelayCompensation(&g_sys);
         Control_CurrentLoop(&g_sys);
         
-        /* Generate SVPWM */
+        /* Generate SVPWM at the angle where the duty will take effect */
         SVPWM_Calculate(&g_sys.svpwm, g_sys.V_ref_dq.d, g_sys.V_ref_dq.q, 
-                        g_sys.pll.theta, g_sys.dc.Vdc);
+                        Control_CompensatedTheta(&g_sys), g_sys.dc.Vdc);
+        
+        /* Compensate dead-time voltage error by current polarity */
+        DeadTime_Compensate(&g_sys.svpwm, &g_sys.deadtime, 
+                            g_sys.ac.Ia, g_sys.ac.Ib, g_sys.ac.Ic);
+#endif
         
         /* Update HRTIM Compare Values */
         HRTIM_SetDuty(&hhrtim1, g_sys.svpwm.duty_a, g_sys.svpwm.duty_b, g_sys.svpwm.duty_c);
+        if (dt_load) {
+            HRTIM_SetDeadTime(&hhrtim1, g_sys.deadtime.dt_counts, g_sys.deadtime.dt_counts);
+        }
+        
+        /* Device losses for the junction estimator (decimated) */
+        Thermal_AccumulateLosses(&g_sys);
+        
+        /* Terminal powers, averaged per main-loop tick for the efficiency */
+        PowerAcc_t *pa = &g_sys.power_acc;
+        pa->P_dc_sum[pa->bank] += g_sys.dc.Pdc;
+        pa->P_ac_sum[pa->bank] += g_sys.ac.Pac;
+        pa->n[pa->bank]++;
+#if RECORDER_ENABLE
+        Recorder_Output(g_sys.svpwm.duty_a, g_sys.svpwm.duty_b, g_sys.svpwm.duty_c);
+#endif
     }
     
-    /* Update timing statistics */
+#if TELEMETRY_ENABLE
+    /* Telemetry sample when due (any state) */
+    if (g_sys.telem.period > 0.0f) Telemetry_Capture(&g_sys);
+#endif
+    
+    ControlIsrTiming(start_time, entry_ticks);
+}
+
+/* Timing statistics of every control ISR, the tripping one included; the
+ * deadline counts from the sampling event */
+static void ControlIsrTiming(uint32_t start_time, uint32_t entry_ticks)
+{
     g_sys.control_cycle_count++;
-    g_sys.control_exec_time_us = (DWT->CYCCNT - start_time) / (SYSCLK_FREQ_HZ / 1000000);
+    uint32_t exec_cycles = DWT->CYCCNT - start_time;
+    g_sys.control_exec_time_us = exec_cycles / (SYSCLK_FREQ_HZ / 1000000);
+    Deadline_Isr(&g_sys.deadline, entry_ticks * (SYSCLK_FREQ_HZ / HRTIM_FREQ_HZ), exec_cycles,
+                 HRTIM_RepetitionPending(&hhrtim1));
+}
+
+/* ============================================================================
+ * HARDWARE FAULT INTERRUPT (HRTIM FLT1..FLT6, HWFLT_IRQ_PRIORITY)
+ * The HRTIM has already forced the outputs inactive; this brings the
+ * firmware state along: classify, log, FAULT (EMERGENCY for the E-stop
+ * loop). A fault during the control ISR is taken right after it.
+ * ========================================================================== */
+void HRTIM1_FLT_IRQHandler(void)
+{
+    uint32_t start_time = DWT->CYCCNT;
+    uint32_t inputs = HRTIM_FaultFlags(&hhrtim1);
+    
+    if (inputs == 0U) return;
+    
+    HRTIM_DisableOutputs(&hhrtim1);
+    g_sys.outputs_enabled = false;
+    Protection_HardwareFault(&g_sys, inputs);
+    
+    if (inputs & HWFLT_BIT(HWFLT_IN_ESTOP)) {
+        g_sys.state = STATE_EMERGENCY;
+    } else if (g_sys.state != STATE_EMERGENCY) {
+        g_sys.state = STATE_FAULT;
+    }
+    
+    Protection_FaultReaction(&g_sys, DWT->CYCCNT - start_time);
 }
 
 /* ============================================================================
@@ -161,25 +370,63 @@ void HRTIM1_Master_IRQHandler(void)
  * ========================================================================== */
 static void StateMachine_Run(void)
 {
-    static uint32_t last_tick = 0;
     uint32_t current_tick = HAL_GetTick();
-    uint32_t elapsed = current_tick - last_tick;
+    uint32_t elapsed = current_tick - g_sys.uptime_ms;
     
     /* Update uptime */
     g_sys.uptime_ms = current_tick;
     
+#if HW_FAULT_ENABLE
+    /* Hardware fault inputs still asserted (fault clear conditions) */
+    g_sys.hwflt.active = HRTIM_FaultLevels(&hhrtim1);
+#endif
+    
     /* Check E-Stop */
     if (HAL_GPIO_ReadPin(DI_ESTOP_PORT, DI_ESTOP_PIN) == GPIO_PIN_SET) {
+        Recorder_Begin(REC_CMD_STATE);
         g_sys.faults |= FAULT_ESTOP_ACTIVE;
         g_sys.state = STATE_EMERGENCY;
         HRTIM_DisableOutputs(&hhrtim1);
+        g_sys.outputs_enabled = false;
+        Recorder_End(REC_CMD_STATE);
         return;
     }
     
     /* Run slow protection checks */
+    Recorder_Begin(REC_CMD_STATE | REC_CMD_BMS | REC_CMD_ISLAND | REC_CMD_THERMAL);
     Protection_CheckSlow(&g_sys);
+    Recorder_End(REC_CMD_STATE | REC_CMD_BMS | REC_CMD_ISLAND | REC_CMD_THERMAL);
     
-    /* State Machine */
+    /* Control ISR deadline: optional stages shed first, a trip only when
+     * the core loop alone overruns */
+    if (Deadline_Supervise(&g_sys, elapsed)) {
+        Recorder_Begin(REC_CMD_STATE);
+        HRTIM_DisableOutputs(&hhrtim1);
+        g_sys.outputs_enabled = false;
+        g_sys.faults |= FAULT_WATCHDOG;
+        g_sys.state = STATE_FAULT;
+        Recorder_End(REC_CMD_STATE);
+    }
+    
+    /* Switching frequency from the load and the predicted junction temperature */
+    Recorder_Begin(REC_CMD_FSW);
+    Fsw_Schedule(&g_sys, elapsed);
+    Recorder_End(REC_CMD_FSW);
+    
+    /* Current limits for the ISR: BMS and SOC, at the level's current limit */
+    Recorder_Begin(REC_CMD_ILIM);
+    Control_CurrentLimits(&g_sys, elapsed);
+    Recorder_End(REC_CMD_ILIM);
+    
+#if GRIDZ_ENABLE
+    /* Grid impedance windows and the controller gain band */
+    Recorder_Begin(REC_CMD_GRIDZ | REC_CMD_PARAMS);
+    Impedance_Update(&g_sys, elapsed);
+    Recorder_End(REC_CMD_GRIDZ | REC_CMD_PARAMS);
+#endif
+    
+    /* State Machine (state, direction and output changes for the recorder) */
+    Recorder_Begin(REC_CMD_STATE);
     switch (g_sys.state)
     {
         case STATE_INIT:
@@ -202,17 +449,19 @@ static void StateMachine_Run(void)
         case STATE_PRECHARGE:
             g_sys.state_timer_ms += elapsed;
             
-            /* Check if DC-link is charged */
-            if (g_sys.dc.Vdc >= g_sys.bms.voltage * 0.95f) {
+            /* Check if DC-link is charged (residual step sets contactor inrush) */
+            if (g_sys.dc.Vdc >= g_sys.bms.voltage - PRECHARGE_DV_MAX_V) {
                 /* Pre-charge complete */
                 HAL_GPIO_WritePin(RELAY_MAIN_PORT, RELAY_MAIN_PIN, GPIO_PIN_SET);
+                Recorder_End(REC_CMD_STATE);
                 HAL_Delay(50);  // Contactor settling time
+                Recorder_Begin(REC_CMD_STATE);
                 HAL_GPIO_WritePin(RELAY_PRECHARGE_PORT, RELAY_PRECHARGE_PIN, GPIO_PIN_RESET);
                 g_sys.precharge_complete = true;
                 g_sys.state = STATE_READY;
                 g_sys.state_timer_ms = 0;
             }
-            else if (g_sys.state_timer_ms > PRECHARGE_TIME_MS) {
+            else if (g_sys.state_timer_ms > Params_Get(&g_sys)->precharge_ms) {
                 /* Pre-charge timeout */
                 g_sys.faults |= FAULT_PRECHARGE_FAIL;
                 g_sys.state = STATE_FAULT;
@@ -221,11 +470,11 @@ static void StateMachine_Run(void)
             break;
             
         case STATE_READY:
-            /* Wait for run command and valid grid */
+            /* Wait for run command and valid grid (or a bus to form) */
             if (!g_sys.enable_cmd) {
                 g_sys.state = STATE_STOPPING;
             }
-            else if (g_sys.grid_connected) {
+            else if (g_sys.grid_connected || Control_BlackStartMode(g_sys.mode)) {
                 g_sys.state = STATE_GRID_SYNC;
                 g_sys.state_timer_ms = 0;
                 PLL_Reset(&g_sys.pll);
@@ -235,24 +484,19 @@ static void StateMachine_Run(void)
         case STATE_GRID_SYNC:
             g_sys.state_timer_ms += elapsed;
             
-            /* Update PLL */
-            PLL_Update(&g_sys.pll, g_sys.ac.Va, g_sys.ac.Vb, g_sys.ac.Vc);
-            
+            /* PLL is updated from the control ISR */
             if (g_sys.pll.locked) {
-                /* Grid synchronized - start operation */
-                Control_Reset(&g_sys);
-                HRTIM_EnableOutputs(&hhrtim1);
-                
-                if (g_sys.ref.P_ref >= 0) {
-                    g_sys.state = STATE_RUN_INVERTER;
-                    g_sys.power_dir = POWER_DIR_INVERTER;
-                } else {
-                    g_sys.state = STATE_RUN_RECTIFIER;
-                    g_sys.power_dir = POWER_DIR_RECTIFIER;
-                }
-                HAL_GPIO_WritePin(RELAY_GRID_PORT, RELAY_GRID_PIN, GPIO_PIN_SET);
+                /* Grid (or bus formed by other units) synchronized */
+                EnterRun(false);
+            }
+            else if (Control_BlackStartMode(g_sys.mode) && 
+                     g_sys.state_timer_ms > GFM_DEAD_BUS_MS &&
+                     sqrtf(g_sys.ac.Va * g_sys.ac.Va + g_sys.ac.Vb * g_sys.ac.Vb + 
+                           g_sys.ac.Vc * g_sys.ac.Vc) < GFM_DEAD_BUS_V) {
+                /* Dead bus: form it from zero */
+                EnterRun(true);
             }
-            else if (g_sys.state_timer_ms > GRID_SYNC_TIMEOUT_MS) {
+            else if (g_sys.state_timer_ms > Params_Get(&g_sys)->grid_sync_ms) {
                 /* Grid sync timeout */
                 g_sys.state = STATE_READY;
             }
@@ -262,35 +506,59 @@ static void StateMachine_Run(void)
         case STATE_RUN_RECTIFIER:
             if (!g_sys.enable_cmd || g_sys.faults != FAULT_NONE) {
                 g_sys.state = STATE_STOPPING;
+                g_sys.state_timer_ms = 0;
             }
             
-            /* Check for power direction change */
-            if (g_sys.state == STATE_RUN_INVERTER && g_sys.ref.P_ref < 0) {
+            /* Check for power direction change (forming: the load decides,
+             * with 1 % hysteresis around zero) */
+            float32_t P_dir = g_sys.gfm.active ? g_sys.gfm.P_filt : g_sys.ref.P_ref;
+            float32_t P_hyst = g_sys.gfm.active ? 0.01f * SYSTEM_POWER_RATING : 0.0f;
+            if (g_sys.state == STATE_RUN_INVERTER && P_dir < -P_hyst) {
                 g_sys.state = STATE_RUN_RECTIFIER;
                 g_sys.power_dir = POWER_DIR_RECTIFIER;
             }
-            else if (g_sys.state == STATE_RUN_RECTIFIER && g_sys.ref.P_ref >= 0) {
+            else if (g_sys.state == STATE_RUN_RECTIFIER && P_dir >= P_hyst) {
                 g_sys.state = STATE_RUN_INVERTER;
                 g_sys.power_dir = POWER_DIR_INVERTER;
             }
             
-            /* Calculate efficiency */
-            if (g_sys.dc.Pdc > 1000.0f && g_sys.ac.Pac > 1000.0f) {
-                if (g_sys.power_dir == POWER_DIR_INVERTER) {
-                    g_sys.efficiency = g_sys.ac.Pac / g_sys.dc.Pdc * 100.0f;
+            /* Calculate efficiency from the powers averaged over the tick: a
+             * 10 ms sample of the instantaneous ratio aliases the 100 Hz
+             * ripple. The ISR only writes the other bank after the swap;
+             * both powers are negative when charging */
+            PowerAcc_t *pa = &g_sys.power_acc;
+            uint8_t bank = pa->bank;
+            pa->bank = bank ^ 1U;
+            float32_t n_inv = (pa->n[bank] > 0U) ? 1.0f / (float32_t)pa->n[bank] : 0.0f;
+            float32_t P_dc = fabsf(pa->P_dc_sum[bank]) * n_inv;
+            float32_t P_ac = fabsf(pa->P_ac_sum[bank]) * n_inv;
+            pa->P_dc_sum[bank] = 0.0f;
+            pa->P_ac_sum[bank] = 0.0f;
+            pa->n[bank] = 0U;
+            if (P_dc > EFFICIENCY_MIN_POWER_W && P_ac > EFFICIENCY_MIN_POWER_W) {
+                float32_t eff = (g_sys.power_dir == POWER_DIR_INVERTER) ?
+                                P_ac / P_dc * 100.0f : P_dc / P_ac * 100.0f;
+                float32_t dt = 1e-3f * (float32_t)elapsed;
+                if (g_sys.efficiency <= 0.0f) {
+                    g_sys.efficiency = eff;
                 } else {
-                    g_sys.efficiency = g_sys.dc.Pdc / g_sys.ac.Pac * 100.0f;
+                    g_sys.efficiency += dt / (EFFICIENCY_LPF_TAU_S + dt) * (eff - g_sys.efficiency);
                 }
+#if EFFICIENCY_MAP_ENABLE
+                g_sys.efficiency_expected = ExpectedEfficiency(g_sys.ac.Pac, g_sys.dc.Vdc);
+#endif
             }
             break;
             
         case STATE_STOPPING:
-            /* Ramp down power */
-            g_sys.ref.P_ref *= 0.9f;
-            g_sys.ref.Q_ref *= 0.9f;
+            g_sys.state_timer_ms += elapsed;
             
-            if (fabsf(g_sys.ref.P_ref) < 100.0f) {
+            /* The trajectory ramps P/Q to zero (commands forced to zero);
+             * the timeout only backs it up */
+            if (!g_sys.outputs_enabled || g_sys.traj.idle ||
+                g_sys.state_timer_ms > 2U * REF_STOP_TIME_MS) {
                 HRTIM_DisableOutputs(&hhrtim1);
+                g_sys.outputs_enabled = false;
                 HAL_GPIO_WritePin(RELAY_GRID_PORT, RELAY_GRID_PIN, GPIO_PIN_RESET);
                 g_sys.power_dir = POWER_DIR_IDLE;
                 g_sys.state = STATE_READY;
@@ -300,6 +568,7 @@ static void StateMachine_Run(void)
         case STATE_FAULT:
             /* Outputs already disabled */
             HRTIM_DisableOutputs(&hhrtim1);
+            g_sys.outputs_enabled = false;
             HAL_GPIO_WritePin(RELAY_GRID_PORT, RELAY_GRID_PIN, GPIO_PIN_RESET);
             HAL_GPIO_WritePin(RELAY_MAIN_PORT, RELAY_MAIN_PIN, GPIO_PIN_RESET);
             g_sys.power_dir = POWER_DIR_IDLE;
@@ -313,6 +582,7 @@ static void StateMachine_Run(void)
         case STATE_EMERGENCY:
             /* E-Stop active - all outputs off */
             HRTIM_DisableOutputs(&hhrtim1);
+            g_sys.outputs_enabled = false;
             HAL_GPIO_WritePin(RELAY_GRID_PORT, RELAY_GRID_PIN, GPIO_PIN_RESET);
             HAL_GPIO_WritePin(RELAY_MAIN_PORT, RELAY_MAIN_PIN, GPIO_PIN_RESET);
             HAL_GPIO_WritePin(RELAY_PRECHARGE_PORT, RELAY_PRECHARGE_PIN, GPIO_PIN_RESET);
@@ -328,52 +598,146 @@ static void StateMachine_Run(void)
             g_sys.state = STATE_FAULT;
             break;
     }
+    Recorder_End(REC_CMD_STATE);
+}
+
+static void EnterRun(bool black_start)
+{
+    Control_Reset(&g_sys);
+    if (black_start) g_sys.gfm.E_ramp = 0.0f;
+    HRTIM_EnableOutputs(&hhrtim1);
+    g_sys.outputs_enabled = true;
+    
+    /* Direction of the command; P_ref soft-starts from zero */
+    if (g_sys.ref.P_cmd >= 0) {
+        g_sys.state = STATE_RUN_INVERTER;
+        g_sys.power_dir = POWER_DIR_INVERTER;
+    } else {
+        g_sys.state = STATE_RUN_RECTIFIER;
+        g_sys.power_dir = POWER_DIR_RECTIFIER;
+    }
+    HAL_GPIO_WritePin(RELAY_GRID_PORT, RELAY_GRID_PIN, GPIO_PIN_SET);
+}
+
+/* ============================================================================
+ * MODBUS COMMANDS
+ * Register values are converted by the frame engine when a master reads
+ * them (modbus_map.c); here only the holding registers written since the
+ * last tick are applied, each write once
+ * ========================================================================== */
+static void ApplyModbusCommands(void)
+{
+    /* Frames are handled in the UART interrupt: hold them off so a
+     * multi-register write is taken whole */
+    Modbus_Lock();
+    const uint32_t written = Modbus_TakeWrites();
+    const uint16_t control_word = g_modbus.control_word;
+    const uint16_t mode_select = g_modbus.mode_select;
+    const uint16_t Vdc_ref_V = g_modbus.Vdc_ref_V;
+    const int16_t P_100W = g_modbus.P_ref_100W;
+    const int16_t Q_100VAr = g_modbus.Q_ref_100VAr;
+    const uint32_t telem_mask = ((uint32_t)g_modbus.telem_mask_high << 16) | g_modbus.telem_mask_low;
+    const uint16_t telem_rate = g_modbus.telem_rate_Hz;
+    const uint16_t param_cmd = g_modbus.param_cmd;
+    int16_t P_follow_100W = 0;
+    if (g_sys.vdc_loop.active) {
+        /* Power follows the voltage loop (the trajectory tracks it); writing
+         * it back to the register makes the return to power-reference mode
+         * bumpless */
+        P_follow_100W = (int16_t)(g_sys.ref.P_ref / 100.0f);
+        g_modbus.P_ref_100W = P_follow_100W;
+    }
+    
+    /* Parameter bank: this tick's writes as one set, then defaults or the
+     * NV record on command. A refused set or a replaced one rewrites the
+     * bank with the values in force; the command reads back 0 once taken */
+    const uint32_t param_written = Modbus_TakeParamWrites();
+    bool param_put = false;
+    Recorder_Begin(REC_CMD_PARAMS);
+    if (param_written != 0U) {
+        Params_t p = *Params_Get(&g_sys);
+        Modbus_GetParams(&p, param_written);
+        param_put = !Params_Stage(&g_sys, &p);
+    }
+    if (written & MODBUS_WRITTEN(param_cmd)) {
+        if (param_cmd == PARAM_CMD_DEFAULTS) {
+            Params_t p;
+            Params_Defaults(&p);
+            param_put = Params_Stage(&g_sys, &p) || param_put;
+        } else if (param_cmd == PARAM_CMD_RELOAD) {
+            param_put = Params_Reload(&g_sys) || param_put;
+        }
+        g_modbus.param_cmd = 0U;
+    }
+    if (param_put) Modbus_PutParams(Params_Get(&g_sys));
+    Recorder_End(REC_CMD_PARAMS);
+    Modbus_Unlock();
+    
+    /* Save outside the lock: the erase holds the main loop, not the link */
+    if ((written & MODBUS_WRITTEN(param_cmd)) && param_cmd == PARAM_CMD_SAVE) {
+        (void)Params_Save(&g_sys);
+    }
+    
+    /* Staged parameters to the ISR, gains scaled to the grid band */
+    Recorder_Begin(REC_CMD_PARAMS | REC_CMD_HOST | REC_CMD_REF);
+    (void)Params_Update(&g_sys);
+    
+    if (written & MODBUS_WRITTEN(control_word)) {
+        g_sys.enable_cmd = (control_word & 0x0001) != 0;
+        g_sys.vdc_control = (control_word & 0x0002) != 0;
+        g_sys.fsw_fixed = (control_word & 0x0004) != 0;
+        g_sys.q_priority = (control_word & 0x0008) != 0;
+    }
+    if (written & MODBUS_WRITTEN(mode_select)) {
+        g_sys.mode = (OperationMode_t)(mode_select & 0x0003);
+    }
+    if (written & MODBUS_WRITTEN(Vdc_ref_V)) {
+        float32_t Vdc_ref = (float32_t)Vdc_ref_V;
+        if (Vdc_ref < VDC_MIN_V) Vdc_ref = VDC_MIN_V;
+        if (Vdc_ref > VDC_MAX_V) Vdc_ref = VDC_MAX_V;
+        g_sys.ref.Vdc_ref = Vdc_ref;
+    }
+    if (written & MODBUS_WRITTEN(P_ref_100W)) g_sys.ref.P_set = (float32_t)P_100W * 100.0f;
+    if (written & MODBUS_WRITTEN(Q_ref_100VAr)) g_sys.ref.Q_set = (float32_t)Q_100VAr * 100.0f;
+    if (g_sys.vdc_loop.active) g_sys.ref.P_set = (float32_t)P_follow_100W * 100.0f;
+    if (written & (MODBUS_WRITTEN(telem_mask_low) | MODBUS_WRITTEN(telem_mask_high) |
+                   MODBUS_WRITTEN(telem_rate_Hz))) {
+        Telemetry_Configure(&g_sys.telem, telem_mask, telem_rate);
+    }
     
-    last_tick = current_tick;
+    /* Commands to the reference trajectory: BMS window, thermal derating,
+     * zero while stopping (P_ref/Q_ref are written by the ISR); the limits
+     * move, so this runs every tick */
+    Control_ReferenceCommand(&g_sys, g_sys.ref.P_set, g_sys.ref.Q_set);
+    Recorder_End(REC_CMD_PARAMS | REC_CMD_HOST | REC_CMD_REF);
 }
 
+#if EFFICIENCY_MAP_ENABLE
 /* ============================================================================
- * UPDATE MODBUS REGISTERS
+ * EXPECTED EFFICIENCY (bilinear in the fweffmap table, clamped to its edges)
  * ========================================================================== */
-static void UpdateModbusRegisters(void)
+static uint32_t MapSegment(const float32_t *axis, uint32_t n, float32_t x, float32_t *frac)
+{
+    uint32_t i = 0;
+
+    if (x <= axis[0]) { *frac = 0.0f; return 0; }
+    if (x >= axis[n - 1U]) { *frac = 1.0f; return n - 2U; }
+    while (x > axis[i + 1U]) i++;
+    *frac = (x - axis[i]) / (axis[i + 1U] - axis[i]);
+    return i;
+}
+
+static float32_t ExpectedEfficiency(float32_t P_ac, float32_t Vdc)
 {
-    /* Status Word */
-    g_modbus.status_word = (uint16_t)g_sys.state;
-    g_modbus.status_word |= (g_sys.pll.locked ? 0x0100 : 0);
-    g_modbus.status_word |= (g_sys.grid_connected ? 0x0200 : 0);
-    g_modbus.status_word |= (g_sys.bms.valid ? 0x0400 : 0);
-    
-    /* Fault Codes */
-    g_modbus.fault_code_low = (uint16_t)(g_sys.faults & 0xFFFF);
-    g_modbus.fault_code_high = (uint16_t)((g_sys.faults >> 16) & 0xFFFF);
-    
-    /* DC Measurements */
-    g_modbus.Vdc_10mV = (int16_t)(g_sys.dc.Vdc * 100.0f);
-    g_modbus.Idc_10mA = (int16_t)(g_sys.dc.Idc * 100.0f);
-    g_modbus.Pdc_100W = (int16_t)(g_sys.dc.Pdc / 100.0f);
-    
-    /* AC Measurements */
-    g_modbus.Vac_10mV = (int16_t)(g_sys.ac.Vab * 100.0f);
-    g_modbus.Iac_10mA = (int16_t)(g_sys.ac.Ia * 100.0f);
-    g_modbus.Pac_100W = (int16_t)(g_sys.ac.Pac / 100.0f);
-    g_modbus.Qac_100VAr = (int16_t)(g_sys.ac.Qac / 100.0f);
-    g_modbus.frequency_10mHz = (uint16_t)(g_sys.ac.frequency * 100.0f);
-    g_modbus.pf_1000 = (uint16_t)(g_sys.ac.pf * 1000.0f);
-    
-    /* Temperatures */
-    g_modbus.temp_heatsink_10C = (int16_t)(g_sys.temps.T_heatsink * 10.0f);
-    g_modbus.temp_mosfet_10C = (int16_t)(g_sys.temps.T_max * 10.0f);
-    
-    /* Performance */
-    g_modbus.efficiency_100 = (uint16_t)(g_sys.efficiency * 100.0f);
-    g_modbus.soc_100 = (uint16_t)(g_sys.bms.soc * 100.0f);
-    
-    /* Process control commands from Modbus */
-    g_sys.enable_cmd = (g_modbus.control_word & 0x0001) != 0;
-    g_sys.mode = (OperationMode_t)(g_modbus.mode_select & 0x0003);
-    g_sys.ref.P_ref = (float32_t)g_modbus.P_ref_100W * 100.0f;
-    g_sys.ref.Q_ref = (float32_t)g_modbus.Q_ref_100VAr * 100.0f;
+    float32_t fv, fp;
+    uint32_t v = MapSegment(eff_map_vdc, EFF_MAP_N_VDC, Vdc, &fv);
+    uint32_t p = MapSegment(eff_map_p, EFF_MAP_N_P, P_ac, &fp);
+
+    float32_t e0 = eff_map[v][p] + fp * ((float32_t)eff_map[v][p + 1U] - eff_map[v][p]);
+    float32_t e1 = eff_map[v + 1U][p] + fp * ((float32_t)eff_map[v + 1U][p + 1U] - eff_map[v + 1U][p]);
+    return 0.01f * (e0 + fv * (e1 - e0));
 }
+#endif
 
 /* ============================================================================
  * SYSTEM CLOCK CONFIGURATION (170 MHz)
@@ -461,6 +825,23 @@ static void GPIO_Init(void)
     HAL_GPIO_Init(DI_ENABLE_PORT, &GPIO_InitStruct);
 }
 
+/* ============================================================================
+ * INDEPENDENT WATCHDOG (LSI 32 kHz / 32: 1 ms per count)
+ * Frozen while the core is halted by the debugger
+ * ========================================================================== */
+static void IWDG_Init(void)
+{
+    __HAL_DBGMCU_FREEZE_IWDG();
+    
+    hiwdg.Instance = IWDG;
+    hiwdg.Init.Prescaler = IWDG_PRESCALER_32;
+    hiwdg.Init.Window = IWDG_WINDOW_DISABLE;
+    hiwdg.Init.Reload = IWDG_TIMEOUT_MS;
+    if (HAL_IWDG_Init(&hiwdg) != HAL_OK) {
+        Error_Handler();
+    }
+}
+
 /* ============================================================================
  * ERROR HANDLER
  * ========================================================================== */
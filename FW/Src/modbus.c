@@ -0,0 +1,204 @@
+/**
+ * @file modbus.c
+ * @brief Modbus RTU UART Driver (USART3, RS485)
+ * @version 2.1
+ * @date 2025-12
+ *
+ * Reception runs by DMA into a frame buffer; the USART idle-line event
+ * (one character of silence, 87 µs at 115200 baud) closes the frame and
+ * the callback hands it to the frame engine in modbus_rtu.c in interrupt
+ * context. The response goes out by DMA with the RS485 driver enabled by
+ * GPIO from the start of the transfer until transmission complete (stop
+ * bit of the last byte). The turnaround is therefore independent of the
+ * 10 ms main loop.
+ *
+ * The UART and both DMA channels run at MODBUS_IRQ_PRIORITY, below the
+ * control ISR. Modbus_Lock raises BASEPRI to that level, so the main loop
+ * can update the register image without being interleaved with a frame
+ * while the control ISR keeps running.
+ *
+ * The idle line is shorter than the 3.5-character gap of the RTU
+ * specification; a frame torn by a pause inside it fails its CRC and is
+ * dropped without a response.
+ */
+
+#include "modbus.h"
+#include "main.h"
+#include "config.h"
+
+/* ============================================================================
+ * PRIVATE VARIABLES
+ * ========================================================================== */
+static UART_HandleTypeDef *uart;
+static DMA_HandleTypeDef hdma_rx;
+static DMA_HandleTypeDef hdma_tx;
+static uint8_t rx_buf[MODBUS_ADU_MAX];
+static uint8_t tx_buf[MODBUS_ADU_MAX];
+static volatile bool rx_armed;
+
+/* ============================================================================
+ * PRIVATE HELPERS
+ * ========================================================================== */
+static void ConfigureDma(DMA_HandleTypeDef *hdma, DMA_Channel_TypeDef *instance,
+                         uint32_t request, uint32_t direction)
+{
+    hdma->Instance = instance;
+    hdma->Init.Request = request;
+    hdma->Init.Direction = direction;
+    hdma->Init.PeriphInc = DMA_PINC_DISABLE;
+    hdma->Init.MemInc = DMA_MINC_ENABLE;
+    hdma->Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+    hdma->Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+    hdma->Init.Mode = DMA_NORMAL;
+    hdma->Init.Priority = DMA_PRIORITY_LOW;
+    if (HAL_DMA_Init(hdma) != HAL_OK) {
+        Error_Handler();
+    }
+}
+
+static void StartReception(void)
+{
+    if (HAL_UARTEx_ReceiveToIdle_DMA(uart, rx_buf, sizeof(rx_buf)) == HAL_OK) {
+        /* Only idle line and buffer full end a frame */
+        __HAL_DMA_DISABLE_IT(&hdma_rx, DMA_IT_HT);
+        rx_armed = true;
+    }
+}
+
+/* ============================================================================
+ * INITIALIZATION
+ * ========================================================================== */
+void Modbus_Init(UART_HandleTypeDef *huart)
+{
+    GPIO_InitTypeDef GPIO_InitStruct = {0};
+    
+    uart = huart;
+    
+    __HAL_RCC_USART3_CLK_ENABLE();
+    __HAL_RCC_GPIOC_CLK_ENABLE();
+    __HAL_RCC_DMAMUX1_CLK_ENABLE();
+    __HAL_RCC_DMA1_CLK_ENABLE();
+    
+    /* TX/RX on AF7, driver enable as GPIO (receive by default) */
+    GPIO_InitStruct.Pin = UART_MODBUS_TX_PIN | UART_MODBUS_RX_PIN;
+    GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
+    GPIO_InitStruct.Pull = GPIO_PULLUP;
+    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_HIGH;
+    GPIO_InitStruct.Alternate = GPIO_AF7_USART3;
+    HAL_GPIO_Init(UART_MODBUS_TX_PORT, &GPIO_InitStruct);
+    
+    HAL_GPIO_WritePin(RS485_DE_PORT, RS485_DE_PIN, GPIO_PIN_RESET);
+    GPIO_InitStruct.Pin = RS485_DE_PIN;
+    GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_PP;
+    GPIO_InitStruct.Pull = GPIO_NOPULL;
+    GPIO_InitStruct.Alternate = 0;
+    HAL_GPIO_Init(RS485_DE_PORT, &GPIO_InitStruct);
+    
+    huart->Instance = USART3;
+    huart->Init.BaudRate = MODBUS_BAUDRATE;
+    huart->Init.WordLength = (MODBUS_PARITY != 0) ? UART_WORDLENGTH_9B : UART_WORDLENGTH_8B;
+    huart->Init.StopBits = (MODBUS_STOPBITS == 2) ? UART_STOPBITS_2 : UART_STOPBITS_1;
+    huart->Init.Parity = (MODBUS_PARITY == 1) ? UART_PARITY_ODD :
+                         (MODBUS_PARITY == 2) ? UART_PARITY_EVEN : UART_PARITY_NONE;
+    huart->Init.Mode = UART_MODE_TX_RX;
+    huart->Init.HwFlowCtl = UART_HWCONTROL_NONE;
+    huart->Init.OverSampling = UART_OVERSAMPLING_16;
+    huart->Init.OneBitSampling = UART_ONE_BIT_SAMPLE_DISABLE;
+    huart->Init.ClockPrescaler = UART_PRESCALER_DIV1;
+    huart->AdvancedInit.AdvFeatureInit = UART_ADVFEATURE_NO_INIT;
+    if (HAL_UART_Init(huart) != HAL_OK) {
+        Error_Handler();
+    }
+    
+    ConfigureDma(&hdma_rx, DMA1_Channel2, DMA_REQUEST_USART3_RX, DMA_PERIPH_TO_MEMORY);
+    __HAL_LINKDMA(huart, hdmarx, hdma_rx);
+    ConfigureDma(&hdma_tx, DMA1_Channel3, DMA_REQUEST_USART3_TX, DMA_MEMORY_TO_PERIPH);
+    __HAL_LINKDMA(huart, hdmatx, hdma_tx);
+    
+    HAL_NVIC_SetPriority(USART3_IRQn, MODBUS_IRQ_PRIORITY, 0);
+    HAL_NVIC_EnableIRQ(USART3_IRQn);
+    HAL_NVIC_SetPriority(DMA1_Channel2_IRQn, MODBUS_IRQ_PRIORITY, 0);
+    HAL_NVIC_EnableIRQ(DMA1_Channel2_IRQn);
+    HAL_NVIC_SetPriority(DMA1_Channel3_IRQn, MODBUS_IRQ_PRIORITY, 0);
+    HAL_NVIC_EnableIRQ(DMA1_Channel3_IRQn);
+    
+    StartReception();
+}
+
+/* ============================================================================
+ * LINK SUPERVISION (main loop)
+ * ========================================================================== */
+void Modbus_Process(void)
+{
+    /* A framing, noise or overrun error aborts the DMA reception */
+    Modbus_Lock();
+    if (!rx_armed && uart->RxState == HAL_UART_STATE_READY) {
+        StartReception();
+    }
+    Modbus_Unlock();
+}
+
+void Modbus_Lock(void)
+{
+    __set_BASEPRI(MODBUS_IRQ_PRIORITY << (8U - __NVIC_PRIO_BITS));
+}
+
+void Modbus_Unlock(void)
+{
+    __set_BASEPRI(0U);
+}
+
+/* ============================================================================
+ * HAL CALLBACKS (UART / DMA interrupt)
+ * ========================================================================== */
+void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef *huart, uint16_t Size)
+{
+    if (huart != uart) return;
+    rx_armed = false;
+    
+    /* A master never sends while the response is on the line; a frame
+     * received during transmission is dropped rather than overwrite tx_buf */
+    if (huart->gState == HAL_UART_STATE_READY) {
+        uint16_t len = Modbus_HandleFrame(rx_buf, Size, tx_buf);
+        if (len > 0U) {
+            HAL_GPIO_WritePin(RS485_DE_PORT, RS485_DE_PIN, GPIO_PIN_SET);
+            if (HAL_UART_Transmit_DMA(huart, tx_buf, len) != HAL_OK) {
+                HAL_GPIO_WritePin(RS485_DE_PORT, RS485_DE_PIN, GPIO_PIN_RESET);
+            }
+        }
+    }
+    StartReception();
+}
+
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart)
+{
+    if (huart != uart) return;
+    HAL_GPIO_WritePin(RS485_DE_PORT, RS485_DE_PIN, GPIO_PIN_RESET);
+}
+
+void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart)
+{
+    if (huart != uart) return;
+    if (huart->RxState == HAL_UART_STATE_READY) rx_armed = false;
+    if (huart->gState == HAL_UART_STATE_READY) {
+        HAL_GPIO_WritePin(RS485_DE_PORT, RS485_DE_PIN, GPIO_PIN_RESET);
+    }
+}
+
+/* ============================================================================
+ * INTERRUPT HANDLERS
+ * ========================================================================== */
+void USART3_IRQHandler(void)
+{
+    HAL_UART_IRQHandler(uart);
+}
+
+void DMA1_Channel2_IRQHandler(void)
+{
+    HAL_DMA_IRQHandler(&hdma_rx);
+}
+
+void DMA1_Channel3_IRQHandler(void)
+{
+    HAL_DMA_IRQHandler(&hdma_tx);
+}
@@ -0,0 +1,494 @@
+/**
+ * @file modbus_map.c
+ * @brief Modbus Register Map: Input Registers, Extended Bank, Descriptors,
+ *        Parameter Bank
+ * @version 2.1
+ * @date 2025-12
+ *
+ * Register values are converted from g_sys when a master reads them. The
+ * main loop holds the banks while it updates g_sys (Modbus_Hold) and marks
+ * the tick's data complete once it is done (Modbus_Invalidate); the frame
+ * engine converts the bank a read falls in if it is older than that mark,
+ * in the UART interrupt. A read while the banks are held is answered from
+ * the last conversion, one whole tick, and its bank is converted at the
+ * next mark instead, so the interrupt never converts a tick the main loop
+ * is halfway through. Several reads in one tick share the conversion, and
+ * no master means no conversion at all.
+ *
+ * The 16-bit registers 30001+ keep their historic scaling, which clips the
+ * DC and AC voltages at 327.67 V. The extended bank carries every
+ * measurement, temperature, BMS value, statistic and counter of g_sys as
+ * a 32-bit value: IEEE-754 floats in engineering units, and unsigned or
+ * signed integers with a decimal exponent. It is split in blocks of at
+ * most one FC 04 (125 registers): telemetry at 31001-31124, then the
+ * deadline supervisor and parameter store counters at 31125+. Each block
+ * starts with its own header:
+ *
+ *   +0  version     MODBUS_EXT_VERSION
+ *   +1  values      in this block
+ *   +2  words       of this block (header included)
+ *   +3  sequence    incremented by every conversion, same in every block
+ *   +4  first value of the block, high word first, then 2 registers each
+ *
+ * A master that reads the blocks separately compares the sequence words:
+ * a conversion between its reads shows as a mismatch, and it reads again.
+ *
+ * The descriptor block at 32001+ lets a client find the layout without a
+ * copy of this table: a header (version, entries, words per entry, bank
+ * address) and one entry per value (register offset in the bank, block
+ * headers included, type and
+ * exponent, unit, name; text as 2 ASCII characters per register, NUL
+ * padded). Both are plain word arrays served in place by the frame engine.
+ *
+ * The parameter bank at 41001+ holds the runtime parameters in force as
+ * holding registers, laid out like the extended bank: a header (version
+ * PARAM_VERSION, values, words, descriptor address), then one 32-bit value
+ * per ParamId_t in its own type (F32 or U32, exponent 0). Its descriptors
+ * at 33001+ add the accepted minimum and maximum, in the value's type, to
+ * each entry. A write is taken only as whole values, each in its range;
+ * the main loop then checks the set as a whole and writes the bank back
+ * with the values in force if it refuses it.
+ */
+
+#include "modbus.h"
+#include "params.h"
+#include "config.h"
+#include <string.h>
+
+/* ============================================================================
+ * CONSTANTS
+ * ========================================================================== */
+/* Where a value comes from in SystemData_t */
+typedef enum {
+    SRC_F32 = 0,                // float32_t member
+    SRC_U32,                    // uint32_t member
+    SRC_U16,                    // uint16_t member
+    SRC_U8,                     // uint8_t or bool member
+    SRC_ENUM,                   // enum member (int)
+    SRC_STATUS,                 // Status bits (computed)
+    SRC_FSW                     // Switching frequency from the carrier period
+} ExtSource_t;
+
+typedef struct {
+    const char *name;           // Up to 16 characters
+    const char *unit;           // Up to 4 characters
+    uint8_t type;               // MODBUS_TYPE_*
+    int8_t exp;                 // Decimal exponent of integer types
+    uint8_t src;                // ExtSource_t
+    uint16_t offset;            // offsetof(SystemData_t, ...)
+} ExtValue_t;
+
+#define VAL(id, name, unit, type, exp, src, member) \
+    [id] = { name, unit, MODBUS_TYPE_##type, exp, src, offsetof(SystemData_t, member) }
+
+/* Status bits above the state (bits 0-7) */
+#define STATUS_PLL_LOCKED       0x0100U
+#define STATUS_GRID_CONNECTED   0x0200U
+#define STATUS_BMS_VALID        0x0400U
+#define STATUS_OUTPUTS_ENABLED  0x0800U
+#define STATUS_GRID_FORMING     0x1000U
+#define STATUS_VDC_CONTROL      0x2000U
+
+/* Converted banks, for the reads deferred while held */
+#define BANK_INPUTS             0x01U
+#define BANK_EXTENDED           0x02U
+
+/* Each block one FC 04 */
+_Static_assert(MODBUS_EXT_DIAG_AT <= MODBUS_EXT_BLOCK_MAX &&
+               MODBUS_EXT_WORDS - MODBUS_EXT_DIAG_AT <= MODBUS_EXT_BLOCK_MAX,
+               "extended bank block above 125 registers");
+
+/* ============================================================================
+ * PRIVATE VARIABLES
+ * ========================================================================== */
+static FW_INSTANCE_LOCAL struct {
+    const SystemData_t *sys;    // Source
+    uint32_t tick;              // Modbus_Invalidate count (main loop)
+    uint32_t inputs_tick;       // Tick of the last 30001+ conversion
+    uint32_t ext_tick;          // Tick of the last 31001+ conversion
+    volatile bool held;         // Main loop updating the source
+    uint8_t deferred;           // Banks read while held: BANK_*
+} map;
+
+/* ============================================================================
+ * VALUE TABLE
+ * ========================================================================== */
+static const ExtValue_t ext_values[MB_EXT_COUNT] = {
+    VAL(MB_EXT_STATUS,              "status",        "",    U32,  0, SRC_STATUS, state),
+    VAL(MB_EXT_MODE,                "mode",          "",    U32,  0, SRC_ENUM,   mode),
+    VAL(MB_EXT_FAULTS,              "faults",        "",    U32,  0, SRC_ENUM,   faults),
+    VAL(MB_EXT_FAULT_HISTORY,       "fault_history", "",    U32,  0, SRC_ENUM,   fault_history),
+    
+    VAL(MB_EXT_VDC,                 "vdc",           "V",   F32,  0, SRC_F32,    dc.Vdc),
+    VAL(MB_EXT_VDC_POS,             "vdc_pos",       "V",   F32,  0, SRC_F32,    dc.Vdc_pos),
+    VAL(MB_EXT_VDC_NEG,             "vdc_neg",       "V",   F32,  0, SRC_F32,    dc.Vdc_neg),
+    VAL(MB_EXT_VNP,                 "vnp",           "V",   F32,  0, SRC_F32,    dc.Vnp),
+    VAL(MB_EXT_IDC,                 "idc",           "A",   F32,  0, SRC_F32,    dc.Idc),
+    VAL(MB_EXT_PDC,                 "pdc",           "W",   F32,  0, SRC_F32,    dc.Pdc),
+    
+    VAL(MB_EXT_VAB,                 "vab",           "V",   F32,  0, SRC_F32,    ac.Vab),
+    VAL(MB_EXT_VBC,                 "vbc",           "V",   F32,  0, SRC_F32,    ac.Vbc),
+    VAL(MB_EXT_VCA,                 "vca",           "V",   F32,  0, SRC_F32,    ac.Vca),
+    VAL(MB_EXT_IA,                  "ia",            "A",   F32,  0, SRC_F32,    ac.Ia),
+    VAL(MB_EXT_IB,                  "ib",            "A",   F32,  0, SRC_F32,    ac.Ib),
+    VAL(MB_EXT_IC,                  "ic",            "A",   F32,  0, SRC_F32,    ac.Ic),
+    VAL(MB_EXT_FREQUENCY,           "frequency",     "Hz",  F32,  0, SRC_F32,    ac.frequency),
+    VAL(MB_EXT_PAC,                 "pac",           "W",   F32,  0, SRC_F32,    ac.Pac),
+    VAL(MB_EXT_QAC,                 "qac",           "VAr", F32,  0, SRC_F32,    ac.Qac),
+    VAL(MB_EXT_SAC,                 "sac",           "VA",  F32,  0, SRC_F32,    ac.Sac),
+    VAL(MB_EXT_PF,                  "pf",            "",    F32,  0, SRC_F32,    ac.pf),
+    
+    VAL(MB_EXT_P_CMD,               "p_cmd",         "W",   F32,  0, SRC_F32,    ref.P_cmd),
+    VAL(MB_EXT_Q_CMD,               "q_cmd",         "VAr", F32,  0, SRC_F32,    ref.Q_cmd),
+    VAL(MB_EXT_P_REF,               "p_ref",         "W",   F32,  0, SRC_F32,    ref.P_ref),
+    VAL(MB_EXT_Q_REF,               "q_ref",         "VAr", F32,  0, SRC_F32,    ref.Q_ref),
+    VAL(MB_EXT_VDC_REF,             "vdc_ref",       "V",   F32,  0, SRC_F32,    ref.Vdc_ref),
+    
+    VAL(MB_EXT_T_HEATSINK,          "t_heatsink",    "C",   F32,  0, SRC_F32,    temps.T_heatsink),
+    VAL(MB_EXT_T_INDUCTOR,          "t_inductor",    "C",   F32,  0, SRC_F32,    temps.T_inductor),
+    VAL(MB_EXT_T_AMBIENT,           "t_ambient",     "C",   F32,  0, SRC_F32,    temps.T_ambient),
+    VAL(MB_EXT_TJ_MAX,              "tj_max",        "C",   F32,  0, SRC_F32,    temps.T_max),
+    VAL(MB_EXT_TJ_PRED_MAX,         "tj_pred_max",   "C",   F32,  0, SRC_F32,    thermal.Tj_pred_max),
+    VAL(MB_EXT_P_LOSS,              "p_loss",        "W",   F32,  0, SRC_F32,    thermal.P_total),
+    VAL(MB_EXT_DERATING,            "derating",      "",    F32,  0, SRC_F32,    prot.derating),
+    
+    VAL(MB_EXT_BMS_VOLTAGE,         "bms_voltage",   "V",   F32,  0, SRC_F32,    bms.voltage),
+    VAL(MB_EXT_BMS_CURRENT,         "bms_current",   "A",   F32,  0, SRC_F32,    bms.current),
+    VAL(MB_EXT_BMS_SOC,             "bms_soc",       "%",   F32,  0, SRC_F32,    bms.soc),
+    VAL(MB_EXT_BMS_SOH,             "bms_soh",       "%",   F32,  0, SRC_F32,    bms.soh),
+    VAL(MB_EXT_BMS_T_MAX,           "bms_t_max",     "C",   F32,  0, SRC_F32,    bms.temperature_max),
+    VAL(MB_EXT_BMS_T_MIN,           "bms_t_min",     "C",   F32,  0, SRC_F32,    bms.temperature_min),
+    VAL(MB_EXT_BMS_CHARGE_LIMIT,    "bms_chg_limit", "A",   F32,  0, SRC_F32,    bms.charge_limit),
+    VAL(MB_EXT_BMS_DISCHARGE_LIMIT, "bms_dis_limit", "A",   F32,  0, SRC_F32,    bms.discharge_limit),
+    VAL(MB_EXT_BMS_STATUS,          "bms_status",    "",    U32,  0, SRC_U32,    bms.status),
+    
+    VAL(MB_EXT_EFFICIENCY,          "efficiency",    "%",   F32,  0, SRC_F32,    efficiency),
+    VAL(MB_EXT_EFFICIENCY_EXPECTED, "eff_expected",  "%",   F32,  0, SRC_F32,    efficiency_expected),
+    VAL(MB_EXT_ENERGY_INVERTER,     "energy_inv",    "kWh", U32, -3, SRC_F32,    energy_inverter_kWh),
+    VAL(MB_EXT_ENERGY_RECTIFIER,    "energy_rect",   "kWh", U32, -3, SRC_F32,    energy_rectifier_kWh),
+    VAL(MB_EXT_RUN_TIME,            "run_time",      "h",   U32,  0, SRC_U32,    run_time_hours),
+    VAL(MB_EXT_FAULT_COUNT,         "fault_count",   "",    U32,  0, SRC_U32,    fault_count),
+    VAL(MB_EXT_UPTIME,              "uptime",        "ms",  U32,  0, SRC_U32,    uptime_ms),
+    VAL(MB_EXT_CYCLE_COUNT,         "cycle_count",   "",    U32,  0, SRC_U32,    control_cycle_count),
+    VAL(MB_EXT_EXEC_TIME,           "exec_time",     "us",  U32,  0, SRC_U16,    control_exec_time_us),
+    
+    VAL(MB_EXT_FSW,                 "fsw",           "Hz",  F32,  0, SRC_FSW,    svpwm.period),
+    VAL(MB_EXT_GRID_SCR,            "grid_scr",      "",    F32,  0, SRC_F32,    gridz.SCR),
+    VAL(MB_EXT_GRID_R,              "grid_r",        "Ohm", F32,  0, SRC_F32,    gridz.R),
+    VAL(MB_EXT_GRID_L,              "grid_l",        "H",   I32, -6, SRC_F32,    gridz.L_grid),
+    VAL(MB_EXT_ISLAND_DETECTIONS,   "island_trips",  "",    U32,  0, SRC_U32,    island.detections),
+    
+    VAL(MB_EXT_HWFLT_TRIPS,         "hwflt_trips",   "",    U32,  0, SRC_U32,    hwflt.head),
+    VAL(MB_EXT_HWFLT_INPUTS,        "hwflt_inputs",  "",    U32,  0, SRC_U32,    hwflt.last_inputs),
+    VAL(MB_EXT_HWFLT_REACT_MAX,     "hwflt_react",   "ns",  U32,  0, SRC_U32,    hwflt.react_ns_max),
+    VAL(MB_EXT_SW_TRIP_LATENCY,     "sw_trip",       "ns",  U32,  0, SRC_U32,    hwflt.sw_trip_ns_max),
+    
+    VAL(MB_EXT_ISR_LOAD,            "isr_load",      "",    F32,  0, SRC_F32,    deadline.load),
+    VAL(MB_EXT_ISR_LOAD_MAX,        "isr_load_max",  "",    F32,  0, SRC_F32,    deadline.load_max),
+    VAL(MB_EXT_ISR_OVERRUNS,        "isr_overruns",  "",    U32,  0, SRC_U32,    deadline.overruns),
+    VAL(MB_EXT_ISR_LATE,            "isr_late",      "",    U32,  0, SRC_U32,    deadline.late),
+    VAL(MB_EXT_ISR_SHED,            "isr_shed",      "",    U32,  0, SRC_U8,     deadline.shed),
+    VAL(MB_EXT_LOOP_LATE,           "loop_late",     "",    U32,  0, SRC_U32,    deadline.loop_late),
+    VAL(MB_EXT_IWDG_RESET,          "iwdg_reset",    "",    U32,  0, SRC_U8,     deadline.iwdg_reset),
+    
+    VAL(MB_EXT_PARAM_SEQ,           "param_seq",     "",    U32,  0, SRC_U32,    params.seq),
+    VAL(MB_EXT_PARAM_REJECTS,       "param_rejects", "",    U32,  0, SRC_U32,    params.rejects),
+    VAL(MB_EXT_PARAM_NV,            "param_nv",      "",    U32,  0, SRC_U8,     params.nv),
+    VAL(MB_EXT_PARAM_NV_SEQ,        "param_nv_seq",  "",    U32,  0, SRC_U32,    params.nv_seq),
+};
+
+/* ============================================================================
+ * PRIVATE HELPERS
+ * ========================================================================== */
+static uint32_t FloatBits(float32_t x)
+{
+    uint32_t u;
+    memcpy(&u, &x, sizeof(u));
+    return u;
+}
+
+/* Float in the entry's unit to raw = x / 10^exp, rounded and saturated */
+static uint32_t Scaled(float32_t x, const ExtValue_t *v)
+{
+    for (int8_t e = v->exp; e < 0; e++) x *= 10.0f;
+    for (int8_t e = v->exp; e > 0; e--) x *= 0.1f;
+    
+    if (v->type == MODBUS_TYPE_U32) {
+        if (!(x > 0.0f)) return 0U;
+        if (x >= 4294967040.0f) return UINT32_MAX;
+        return (uint32_t)(x + 0.5f);
+    }
+    if (x >= 2147483520.0f) return (uint32_t)INT32_MAX;
+    if (x <= -2147483648.0f) return (uint32_t)INT32_MIN;
+    return (uint32_t)(int32_t)((x >= 0.0f) ? x + 0.5f : x - 0.5f);
+}
+
+/* 16-bit register scaling, saturated: Vdc and Vac in 10 mV clip at
+ * 327.67 V instead of wrapping; the extended bank carries the full value */
+static int16_t RegS16(float32_t x)
+{
+    if (x >= 32767.0f) return INT16_MAX;
+    if (x <= -32768.0f) return INT16_MIN;
+    return (int16_t)x;
+}
+
+static uint16_t RegU16(float32_t x)
+{
+    if (x >= 65535.0f) return UINT16_MAX;
+    if (!(x > 0.0f)) return 0U;
+    return (uint16_t)x;
+}
+
+static uint32_t StatusBits(const SystemData_t *sys)
+{
+    uint32_t s = (uint32_t)sys->state & 0xFFU;
+    
+    if (sys->pll.locked) s |= STATUS_PLL_LOCKED;
+    if (sys->grid_connected) s |= STATUS_GRID_CONNECTED;
+    if (sys->bms.valid) s |= STATUS_BMS_VALID;
+    if (sys->outputs_enabled) s |= STATUS_OUTPUTS_ENABLED;
+    if (sys->gfm.active) s |= STATUS_GRID_FORMING;
+    if (sys->vdc_loop.active) s |= STATUS_VDC_CONTROL;
+    return s;
+}
+
+static uint32_t Encode(const ExtValue_t *v, const SystemData_t *sys)
+{
+    const uint8_t *p = (const uint8_t *)sys + v->offset;
+    float32_t f;
+    uint32_t u32;
+    uint16_t u16;
+    int e;
+    
+    switch (v->src) {
+        case SRC_F32:
+            memcpy(&f, p, sizeof(f));
+            return (v->type == MODBUS_TYPE_F32) ? FloatBits(f) : Scaled(f, v);
+        case SRC_U32:
+            memcpy(&u32, p, sizeof(u32));
+            return u32;
+        case SRC_U16:
+            memcpy(&u16, p, sizeof(u16));
+            return u16;
+        case SRC_U8:
+            return *p;
+        case SRC_ENUM:
+            memcpy(&e, p, sizeof(e));
+            return (uint32_t)e;
+        case SRC_STATUS:
+            return StatusBits(sys);
+        case SRC_FSW:
+            memcpy(&u16, p, sizeof(u16));
+            return FloatBits((u16 != 0U) ? (float32_t)HRTIM_FREQ_HZ / (float32_t)u16 : 0.0f);
+        default:
+            return 0U;
+    }
+}
+
+/* Text as 2 characters per register, first character in the high byte */
+static void PutText(uint16_t *w, uint32_t words, const char *text)
+{
+    size_t n = strlen(text);
+    
+    for (uint32_t i = 0; i < words; i++) {
+        uint8_t hi = (2U * i < n) ? (uint8_t)text[2U * i] : 0U;
+        uint8_t lo = (2U * i + 1U < n) ? (uint8_t)text[2U * i + 1U] : 0U;
+        w[i] = (uint16_t)(((uint16_t)hi << 8) | lo);
+    }
+}
+
+/* ============================================================================
+ * INITIALIZATION
+ * ========================================================================== */
+void Modbus_InitMap(const SystemData_t *sys)
+{
+    ModbusExtended_t *x = &g_modbus_ext;
+    
+    /* Both banks stale until the first read */
+    map.sys = sys;
+    map.tick = 1U;
+    map.inputs_tick = 0U;
+    map.ext_tick = 0U;
+    map.held = false;
+    map.deferred = 0U;
+    
+    memset(x, 0, sizeof(*x));
+    x->bank[0] = MODBUS_EXT_VERSION;
+    x->bank[1] = MB_EXT_DIAG_FIRST;
+    x->bank[2] = MODBUS_EXT_DIAG_AT;
+    x->bank[MODBUS_EXT_DIAG_AT + 0] = MODBUS_EXT_VERSION;
+    x->bank[MODBUS_EXT_DIAG_AT + 1] = MB_EXT_COUNT - MB_EXT_DIAG_FIRST;
+    x->bank[MODBUS_EXT_DIAG_AT + 2] = MODBUS_EXT_WORDS - MODBUS_EXT_DIAG_AT;
+    
+    x->desc[0] = MODBUS_EXT_VERSION;
+    x->desc[1] = MB_EXT_COUNT;
+    x->desc[2] = MODBUS_DESC_ENTRY;
+    x->desc[3] = MODBUS_EXT_BASE;
+    for (uint32_t i = 0; i < MB_EXT_COUNT; i++) {
+        const ExtValue_t *v = &ext_values[i];
+        uint16_t *d = &x->desc[MODBUS_DESC_HEADER + MODBUS_DESC_ENTRY * i];
+    
+        d[0] = (uint16_t)MODBUS_EXT_OFFSET(i);
+        d[1] = (uint16_t)(((uint16_t)v->type << 8) | (uint8_t)v->exp);
+        PutText(&d[2], 2, v->unit);
+        PutText(&d[4], 8, v->name);
+    }
+    
+    /* Parameter bank and its descriptors */
+    x->param[0] = PARAM_VERSION;
+    x->param[1] = PARAM_COUNT;
+    x->param[2] = MODBUS_PARAM_WORDS;
+    x->param[3] = MODBUS_PDESC_BASE;
+    Modbus_PutParams(Params_Get(sys));
+    
+    x->pdesc[0] = PARAM_VERSION;
+    x->pdesc[1] = PARAM_COUNT;
+    x->pdesc[2] = MODBUS_PDESC_ENTRY;
+    x->pdesc[3] = MODBUS_PARAM_BASE;
+    for (uint32_t i = 0; i < PARAM_COUNT; i++) {
+        const ParamInfo_t *t = Params_Info(i);
+        uint16_t *d = &x->pdesc[MODBUS_DESC_HEADER + MODBUS_PDESC_ENTRY * i];
+        const uint32_t min = (t->type == MODBUS_TYPE_F32) ? FloatBits(t->min) : (uint32_t)t->min;
+        const uint32_t max = (t->type == MODBUS_TYPE_F32) ? FloatBits(t->max) : (uint32_t)t->max;
+    
+        d[0] = (uint16_t)(MODBUS_PARAM_HEADER + 2U * i);
+        d[1] = (uint16_t)((uint16_t)t->type << 8);
+        PutText(&d[2], 2, t->unit);
+        PutText(&d[4], 8, t->name);
+        d[12] = (uint16_t)(min >> 16);
+        d[13] = (uint16_t)(min & 0xFFFFU);
+        d[14] = (uint16_t)(max >> 16);
+        d[15] = (uint16_t)(max & 0xFFFFU);
+    }
+}
+
+/* ============================================================================
+ * ON-DEMAND CONVERSION
+ * ========================================================================== */
+void Modbus_Hold(void)
+{
+    map.held = true;
+}
+
+void Modbus_Invalidate(void)
+{
+    const uint8_t deferred = map.deferred;
+    
+    map.tick++;
+    map.held = false;
+    map.deferred = 0U;
+    if (deferred & BANK_INPUTS) (void)Modbus_RefreshInputs();
+    if (deferred & BANK_EXTENDED) (void)Modbus_RefreshExtended();
+}
+
+bool Modbus_RefreshInputs(void)
+{
+    const SystemData_t *sys = map.sys;
+    
+    if (sys == NULL || map.inputs_tick == map.tick) return false;
+    if (map.held) {
+        map.deferred |= BANK_INPUTS;
+        return false;
+    }
+    map.inputs_tick = map.tick;
+    
+    /* Status Word */
+    g_modbus.status_word = (uint16_t)sys->state;
+    g_modbus.status_word |= (sys->pll.locked ? 0x0100 : 0);
+    g_modbus.status_word |= (sys->grid_connected ? 0x0200 : 0);
+    g_modbus.status_word |= (sys->bms.valid ? 0x0400 : 0);
+    
+    /* Fault Codes */
+    g_modbus.fault_code_low = (uint16_t)(sys->faults & 0xFFFF);
+    g_modbus.fault_code_high = (uint16_t)((sys->faults >> 16) & 0xFFFF);
+    
+    /* DC Measurements */
+    g_modbus.Vdc_10mV = RegS16(sys->dc.Vdc * 100.0f);
+    g_modbus.Idc_10mA = RegS16(sys->dc.Idc * 100.0f);
+    g_modbus.Pdc_100W = RegS16(sys->dc.Pdc / 100.0f);
+    
+    /* AC Measurements */
+    g_modbus.Vac_10mV = RegS16(sys->ac.Vab * 100.0f);
+    g_modbus.Iac_10mA = RegS16(sys->ac.Ia * 100.0f);
+    g_modbus.Pac_100W = RegS16(sys->ac.Pac / 100.0f);
+    g_modbus.Qac_100VAr = RegS16(sys->ac.Qac / 100.0f);
+    g_modbus.frequency_10mHz = RegU16(sys->ac.frequency * 100.0f);
+    g_modbus.pf_1000 = RegU16(sys->ac.pf * 1000.0f);
+    
+    /* Temperatures */
+    g_modbus.temp_heatsink_10C = RegS16(sys->temps.T_heatsink * 10.0f);
+    g_modbus.temp_mosfet_10C = RegS16(sys->temps.T_max * 10.0f);
+    
+    /* Performance */
+    g_modbus.efficiency_100 = RegU16(sys->efficiency * 100.0f);
+    g_modbus.soc_100 = RegU16(sys->bms.soc * 100.0f);
+    g_modbus.eff_expected_100 = RegU16(sys->efficiency_expected * 100.0f);
+    g_modbus.fsw_100Hz = (sys->svpwm.period != 0U) ? (uint16_t)(HRTIM_FREQ_HZ / 100U / sys->svpwm.period) : 0U;
+    g_modbus.grid_scr_10 = sys->gridz.valid ? RegU16(sys->gridz.SCR * 10.0f) : 0U;
+    g_modbus.grid_L_uH = RegU16(sys->gridz.L_grid * 1e6f);
+    return true;
+}
+
+bool Modbus_RefreshExtended(void)
+{
+    const SystemData_t *sys = map.sys;
+    uint16_t *bank = g_modbus_ext.bank;
+    
+    if (sys == NULL || map.ext_tick == map.tick) return false;
+    if (map.held) {
+        map.deferred |= BANK_EXTENDED;
+        return false;
+    }
+    map.ext_tick = map.tick;
+    
+    for (uint32_t i = 0; i < MB_EXT_COUNT; i++) {
+        uint32_t raw = Encode(&ext_values[i], sys);
+        uint16_t *w = &bank[MODBUS_EXT_OFFSET(i)];
+        w[0] = (uint16_t)(raw >> 16);
+        w[1] = (uint16_t)(raw & 0xFFFFU);
+    }
+    bank[3]++;
+    bank[MODBUS_EXT_DIAG_AT + 3] = bank[3];
+    return true;
+}
+
+/* ============================================================================
+ * PARAMETER BANK
+ * ========================================================================== */
+uint8_t Modbus_CheckParamWrite(uint16_t offset, uint16_t n, const uint8_t *data)
+{
+    /* Header read-only, whole values only */
+    if (offset < MODBUS_PARAM_HEADER || ((offset - MODBUS_PARAM_HEADER) & 1U) != 0U || (n & 1U) != 0U) {
+        return MODBUS_EX_ILLEGAL_ADDRESS;
+    }
+    
+    const uint32_t id = (uint32_t)(offset - MODBUS_PARAM_HEADER) / 2U;
+    for (uint32_t i = 0; i < n / 2U; i++) {
+        const uint8_t *v = &data[4U * i];
+        const uint32_t raw = ((uint32_t)v[0] << 24) | ((uint32_t)v[1] << 16) | ((uint32_t)v[2] << 8) | v[3];
+        if (!Params_CheckRaw(id + i, raw)) return MODBUS_EX_ILLEGAL_VALUE;
+    }
+    return 0;
+}
+
+void Modbus_GetParams(Params_t *p, uint32_t written)
+{
+    const uint16_t *w = &g_modbus_ext.param[MODBUS_PARAM_HEADER];
+    
+    for (uint32_t i = 0; i < PARAM_COUNT; i++) {
+        if (written & (1UL << i)) {
+            (void)Params_SetRaw(p, i, ((uint32_t)w[2U * i] << 16) | w[2U * i + 1U]);
+        }
+    }
+}
+
+void Modbus_PutParams(const Params_t *p)
+{
+    uint16_t *w = &g_modbus_ext.param[MODBUS_PARAM_HEADER];
+    
+    for (uint32_t i = 0; i < PARAM_COUNT; i++) {
+        const uint32_t raw = Params_GetRaw(p, i);
+        w[2U * i] = (uint16_t)(raw >> 16);
+        w[2U * i + 1U] = (uint16_t)(raw & 0xFFFFU);
+    }
+}
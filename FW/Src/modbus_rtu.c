@@ -0,0 +1,346 @@
+/**
+ * @file modbus_rtu.c
+ * @brief Modbus RTU Frame Engine
+ * @version 2.1
+ * @date 2025-12
+ *
+ * Hardware independent: linked unchanged into the target (called from the
+ * UART idle-line interrupt in modbus.c) and the host pty bench (fwrtu).
+ *
+ * The request is parsed in the receive buffer and the response is built
+ * in the transmit buffer straight from the register image g_modbus; there
+ * is no per-register table or copy. Supported functions:
+ *
+ *   03  Read Holding Registers      1..125, from one of: 40001+ (g_modbus),
+ *                                   41001+ parameter bank
+ *   04  Read Input Registers        1..125, from one of: 30001+ (g_modbus),
+ *                                   31001+ extended bank, 32001+ descriptors,
+ *                                   33001+ parameter descriptors
+ *   06  Write Single Register
+ *   16  Write Multiple Registers    1..123
+ *   23  Read/Write Multiple         write 1..121, then read 1..125
+ *
+ * A write is checked completely (function, count, byte count, range)
+ * before the first register changes, so a rejected frame leaves the image
+ * untouched. An accepted one is applied within the interrupt and marks
+ * its registers written; the main loop takes the marks under Modbus_Lock
+ * and applies only those registers, once: P and Q written by one FC 16
+ * reach the reference trajectory in the same main-loop tick. A write to
+ * the parameter bank must cover whole values, each in its range (checked
+ * by the register map); FC 06 there is refused with exception 02.
+ *
+ * Input registers are converted by the register map (modbus_map.c) just
+ * before a read of their bank, when the main loop has new data.
+ */
+
+#include "modbus.h"
+#include "config.h"
+
+/* ============================================================================
+ * CONSTANTS
+ * ========================================================================== */
+#define READ_MAX            125U
+#define WRITE_MAX           123U
+#define RW_WRITE_MAX        121U
+#define EXCEPTION_FLAG      0x80U
+
+/* CRC-16/MODBUS, reflected polynomial 0xA001 */
+static const uint16_t crc_table[256] = {
+    0x0000, 0xC0C1, 0xC181, 0x0140, 0xC301, 0x03C0, 0x0280, 0xC241,
+    0xC601, 0x06C0, 0x0780, 0xC741, 0x0500, 0xC5C1, 0xC481, 0x0440,
+    0xCC01, 0x0CC0, 0x0D80, 0xCD41, 0x0F00, 0xCFC1, 0xCE81, 0x0E40,
+    0x0A00, 0xCAC1, 0xCB81, 0x0B40, 0xC901, 0x09C0, 0x0880, 0xC841,
+    0xD801, 0x18C0, 0x1980, 0xD941, 0x1B00, 0xDBC1, 0xDA81, 0x1A40,
+    0x1E00, 0xDEC1, 0xDF81, 0x1F40, 0xDD01, 0x1DC0, 0x1C80, 0xDC41,
+    0x1400, 0xD4C1, 0xD581, 0x1540, 0xD701, 0x17C0, 0x1680, 0xD641,
+    0xD201, 0x12C0, 0x1380, 0xD341, 0x1100, 0xD1C1, 0xD081, 0x1040,
+    0xF001, 0x30C0, 0x3180, 0xF141, 0x3300, 0xF3C1, 0xF281, 0x3240,
+    0x3600, 0xF6C1, 0xF781, 0x3740, 0xF501, 0x35C0, 0x3480, 0xF441,
+    0x3C00, 0xFCC1, 0xFD81, 0x3D40, 0xFF01, 0x3FC0, 0x3E80, 0xFE41,
+    0xFA01, 0x3AC0, 0x3B80, 0xFB41, 0x3900, 0xF9C1, 0xF881, 0x3840,
+    0x2800, 0xE8C1, 0xE981, 0x2940, 0xEB01, 0x2BC0, 0x2A80, 0xEA41,
+    0xEE01, 0x2EC0, 0x2F80, 0xEF41, 0x2D00, 0xEDC1, 0xEC81, 0x2C40,
+    0xE401, 0x24C0, 0x2580, 0xE541, 0x2700, 0xE7C1, 0xE681, 0x2640,
+    0x2200, 0xE2C1, 0xE381, 0x2340, 0xE101, 0x21C0, 0x2080, 0xE041,
+    0xA001, 0x60C0, 0x6180, 0xA141, 0x6300, 0xA3C1, 0xA281, 0x6240,
+    0x6600, 0xA6C1, 0xA781, 0x6740, 0xA501, 0x65C0, 0x6480, 0xA441,
+    0x6C00, 0xACC1, 0xAD81, 0x6D40, 0xAF01, 0x6FC0, 0x6E80, 0xAE41,
+    0xAA01, 0x6AC0, 0x6B80, 0xAB41, 0x6900, 0xA9C1, 0xA881, 0x6840,
+    0x7800, 0xB8C1, 0xB981, 0x7940, 0xBB01, 0x7BC0, 0x7A80, 0xBA41,
+    0xBE01, 0x7EC0, 0x7F80, 0xBF41, 0x7D00, 0xBDC1, 0xBC81, 0x7C40,
+    0xB401, 0x74C0, 0x7580, 0xB541, 0x7700, 0xB7C1, 0xB681, 0x7640,
+    0x7200, 0xB2C1, 0xB381, 0x7340, 0xB101, 0x71C0, 0x7080, 0xB041,
+    0x5000, 0x90C1, 0x9181, 0x5140, 0x9301, 0x53C0, 0x5280, 0x9241,
+    0x9601, 0x56C0, 0x5780, 0x9741, 0x5500, 0x95C1, 0x9481, 0x5440,
+    0x9C01, 0x5CC0, 0x5D80, 0x9D41, 0x5F00, 0x9FC1, 0x9E81, 0x5E40,
+    0x5A00, 0x9AC1, 0x9B81, 0x5B40, 0x9901, 0x59C0, 0x5880, 0x9841,
+    0x8801, 0x48C0, 0x4980, 0x8941, 0x4B00, 0x8BC1, 0x8A81, 0x4A40,
+    0x4E00, 0x8EC1, 0x8F81, 0x4F40, 0x8D01, 0x4DC0, 0x4C80, 0x8C41,
+    0x4400, 0x84C1, 0x8581, 0x4540, 0x8701, 0x47C0, 0x4680, 0x8641,
+    0x8201, 0x42C0, 0x4380, 0x8341, 0x4100, 0x81C1, 0x8081, 0x4040,
+};
+
+/* ============================================================================
+ * PRIVATE VARIABLES
+ * ========================================================================== */
+static FW_INSTANCE_LOCAL ModbusStats_t stats;
+static FW_INSTANCE_LOCAL uint32_t written;  // MODBUS_WRITTEN bits
+static FW_INSTANCE_LOCAL uint32_t param_written;    // Bit per ParamId_t
+
+/* ============================================================================
+ * PRIVATE HELPERS
+ * ========================================================================== */
+static inline uint16_t *Image(void)
+{
+    return (uint16_t *)&g_modbus;
+}
+
+static inline uint16_t Get16(const uint8_t *p)
+{
+    return (uint16_t)(((uint16_t)p[0] << 8) | p[1]);
+}
+
+static inline void Put16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)(v & 0xFFU);
+}
+
+/* Registers [first, first + n) inside a bank of count registers */
+static inline bool InBank(uint16_t first, uint16_t n, uint16_t count)
+{
+    return first < count && n <= count - first;
+}
+
+/* Input registers [first, first + n) inside one bank: legacy registers,
+ * extended bank or descriptors; NULL if the range spans or leaves them */
+static const uint16_t *InputBank(uint16_t first, uint16_t n)
+{
+    if (InBank(first, n, (uint16_t)MODBUS_INPUT_COUNT)) {
+        if (Modbus_RefreshInputs()) stats.refreshes++;
+        return Image() + MODBUS_HOLDING_COUNT + first;
+    }
+    if (first >= MODBUS_EXT_BASE && InBank((uint16_t)(first - MODBUS_EXT_BASE), n, MODBUS_EXT_WORDS)) {
+        if (Modbus_RefreshExtended()) stats.refreshes++;
+        return &g_modbus_ext.bank[first - MODBUS_EXT_BASE];
+    }
+    if (first >= MODBUS_DESC_BASE && InBank((uint16_t)(first - MODBUS_DESC_BASE), n, MODBUS_DESC_WORDS)) {
+        return &g_modbus_ext.desc[first - MODBUS_DESC_BASE];
+    }
+    if (first >= MODBUS_PDESC_BASE && InBank((uint16_t)(first - MODBUS_PDESC_BASE), n, MODBUS_PDESC_WORDS)) {
+        return &g_modbus_ext.pdesc[first - MODBUS_PDESC_BASE];
+    }
+    return NULL;
+}
+
+/* Holding registers [first, first + n): command registers or parameter
+ * bank; NULL if the range spans or leaves them */
+static uint16_t *HoldingBank(uint16_t first, uint16_t n)
+{
+    if (InBank(first, n, (uint16_t)MODBUS_HOLDING_COUNT)) return Image() + first;
+    if (first >= MODBUS_PARAM_BASE && InBank((uint16_t)(first - MODBUS_PARAM_BASE), n, MODBUS_PARAM_WORDS)) {
+        return &g_modbus_ext.param[first - MODBUS_PARAM_BASE];
+    }
+    return NULL;
+}
+
+/* Exception code of a write of n registers (0: accepted) */
+static uint8_t CheckWrite(uint16_t first, uint16_t n, const uint8_t *data)
+{
+    if (HoldingBank(first, n) == NULL) return MODBUS_EX_ILLEGAL_ADDRESS;
+    if (first < MODBUS_PARAM_BASE) return 0;
+    return Modbus_CheckParamWrite((uint16_t)(first - MODBUS_PARAM_BASE), n, data);
+}
+
+/* Response: byte count and n registers, big-endian */
+static uint16_t ReadRegisters(const uint16_t *regs, uint16_t n, uint8_t *pdu)
+{
+    pdu[1] = (uint8_t)(2U * n);
+    for (uint16_t i = 0; i < n; i++) {
+        Put16(&pdu[2U + 2U * i], regs[i]);
+    }
+    return (uint16_t)(2U + 2U * n);
+}
+
+/* Checked with CheckWrite */
+static void WriteRegisters(uint16_t first, uint16_t n, const uint8_t *data)
+{
+    uint16_t *hold = HoldingBank(first, n);
+    
+    for (uint16_t i = 0; i < n; i++) {
+        hold[i] = Get16(&data[2U * i]);
+    }
+    if (first < MODBUS_PARAM_BASE) {
+        for (uint16_t i = 0; i < n; i++) written |= 1UL << (first + i);
+    } else {
+        const uint16_t id = (uint16_t)((first - MODBUS_PARAM_BASE - MODBUS_PARAM_HEADER) / 2U);
+        for (uint16_t i = 0; i < n / 2U; i++) param_written |= 1UL << (id + i);
+    }
+    stats.writes++;
+}
+
+/* ============================================================================
+ * FUNCTION DISPATCH
+ * req/rsp point at the function code; returns the exception code (0: the
+ * response PDU of *rsp_len bytes is built)
+ * ========================================================================== */
+static uint8_t Execute(const uint8_t *req, uint16_t len, uint8_t *rsp, uint16_t *rsp_len)
+{
+    const uint8_t fc = req[0];
+    
+    rsp[0] = fc;
+    switch (fc) {
+        case MODBUS_FC_READ_HOLDING:
+        case MODBUS_FC_READ_INPUT: {
+            if (len != 5U) return MODBUS_EX_ILLEGAL_VALUE;
+            const uint16_t first = Get16(&req[1]);
+            const uint16_t n = Get16(&req[3]);
+            if (n == 0U || n > READ_MAX) return MODBUS_EX_ILLEGAL_VALUE;
+            const uint16_t *regs = (fc == MODBUS_FC_READ_HOLDING) ? HoldingBank(first, n) : InputBank(first, n);
+            if (regs == NULL) return MODBUS_EX_ILLEGAL_ADDRESS;
+            *rsp_len = ReadRegisters(regs, n, rsp);
+            return 0;
+        }
+        
+        case MODBUS_FC_WRITE_SINGLE: {
+            if (len != 5U) return MODBUS_EX_ILLEGAL_VALUE;
+            const uint16_t addr = Get16(&req[1]);
+            const uint8_t ex = CheckWrite(addr, 1U, &req[3]);
+            if (ex != 0U) return ex;
+            WriteRegisters(addr, 1U, &req[3]);
+            for (uint16_t i = 1; i < 5U; i++) rsp[i] = req[i];
+            *rsp_len = 5U;
+            return 0;
+        }
+        
+        case MODBUS_FC_WRITE_MULTI: {
+            if (len < 6U) return MODBUS_EX_ILLEGAL_VALUE;
+            const uint16_t first = Get16(&req[1]);
+            const uint16_t n = Get16(&req[3]);
+            if (n == 0U || n > WRITE_MAX || req[5] != 2U * n || len != 6U + 2U * n) {
+                return MODBUS_EX_ILLEGAL_VALUE;
+            }
+            const uint8_t ex = CheckWrite(first, n, &req[6]);
+            if (ex != 0U) return ex;
+            WriteRegisters(first, n, &req[6]);
+            for (uint16_t i = 1; i < 5U; i++) rsp[i] = req[i];
+            *rsp_len = 5U;
+            return 0;
+        }
+        
+        case MODBUS_FC_READ_WRITE: {
+            if (len < 10U) return MODBUS_EX_ILLEGAL_VALUE;
+            const uint16_t r_first = Get16(&req[1]);
+            const uint16_t r_n = Get16(&req[3]);
+            const uint16_t w_first = Get16(&req[5]);
+            const uint16_t w_n = Get16(&req[7]);
+            if (r_n == 0U || r_n > READ_MAX || w_n == 0U || w_n > RW_WRITE_MAX ||
+                req[9] != 2U * w_n || len != 10U + 2U * w_n) {
+                return MODBUS_EX_ILLEGAL_VALUE;
+            }
+            if (HoldingBank(r_first, r_n) == NULL) return MODBUS_EX_ILLEGAL_ADDRESS;
+            const uint8_t ex = CheckWrite(w_first, w_n, &req[10]);
+            if (ex != 0U) return ex;
+            /* Write before read (the read returns the new values) */
+            WriteRegisters(w_first, w_n, &req[10]);
+            *rsp_len = ReadRegisters(HoldingBank(r_first, r_n), r_n, rsp);
+            return 0;
+        }
+        
+        default:
+            return MODBUS_EX_ILLEGAL_FUNCTION;
+    }
+}
+
+/* ============================================================================
+ * CRC
+ * ========================================================================== */
+uint16_t Modbus_Crc16(const uint8_t *data, uint16_t len)
+{
+    uint16_t crc = 0xFFFFU;
+    
+    while (len-- > 0U) {
+        crc = (uint16_t)((crc >> 8) ^ crc_table[(crc ^ *data++) & 0xFFU]);
+    }
+    return crc;
+}
+
+/* ============================================================================
+ * FRAME HANDLING
+ * ========================================================================== */
+uint16_t Modbus_HandleFrame(const uint8_t *req, uint16_t len, uint8_t *rsp)
+{
+    if (len < 4U || len > MODBUS_ADU_MAX ||
+        Modbus_Crc16(req, (uint16_t)(len - 2U)) != (uint16_t)(req[len - 2U] | (req[len - 1U] << 8))) {
+        stats.crc_errors++;
+        return 0;
+    }
+    stats.frames++;
+    
+    /* Broadcast: single and multiple writes only, never answered */
+    const uint8_t addr = req[0];
+    const uint8_t fc = req[1];
+    const bool broadcast = (addr == MODBUS_ADDR_BROADCAST);
+    if (addr != MODBUS_SLAVE_ADDRESS && !broadcast) return 0;
+    if (broadcast && fc != MODBUS_FC_WRITE_SINGLE && fc != MODBUS_FC_WRITE_MULTI) return 0;
+    
+    uint16_t pdu_len = 0;
+    const uint8_t ex = Execute(&req[1], (uint16_t)(len - 3U), &rsp[1], &pdu_len);
+    if (broadcast) return 0;
+    
+    rsp[0] = addr;
+    if (ex != 0U) {
+        rsp[1] = (uint8_t)(fc | EXCEPTION_FLAG);
+        rsp[2] = ex;
+        pdu_len = 2U;
+        stats.exceptions++;
+    }
+    
+    const uint16_t crc = Modbus_Crc16(rsp, (uint16_t)(pdu_len + 1U));
+    rsp[pdu_len + 1U] = (uint8_t)(crc & 0xFFU);
+    rsp[pdu_len + 2U] = (uint8_t)(crc >> 8);
+    stats.responses++;
+    return (uint16_t)(pdu_len + 3U);
+}
+
+const ModbusStats_t *Modbus_GetStats(void)
+{
+    return &stats;
+}
+
+uint32_t Modbus_TakeWrites(void)
+{
+    const uint32_t w = written;
+    written = 0U;
+    return w;
+}
+
+uint32_t Modbus_TakeParamWrites(void)
+{
+    const uint32_t w = param_written;
+    param_written = 0U;
+    return w;
+}
+
+/* ============================================================================
+ * REGISTER ACCESS
+ * ========================================================================== */
+uint16_t Modbus_ReadHoldingRegister(uint16_t address)
+{
+    return (address < MODBUS_HOLDING_COUNT) ? Image()[address] : 0U;
+}
+
+void Modbus_WriteHoldingRegister(uint16_t address, uint16_t value)
+{
+    if (address < MODBUS_HOLDING_COUNT) {
+        Image()[address] = value;
+        written |= 1UL << address;
+    }
+}
+
+uint16_t Modbus_ReadInputRegister(uint16_t address)
+{
+    if (address >= MODBUS_INPUT_COUNT) return 0U;
+    (void)Modbus_RefreshInputs();
+    return Image()[MODBUS_HOLDING_COUNT + address];
+}
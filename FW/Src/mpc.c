@@ -0,0 +1,258 @@
+/**
+ * @file mpc.c
+ * @brief Finite-Control-Set Model Predictive Current Control
+ * @version 2.1
+ * @date 2025-12
+ * 
+ * Alternative to PR + carrier SVPWM, selected with CURRENT_CTRL_FCS_MPC.
+ * Each period one of the 27 T-Type switching states is applied for the
+ * whole control period. Candidates are scored against a discrete model
+ * of the LC filter with one-step delay compensation:
+ * 
+ *   i(k+1)  = i(k)  + Ts/Lc * (v_conv(S) - v_cf(k))
+ *   vcf(k+1)= vcf(k) + Ts/Cf * (i(k) - ig(k))
+ *   J       = |i_ref(k+2) - i(k+2)|² + λnp·ΔVnp(k+2)² + λsw·n_sw
+ * 
+ * The 27 states map onto 19 distinct voltage vectors; the current term is
+ * evaluated once per vector and only the NP and switching terms per state.
+ * States that would switch any phase directly between P and N are pruned.
+ * The current reference carries a virtual resistor across Cf, which damps
+ * the resonance of Cf with the grid inductance.
+ */
+
+#include "mpc.h"
+#include "control.h"
+#include "island.h"
+#include "config.h"
+#include <math.h>
+
+/* ============================================================================
+ * CONSTANTS
+ * ========================================================================== */
+#define TWO_PI          6.28318530718f
+
+#define CONTROL_TS      (1.0f / CONTROL_LOOP_FREQ_HZ)  // 5 µs
+#define MPC_AD_ALPHA    (TWO_PI * MPC_AD_LPF_HZ * CONTROL_TS)
+
+#define MPC_NUM_STATES  27
+#define MPC_NUM_VECTORS 19
+#define MPC_STATE_ZERO  13          // (0, 0, 0)
+
+/* Split DC-link: each half is twice the total series capacitance */
+#define CDC_HALF_F      (2.0f * CDC_CAPACITANCE_F)
+
+/* ============================================================================
+ * SWITCHING STATE TABLE
+ * Index = (Sa+1)*9 + (Sb+1)*3 + (Sc+1), levels in {-1, 0, +1}
+ * ========================================================================== */
+typedef struct {
+    int8_t sa;
+    int8_t sb;
+    int8_t sc;
+    uint8_t vec;            // Index into mpc_vectors
+} MpcState_t;
+
+static const MpcState_t mpc_states[MPC_NUM_STATES] = {
+    {-1, -1, -1,  0}, {-1, -1,  0,  1}, {-1, -1,  1,  2},
+    {-1,  0, -1,  3}, {-1,  0,  0,  4}, {-1,  0,  1,  5},
+    {-1,  1, -1,  6}, {-1,  1,  0,  7}, {-1,  1,  1,  8},
+    { 0, -1, -1,  9}, { 0, -1,  0, 10}, { 0, -1,  1, 11},
+    { 0,  0, -1, 12}, { 0,  0,  0,  0}, { 0,  0,  1,  1},
+    { 0,  1, -1, 13}, { 0,  1,  0,  3}, { 0,  1,  1,  4},
+    { 1, -1, -1, 14}, { 1, -1,  0, 15}, { 1, -1,  1, 16},
+    { 1,  0, -1, 17}, { 1,  0,  0,  9}, { 1,  0,  1, 10},
+    { 1,  1, -1, 18}, { 1,  1,  0, 12}, { 1,  1,  1,  0}
+};
+
+/* Normalized αβ voltage vectors (× Vdc/2), amplitude-invariant Clarke */
+static const AlphaBeta_t mpc_vectors[MPC_NUM_VECTORS] = {
+    { 0.00000000f,  0.00000000f}, {-0.33333333f, -0.57735027f},
+    {-0.66666667f, -1.15470054f}, {-0.33333333f,  0.57735027f},
+    {-0.66666667f,  0.00000000f}, {-1.00000000f, -0.57735027f},
+    {-0.66666667f,  1.15470054f}, {-1.00000000f,  0.57735027f},
+    {-1.33333333f,  0.00000000f}, { 0.66666667f,  0.00000000f},
+    { 0.33333333f, -0.57735027f}, { 0.00000000f, -1.15470054f},
+    { 0.33333333f,  0.57735027f}, { 0.00000000f,  1.15470054f},
+    { 1.33333333f,  0.00000000f}, { 1.00000000f, -0.57735027f},
+    { 0.66666667f, -1.15470054f}, { 1.00000000f,  0.57735027f},
+    { 0.66666667f,  1.15470054f}
+};
+
+/* ============================================================================
+ * INITIALIZATION
+ * ========================================================================== */
+void MPC_Init(FcsMpc_t *mpc)
+{
+    mpc->lambda_np = MPC_LAMBDA_NP;
+    mpc->lambda_sw = MPC_LAMBDA_SW;
+    MPC_Reset(mpc);
+}
+
+void MPC_Reset(FcsMpc_t *mpc)
+{
+    mpc->state = MPC_STATE_ZERO;
+    mpc->candidates = 0;
+    mpc->cost = 0.0f;
+    mpc->ig_alpha = 0.0f;
+    mpc->ig_beta = 0.0f;
+    mpc->ad_primed = false;
+}
+
+/* ============================================================================
+ * HELPERS
+ * ========================================================================== */
+static inline int32_t LevelStep(int8_t from, int8_t to)
+{
+    int32_t d = (int32_t)to - (int32_t)from;
+    return (d < 0) ? -d : d;
+}
+
+static inline float32_t NeutralPointCurrent(const MpcState_t *s, 
+                                            float32_t ia, float32_t ib, float32_t ic)
+{
+    /* Phases clamped to NP draw their current from the mid-point */
+    float32_t i_np = 0.0f;
+    if (s->sa == 0) i_np += ia;
+    if (s->sb == 0) i_np += ib;
+    if (s->sc == 0) i_np += ic;
+    return i_np;
+}
+
+static inline uint16_t LevelToCompare(int8_t level)
+{
+    /* Same convention as SVPWM: compare = period/2 * (1 + m) */
+    return (uint16_t)((int32_t)(HRTIM_PERIOD / 2) * (1 + level));
+}
+
+/* ============================================================================
+ * FCS-MPC CURRENT LOOP
+ * ========================================================================== */
+void MPC_CurrentLoop(SystemData_t *sys)
+{
+    FcsMpc_t *mpc = &sys->mpc;
+    AlphaBeta_t I_ab, V_ab, Iref_ab;
+    
+    const float32_t Ts = CONTROL_TS;
+    const float32_t Vdc_half = 0.5f * sys->dc.Vdc;
+    
+    /* Measurements in αβ */
+    Clarke_Transform(sys->ac.Ia, sys->ac.Ib, sys->ac.Ic, &I_ab);
+    Clarke_Transform(sys->ac.Va, sys->ac.Vb, sys->ac.Vc, &V_ab);
+    Park_Transform(I_ab.alpha, I_ab.beta, sys->pll.theta, &sys->I_dq);
+    
+    /* Current references (shared with PR path) */
+    Control_CurrentReference(sys);
+    float32_t Id_ref = sys->ref.Id_ref;
+    float32_t Iq_ref = sys->ref.Iq_ref;
+    
+    /* Virtual resistor across Cf: the tracked converter current is a
+     * current source, which leaves the Cf / grid inductance resonance
+     * (2.4 kHz at 250 µH) undamped. It gives up V/R of the PCC voltage
+     * above MPC_AD_LPF_HZ, i.e. of the resonance and transients. */
+    Dq_t V_dq;
+    Park_Transform(V_ab.alpha, V_ab.beta, sys->pll.theta, &V_dq);
+    if (!mpc->ad_primed) {
+        mpc->V_lp = V_dq;
+        mpc->ad_primed = true;
+    }
+    mpc->V_lp.d += MPC_AD_ALPHA * (V_dq.d - mpc->V_lp.d);
+    mpc->V_lp.q += MPC_AD_ALPHA * (V_dq.q - mpc->V_lp.q);
+    Id_ref -= (V_dq.d - mpc->V_lp.d) * (1.0f / MPC_AD_R_OHM);
+    Iq_ref -= (V_dq.q - mpc->V_lp.q) * (1.0f / MPC_AD_R_OHM);
+    
+#if ANTI_ISLAND_ACTIVE
+    /* Sandia frequency shift, as in the PR path */
+    Island_Shift(sys);
+    Id_ref += sys->island.est.dI.d;
+    Iq_ref += sys->island.est.dI.q;
+#endif
+    
+    /* Grid-side current estimate: converter current minus ripple */
+    float32_t k_ig = TWO_PI * MPC_IG_FILTER_HZ * Ts;
+    mpc->ig_alpha += k_ig * (I_ab.alpha - mpc->ig_alpha);
+    mpc->ig_beta += k_ig * (I_ab.beta - mpc->ig_beta);
+    
+    /* Step 1: delay compensation with the state already applied */
+    const MpcState_t *s_prev = &mpc_states[mpc->state];
+    const AlphaBeta_t *v_prev = &mpc_vectors[s_prev->vec];
+    float32_t k_L = Ts / LC_INDUCTANCE_H;
+    float32_t k_C = Ts / CF_CAPACITANCE_F;
+    
+    float32_t i1_a = I_ab.alpha + k_L * (v_prev->alpha * Vdc_half - V_ab.alpha);
+    float32_t i1_b = I_ab.beta + k_L * (v_prev->beta * Vdc_half - V_ab.beta);
+    float32_t vc1_a = V_ab.alpha + k_C * (I_ab.alpha - mpc->ig_alpha);
+    float32_t vc1_b = V_ab.beta + k_C * (I_ab.beta - mpc->ig_beta);
+    
+    float32_t Vnp_err = sys->dc.Vdc_pos - sys->dc.Vdc_neg;
+    float32_t k_np = Ts / CDC_HALF_F;
+    float32_t np1 = Vnp_err + k_np * NeutralPointCurrent(s_prev, sys->ac.Ia, 
+                                                         sys->ac.Ib, sys->ac.Ic);
+    
+    /* Phase currents at k+1 for the NP prediction */
+    float32_t i1a, i1b, i1c;
+    InvClarke_Transform(i1_a, i1_b, &i1a, &i1b, &i1c);
+    
+    /* Reference at k+2: rotate dq reference two samples ahead */
+    float32_t theta2 = sys->pll.theta + 2.0f * sys->pll.omega * Ts;
+    if (theta2 >= TWO_PI) theta2 -= TWO_PI;
+    InvPark_Transform(Id_ref, Iq_ref, theta2, 
+                      &Iref_ab.alpha, &Iref_ab.beta);
+    
+    /* i(k+2) = i1 + k_L*(v*Vdc/2 - vc1)  =>  e = base - kv * v */
+    float32_t base_a = Iref_ab.alpha - i1_a + k_L * vc1_a;
+    float32_t base_b = Iref_ab.beta - i1_b + k_L * vc1_b;
+    float32_t kv = k_L * Vdc_half;
+    
+    /* Step 2: evaluate candidates, current cost cached per voltage vector */
+    float32_t J_vec[MPC_NUM_VECTORS];
+    uint32_t vec_done = 0;
+    float32_t J_best = 3.4e38f;
+    uint8_t best = mpc->state;
+    uint8_t evaluated = 0;
+    
+    for (uint8_t n = 0; n < MPC_NUM_STATES; n++) {
+        const MpcState_t *s = &mpc_states[n];
+        
+        /* Prune direct P <-> N transitions */
+        int32_t da = LevelStep(s_prev->sa, s->sa);
+        int32_t db = LevelStep(s_prev->sb, s->sb);
+        int32_t dc = LevelStep(s_prev->sc, s->sc);
+        if (da > 1 || db > 1 || dc > 1) continue;
+        
+        if (!(vec_done & (1UL << s->vec))) {
+            float32_t ea = base_a - kv * mpc_vectors[s->vec].alpha;
+            float32_t eb = base_b - kv * mpc_vectors[s->vec].beta;
+            J_vec[s->vec] = ea * ea + eb * eb;
+            vec_done |= (1UL << s->vec);
+        }
+        
+        float32_t np2 = np1 + k_np * NeutralPointCurrent(s, i1a, i1b, i1c);
+        float32_t J = J_vec[s->vec] 
+                    + mpc->lambda_np * np2 * np2 
+                    + mpc->lambda_sw * (float32_t)(da + db + dc);
+        evaluated++;
+        
+        if (J < J_best) {
+            J_best = J;
+            best = n;
+        }
+    }
+    
+    mpc->state = best;
+    mpc->candidates = evaluated;
+    mpc->cost = J_best;
+    
+    /* Output as HRTIM compare values (full-period levels) */
+    const MpcState_t *s = &mpc_states[best];
+    sys->svpwm.ma = (float32_t)s->sa;
+    sys->svpwm.mb = (float32_t)s->sb;
+    sys->svpwm.mc = (float32_t)s->sc;
+    sys->svpwm.duty_a = LevelToCompare(s->sa);
+    sys->svpwm.duty_b = LevelToCompare(s->sb);
+    sys->svpwm.duty_c = LevelToCompare(s->sc);
+    
+    /* Equivalent voltage reference for monitoring */
+    Park_Transform(mpc_vectors[s->vec].alpha * Vdc_half, 
+                   mpc_vectors[s->vec].beta * Vdc_half, 
+                   sys->pll.theta, &sys->V_ref_dq);
+}
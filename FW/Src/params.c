@@ -0,0 +1,355 @@
+/**
+ * @file params.c
+ * @brief Runtime Parameter Store
+ * @version 2.1
+ * @date 2025-12
+ *
+ * Gains, protection thresholds and state machine timing as a typed table
+ * of 32-bit values: name, unit, type, config.h default and the accepted
+ * range per id. A set is checked whole (every value in range, then the
+ * cross checks) before it is staged; a set that fails is refused and
+ * counted, and the values in force stay.
+ *
+ * The control ISR reads its parameters lock-free from one of two sets in
+ * the parameter bank. The main loop writes the inactive set and then flips
+ * active, a single byte; the ISR takes the flip at the start of a period
+ * and reads that set until the next one, so no period sees half a set. A
+ * set is only overwritten after the ISR has loaded the previous swap. Each
+ * set carries its current and PLL gains scaled to the grid impedance band
+ * (impedance.c); a band change republishes the set in force, and the ISR
+ * copies the gains into the controllers when it takes the flip.
+ *
+ * Non-volatile storage keeps two records, one per slot, written
+ * alternately; the newest valid one is loaded at start-up. A record is
+ *   magic, version | count << 16, sequence, count values, CRC
+ * in 32-bit words, padded to a double word, with the CRC-16/MODBUS of the
+ * words before it. The first double word is programmed last, so a save cut
+ * short leaves an erased slot and the previous record in the other. A
+ * record with fewer values than PARAM_COUNT (an older firmware of the same
+ * version) loads them and takes the defaults for the rest; any value out
+ * of range rejects the record.
+ */
+
+#include "params.h"
+#include "modbus.h"
+#include "config.h"
+#include "arm_math.h"
+#include <stddef.h>
+#include <string.h>
+
+/* ============================================================================
+ * CONSTANTS
+ * ========================================================================== */
+#define NV_MAGIC            0x4D524150U     // "PARM"
+#define NV_HEADER           3U              // Magic, version/count, sequence
+#define NV_WORDS            ((NV_HEADER + PARAM_COUNT + 1U + 1U) & ~1U)
+
+#define PAR(id, name, unit, type, member, def, min, max) \
+    [id] = { name, unit, MODBUS_TYPE_##type, offsetof(Params_t, member), def, min, max }
+
+/* ============================================================================
+ * PARAMETER TABLE
+ * Protection thresholds and response times range from their config.h
+ * value inwards: a parameter can tighten a trip, never relax it. The gain
+ * ranges cover the fwtune search space.
+ * ========================================================================== */
+static const ParamInfo_t params[PARAM_COUNT] = {
+    PAR(PARAM_CURRENT_KP,  "current_kp",  "V/A",  F32, current_kp,     CURRENT_KP,            0.05f,                          10.0f),
+    PAR(PARAM_CURRENT_KR,  "current_kr",  "",     F32, current_kr,     CURRENT_KR,            0.0f,                           2000.0f),
+    PAR(PARAM_PLL_KP,      "pll_kp",      "",     F32, pll_kp,         PLL_KP,                10.0f,                          1000.0f),
+    PAR(PARAM_PLL_KI,      "pll_ki",      "",     F32, pll_ki,         PLL_KI,                500.0f,                         100000.0f),
+    PAR(PARAM_VOLTAGE_KP,  "voltage_kp",  "A/V",  F32, voltage_kp,     VOLTAGE_KP,            0.05f,                          10.0f),
+    PAR(PARAM_VOLTAGE_KI,  "voltage_ki",  "A/Vs", F32, voltage_ki,     VOLTAGE_KI,            0.0f,                           20000.0f),
+    
+    PAR(PARAM_VDC_OV,      "vdc_ov",      "V",    F32, vdc_ov_V,       VDC_OV_TRIP_V,         VDC_OV_WARNING_V,               VDC_OV_TRIP_V),
+    PAR(PARAM_VDC_UV,      "vdc_uv",      "V",    F32, vdc_uv_V,       VDC_UV_TRIP_V,         VDC_UV_TRIP_V,                  VDC_UV_WARNING_V),
+    PAR(PARAM_IDC_OC,      "idc_oc",      "A",    F32, idc_oc_A,       IDC_MAX_A * 1.2f,      IDC_MAX_A * 0.5f,               IDC_MAX_A * 1.2f),
+    PAR(PARAM_IAC_OC,      "iac_oc",      "A",    F32, iac_oc_A,       IAC_OC_TRIP_A,         IAC_RATED_A,                    IAC_OC_TRIP_A),
+    PAR(PARAM_IAC_SC,      "iac_sc",      "A",    F32, iac_sc_A,       IAC_SC_TRIP_A,         IAC_RATED_A,                    IAC_SC_TRIP_A),
+    PAR(PARAM_T_MOSFET,    "t_mosfet",    "C",    F32, t_mosfet_C,     TEMP_MOSFET_TRIP_C,    TEMP_MOSFET_WARNING_C + 5.0f,   TEMP_MOSFET_TRIP_C),
+    PAR(PARAM_T_HEATSINK,  "t_heatsink",  "C",    F32, t_heatsink_C,   TEMP_HEATSINK_TRIP_C,  TEMP_HEATSINK_WARNING_C,        TEMP_HEATSINK_TRIP_C),
+    PAR(PARAM_VAC_MAX,     "vac_max",     "V",    F32, vac_max_V,      VAC_MAX_V,             VAC_NOMINAL_V,                  VAC_MAX_V),
+    PAR(PARAM_VAC_MIN,     "vac_min",     "V",    F32, vac_min_V,      VAC_MIN_V,             VAC_MIN_V,                      VAC_NOMINAL_V),
+    PAR(PARAM_FREQ_MAX,    "f_max",       "Hz",   F32, f_max_Hz,       GRID_FREQ_MAX_HZ,      GRID_FREQ_NOMINAL_HZ,           GRID_FREQ_MAX_HZ),
+    PAR(PARAM_FREQ_MIN,    "f_min",       "Hz",   F32, f_min_Hz,       GRID_FREQ_MIN_HZ,      GRID_FREQ_MIN_HZ,               GRID_FREQ_NOMINAL_HZ),
+    
+    PAR(PARAM_OC_RESPONSE, "oc_response", "us",   U32, oc_response_us, FAULT_OC_RESPONSE_US,  10.0f,                          FAULT_OC_RESPONSE_US),
+    PAR(PARAM_UV_RESPONSE, "uv_response", "ms",   U32, uv_response_ms, FAULT_UV_RESPONSE_MS,  10.0f,                          FAULT_UV_RESPONSE_MS),
+    PAR(PARAM_BMS_TIMEOUT, "bms_timeout", "ms",   U32, bms_timeout_ms, BMS_TIMEOUT_MS,        500.0f,                         BMS_TIMEOUT_MS),
+    PAR(PARAM_ANTI_ISLAND, "anti_island", "ms",   U32, anti_island_ms, ANTI_ISLAND_TIME_MS,   100.0f,                         ANTI_ISLAND_TIME_MS),
+    PAR(PARAM_PRECHARGE,   "precharge",   "ms",   U32, precharge_ms,   PRECHARGE_TIME_MS,     500.0f,                         PRECHARGE_TIME_MS),
+    PAR(PARAM_GRID_SYNC,   "grid_sync",   "ms",   U32, grid_sync_ms,   GRID_SYNC_TIMEOUT_MS,  1000.0f,                        60000.0f),
+};
+
+/* Gain factors per grid impedance band (config.h) */
+static const float32_t band_current_kp[GAIN_BANDS] = GAIN_BAND_CURRENT_KP;
+static const float32_t band_pll_kp[GAIN_BANDS] = GAIN_BAND_PLL_KP;
+static const float32_t band_pll_ki[GAIN_BANDS] = GAIN_BAND_PLL_KI;
+
+/* ============================================================================
+ * TABLE ACCESS
+ * ========================================================================== */
+const ParamInfo_t *Params_Info(uint32_t id)
+{
+    return (id < PARAM_COUNT) ? &params[id] : NULL;
+}
+
+uint32_t Params_Find(const char *name)
+{
+    uint32_t id = 0;
+    
+    while (id < PARAM_COUNT && strcmp(name, params[id].name) != 0) id++;
+    return id;
+}
+
+uint32_t Params_GetRaw(const Params_t *p, uint32_t id)
+{
+    uint32_t raw = 0U;
+    
+    if (id < PARAM_COUNT) memcpy(&raw, (const uint8_t *)p + params[id].offset, sizeof(raw));
+    return raw;
+}
+
+bool Params_CheckRaw(uint32_t id, uint32_t raw)
+{
+    float32_t x;
+    
+    if (id >= PARAM_COUNT) return false;
+    if (params[id].type == MODBUS_TYPE_F32) {
+        memcpy(&x, &raw, sizeof(x));
+    } else {
+        x = (float32_t)raw;
+    }
+    /* NaN fails both */
+    return x >= params[id].min && x <= params[id].max;
+}
+
+bool Params_SetRaw(Params_t *p, uint32_t id, uint32_t raw)
+{
+    if (!Params_CheckRaw(id, raw)) return false;
+    memcpy((uint8_t *)p + params[id].offset, &raw, sizeof(raw));
+    return true;
+}
+
+/* ============================================================================
+ * DEFAULTS AND VALIDATION
+ * ========================================================================== */
+void Params_Defaults(Params_t *p)
+{
+    for (uint32_t i = 0; i < PARAM_COUNT; i++) {
+        const ParamInfo_t *t = &params[i];
+        uint32_t raw = (uint32_t)t->def;
+        
+        if (t->type == MODBUS_TYPE_F32) memcpy(&raw, &t->def, sizeof(raw));
+        memcpy((uint8_t *)p + t->offset, &raw, sizeof(raw));
+    }
+}
+
+bool Params_Validate(const Params_t *p)
+{
+    for (uint32_t i = 0; i < PARAM_COUNT; i++) {
+        if (!Params_CheckRaw(i, Params_GetRaw(p, i))) return false;
+    }
+    
+    /* Short circuit above over-current, both windows open */
+    return p->iac_oc_A < p->iac_sc_A && p->vac_min_V < p->vac_max_V && p->f_min_Hz < p->f_max_Hz;
+}
+
+/* ============================================================================
+ * NON-VOLATILE RECORDS
+ * ========================================================================== */
+/* Sequence of the record in a slot (0: none or invalid), its values into
+ * p; found is set by any record header, valid or not */
+static uint32_t ReadRecord(uint32_t slot, Params_t *p, bool *found)
+{
+    uint32_t w[NV_WORDS];
+    
+    if (!ParamsNv_Read(slot, w, sizeof(w)) || w[0] != NV_MAGIC) return 0U;
+    *found = true;
+    
+    const uint32_t count = w[1] >> 16;
+    if ((w[1] & 0xFFFFU) != PARAM_VERSION || count == 0U || count > PARAM_COUNT || w[2] == 0U) return 0U;
+    if (w[NV_HEADER + count] != Modbus_Crc16((const uint8_t *)w, (uint16_t)(4U * (NV_HEADER + count)))) {
+        return 0U;
+    }
+    
+    Params_Defaults(p);
+    for (uint32_t i = 0; i < count; i++) {
+        if (!Params_SetRaw(p, i, w[NV_HEADER + i])) return 0U;
+    }
+    return Params_Validate(p) ? w[2] : 0U;
+}
+
+/* Newest valid record: values, slot and sequence (0: none) */
+static uint32_t FindRecord(Params_t *p, uint8_t *slot, bool *found)
+{
+    uint32_t best = 0U;
+    Params_t q;
+    
+    for (uint32_t s = 0; s < PARAM_NV_SLOTS; s++) {
+        const uint32_t seq = ReadRecord(s, &q, found);
+        if (seq != 0U && (best == 0U || (int32_t)(seq - best) > 0)) {
+            best = seq;
+            *p = q;
+            *slot = (uint8_t)s;
+        }
+    }
+    return best;
+}
+
+bool Params_Reload(SystemData_t *sys)
+{
+    ParamBank_t *pb = &sys->params;
+    Params_t p;
+    uint8_t slot = 0;
+    bool found = false;
+    
+    const uint32_t seq = FindRecord(&p, &slot, &found);
+    if (seq == 0U) {
+        pb->nv = found ? PARAM_NV_INVALID : PARAM_NV_NONE;
+        return false;
+    }
+    pb->nv = PARAM_NV_LOADED;
+    pb->nv_seq = seq;
+    pb->nv_slot = slot;
+    return Params_Stage(sys, &p);
+}
+
+bool Params_Save(SystemData_t *sys)
+{
+    ParamBank_t *pb = &sys->params;
+    const Params_t *p = Params_Get(sys);
+    uint32_t w[NV_WORDS];
+    
+    /* The slot not holding the newest record; sequence 0 is never used */
+    const uint32_t seq = (pb->nv_seq + 1U != 0U) ? pb->nv_seq + 1U : 1U;
+    const uint8_t slot = (pb->nv_seq != 0U) ? (uint8_t)((pb->nv_slot + 1U) % PARAM_NV_SLOTS) : 0U;
+    
+    memset(w, 0, sizeof(w));
+    w[0] = NV_MAGIC;
+    w[1] = PARAM_VERSION | ((uint32_t)PARAM_COUNT << 16);
+    w[2] = seq;
+    for (uint32_t i = 0; i < PARAM_COUNT; i++) {
+        w[NV_HEADER + i] = Params_GetRaw(p, i);
+    }
+    w[NV_HEADER + PARAM_COUNT] = Modbus_Crc16((const uint8_t *)w, (uint16_t)(4U * (NV_HEADER + PARAM_COUNT)));
+    
+    if (!ParamsNv_Write(slot, w, sizeof(w))) {
+        pb->nv = PARAM_NV_FAILED;
+        return false;
+    }
+    pb->nv = PARAM_NV_SAVED;
+    pb->nv_seq = seq;
+    pb->nv_slot = slot;
+    return true;
+}
+
+/* ============================================================================
+ * INITIALIZATION
+ * ========================================================================== */
+static void ScaleGains(ControlGains_t *g, const Params_t *p, uint8_t band)
+{
+    g->current_kp = p->current_kp * band_current_kp[band];
+    g->current_kr = p->current_kr;
+    g->pll_kp = p->pll_kp * band_pll_kp[band];
+    g->pll_ki = p->pll_ki * band_pll_ki[band];
+}
+
+void Params_Init(SystemData_t *sys)
+{
+    ParamBank_t *pb = &sys->params;
+    bool found = false;
+    
+    memset(pb, 0, sizeof(*pb));
+    pb->nv_seq = FindRecord(&pb->set[0], &pb->nv_slot, &found);
+    if (pb->nv_seq != 0U) {
+        pb->nv = PARAM_NV_LOADED;
+    } else {
+        Params_Defaults(&pb->set[0]);
+        pb->nv = found ? PARAM_NV_INVALID : PARAM_NV_NONE;
+    }
+    
+    /* Nominal band until the first grid impedance estimate */
+    pb->band = 1;
+    ScaleGains(&pb->gains[0], &pb->set[0], pb->band);
+}
+
+/* ============================================================================
+ * PARAMETER BANK (main loop → ISR)
+ * ========================================================================== */
+const Params_t *Params_Get(const SystemData_t *sys)
+{
+    const ParamBank_t *pb = &sys->params;
+    
+    return pb->pending ? &pb->next : &pb->set[pb->active];
+}
+
+bool Params_Stage(SystemData_t *sys, const Params_t *p)
+{
+    ParamBank_t *pb = &sys->params;
+    
+    if (!Params_Validate(p)) {
+        pb->rejects++;
+        return false;
+    }
+    pb->next = *p;
+    pb->pending = true;
+    return true;
+}
+
+/* Set and its gains at the band into the inactive half, then the flip */
+static bool Publish(ParamBank_t *pb, const Params_t *p, uint8_t band)
+{
+    uint8_t next = pb->active ^ 1U;
+    
+    if (pb->loaded != pb->active) return false;
+    
+    pb->set[next] = *p;
+    ScaleGains(&pb->gains[next], p, band);
+    __DMB();
+    pb->active = next;
+    pb->band = band;
+    return true;
+}
+
+bool Params_Publish(SystemData_t *sys, const Params_t *p)
+{
+    return Publish(&sys->params, p, sys->params.band);
+}
+
+bool Params_SetBand(SystemData_t *sys, uint8_t band)
+{
+    ParamBank_t *pb = &sys->params;
+    
+    if (band == pb->band) return true;
+    return Publish(pb, &pb->set[pb->active], band);
+}
+
+bool Params_Update(SystemData_t *sys)
+{
+    ParamBank_t *pb = &sys->params;
+    
+    if (!pb->pending || !Publish(pb, &pb->next, pb->band)) return false;
+    pb->pending = false;
+    pb->seq++;
+    return true;
+}
+
+void Params_Load(SystemData_t *sys)
+{
+    ParamBank_t *pb = &sys->params;
+    uint8_t active = pb->active;
+    
+    if (active == pb->loaded) return;
+    
+    const ControlGains_t *g = &pb->gains[active];
+    sys->current_ctrl_d.Kp = g->current_kp;
+    sys->current_ctrl_d.Kr = g->current_kr;
+    sys->current_ctrl_q.Kp = g->current_kp;
+    sys->current_ctrl_q.Kr = g->current_kr;
+    sys->pll.pi.Kp = g->pll_kp;
+    sys->pll.pi.Ki = g->pll_ki;
+    sys->voltage_ctrl.Kp = pb->set[active].voltage_kp;
+    sys->voltage_ctrl.Ki = pb->set[active].voltage_ki;
+    pb->loaded = active;
+}
@@ -0,0 +1,78 @@
+/**
+ * @file params_flash.c
+ * @brief Parameter Store Flash Slots (bank 2)
+ * @version 2.1
+ * @date 2025-12
+ *
+ * Each slot is one 2 KB page at the end of bank 2 (PARAM_NV_ADDR). In
+ * dual-bank mode the core keeps fetching from bank 1 while bank 2 is
+ * erased and programmed, so the control ISR runs on through a save; only
+ * the main loop waits, about 22 ms for the erase and 90 µs per double
+ * word. A read is a plain copy from the memory-mapped slot.
+ *
+ * The first double word (record magic) is programmed last: a save cut
+ * short by a reset leaves a slot without a header, which the store skips.
+ * The slot is compared with the source afterwards; an ECC error or a
+ * mismatch fails the save.
+ */
+
+#include "params.h"
+#include "config.h"
+#include "stm32g4xx_hal.h"
+#include <string.h>
+
+/* ============================================================================
+ * CONSTANTS
+ * ========================================================================== */
+#define SLOT_SIZE           FLASH_PAGE_SIZE
+#define SLOT_ADDR(slot)     (PARAM_NV_ADDR + (slot) * SLOT_SIZE)
+
+/* ============================================================================
+ * PRIVATE HELPERS
+ * ========================================================================== */
+static bool Program(uint32_t addr, const uint8_t *src)
+{
+    uint64_t dw;
+    
+    memcpy(&dw, src, sizeof(dw));
+    return HAL_FLASH_Program(FLASH_TYPEPROGRAM_DOUBLEWORD, addr, dw) == HAL_OK;
+}
+
+/* ============================================================================
+ * SLOT ACCESS
+ * ========================================================================== */
+bool ParamsNv_Read(uint32_t slot, void *dst, uint32_t len)
+{
+    if (slot >= PARAM_NV_SLOTS || len > SLOT_SIZE) return false;
+    
+    memcpy(dst, (const void *)SLOT_ADDR(slot), len);
+    return true;
+}
+
+bool ParamsNv_Write(uint32_t slot, const void *src, uint32_t len)
+{
+    const uint8_t *data = (const uint8_t *)src;
+    FLASH_EraseInitTypeDef erase = {0};
+    uint32_t page_error = 0;
+    bool ok;
+    
+    if (slot >= PARAM_NV_SLOTS || len < 8U || len > SLOT_SIZE || (len % 8U) != 0U) return false;
+    
+    HAL_FLASH_Unlock();
+    __HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_ALL_ERRORS);
+    
+    erase.TypeErase = FLASH_TYPEERASE_PAGES;
+    erase.Banks = FLASH_BANK_2;
+    erase.Page = PARAM_NV_PAGE + slot;
+    erase.NbPages = 1;
+    ok = HAL_FLASHEx_Erase(&erase, &page_error) == HAL_OK;
+    
+    /* Body first, header last */
+    for (uint32_t at = 8U; ok && at < len; at += 8U) {
+        ok = Program(SLOT_ADDR(slot) + at, &data[at]);
+    }
+    if (ok) ok = Program(SLOT_ADDR(slot), data);
+    
+    HAL_FLASH_Lock();
+    return ok && memcmp((const void *)SLOT_ADDR(slot), src, len) == 0;
+}
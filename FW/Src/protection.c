@@ -8,70 +8,69 @@
 #include "protection.h"
 #include "config.h"
 #include "hrtim.h"
+#include "thermal.h"
+#include "island.h"
+#include "can_bms.h"
+#include "params.h"
 #include <math.h>
-
-/* ============================================================================
- * PRIVATE VARIABLES
- * ========================================================================== */
-static uint32_t ov_timer_ms = 0;
-static uint32_t uv_timer_ms = 0;
-static uint32_t oc_timer_us = 0;
-static uint32_t freq_timer_ms = 0;
+#include <string.h>
 
 /* ============================================================================
  * INITIALIZATION
  * ========================================================================== */
 void Protection_Init(void)
 {
-    ov_timer_ms = 0;
-    uv_timer_ms = 0;
-    oc_timer_us = 0;
-    freq_timer_ms = 0;
+    /* Timers live in g_sys.prot so the ISR state can be captured/restored */
+    memset(&g_sys.prot, 0, sizeof(g_sys.prot));
+    memset(&g_sys.hwflt, 0, sizeof(g_sys.hwflt));
+    g_sys.prot.derating = 1.0f;
 }
 
 /* ============================================================================
  * FAST PROTECTION CHECK (Called from ISR @ 200 kHz)
- * Response time: < 10 µs for critical faults
+ * Response time: < 10 µs for critical faults. Thresholds from the
+ * parameter set of this period (Params_Load).
  * ========================================================================== */
 bool Protection_CheckFast(SystemData_t *sys)
 {
+    const Params_t *p = Params_Live(sys);
     bool fault_detected = false;
     
     /* ===== DC OVER-VOLTAGE (CRITICAL) ===== */
-    if (sys->dc.Vdc > VDC_OV_TRIP_V) {
+    if (sys->dc.Vdc > p->vdc_ov_V) {
         sys->faults |= FAULT_DC_OVERVOLTAGE;
         fault_detected = true;
     }
     
     /* ===== DC OVER-CURRENT ===== */
-    if (fabsf(sys->dc.Idc) > IDC_MAX_A * 1.2f) {
+    if (fabsf(sys->dc.Idc) > p->idc_oc_A) {
         sys->faults |= FAULT_DC_OVERCURRENT;
         fault_detected = true;
     }
     
     /* ===== AC SHORT CIRCUIT (CRITICAL) ===== */
-    if (fabsf(sys->ac.Ia) > IAC_SC_TRIP_A ||
-        fabsf(sys->ac.Ib) > IAC_SC_TRIP_A ||
-        fabsf(sys->ac.Ic) > IAC_SC_TRIP_A) {
+    if (fabsf(sys->ac.Ia) > p->iac_sc_A ||
+        fabsf(sys->ac.Ib) > p->iac_sc_A ||
+        fabsf(sys->ac.Ic) > p->iac_sc_A) {
         sys->faults |= FAULT_AC_SHORT_CIRCUIT;
         fault_detected = true;
     }
     
     /* ===== AC OVER-CURRENT ===== */
-    if (fabsf(sys->ac.Ia) > IAC_OC_TRIP_A ||
-        fabsf(sys->ac.Ib) > IAC_OC_TRIP_A ||
-        fabsf(sys->ac.Ic) > IAC_OC_TRIP_A) {
-        oc_timer_us += 5;  // 5 µs per call
-        if (oc_timer_us > FAULT_OC_RESPONSE_US) {
+    if (fabsf(sys->ac.Ia) > p->iac_oc_A ||
+        fabsf(sys->ac.Ib) > p->iac_oc_A ||
+        fabsf(sys->ac.Ic) > p->iac_oc_A) {
+        sys->prot.oc_timer_ns += sys->timing.Ts_ns;  // One control period per call
+        if (sys->prot.oc_timer_ns > p->oc_response_us * 1000U) {
             sys->faults |= FAULT_AC_OVERCURRENT;
             fault_detected = true;
         }
     } else {
-        oc_timer_us = 0;
+        sys->prot.oc_timer_ns = 0;
     }
     
     /* ===== MOSFET OVER-TEMPERATURE (CRITICAL) ===== */
-    if (sys->temps.T_max > TEMP_MOSFET_TRIP_C) {
+    if (sys->temps.T_max > p->t_mosfet_C) {
         sys->faults |= FAULT_OVERTEMP_MOSFET;
         fault_detected = true;
     }
@@ -79,64 +78,117 @@ bool Protection_CheckFast(SystemData_t *sys)
     return fault_detected;
 }
 
+/* ============================================================================
+ * HARDWARE FAULT PATH
+ * The HRTIM has taken the outputs down HWFLT_DELAY_NS after the input;
+ * the fault interrupt classifies the source and logs it with the last
+ * control ISR sample. Reaction is the fault interrupt's own time from
+ * entry to a safe state; for comparison the control ISR records its trip
+ * latency from the sampling instant to the outputs disabled.
+ * ========================================================================== */
+void Protection_HardwareFault(SystemData_t *sys, uint32_t inputs)
+{
+    HwFaultState_t *hf = &sys->hwflt;
+    HwFaultEntry_t *e = &hf->log[hf->head & (HWFLT_LOG_DEPTH - 1U)];
+    
+    if (inputs & HWFLT_BIT(HWFLT_IN_DESAT)) sys->faults |= FAULT_DESAT_DETECTED;
+    if (inputs & HWFLT_BIT(HWFLT_IN_DRIVER)) sys->faults |= FAULT_GATE_DRIVER;
+    if (inputs & HWFLT_BIT(HWFLT_IN_ESTOP)) sys->faults |= FAULT_ESTOP_ACTIVE;
+    if (inputs & HWFLT_OC_MASK) sys->faults |= FAULT_AC_SHORT_CIRCUIT;
+    
+    for (uint32_t i = 0; i < HWFLT_IN_COUNT; i++) {
+        if (inputs & HWFLT_BIT(i)) hf->count[i]++;
+    }
+    
+    e->t_ms = HAL_GetTick();
+    e->inputs = (uint8_t)inputs;
+    e->state = (uint8_t)sys->state;
+    e->react_ns = 0;
+    e->Ia = sys->ac.Ia;
+    e->Ib = sys->ac.Ib;
+    e->Ic = sys->ac.Ic;
+    e->Vdc = sys->dc.Vdc;
+    hf->last_inputs = inputs;
+    hf->head++;
+}
+
+void Protection_FaultReaction(SystemData_t *sys, uint32_t cycles)
+{
+    HwFaultState_t *hf = &sys->hwflt;
+    uint32_t ns = (uint32_t)((uint64_t)cycles * 1000000000U / SYSCLK_FREQ_HZ);
+    
+    if (hf->head == 0U) return;
+    hf->log[(hf->head - 1U) & (HWFLT_LOG_DEPTH - 1U)].react_ns = (ns > UINT16_MAX) ? UINT16_MAX : (uint16_t)ns;
+    if (ns > hf->react_ns_max) hf->react_ns_max = ns;
+}
+
+void Protection_SoftwareTrip(SystemData_t *sys, uint16_t ticks)
+{
+    HwFaultState_t *hf = &sys->hwflt;
+    
+    hf->sw_trip_ns = (uint32_t)((uint64_t)ticks * 1000000000U / HRTIM_FREQ_HZ);
+    if (hf->sw_trip_ns > hf->sw_trip_ns_max) hf->sw_trip_ns_max = hf->sw_trip_ns;
+}
+
 /* ============================================================================
  * SLOW PROTECTION CHECK (Called from main loop @ ~100 Hz)
  * Response time: 10-100 ms for non-critical faults
  * ========================================================================== */
 void Protection_CheckSlow(SystemData_t *sys)
 {
-    static uint32_t last_tick = 0;
+    const Params_t *p = Params_Get(sys);
     uint32_t current_tick = HAL_GetTick();
-    uint32_t elapsed = current_tick - last_tick;
+    uint32_t elapsed = current_tick - sys->prot.slow_last_tick;
     
     if (elapsed < 10) return;  // Run every 10 ms
-    last_tick = current_tick;
+    sys->prot.slow_last_tick = current_tick;
     
     /* ===== DC UNDER-VOLTAGE ===== */
     if (sys->state == STATE_RUN_INVERTER || sys->state == STATE_RUN_RECTIFIER) {
-        if (sys->dc.Vdc < VDC_UV_TRIP_V) {
-            uv_timer_ms += elapsed;
-            if (uv_timer_ms > FAULT_UV_RESPONSE_MS) {
+        if (sys->dc.Vdc < p->vdc_uv_V) {
+            sys->prot.uv_timer_ms += elapsed;
+            if (sys->prot.uv_timer_ms > p->uv_response_ms) {
                 sys->faults |= FAULT_DC_UNDERVOLTAGE;
             }
         } else {
-            uv_timer_ms = 0;
+            sys->prot.uv_timer_ms = 0;
         }
     }
     
     /* ===== AC OVER-VOLTAGE ===== */
+    /* sqrt(Va² + Vb² + Vc²) = sqrt(3/2)·Vpk = L-L RMS for a balanced set */
     float32_t Vac_mag = sqrtf(sys->ac.Va * sys->ac.Va + 
                               sys->ac.Vb * sys->ac.Vb + 
-                              sys->ac.Vc * sys->ac.Vc) * 0.8165f;  // RMS
+                              sys->ac.Vc * sys->ac.Vc);
     
-    if (Vac_mag > VAC_MAX_V) {
+    if (Vac_mag > p->vac_max_V) {
         sys->faults |= FAULT_AC_OVERVOLTAGE;
     }
     
     /* ===== AC UNDER-VOLTAGE ===== */
-    if (sys->grid_connected && Vac_mag < VAC_MIN_V) {
+    if (sys->grid_connected && Vac_mag < p->vac_min_V) {
         sys->faults |= FAULT_AC_UNDERVOLTAGE;
     }
     
     /* ===== FREQUENCY DEVIATION ===== */
     if (sys->grid_connected && sys->pll.locked) {
-        if (sys->pll.frequency > GRID_FREQ_MAX_HZ || 
-            sys->pll.frequency < GRID_FREQ_MIN_HZ) {
-            freq_timer_ms += elapsed;
-            if (freq_timer_ms > 100) {  // 100 ms delay
-                if (sys->pll.frequency > GRID_FREQ_MAX_HZ) {
+        if (sys->pll.frequency > p->f_max_Hz || 
+            sys->pll.frequency < p->f_min_Hz) {
+            sys->prot.freq_timer_ms += elapsed;
+            if (sys->prot.freq_timer_ms > 100) {  // 100 ms delay
+                if (sys->pll.frequency > p->f_max_Hz) {
                     sys->faults |= FAULT_OVER_FREQUENCY;
                 } else {
                     sys->faults |= FAULT_UNDER_FREQUENCY;
                 }
             }
         } else {
-            freq_timer_ms = 0;
+            sys->prot.freq_timer_ms = 0;
         }
     }
     
     /* ===== HEATSINK OVER-TEMPERATURE ===== */
-    if (sys->temps.T_heatsink > TEMP_HEATSINK_TRIP_C) {
+    if (sys->temps.T_heatsink > p->t_heatsink_C) {
         sys->faults |= FAULT_OVERTEMP_HEATSINK;
     }
     
@@ -151,8 +203,9 @@ void Protection_CheckSlow(SystemData_t *sys)
     }
     
     /* ===== BMS COMMUNICATION TIMEOUT ===== */
+    /* Oldest data group by its RX timestamp (can_bms.h) */
     if (sys->state == STATE_RUN_INVERTER || sys->state == STATE_RUN_RECTIFIER) {
-        if ((current_tick - sys->bms.last_update_ms) > BMS_TIMEOUT_MS) {
+        if (CAN_BMS_Age(&sys->bms, current_tick) > p->bms_timeout_ms) {
             sys->bms.valid = false;
             sys->faults |= FAULT_BMS_TIMEOUT;
         }
@@ -165,26 +218,38 @@ void Protection_CheckSlow(SystemData_t *sys)
     }
     
     /* ===== ANTI-ISLANDING ===== */
-    if (sys->grid_connected && !sys->pll.locked) {
-        static uint32_t island_timer = 0;
-        island_timer += elapsed;
-        if (island_timer > ANTI_ISLAND_TIME_MS) {
+    /* Passive backstop: PLL unlocked while following a grid at power (the
+     * PLL does not run in STANDBY, and forming modes have their own frame) */
+    if (sys->outputs_enabled && sys->grid_connected && !sys->gfm.active && !sys->pll.locked) {
+        sys->prot.island_timer_ms += elapsed;
+        if (sys->prot.island_timer_ms > p->anti_island_ms) {
             sys->faults |= FAULT_ANTI_ISLANDING;
+            sys->island.cause = (uint8_t)AI_CAUSE_PLL_UNLOCK;
         }
+    } else {
+        sys->prot.island_timer_ms = 0;
+    }
+    
+#if ANTI_ISLAND_ACTIVE
+    /* Active: Sandia frequency shift with ROCOF and frequency window */
+    if (Island_Update(sys, elapsed)) {
+        sys->faults |= FAULT_ANTI_ISLANDING;
     }
+#endif
     
     /* ===== THERMAL DERATING ===== */
-    /* Apply power derating based on temperature */
+    /* Junction estimate and its prediction over THERMAL_PREDICT_S */
+    Thermal_Update(sys, elapsed);
+    
+    /* Power derating based on temperature (applied to the P/Q commands by
+     * Control_ReferenceCommand, ahead of the reference trajectory); the
+     * predictive limit acts first, the linear one is the backstop */
+    sys->prot.derating = sys->thermal.derating;
     if (sys->temps.T_max > TEMP_MOSFET_WARNING_C) {
         float32_t derating = 1.0f - (sys->temps.T_max - TEMP_MOSFET_WARNING_C) / 
-                             (TEMP_MOSFET_TRIP_C - TEMP_MOSFET_WARNING_C);
+                             (p->t_mosfet_C - TEMP_MOSFET_WARNING_C);
         if (derating < 0.0f) derating = 0.0f;
-        
-        /* Apply derating to power reference */
-        float32_t max_power = SYSTEM_POWER_RATING * derating;
-        if (fabsf(sys->ref.P_ref) > max_power) {
-            sys->ref.P_ref = (sys->ref.P_ref > 0) ? max_power : -max_power;
-        }
+        if (derating < sys->prot.derating) sys->prot.derating = derating;
     }
 }
 
@@ -212,6 +277,17 @@ bool Protection_ClearFault(SystemData_t *sys, FaultCode_t fault)
         can_clear = can_clear && sys->bms.valid;
     }
     
+    /* Latched in the HRTIM: only once the input has been released */
+    if (fault & FAULT_DESAT_DETECTED) {
+        can_clear = can_clear && !(sys->hwflt.active & HWFLT_BIT(HWFLT_IN_DESAT));
+    }
+    if (fault & FAULT_GATE_DRIVER) {
+        can_clear = can_clear && !(sys->hwflt.active & HWFLT_BIT(HWFLT_IN_DRIVER));
+    }
+    if (fault & FAULT_AC_SHORT_CIRCUIT) {
+        can_clear = can_clear && !(sys->hwflt.active & HWFLT_OC_MASK);
+    }
+    
     if (can_clear) {
         sys->faults &= ~fault;
         return true;
@@ -239,6 +315,7 @@ const char* Protection_GetFaultString(FaultCode_t fault)
     if (fault & FAULT_ANTI_ISLANDING) return "Anti-Islanding";
     if (fault & FAULT_BMS_TIMEOUT) return "BMS Timeout";
     if (fault & FAULT_DESAT_DETECTED) return "DESAT Detected";
+    if (fault & FAULT_GATE_DRIVER) return "Gate Driver";
     if (fault & FAULT_NP_IMBALANCE) return "NP Imbalance";
     if (fault & FAULT_PRECHARGE_FAIL) return "Pre-charge Fail";
     if (fault & FAULT_ESTOP_ACTIVE) return "E-Stop Active";
@@ -0,0 +1,471 @@
+/**
+ * @file recorder.c
+ * @brief ISR Input Recorder for Off-Target Replay
+ * @version 2.1
+ * @date 2025-12
+ *
+ * The control ISR only appends: per control period ~25 bytes of varint
+ * deltas, and the command groups its writers flagged (Recorder_Begin /
+ * Recorder_End), usually none. It neither copies nor compares state.
+ *
+ * Keyframes come from the main loop. When a block runs short of room, or
+ * after a state transition or a shed, the ISR asks for one; the idle loop
+ * (Recorder_Service) writes the field values into the next block between
+ * two control ISRs and checks the ISR count around the copy. If an ISR ran
+ * meanwhile the copy is torn and is retried on the next call; otherwise
+ * the next period opens that block and appends its deltas behind the
+ * keyframe. Until then the block in progress continues, or, if it is full
+ * or closed, capture pauses. The copy is the ~1.2 kB of ISR-visible
+ * fields, so it needs that much idle time between two control ISRs;
+ * beyond the load where the deadline supervisor sheds the recorder it
+ * rarely finds it.
+ */
+
+#include "recorder.h"
+#include "arm_math.h"
+#include <stddef.h>
+#include <string.h>
+
+/* ============================================================================
+ * CONSTANTS
+ * ========================================================================== */
+#define REC_VARINT_MAX          3           // 17-bit zigzag delta
+#define REC_FRAME_MAX           (1 + ADC_RAW_COUNT * REC_VARINT_MAX)
+#define REC_OUTPUT_MAX          (1 + 3 * REC_VARINT_MAX)
+#define REC_KEY_LEAD            512         // Room left when the next keyframe is asked for (~100 µs)
+
+#define REC_BUILD_ID            (((uint32_t)FW_VERSION_MAJOR << 16) | \
+                                 ((uint32_t)FW_VERSION_MINOR << 8) | FW_VERSION_PATCH)
+
+#define FIELD(id, cmd, member)  { id, cmd, sizeof(((SystemData_t *)0)->member), \
+                                  offsetof(SystemData_t, member) }
+
+/* Keyframe handshake (rec.key) */
+#define REC_KEY_IDLE            0           // Nothing asked
+#define REC_KEY_WANTED          1           // ISR asks for a keyframe
+#define REC_KEY_SNAPPED         2           // Main loop wrote one, valid for the next period
+
+/* ============================================================================
+ * FIELD TABLE
+ * ========================================================================== */
+static const RecField_t rec_fields[] = {
+    FIELD(REC_FIELD_STATE,               REC_CMD_STATE,    state),
+    FIELD(REC_FIELD_MODE,                REC_CMD_HOST,     mode),
+    FIELD(REC_FIELD_POWER_DIR,           REC_CMD_STATE,    power_dir),
+    FIELD(REC_FIELD_FAULTS,              REC_CMD_STATE,    faults),
+    FIELD(REC_FIELD_DC,                  0,                dc),
+    FIELD(REC_FIELD_AC,                  0,                ac),
+    FIELD(REC_FIELD_TEMPS,               0,                temps),
+    FIELD(REC_FIELD_ADC_CAL,             REC_CMD_ADC_CAL,  adc_cal),
+    FIELD(REC_FIELD_P_REF,               0,                ref.P_ref),
+    FIELD(REC_FIELD_Q_REF,               0,                ref.Q_ref),
+    FIELD(REC_FIELD_ID_REF,              0,                ref.Id_ref),
+    FIELD(REC_FIELD_IQ_REF,              0,                ref.Iq_ref),
+    FIELD(REC_FIELD_VDC_REF,             REC_CMD_HOST,     ref.Vdc_ref),
+    FIELD(REC_FIELD_PF_REF,              REC_CMD_HOST,     ref.pf_ref),
+    FIELD(REC_FIELD_PLL,                 0,                pll),
+    FIELD(REC_FIELD_CTRL_D,              0,                current_ctrl_d),
+    FIELD(REC_FIELD_CTRL_Q,              0,                current_ctrl_q),
+    FIELD(REC_FIELD_VOLTAGE_CTRL,        0,                voltage_ctrl),
+    FIELD(REC_FIELD_SVPWM,               0,                svpwm),
+    FIELD(REC_FIELD_MPC,                 0,                mpc),
+    FIELD(REC_FIELD_DELAY,               0,                delay),
+    FIELD(REC_FIELD_DEADTIME,            REC_CMD_DEADTIME, deadtime),
+    FIELD(REC_FIELD_I_DQ,                0,                I_dq),
+    FIELD(REC_FIELD_V_DQ,                0,                V_dq),
+    FIELD(REC_FIELD_V_REF_DQ,            0,                V_ref_dq),
+    FIELD(REC_FIELD_PROT,                0,                prot),
+    FIELD(REC_FIELD_BMS_CHARGE_LIMIT,    REC_CMD_BMS,      bms.charge_limit),
+    FIELD(REC_FIELD_BMS_DISCHARGE_LIMIT, REC_CMD_BMS,      bms.discharge_limit),
+    FIELD(REC_FIELD_BMS_VALID,           REC_CMD_BMS,      bms.valid),
+    FIELD(REC_FIELD_ENABLE_CMD,          REC_CMD_HOST,     enable_cmd),
+    FIELD(REC_FIELD_GRID_CONNECTED,      REC_CMD_HOST,     grid_connected),
+    FIELD(REC_FIELD_CYCLE_COUNT,         0,                control_cycle_count),
+    FIELD(REC_FIELD_VDC_CONTROL,         REC_CMD_HOST,     vdc_control),
+    FIELD(REC_FIELD_VDC_LOOP,            0,                vdc_loop),
+    FIELD(REC_FIELD_GFM,                 0,                gfm),
+    FIELD(REC_FIELD_P_CMD,               REC_CMD_REF,      ref.P_cmd),
+    FIELD(REC_FIELD_Q_CMD,               REC_CMD_REF,      ref.Q_cmd),
+    FIELD(REC_FIELD_TRAJ,                0,                traj),
+    FIELD(REC_FIELD_OUTPUTS_ENABLED,     REC_CMD_STATE,    outputs_enabled),
+    FIELD(REC_FIELD_VD_PQ,               0,                ref.Vd_pq),
+    FIELD(REC_FIELD_T_MAX,               REC_CMD_THERMAL,  temps.T_max),
+    FIELD(REC_FIELD_THERMAL_RON,         REC_CMD_THERMAL,  thermal.R_on),
+    FIELD(REC_FIELD_THERMAL_ACC,         0,                thermal.acc),
+    FIELD(REC_FIELD_FSW_PERIOD_REQ,      REC_CMD_FSW,      fsw.period_req),
+    FIELD(REC_FIELD_FSW_I_LIMIT,         REC_CMD_FSW,      fsw.I_limit),
+    FIELD(REC_FIELD_TIMING,              0,                timing),
+    FIELD(REC_FIELD_DAMPING,             0,                damping),
+    FIELD(REC_FIELD_GRIDZ_REQ,           REC_CMD_GRIDZ,    gridz.req),
+    FIELD(REC_FIELD_GRIDZ_ACC,           0,                gridz.acc),
+    FIELD(REC_FIELD_ISLAND_ARMED,        REC_CMD_ISLAND,   island.armed),
+    FIELD(REC_FIELD_ISLAND_EST,          0,                island.est),
+    FIELD(REC_FIELD_ILIM_I_CHARGE,       REC_CMD_ILIM,     ilim.I_charge),
+    FIELD(REC_FIELD_ILIM_I_DISCHARGE,    REC_CMD_ILIM,     ilim.I_discharge),
+    FIELD(REC_FIELD_ILIM_ID_MAX_TGT,     REC_CMD_ILIM,     ilim.Id_max_tgt),
+    FIELD(REC_FIELD_ILIM_ID_MIN_TGT,     REC_CMD_ILIM,     ilim.Id_min_tgt),
+    FIELD(REC_FIELD_ILIM_ID_STEP,        REC_CMD_ILIM,     ilim.Id_step),
+    FIELD(REC_FIELD_ILIM_ID_MAX,         0,                ilim.Id_max),
+    FIELD(REC_FIELD_ILIM_ID_MIN,         0,                ilim.Id_min),
+    FIELD(REC_FIELD_ILIM_I_MAX,          REC_CMD_ILIM,     ilim.I_max),
+    FIELD(REC_FIELD_ILIM_I_MAX_SQ,       REC_CMD_ILIM,     ilim.I_max_sq),
+    FIELD(REC_FIELD_ILIM_Q_PRIORITY,     REC_CMD_ILIM,     ilim.q_priority),
+    FIELD(REC_FIELD_PARAM_SET,           REC_CMD_PARAMS,   params.set),
+    FIELD(REC_FIELD_PARAM_GAINS,         REC_CMD_PARAMS,   params.gains),
+    FIELD(REC_FIELD_PARAM_ACTIVE,        REC_CMD_PARAMS,   params.active),
+    FIELD(REC_FIELD_PARAM_LOADED,        0,                params.loaded),
+    FIELD(REC_FIELD_PARAM_BAND,          REC_CMD_PARAMS,   params.band),
+};
+#define REC_NUM_FIELDS          (sizeof(rec_fields) / sizeof(rec_fields[0]))
+
+/* ============================================================================
+ * PRIVATE VARIABLES
+ * ========================================================================== */
+FW_INSTANCE_LOCAL RecImage_t g_rec;
+
+static FW_INSTANCE_LOCAL struct {
+    RecBlock_t *blk;                    // Block being written (NULL: paused)
+    uint16_t prev_code[ADC_RAW_COUNT];  // Frame delta base
+    uint16_t prev_duty[3];              // Output delta base
+    uint16_t key_size;                  // Keyframe record size
+    uint16_t cmd_max;                   // Worst-case command record size
+    uint8_t cmd_field[REC_FIELD_COUNT]; // Table index of each command field
+    uint8_t cmd_count;
+    SystemState_t last_state;           // State in the block's keyframe
+    bool frame_open;                    // Frame written, output pending
+    volatile uint32_t isr_seq;          // Control ISR count (keyframe check)
+    volatile uint32_t cmd_open;         // REC_CMD_* being written
+    volatile uint32_t cmd_dirty;        // REC_CMD_* written since the last record
+    volatile uint8_t key;               // REC_KEY_*
+    uint8_t key_blk;                    // Block holding the snapped keyframe
+    SystemState_t key_state;            // State in it
+    uint32_t key_seq;                   // isr_seq when it was taken
+} rec;
+
+/* ============================================================================
+ * PRIVATE HELPERS
+ * ========================================================================== */
+static inline uint8_t* PutVarint(uint8_t *p, int32_t delta)
+{
+    uint32_t z = ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31);
+
+    while (z >= 0x80U) {
+        *p++ = (uint8_t)(z | 0x80U);
+        z >>= 7;
+    }
+    *p++ = (uint8_t)z;
+    return p;
+}
+
+static inline const void* FieldAddr(const RecField_t *f)
+{
+    return (const uint8_t *)&g_sys + f->offset;
+}
+
+static inline void RequestKey(void)
+{
+    if (rec.key == REC_KEY_IDLE) rec.key = REC_KEY_WANTED;
+}
+
+/* Block in progress ends; the post-trigger window freezes with the last */
+static void CloseBlock(void)
+{
+    RecHeader_t *hdr = &g_rec.hdr;
+
+    rec.blk = NULL;
+    if (hdr->mode == REC_MODE_POST_TRIGGER && hdr->post_left == 0U) {
+        hdr->mode = REC_MODE_FROZEN;
+    }
+}
+
+/* The snapped keyframe's block, deltas from this period on */
+static void OpenBlock(void)
+{
+    RecHeader_t *hdr = &g_rec.hdr;
+
+    rec.key = REC_KEY_IDLE;
+    if (hdr->mode == REC_MODE_POST_TRIGGER) {
+        if (hdr->post_left == 0U) {
+            hdr->mode = REC_MODE_FROZEN;
+            return;
+        }
+        hdr->post_left--;
+    }
+
+    hdr->head = rec.key_blk;
+    rec.blk = &g_rec.block[hdr->head];
+    rec.blk->first_frame = hdr->frame_count;
+    rec.blk->used = rec.key_size;
+    rec.blk->frames = 0;
+    rec.blk->seq = hdr->next_seq++;
+
+    memset(rec.prev_code, 0, sizeof(rec.prev_code));
+    memset(rec.prev_duty, 0, sizeof(rec.prev_duty));
+    rec.last_state = rec.key_state;
+}
+
+/* Keyframe layout: tag, { id, size } per field with room for its value */
+static void KeyframeHeaders(uint8_t *p)
+{
+    *p++ = REC_TAG_KEYFRAME;
+    for (uint32_t i = 0; i < REC_NUM_FIELDS; i++) {
+        const RecField_t *f = &rec_fields[i];
+        *p++ = f->id;
+        *p++ = (uint8_t)(f->size & 0xFFU);
+        *p++ = (uint8_t)(f->size >> 8);
+        p += f->size;
+    }
+    *p = REC_FIELD_END;
+}
+
+static void KeyframeValues(uint8_t *p)
+{
+    p++;
+    for (uint32_t i = 0; i < REC_NUM_FIELDS; i++) {
+        const RecField_t *f = &rec_fields[i];
+        p += 3;
+        memcpy(p, FieldAddr(f), f->size);
+        p += f->size;
+    }
+}
+
+static void WriteCommands(uint32_t cmds)
+{
+    uint8_t *start = &rec.blk->data[rec.blk->used];
+    uint8_t *p = start + 2;     // Tag and count filled in below
+    uint8_t count = 0;
+
+    for (uint32_t i = 0; i < rec.cmd_count; i++) {
+        const RecField_t *f = &rec_fields[rec.cmd_field[i]];
+        if ((f->cmd & cmds) == 0U) continue;
+
+        *p++ = f->id;
+        *p++ = (uint8_t)f->size;
+        memcpy(p, FieldAddr(f), f->size);
+        p += f->size;
+        count++;
+    }
+
+    if (count != 0U) {
+        start[0] = REC_TAG_COMMAND;
+        start[1] = count;
+        rec.blk->used = (uint16_t)(p - rec.blk->data);
+    }
+}
+
+/* ============================================================================
+ * INITIALIZATION
+ * ========================================================================== */
+void Recorder_Init(void)
+{
+    uint32_t key = 2, cmd = 2;
+
+    memset(&g_rec, 0, sizeof(g_rec));
+    memset(&rec, 0, sizeof(rec));
+
+    for (uint32_t i = 0; i < REC_NUM_FIELDS; i++) {
+        key += 3U + rec_fields[i].size;
+        if (rec_fields[i].cmd != 0U) {
+            cmd += 2U + rec_fields[i].size;
+            rec.cmd_field[rec.cmd_count++] = (uint8_t)i;
+        }
+    }
+
+    g_rec.hdr.magic = REC_MAGIC;
+    g_rec.hdr.version = REC_FORMAT_VERSION;
+    g_rec.hdr.header_size = sizeof(RecHeader_t);
+    g_rec.hdr.block_size = REC_BLOCK_SIZE;
+    g_rec.hdr.block_count = REC_BLOCK_COUNT;
+    g_rec.hdr.build_id = REC_BUILD_ID;
+
+    /* Layout does not fit the configured block: stay off */
+    if (REC_BLOCK_COUNT < 2 ||
+        key + cmd + REC_FRAME_MAX + REC_OUTPUT_MAX > REC_PAYLOAD_SIZE) {
+        return;
+    }
+    rec.key_size = (uint16_t)key;
+    rec.cmd_max = (uint16_t)cmd;
+
+    Recorder_Rearm();
+}
+
+void Recorder_Rearm(void)
+{
+    if (rec.key_size == 0U) return;
+
+    g_rec.hdr.mode = REC_MODE_OFF;      // ISR skips while the ring is reset
+    for (uint32_t i = 0; i < REC_BLOCK_COUNT; i++) {
+        g_rec.block[i].seq = 0;
+    }
+    g_rec.hdr.head = 0;
+    g_rec.hdr.next_seq = 1;
+    g_rec.hdr.frame_count = 0;
+    g_rec.hdr.trigger_frame = 0;
+    g_rec.hdr.trigger_faults = 0;
+    g_rec.hdr.post_left = 0;
+    rec.blk = NULL;                     // First period asks for a keyframe
+    rec.frame_open = false;
+    rec.key = REC_KEY_IDLE;
+    g_rec.hdr.mode = REC_MODE_ARMED;
+}
+
+/* ============================================================================
+ * TRIGGER
+ * ========================================================================== */
+void Recorder_Trigger(uint32_t faults)
+{
+    if (g_rec.hdr.mode != REC_MODE_ARMED) return;
+
+    g_rec.hdr.trigger_frame = g_rec.hdr.frame_count;
+    g_rec.hdr.trigger_faults = faults;
+    g_rec.hdr.post_left = REC_POST_TRIGGER_BLOCKS;
+    g_rec.hdr.mode = REC_MODE_POST_TRIGGER;
+}
+
+/* ============================================================================
+ * ISR HOOKS
+ * ========================================================================== */
+void Recorder_CaptureInput(const AdcRaw_t *raw)
+{
+    RecHeader_t *hdr = &g_rec.hdr;
+
+    rec.isr_seq++;
+    rec.frame_open = false;
+    if (hdr->mode != REC_MODE_ARMED && hdr->mode != REC_MODE_POST_TRIGGER) return;
+
+    if (g_sys.faults != FAULT_NONE) {
+        Recorder_Trigger((uint32_t)g_sys.faults);
+    }
+
+    /* Shed for the control ISR deadline: the block ends, capture resumes
+     * behind the next keyframe */
+    if (g_sys.deadline.shed & SHED_RECORDER) {
+        CloseBlock();
+        return;
+    }
+
+    /* A keyframe taken since the previous period opens its block; one with
+     * an ISR in between is stale and taken again */
+    if (rec.key == REC_KEY_SNAPPED) {
+        if (rec.key_seq == rec.isr_seq - 1U) OpenBlock();
+        else rec.key = REC_KEY_WANTED;
+        if (hdr->mode == REC_MODE_FROZEN) return;
+    }
+
+    /* A state transition comes with main-loop resets outside the command
+     * fields: the block ends and the next keyframe carries them */
+    if (rec.blk != NULL && g_sys.state != rec.last_state) {
+        CloseBlock();
+    }
+    if (rec.blk == NULL) {
+        RequestKey();
+        return;
+    }
+
+    /* Command groups flagged by their writers, else just the frame */
+    uint32_t cmds = rec.cmd_dirty | rec.cmd_open;
+    uint32_t room = REC_PAYLOAD_SIZE - rec.blk->used;
+    uint32_t need = ((cmds != 0U) ? rec.cmd_max : 0U) + REC_FRAME_MAX + REC_OUTPUT_MAX;
+
+    if (need > room) {
+        CloseBlock();
+        RequestKey();
+        return;
+    }
+    if (room < REC_KEY_LEAD) RequestKey();
+    if (cmds != 0U) {
+        rec.cmd_dirty = 0U;
+        WriteCommands(cmds);
+    }
+
+    /* Frame: raw codes as deltas */
+    uint8_t *p = &rec.blk->data[rec.blk->used];
+    *p++ = REC_TAG_FRAME;
+    for (uint32_t i = 0; i < ADC_RAW_COUNT; i++) {
+        p = PutVarint(p, (int32_t)raw->code[i] - (int32_t)rec.prev_code[i]);
+        rec.prev_code[i] = raw->code[i];
+    }
+    rec.blk->used = (uint16_t)(p - rec.blk->data);
+    rec.blk->frames++;
+    hdr->frame_count++;
+    rec.frame_open = true;
+}
+
+void Recorder_Output(uint16_t duty_a, uint16_t duty_b, uint16_t duty_c)
+{
+    if (!rec.frame_open) return;
+
+    uint8_t *p = &rec.blk->data[rec.blk->used];
+    *p++ = REC_TAG_OUTPUT;
+    p = PutVarint(p, (int32_t)duty_a - (int32_t)rec.prev_duty[0]);
+    p = PutVarint(p, (int32_t)duty_b - (int32_t)rec.prev_duty[1]);
+    p = PutVarint(p, (int32_t)duty_c - (int32_t)rec.prev_duty[2]);
+    rec.prev_duty[0] = duty_a;
+    rec.prev_duty[1] = duty_b;
+    rec.prev_duty[2] = duty_c;
+    rec.blk->used = (uint16_t)(p - rec.blk->data);
+    rec.frame_open = false;
+}
+
+/* ============================================================================
+ * KEYFRAMES (main loop)
+ * ========================================================================== */
+void Recorder_Service(void)
+{
+    RecHeader_t *hdr = &g_rec.hdr;
+
+    if (rec.key != REC_KEY_WANTED) return;
+    if (hdr->mode != REC_MODE_ARMED &&
+        (hdr->mode != REC_MODE_POST_TRIGGER || hdr->post_left == 0U)) return;
+
+    /* The next block, the oldest: invalid from here until the ISR opens it */
+    uint32_t idx = (hdr->next_seq == 1U) ? 0U : (hdr->head + 1U) % REC_BLOCK_COUNT;
+    RecBlock_t *blk = &g_rec.block[idx];
+    blk->seq = 0;
+    KeyframeHeaders(blk->data);
+
+    /* Values between two control ISRs; torn if one ran during the copy */
+    uint32_t seq = rec.isr_seq;
+    __DMB();
+    KeyframeValues(blk->data);
+    SystemState_t state = g_sys.state;
+    __DMB();
+    if (rec.isr_seq != seq) return;
+
+    rec.key_blk = (uint8_t)idx;
+    rec.key_state = state;
+    rec.key_seq = seq;
+    __DMB();                    // Keyframe complete before it is offered
+    rec.key = REC_KEY_SNAPPED;
+}
+
+/* ============================================================================
+ * COMMAND FLAGS (main loop)
+ * ========================================================================== */
+#if RECORDER_ENABLE
+void Recorder_Begin(uint32_t cmds)
+{
+    rec.cmd_open |= cmds;
+    __DMB();                    // Flagged before the first write
+}
+
+/* The ISR may clear the dirty flags between this read and write: groups
+ * it just recorded are then recorded once more, which is harmless */
+void Recorder_End(uint32_t cmds)
+{
+    __DMB();                    // Last write done before the final record
+    rec.cmd_dirty |= cmds;
+    rec.cmd_open &= ~cmds;
+}
+#endif
+
+/* ============================================================================
+ * FIELD LOOKUP
+ * ========================================================================== */
+const RecField_t* Recorder_FindField(uint8_t id)
+{
+    for (uint32_t i = 0; i < REC_NUM_FIELDS; i++) {
+        if (rec_fields[i].id == id) return &rec_fields[i];
+    }
+    return NULL;
+}
@@ -0,0 +1,293 @@
+/**
+ * @file telemetry.c
+ * @brief Push-Mode Binary Telemetry Stream on its own UART
+ * @version 2.1
+ * @date 2025-12
+ *
+ * The ISR side takes a sample when the time accumulated from the control
+ * period Ts reaches 1 / rate, so the sampling instants jitter by at most
+ * one control period while the switching frequency is scheduled. A
+ * sample is the index followed by one raw integer per signal of the set;
+ * when the ring is full, or while the deadline supervisor sheds telemetry
+ * (deadline.c), the sample is counted as dropped and its index skipped,
+ * which the host sees as a gap.
+ *
+ * The main loop packs consecutive samples as zigzag varint deltas (a
+ * current at 0.1 A resolution moving by less than 6.3 A per sample takes
+ * one byte), adds the CRC, COBS-encodes the frame between two delimiters
+ * and hands it to the telemetry UART (telemetry_uart.c) once the previous
+ * frame is out. That line carries nothing else, so the stream never
+ * delays or corrupts Modbus traffic. The frame budget is the smaller of
+ * TELEMETRY_FRAME_MAX and TELEMETRY_LINK_MS of line time: at 921600 baud
+ * 921 bytes per 10 ms tick, several kHz for a full set.
+ *
+ *   id  name       unit  exp  source
+ *   0-2 ia..ic     A     -1   ac.Ia..Ic
+ *   3-5 va..vc     V     -1   ac.Va..Vc
+ *   6   vdc        V     -1   dc.Vdc
+ *   7-8 vdc_pos/neg V    -1   dc.Vdc_pos / Vdc_neg
+ *   9   vnp        V     -1   dc.Vnp
+ *   10  idc        A     -1   dc.Idc
+ *   11  id         A     -1   I_dq.d
+ *   12  iq         A     -1   I_dq.q
+ *   13  id_ref     A     -1   ref.Id_ref
+ *   14  iq_ref     A     -1   ref.Iq_ref
+ *   15  vd         V     -1   V_dq.d
+ *   16  vq         V     -1   V_dq.q
+ *   17  vd_ref     V     -1   V_ref_dq.d
+ *   18  vq_ref     V     -1   V_ref_dq.q
+ *   19  pac        W      1   ac.Pac
+ *   20  qac        VAr    1   ac.Qac
+ *   21  p_ref      W      1   ref.P_ref
+ *   22  q_ref      VAr    1   ref.Q_ref
+ *   23  frequency  Hz    -3   ac.frequency
+ *   24  theta      rad   -4   pll.theta
+ *   25-27 duty_a..c tick  0   svpwm.duty_a..c (HRTIM compare)
+ */
+
+#include "telemetry.h"
+#include "modbus.h"
+#include "config.h"
+#include "arm_math.h"
+#include <stddef.h>
+
+/* ============================================================================
+ * CONSTANTS
+ * ========================================================================== */
+#define FRAME_RAW_MAX   (TELEMETRY_FRAME_MAX + TLM_SIG_COUNT * TELEMETRY_VARINT_MAX)
+
+typedef struct {
+    uint16_t offset;            // offsetof(SystemData_t, ...)
+    bool u16;                   // uint16_t member (else float32_t)
+    float32_t scale;            // raw = value · scale = value · 10^-exp
+} TlmSource_t;
+
+#define SIG(id, member, scale) \
+    [id] = { offsetof(SystemData_t, member), false, scale }
+#define SIG_U16(id, member) \
+    [id] = { offsetof(SystemData_t, member), true, 1.0f }
+
+static const TlmSource_t tlm_src[TLM_SIG_COUNT] = {
+    SIG(TLM_IA,         ac.Ia,          1e1f),
+    SIG(TLM_IB,         ac.Ib,          1e1f),
+    SIG(TLM_IC,         ac.Ic,          1e1f),
+    SIG(TLM_VA,         ac.Va,          1e1f),
+    SIG(TLM_VB,         ac.Vb,          1e1f),
+    SIG(TLM_VC,         ac.Vc,          1e1f),
+    SIG(TLM_VDC,        dc.Vdc,         1e1f),
+    SIG(TLM_VDC_POS,    dc.Vdc_pos,     1e1f),
+    SIG(TLM_VDC_NEG,    dc.Vdc_neg,     1e1f),
+    SIG(TLM_VNP,        dc.Vnp,         1e1f),
+    SIG(TLM_IDC,        dc.Idc,         1e1f),
+    SIG(TLM_ID,         I_dq.d,         1e1f),
+    SIG(TLM_IQ,         I_dq.q,         1e1f),
+    SIG(TLM_ID_REF,     ref.Id_ref,     1e1f),
+    SIG(TLM_IQ_REF,     ref.Iq_ref,     1e1f),
+    SIG(TLM_VD,         V_dq.d,         1e1f),
+    SIG(TLM_VQ,         V_dq.q,         1e1f),
+    SIG(TLM_VD_REF,     V_ref_dq.d,     1e1f),
+    SIG(TLM_VQ_REF,     V_ref_dq.q,     1e1f),
+    SIG(TLM_PAC,        ac.Pac,         1e-1f),
+    SIG(TLM_QAC,        ac.Qac,         1e-1f),
+    SIG(TLM_P_REF,      ref.P_ref,      1e-1f),
+    SIG(TLM_Q_REF,      ref.Q_ref,      1e-1f),
+    SIG(TLM_FREQUENCY,  ac.frequency,   1e3f),
+    SIG(TLM_THETA,      pll.theta,      1e4f),
+    SIG_U16(TLM_DUTY_A, svpwm.duty_a),
+    SIG_U16(TLM_DUTY_B, svpwm.duty_b),
+    SIG_U16(TLM_DUTY_C, svpwm.duty_c),
+};
+
+/* ============================================================================
+ * PRIVATE VARIABLES
+ * ========================================================================== */
+static FW_INSTANCE_LOCAL int32_t ring[TELEMETRY_RING_WORDS];
+static FW_INSTANCE_LOCAL uint8_t raw[FRAME_RAW_MAX];
+static FW_INSTANCE_LOCAL uint8_t line[TELEMETRY_FRAME_MAX];    // Held by the UART until sent
+
+/* ============================================================================
+ * PRIVATE HELPERS
+ * ========================================================================== */
+static int32_t SignalRaw(const SystemData_t *sys, uint8_t id)
+{
+    const TlmSource_t *s = &tlm_src[id];
+    const uint8_t *p = (const uint8_t *)sys + s->offset;
+    
+    if (s->u16) return (int32_t)*(const uint16_t *)p;
+    
+    float32_t v = *(const float32_t *)p * s->scale;
+    return (int32_t)((v >= 0.0f) ? v + 0.5f : v - 0.5f);
+}
+
+static uint16_t PutVarint(uint8_t *out, uint16_t len, int32_t delta)
+{
+    uint32_t z = ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31);
+    
+    while (z >= 0x80U) {
+        out[len++] = (uint8_t)(z | 0x80U);
+        z >>= 7;
+    }
+    out[len++] = (uint8_t)z;
+    return len;
+}
+
+static uint16_t Put16(uint8_t *out, uint16_t len, uint16_t v)
+{
+    out[len++] = (uint8_t)v;
+    out[len++] = (uint8_t)(v >> 8);
+    return len;
+}
+
+static uint16_t Put32(uint8_t *out, uint16_t len, uint32_t v)
+{
+    len = Put16(out, len, (uint16_t)v);
+    return Put16(out, len, (uint16_t)(v >> 16));
+}
+
+/* COBS between two delimiters; returns the line length */
+static uint16_t CobsFrame(const uint8_t *in, uint16_t n, uint8_t *out)
+{
+    uint16_t len = 0, code_at;
+    uint8_t code = 1;
+    
+    out[len++] = 0x00U;
+    code_at = len++;
+    for (uint16_t i = 0; i < n; i++) {
+        if (in[i] != 0x00U) {
+            out[len++] = in[i];
+            code++;
+        }
+        if (in[i] == 0x00U || code == 0xFFU) {
+            out[code_at] = code;
+            code = 1;
+            code_at = len++;
+        }
+    }
+    out[code_at] = code;
+    out[len++] = 0x00U;
+    return len;
+}
+
+/* ============================================================================
+ * CONFIGURATION (main loop)
+ * The ISR preempts the main loop, never the reverse: with the period at
+ * zero it leaves the stream alone until the new set is complete.
+ * ========================================================================== */
+void Telemetry_Configure(TelemetryStream_t *tlm, uint32_t mask, uint16_t rate_Hz)
+{
+    tlm->period = 0.0f;
+    __DMB();
+    
+    mask &= (uint32_t)TLM_SET_ALL;
+    if (rate_Hz > TELEMETRY_RATE_MAX_HZ) rate_Hz = TELEMETRY_RATE_MAX_HZ;
+    
+    tlm->n_sig = 0;
+    for (uint8_t id = 0; id < TLM_SIG_COUNT; id++) {
+        if (mask & (1UL << id)) tlm->sig[tlm->n_sig++] = id;
+    }
+    
+    /* Power-of-two capacity: head and tail wrap with the ring */
+    tlm->stride = (uint16_t)(1U + tlm->n_sig);
+    tlm->capacity = 1U;
+    while (2U * tlm->capacity * tlm->stride <= TELEMETRY_RING_WORDS) tlm->capacity *= 2U;
+    
+    tlm->mask = mask;
+    tlm->rate_Hz = rate_Hz;
+    tlm->phase = 0.0f;
+    tlm->index = 0;
+    tlm->head = 0;
+    tlm->tail = 0;
+    tlm->dropped = 0;
+    __DMB();
+    
+    if (rate_Hz > 0U && tlm->n_sig > 0U) tlm->period = 1.0f / (float32_t)rate_Hz;
+}
+
+/* ============================================================================
+ * SAMPLING (control ISR)
+ * ========================================================================== */
+void Telemetry_Capture(SystemData_t *sys)
+{
+    TelemetryStream_t *tlm = &sys->telem;
+    const float32_t period = tlm->period;
+    
+    if (period <= 0.0f) return;
+    
+    tlm->phase += sys->timing.Ts;
+    if (tlm->phase < period) return;
+    tlm->phase -= period;
+    if (tlm->phase >= period) tlm->phase = 0.0f;
+    
+    const uint32_t head = tlm->head;
+    if ((sys->deadline.shed & SHED_TELEMETRY) || head - tlm->tail >= tlm->capacity) {
+        tlm->dropped++;
+    } else {
+        int32_t *rec = &ring[(head & (tlm->capacity - 1U)) * tlm->stride];
+        rec[0] = (int32_t)tlm->index;
+        for (uint8_t i = 0; i < tlm->n_sig; i++) {
+            rec[1U + i] = SignalRaw(sys, tlm->sig[i]);
+        }
+        tlm->head = head + 1U;
+    }
+    tlm->index++;
+}
+
+/* ============================================================================
+ * FRAMING (main loop)
+ * ========================================================================== */
+void Telemetry_Process(TelemetryStream_t *tlm)
+{
+    const uint32_t head = tlm->head;
+    uint32_t tail = tlm->tail;
+    
+    if (tlm->period <= 0.0f || head == tail || !Telemetry_UartReady()) return;
+    
+    /* Raw bytes that fit the line budget after COBS (1 per 254) and the
+     * delimiters */
+    uint32_t budget = (uint32_t)TELEMETRY_BAUDRATE / 10U * TELEMETRY_LINK_MS / 1000U;
+    if (budget > TELEMETRY_FRAME_MAX) budget = TELEMETRY_FRAME_MAX;
+    const uint16_t raw_max = (uint16_t)((budget - 3U) * 254U / 255U - 2U);
+    
+    const uint32_t first = (uint32_t)ring[(tail & (tlm->capacity - 1U)) * tlm->stride];
+    uint16_t len = 0;
+    raw[len++] = TELEMETRY_VERSION;
+    len = Put16(raw, len, tlm->seq);
+    len = Put32(raw, len, tlm->mask);
+    len = Put16(raw, len, tlm->rate_Hz);
+    len = Put32(raw, len, first);
+    const uint16_t count_at = len++;
+    
+    int32_t prev[TLM_SIG_COUNT] = {0};
+    uint8_t n = 0;
+    while (tail != head && n < 255U) {
+        const int32_t *rec = &ring[(tail & (tlm->capacity - 1U)) * tlm->stride];
+        if ((uint32_t)rec[0] != first + n) break;       // Drop gap: next frame
+    
+        uint16_t end = len;
+        for (uint8_t i = 0; i < tlm->n_sig; i++) {
+            end = PutVarint(raw, end, rec[1U + i] - prev[i]);
+        }
+        if (end > raw_max) break;
+        for (uint8_t i = 0; i < tlm->n_sig; i++) prev[i] = rec[1U + i];
+        len = end;
+        n++;
+        tail++;
+    }
+    
+    if (n == 0U) {
+        /* One sample of this set does not fit the budget: skip it rather
+         * than stall (use a smaller set or a faster line) */
+        tlm->tail = tail + 1U;
+        tlm->dropped++;
+        return;
+    }
+    
+    raw[count_at] = n;
+    len = Put16(raw, len, Modbus_Crc16(raw, len));
+    
+    if (Telemetry_UartSend(line, CobsFrame(raw, len, line))) {
+        tlm->tail = tail;
+        tlm->seq++;
+        tlm->frames++;
+    }
+}
@@ -0,0 +1,110 @@
+/**
+ * @file telemetry_uart.c
+ * @brief Telemetry Stream UART Driver (USART1, transmit only)
+ * @version 2.1
+ * @date 2025-12
+ *
+ * The binary telemetry stream (telemetry.c) has a line of its own: USART1
+ * TX on PB6 drives a second RS485 transceiver whose driver is always
+ * enabled (DE tied high), point to point to the host's telemetry port.
+ * The Modbus bus is never driven by a telemetry frame, so polling and
+ * other slaves on it are unaffected by the stream.
+ *
+ * A frame goes out by DMA from the main loop; the UART is ready again
+ * once the DMA has handed over the last byte. There is no reception and
+ * no driver-enable timing, so the HAL callbacks are left to modbus.c.
+ */
+
+#include "telemetry.h"
+#include "main.h"
+#include "config.h"
+
+/* ============================================================================
+ * PRIVATE VARIABLES
+ * ========================================================================== */
+static UART_HandleTypeDef *uart;
+static DMA_HandleTypeDef hdma_tx;
+
+/* ============================================================================
+ * INITIALIZATION
+ * ========================================================================== */
+void Telemetry_UartInit(UART_HandleTypeDef *huart)
+{
+    GPIO_InitTypeDef GPIO_InitStruct = {0};
+    
+    uart = huart;
+    
+    __HAL_RCC_USART1_CLK_ENABLE();
+    __HAL_RCC_GPIOB_CLK_ENABLE();
+    __HAL_RCC_DMAMUX1_CLK_ENABLE();
+    __HAL_RCC_DMA1_CLK_ENABLE();
+    
+    /* TX on AF7 */
+    GPIO_InitStruct.Pin = UART_TELEM_TX_PIN;
+    GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
+    GPIO_InitStruct.Pull = GPIO_PULLUP;
+    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_HIGH;
+    GPIO_InitStruct.Alternate = GPIO_AF7_USART1;
+    HAL_GPIO_Init(UART_TELEM_TX_PORT, &GPIO_InitStruct);
+    
+    huart->Instance = USART1;
+    huart->Init.BaudRate = TELEMETRY_BAUDRATE;
+    huart->Init.WordLength = UART_WORDLENGTH_8B;
+    huart->Init.StopBits = UART_STOPBITS_1;
+    huart->Init.Parity = UART_PARITY_NONE;
+    huart->Init.Mode = UART_MODE_TX;
+    huart->Init.HwFlowCtl = UART_HWCONTROL_NONE;
+    huart->Init.OverSampling = UART_OVERSAMPLING_16;
+    huart->Init.OneBitSampling = UART_ONE_BIT_SAMPLE_DISABLE;
+    huart->Init.ClockPrescaler = UART_PRESCALER_DIV1;
+    huart->AdvancedInit.AdvFeatureInit = UART_ADVFEATURE_NO_INIT;
+    if (HAL_UART_Init(huart) != HAL_OK) {
+        Error_Handler();
+    }
+    
+    hdma_tx.Instance = DMA1_Channel4;
+    hdma_tx.Init.Request = DMA_REQUEST_USART1_TX;
+    hdma_tx.Init.Direction = DMA_MEMORY_TO_PERIPH;
+    hdma_tx.Init.PeriphInc = DMA_PINC_DISABLE;
+    hdma_tx.Init.MemInc = DMA_MINC_ENABLE;
+    hdma_tx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+    hdma_tx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+    hdma_tx.Init.Mode = DMA_NORMAL;
+    hdma_tx.Init.Priority = DMA_PRIORITY_LOW;
+    if (HAL_DMA_Init(&hdma_tx) != HAL_OK) {
+        Error_Handler();
+    }
+    __HAL_LINKDMA(huart, hdmatx, hdma_tx);
+    
+    HAL_NVIC_SetPriority(USART1_IRQn, TELEMETRY_IRQ_PRIORITY, 0);
+    HAL_NVIC_EnableIRQ(USART1_IRQn);
+    HAL_NVIC_SetPriority(DMA1_Channel4_IRQn, TELEMETRY_IRQ_PRIORITY, 0);
+    HAL_NVIC_EnableIRQ(DMA1_Channel4_IRQn);
+}
+
+/* ============================================================================
+ * TRANSMISSION (main loop)
+ * ========================================================================== */
+bool Telemetry_UartReady(void)
+{
+    return uart != NULL && uart->gState == HAL_UART_STATE_READY;
+}
+
+bool Telemetry_UartSend(const uint8_t *data, uint16_t len)
+{
+    if (!Telemetry_UartReady()) return false;
+    return HAL_UART_Transmit_DMA(uart, (uint8_t *)data, len) == HAL_OK;
+}
+
+/* ============================================================================
+ * INTERRUPT HANDLERS
+ * ========================================================================== */
+void USART1_IRQHandler(void)
+{
+    HAL_UART_IRQHandler(uart);
+}
+
+void DMA1_Channel4_IRQHandler(void)
+{
+    HAL_DMA_IRQHandler(&hdma_tx);
+}
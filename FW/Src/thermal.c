@@ -0,0 +1,206 @@
+/**
+ * @file thermal.c
+ * @brief Junction Temperature Estimator and Predictive Derating
+ * @version 2.1
+ * @date 2025-12
+ *
+ * The heatsink NTC sits centimetres from the dies and lags them by seconds,
+ * so junction temperatures are estimated from a loss model instead. Per
+ * switch position (T1, T4 and the T2/T3 neutral path of each phase):
+ *
+ *   P_cond = i² · RDS(on)(Tj) · share of the period the position conducts
+ *   P_sw   = Esw/(A·V) · |i| · Vdc/2 · f_sw      (hard-switching position)
+ *   P_bd   = Vf · |i| · 2·t_dead · f_sw          (the other position)
+ *
+ * With duty m of the phase, T1 (m > 0) or T4 (m < 0) conducts |m| of the
+ * period and the neutral path the rest. The outer switch commutates hard
+ * when current and voltage have the same sign, the neutral path otherwise.
+ * Under FCS-MPC the loss at the fixed carrier rate is an upper bound.
+ *
+ * The ISR samples the losses every THERMAL_LOSS_DECIM periods into one of
+ * two banks (~150 cycles per sample, under 1 % of the 850-cycle ISR budget
+ * averaged over the decimation; the Foster update with its 12 expf() costs
+ * ~3 k cycles every 10 ms in the main loop). The main loop swaps the bank
+ * and steps the Foster network of each position from the NTC temperature
+ * with the energy of the elapsed interval:
+ *
+ *   ΔT_k ← ΔT_k·a_k + R_k·(1 - a_k)·P,   a_k = exp(-Δt/τ_k),   Tj = T_ntc + Σ ΔT_k
+ *
+ * Holding the filtered loss for THERMAL_PREDICT_S gives the predicted
+ * junction temperature; the derating integrates towards the loss scale
+ * that brings the hottest prediction to THERMAL_TJ_LIMIT_C. Losses fall at
+ * least in proportion to the current, so scaling by that ratio is safe.
+ */
+
+#include "thermal.h"
+#include "config.h"
+#include <math.h>
+#include <string.h>
+
+/* ============================================================================
+ * CONSTANTS
+ * ========================================================================== */
+#define LOSS_EDGES      (0.5f * THERMAL_LOSS_DECIM)    // Switching periods per loss sample
+
+#define POS_T1          0U
+#define POS_T4          1U
+#define POS_T23         2U
+#define POS_TYPE(pos)   (((pos) % 3U == POS_T23) ? 1U : 0U)  // 0 = outer, 1 = neutral path
+
+/* Junction to heatsink (at the NTC) Foster fit per position type; the last
+ * term is the spreading in the heatsink under the position footprint */
+static const float32_t foster_R[2][THERMAL_FOSTER_ORDER] = {
+    { 0.042f, 0.075f, 0.343f },     // T1/T4: 2 devices, RthJC + RthCS = 0.16 K/W
+    { 0.011f, 0.013f, 0.166f },     // T2/T3: 4 devices
+};
+static const float32_t foster_tau[2][THERMAL_FOSTER_ORDER] = {
+    { 0.013f, 0.140f, 2.66f },
+    { 0.013f, 0.116f, 3.21f },
+};
+static const float32_t rds_25[2] = { THERMAL_RDS_OUTER_OHM, THERMAL_RDS_INNER_OHM };
+
+/* ============================================================================
+ * INITIALIZATION
+ * ========================================================================== */
+void Thermal_Init(Thermal_t *th)
+{
+    memset(th, 0, sizeof(*th));
+    for (uint32_t pos = 0; pos < THERMAL_POSITIONS; pos++) {
+        th->R_on[pos] = rds_25[POS_TYPE(pos)];
+    }
+    th->derating = 1.0f;
+}
+
+/* ============================================================================
+ * LOSS SAMPLING (ISR, every THERMAL_LOSS_DECIM periods)
+ * ========================================================================== */
+void Thermal_AccumulateLosses(SystemData_t *sys)
+{
+    Thermal_t *th = &sys->thermal;
+    ThermalAcc_t *acc = &th->acc;
+    
+    if (++acc->decim < THERMAL_LOSS_DECIM) return;
+    acc->decim = 0;
+    
+    const float32_t i_ph[3] = { sys->ac.Ia, sys->ac.Ib, sys->ac.Ic };
+    const float32_t m_ph[3] = { sys->svpwm.ma, sys->svpwm.mb, sys->svpwm.mc };
+    float32_t *E = acc->E[acc->bank];
+    
+    /* Per ampere, over one loss sample (two ISRs per switching period at
+     * any carrier frequency; the sample lasts longer at a lower one) */
+    const float32_t loss_ts = sys->timing.Ts * THERMAL_LOSS_DECIM;
+    const float32_t e_sw = THERMAL_ESW_J_PER_AV * 0.5f * sys->dc.Vdc * LOSS_EDGES;
+    const float32_t e_bd = THERMAL_VF_BODY_V * 2e-9f * sys->deadtime.dt_ns * LOSS_EDGES;
+    
+    for (uint32_t ph = 0; ph < 3; ph++) {
+        float32_t i = i_ph[ph];
+        float32_t m = m_ph[ph];
+        float32_t d = fabsf(m);
+        float32_t i_abs = fabsf(i);
+        float32_t e_cond = i * i * loss_ts;
+        uint32_t outer = 3U * ph + ((m >= 0.0f) ? POS_T1 : POS_T4);
+        uint32_t inner = 3U * ph + POS_T23;
+    
+        float32_t E_outer = e_cond * th->R_on[outer] * d;
+        float32_t E_inner = e_cond * th->R_on[inner] * (1.0f - d);
+        if (i * m >= 0.0f) {
+            E_outer += e_sw * i_abs;
+            E_inner += e_bd * i_abs;
+        } else {
+            E_inner += e_sw * i_abs;
+            E_outer += e_bd * i_abs;
+        }
+        E[outer] += E_outer;
+        E[inner] += E_inner;
+    }
+}
+
+/* ============================================================================
+ * FOSTER NETWORK, PREDICTION AND DERATING (main loop)
+ * ========================================================================== */
+void Thermal_Update(SystemData_t *sys, uint32_t elapsed_ms)
+{
+    Thermal_t *th = &sys->thermal;
+    Temperatures_t *temps = &sys->temps;
+    
+    if (elapsed_ms == 0U) return;
+    const float32_t dt = 1e-3f * (float32_t)elapsed_ms;
+    
+    /* The ISR cannot run inside a main-loop statement; after the swap it
+     * only writes the other bank */
+    uint8_t bank = th->acc.bank;
+    th->acc.bank = bank ^ 1U;
+    float32_t *E = th->acc.E[bank];
+    
+    float32_t a[2][THERMAL_FOSTER_ORDER];       // Decay over dt
+    float32_t ah[2][THERMAL_FOSTER_ORDER];      // Decay over the horizon
+    for (uint32_t t = 0; t < 2U; t++) {
+        for (uint32_t k = 0; k < THERMAL_FOSTER_ORDER; k++) {
+            a[t][k] = expf(-dt / foster_tau[t][k]);
+            ah[t][k] = expf(-THERMAL_PREDICT_S / foster_tau[t][k]);
+        }
+    }
+    
+    const float32_t T_ref = temps->T_heatsink;
+    const float32_t alpha = dt / (THERMAL_LOSS_TAU_S + dt);
+    float32_t T_max = T_ref, T_pred_max = T_ref, P_total = 0.0f;
+    float32_t k_min = 4.0f;         // Allowed loss scale (4 = no limit)
+    
+    for (uint32_t pos = 0; pos < THERMAL_POSITIONS; pos++) {
+        uint32_t t = POS_TYPE(pos);
+        float32_t P = E[pos] / dt;
+        E[pos] = 0.0f;
+        th->P_loss[pos] = P;
+        th->P_filt[pos] += alpha * (P - th->P_filt[pos]);
+        P_total += P;
+    
+        float32_t Tj = T_ref, T_free = T_ref, Z = 0.0f;
+        for (uint32_t k = 0; k < THERMAL_FOSTER_ORDER; k++) {
+            float32_t *dT = &th->dT[pos][k];
+            *dT = *dT * a[t][k] + foster_R[t][k] * (1.0f - a[t][k]) * P;
+            Tj += *dT;
+            T_free += *dT * ah[t][k];
+            Z += foster_R[t][k] * (1.0f - ah[t][k]);
+        }
+        float32_t rise = th->P_filt[pos] * Z;
+        th->Tj[pos] = Tj;
+        th->Tj_pred[pos] = T_free + rise;
+        th->R_on[pos] = rds_25[t] * (1.0f + THERMAL_RDS_TC * (Tj - 25.0f));
+    
+        if (Tj > T_max) T_max = Tj;
+        if (th->Tj_pred[pos] > T_pred_max) T_pred_max = th->Tj_pred[pos];
+    
+        /* Loss scale that puts the prediction on the limit */
+        if (rise > 0.1f) {
+            float32_t k_pos = (THERMAL_TJ_LIMIT_C - T_free) / rise;
+            if (k_pos < k_min) k_min = k_pos;
+        } else if (T_free > THERMAL_TJ_LIMIT_C) {
+            k_min = 0.0f;
+        }
+    }
+    th->P_total = P_total;
+    th->Tj_pred_max = T_pred_max;
+    
+    /* Published per phase: hotter outer switch, neutral path */
+    float32_t *Tj_out[3] = { temps->Tj_phase_a, temps->Tj_phase_b, temps->Tj_phase_c };
+    for (uint32_t ph = 0; ph < 3; ph++) {
+        const float32_t *Tj = &th->Tj[3U * ph];
+        Tj_out[ph][0] = (Tj[POS_T1] > Tj[POS_T4]) ? Tj[POS_T1] : Tj[POS_T4];
+        Tj_out[ph][1] = Tj[POS_T23];
+    }
+    temps->T_max = T_max;
+    
+#if THERMAL_PREDICT_ENABLE
+    /* Loss ∝ I^1..2: a current scale s cuts the loss by at least s, and a
+     * raise by s costs at most s², hence the square root when recovering */
+    if (k_min < 0.0f) k_min = 0.0f;
+    float32_t scale = (k_min < 1.0f) ? k_min : sqrtf(k_min);
+    float32_t d = th->derating * powf(scale, dt / THERMAL_DERATE_TAU_S);
+    if (d > th->derating + THERMAL_RECOVERY_PER_S * dt) d = th->derating + THERMAL_RECOVERY_PER_S * dt;
+    if (d > 1.0f) d = 1.0f;
+    if (d < 0.0f) d = 0.0f;
+    th->derating = d;
+#else
+    th->derating = 1.0f;
+#endif
+}
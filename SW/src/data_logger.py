@@ -173,6 +173,77 @@ class DataLogger:
             self.file_handle.flush()
 
 
+class TelemetryLogger:
+    """High-rate CSV of the binary telemetry stream (one row per sample,
+    a new file whenever the signal set or rate changes)"""
+    
+    def __init__(self, config: Dict[str, Any]):
+        self.config = config.get('logging', {})
+        self.enabled = self.config.get('enabled', True) and config.get('telemetry', {}).get('log', True)
+        self.directory = Path(self.config.get('directory', './logs'))
+        self.file_prefix = self.config.get('file_prefix', 'inverter_log') + '_telemetry'
+        
+        self.file_handle = None
+        self.csv_writer = None
+        self.layout = None
+        self.frame_queue: queue.Queue = queue.Queue()
+        self.running = False
+        self.thread: Optional[threading.Thread] = None
+        
+        self.directory.mkdir(parents=True, exist_ok=True)
+        
+    def start(self):
+        """Start the logger thread"""
+        if not self.enabled:
+            return
+            
+        self.running = True
+        self.thread = threading.Thread(target=self._log_worker, daemon=True)
+        self.thread.start()
+        
+    def stop(self):
+        """Stop the logger thread"""
+        self.running = False
+        if self.thread:
+            self.thread.join(timeout=2.0)
+        if self.file_handle:
+            self.file_handle.close()
+            self.file_handle = None
+            
+    def log(self, frame):
+        """Queue a decoded telemetry frame"""
+        if self.enabled and self.running:
+            self.frame_queue.put(frame)
+            
+    def _log_worker(self):
+        """Worker thread: write every sample of every frame"""
+        while self.running:
+            try:
+                frame = self.frame_queue.get(timeout=0.5)
+            except queue.Empty:
+                continue
+            try:
+                if (frame.mask, frame.rate) != self.layout:
+                    self._open_new_file(frame)
+                for t, row in zip(frame.times(), frame.values()):
+                    self.csv_writer.writerow([f"{t:.6f}"] + [f"{v:.4f}" for v in row])
+                self.file_handle.flush()
+            except Exception as e:
+                logger.error(f"Telemetry logger error: {e}")
+                
+    def _open_new_file(self, frame):
+        """Open a file for a new signal set / rate"""
+        if self.file_handle:
+            self.file_handle.close()
+        timestamp = datetime.now().strftime("%Y%m%d_%H%M%S")
+        path = self.directory / f"{self.file_prefix}_{timestamp}_{frame.rate}Hz.csv"
+        self.file_handle = open(path, 'w', newline='')
+        self.csv_writer = csv.writer(self.file_handle)
+        self.csv_writer.writerow(['t_s'] + frame.names)
+        self.layout = (frame.mask, frame.rate)
+        logger.info(f"Opened telemetry log: {path}")
+
+
 class EventLogger:
     """Logs events, faults, and state transitions"""
     
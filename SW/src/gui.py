@@ -13,6 +13,8 @@ import threading
 import time
 
 from modbus_client import ModbusClient, InverterData, SystemState
+from telemetry import TelemetryReceiver, SETS, signal_mask
+from data_logger import TelemetryLogger
 
 logger = logging.getLogger(__name__)
 
@@ -26,6 +28,10 @@ class InverterMonitorApp:
         self.running = False
         self.update_thread: Optional[threading.Thread] = None
         
+        # Binary telemetry stream (receiver runs while the stream is on)
+        self.telemetry: Optional[TelemetryReceiver] = None
+        self.telemetry_logger = TelemetryLogger(config)
+        
         # Data history for trends
         history_len = config.get('display', {}).get('trend_history_seconds', 300)
         self.history = {
@@ -341,6 +347,27 @@ class InverterMonitorApp:
         )
         self.clear_fault_btn.pack(pady=10)
         
+        # Binary telemetry stream
+        tlm_frame = ctk.CTkFrame(panel)
+        tlm_frame.pack(fill="x", padx=10, pady=10)
+        tlm_cfg = self.config.get('telemetry', {})
+        
+        ctk.CTkLabel(tlm_frame, text="Telemetry Stream (set, Hz)").grid(row=0, column=0, columnspan=3, pady=5)
+        
+        self.tlm_set = ctk.CTkOptionMenu(tlm_frame, values=list(SETS.keys()), width=90)
+        self.tlm_set.set(tlm_cfg.get('set', 'dq'))
+        self.tlm_set.grid(row=1, column=0, padx=5)
+        
+        self.tlm_rate = ctk.CTkEntry(tlm_frame, width=70)
+        self.tlm_rate.insert(0, str(tlm_cfg.get('rate_hz', 1000)))
+        self.tlm_rate.grid(row=1, column=1, padx=5)
+        
+        self.tlm_btn = ctk.CTkButton(tlm_frame, text="Start", width=70, command=self._toggle_telemetry)
+        self.tlm_btn.grid(row=1, column=2, padx=5)
+        
+        self.tlm_label = ctk.CTkLabel(tlm_frame, text="Stream off", justify="left", anchor="w")
+        self.tlm_label.grid(row=2, column=0, columnspan=3, sticky="w", padx=5, pady=5)
+        
     def _create_fault_panel(self):
         """Create fault display panel"""
         panel = ctk.CTkFrame(self.main_frame)
@@ -388,6 +415,8 @@ class InverterMonitorApp:
             
     def _disconnect(self):
         """Close connection"""
+        if self.telemetry:
+            self._toggle_telemetry()
         self.running = False
         if self.update_thread:
             self.update_thread.join(timeout=1.0)
@@ -471,6 +500,10 @@ class InverterMonitorApp:
             self.fault_text.insert("end", f"⚠ {fault}\n")
         self.fault_text.configure(state="disabled")
         
+        # Telemetry stream: last value and range over the last second
+        if self.telemetry:
+            self._update_telemetry_display()
+            
         # Update time
         self.time_label.configure(text=datetime.now().strftime("%Y-%m-%d %H:%M:%S"))
         
@@ -500,6 +533,51 @@ class InverterMonitorApp:
         else:
             self.status_label.configure(text="Failed to send power reference")
             
+    def _toggle_telemetry(self):
+        """Start or stop the binary telemetry stream"""
+        if self.telemetry:
+            self.modbus.write_telemetry(0, 0)
+            self.telemetry.stop()
+            self.telemetry_logger.stop()
+            self.telemetry = None
+            self.tlm_btn.configure(text="Start")
+            self.tlm_label.configure(text="Stream off")
+            return
+            
+        try:
+            rate = int(self.tlm_rate.get())
+        except ValueError:
+            self.status_label.configure(text="Telemetry rate must be an integer (Hz)")
+            return
+            
+        receiver = TelemetryReceiver(self.config, on_frame=self.telemetry_logger.log)
+        if not receiver.start():
+            self.status_label.configure(text=receiver.error)
+            return
+        if not self.modbus.write_telemetry(signal_mask([self.tlm_set.get()]), rate):
+            receiver.stop()
+            self.status_label.configure(text="Failed to start telemetry stream")
+            return
+            
+        self.telemetry = receiver
+        self.telemetry_logger.start()
+        self.tlm_btn.configure(text="Stop")
+        self.status_label.configure(text=f"Telemetry {self.tlm_set.get()} at {rate} Hz")
+        
+    def _update_telemetry_display(self):
+        """Stream statistics and per-signal values"""
+        dec = self.telemetry.decoder
+        buf = self.telemetry.buffer
+        lines = [f"{buf.rate} Hz, frames {dec.frames}, lost {dec.lost_frames} frames / "
+                 f"{dec.lost_samples} samples"]
+        for name in list(buf.data.keys()):
+            t, v = buf.latest(name)
+            if len(v) == 0:
+                continue
+            last = v[t >= t[-1] - 1.0]
+            lines.append(f"{name:>9} {v[-1]:10.2f}  [{last.min():.2f} .. {last.max():.2f}]")
+        self.tlm_label.configure(text="\n".join(lines))
+        
     def _clear_faults(self):
         """Send fault clear command"""
         if self.modbus.clear_faults():
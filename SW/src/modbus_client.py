@@ -5,8 +5,8 @@ Handles communication with the STM32G474 controller
 
 import struct
 import logging
-from typing import Optional, Dict, Any, Tuple
-from dataclasses import dataclass
+from typing import Optional, Dict, Any, List, Tuple
+from dataclasses import dataclass, field
 from enum import IntEnum
 
 from pymodbus.client import ModbusSerialClient, ModbusTcpClient
@@ -89,6 +89,9 @@ class InverterData:
     efficiency: float = 0.0  # %
     soc: float = 0.0         # %
     
+    # Extended bank: every published value by descriptor name (SI units)
+    ext: Dict[str, float] = field(default_factory=dict)
+    
     # Communication
     connected: bool = False
     last_error: str = ""
@@ -101,12 +104,34 @@ class ModbusClient:
     INPUT_REG_BASE = 0      # Input registers start at address 0 (30001)
     HOLDING_REG_BASE = 0    # Holding registers start at address 0 (40001)
     
+    # Extended bank: 32-bit values (31001+) and their descriptors (32001+)
+    EXT_BASE = 1000
+    DESC_BASE = 2000
+    EXT_VERSION = 2         # Blocks of at most MAX_READ registers
+    EXT_TYPE_U32, EXT_TYPE_I32, EXT_TYPE_F32 = 1, 2, 3
+    MAX_READ = 125          # Registers per FC 04
+    
+    # Runtime parameters: 32-bit values (41001+), descriptors (33001+) and
+    # the store command register (40010)
+    PARAM_BASE = 1000
+    PDESC_BASE = 3000
+    PARAM_CMD_REG = 9
+    PARAM_CMD_SAVE, PARAM_CMD_DEFAULTS, PARAM_CMD_RELOAD = 1, 2, 3
+    
     def __init__(self, config: Dict[str, Any]):
         """Initialize Modbus client with configuration"""
         self.config = config
         self.client: Optional[ModbusSerialClient | ModbusTcpClient] = None
         self.slave_address = config.get('modbus', {}).get('slave_address', 1)
         self.data = InverterData()
+        # Extended layout [(name, offset, type, exponent, unit)], [] = legacy
+        # registers only, None = not discovered yet
+        self.ext_layout: Optional[List[Tuple[str, int, int, int, str]]] = None
+        self.ext_words = 0
+        # Parameter layout {name: (offset, type, unit, min, max)}, None = not
+        # discovered yet
+        self.param_layout: Optional[Dict[str, Tuple[int, int, str, float, float]]] = None
+        self.param_words = 0
         
     def connect(self) -> bool:
         """Establish connection to inverter"""
@@ -132,6 +157,8 @@ class ModbusClient:
             
             connected = self.client.connect()
             self.data.connected = connected
+            self.ext_layout = None
+            self.param_layout = None
             
             if connected:
                 logger.info(f"Connected to inverter via {comm_type}")
@@ -154,12 +181,51 @@ class ModbusClient:
             self.data.connected = False
             logger.info("Disconnected from inverter")
     
+    def discover_extended(self) -> bool:
+        """Read the extended bank descriptors (False: firmware without one)"""
+        self.ext_layout = []
+        result = self.client.read_input_registers(
+            address=self.DESC_BASE, count=4, slave=self.slave_address
+        )
+        if result.isError() or result.registers[0] != self.EXT_VERSION:
+            logger.info("No extended register bank, using 16-bit registers")
+            return False
+        
+        _, entries, entry_words, _ = result.registers
+        per_read = self.MAX_READ // entry_words
+        layout = []
+        for first in range(0, entries, per_read):
+            n = min(per_read, entries - first)
+            result = self.client.read_input_registers(
+                address=self.DESC_BASE + 4 + first * entry_words,
+                count=n * entry_words, slave=self.slave_address
+            )
+            if result.isError():
+                raise ModbusException(f"Descriptor read error: {result}")
+            for k in range(n):
+                e = result.registers[k * entry_words:(k + 1) * entry_words]
+                exponent = struct.unpack('b', bytes([e[1] & 0xFF]))[0]
+                layout.append((self._text(e[4:12]), e[0], e[1] >> 8, exponent, self._text(e[2:4])))
+        
+        self.ext_layout = layout
+        self.ext_words = max(e[1] for e in layout) + 2
+        logger.info(f"Extended register bank: {entries} values")
+        return True
+    
     def read_all(self) -> InverterData:
-        """Read all inverter data"""
+        """Read all inverter data (the extended bank when the firmware has
+        one, else the 16-bit input registers)"""
         if not self.client or not self.data.connected:
             return self.data
             
         try:
+            if self.ext_layout is None:
+                self.discover_extended()
+            if self.ext_layout:
+                self._read_extended()
+                self.data.last_error = ""
+                return self.data
+            
             # Read input registers (30001-30016 = addresses 0-15)
             result = self.client.read_input_registers(
                 address=0, count=16, slave=self.slave_address
@@ -209,10 +275,148 @@ class ModbusClient:
             
         return self.data
     
-    def write_control_word(self, enable: bool, mode: int = 0) -> bool:
-        """Write control word to inverter"""
+    def _read_ext_blocks(self) -> Tuple[List[int], List[int]]:
+        """Read the extended bank block by block, each block header giving
+        its length; return the registers and the blocks' sequence words"""
+        regs, sequences = [], []
+        while len(regs) < self.ext_words:
+            result = self.client.read_input_registers(
+                address=self.EXT_BASE + len(regs),
+                count=min(self.MAX_READ, self.ext_words - len(regs)), slave=self.slave_address
+            )
+            if result.isError():
+                raise ModbusException(f"Read error: {result}")
+            words = result.registers[2]
+            if result.registers[0] != self.EXT_VERSION or not 4 < words <= len(result.registers):
+                raise ModbusException("Extended bank block header mismatch")
+            regs.extend(result.registers[:words])
+            sequences.append(result.registers[3])
+        return regs, sequences
+    
+    def _read_extended(self):
+        """Read the extended bank one block per request and decode every
+        value (re-read once when the blocks come from different updates)"""
+        for _ in range(2):
+            regs, sequences = self._read_ext_blocks()
+            if len(set(sequences)) == 1:
+                break
+        
+        ext = {}
+        for name, offset, vtype, exponent, _ in self.ext_layout:
+            raw = struct.pack('>HH', regs[offset], regs[offset + 1])
+            if vtype == self.EXT_TYPE_F32:
+                ext[name] = struct.unpack('>f', raw)[0]
+            else:
+                value = struct.unpack('>i' if vtype == self.EXT_TYPE_I32 else '>I', raw)[0]
+                ext[name] = value * 10.0 ** exponent if exponent else value
+        self.data.ext = ext
+        
+        status = int(ext.get('status', 0))
+        self.data.state = SystemState(status & 0x000F)
+        self.data.pll_locked = bool(status & 0x0100)
+        self.data.grid_connected = bool(status & 0x0200)
+        self.data.bms_valid = bool(status & 0x0400)
+        self.data.fault_code = int(ext.get('faults', 0))
+        
+        self.data.vdc = ext.get('vdc', 0.0)
+        self.data.idc = ext.get('idc', 0.0)
+        self.data.pdc = ext.get('pdc', 0.0)
+        self.data.vac = ext.get('vab', 0.0)
+        self.data.iac = ext.get('ia', 0.0)
+        self.data.pac = ext.get('pac', 0.0)
+        self.data.qac = ext.get('qac', 0.0)
+        self.data.frequency = ext.get('frequency', 0.0)
+        self.data.power_factor = ext.get('pf', 0.0)
+        self.data.temp_heatsink = ext.get('t_heatsink', 0.0)
+        self.data.temp_mosfet = ext.get('tj_max', 0.0)
+        self.data.efficiency = ext.get('efficiency', 0.0)
+        self.data.soc = ext.get('bms_soc', 0.0)
+    
+    def discover_parameters(self) -> bool:
+        """Read the parameter descriptors (False: firmware without a
+        parameter store)"""
+        self.param_layout = {}
+        result = self.client.read_input_registers(
+            address=self.PDESC_BASE, count=4, slave=self.slave_address
+        )
+        if result.isError():
+            return False
+        
+        _, entries, entry_words, _ = result.registers
+        per_read = self.MAX_READ // entry_words
+        for first in range(0, entries, per_read):
+            n = min(per_read, entries - first)
+            result = self.client.read_input_registers(
+                address=self.PDESC_BASE + 4 + first * entry_words,
+                count=n * entry_words, slave=self.slave_address
+            )
+            if result.isError():
+                raise ModbusException(f"Descriptor read error: {result}")
+            for k in range(n):
+                e = result.registers[k * entry_words:(k + 1) * entry_words]
+                vtype = e[1] >> 8
+                lo, hi = self._decode32(e[12:14], vtype), self._decode32(e[14:16], vtype)
+                self.param_layout[self._text(e[4:12])] = (e[0], vtype, self._text(e[2:4]), lo, hi)
+        
+        self.param_words = 4 + 2 * entries
+        return True
+    
+    def read_parameters(self) -> Dict[str, float]:
+        """Parameters in force, by name ({} without a parameter store)"""
+        if self.param_layout is None:
+            self.discover_parameters()
+        regs = []
+        for first in range(0, self.param_words, self.MAX_READ):
+            result = self.client.read_holding_registers(
+                address=self.PARAM_BASE + first,
+                count=min(self.MAX_READ, self.param_words - first), slave=self.slave_address
+            )
+            if result.isError():
+                raise ModbusException(f"Read error: {result}")
+            regs.extend(result.registers)
+        return {name: self._decode32(regs[offset:offset + 2], vtype)
+                for name, (offset, vtype, _, _, _) in self.param_layout.items()}
+    
+    def write_parameters(self, values: Dict[str, float]) -> bool:
+        """Write parameters, one FC 16 frame each. The inverter applies the
+        set once it passes its cross checks (param_rejects counts refusals)
+        and keeps it until restart unless saved (parameter_command)"""
+        try:
+            if self.param_layout is None:
+                self.discover_parameters()
+            for name, value in values.items():
+                offset, vtype, _, lo, hi = self.param_layout[name]
+                if not lo <= value <= hi:
+                    logger.error(f"{name} = {value} outside [{lo}, {hi}]")
+                    return False
+                raw = struct.pack('>f', value) if vtype == self.EXT_TYPE_F32 else struct.pack('>I', int(value))
+                result = self.client.write_registers(
+                    address=self.PARAM_BASE + offset, values=list(struct.unpack('>HH', raw)),
+                    slave=self.slave_address
+                )
+                if result.isError():
+                    return False
+            return True
+        except Exception as e:
+            logger.error(f"Write error: {e}")
+            return False
+    
+    def parameter_command(self, cmd: int) -> bool:
+        """Parameter store command: PARAM_CMD_SAVE (values in force to
+        flash), PARAM_CMD_DEFAULTS or PARAM_CMD_RELOAD"""
         try:
-            control_word = (0x0001 if enable else 0x0000) | (mode << 4)
+            result = self.client.write_register(
+                address=self.PARAM_CMD_REG, value=cmd, slave=self.slave_address
+            )
+            return not result.isError()
+        except Exception as e:
+            logger.error(f"Write error: {e}")
+            return False
+    
+    def write_control_word(self, enable: bool, mode: int = 0, vdc_control: bool = False) -> bool:
+        """Write control word to inverter (vdc_control: regulate the DC link)"""
+        try:
+            control_word = (0x0001 if enable else 0x0000) | (0x0002 if vdc_control else 0x0000) | (mode << 4)
             result = self.client.write_register(
                 address=0, value=control_word, slave=self.slave_address
             )
@@ -222,14 +426,40 @@ class ModbusClient:
             return False
     
     def write_power_reference(self, p_kw: float, q_kvar: float = 0) -> bool:
-        """Write power references"""
+        """Write power references (one FC 16 frame: P and Q apply together)"""
         try:
             p_100w = int(p_kw * 10)  # Convert kW to 100W units
             q_100var = int(q_kvar * 10)
             
-            self.client.write_register(address=2, value=self._to_unsigned(p_100w), slave=self.slave_address)
-            self.client.write_register(address=3, value=self._to_unsigned(q_100var), slave=self.slave_address)
-            return True
+            result = self.client.write_registers(
+                address=2, values=[self._to_unsigned(p_100w), self._to_unsigned(q_100var)],
+                slave=self.slave_address
+            )
+            return not result.isError()
+        except Exception as e:
+            logger.error(f"Write error: {e}")
+            return False
+    
+    def write_vdc_reference(self, vdc_v: float) -> bool:
+        """Write DC link voltage reference (used with vdc_control)"""
+        try:
+            result = self.client.write_register(
+                address=5, value=int(vdc_v), slave=self.slave_address
+            )
+            return not result.isError()
+        except Exception as e:
+            logger.error(f"Write error: {e}")
+            return False
+    
+    def write_telemetry(self, mask: int, rate_hz: int) -> bool:
+        """Select the binary telemetry signal set and sample rate (40007-40009,
+        one FC 16 frame; rate 0 stops the stream)"""
+        try:
+            result = self.client.write_registers(
+                address=6, values=[mask & 0xFFFF, (mask >> 16) & 0xFFFF, int(rate_hz)],
+                slave=self.slave_address
+            )
+            return not result.isError()
         except Exception as e:
             logger.error(f"Write error: {e}")
             return False
@@ -246,6 +476,18 @@ class ModbusClient:
             logger.error(f"Clear fault error: {e}")
             return False
     
+    @staticmethod
+    def _text(regs: List[int]) -> str:
+        """Descriptor text: two characters per register, high byte first"""
+        raw = b''.join(struct.pack('>H', r) for r in regs)
+        return raw.split(b'\0', 1)[0].decode('ascii', 'replace')
+    
+    @classmethod
+    def _decode32(cls, regs: List[int], vtype: int) -> float:
+        """32-bit value, high word first"""
+        raw = struct.pack('>HH', regs[0], regs[1])
+        return struct.unpack('>f' if vtype == cls.EXT_TYPE_F32 else '>I', raw)[0]
+    
     @staticmethod
     def _to_signed(value: int) -> int:
         """Convert unsigned 16-bit to signed"""
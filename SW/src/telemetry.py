@@ -0,0 +1,306 @@
+"""
+Binary Telemetry Stream Receiver for 120kW Hybrid Inverter
+Decodes the push-mode stream the firmware sends on its own telemetry line
+(USART1, FW/Inc/telemetry.h) into numpy arrays
+
+Frame on the line: 0x00, COBS(frame), 0x00. Frame: version u8, seq u16,
+mask u32, rate u16, first sample index u32, count u8, count samples of one
+zigzag varint per signal (delta to the previous sample, zero base per
+frame), CRC-16/MODBUS. Noise or a partial first frame fails the CRC and is
+skipped.
+
+Usage: python telemetry.py capture.bin [-o out.csv]
+  (capture.bin: raw bytes from the line, or fwsim --telem-out)
+"""
+
+import sys
+import struct
+import logging
+import argparse
+import threading
+from dataclasses import dataclass
+from typing import Callable, Dict, List, Optional, Tuple
+
+import numpy as np
+
+logger = logging.getLogger(__name__)
+
+VERSION = 1
+HEADER_SIZE = 14
+
+# Signal ids (append-only in firmware): name, unit, decimal exponent
+SIGNALS: List[Tuple[str, str, int]] = [
+    ('ia', 'A', -1), ('ib', 'A', -1), ('ic', 'A', -1),
+    ('va', 'V', -1), ('vb', 'V', -1), ('vc', 'V', -1),
+    ('vdc', 'V', -1), ('vdc_pos', 'V', -1), ('vdc_neg', 'V', -1), ('vnp', 'V', -1),
+    ('idc', 'A', -1),
+    ('id', 'A', -1), ('iq', 'A', -1), ('id_ref', 'A', -1), ('iq_ref', 'A', -1),
+    ('vd', 'V', -1), ('vq', 'V', -1), ('vd_ref', 'V', -1), ('vq_ref', 'V', -1),
+    ('pac', 'W', 1), ('qac', 'VAr', 1), ('p_ref', 'W', 1), ('q_ref', 'VAr', 1),
+    ('frequency', 'Hz', -3), ('theta', 'rad', -4),
+    ('duty_a', 'tick', 0), ('duty_b', 'tick', 0), ('duty_c', 'tick', 0),
+]
+SIGNAL_IDS = {name: i for i, (name, _, _) in enumerate(SIGNALS)}
+
+# Signal sets (firmware TLM_SET_*)
+SETS = {
+    'ac': ['ia', 'ib', 'ic', 'va', 'vb', 'vc'],
+    'dc': ['vdc', 'vdc_pos', 'vdc_neg', 'vnp', 'idc'],
+    'dq': ['id', 'iq', 'id_ref', 'iq_ref', 'vd', 'vq', 'vd_ref', 'vq_ref'],
+    'power': ['pac', 'qac', 'p_ref', 'q_ref', 'frequency'],
+    'pwm': ['theta', 'duty_a', 'duty_b', 'duty_c'],
+}
+
+
+def signal_mask(names: List[str]) -> int:
+    """Set mask for holding registers 40007/40008 from signal or set names"""
+    mask = 0
+    for name in names:
+        for sig in SETS.get(name, [name]):
+            mask |= 1 << SIGNAL_IDS[sig]
+    return mask
+
+
+def signal_names(mask: int) -> List[str]:
+    """Signals of a set mask, in frame order"""
+    return [SIGNALS[i][0] for i in range(len(SIGNALS)) if mask & (1 << i)]
+
+
+def crc16(data: bytes) -> int:
+    """CRC-16/MODBUS (poly 0xA001 reflected, init 0xFFFF)"""
+    crc = 0xFFFF
+    for b in data:
+        crc ^= b
+        for _ in range(8):
+            crc = (crc >> 1) ^ 0xA001 if crc & 1 else crc >> 1
+    return crc
+
+
+def cobs_decode(data: bytes) -> Optional[bytes]:
+    """Decode one COBS block (no delimiters); None if malformed"""
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        if code == 0 or i + code > len(data):
+            return None
+        out += data[i + 1:i + code]
+        i += code
+        if code < 0xFF and i < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+@dataclass
+class TelemetryFrame:
+    """One decoded frame: raw integer samples (count × signals)"""
+    seq: int
+    mask: int
+    rate: int
+    index: int
+    raw: np.ndarray
+    
+    @property
+    def names(self) -> List[str]:
+        return signal_names(self.mask)
+    
+    def values(self) -> np.ndarray:
+        """Samples in engineering units (count × signals)"""
+        scale = np.array([10.0 ** SIGNALS[SIGNAL_IDS[n]][2] for n in self.names])
+        return self.raw * scale
+    
+    def times(self) -> np.ndarray:
+        """Sample times from stream start [s]"""
+        return (self.index + np.arange(self.raw.shape[0])) / float(self.rate)
+
+
+def parse_frame(frame: bytes) -> Optional[TelemetryFrame]:
+    """Check and decode a frame after COBS; None on CRC or format error"""
+    if len(frame) < HEADER_SIZE + 2 or crc16(frame[:-2]) != struct.unpack('<H', frame[-2:])[0]:
+        return None
+    version, seq, mask, rate, index, count = struct.unpack('<BHIHIB', frame[:HEADER_SIZE])
+    if version != VERSION or rate == 0:
+        return None
+    
+    n_sig = bin(mask).count('1')
+    raw = np.zeros((count, n_sig), dtype=np.int64)
+    prev = [0] * n_sig
+    pos, end = HEADER_SIZE, len(frame) - 2
+    for k in range(count):
+        for j in range(n_sig):
+            z, shift = 0, 0
+            while True:
+                if pos >= end:
+                    return None
+                b = frame[pos]
+                pos += 1
+                z |= (b & 0x7F) << shift
+                shift += 7
+                if b < 0x80:
+                    break
+            prev[j] += (z >> 1) ^ -(z & 1)
+            prev[j] = (prev[j] + 2**31) % 2**32 - 2**31
+            raw[k, j] = prev[j]
+    return TelemetryFrame(seq, mask, rate, index, raw) if pos == end else None
+
+
+class TelemetryDecoder:
+    """Splits a byte stream at delimiters and decodes frames; counts losses"""
+    
+    def __init__(self):
+        self.buf = bytearray()
+        self.frames = 0
+        self.rejected = 0           # Chunks failing COBS/CRC (noise, partial frame)
+        self.lost_frames = 0        # Sequence gaps
+        self.lost_samples = 0       # Index gaps (firmware ring full)
+        self._seq: Optional[int] = None
+        self._next: Optional[Tuple[int, int, int]] = None   # mask, rate, next index
+    
+    def feed(self, data: bytes) -> List[TelemetryFrame]:
+        """Add line bytes; returns the frames completed by them"""
+        self.buf += data
+        out = []
+        while True:
+            end = self.buf.find(0)
+            if end < 0:
+                break
+            chunk = bytes(self.buf[:end])
+            del self.buf[:end + 1]
+            if not chunk:
+                continue
+            raw = cobs_decode(chunk)
+            frame = parse_frame(raw) if raw is not None else None
+            if frame is None:
+                self.rejected += 1
+                continue
+            self._account(frame)
+            out.append(frame)
+        return out
+    
+    def _account(self, frame: TelemetryFrame):
+        self.frames += 1
+        if self._seq is not None:
+            self.lost_frames += (frame.seq - self._seq - 1) & 0xFFFF
+        self._seq = frame.seq
+        if self._next is not None and self._next[:2] == (frame.mask, frame.rate) and frame.index >= self._next[2]:
+            self.lost_samples += frame.index - self._next[2]
+        self._next = (frame.mask, frame.rate, frame.index + frame.raw.shape[0])
+
+
+class TelemetryBuffer:
+    """Last `seconds` of every signal as numpy ring arrays"""
+    
+    def __init__(self, seconds: float = 10.0, max_samples: int = 200000):
+        self.seconds = seconds
+        self.max_samples = max_samples
+        self.lock = threading.Lock()
+        self.mask = 0
+        self.rate = 0
+        self.t = np.zeros(0)
+        self.data: Dict[str, np.ndarray] = {}
+    
+    def append(self, frame: TelemetryFrame):
+        with self.lock:
+            if (frame.mask, frame.rate) != (self.mask, self.rate):
+                self.mask, self.rate = frame.mask, frame.rate
+                self.t = np.zeros(0)
+                self.data = {n: np.zeros(0) for n in frame.names}
+            keep = min(self.max_samples, int(self.seconds * frame.rate) + 1)
+            values = frame.values()
+            self.t = np.concatenate((self.t, frame.times()))[-keep:]
+            for j, name in enumerate(frame.names):
+                self.data[name] = np.concatenate((self.data[name], values[:, j]))[-keep:]
+    
+    def latest(self, name: str) -> Tuple[np.ndarray, np.ndarray]:
+        """Times and values of one signal (copies)"""
+        with self.lock:
+            return self.t.copy(), self.data.get(name, np.zeros(0)).copy()
+
+
+class TelemetryReceiver:
+    """Reads the stream in a thread from its own serial port: an RS485
+    adapter on the inverter's telemetry line. The Modbus client owns the
+    Modbus port, so the receiver refuses to share it"""
+    
+    def __init__(self, config: Dict, on_frame: Optional[Callable[[TelemetryFrame], None]] = None):
+        tcfg = config.get('telemetry', {})
+        scfg = config.get('communication', {}).get('serial', {})
+        self.port = tcfg.get('port') or ''
+        rtu = config.get('communication', {}).get('type', 'modbus_rtu') == 'modbus_rtu'
+        self.modbus_port = scfg.get('port', 'COM3') if rtu else ''
+        self.baudrate = tcfg.get('baudrate', 921600)
+        self.error = ''
+        self.decoder = TelemetryDecoder()
+        self.buffer = TelemetryBuffer(tcfg.get('history_seconds', 10.0))
+        self.on_frame = on_frame
+        self.running = False
+        self.thread: Optional[threading.Thread] = None
+        self.serial = None
+    
+    def start(self) -> bool:
+        if not self.port:
+            self.error = "telemetry.port is not set (needs its own RS485 adapter)"
+        elif self.port == self.modbus_port:
+            self.error = f"telemetry.port {self.port} is the Modbus port"
+        if self.error:
+            logger.error(self.error)
+            return False
+        import serial
+        try:
+            self.serial = serial.Serial(self.port, self.baudrate, timeout=0.1)
+        except Exception as e:
+            self.error = f"Cannot open telemetry port {self.port}"
+            logger.error(f"Telemetry port {self.port}: {e}")
+            return False
+        self.running = True
+        self.thread = threading.Thread(target=self._worker, daemon=True)
+        self.thread.start()
+        logger.info(f"Telemetry receiver on {self.port}")
+        return True
+    
+    def stop(self):
+        self.running = False
+        if self.thread:
+            self.thread.join(timeout=1.0)
+        if self.serial:
+            self.serial.close()
+    
+    def _worker(self):
+        while self.running:
+            data = self.serial.read(4096)
+            if not data:
+                continue
+            for frame in self.decoder.feed(data):
+                self.buffer.append(frame)
+                if self.on_frame:
+                    self.on_frame(frame)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Decode a telemetry capture to CSV")
+    parser.add_argument('capture', help="raw line bytes (fwsim --telem-out)")
+    parser.add_argument('-o', '--out', help="CSV output (default stdout)")
+    args = parser.parse_args()
+    
+    decoder = TelemetryDecoder()
+    with open(args.capture, 'rb') as f:
+        frames = decoder.feed(f.read())
+    
+    out = open(args.out, 'w') if args.out else sys.stdout
+    names = None
+    for frame in frames:
+        if frame.names != names:
+            names = frame.names
+            out.write('t,' + ','.join(names) + '\n')
+        for t, row in zip(frame.times(), frame.values()):
+            out.write(f"{t:.6f}," + ','.join(f"{v:.4f}" for v in row) + '\n')
+    if out is not sys.stdout:
+        out.close()
+    
+    print(f"frames {decoder.frames}, rejected {decoder.rejected}, lost frames "
+          f"{decoder.lost_frames}, lost samples {decoder.lost_samples}", file=sys.stderr)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())